@@ -4,17 +4,25 @@ resources/speedcrunch.qrc
 
 set(speedcrunch_HEADERS
 core/book.h
+core/completionindex.h
 core/constants.h
+core/dataimport.h
+core/evaluationservice.h
 core/evaluator.h
 core/functions.h
 core/manualserver.h
+core/memoryusage.h
 core/session.h
 core/errors.h
 core/numberformatter.h
 core/pageserver.h
+core/pipelinetrace.h
 core/settings.h
 core/opcode.h
 core/sessionhistory.h
+core/sessionwriter.h
+core/startuptrace.h
+core/taskpool.h
 core/variable.h
 core/userfunction.h
 gui/aboutbox.h
@@ -23,6 +31,7 @@ gui/bookdock.h
 gui/constantswidget.h
 gui/editor.h
 gui/functionswidget.h
+gui/historyexporter.h
 gui/historywidget.h
 gui/genericdock.h
 gui/keypad.h
@@ -32,9 +41,11 @@ gui/resultdisplay.h
 gui/variablelistwidget.h
 gui/userfunctionlistwidget.h
 gui/syntaxhighlighter.h
+gui/treefilter.h
 math/floatcommon.h
 math/floatconfig.h
 math/floatconst.h
+math/floatconstcalc.h
 math/floatconvert.h
 math/floaterf.h
 math/floatexp.h
@@ -57,44 +68,39 @@ math/quantity.h
 math/units.h
 )
 
-set(speedcrunch_SOURCES
-main.cpp
+# The engine: math/ and the parts of core/ that need QtCore only. The GUI,
+# the command-line interface and the tests link to it.
+set(speedcrunch_core_SOURCES
+core/batch.cpp
 core/book.cpp
+core/completionindex.cpp
 core/constants.cpp
+core/dataimport.cpp
+core/evaluationservice.cpp
 core/evaluator.cpp
 core/functions.cpp
-core/manualserver.cpp
+core/memoryusage.cpp
 core/numberformatter.cpp
 core/pageserver.cpp
+core/pipelinetrace.cpp
 core/settings.cpp
 core/session.cpp
 core/sessionhistory.cpp
+core/sessionwriter.cpp
+core/startuptrace.cpp
+core/taskpool.cpp
 core/variable.cpp
 core/userfunction.cpp
 core/opcode.cpp
-gui/aboutbox.cpp
-gui/bitfieldwidget.cpp
-gui/bookdock.cpp
-gui/constantswidget.cpp
-gui/editor.cpp
-gui/functionswidget.cpp
-gui/historywidget.cpp
-# added here explicitly so it shows up in QtCreator
-gui/genericdock.h
-gui/keypad.cpp
-gui/mainwindow.cpp
-gui/manualwindow.cpp
-gui/resultdisplay.cpp
-gui/syntaxhighlighter.cpp
-gui/variablelistwidget.cpp
-gui/userfunctionlistwidget.cpp
 math/floatcommon.c
 math/floatconst.c
+math/floatconstcalc.c
 math/floatconvert.c
 math/floaterf.c
 math/floatexp.c
 math/floatgamma.c
 math/floathmath.c
+math/floatincgamma.c
 math/floatio.c
 math/floatipower.c
 math/floatlog.c
@@ -104,7 +110,6 @@ math/floatnum.c
 math/floatpower.c
 math/floatseries.c
 math/floattrig.c
-math/floatincgamma.c
 math/hmath.cpp
 math/number.c
 math/cmath.cpp
@@ -114,76 +119,51 @@ math/quantity.cpp
 math/units.cpp
 )
 
+set(speedcrunch_SOURCES
+main.cpp
+core/manualserver.cpp
+gui/aboutbox.cpp
+gui/bitfieldwidget.cpp
+gui/bookdock.cpp
+gui/constantswidget.cpp
+gui/editor.cpp
+gui/functionswidget.cpp
+gui/historyexporter.cpp
+gui/historywidget.cpp
+# added here explicitly so it shows up in QtCreator
+gui/genericdock.h
+gui/keypad.cpp
+gui/mainwindow.cpp
+gui/manualwindow.cpp
+gui/resultdisplay.cpp
+gui/syntaxhighlighter.cpp
+gui/treefilter.cpp
+gui/variablelistwidget.cpp
+gui/userfunctionlistwidget.cpp
+)
+
 set(testhmath_SOURCES
-math/floatcommon.c
-math/floatconst.c
-math/floatconvert.c
-math/floaterf.c
-math/floatexp.c
-math/floatgamma.c
-math/floathmath.c
-math/floatio.c
-math/floatipower.c
-math/floatlog.c
-math/floatlogic.c
-math/floatlong.c
-math/floatnum.c
-math/floatpower.c
-math/floatseries.c
-math/floattrig.c
-math/hmath.cpp
-math/number.c
-math/rational.cpp
-math/quantity.cpp
-math/cmath.cpp
-math/units.cpp
-math/cnumberparser.cpp
 tests/testhmath.cpp
 )
 
+set(speedcrunch_cli_SOURCES
+climain.cpp
+cliserver.cpp
+)
+
 set(testevaluator_HEADERS
 core/evaluator.h
 core/functions.h
 )
 
 set(testevaluator_SOURCES
-core/evaluator.cpp
-core/functions.cpp
-core/settings.cpp
-core/userfunction.cpp
-core/session.cpp
-core/sessionhistory.cpp
-core/variable.cpp
-core/numberformatter.cpp
-math/floatcommon.c
-math/floatconst.c
-math/floatconvert.c
-math/floaterf.c
-math/floatexp.c
-math/floatgamma.c
-math/floathmath.c
-math/floatio.c
-math/floatipower.c
-math/floatlog.c
-math/floatlogic.c
-math/floatlong.c
-math/floatnum.c
-math/floatpower.c
-math/floatseries.c
-math/floattrig.c
-math/hmath.cpp
-math/number.c
-math/cmath.cpp
-math/cnumberparser.cpp
-math/rational.cpp
-math/quantity.cpp
-math/units.cpp
 tests/testevaluator.cpp
 )
 
 set(testfloatnum_SOURCES
 math/floatcommon.c
 math/floatconst.c
+math/floatconstcalc.c
 math/floatconvert.c
 math/floaterf.c
 math/floatexp.c
@@ -202,9 +182,10 @@ math/number.c
 tests/testfloatnum.c
 )
 
-set(testcmath_SOURCES
+set(benchfloatnum_SOURCES
 math/floatcommon.c
 math/floatconst.c
+math/floatconstcalc.c
 math/floatconvert.c
 math/floaterf.c
 math/floatexp.c
@@ -219,68 +200,30 @@ math/floatnum.c
 math/floatpower.c
 math/floatseries.c
 math/floattrig.c
-math/hmath.cpp
 math/number.c
-math/cmath.cpp
-math/cnumberparser.cpp
-math/rational.cpp
-math/quantity.cpp
-math/units.cpp
+tests/benchfloatnum.c
+)
+
+set(benchevaluator_SOURCES
+tests/benchevaluator.cpp
+)
+
+set(benchgui_SOURCES
+tests/benchgui.cpp
+)
+
+set(fuzzevaluator_SOURCES
+tests/fuzzevaluator.cpp
+)
+
+set(testcmath_SOURCES
 tests/testcmath.cpp
 )
 
 set(testdmath_SOURCES
-math/floatcommon.c
-math/floatconst.c
-math/floatconvert.c
-math/floaterf.c
-math/floatexp.c
-math/floatgamma.c
-math/floathmath.c
-math/floatio.c
-math/floatipower.c
-math/floatlog.c
-math/floatlogic.c
-math/floatlong.c
-math/floatnum.c
-math/floatpower.c
-math/floatseries.c
-math/floattrig.c
-math/hmath.cpp
-math/number.c
-math/cmath.cpp
-math/cnumberparser.cpp
-math/rational.cpp
-math/quantity.cpp
-math/units.cpp
 tests/testdmath.cpp
 )
 
 set(testser_SOURCES
-core/numberformatter.cpp
-core/settings.cpp
-math/floatcommon.c
-math/floatconst.c
-math/floatconvert.c
-math/floaterf.c
-math/floatexp.c
-math/floatgamma.c
-math/floathmath.c
-math/floatio.c
-math/floatipower.c
-math/floatlog.c
-math/floatlogic.c
-math/floatlong.c
-math/floatnum.c
-math/floatpower.c
-math/floatseries.c
-math/floattrig.c
-math/hmath.cpp
-math/number.c
-math/cmath.cpp
-math/cnumberparser.cpp
-math/rational.cpp
-math/quantity.cpp
-math/units.cpp
 tests/testser.cpp
 )
@@ -0,0 +1,292 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+// The command-line interface: evaluates expressions line by line, from the
+// files given or from the standard input, and writes one line for each to
+// the standard output, or serves them over a local socket. Only QtCore and
+// QtNetwork are used.
+
+#include "cliserver.h"
+#include "core/batch.h"
+#include "core/functions.h"
+#include "core/pipelinetrace.h"
+#include "core/settings.h"
+#include "core/taskpool.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <cstdio>
+
+static int usage(int status)
+{
+    std::fprintf(status ? stderr : stdout,
+                 "Usage: speedcrunch-cli [--format plain|json|csv] [--jobs N]\n"
+                 "                       [--timeout MSECS] [--memory] [--trace TRACE]\n"
+                 "                       [FILE]...\n"
+                 "Evaluates each line of the FILEs, or of the standard input if there\n"
+                 "are none or FILE is -, and writes the results to the standard output.\n"
+                 "Variables, user functions and ans carry over from line to line.\n"
+                 "\n"
+                 "  --jobs N         run each FILE as a script of its own, on a session\n"
+                 "                   of its own, N at a time (0: one per processor);\n"
+                 "                   the output keeps the order of the FILEs\n"
+                 "  --timeout MSECS  let the lines of each FILE take MSECS at most\n"
+                 "  --memory         write the memory the session and the caches take\n"
+                 "                   to the standard error at the end (not with --jobs)\n"
+                 "  --trace TRACE    write how long the stages of the evaluations took\n"
+                 "                   to the file TRACE at the end, as a Chrome trace\n"
+                 "  --serve NAME     answer JSON requests on the local socket NAME\n"
+                 "                   instead, see cliserver.h for the protocol\n"
+                 "\n"
+                 "The exit status is 1 if an expression had an error, 2 if an\n"
+                 "argument was wrong or a file could not be read.\n");
+    return status;
+}
+
+static bool openInput(QFile& input, const QString& name)
+{
+    if (name == "-")
+        return input.open(stdin, QIODevice::ReadOnly);
+    input.setFileName(name);
+    return input.open(QIODevice::ReadOnly);
+}
+
+static bool run(Batch& batch, QFile& input, QTextStream& out)
+{
+    QTextStream in(&input);
+    in.setCodec("UTF-8");
+    while (!in.atEnd()) {
+        const QString result = batch.evaluate(in.readLine());
+        if (!result.isNull()) {
+            out << result << '\n';
+            out.flush();
+        }
+    }
+    return input.error() == QFile::NoError;
+}
+
+// The scripts of a parallel run. Idle workers take the next script that no
+// one has started, and each script's output is kept until all the scripts
+// before it have been written. Each script has a session and an evaluator
+// of its own; the numbers the threads share, like the floatnum constants,
+// are only read, which floatnum allows (see floatnum.h).
+struct ScriptRun {
+    QStringList files;
+    Batch::Format format;
+    int timeLimit;
+    QAtomicInt next;
+
+    QMutex mutex;
+    QWaitCondition finished;
+    QVector<bool> done;
+    QVector<QString> outputs;
+    QVector<int> errors;
+    QVector<bool> readable;
+};
+
+static void runScriptWorker(ScriptRun* scripts)
+{
+    for (;;) {
+        const int i = scripts->next.fetchAndAddRelaxed(1);
+        if (i >= scripts->files.count())
+            return;
+
+        const QString& name = scripts->files.at(i);
+        Batch batch(scripts->format, name);
+        batch.setTimeLimit(scripts->timeLimit);
+        QString output;
+        QTextStream out(&output);
+        if (scripts->format == Batch::Plain)
+            out << "==> " << name << " <==\n";
+        QFile input;
+        const bool readable = openInput(input, name) && ::run(batch, input, out);
+        out.flush();
+
+        QMutexLocker locker(&scripts->mutex);
+        scripts->outputs[i] = output;
+        scripts->errors[i] = batch.errorCount();
+        scripts->readable[i] = readable;
+        scripts->done[i] = true;
+        scripts->finished.wakeAll();
+    }
+}
+
+static int runScripts(const QStringList& files, Batch::Format format, int jobs,
+                      int timeLimit, QTextStream& out)
+{
+    // The singletons the evaluators share are made before they start.
+    Settings::instance();
+    FunctionRepo::instance();
+
+    ScriptRun scripts;
+    scripts.files = files;
+    scripts.format = format;
+    scripts.timeLimit = timeLimit;
+    scripts.done.fill(false, files.count());
+    scripts.outputs.resize(files.count());
+    scripts.errors.fill(0, files.count());
+    scripts.readable.fill(false, files.count());
+
+    const QString header = Batch(format, QStringLiteral("")).header();
+    if (!header.isNull())
+        out << header << '\n';
+
+    // --jobs overrides the setting.
+    TaskGroup::setMaxThreadCount(jobs);
+    TaskGroup group;
+    for (int i = 0; i < qMin(jobs, files.count()); ++i)
+        group.run([&scripts] { runScriptWorker(&scripts); });
+
+    bool failed = false;
+    int errors = 0;
+    for (int i = 0; i < files.count(); ++i) {
+        QString output;
+        {
+            QMutexLocker locker(&scripts.mutex);
+            while (!scripts.done.at(i))
+                scripts.finished.wait(&scripts.mutex);
+            output.swap(scripts.outputs[i]);
+        }
+        out << output;
+        out.flush();
+        errors += scripts.errors.at(i);
+        if (!scripts.readable.at(i)) {
+            std::fprintf(stderr, "speedcrunch-cli: cannot read %s\n", qPrintable(files.at(i)));
+            failed = true;
+        }
+    }
+    group.wait();
+
+    return failed ? 2 : (errors > 0 ? 1 : 0);
+}
+
+static int runBatch(const QStringList& files, Batch::Format format, int timeLimit,
+                    bool memory, QTextStream& out)
+{
+    Batch batch(format);
+    const QString header = batch.header();
+    if (!header.isNull())
+        out << header << '\n';
+
+    bool failed = false;
+    for (const QString& name : files) {
+        QFile input;
+        batch.setTimeLimit(timeLimit);
+        if (!openInput(input, name) || !run(batch, input, out)) {
+            std::fprintf(stderr, "speedcrunch-cli: cannot read %s\n", qPrintable(name));
+            failed = true;
+        }
+    }
+    out.flush();
+
+    if (memory)
+        std::fprintf(stderr, "%s\n", qPrintable(batch.memoryUsage().toText()));
+
+    return failed ? 2 : (batch.errorCount() > 0 ? 1 : 0);
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication application(argc, argv);
+
+    QCoreApplication::setApplicationName("SpeedCrunch");
+    QCoreApplication::setOrganizationDomain("speedcrunch.org");
+
+    Batch::Format format = Batch::Plain;
+    int jobs = -1;
+    int timeLimit = 0;
+    bool memory = false;
+    QString traceFile;
+    QString serverName;
+    QStringList files;
+    QStringList arguments = application.arguments();
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString& argument = arguments.at(i);
+        if (argument == "--help" || argument == "-h")
+            return usage(0);
+        if (argument == "--format" && i + 1 < arguments.count()) {
+            const QString name = arguments.at(++i);
+            if (name == "plain")
+                format = Batch::Plain;
+            else if (name == "json")
+                format = Batch::JsonLines;
+            else if (name == "csv")
+                format = Batch::Csv;
+            else
+                return usage(2);
+        } else if (argument == "--jobs" && i + 1 < arguments.count()) {
+            bool ok;
+            jobs = arguments.at(++i).toInt(&ok);
+            if (!ok || jobs < 0)
+                return usage(2);
+            if (jobs == 0)
+                jobs = QThread::idealThreadCount();
+        } else if (argument == "--timeout" && i + 1 < arguments.count()) {
+            bool ok;
+            timeLimit = arguments.at(++i).toInt(&ok);
+            if (!ok || timeLimit < 0)
+                return usage(2);
+        } else if (argument == "--memory") {
+            memory = true;
+        } else if (argument == "--trace" && i + 1 < arguments.count()) {
+            traceFile = arguments.at(++i);
+        } else if (argument == "--serve" && i + 1 < arguments.count()) {
+            serverName = arguments.at(++i);
+        } else if (argument.startsWith("--"))
+            return usage(2);
+        else
+            files.append(argument);
+    }
+
+    if (!serverName.isNull()) {
+        EvaluationServer server;
+        if (!server.listen(serverName)) {
+            std::fprintf(stderr, "speedcrunch-cli: cannot listen on %s: %s\n",
+                         qPrintable(serverName), qPrintable(server.errorString()));
+            return 2;
+        }
+        return application.exec();
+    }
+
+    if (files.isEmpty())
+        files.append("-");
+
+    if (!traceFile.isNull())
+        PipelineTrace::enable(true);
+
+    QTextStream out(stdout);
+    out.setCodec("UTF-8");
+    int status;
+    if (jobs > 0)
+        status = runScripts(files, format, jobs, timeLimit, out);
+    else
+        status = runBatch(files, format, timeLimit, memory, out);
+
+    if (!traceFile.isNull() && !PipelineTrace::save(traceFile)) {
+        std::fprintf(stderr, "speedcrunch-cli: cannot write %s\n", qPrintable(traceFile));
+        return 2;
+    }
+    return status;
+}
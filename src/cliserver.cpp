@@ -0,0 +1,150 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "cliserver.h"
+
+#include "core/batch.h"
+#include "core/numberformatter.h"
+#include "core/pipelinetrace.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+static const int IdleTrimMsecs = 60 * 1000;
+
+EvaluationServer::EvaluationServer(QObject* parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+    , m_idleTimer(new QTimer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &EvaluationServer::accept);
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IdleTrimMsecs);
+    connect(m_idleTimer, &QTimer::timeout, this, &EvaluationServer::trim);
+}
+
+EvaluationServer::~EvaluationServer()
+{
+    qDeleteAll(m_sessions);
+}
+
+bool EvaluationServer::listen(const QString& name)
+{
+    // A socket left behind by a server that did not shut down cleanly.
+    QLocalServer::removeServer(name);
+    return m_server->listen(name);
+}
+
+QString EvaluationServer::errorString() const
+{
+    return m_server->errorString();
+}
+
+void EvaluationServer::accept()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        m_sessions.insert(socket, new Batch);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket] { read(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] {
+            delete m_sessions.take(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void EvaluationServer::trim()
+{
+    for (Batch* batch : m_sessions)
+        batch->trimMemory();
+}
+
+void EvaluationServer::read(QLocalSocket* socket)
+{
+    m_idleTimer->start();
+    while (socket->canReadLine()) {
+        const QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+        QJsonParseError parseError;
+        const QJsonDocument request = QJsonDocument::fromJson(line, &parseError);
+        QJsonObject response;
+        if (parseError.error != QJsonParseError::NoError || !request.isObject())
+            response["error"] = QStringLiteral("invalid request");
+        else
+            response = respond(socket, request.object());
+        socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+        socket->write("\n");
+    }
+}
+
+QJsonObject EvaluationServer::respond(QLocalSocket* socket, const QJsonObject& request)
+{
+    QJsonObject response;
+    if (request.contains("id"))
+        response["id"] = request["id"];
+
+    Batch*& batch = m_sessions[socket];
+    const QString op = request["op"].toString(QStringLiteral("evaluate"));
+    if (op == "evaluate" || op == "define") {
+        QString line = request["expression"].toString();
+        if (op == "define")
+            line = request["name"].toString() + '=' + line;
+        QString expression, result, error;
+        if (!batch->evaluate(line, expression, result, error))
+            response["error"] = QStringLiteral("empty expression");
+        else if (!error.isNull())
+            response["error"] = error;
+        else
+            response["result"] = result;
+    } else if (op == "variables") {
+        QJsonObject variables;
+        const QList<Variable> list = batch->session().variablesToList();
+        for (const Variable& variable : list) {
+            if (variable.type() == Variable::UserDefined)
+                variables[variable.identifier()] = NumberFormatter::format(variable.value());
+        }
+        response["variables"] = variables;
+    } else if (op == "functions") {
+        QJsonArray functions;
+        const QList<UserFunction> list = batch->session().UserFunctionsToList();
+        for (const UserFunction& function : list) {
+            functions.append(QString(function.name() + '(' + function.arguments().join(';')
+                                     + ")=" + function.expression()));
+        }
+        response["functions"] = functions;
+    } else if (op == "memory") {
+        response["memory"] = batch->memoryUsage().toJson();
+    } else if (op == "trim") {
+        batch->trimMemory();
+    } else if (op == "trace") {
+        if (request.contains("enable")) {
+            PipelineTrace::enable(request["enable"].toBool());
+            PipelineTrace::clear();
+        } else
+            response["trace"] = QJsonDocument::fromJson(PipelineTrace::toChromeTrace()).object();
+        response["enabled"] = PipelineTrace::isEnabled();
+    } else if (op == "reset") {
+        delete batch;
+        batch = new Batch;
+    } else
+        response["error"] = QString("unknown op: " + op);
+    return response;
+}
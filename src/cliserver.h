@@ -0,0 +1,71 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CLISERVER_H
+#define CLISERVER_H
+
+#include <QHash>
+#include <QObject>
+
+class Batch;
+class QJsonObject;
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+// Serves evaluations over a local socket, so that tools do not start a
+// process for each expression. Every connection has a session of its own.
+// Requests and responses are JSON objects, one per line:
+//
+//   {"id": 1, "op": "evaluate", "expression": "x = 6*7"}  ->  {"id": 1, "result": "42"}
+//   {"op": "define", "name": "f(a)", "expression": "a+1"}  ->  {"result": ""}
+//   {"op": "variables"}  ->  {"variables": {"x": "42"}}
+//   {"op": "functions"}  ->  {"functions": ["f(a)=a+1"]}
+//   {"op": "reset"}      ->  {}
+//   {"op": "memory"}     ->  {"memory": {"history": 1234, ..., "total": 56789}}
+//   {"op": "trim"}       ->  {}
+//   {"op": "trace", "enable": true}  ->  {"enabled": true}
+//   {"op": "trace"}      ->  {"enabled": true, "trace": {"traceEvents": [...]}}
+//
+// "memory" gives the bytes the session of the connection and the caches
+// take, see MemoryUsage; "trim" gives back what can be rebuilt. All the
+// sessions are trimmed once no request came for a minute. "trace" turns
+// the PipelineTrace of the server on or off, which starts it afresh, or
+// gets the spans recorded so far as a Chrome trace.
+//
+// A request that fails gets {"error": "..."} instead; "id" is sent back
+// unchanged when given.
+class EvaluationServer : public QObject {
+public:
+    explicit EvaluationServer(QObject* parent = nullptr);
+    ~EvaluationServer();
+
+    bool listen(const QString& name);
+    QString errorString() const;
+
+private:
+    void accept();
+    void trim();
+    void read(QLocalSocket*);
+    QJsonObject respond(QLocalSocket*, const QJsonObject& request);
+
+    QLocalServer* m_server;
+    QTimer* m_idleTimer;
+    QHash<QLocalSocket*, Batch*> m_sessions;
+};
+
+#endif
@@ -0,0 +1,142 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/batch.h"
+
+#include "core/numberformatter.h"
+#include "core/sessionhistory.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+
+// Evaluator messages are meant for a label and may carry markup.
+static QString plainMessage(QString message)
+{
+    static const QRegularExpression tags("<[^>]*>");
+    message.remove(tags);
+    message.replace("&lt;", "<").replace("&gt;", ">").replace("&amp;", "&");
+    return message;
+}
+
+static QString csvField(QString field)
+{
+    if (!field.contains(QRegularExpression("[\",\\r\\n]")))
+        return field;
+    field.replace('"', "\"\"");
+    return '"' + field + '"';
+}
+
+Batch::Batch(Format format, const QString& source)
+    : m_evaluator(&m_session)
+    , m_format(format)
+    , m_source(source)
+    , m_timeLimit(0)
+    , m_lineNumber(0)
+    , m_errorCount(0)
+{
+    m_evaluator.initializeBuiltInVariables();
+}
+
+void Batch::setTimeLimit(int msecs)
+{
+    m_timeLimit = qMax(msecs, 0);
+    m_clock.start();
+}
+
+QString Batch::header() const
+{
+    if (m_format != Csv)
+        return QString();
+    if (m_source.isNull())
+        return QStringLiteral("line,expression,result,error");
+    return QStringLiteral("file,line,expression,result,error");
+}
+
+QString Batch::evaluate(const QString& line)
+{
+    QString expression, result, error;
+    if (!evaluate(line, expression, result, error))
+        return QString();
+    return output(expression, result, error);
+}
+
+bool Batch::evaluate(const QString& line, QString& expression, QString& result,
+                     QString& error)
+{
+    ++m_lineNumber;
+    expression = m_evaluator.autoFix(line);
+    result = QString();
+    error = QString();
+    if (expression.isEmpty())
+        return false;
+
+    if (m_timeLimit > 0) {
+        const qint64 left = m_timeLimit - m_clock.elapsed();
+        if (left <= 0) {
+            ++m_errorCount;
+            error = QStringLiteral("time limit exceeded");
+            return true;
+        }
+        m_evaluator.setTimeout(int(left));
+    }
+
+    m_evaluator.setExpression(expression);
+    Quantity value = m_evaluator.evalUpdateAns();
+    if (m_evaluator.hasError()) {
+        ++m_errorCount;
+        error = plainMessage(m_evaluator.error());
+        return true;
+    }
+
+    // As in the editor, a function definition has no result, and an
+    // expression without one is not kept.
+    if (m_evaluator.isUserFunctionAssign())
+        value = CMath::nan();
+    else if (value.isNan())
+        return true;
+
+    m_session.addHistoryEntry(HistoryEntry(expression, value));
+    if (!value.isNan())
+        result = NumberFormatter::format(value);
+    return true;
+}
+
+QString Batch::output(const QString& expression, const QString& result,
+                      const QString& error) const
+{
+    switch (m_format) {
+    case JsonLines: {
+        QJsonObject json;
+        if (!m_source.isNull())
+            json["file"] = m_source;
+        json["line"] = m_lineNumber;
+        json["expression"] = expression;
+        if (error.isNull())
+            json["result"] = result;
+        else
+            json["error"] = error;
+        return QString::fromUtf8(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    }
+    case Csv:
+        return (m_source.isNull() ? QString() : csvField(m_source) + ',')
+            + QString::number(m_lineNumber) + ',' + csvField(expression) + ','
+            + csvField(result) + ',' + csvField(error);
+    default:
+        return error.isNull() ? result : "error: " + error;
+    }
+}
@@ -0,0 +1,77 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_BATCH_H
+#define CORE_BATCH_H
+
+#include "core/evaluator.h"
+#include "core/memoryusage.h"
+#include "core/session.h"
+
+#include <QElapsedTimer>
+#include <QString>
+
+// Evaluates expressions one after the other as the editor does: variables,
+// user functions and "ans" carry over from one to the next, and every
+// result goes into the history of its own session. Each result is returned as one
+// line of the chosen output format, for the command-line interface.
+class Batch {
+public:
+    enum Format { Plain, JsonLines, Csv };
+
+    // A source names the script in every line of JSON or CSV output, for
+    // scripts that are run side by side.
+    explicit Batch(Format = Plain, const QString& source = QString());
+
+    // The first line to write, null if the format has none.
+    QString header() const;
+    // The line to write for one line of input, null for a blank one.
+    QString evaluate(const QString& line);
+    // The same, giving the expression as evaluated and its formatted result
+    // or error apart. Returns false for a blank line.
+    bool evaluate(const QString& line, QString& expression, QString& result,
+                  QString& error);
+    // Limits the time left for all the expressions still to come, in
+    // milliseconds. Once it is used up, further lines fail. 0 sets no limit.
+    void setTimeLimit(int msecs);
+    // The number of significant digits the expressions are evaluated with,
+    // see Evaluator::setWorkingPrecision.
+    void setWorkingPrecision(int digits) { m_evaluator.setWorkingPrecision(digits); }
+    int errorCount() const { return m_errorCount; }
+    const Session& session() const { return m_session; }
+    // See MemoryUsage.
+    MemoryUsage memoryUsage() const { return MemoryUsage::measure(&m_session, &m_evaluator); }
+    void trimMemory() { MemoryUsage::trim(&m_session, &m_evaluator); }
+
+private:
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    QString output(const QString& expression, const QString& result,
+                   const QString& error) const;
+
+    Session m_session;
+    Evaluator m_evaluator;
+    Format m_format;
+    QString m_source;
+    int m_timeLimit;
+    QElapsedTimer m_clock;
+    int m_lineNumber;
+    int m_errorCount;
+};
+
+#endif
@@ -0,0 +1,129 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#include "core/completionindex.h"
+
+#include <algorithm>
+
+static bool keyLess(const CompletionIndex::Entry& entry, const QString& key)
+{
+    return entry.key < key;
+}
+
+static bool entryLess(const CompletionIndex::Entry& a, const CompletionIndex::Entry& b)
+{
+    if (a.key != b.key)
+        return a.key < b.key;
+    if (a.kind != b.kind)
+        return a.kind < b.kind;
+    return a.name < b.name;
+}
+
+static bool rankLess(const CompletionIndex::Entry& a, const CompletionIndex::Entry& b)
+{
+    if (a.kind != b.kind)
+        return a.kind < b.kind;
+    return a.name < b.name;
+}
+
+void CompletionIndex::addFunctions(const QStringList& names)
+{
+    for (int i = 0; i < names.count(); ++i)
+        insert(names.at(i), BuiltInFunction);
+}
+
+void CompletionIndex::update(const Session* session)
+{
+    QList<Session::Change> changes;
+    if (!session || session != m_session
+        || !session->changesSince(m_changeCount, changes))
+    {
+        rebuild(session);
+        return;
+    }
+
+    for (int i = 0; i < changes.count(); ++i) {
+        const Session::Change& change = changes.at(i);
+        const Kind kind = change.subject == Session::Change::Variables
+            ? SessionVariable : SessionFunction;
+        if (change.kind == Session::Change::Added)
+            insert(change.key, kind);
+        else if (change.kind == Session::Change::Removed)
+            remove(change.key, kind);
+    }
+    m_changeCount = session->changeCount();
+}
+
+QList<CompletionIndex::Entry> CompletionIndex::match(const QString& fragment) const
+{
+    const QString key = fragment.toCaseFolded();
+    QList<Entry> matches;
+    auto i = std::lower_bound(m_entries.constBegin(), m_entries.constEnd(), key, keyLess);
+    for (; i != m_entries.constEnd() && i->key.startsWith(key); ++i)
+        matches.append(*i);
+    std::sort(matches.begin(), matches.end(), rankLess);
+    return matches;
+}
+
+void CompletionIndex::insert(const QString& name, Kind kind)
+{
+    const Entry entry = { name.toCaseFolded(), name, kind };
+    auto i = std::lower_bound(m_entries.begin(), m_entries.end(), entry, entryLess);
+    if (i != m_entries.end() && i->name == name && i->kind == kind)
+        return;
+    m_entries.insert(i, entry);
+}
+
+void CompletionIndex::remove(const QString& name, Kind kind)
+{
+    const Entry entry = { name.toCaseFolded(), name, kind };
+    auto i = std::lower_bound(m_entries.begin(), m_entries.end(), entry, entryLess);
+    if (i != m_entries.end() && i->name == name && i->kind == kind)
+        m_entries.erase(i);
+}
+
+// Sorts everything again rather than inserting the names one at a time,
+// as after loading a session.
+void CompletionIndex::rebuild(const Session* session)
+{
+    QVector<Entry> entries;
+    for (int i = 0; i < m_entries.count(); ++i) {
+        if (m_entries.at(i).kind == BuiltInFunction)
+            entries.append(m_entries.at(i));
+    }
+
+    m_session = session;
+    m_changeCount = 0;
+    if (session) {
+        m_changeCount = session->changeCount();
+        const QList<Variable> variables = session->variablesToList();
+        for (int i = 0; i < variables.count(); ++i) {
+            const QString name = variables.at(i).identifier();
+            const Entry entry = { name.toCaseFolded(), name, SessionVariable };
+            entries.append(entry);
+        }
+        const QList<UserFunction> functions = session->UserFunctionsToList();
+        for (int i = 0; i < functions.count(); ++i) {
+            const QString name = functions.at(i).name();
+            const Entry entry = { name.toCaseFolded(), name, SessionFunction };
+            entries.append(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), entryLess);
+    m_entries = entries;
+}
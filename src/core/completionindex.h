@@ -0,0 +1,62 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#ifndef CORE_COMPLETIONINDEX_H
+#define CORE_COMPLETIONINDEX_H
+
+#include "core/session.h"
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// The names the editor completes, kept sorted by their case-folded form,
+// so that those starting with a fragment are found by binary search.
+// Built-in functions are added once, variables and user functions follow
+// a session through its changes (see Session::changesSince()).
+class CompletionIndex {
+public:
+    // Matches come in this order, those of each kind sorted by name.
+    enum Kind { BuiltInFunction, SessionVariable, SessionFunction };
+
+    struct Entry {
+        QString key;
+        QString name;
+        Kind kind;
+    };
+
+    CompletionIndex() : m_session(nullptr), m_changeCount(0) {}
+
+    void addFunctions(const QStringList& names);
+    // Brings the variables and user functions in line with session.
+    void update(const Session* session);
+    QList<Entry> match(const QString& fragment) const;
+    int count() const { return m_entries.count(); }
+
+private:
+    void insert(const QString& name, Kind);
+    void remove(const QString& name, Kind);
+    void rebuild(const Session* session);
+
+    QVector<Entry> m_entries;
+    const Session* m_session;
+    quint64 m_changeCount;
+};
+
+#endif // CORE_COMPLETIONINDEX_H
@@ -22,6 +22,7 @@
 #include "core/constants.h"
 
 #include "core/numberformatter.h"
+#include "core/startuptrace.h"
 #include "math/hmath.h"
 
 #include <QCoreApplication>
@@ -39,11 +40,29 @@ struct Constants::Private
 {
     QStringList categories;
     QList<Constant> list;
+    bool translated = false;
 
     void populate();
     void retranslateText();
+    void resolve();
 };
 
+// The table is only shown by the constants dock and the completion, so it
+// is built when first asked for, and translated again after a language
+// change only once it is asked for again.
+void Constants::Private::resolve()
+{
+    if (!list.isEmpty() && translated)
+        return;
+    StartupTrace::Phase phase("constants");
+    if (list.isEmpty())
+        populate();
+    if (!translated) {
+        translated = true;
+        retranslateText();
+    }
+}
+
 // UNCERTAINTY  and CHECKEC reserved for future use
 #define PUSH_CONSTANT_CODATA(NAME,VALUE,UNIT,UNCERTAINTY,CHECKED) \
     c.value = QLatin1String(VALUE); \
@@ -776,23 +795,23 @@ Constants::Constants()
     : d(new Constants::Private)
 {
     setObjectName("Constants");
-    d->populate();
-    d->retranslateText();
 }
 
 const QList<Constant>& Constants::list() const
 {
+    d->resolve();
     return d->list;
 }
 
 const QStringList& Constants::categories() const
 {
+    d->resolve();
     return d->categories;
 }
 
 void Constants::retranslateText()
 {
-    d->retranslateText();
+    d->translated = false;
 }
 
 Constants::~Constants()
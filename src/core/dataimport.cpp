@@ -0,0 +1,175 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#include "core/dataimport.h"
+#include "math/hmath.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QPair>
+#include <QVarLengthArray>
+
+#include <cmath>
+#include <cstring>
+
+// A cell without the blanks and quotes around it.
+static void trimCell(const char*& begin, const char*& end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\r'))
+        ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\r'))
+        --end;
+    if (end - begin >= 2 && *begin == '"' && end[-1] == '"') {
+        ++begin;
+        --end;
+    }
+}
+
+// HNumber parses C strings, the cells of the mapped file aren't.
+static HNumber parseCell(const char* begin, const char* end)
+{
+    QVarLengthArray<char, 64> text(int(end - begin) + 1);
+    std::memcpy(text.data(), begin, size_t(end - begin));
+    text[int(end - begin)] = 0;
+    return HNumber(text.constData());
+}
+
+static bool parseText(const char* data, qint64 size, char separator,
+                      QList<DataImport::Column>& columns, QString& error)
+{
+    const char* const last = data + size;
+    const char* line = data;
+    int row = 0;
+    bool first = true;
+    while (line < last) {
+        const char* lineEnd = static_cast<const char*>(
+            std::memchr(line, '\n', size_t(last - line)));
+        if (!lineEnd)
+            lineEnd = last;
+        ++row;
+
+        // The cells of this row, all parsed before any is kept.
+        QVarLengthArray<QPair<const char*, const char*>, 16> cells;
+        for (const char* cell = line; ; ) {
+            const char* cellEnd = static_cast<const char*>(
+                std::memchr(cell, separator, size_t(lineEnd - cell)));
+            if (!cellEnd)
+                cellEnd = lineEnd;
+            const char* begin = cell;
+            const char* end = cellEnd;
+            trimCell(begin, end);
+            cells.append(qMakePair(begin, end));
+            if (cellEnd == lineEnd)
+                break;
+            cell = cellEnd + 1;
+        }
+        line = lineEnd + 1;
+
+        if (cells.count() == 1 && cells.at(0).first == cells.at(0).second)
+            continue;
+        while (columns.count() < cells.count())
+            columns.append(DataImport::Column());
+
+        // The first row names the columns if it isn't all numbers.
+        QVarLengthArray<HNumber, 16> numbers;
+        int bad = -1;
+        for (int i = 0; i < cells.count(); ++i) {
+            const char* begin = cells.at(i).first;
+            const char* end = cells.at(i).second;
+            numbers.append(begin == end ? HNumber() : parseCell(begin, end));
+            if (begin != end && numbers.last().isNan() && bad < 0)
+                bad = i;
+        }
+        const bool heading = bad >= 0 && first;
+        first = false;
+        if (bad >= 0 && !heading) {
+            const char* begin = cells.at(bad).first;
+            const char* end = cells.at(bad).second;
+            error = DataImport::tr("line %1: '%2' is not a number")
+                .arg(row).arg(QString::fromUtf8(begin, int(end - begin)));
+            return false;
+        }
+
+        for (int i = 0; i < cells.count(); ++i) {
+            const char* begin = cells.at(i).first;
+            const char* end = cells.at(i).second;
+            if (heading)
+                columns[i].name = QString::fromUtf8(begin, int(end - begin));
+            else if (begin != end)
+                columns[i].values.append(Quantity(numbers.at(i)));
+        }
+    }
+    return true;
+}
+
+static bool parseDoubles(const char* data, qint64 size,
+                         QList<DataImport::Column>& columns, QString& error)
+{
+    if (size % qint64(sizeof(double)) != 0) {
+        error = DataImport::tr("the size is not a multiple of %1 bytes")
+            .arg(int(sizeof(double)));
+        return false;
+    }
+
+    DataImport::Column column;
+    column.values.reserve(int(size / qint64(sizeof(double))));
+    for (qint64 offset = 0; offset < size; offset += qint64(sizeof(double))) {
+        double value;
+        std::memcpy(&value, data + offset, sizeof(value));
+        // Enough digits to give back the same double.
+        column.values.append(std::isfinite(value)
+            ? Quantity(HNumber(QByteArray::number(value, 'g', 17).constData()))
+            : Quantity(HMath::nan()));
+    }
+    columns.append(column);
+    return true;
+}
+
+bool DataImport::parse(const char* data, qint64 size, Format format,
+                       QList<Column>& columns, QString& error)
+{
+    columns.clear();
+    const bool parsed = format == Doubles
+        ? parseDoubles(data, size, columns, error)
+        : parseText(data, size, format == Csv ? ',' : '\t', columns, error);
+    if (!parsed)
+        columns.clear();
+    return parsed;
+}
+
+bool DataImport::read(const QString& path, Format format,
+                      QList<Column>& columns, QString& error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    if (file.size() == 0) {
+        columns.clear();
+        return true;
+    }
+
+    // Not all files can be mapped, those are read instead.
+    const uchar* mapped = file.map(0, file.size());
+    if (mapped)
+        return parse(reinterpret_cast<const char*>(mapped), file.size(),
+                     format, columns, error);
+    const QByteArray data = file.readAll();
+    return parse(data.constData(), data.size(), format, columns, error);
+}
@@ -0,0 +1,55 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#ifndef CORE_DATAIMPORT_H
+#define CORE_DATAIMPORT_H
+
+#include "math/quantity.h"
+
+#include <QCoreApplication>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// Reads columns of numbers from files too large to go through the editor,
+// such as measurement logs. The file is mapped in memory and parsed in
+// place, each number straight into a Quantity.
+class DataImport {
+    Q_DECLARE_TR_FUNCTIONS(DataImport)
+
+public:
+    // Text with one row per line, the cells separated by commas or by tabs,
+    // or the native doubles of a single column.
+    enum Format { Csv, Tsv, Doubles };
+
+    struct Column {
+        // From the first row when it isn't numbers, else empty.
+        QString name;
+        // Empty cells are left out.
+        QVector<Quantity> values;
+    };
+
+    // Returns false, with the reason in error, if the file can't be read
+    // or has cells that aren't numbers.
+    static bool read(const QString& path, Format, QList<Column>& columns,
+                     QString& error);
+    static bool parse(const char* data, qint64 size, Format,
+                      QList<Column>& columns, QString& error);
+};
+
+#endif // CORE_DATAIMPORT_H
@@ -0,0 +1,243 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/evaluationservice.h"
+
+#include <QMetaObject>
+#include <QSet>
+
+void EvaluationService::Result::apply(Session* session) const
+{
+    for (const Variable& variable : variables)
+        session->addVariable(variable);
+    for (const QString& id : removedVariables)
+        session->removeVariable(id);
+    for (const UserFunction& function : functions)
+        session->addUserFunction(function);
+    for (const QString& name : removedFunctions)
+        session->removeUserFunction(name);
+}
+
+EvaluationService::EvaluationService(QObject* parent)
+    : QObject(parent)
+    , m_running(false)
+    , m_current(0)
+    , m_currentKind(Preview)
+    , m_currentCancelled(false)
+    , m_lastId(0)
+    , m_evaluator(&m_session)
+    , m_group(TaskGroup::Interactive)
+{
+}
+
+EvaluationService::~EvaluationService()
+{
+    cancel();
+    m_group.wait();
+}
+
+int EvaluationService::preview(const QString& expression, const Session& session,
+                               int roughPrecision, int timeout)
+{
+    Job job;
+    job.kind = Preview;
+    job.expression = expression;
+    job.roughPrecision = roughPrecision;
+    job.timeout = timeout;
+    job.snapshot.reset(new Session(session.snapshot()));
+    return submit(job);
+}
+
+int EvaluationService::evaluate(const QString& expression, const Session& session,
+                                int timeout)
+{
+    Job job;
+    job.kind = Evaluation;
+    job.expression = expression;
+    job.roughPrecision = 0;
+    job.timeout = timeout;
+    job.snapshot.reset(new Session(session.snapshot()));
+    return submit(job);
+}
+
+int EvaluationService::submit(Job& job)
+{
+    job.id = ++m_lastId;
+    cancelPreviews();
+    QMutexLocker locker(&m_mutex);
+    m_jobs.append(job);
+    if (!m_running) {
+        m_running = true;
+        m_group.run([this] { work(); });
+    }
+    return job.id;
+}
+
+void EvaluationService::cancelPreviews()
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_jobs.count() - 1; i >= 0; --i) {
+        if (m_jobs.at(i).kind == Preview)
+            m_jobs.removeAt(i);
+    }
+    if (m_current != 0 && m_currentKind == Preview) {
+        m_currentCancelled = true;
+        m_evaluator.cancel();
+    }
+}
+
+void EvaluationService::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_jobs.clear();
+    if (m_current != 0) {
+        m_currentCancelled = m_currentKind == Preview;
+        m_evaluator.cancel();
+    }
+}
+
+bool EvaluationService::isBusy(Kind kind) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_current != 0 && m_currentKind == kind)
+        return true;
+    for (const Job& job : m_jobs) {
+        if (job.kind == kind)
+            return true;
+    }
+    return false;
+}
+
+void EvaluationService::waitForDone()
+{
+    m_group.wait();
+    deliver();
+}
+
+void EvaluationService::deliver()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&m_mutex);
+        results.swap(m_results);
+    }
+    for (const Result& result : results)
+        emit finished(result);
+}
+
+// Runs the jobs until none is left. Only one worker runs it at a time.
+void EvaluationService::work()
+{
+    for (;;) {
+        Job job;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_jobs.isEmpty()) {
+                m_current = 0;
+                m_running = false;
+                return;
+            }
+            job = m_jobs.takeFirst();
+            m_current = job.id;
+            m_currentKind = job.kind;
+            m_currentCancelled = false;
+        }
+        run(job);
+    }
+}
+
+void EvaluationService::run(Job& job)
+{
+    // The old contents of the session go with the snapshot.
+    m_session.adopt(*job.snapshot);
+    job.snapshot.clear();
+    const quint64 changes = m_session.changeCount();
+
+    Result result;
+    result.id = job.id;
+    result.kind = job.kind;
+    result.expression = job.expression;
+    m_evaluator.setTimeout(job.timeout);
+    m_evaluator.setExpression(job.expression);
+    if (job.kind == Preview) {
+        result.value = m_evaluator.evalPreview(job.roughPrecision);
+        result.rough = m_evaluator.isPreviewRough();
+    } else {
+        result.value = m_evaluator.evalUpdateAns();
+    }
+    result.error = m_evaluator.error();
+    result.userFunctionAssign = m_evaluator.isUserFunctionAssign();
+
+    if (job.kind == Evaluation) {
+        // The last values of what changed; an evaluation changes far fewer
+        // than the session keeps track of.
+        QList<Session::Change> list;
+        m_session.changesSince(changes, list);
+        QSet<QString> variables, functions;
+        for (const Session::Change& change : list) {
+            if (change.subject == Session::Change::Variables)
+                variables.insert(change.key);
+            else
+                functions.insert(change.key);
+        }
+        for (const QString& id : variables) {
+            if (const Variable* variable = m_session.findVariable(id))
+                result.variables.append(*variable);
+            else
+                result.removedVariables.append(id);
+        }
+        for (const QString& name : functions) {
+            if (m_session.hasUserFunction(name)) {
+                UserFunction function = *m_session.getUserFunction(name);
+                function.bindings = IdentifierBindings();
+                function.memo = UserFunction::Memo();
+                result.functions.append(function);
+            } else {
+                result.removedFunctions.append(name);
+            }
+        }
+    }
+    publish(result);
+
+    // A refinement that fails or takes too long leaves the rough result.
+    if (result.rough && !isCancelled()) {
+        result.value = m_evaluator.evalPreview();
+        result.rough = false;
+        if (!m_evaluator.hasError())
+            publish(result);
+    }
+    m_evaluator.setTimeout(0);
+}
+
+bool EvaluationService::isCancelled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_currentCancelled;
+}
+
+// Results of a cancelled preview are dropped, it was asked for again or is
+// no longer needed.
+void EvaluationService::publish(const Result& result)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_currentCancelled)
+            return;
+        m_results.append(result);
+    }
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
@@ -0,0 +1,141 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_EVALUATIONSERVICE_H
+#define CORE_EVALUATIONSERVICE_H
+
+#include "core/evaluator.h"
+#include "core/session.h"
+#include "core/taskpool.h"
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+// Evaluates expressions on a worker thread of the task pool, so that a slow
+// one does not hold up the user interface, and hands the results over in
+// finished() on the thread that made the service. The jobs run one after
+// the other, each on a snapshot of the session taken when it was asked for
+// (see Session::snapshot()); the session itself is only changed by
+// Result::apply(). A new job cancels the previews not finished yet, whose
+// results are dropped. The worker reads the settings as they are, so they
+// should not change while a job runs.
+class EvaluationService : public QObject {
+    Q_OBJECT
+
+public:
+    enum Kind {
+        // Evaluator::evalPreview(): nothing is assigned, "ans" included.
+        Preview,
+        // Evaluator::evalUpdateAns().
+        Evaluation
+    };
+
+    struct Result {
+        Result() : id(0), kind(Preview), rough(false), userFunctionAssign(false) { }
+
+        // Makes the changes the evaluation made to its snapshot in the
+        // session, see Evaluator::eval().
+        void apply(Session*) const;
+
+        int id;
+        Kind kind;
+        QString expression;
+        Quantity value;
+        QString error;
+        // A preview computed with fewer digits, which the one at the full
+        // precision follows with the same id, unless that one fails.
+        bool rough;
+        bool userFunctionAssign;
+        // What the evaluation assigned or removed, "ans" included.
+        QList<Variable> variables;
+        QStringList removedVariables;
+        QList<UserFunction> functions;
+        QStringList removedFunctions;
+    };
+
+    explicit EvaluationService(QObject* parent = nullptr);
+    // Cancels the jobs and waits for the running one.
+    ~EvaluationService();
+
+    // Both return the id of the results to come. The timeout is in
+    // milliseconds, 0 lets the job run to the end. A preview with a rough
+    // precision is computed with that many digits first, see
+    // Evaluator::evalPreview().
+    int preview(const QString& expression, const Session&,
+                int roughPrecision = 0, int timeout = 0);
+    int evaluate(const QString& expression, const Session&, int timeout = 0);
+    // Drops the previews, a running one stops at the next opportunity.
+    void cancelPreviews();
+    // The same for all the jobs. A cancelled evaluation still reports its
+    // error.
+    void cancel();
+    // Whether a job of the kind is queued or running.
+    bool isBusy(Kind) const;
+    // Waits until no job is left and hands over their results, for those
+    // that cannot wait for the event loop.
+    void waitForDone();
+
+signals:
+    void finished(const EvaluationService::Result&);
+
+private slots:
+    void deliver();
+
+private:
+    Q_DISABLE_COPY(EvaluationService)
+
+    struct Job {
+        int id;
+        Kind kind;
+        QString expression;
+        int roughPrecision;
+        int timeout;
+        QSharedPointer<Session> snapshot;
+    };
+
+    int submit(Job&);
+    void work();
+    void run(Job&);
+    void publish(const Result&);
+    // Whether the running job was cancelled, see cancelPreviews().
+    bool isCancelled() const;
+
+    // Shared with the worker.
+    mutable QMutex m_mutex;
+    QList<Job> m_jobs;
+    QList<Result> m_results;
+    bool m_running;
+    int m_current;
+    Kind m_currentKind;
+    bool m_currentCancelled;
+
+    // The thread of the service only.
+    int m_lastId;
+
+    // The worker only. The session keeps its address from one job to the
+    // next, so that the evaluator can tell its revisions apart.
+    Session m_session;
+    Evaluator m_evaluator;
+    // Last, so that it waits for the worker before the rest goes.
+    TaskGroup m_group;
+};
+
+#endif // CORE_EVALUATIONSERVICE_H
@@ -23,14 +23,29 @@
 // Boston, MA 02110-1301, USA.
 
 #include "core/evaluator.h"
+#include "core/pipelinetrace.h"
 #include "core/session.h"
 #include "core/settings.h"
+#include "math/floatnum.h"
+#include "math/hmath.h"
+#include "math/number.h"
 #include "math/rational.h"
 #include "math/units.h"
 
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QMutex>
 #include <QRegularExpression>
+#include <QSet>
 #include <QStack>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <utility>
 
 #define ALLOW_IMPLICIT_MULT
 
@@ -56,6 +71,114 @@ static void s_deleteEvaluator()
     delete s_evaluatorInstance;
 }
 
+// Scopes a bc_num arena around one evaluation: the temporaries of the
+// expression are bump-allocated and released together, and whatever is
+// still referenced when the scope closes is copied to the heap.
+class NumberArenaScope {
+public:
+    NumberArenaScope() { bc_arena_begin(); }
+    ~NumberArenaScope() { bc_arena_end(); }
+private:
+    NumberArenaScope(const NumberArenaScope&) = delete;
+    NumberArenaScope& operator=(const NumberArenaScope&) = delete;
+};
+
+// Applies the working precision of an evaluation to HMath and restores
+// the previous one when the scope closes.
+class WorkingPrecisionScope {
+public:
+    WorkingPrecisionScope(int prec) : m_save(HMath::setWorkingPrecision(prec)) { }
+    ~WorkingPrecisionScope() { HMath::setWorkingPrecision(m_save); }
+private:
+    int m_save;
+    WorkingPrecisionScope(const WorkingPrecisionScope&) = delete;
+    WorkingPrecisionScope& operator=(const WorkingPrecisionScope&) = delete;
+};
+
+// Arms the cancellation of an evaluation: starts the timeout and lets
+// the long running loops of floatnum poll the evaluator.
+class Evaluator::CancellationScope {
+public:
+    CancellationScope(Evaluator* evaluator)
+    {
+        evaluator->m_cancelled = false;
+        evaluator->m_timer.start();
+        float_setcancelcheck(check, evaluator);
+    }
+    ~CancellationScope() { float_setcancelcheck(nullptr, nullptr); }
+private:
+    static int check(void* evaluator)
+    {
+        return static_cast<Evaluator*>(evaluator)->isCancelled();
+    }
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+};
+
+// Sets the work and memory budgets of the evaluator for what the scope
+// covers. floatnum enforces them, see float_setbudget().
+class Evaluator::BudgetScope {
+public:
+    BudgetScope(const Evaluator* evaluator)
+    {
+        float_setbudget(long(qMin<qint64>(evaluator->m_workBudget, LONG_MAX)),
+                        evaluator->m_memoryBudget);
+    }
+    ~BudgetScope() { float_setbudget(0, 0); }
+private:
+    BudgetScope(const BudgetScope&) = delete;
+    BudgetScope& operator=(const BudgetScope&) = delete;
+};
+
+// Counts a run of what the scope covers in a profile entry, if not null.
+class ProfileScope {
+public:
+    ProfileScope(Evaluator::ProfileEntry* entry) : m_entry(entry)
+    {
+        if (m_entry)
+            m_timer.start();
+    }
+    ~ProfileScope()
+    {
+        if (m_entry) {
+            ++m_entry->count;
+            m_entry->nsecs += m_timer.nsecsElapsed();
+        }
+    }
+private:
+    Evaluator::ProfileEntry* m_entry;
+    QElapsedTimer m_timer;
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// Counts the numbers allocated by one evaluation into the profile.
+class AllocationScope {
+public:
+    AllocationScope(Evaluator::Profile* profile) : m_profile(profile)
+    {
+        if (m_profile) {
+            bc_alloc_stats stats;
+            bc_get_alloc_stats(&stats);
+            m_allocations = stats.allocations;
+        }
+    }
+    ~AllocationScope()
+    {
+        if (m_profile) {
+            bc_alloc_stats stats;
+            bc_get_alloc_stats(&stats);
+            ++m_profile->evaluations;
+            m_profile->numberAllocations += stats.allocations - m_allocations;
+        }
+    }
+private:
+    Evaluator::Profile* m_profile;
+    long m_allocations;
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+};
+
 bool isMinus(const QChar& ch)
 {
     return ch == QLatin1Char('-') || ch == QChar(0x2212);
@@ -82,48 +205,30 @@ const Quantity& Evaluator::checkOperatorResult(const Quantity& n)
     switch (n.error()) {
     case Success: break;
     case NoOperand:
-        if (!m_assignFunc)
-            // The arguments are still NaN, so ignore this error.
-            m_error = Evaluator::tr("cannot operate on a NaN");
-        break;
+    case DimensionMismatch:
+        // The arguments are still NaN while assigning a function, and we
+        // cannot make any assumptions about their dimension, so ignore
+        // these errors then.
+        if (m_assignFunc)
+            break;
+        // Fall through.
     case Underflow:
-        m_error = Evaluator::tr("underflow - tiny result is out "
-                                "of SpeedCrunch's number range");
-        break;
     case Overflow:
-        m_error = Evaluator::tr("overflow - huge result is out of "
-                                "SpeedCrunch's number range");
-        break;
     case ZeroDivide:
-        m_error = Evaluator::tr("division by zero");
-        break;
     case OutOfLogicRange:
-        m_error = Evaluator::tr("overflow - logic result exceeds "
-                                "maximum of 256 bits");
-        break;
     case OutOfIntegerRange:
-        m_error = Evaluator::tr("overflow - integer result exceeds "
-                                "maximum limit for integers");
-        break;
-    case TooExpensive:
-        m_error = Evaluator::tr("too time consuming - "
-                                "computation was rejected");
-        break;
-    case DimensionMismatch:
-        // We cannot make any assumptions about the dimension of the arguments,
-        // so ignore this error when assigning a function.
-        if (!m_assignFunc)
-            m_error = Evaluator::tr("dimension mismatch - quantities with "
-                                    "different dimensions cannot be "
-                                    "compared, added, etc.");
-        break;
     case InvalidDimension:
-        m_error = Evaluator::tr("invalid dimension - operation might "
-                                "require dimensionless arguments");
-        break;
     case EvalUnstable:
-        m_error = Evaluator::tr("Computation aborted - encountered "
-                                "numerical instability");
+        m_error = Failure(Failure::OperatorError);
+        m_error.code = n.error();
+        break;
+    case TooExpensive:
+        if (isCancelled())
+            m_error = Failure(Failure::Cancelled);
+        else {
+            m_error = Failure(Failure::OperatorError);
+            m_error.code = TooExpensive;
+        }
         break;
     default:;
     }
@@ -131,14 +236,52 @@ const Quantity& Evaluator::checkOperatorResult(const Quantity& n)
     return n;
 }
 
-QString Evaluator::stringFromFunctionError(Function* function)
+static QString stringFromOperatorError(Error error)
+{
+    switch (error) {
+    case NoOperand:
+        return Evaluator::tr("cannot operate on a NaN");
+    case Underflow:
+        return Evaluator::tr("underflow - tiny result is out "
+                             "of SpeedCrunch's number range");
+    case Overflow:
+        return Evaluator::tr("overflow - huge result is out of "
+                             "SpeedCrunch's number range");
+    case ZeroDivide:
+        return Evaluator::tr("division by zero");
+    case OutOfLogicRange:
+        return Evaluator::tr("overflow - logic result exceeds "
+                             "maximum of 256 bits");
+    case OutOfIntegerRange:
+        return Evaluator::tr("overflow - integer result exceeds "
+                             "maximum limit for integers");
+    case TooExpensive:
+        return Evaluator::tr("too time consuming - "
+                             "computation was rejected");
+    case DimensionMismatch:
+        return Evaluator::tr("dimension mismatch - quantities with "
+                             "different dimensions cannot be "
+                             "compared, added, etc.");
+    case InvalidDimension:
+        return Evaluator::tr("invalid dimension - operation might "
+                             "require dimensionless arguments");
+    case EvalUnstable:
+        return Evaluator::tr("Computation aborted - encountered "
+                             "numerical instability");
+    default:
+        return QString();
+    }
+}
+
+QString Evaluator::stringFromFunctionError(const Function* function,
+                                           Error error)
 {
-    if (!function->error())
+    if (!error)
         return QString();
 
     QString result = QString::fromLatin1("<b>%1</b>: ");
 
-    switch (function->error()) {
+    switch (error) {
     case Success: break;
     case InvalidParamCount:
         result += Evaluator::tr("wrong number of arguments");
@@ -372,9 +515,9 @@ Token& Token::operator=(const Token& token)
 
 Quantity Token::asNumber() const
 {
-    QString text = m_text;
-    return isNumber() ? Quantity(CNumber((const char*)text.toLatin1()))
-                      : Quantity(0);
+    return isNumber()
+        ? Quantity(CNumber(HMath::parse(m_text.constData(), m_text.size())))
+        : Quantity(0);
 }
 
 Token::Operator Token::asOperator() const
@@ -627,7 +770,8 @@ bool Evaluator::isRadixChar(const QChar& ch)
 bool Evaluator::isSeparatorChar(const QChar& ch)
 {
     // Match everything that is not alphanumeric or an operator or NUL.
-    static const QRegExp s_separatorRE(
+    // QRegExp keeps the state of the last match, hence one per thread.
+    static thread_local const QRegExp s_separatorRE(
         "[^a-zA-Z0-9\\+\\-−\\*×⋅÷/\\^;\\(\\)%!=\\\\&\\|<>\\?#\\x0000]"
     );
 
@@ -658,6 +802,10 @@ QString Evaluator::fixNumberRadix(const QString& number)
         }
     }
 
+    // A single dot is already the radix point, share the text as it is.
+    if (commaCount == 0 && dotCount <= 1 && !number.isNull())
+        return number;
+
     // Decide which radix characters to ignore based on their occurence count.
     bool ignoreDot = dotCount != 1;
     bool ignoreComma = commaCount != 1;
@@ -676,6 +824,7 @@ QString Evaluator::fixNumberRadix(const QString& number)
 
     // Second pass: write the result.
     QString result = "";
+    result.reserve(number.size());
     for (int i = 0 ; i < number.size() ; ++i) {
         QChar c = number[i];
         if (isRadixChar(c)) {
@@ -688,15 +837,21 @@ QString Evaluator::fixNumberRadix(const QString& number)
     return result;
 }
 
-HNumber getNumber(const QString& number) {
-    if (number.size() == 0)
-        return HNumber(0);
-    int endPos = number.indexOf(QRegExp("['\":]"));
+// Helper function: parse the digits up to the next sexagesimal mark.
+static HNumber getNumber(const QString& number)
+{
+    int endPos = 0;
+    while (endPos < number.size()) {
+        const QChar c = number.at(endPos);
+        if (c == '\'' || c == '"' || c == ':')
+            break;
+        ++endPos;
+    }
     if (endPos == 0)
         return HNumber(0);
-    if (endPos > 0)
-        return HNumber(Evaluator::fixNumberRadix(number.left(endPos)).toStdString().c_str());
-    return HNumber(Evaluator::fixNumberRadix(number).toStdString().c_str());
+    const QString digits = Evaluator::fixNumberRadix(
+        endPos < number.size() ? number.left(endPos) : number);
+    return HMath::parse(digits.constData(), digits.size());
 }
 
 QString Evaluator::fixSexagesimal(const QString& number, QString& unit)
@@ -804,7 +959,7 @@ QString Evaluator::fixSexagesimal(const QString& number, QString& unit)
             return bad;
         if (!minutes.isZero() && !mains.isInteger())
             return bad;
-        int dotNumber = number.lastIndexOf(QRegExp("[.,]"));
+        int dotNumber = qMax(number.lastIndexOf('.'), number.lastIndexOf(','));
         if (dotNumber >= 0) {  // append decimals, remove possible postfix units
             int minPos = number.indexOf('\''), secPos = number.indexOf('"');
             int unitPos = (secPos >= 0 && secPos < minPos) ? secPos : minPos;
@@ -820,6 +975,11 @@ QString Evaluator::fixSexagesimal(const QString& number, QString& unit)
     return result;
 }
 
+/**
+ * Returns the evaluator of the application, the one working on the
+ * current session. Other instances can be created for work that must not
+ * disturb its state; each one is meant to be used by a single thread.
+ */
 Evaluator* Evaluator::instance()
 {
     if (!s_evaluatorInstance) {
@@ -829,11 +989,67 @@ Evaluator* Evaluator::instance()
     return s_evaluatorInstance;
 }
 
+// Compiled expressions kept for re-evaluation, see compileExpression().
+static const int CompiledExpressionCacheSize = 4096;
+static const int LiteralCacheSize = 1024;
+// Results kept per user function, see execUserFunction().
+static const int UserFunctionMemoSize = 64;
+// Multiplications a builtin function or a power takes, roughly, see
+// estimateCost().
+static const int FunctionCost = 64;
+
+/**
+ * Creates an evaluator with a session of its own, holding the builtin
+ * variables.
+ */
 Evaluator::Evaluator()
+    : m_stackDepth(-1)
+    , m_compiledExpressions(CompiledExpressionCacheSize)
+    , m_compiledSession(nullptr)
+    , m_compiledRevision(0)
+    , m_literals(LiteralCacheSize)
+    , m_previewSession(nullptr)
+    , m_previewRevision(0)
+    , m_cancelled(false)
+    , m_timeout(0)
+    , m_workBudget(0)
+    , m_memoryBudget(0)
+    , m_profiling(false)
+    , m_previewRough(false)
 {
     reset();
 }
 
+/**
+ * Creates an evaluator working on an existing session, e.g. the one of
+ * instance(). Evaluating assignments modifies the session, so while an
+ * evaluator runs on another thread the session must not be modified
+ * elsewhere, and the evaluator should only be given expressions without
+ * assignments.
+ */
+Evaluator::Evaluator(Session* session)
+    : m_stackDepth(-1)
+    , m_compiledExpressions(CompiledExpressionCacheSize)
+    , m_compiledSession(nullptr)
+    , m_compiledRevision(0)
+    , m_literals(LiteralCacheSize)
+    , m_previewSession(nullptr)
+    , m_previewRevision(0)
+    , m_cancelled(false)
+    , m_timeout(0)
+    , m_workBudget(0)
+    , m_memoryBudget(0)
+    , m_profiling(false)
+    , m_previewRough(false)
+{
+    clearState();
+    m_session = session;
+}
+
+Evaluator::~Evaluator()
+{
+}
+
 #define ADD_UNIT(name) \
     setVariable(QString::fromUtf8(#name), Units::name(), Variable::BuiltIn)
 
@@ -904,7 +1120,7 @@ bool Evaluator::isValid()
 {
     if (m_dirty) {
         Tokens tokens = scan(m_expression);
-        if (!tokens.valid())
+        if (tokens.valid())
             compile(tokens);
         else
             m_valid = false;
@@ -913,6 +1129,13 @@ bool Evaluator::isValid()
 }
 
 void Evaluator::reset()
+{
+    clearState();
+    m_session = nullptr;
+    initializeBuiltInVariables();
+}
+
+void Evaluator::clearState()
 {
     m_expression = QString();
     m_dirty = true;
@@ -923,10 +1146,22 @@ void Evaluator::reset()
     m_assignId = QString();
     m_assignFunc = false;
     m_assignArg.clear();
-    m_session = nullptr;
+    m_workingPrecision = 0;
     m_functionsInUse.clear();
+    m_compiledExpressions.clear();
+}
 
-    initializeBuiltInVariables();
+/**
+ * The value of a number token. Each literal text is parsed once, the
+ * compiled expressions then share its digits.
+ */
+const Quantity& Evaluator::literal(const Token& token)
+{
+    if (Quantity* cached = m_literals.object(token.text()))
+        return *cached;
+    Quantity* value = new Quantity(token.asNumber());
+    m_literals.insert(token.text(), value);
+    return *value;
 }
 
 void Evaluator::setSession(Session* s)
@@ -939,15 +1174,221 @@ const Session* Evaluator::session()
     return m_session;
 }
 
+// Sets the number of significant digits expressions are evaluated with
+// by this evaluator. 0 falls back to the precision of the session, and
+// then to HMath::defaultWorkingPrecision().
+void Evaluator::setWorkingPrecision(int prec)
+{
+    m_workingPrecision = prec > 0 ? prec : 0;
+}
+
+int Evaluator::workingPrecision() const
+{
+    if (m_workingPrecision > 0)
+        return m_workingPrecision;
+    if (m_session && m_session->workingPrecision() > 0)
+        return m_session->workingPrecision();
+    return HMath::defaultWorkingPrecision();
+}
+
+// Limits each evaluation to the given number of milliseconds, after which
+// it fails with "evaluation cancelled". 0 lets evaluations run to the end.
+void Evaluator::setTimeout(int msecs)
+{
+    m_timeout = qMax(msecs, 0);
+}
+
+int Evaluator::timeout() const
+{
+    return m_timeout;
+}
+
+/**
+ * Asks the running evaluation to stop at the next opportunity. It may be
+ * called from any thread, e.g. from a watchdog, while the evaluator is busy.
+ * Evaluations started afterwards are not affected.
+ */
+void Evaluator::cancel()
+{
+    m_cancelled = true;
+}
+
+bool Evaluator::isCancelled() const
+{
+    if (m_cancelled)
+        return true;
+    return m_timeout > 0 && m_timer.isValid() && m_timer.hasExpired(m_timeout);
+}
+
+/**
+ * Limits the work of each evaluation. A unit is about one digit operation:
+ * a multiplication at the working precision costs its square. Expressions
+ * estimated to take more are rejected before they run, the others fail
+ * once they have used it up, with "too time consuming". 0, the default,
+ * sets no limit.
+ */
+void Evaluator::setWorkBudget(qint64 units)
+{
+    m_workBudget = qMax<qint64>(units, 0);
+}
+
+qint64 Evaluator::workBudget() const
+{
+    return m_workBudget;
+}
+
+/**
+ * Limits the numbers an evaluation may hold at once, which bounds the
+ * memory it takes: a number has at most as many bytes as digits. 0, the
+ * default, sets no limit.
+ */
+void Evaluator::setMemoryBudget(int numbers)
+{
+    m_memoryBudget = qMax(numbers, 0);
+}
+
+int Evaluator::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+/**
+ * Turns on counting how often and how long each opcode, builtin function
+ * and user function runs, and how many numbers the evaluations allocate.
+ * The counters add up until resetProfile().
+ */
+void Evaluator::setProfiling(bool enabled)
+{
+    m_profiling = enabled;
+}
+
+bool Evaluator::isProfiling() const
+{
+    return m_profiling;
+}
+
+const Evaluator::Profile& Evaluator::profile() const
+{
+    return m_profile;
+}
+
+void Evaluator::resetProfile()
+{
+    m_profile = Profile();
+}
+
+static QString opcodeName(Opcode::Type type)
+{
+    switch (type) {
+        case Opcode::Nop: return "Nop";
+        case Opcode::Load: return "Load";
+        case Opcode::Ref: return "Ref";
+        case Opcode::Function: return "Function";
+        case Opcode::Add: return "Add";
+        case Opcode::Sub: return "Sub";
+        case Opcode::Neg: return "Neg";
+        case Opcode::Mul: return "Mul";
+        case Opcode::Div: return "Div";
+        case Opcode::Pow: return "Pow";
+        case Opcode::Fact: return "Fact";
+        case Opcode::Modulo: return "Modulo";
+        case Opcode::IntDiv: return "IntDiv";
+        case Opcode::LSh: return "LSh";
+        case Opcode::RSh: return "RSh";
+        case Opcode::BAnd: return "BAnd";
+        case Opcode::BOr: return "BOr";
+        case Opcode::Conv: return "Conv";
+        case Opcode::Arg: return "Arg";
+        case Opcode::Sqr: return "Sqr";
+        case Opcode::Unit: return "Unit";
+        case Opcode::Range: return "Range";
+        case Opcode::Counter: return "Counter";
+        case Opcode::Store: return "Store";
+        case Opcode::Recall: return "Recall";
+        default: return "Unknown";
+    }
+}
+
+static QString profileLine(const QString& name,
+                           const Evaluator::ProfileEntry& entry)
+{
+    return QString("    %1: %2 in %3 ms\n").arg(name).arg(entry.count)
+        .arg(entry.nsecs / 1e6, 0, 'f', 3);
+}
+
+// Lists the profile, the way dump() lists the program.
+QString Evaluator::profileReport() const
+{
+    QString result = QString("Profile: %1 evaluations, %2 number allocations\n")
+        .arg(m_profile.evaluations).arg(m_profile.numberAllocations);
+
+    result.append("  Opcodes:\n");
+    for (auto i = m_profile.opcodes.constBegin();
+         i != m_profile.opcodes.constEnd(); ++i)
+        result.append(profileLine(opcodeName(i.key()), i.value()));
+
+    result.append("\n");
+    result.append("  Functions:\n");
+    for (auto i = m_profile.functions.constBegin();
+         i != m_profile.functions.constEnd(); ++i)
+        result.append(profileLine(i.key(), i.value()));
+
+    result.append("\n");
+    result.append("  User functions:\n");
+    for (auto i = m_profile.userFunctions.constBegin();
+         i != m_profile.userFunctions.constEnd(); ++i)
+        result.append(profileLine(i.key(), i.value()));
+
+    return result;
+}
+
 QString Evaluator::error() const
 {
-    return m_error;
+    QString result;
+    switch (m_error.kind) {
+        case Failure::None:
+            break;
+        case Failure::Message:
+            result = m_error.message;
+            break;
+        case Failure::InvalidExpression:
+            result = tr("invalid expression");
+            break;
+        case Failure::Cancelled:
+            result = tr("evaluation cancelled");
+            break;
+        case Failure::UnknownIdentifier:
+            result = "<b>" + m_error.name + "</b>: "
+                     + tr("unknown function or variable");
+            break;
+        case Failure::FunctionUsage:
+            result = QString::fromLatin1("<b>%1</b>(%2)").arg(
+                m_error.name, m_error.function->usage());
+            break;
+        case Failure::UserFunctionUsage:
+            result = QString::fromLatin1("<b>%1</b>(%2)").arg(
+                m_error.name, m_error.arguments.join(";"));
+            break;
+        case Failure::OperatorError:
+            result = stringFromOperatorError(m_error.code);
+            break;
+        case Failure::FunctionError:
+            result = stringFromFunctionError(m_error.function, m_error.code);
+            break;
+    }
+    for (int i = 0; i < m_error.callers.count(); ++i)
+        result = "<b>" + m_error.callers.at(i) + "</b>: " + result;
+    return result;
+}
+
+bool Evaluator::hasError() const
+{
+    return !m_error.isEmpty();
 }
 
 // Returns list of token for the expression.
-// This triggers again the lexical analysis step. It is however preferable
-// (even when there's small performance penalty) because otherwise we need to
-// store parsed tokens all the time which serves no good purpose.
+// This goes through scan(), which answers from its cache when the
+// expression was just scanned.
 Tokens Evaluator::tokens() const
 {
     return scan(m_expression);
@@ -958,25 +1399,55 @@ bool isArcTime(QChar ch) {
 }
 
 Tokens Evaluator::scan(const QString& expr) const
+{
+    PipelineTrace::Span span("Evaluator::scan");
+    // The highlighter, the editor and the evaluator all scan the text being
+    // typed, which changes by a keystroke at a time.
+    const Settings* settings = Settings::instance();
+    const bool sameRadix =
+        m_scanCache.radixBoth == settings->isRadixCharacterBoth()
+        && m_scanCache.radix == settings->radixCharacter();
+    if (sameRadix && m_scanCache.text == expr)
+        return m_scanCache.tokens;
+
+    ScanCache result;
+    result.text = expr;
+    result.radixBoth = settings->isRadixCharacterBoth();
+    result.radix = settings->radixCharacter();
+    lex(expr, sameRadix ? &m_scanCache : nullptr, result);
+    m_scanCache = result;
+    return m_scanCache.tokens;
+}
+
+// Lexing starts afresh at every token boundary, so only the part of the text
+// around an edit has to be looked at again: the tokens of the previous text
+// that did not look past the unchanged beginning are kept, and once the
+// scanner reaches a token boundary of the previous text within the unchanged
+// end, the remaining tokens are taken over, shifted.
+void Evaluator::lex(const QString& expr, const ScanCache* previous,
+                    ScanCache& result) const
 {
     // Associate character codes with the highest number base
     // they might belong to.
+    // Built once, evaluators may scan on several threads.
     constexpr unsigned DIGIT_MAP_COUNT = 128;
-    static unsigned char s_digitMap[DIGIT_MAP_COUNT] = { 0 };
-
-    if (s_digitMap[0] == 0) {
-        // Initialize the digits map.
-        std::fill_n(s_digitMap, DIGIT_MAP_COUNT, 255);
-        for (int i = '0' ; i <= '9' ; ++i)
-            s_digitMap[i] = i - '0' + 1;
-        for (int i = 'a' ; i <= 'z' ; ++i)
-            s_digitMap[i] = i - 'a' + 11;
-        for (int i = 'A' ; i <= 'Z' ; ++i)
-            s_digitMap[i] = i - 'A' + 11;
-    }
+    static const struct DigitMap {
+        unsigned char digits[DIGIT_MAP_COUNT];
+        DigitMap()
+        {
+            std::fill_n(digits, DIGIT_MAP_COUNT, 255);
+            for (int i = '0' ; i <= '9' ; ++i)
+                digits[i] = i - '0' + 1;
+            for (int i = 'a' ; i <= 'z' ; ++i)
+                digits[i] = i - 'a' + 11;
+            for (int i = 'A' ; i <= 'Z' ; ++i)
+                digits[i] = i - 'A' + 11;
+        }
+    } s_digitMap;
 
     // Result.
-    Tokens tokens;
+    Tokens& tokens = result.tokens;
+    QVector<int>& reaches = result.reaches;
 
     // Parsing state.
     enum {
@@ -984,9 +1455,50 @@ Tokens Evaluator::scan(const QString& expr) const
         InExponentBase, InExponent, InIdentifier, InNumberEnd
     } state;
 
+    // Reuse what the previous text has in common with this one.
+    int i = 0;
+    int suffixStart = expr.length() + 1;
+    int delta = 0;
+    int next = 0;
+    if (previous) {
+        const QString& text = previous->text;
+        const Tokens& previousTokens = previous->tokens;
+        const int common = qMin(text.length(), expr.length());
+        int prefix = 0;
+        while (prefix < common && text.at(prefix) == expr.at(prefix))
+            ++prefix;
+        int suffix = 0;
+        while (suffix < common - prefix
+               && text.at(text.length() - 1 - suffix)
+                  == expr.at(expr.length() - 1 - suffix))
+            ++suffix;
+
+        while (next < previousTokens.count()
+               && previous->reaches.at(next) < prefix)
+            ++next;
+        // The last token may have been what made the text invalid.
+        if (!previousTokens.valid() && next > 0
+            && next == previousTokens.count())
+            --next;
+        // A unit goes with its number.
+        while (next > 0 && next < previousTokens.count()
+               && previousTokens.at(next).size() == 0)
+            --next;
+        for (int j = 0; j < next; ++j) {
+            tokens.append(previousTokens.at(j));
+            reaches.append(previous->reaches.at(j));
+        }
+        if (next > 0)
+            i = previousTokens.at(next - 1).pos()
+                + previousTokens.at(next - 1).size();
+
+        suffixStart = expr.length() - suffix;
+        delta = expr.length() - text.length();
+    }
+
     // Initialize variables.
     state = Init;
-    int i = 0;
+    int reach = i;
     QString ex = expr;
     QString tokenText, tokenUnit;
     int tokenStart = 0; // Includes leading spaces.
@@ -1006,6 +1518,7 @@ Tokens Evaluator::scan(const QString& expr) const
     // Main loop.
     while (state != Bad && state != Finish && i < ex.length()) {
         QChar ch = ex.at(i);
+        reach = qMax(reach, i);
 
 #ifdef EVALUATOR_DEBUG
         qDebug() << QString("state=%1 ch=%2 i=%3 tokenText=%4")
@@ -1014,8 +1527,33 @@ Tokens Evaluator::scan(const QString& expr) const
 
         switch (state) {
         case Init:
+            if (i >= suffixStart) {
+                // The rest is lexed as in the previous text.
+                const Tokens& previousTokens = previous->tokens;
+                while (next < previousTokens.count()
+                       && (previousTokens.at(next).pos() < i - delta
+                           || (previousTokens.at(next).pos() == i - delta
+                               && previousTokens.at(next).size() == 0)))
+                    ++next;
+                if (next < previousTokens.count()
+                    && previousTokens.at(next).pos() == i - delta)
+                {
+                    for (; next < previousTokens.count(); ++next) {
+                        Token token = previousTokens.at(next);
+                        token.setPos(token.pos() + delta);
+                        tokens.append(token);
+                        reaches.append(previous->reaches.at(next) + delta);
+                    }
+                    tokens.setValid(previousTokens.valid());
+                    state = Finish;
+                    break;
+                }
+            }
+
             tokenStart = i;
             tokenText = "";
+            tokenUnit.clear();
+            reach = i;
             state = Start;
 
             // State variables reset
@@ -1057,6 +1595,7 @@ Tokens Evaluator::scan(const QString& expr) const
             else { // Look for operator match.
                 int op;
                 QString s;
+                reach = qMax(reach, i + 1);
                 s = QString(ch).append(ex.at(i+1));
                 op = matchOperator(s);
                 // Check for one-char operator.
@@ -1083,6 +1622,7 @@ Tokens Evaluator::scan(const QString& expr) const
                     int tokenSize = i - tokenStart;
                     tokens.append(Token(type, s.left(len),
                                         tokenStart, tokenSize));
+                    reaches.append(reach);
                     state = Init;
                 }
                 else
@@ -1100,10 +1640,12 @@ Tokens Evaluator::scan(const QString& expr) const
                 if (matchOperator(tokenText)) {
                     tokens.append(Token(Token::stxOperator, tokenText,
                                         tokenStart, tokenSize));
+                    reaches.append(reach);
                 } else {
                     // Normal identifier.
                     tokens.append(Token(Token::stxIdentifier, tokenText,
                                         tokenStart, tokenSize));
+                    reaches.append(reach);
                 }
                 state = Init;
             }
@@ -1190,7 +1732,7 @@ Tokens Evaluator::scan(const QString& expr) const
         // Parse the number digits.
         case InNumber: {
             ushort c = ch.unicode();
-            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap[c] <= numberBase);
+            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap.digits[c] <= numberBase);
 
             if (isDigit) {
                 // Consume as long as it's a digit
@@ -1234,7 +1776,7 @@ Tokens Evaluator::scan(const QString& expr) const
         // Validate exponent start.
         case InExpIndicator: {
             ushort c = ch.unicode();
-            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap[c] <= numberBase);
+            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap.digits[c] <= numberBase);
 
             if (expBase == 0) {
                 // Set the default exponent base (same as number)
@@ -1306,7 +1848,7 @@ Tokens Evaluator::scan(const QString& expr) const
         // Parse exponent.
         case InExponent: {
             ushort c = ch.unicode();
-            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap[c] <= expBase);
+            bool isDigit = c < DIGIT_MAP_COUNT && (s_digitMap.digits[c] <= expBase);
 
             if (isDigit) {
                 // Consume as long as it's a digit.
@@ -1326,10 +1868,12 @@ Tokens Evaluator::scan(const QString& expr) const
             int tokenSize = i - tokenStart;
             tokens.append(Token(Token::stxNumber, tokenText,
                                 tokenStart, tokenSize));
+            reaches.append(reach);
 
             if (!tokenUnit.isEmpty()) { // add unit token
                 tokens.append(Token(Token::stxIdentifier, tokenUnit,
                     tokenStart + tokenSize, 0));
+                reaches.append(reach);
             }
 
             // Make sure a number cannot be followed by another number.
@@ -1353,12 +1897,25 @@ Tokens Evaluator::scan(const QString& expr) const
         // Invalidating here too, because usually when we set state to Bad,
         // the case Bad won't be run.
         tokens.setValid(false);
+}
 
-    return tokens;
+// The builtin functions reducing their first argument over a range of
+// values of a loop variable, e.g. sumrange(k^2; k; 1; 10), or running it
+// for the values of a numerical method, e.g. integrate(x^2; x; 0; 1). The
+// first argument is compiled as the body of a loop, see Opcode::Range, and
+// the loop variable only exists inside it.
+static bool isRangeFunction(const QString& name)
+{
+    static const QSet<QString> names = {
+        "integrate", "maxrange", "minrange", "productrange", "solve",
+        "sumrange"
+    };
+    return names.contains(name);
 }
 
 void Evaluator::compile(const Tokens& tokens)
 {
+    PipelineTrace::Span span("Evaluator::compile");
 #ifdef EVALUATOR_DEBUG
     QFile debugFile("eval.log");
     debugFile.open(QIODevice::WriteOnly);
@@ -1371,6 +1928,8 @@ void Evaluator::compile(const Tokens& tokens)
     m_codes.clear();
     m_constants.clear();
     m_identifiers.clear();
+    m_bindings = IdentifierBindings();
+    m_stackDepth = -1;
     m_error = QString();
 
     // Sanity check.
@@ -1381,6 +1940,52 @@ void Evaluator::compile(const Tokens& tokens)
     QStack<int> argStack;
     unsigned argCount = 1;
 
+    // The calls of range functions being parsed: the position of the name,
+    // where the code of the body starts, how many of the arguments ended
+    // and where the code of the loop variable starts.
+    struct RangeCall {
+        int position;
+        QString name;
+        int start;
+        int separators;
+        int variable;
+    };
+    QVector<RangeCall> rangeCalls;
+    QString rangeError;
+
+    // Once its argument is parsed, the loop variable is taken out of the
+    // code and its uses in the body load the counter of the loop. Loops
+    // are numbered by how many bodies of other ones they are in.
+    auto bindLoopVariable = [&](const RangeCall& call) {
+        const Opcode variable = m_codes.count() == call.variable + 1
+            ? m_codes.at(call.variable) : Opcode();
+        const QString name = variable.type == Opcode::Ref
+            ? m_identifiers.at(variable.index) : QString();
+        if (variable.type != Opcode::Arg
+            && (name.isEmpty() || FunctionRepo::instance()->find(name)
+                || hasUserFunction(name)))
+        {
+            rangeError = "<b>" + call.name + "</b>: "
+                + tr("the second argument must be the name of the "
+                     "loop variable");
+            return;
+        }
+        int nesting = 0;
+        for (int i = 0; i < rangeCalls.count() - 1; ++i)
+            nesting += rangeCalls.at(i).separators == 0 ? 1 : 0;
+        for (int pc = call.start + 1; pc < call.variable; ++pc) {
+            Opcode& opcode = m_codes[pc];
+            if (opcode.type == variable.type
+                && (variable.type == Opcode::Arg
+                    ? opcode.index == variable.index
+                    : m_identifiers.at(opcode.index) == name))
+            {
+                opcode = Opcode(Opcode::Counter, nesting);
+            }
+        }
+        m_codes.resize(call.variable);
+    };
+
     for (int i = 0; i <= tokens.count() && !syntaxStack.hasError(); ++i) {
         // Helper token: Invalid is end-of-expression.
         auto token = (i < tokens.count()) ? tokens.at(i)
@@ -1418,6 +2023,13 @@ void Evaluator::compile(const Tokens& tokens)
                     && id.isIdentifier())
                 {
                     ruleFound = true;
+                    if (!rangeCalls.isEmpty()
+                        && rangeCalls.last().position == id.pos())
+                    {
+                        if (rangeCalls.last().separators == 1)
+                            bindLoopVariable(rangeCalls.last());
+                        rangeCalls.removeLast();
+                    }
                     syntaxStack.reduce(4, MAX_PRECEDENCE);
                     m_codes.append(Opcode(Opcode::Function, argCount));
 #ifdef EVALUATOR_DEBUG
@@ -1577,6 +2189,11 @@ void Evaluator::compile(const Tokens& tokens)
                    && id.isIdentifier())
                {
                    ruleFound = true;
+                   if (!rangeCalls.isEmpty()
+                       && rangeCalls.last().position == id.pos())
+                   {
+                       rangeCalls.removeLast();
+                   }
                    syntaxStack.reduce(3, MAX_PRECEDENCE);
                    m_codes.append(Opcode(Opcode::Function, 0));
 #ifdef EVALUATOR_DEBUG
@@ -1650,7 +2267,7 @@ void Evaluator::compile(const Tokens& tokens)
                        m_codes.append(Opcode::BOr);
                        break;
                    case Token::UnitConversion: {
-                       static const QRegExp unitNameNumberRE(
+                       static thread_local const QRegExp unitNameNumberRE(
                            "(^[0-9e\\+\\-\\.,]|[0-9e\\.,]$)",
                            Qt::CaseInsensitive);
                        QString unitName =
@@ -1666,7 +2283,9 @@ void Evaluator::compile(const Tokens& tokens)
                        // if it starts or ends with a number.
                        else if (unitNameNumberRE.indexIn(unitName) != -1)
                            unitName = "(" + unitName + ")";
-                       m_codes.append(Opcode(Opcode::Conv, unitName));
+                       m_identifiers.append(unitName);
+                       m_codes.append(Opcode(Opcode::Conv,
+                                             m_identifiers.count() - 1));
                        break; }
                    default: break;
                    };
@@ -1767,13 +2386,46 @@ void Evaluator::compile(const Tokens& tokens)
                break;
         }
 
+        // The first argument of a range function ends: put the Range
+        // before its code. The second one ends: bind the loop variable.
+        if (token.asOperator() == Token::ListSeparator
+            && !rangeCalls.isEmpty() && syntaxStack.itemCount() >= 3
+            && syntaxStack.top().isOperand()
+            && syntaxStack.top(1).asOperator() == Token::AssociationStart
+            && syntaxStack.top(2).pos() == rangeCalls.last().position)
+        {
+            RangeCall& call = rangeCalls.last();
+            if (++call.separators == 1) {
+                m_codes.insert(call.start, Opcode(Opcode::Range,
+                                                  m_codes.count() - call.start));
+                call.variable = m_codes.count();
+            } else if (call.separators == 2)
+                bindLoopVariable(call);
+            if (!rangeError.isEmpty())
+                break;
+        }
+
         // Can't apply rules anymore, push the token.
         syntaxStack.push(token);
 
         // For identifier, generate code to load from reference.
         if (tokenType == Token::stxIdentifier) {
-            m_identifiers.append(token.text());
-            m_codes.append(Opcode(Opcode::Ref, m_identifiers.count() - 1));
+            // Arguments of a user function being defined get their slot.
+            const int arg = m_assignArg.indexOf(token.text());
+            if (arg >= 0)
+                m_codes.append(Opcode(Opcode::Arg, arg));
+            else {
+                m_identifiers.append(token.text());
+                m_codes.append(Opcode(Opcode::Ref, m_identifiers.count() - 1));
+                if (isRangeFunction(token.text()) && i + 1 < tokens.count()
+                    && tokens.at(i + 1).asOperator() == Token::AssociationStart)
+                {
+                    const RangeCall call = {
+                        token.pos(), token.text(), m_codes.count(), 0, -1
+                    };
+                    rangeCalls.append(call);
+                }
+            }
 #ifdef EVALUATOR_DEBUG
             dbg << "\tPush " << token.text() << " to identifier pools" << "\n";
 #endif
@@ -1781,17 +2433,19 @@ void Evaluator::compile(const Tokens& tokens)
 
         // For constants, generate code to load from a constant.
         if (tokenType == Token::stxNumber) {
-            m_constants.append(token.asNumber());
+            m_constants.append(literal(token));
             m_codes.append(Opcode(Opcode::Load, m_constants.count() - 1));
 #ifdef EVALUATOR_DEBUG
-            dbg << "\tPush " << token.asNumber()
+            dbg << "\tPush " << m_constants.last()
                 << " to constant pools" << "\n";
 #endif
         }
     }
 
     m_valid = false;
-    if (syntaxStack.hasError())
+    if (!rangeError.isEmpty())
+        m_error = rangeError;
+    else if (syntaxStack.hasError())
         m_error = syntaxStack.error();
     // syntaxStack must left only one operand
     // and end-of-expression (i.e. Invalid).
@@ -1813,35 +2467,598 @@ void Evaluator::compile(const Tokens& tokens)
         m_constants.clear();
         m_codes.clear();
         m_identifiers.clear();
+    } else {
+        {
+            // Folding runs the constant parts of the expression.
+            BudgetScope budget(this);
+            optimize();
+        }
+        eliminateCommonSubexpressions();
+        m_stackDepth = stackDepth(m_codes);
     }
 }
 
-Quantity Evaluator::evalNoAssign()
+// Builtin functions whose result only depends on their arguments. The
+// trigonometric ones follow the angle unit and can't be folded.
+static bool isFoldableFunction(const QString& name)
 {
-    Quantity result;
+    static const QSet<QString> names = {
+        "abs", "average", "cbrt", "ceil", "cosh", "erf", "erfc", "exp",
+        "floor", "frac", "gamma", "gcd", "geomean", "int", "lb", "lg",
+        "ln", "lngamma", "log", "max", "min", "ncr", "npr", "product",
+        "round", "sgn", "sinh", "sqrt", "sum", "tanh", "trunc"
+    };
+    return names.contains(name);
+}
 
-    if (m_dirty) {
-        // Reset.
-        m_assignId = QString();
-        m_assignFunc = false;
-        m_assignArg.clear();
+// Whether a value computed at compile time can replace its computation.
+// Complex or invalid results are left to be computed at run time, where
+// the complex mode and the error reporting apply.
+static bool isFoldable(const Quantity& value)
+{
+    return value.error() == Success && !value.isNan() && value.isReal();
+}
 
-        Tokens tokens = scan(m_expression);
+// Builtin variables that never change: the constants and the units, but
+// not the answer nor the angle units, which follow the angle mode.
+static bool isConstantVariable(const Variable& variable)
+{
+    static const QSet<QString> changing = {
+        "ans", "radian", "degree", "gradian", "gon", "arcminute", "arcsecond"
+    };
+    return variable.type() == Variable::BuiltIn
+        && !changing.contains(variable.identifier())
+        && isFoldable(variable.value());
+}
 
-        // Invalid expression?
-        if (!tokens.valid()) {
-            m_error = tr("invalid expression");
-            return Quantity(0);
+// Rewrites the compiled program: computes the subexpressions made of
+// constants and constant variables, including calls of the builtin
+// functions above, turns squares into a multiplication and resolves
+// conversions to constant targets into Unit. The bodies of range functions
+// are folded on their own, as they run apart. The program is left
+// untouched if its stack use can't be followed, e.g. for a variable called
+// like a function.
+void Evaluator::optimize()
+{
+    // A value on the stack: the position of the code computing it in the
+    // new program, its value if it is a constant and, if it is a
+    // reference to a function, whether the function can be folded.
+    struct Entry {
+        int start;
+        bool constant;
+        Quantity value;
+        bool callee;
+        Function* function;
+    };
+
+    // A body being folded: where it ends in the program, where its Range
+    // is in the new one and the stack below it.
+    struct Body {
+        int end;
+        int range;
+        int depth;
+    };
+
+    QVector<Opcode> codes;
+    QVector<Quantity> constants;
+    QVector<Entry> stack;
+    QVector<Body> bodies;
+
+    auto pushConstant = [&](int start, const Quantity& value) {
+        codes.resize(start);
+        codes.append(Opcode(Opcode::Load, constants.count()));
+        constants.append(value);
+        Entry entry = { start, true, value, false, nullptr };
+        stack.append(entry);
+    };
+    auto pushResult = [&](int start) {
+        Entry entry = { start, false, Quantity(), false, nullptr };
+        stack.append(entry);
+    };
+
+    for (int pc = 0; pc < m_codes.count(); ++pc) {
+        // A body leaves its value, which the call gets as a placeholder
+        // like the loop variable after it.
+        while (!bodies.isEmpty() && bodies.last().end == pc) {
+            const Body body = bodies.takeLast();
+            if (stack.count() != body.depth + 1)
+                return;
+            stack.removeLast();
+            codes[body.range].index = codes.count() - body.range - 1;
+            pushResult(body.range);
+            pushResult(codes.count());
         }
 
-        // Variable assignment?
-        if (tokens.count() > 2
-            && tokens.at(0).isIdentifier()
-            && tokens.at(1).asOperator() == Token::Assignment)
-        {
-            m_assignId = tokens.at(0).text();
-            tokens.erase(tokens.begin());
-            tokens.erase(tokens.begin());
+        const Opcode& opcode = m_codes.at(pc);
+        switch (opcode.type) {
+            case Opcode::Nop:
+                break;
+
+            case Opcode::Load:
+                pushConstant(codes.count(), m_constants.at(opcode.index));
+                break;
+
+            case Opcode::Arg:
+            case Opcode::Counter:
+                pushResult(codes.count());
+                codes.append(opcode);
+                break;
+
+            case Opcode::Range: {
+                const Body body = {
+                    pc + 1 + int(opcode.index), codes.count(), stack.count()
+                };
+                if (body.end >= m_codes.count())
+                    return;
+                bodies.append(body);
+                codes.append(opcode);
+                break;
+            }
+
+            case Opcode::Ref: {
+                const QString& name = m_identifiers.at(opcode.index);
+                if (hasVariable(name)) {
+                    const Variable variable = getVariable(name);
+                    if (isConstantVariable(variable)) {
+                        pushConstant(codes.count(), variable.value());
+                        break;
+                    }
+                    pushResult(codes.count());
+                    codes.append(opcode);
+                    break;
+                }
+                pushResult(codes.count());
+                codes.append(opcode);
+                Function* function = FunctionRepo::instance()->find(name);
+                stack.last().callee = function || hasUserFunction(name);
+                if (function && isFoldableFunction(name))
+                    stack.last().function = function;
+                break;
+            }
+
+            case Opcode::Neg:
+            case Opcode::Fact: {
+                if (stack.isEmpty())
+                    return;
+                const Entry operand = stack.takeLast();
+                if (operand.constant) {
+                    const Quantity value = opcode.type == Opcode::Neg
+                        ? -operand.value : DMath::factorial(operand.value);
+                    if (isFoldable(value)) {
+                        pushConstant(operand.start, value);
+                        break;
+                    }
+                }
+                pushResult(operand.start);
+                codes.append(opcode);
+                break;
+            }
+
+            case Opcode::Function: {
+                const int argumentCount = opcode.index;
+                if (stack.count() < argumentCount + 1)
+                    return;
+                const Entry callee = stack.at(stack.count() - argumentCount - 1);
+                if (!callee.callee)
+                    return;
+                bool constant = callee.function && argumentCount > 0;
+                Function::ArgumentList args;
+                for (int i = stack.count() - argumentCount; i < stack.count(); ++i) {
+                    constant = constant && stack.at(i).constant;
+                    if (constant)
+                        args.append(stack.at(i).value);
+                }
+                stack.resize(stack.count() - argumentCount - 1);
+                if (constant) {
+                    const Quantity value = callee.function->exec(args);
+                    if (callee.function->error() == Success && isFoldable(value)) {
+                        pushConstant(callee.start, value);
+                        break;
+                    }
+                }
+                pushResult(callee.start);
+                codes.append(opcode);
+                break;
+            }
+
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+            case Opcode::Modulo:
+            case Opcode::IntDiv:
+            case Opcode::LSh:
+            case Opcode::RSh:
+            case Opcode::BAnd:
+            case Opcode::BOr:
+            case Opcode::Conv: {
+                if (stack.count() < 2)
+                    return;
+                const Entry rhs = stack.takeLast();
+                const Entry lhs = stack.takeLast();
+                if (lhs.constant && rhs.constant && opcode.type != Opcode::Conv
+                    && (opcode.type != Opcode::Pow || rhs.value.isInteger()))
+                {
+                    Quantity value;
+                    switch (opcode.type) {
+                        case Opcode::Add: value = lhs.value + rhs.value; break;
+                        case Opcode::Sub: value = lhs.value - rhs.value; break;
+                        case Opcode::Mul: value = lhs.value * rhs.value; break;
+                        case Opcode::Div: value = lhs.value / rhs.value; break;
+                        case Opcode::Pow:
+                            value = DMath::raise(lhs.value, rhs.value);
+                            break;
+                        case Opcode::Modulo: value = lhs.value % rhs.value; break;
+                        case Opcode::IntDiv:
+                            value = lhs.value / rhs.value;
+                            if (value.error() == Success)
+                                value = DMath::integer(value);
+                            break;
+                        case Opcode::LSh: value = lhs.value << rhs.value; break;
+                        case Opcode::RSh: value = lhs.value >> rhs.value; break;
+                        case Opcode::BAnd: value = lhs.value & rhs.value; break;
+                        default: value = lhs.value | rhs.value; break;
+                    }
+                    if (isFoldable(value)) {
+                        pushConstant(lhs.start, value);
+                        break;
+                    }
+                }
+                pushResult(lhs.start);
+                if (opcode.type == Opcode::Pow && rhs.constant
+                    && rhs.value == Quantity(2))
+                {
+                    codes.resize(rhs.start);
+                    codes.append(Opcode(Opcode::Sqr));
+                } else if (opcode.type == Opcode::Conv && rhs.constant
+                           && !rhs.value.isZero())
+                {
+                    // The target is checked and its display unit made once.
+                    Quantity target = rhs.value;
+                    target.setDisplayUnit(target.numericValue(),
+                                          m_identifiers.at(opcode.index));
+                    codes.resize(rhs.start);
+                    codes.append(Opcode(Opcode::Unit, constants.count()));
+                    constants.append(target);
+                } else
+                    codes.append(opcode);
+                break;
+            }
+
+            default:
+                return;
+        }
+    }
+
+    if (stack.count() != 1 || !bodies.isEmpty())
+        return;
+
+    // Keep only the constants and identifiers still referred to.
+    QVector<Quantity> usedConstants;
+    QStringList usedIdentifiers;
+    for (int i = 0; i < codes.count(); ++i) {
+        Opcode& opcode = codes[i];
+        if (opcode.type == Opcode::Load || opcode.type == Opcode::Unit) {
+            usedConstants.append(constants.at(opcode.index));
+            opcode.index = usedConstants.count() - 1;
+        } else if (opcode.type == Opcode::Ref || opcode.type == Opcode::Conv) {
+            usedIdentifiers.append(m_identifiers.at(opcode.index));
+            opcode.index = usedIdentifiers.count() - 1;
+        }
+    }
+
+    m_codes = codes;
+    m_constants = usedConstants;
+    m_identifiers = usedIdentifiers;
+}
+
+// Computes the subexpressions written more than once a single time: the
+// first copy is followed by a Store to a slot and the others make way for
+// a Recall of it. Shared are those made of constants, arguments,
+// variables, operators and calls of functions, which have no side
+// effects. Range functions and the lists, which are not variables, are
+// left alone. So is the program if its stack use can't be followed, as in
+// optimize().
+void Evaluator::eliminateCommonSubexpressions()
+{
+    // A value of the program: its operands, the code computing it after
+    // them, first to last, and its value number, or -1 if it is not pure.
+    struct Node {
+        QVector<int> operands;
+        int first;
+        int last;
+        int value;
+    };
+
+    QVector<Node> nodes;
+    QVector<int> stack;
+    QHash<QString, int> values;
+    QHash<QByteArray, int> constantClasses;
+    QVector<int> counts;
+
+    // The same constant may be loaded from several entries.
+    auto constantClass = [&](int index) {
+        QByteArray bytes;
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        m_constants.at(index).serialize(stream);
+        return constantClasses.insert(bytes, constantClasses.value(
+            bytes, constantClasses.count())).value();
+    };
+    auto valueNumber = [&](const QString& key) {
+        const int value = values.value(key, values.count());
+        values.insert(key, value);
+        if (value == counts.count())
+            counts.append(0);
+        ++counts[value];
+        return value;
+    };
+    auto push = [&](const QVector<int>& operands, int first, int last,
+                    const QString& key) {
+        int value = key.isEmpty() ? -1 : 0;
+        QString fullKey = key;
+        for (int i = 0; i < operands.count() && value >= 0; ++i) {
+            value = nodes.at(operands.at(i)).value;
+            fullKey += QLatin1Char(' ') + QString::number(value);
+        }
+        const Node node = {
+            operands, first, last, value >= 0 ? valueNumber(fullKey) : -1
+        };
+        stack.append(nodes.count());
+        nodes.append(node);
+    };
+    auto take = [&](int count) {
+        QVector<int> operands = stack.mid(stack.count() - count);
+        stack.resize(stack.count() - count);
+        return operands;
+    };
+
+    bool repeated = false;
+    for (int pc = 0; pc < m_codes.count(); ++pc) {
+        const Opcode& opcode = m_codes.at(pc);
+        const QString type = QString::number(opcode.type) + QLatin1Char(':');
+        switch (opcode.type) {
+            case Opcode::Nop:
+                break;
+
+            case Opcode::Load:
+                push(QVector<int>(), pc, pc,
+                     type + QString::number(constantClass(opcode.index)));
+                break;
+
+            case Opcode::Arg:
+                push(QVector<int>(), pc, pc, type + QString::number(opcode.index));
+                break;
+
+            case Opcode::Counter:
+                push(QVector<int>(), pc, pc, QString());
+                break;
+
+            // The body and the loop variable, with a placeholder each.
+            case Opcode::Range:
+                if (int(opcode.index) >= m_codes.count() - pc)
+                    return;
+                push(QVector<int>(), pc, pc + opcode.index, QString());
+                pc += opcode.index;
+                push(QVector<int>(), pc + 1, pc, QString());
+                break;
+
+            case Opcode::Ref: {
+                // Nothing changes while the program runs, but the lists
+                // take their place on the stack apart from the values.
+                const QString& name = m_identifiers.at(opcode.index);
+                const bool pure = hasVariable(name)
+                    || FunctionRepo::instance()->find(name)
+                    || hasUserFunction(name);
+                push(QVector<int>(), pc, pc,
+                     pure ? QString(type + name) : QString());
+                break;
+            }
+
+            case Opcode::Neg:
+            case Opcode::Fact:
+            case Opcode::Sqr:
+                if (stack.isEmpty())
+                    return;
+                push(take(1), pc, pc, type);
+                break;
+
+            case Opcode::Unit:
+                if (stack.isEmpty())
+                    return;
+                push(take(1), pc, pc,
+                     type + QString::number(constantClass(opcode.index)));
+                break;
+
+            // The callee must be a function, a variable keeps the arguments
+            // on the stack.
+            case Opcode::Function: {
+                const int argumentCount = opcode.index;
+                if (stack.count() < argumentCount + 1)
+                    return;
+                const Node& callee = nodes.at(stack.at(stack.count()
+                                                       - argumentCount - 1));
+                const Opcode* ref = callee.operands.isEmpty()
+                    && callee.first == callee.last
+                    ? &m_codes.at(callee.first) : nullptr;
+                if (!ref || ref->type != Opcode::Ref
+                    || hasVariable(m_identifiers.at(ref->index)))
+                {
+                    return;
+                }
+                push(take(argumentCount + 1), pc, pc, type);
+                break;
+            }
+
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+            case Opcode::Modulo:
+            case Opcode::IntDiv:
+            case Opcode::LSh:
+            case Opcode::RSh:
+            case Opcode::BAnd:
+            case Opcode::BOr:
+                if (stack.count() < 2)
+                    return;
+                push(take(2), pc, pc, type);
+                break;
+
+            case Opcode::Conv:
+                if (stack.count() < 2)
+                    return;
+                push(take(2), pc, pc, type + m_identifiers.at(opcode.index));
+                break;
+
+            default:
+                return;
+        }
+        if (!stack.isEmpty()) {
+            const Node& node = nodes.at(stack.last());
+            repeated = repeated
+                || (node.value >= 0 && counts.at(node.value) > 1
+                    && !node.operands.isEmpty());
+        }
+    }
+
+    if (stack.count() != 1 || !repeated)
+        return;
+
+    // Shared are the values met more than once, not counting those within
+    // the copies that are recalled.
+    auto isShared = [&](const Node& node, const QVector<int>& met) {
+        return node.value >= 0 && !node.operands.isEmpty()
+            && counts.at(node.value) > 1 && met.at(node.value) > 1;
+    };
+    QVector<int> met(counts.count(), 0);
+    QVector<int> pending(1, stack.last());
+    while (!pending.isEmpty()) {
+        const Node& node = nodes.at(pending.takeLast());
+        if (node.value >= 0 && ++met[node.value] > 1 && isShared(node, met))
+            continue;
+        for (int i = node.operands.count() - 1; i >= 0; --i)
+            pending.append(node.operands.at(i));
+    }
+
+    // Write the program anew, the operands before their node.
+    QVector<Opcode> codes;
+    codes.reserve(m_codes.count());
+    QVector<int> slots(counts.count(), -1);
+    int slotCount = 0;
+    // The nodes to write, negated once their operands are written.
+    QVector<int> order(1, stack.last());
+    while (!order.isEmpty()) {
+        const int entry = order.takeLast();
+        const Node& node = nodes.at(entry < 0 ? ~entry : entry);
+        const bool shared = isShared(node, met);
+        if (entry >= 0) {
+            if (shared && slots.at(node.value) >= 0) {
+                codes.append(Opcode(Opcode::Recall, slots.at(node.value)));
+                continue;
+            }
+            order.append(~entry);
+            for (int i = node.operands.count() - 1; i >= 0; --i)
+                order.append(node.operands.at(i));
+            continue;
+        }
+        for (int pc = node.first; pc <= node.last; ++pc)
+            codes.append(m_codes.at(pc));
+        if (shared) {
+            slots[node.value] = slotCount;
+            codes.append(Opcode(Opcode::Store, slotCount++));
+        }
+    }
+
+    if (slotCount > 0)
+        m_codes = codes;
+}
+
+// Scans and compiles the expression unless it is already compiled. Returns
+// false, with m_error set, when it is invalid.
+//
+// Auto-calc, the result display and history replay evaluate the same
+// texts over and over, so the outcome is kept in a bounded LRU cache.
+// The compiled code depends on the user functions, the radix character
+// and the precision the constants are parsed with, all part of the
+// lookup. Variables are only looked up when the code runs, but for the
+// builtin constants and units optimize() takes in.
+bool Evaluator::compileExpression()
+{
+    if (!m_dirty)
+        return true;
+
+    const unsigned revision =
+        m_session ? m_session->userFunctionsRevision() : 0;
+    if (m_compiledSession != m_session || m_compiledRevision != revision) {
+        m_compiledExpressions.clear();
+        m_compiledSession = m_session;
+        m_compiledRevision = revision;
+    }
+
+    const Settings* settings = Settings::instance();
+    const QString key = QString::number(workingPrecision())
+        + QLatin1Char(settings->isRadixCharacterBoth() ? '*'
+                                                       : settings->radixCharacter())
+        + QLatin1Char(':') + m_expression;
+
+    if (const CompiledExpression* compiled = m_compiledExpressions.object(key)) {
+        m_dirty = compiled->dirty;
+        m_valid = compiled->valid;
+        m_error = compiled->error;
+        m_assignId = compiled->assignId;
+        m_assignFunc = compiled->assignFunc;
+        m_assignArg = compiled->assignArg;
+        m_codes = compiled->codes;
+        m_constants = compiled->constants;
+        m_identifiers = compiled->identifiers;
+        m_stackDepth = compiled->stackDepth;
+        m_bindings = IdentifierBindings();
+        return m_error.isEmpty();
+    }
+
+    const bool result = parseExpression();
+
+    CompiledExpression* compiled = new CompiledExpression;
+    compiled->dirty = m_dirty;
+    compiled->valid = m_valid;
+    compiled->error = m_error;
+    compiled->assignId = m_assignId;
+    compiled->assignFunc = m_assignFunc;
+    compiled->assignArg = m_assignArg;
+    compiled->codes = m_codes;
+    compiled->constants = m_constants;
+    compiled->identifiers = m_identifiers;
+    compiled->stackDepth = m_stackDepth;
+    m_compiledExpressions.insert(key, compiled);
+    return result;
+}
+
+bool Evaluator::parseExpression()
+{
+    if (m_dirty) {
+        // Reset.
+        m_assignId = QString();
+        m_assignFunc = false;
+        m_assignArg.clear();
+
+        Tokens tokens = scan(m_expression);
+
+        // Invalid expression?
+        if (!tokens.valid()) {
+            m_error = Failure(Failure::InvalidExpression);
+            return false;
+        }
+
+        // Variable assignment?
+        if (tokens.count() > 2
+            && tokens.at(0).isIdentifier()
+            && tokens.at(1).asOperator() == Token::Assignment)
+        {
+            m_assignId = tokens.at(0).text();
+            tokens.erase(tokens.begin());
+            tokens.erase(tokens.begin());
         } else if (tokens.count() > 2
                    && tokens.at(0).isIdentifier()
                    && tokens.at(1).asOperator() == Token::AssociationStart)
@@ -1891,318 +3108,1702 @@ Quantity Evaluator::evalNoAssign()
         if (!m_valid) {
             if (m_error.isEmpty())
                 m_error = tr("compile error");
-            return CNumber(0);
+            return false;
         }
     }
+    return true;
+}
+
+Quantity Evaluator::evalNoAssign()
+{
+    Quantity result;
+    WorkingPrecisionScope precision(workingPrecision());
+
+    if (!compileExpression())
+        return Quantity(0);
+    if (!isAffordable(1))
+        return CMath::nan();
 
-    result = exec(m_codes, m_constants, m_identifiers);
+    {
+        CancellationScope cancellation(this);
+        BudgetScope budget(this);
+        AllocationScope allocations(m_profiling ? &m_profile : nullptr);
+        NumberArenaScope arena;
+        result = exec(m_codes, m_constants, m_identifiers, m_bindings,
+                      m_stackDepth, nullptr);
+    }
     return result;
 }
 
-Quantity Evaluator::exec(const QVector<Opcode>& opcodes,
-                         const QVector<Quantity>& constants,
-                         const QStringList& identifiers)
+/**
+ * Evaluates the expression like evalNoAssign() once for each of the values,
+ * with the variable set to it. The expression is compiled only once and the
+ * variable is restored afterwards. Evaluation stops at the first error,
+ * the results computed until then are returned.
+ */
+QVector<Quantity> Evaluator::evalBatch(const QString& variable,
+                                       const QVector<Quantity>& values)
 {
-    QStack<Quantity> stack;
-    QHash<int, QString> refs;
-    int index;
-    Quantity val1, val2;
-    QVector<Quantity> args;
-    QString fname;
-    Function* function;
-    const UserFunction* userFunction = nullptr;
+    QVector<Quantity> results;
+    WorkingPrecisionScope precision(workingPrecision());
+
+    if (!compileExpression() || !isAffordable(values.count()))
+        return results;
 
+    if (isBuiltInVariable(variable)) {
+        m_error = tr("%1 is a reserved name, "
+                     "please choose another").arg(variable);
+        return results;
+    }
+
+    const bool existed = hasVariable(variable);
+    const Variable saved = getVariable(variable);
+
+    // The timeout and the budgets cover the whole batch.
+    CancellationScope cancellation(this);
+    BudgetScope budget(this);
+
+    // Assigning an existing variable keeps the bindings of the program.
+    results.reserve(values.count());
+    for (int i = 0; i < values.count(); ++i) {
+        setVariable(variable, values.at(i));
+        Quantity result;
+        {
+            AllocationScope allocations(m_profiling ? &m_profile : nullptr);
+            NumberArenaScope arena;
+            result = exec(m_codes, m_constants, m_identifiers, m_bindings,
+                          m_stackDepth, nullptr);
+        }
+        if (!m_error.isEmpty())
+            break;
+        results.append(result);
+    }
+
+    if (existed)
+        m_session->addVariable(saved);
+    else
+        unsetVariable(variable);
+    return results;
+}
+
+// QStack copies on push and pop. The values of the evaluation stack are
+// handed over instead, which saves copying their significands.
+static void pushValue(QStack<Quantity>& stack, Quantity value)
+{
+    stack.append(std::move(value));
+}
+
+static Quantity popValue(QStack<Quantity>& stack)
+{
+    Quantity value(std::move(stack.last()));
+    stack.removeLast();
+    return value;
+}
+
+// Resolves the identifiers of compiled code to what they name, unless
+// the bindings already hold for the current revision of the session.
+void Evaluator::bind(const QStringList& identifiers,
+                     IdentifierBindings& bindings) const
+{
+    const unsigned revision = m_session ? m_session->bindingRevision() : 0;
+    if (bindings.session == m_session && bindings.revision == revision
+        && bindings.targets.count() == identifiers.count())
+    {
+        return;
+    }
+
+    bindings.session = m_session;
+    bindings.revision = revision;
+    bindings.targets.resize(identifiers.count());
+    for (int i = 0; i < identifiers.count(); ++i) {
+        const QString& name = identifiers.at(i);
+        IdentifierBinding& binding = bindings.targets[i];
+        binding = IdentifierBinding();
+        if (hasVariable(name)) {
+            binding.kind = IdentifierBinding::Variable;
+            binding.variable = m_session->findVariable(name);
+        } else if ((binding.function = FunctionRepo::instance()->find(name)))
+            binding.kind = IdentifierBinding::Function;
+        else if ((binding.userFunction = getUserFunction(name)))
+            binding.kind = IdentifierBinding::UserFunction;
+        else if (m_session && (binding.list = m_session->findList(name)))
+            binding.kind = IdentifierBinding::List;
+    }
+}
+
+// Function references waiting for their call: the stack position of the
+// placeholder and the identifier index.
+typedef QVarLengthArray<QPair<int, int>, 8> PendingRefs;
+
+static void addRef(PendingRefs& refs, int position, int identifier)
+{
+    for (int i = 0; i < refs.count(); ++i) {
+        if (refs.at(i).first == position) {
+            refs[i].second = identifier;
+            return;
+        }
+    }
+    refs.append(qMakePair(position, identifier));
+}
+
+static int takeRef(PendingRefs& refs, int position)
+{
+    for (int i = refs.count() - 1; i >= 0; --i) {
+        if (refs.at(i).first == position) {
+            int identifier = refs.at(i).second;
+            refs.remove(i);
+            return identifier;
+        }
+    }
+    return -1;
+}
+
+static QString listError(const QString& name, const QString& message)
+{
+    return "<b>" + name + "</b>: " + message;
+}
+
+// A list on the evaluation stack, in place of its placeholder: the stack
+// position, the identifier it comes from, for the messages, and its
+// values, those of the session or those computed from them by operators
+// and element-wise calls.
+struct StackList {
+    StackList() : position(0), identifier(-1), bound(nullptr) { }
+
+    const QVector<Quantity>& values() const
+    { return bound ? *bound : computed; }
+
+    int position;
+    int identifier;
+    const QVector<Quantity>* bound;
+    QVector<Quantity> computed;
+};
+
+typedef QVector<StackList> StackLists;
+
+static int findList(const StackLists& lists, int position)
+{
+    for (int i = 0; i < lists.count(); ++i) {
+        if (lists.at(i).position == position)
+            return i;
+    }
+    return -1;
+}
+
+// Takes the arguments of a call from the stack, each list in their place
+// giving all its values. The lists go to taken and, in case the call
+// runs element by element, the arguments as they are to scalars, with
+// columns holding the list of each, or null.
+static void takeArguments(QStack<Quantity>& stack, int count,
+                          StackLists& lists, QVector<Quantity>& args,
+                          StackLists& taken, QVector<Quantity>& scalars,
+                          QVector<const QVector<Quantity>*>& columns)
+{
+    const int base = stack.count() - count;
+    QVector<int> listOf(count, -1);
+    for (int i = base; i < stack.count(); ++i) {
+        const int list = findList(lists, i + 1);
+        if (list >= 0) {
+            listOf[i - base] = taken.count();
+            taken.append(std::move(lists[list]));
+            lists.remove(list);
+            args += taken.last().values();
+        } else
+            args.append(stack.at(i));
+    }
+    scalars.resize(count);
+    columns.fill(nullptr, count);
+    for (int i = 0; i < count; ++i) {
+        if (listOf.at(i) >= 0)
+            columns[i] = &taken.at(listOf.at(i)).values();
+        else
+            scalars[i] = std::move(stack[base + i]);
+    }
+    stack.resize(base);
+}
+
+// Checks at compile time what exec() would otherwise check for each
+// instruction: that none takes more values than are on the stack. Calls
+// may leave their arguments on the stack when the callee turns out to be
+// a variable, so they are taken to consume them for this check and to
+// keep them for the depth. The bodies of range functions run on their own
+// stack, with the checks. Returns the most values the program can have
+// on the stack, or -1 if it must be run with the checks.
+int Evaluator::stackDepth(const QVector<Opcode>& opcodes)
+{
+    int least = 0;
+    int most = 0;
+    int depth = 0;
     for (int pc = 0; pc < opcodes.count(); ++pc) {
         const Opcode& opcode = opcodes.at(pc);
-        index = opcode.index;
         switch (opcode.type) {
-            // No operation.
             case Opcode::Nop:
                 break;
-
-            // Load a constant, push to stack.
             case Opcode::Load:
-                val1 = constants.at(index);
-                stack.push(val1);
+            case Opcode::Ref:
+            case Opcode::Arg:
+            case Opcode::Counter:
+            case Opcode::Recall:
+                ++least;
+                depth = qMax(depth, ++most);
+                break;
+            case Opcode::Range:
+                // The placeholders of the body and of the loop variable.
+                if (int(opcode.index) >= opcodes.count() - pc)
+                    return -1;
+                pc += opcode.index;
+                least += 2;
+                most += 2;
+                depth = qMax(depth, most);
+                break;
+            case Opcode::Neg:
+            case Opcode::Fact:
+            case Opcode::Sqr:
+            case Opcode::Unit:
+            case Opcode::Store:
+                if (least < 1)
+                    return -1;
+                break;
+            case Opcode::Function:
+                if (least < int(opcode.index) + 1)
+                    return -1;
+                least -= opcode.index;
+                break;
+            default:
+                if (least < 2)
+                    return -1;
+                --least;
+                --most;
+                break;
+        }
+    }
+    return depth;
+}
+
+// Adds estimates without overflowing: those of runaway programs grow
+// exponentially with the nesting of user functions.
+static qint64 addCost(qint64 cost, qint64 more)
+{
+    const qint64 most = std::numeric_limits<qint64>::max();
+    return cost > most - more ? most : cost + more;
+}
+
+// The value of a constant as a small nonnegative integer, or -1.
+static int smallInteger(const Quantity& value)
+{
+    if (!value.isInteger())
+        return -1;
+    const HNumber n = HMath::abs(value.numericValue().real);
+    return n < HNumber(FunctionCost) ? n.toInt() : -1;
+}
+
+// Estimates the work units, as of setWorkBudget(), a run of the program
+// takes: an addition per instruction, a multiplication per product, and
+// FunctionCost multiplications per builtin function, power or factorial.
+// Integer powers and factorials of small constants take a multiplication
+// per bit or factor instead. Calls of user functions add the cost of
+// their bodies, but repeated ones of pure functions, which are memoized.
+// Lists add an addition per value.
+qint64 Evaluator::estimateCost(const QVector<Opcode>& opcodes,
+                               const QVector<Quantity>& constants,
+                               const QStringList& identifiers,
+                               IdentifierBindings& bindings,
+                               QHash<const UserFunction*, qint64>& known) const
+{
+    const qint64 digits = workingPrecision();
+    const qint64 multiplication = digits * digits;
+    qint64 cost = 0;
+
+    bind(identifiers, bindings);
+    for (int pc = 0; pc < opcodes.count(); ++pc) {
+        const Opcode& opcode = opcodes.at(pc);
+        const Opcode* previous = pc > 0 ? &opcodes.at(pc - 1) : nullptr;
+        const int operand = previous && previous->type == Opcode::Load
+                            ? smallInteger(constants.at(previous->index)) : -1;
+        qint64 step = digits;
+        switch (opcode.type) {
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Modulo:
+            case Opcode::IntDiv:
+            case Opcode::Sqr:
+                step = multiplication;
+                break;
+            case Opcode::Pow: {
+                int bits = 0;
+                for (int n = operand; n > 0; n >>= 1)
+                    ++bits;
+                step = (operand < 0 ? FunctionCost : 2 * bits + 1)
+                       * multiplication;
+                break;
+            }
+            case Opcode::Fact:
+                step = (operand < 0 ? FunctionCost : operand + 1)
+                       * multiplication;
+                break;
+            case Opcode::Ref: {
+                const IdentifierBinding& binding
+                    = bindings.targets.at(opcode.index);
+                if (binding.kind == IdentifierBinding::Function)
+                    step = FunctionCost * multiplication;
+                else if (binding.kind == IdentifierBinding::UserFunction)
+                    step = addCost(step, estimateCost(binding.userFunction,
+                                                      known));
+                else if (binding.kind == IdentifierBinding::List)
+                    step = qint64(binding.list->count()) * digits;
+                break;
+            }
+            default:
+                break;
+        }
+        cost = addCost(cost, step);
+    }
+    return cost;
+}
+
+// The cost of a call of the user function, see above. known holds those
+// of the functions already looked at; a recursion fails at run time, so
+// its calls cost nothing here.
+qint64 Evaluator::estimateCost(const UserFunction* function,
+                               QHash<const UserFunction*, qint64>& known) const
+{
+    const auto it = known.constFind(function);
+    if (it != known.constEnd())
+        return it.value();
+
+    known.insert(function, 0);
+    const qint64 cost = estimateCost(function->opcodes, function->constants,
+                                     function->identifiers, function->bindings,
+                                     known);
+    QVector<const UserFunction*> visited;
+    if (!isPure(function, visited))
+        known.insert(function, cost);
+    return cost;
+}
+
+// Rejects the expression, with m_error set, if the given number of runs
+// is estimated to take more than the work budget. Definitions of user
+// functions don't run the calls in their body.
+bool Evaluator::isAffordable(int runs)
+{
+    if (m_workBudget <= 0 || m_assignFunc)
+        return true;
+    QHash<const UserFunction*, qint64> known;
+    const qint64 cost = estimateCost(m_codes, m_constants, m_identifiers,
+                                     m_bindings, known);
+    if (cost <= m_workBudget / qMax(runs, 1))
+        return true;
+    m_error = Failure(Failure::OperatorError);
+    m_error.code = TooExpensive;
+    return false;
+}
+
+Quantity Evaluator::exec(const QVector<Opcode>& opcodes,
+                         const QVector<Quantity>& constants,
+                         const QStringList& identifiers,
+                         IdentifierBindings& bindings,
+                         int stackDepth,
+                         const QVector<Quantity>* arguments,
+                         QVector<Quantity>* counters)
+{
+    PipelineTrace::Span span("Evaluator::exec");
+
+    // Programs verified by stackDepth() run without the underflow checks,
+    // on a stack that never grows.
+    const bool checked = stackDepth < 0;
+    QStack<Quantity> stack;
+    stack.reserve(checked ? 16 : stackDepth);
+    PendingRefs refs;
+    // The bodies of range functions skipped until their call: the stack
+    // position of the function reference and the Range instruction.
+    PendingRefs ranges;
+    // The lists in place of their placeholders. Operators and calls run
+    // element by element on them, see applyToLists() and execElementwise().
+    StackLists lists;
+    // The values kept by Store for Recall, and those of them that are
+    // lists, with the slot as the position.
+    QVector<Quantity> slots;
+    StackLists slotLists;
+    // The values of the loop variables, for the Counter instructions.
+    QVector<Quantity> ownCounters;
+    if (!counters)
+        counters = &ownCounters;
+    int index;
+    QVector<Quantity> args;
+    QString fname;
+    Function* function;
+    const UserFunction* userFunction = nullptr;
+    int range;
+
+    bind(identifiers, bindings);
+
+    // Each instruction is charged like an addition.
+    const long instructionCost = workingPrecision();
+
+    for (int pc = 0; pc < opcodes.count(); ++pc) {
+        if (isCancelled()) {
+            m_error = Failure(Failure::Cancelled);
+            return CMath::nan();
+        }
+        if (!charge(instructionCost))
+            return CMath::nan();
+        const Opcode& opcode = opcodes.at(pc);
+        index = opcode.index;
+        ProfileScope opcodeProfile(m_profiling
+                                   ? &m_profile.opcodes[opcode.type] : nullptr);
+        switch (opcode.type) {
+            // No operation.
+            case Opcode::Nop:
+                break;
+
+            // Load a constant, push to stack.
+            case Opcode::Load:
+                stack.append(constants.at(index));
+                break;
+
+            // Load an argument. They are NaN while the function is defined.
+            case Opcode::Arg:
+                if (arguments)
+                    stack.append(arguments->at(index));
+                else
+                    pushValue(stack, CMath::nan());
+                break;
+
+            // Load the loop variable of a range function.
+            case Opcode::Counter:
+                if (index < counters->count())
+                    stack.append(counters->at(index));
+                else
+                    pushValue(stack, CMath::nan());
+                break;
+
+            // Keep the top of the stack for a Recall of the same value.
+            case Opcode::Store: {
+                if (checked && stack.count() < 1) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+                if (index >= slots.count())
+                    slots.resize(index + 1);
+                slots[index] = stack.last();
+                const int slotList = findList(slotLists, index);
+                if (slotList >= 0)
+                    slotLists.remove(slotList);
+                const int list = lists.isEmpty()
+                    ? -1 : findList(lists, stack.count());
+                if (list >= 0) {
+                    StackList kept = lists.at(list);
+                    kept.position = index;
+                    slotLists.append(kept);
+                }
+                break;
+            }
+
+            case Opcode::Recall: {
+                if (index >= slots.count()) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+                stack.append(slots.at(index));
+                const int slotList = slotLists.isEmpty()
+                    ? -1 : findList(slotLists, index);
+                if (slotList >= 0) {
+                    StackList list = slotLists.at(slotList);
+                    list.position = stack.count();
+                    lists.append(list);
+                }
+                break;
+            }
+
+            // Skip the body of a range function, it runs when the function
+            // is called. It and the loop variable take a placeholder each.
+            case Opcode::Range:
+                if (checked && index >= opcodes.count() - pc) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+                ranges.append(qMakePair(stack.count(), pc));
+                pushValue(stack, CMath::nan());
+                pushValue(stack, CMath::nan());
+                pc += index;
+                break;
+
+            // Unary operation, on the top of the stack in place. Conversion
+            // to a target resolved by optimize() is one too.
+            case Opcode::Neg:
+            case Opcode::Fact:
+            case Opcode::Sqr:
+            case Opcode::Unit:
+                if (checked && stack.count() < 1) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+                if (!lists.isEmpty()
+                    && findList(lists, stack.count()) >= 0)
+                {
+                    if (!applyToLists(opcode, constants, identifiers, stack,
+                                      lists))
+                        return CMath::nan();
+                } else if (!applyOperator(opcode, constants, identifiers,
+                                          stack.last(), stack.last()))
+                    return CMath::nan();
+                break;
+
+            // Binary operation: take the right operand from the stack
+            // and replace the left one, below it, by the result.
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+            case Opcode::Modulo:
+            case Opcode::IntDiv:
+            case Opcode::LSh:
+            case Opcode::RSh:
+            case Opcode::BAnd:
+            case Opcode::BOr:
+            case Opcode::Conv: {
+                if (checked && stack.count() < 2) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+                if (!lists.isEmpty()
+                    && (findList(lists, stack.count()) >= 0
+                        || findList(lists, stack.count() - 1) >= 0))
+                {
+                    if (!applyToLists(opcode, constants, identifiers, stack,
+                                      lists))
+                        return CMath::nan();
+                    break;
+                }
+                const Quantity rhs = popValue(stack);
+                if (!applyOperator(opcode, constants, identifiers,
+                                   stack.last(), rhs))
+                    return CMath::nan();
+                break;
+            }
+
+            // Reference.
+            case Opcode::Ref: {
+                const IdentifierBinding& binding = bindings.targets.at(index);
+                if (binding.kind == IdentifierBinding::Variable) {
+                    // Variable.
+                    pushValue(stack, binding.variable->value());
+                } else if (binding.kind == IdentifierBinding::List) {
+                    pushValue(stack, CMath::nan());
+                    StackList list;
+                    list.position = stack.count();
+                    list.identifier = index;
+                    list.bound = binding.list;
+                    lists.append(list);
+                } else if (binding.kind == IdentifierBinding::Function
+                           || binding.kind == IdentifierBinding::UserFunction
+                           || m_assignFunc)
+                {
+                    // Function. Arbitrary identifiers are allowed
+                    // when declaring user functions.
+                    pushValue(stack, CMath::nan());
+                    addRef(refs, stack.count(), index);
+                } else {
+                    m_error = Failure(Failure::UnknownIdentifier);
+                    m_error.name = identifiers.at(index);
+                    return CMath::nan();
+                }
+                break;
+            }
+
+            // Calling function.
+            case Opcode::Function: {
+                // Must do this first to avoid crash
+                // when using vars like functions.
+                if (refs.isEmpty())
+                    break;
+
+                {
+                    const int ref = takeRef(refs, stack.count() - index);
+                    const IdentifierBinding& binding = ref >= 0
+                        ? bindings.targets.at(ref) : IdentifierBinding();
+                    fname = ref >= 0 ? identifiers.at(ref) : QString();
+                    function = binding.kind == IdentifierBinding::Function
+                        ? binding.function : nullptr;
+                    userFunction = binding.kind == IdentifierBinding::UserFunction
+                        ? binding.userFunction : nullptr;
+                }
+
+                if (!function && !userFunction && !m_assignFunc) {
+                    m_error = Failure(Failure::UnknownIdentifier);
+                    m_error.name = fname;
+                    return CMath::nan();
+                }
+
+                if (checked && stack.count() < index + 1) {
+                    m_error = Failure(Failure::InvalidExpression);
+                    return CMath::nan();
+                }
+
+                range = takeRef(ranges, stack.count() - index);
+
+                // The lists among the arguments, and the arguments as they
+                // are, for a call element by element.
+                StackLists taken;
+                QVector<Quantity> scalars;
+                QVector<const QVector<Quantity>*> columns;
+                const int count = index;
+                args.clear();
+                if (lists.isEmpty()) {
+                    args.resize(index);
+                    for(; index; --index)
+                        args[index - 1] = popValue(stack);
+                } else
+                    takeArguments(stack, index, lists, args, taken, scalars,
+                                  columns);
+
+                // Remove the NaN we put on the stack (needed to make the user
+                // functions declaration work with arbitrary identifiers).
+                stack.removeLast();
+
+                // Show function signature if user has given no argument (yet).
+                if (userFunction) {
+                    if (!args.count()
+                        && userFunction->arguments().count() != 0)
+                    {
+                        m_error = Failure(Failure::UserFunctionUsage);
+                        m_error.name = userFunction->name();
+                        m_error.arguments = userFunction->arguments();
+                        return CMath::nan();
+                    }
+                } else if (function) {
+                    if (!args.count()) {
+                        m_error = Failure(Failure::FunctionUsage);
+                        m_error.name = fname;
+                        m_error.function = function;
+                        return CMath::nan();
+                    }
+                }
+
+                // A user function runs element by element when it takes
+                // as many arguments as given, but not as many as the lists
+                // give. A builtin one when it rejects the values the lists
+                // give.
+                bool elementwise = !taken.isEmpty() && !m_assignFunc
+                    && userFunction
+                    && userFunction->arguments().count() == count
+                    && args.count() != count;
+                QVector<Quantity> results;
+                if (m_assignFunc) {
+                    // Allow arbitrary identifiers for declaring user functions.
+                    pushValue(stack, CMath::nan());
+                } else if (userFunction) {
+                    {
+                        ProfileScope profile(m_profiling
+                            ? &m_profile.userFunctions[userFunction->name()]
+                            : nullptr);
+                        if (elementwise)
+                            execElementwise(nullptr, userFunction, scalars,
+                                            columns,
+                                            identifiers.at(taken.at(0).identifier),
+                                            results);
+                        else
+                            pushValue(stack,
+                                      execUserFunction(userFunction, args));
+                    }
+                    if (!m_error.isEmpty())
+                        return CMath::nan();
+                } else {
+                    {
+                        ProfileScope profile(m_profiling
+                            ? &m_profile.functions[fname] : nullptr);
+                        Quantity result = range < 0 ? function->exec(args)
+                            : execRange(function,
+                                        opcodes.mid(range + 1,
+                                                    opcodes.at(range).index),
+                                        constants, identifiers, bindings,
+                                        arguments, *counters, args);
+                        elementwise = range < 0 && !taken.isEmpty()
+                            && function->error() == InvalidParamCount;
+                        if (elementwise)
+                            execElementwise(function, nullptr, scalars,
+                                            columns,
+                                            identifiers.at(taken.at(0).identifier),
+                                            results);
+                        else
+                            pushValue(stack, std::move(result));
+                    }
+                    if (!m_error.isEmpty())
+                        return CMath::nan();
+                    if (function->error()) {
+                        m_error = Failure(isCancelled() ? Failure::Cancelled
+                                                        : Failure::FunctionError);
+                        m_error.function = function;
+                        m_error.code = function->error();
+                        return CMath::nan();
+                    }
+                }
+                if (elementwise) {
+                    pushValue(stack, CMath::nan());
+                    StackList list;
+                    list.position = stack.count();
+                    list.identifier = taken.at(0).identifier;
+                    list.computed = std::move(results);
+                    lists.append(std::move(list));
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    if (!lists.isEmpty()) {
+        m_error = listError(identifiers.at(lists.at(0).identifier),
+            tr("a list can only be an argument of a function"));
+        return CMath::nan();
+    }
+
+    // More than one value in stack? Unsuccessful execution.
+    if (stack.count() != 1) {
+        m_error = Failure(Failure::InvalidExpression);
+        return CMath::nan();
+    }
+    return popValue(stack);
+}
+
+// Charges the given work units against the budget, see exec(). Returns
+// false, with m_error set, once it is spent.
+bool Evaluator::charge(long units)
+{
+    if (float_charge(units))
+        return true;
+    m_error = Failure(Failure::OperatorError);
+    m_error.code = TooExpensive;
+    return false;
+}
+
+// Runs the operator of the instruction on lhs in place, with rhs as the
+// right operand of the binary ones. Returns false, with m_error set, if
+// the evaluation must stop; the errors of the results are only recorded.
+bool Evaluator::applyOperator(const Opcode& opcode,
+                              const QVector<Quantity>& constants,
+                              const QStringList& identifiers,
+                              Quantity& lhs, const Quantity& rhs)
+{
+    switch (opcode.type) {
+        case Opcode::Neg:
+            lhs = -lhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Fact:
+            lhs = DMath::factorial(lhs);
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Sqr:
+            lhs = lhs * lhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Unit: {
+            const Quantity& target = constants.at(opcode.index);
+            if (!m_assignFunc && !target.sameDimension(lhs)) {
+                m_error = tr("Conversion failed - dimension mismatch");
+                return false;
+            }
+            lhs.setDisplayUnit(target);
+            break;
+        }
+        case Opcode::Add:
+            lhs = lhs + rhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Sub:
+            lhs = lhs - rhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Mul:
+            lhs = lhs * rhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Div:
+            lhs = lhs / rhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Pow:
+            lhs = DMath::raise(lhs, rhs);
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::Modulo:
+            lhs = lhs % rhs;
+            checkOperatorResult(lhs);
+            break;
+        case Opcode::IntDiv:
+            lhs = lhs / rhs;
+            checkOperatorResult(lhs);
+            lhs = DMath::integer(lhs);
+            break;
+        case Opcode::LSh:
+            lhs = lhs << rhs;
+            break;
+        case Opcode::RSh:
+            lhs = lhs >> rhs;
+            break;
+        case Opcode::BAnd:
+            lhs &= rhs;
+            break;
+        case Opcode::BOr:
+            lhs |= rhs;
+            break;
+        case Opcode::Conv:
+            if (rhs.isZero()) {
+                m_error = tr("unit must not be zero");
+                return false;
+            }
+            // The arguments are still NaN while a function is defined, so
+            // ignore their dimension.
+            if (!m_assignFunc && !rhs.sameDimension(lhs)) {
+                m_error = tr("Conversion failed - dimension mismatch");
+                return false;
+            }
+            lhs.setDisplayUnit(rhs.numericValue(), identifiers.at(opcode.index));
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+// Runs an operator with a list operand on the top of the stack element by
+// element, in one pass over the values. A scalar operand takes part as it
+// is with each element, two lists must have the same length. The result
+// is a list in place of the left operand.
+bool Evaluator::applyToLists(const Opcode& opcode,
+                             const QVector<Quantity>& constants,
+                             const QStringList& identifiers,
+                             QStack<Quantity>& stack, StackLists& lists)
+{
+    const bool unary = opcode.type == Opcode::Neg
+        || opcode.type == Opcode::Fact || opcode.type == Opcode::Sqr
+        || opcode.type == Opcode::Unit;
+    const int right = unary ? -1 : findList(lists, stack.count());
+    const int left = findList(lists, unary ? stack.count()
+                                           : stack.count() - 1);
+    if (opcode.type == Opcode::Conv && right >= 0) {
+        m_error = listError(identifiers.at(lists.at(right).identifier),
+                            tr("a list can not be a unit"));
+        return false;
+    }
+    const QVector<Quantity>* rhs = right >= 0 ? &lists.at(right).values()
+                                              : nullptr;
+    if (left >= 0 && rhs && lists.at(left).values().count() != rhs->count()) {
+        m_error = listError(identifiers.at(lists.at(right).identifier),
+                            tr("the lists have different lengths"));
+        return false;
+    }
+
+    const Quantity scalar = unary ? Quantity() : popValue(stack);
+    if (left < 0) {
+        // The result takes the place of the scalar on the left.
+        lists[right].position = stack.count();
+        StackList& result = lists[right];
+        if (result.bound) {
+            result.computed = *result.bound;
+            result.bound = nullptr;
+        }
+        if (!charge(long(workingPrecision()) * result.computed.count()))
+            return false;
+        const Quantity lhs = stack.last();
+        for (Quantity& value : result.computed) {
+            Quantity element = lhs;
+            if (!applyOperator(opcode, constants, identifiers, element, value)
+                || !m_error.isEmpty())
+                return false;
+            value = std::move(element);
+        }
+        return true;
+    }
+
+    StackList& result = lists[left];
+    if (result.bound) {
+        result.computed = *result.bound;
+        result.bound = nullptr;
+    }
+    if (!charge(long(workingPrecision()) * result.computed.count()))
+        return false;
+    for (int i = 0; i < result.computed.count(); ++i) {
+        Quantity& value = result.computed[i];
+        if (!applyOperator(opcode, constants, identifiers, value,
+                           unary ? value : rhs ? rhs->at(i) : scalar)
+            || !m_error.isEmpty())
+            return false;
+    }
+    if (right >= 0)
+        lists.remove(right);
+    return true;
+}
+
+// Runs a call once for each element of its list arguments, which must all
+// have the same length, each list giving its element in its place and the
+// other arguments the same for all. The results make a list. It stops at
+// the first failing call, with m_error or the error of the function set.
+void Evaluator::execElementwise(Function* function,
+                                const UserFunction* userFunction,
+                                const QVector<Quantity>& scalars,
+                                const QVector<const QVector<Quantity>*>& columns,
+                                const QString& name,
+                                QVector<Quantity>& results)
+{
+    int count = -1;
+    for (const QVector<Quantity>* column : columns) {
+        if (!column)
+            continue;
+        if (count >= 0 && column->count() != count) {
+            m_error = listError(name, tr("the lists have different lengths"));
+            return;
+        }
+        count = column->count();
+    }
+
+    QVector<Quantity> arguments(scalars);
+    results.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (isCancelled()) {
+            m_error = Failure(Failure::Cancelled);
+            return;
+        }
+        for (int j = 0; j < columns.count(); ++j) {
+            if (columns.at(j))
+                arguments[j] = columns.at(j)->at(i);
+        }
+        if (userFunction)
+            results.append(execUserFunction(userFunction, arguments));
+        else
+            results.append(function->exec(arguments));
+        if (!m_error.isEmpty() || (function && function->error()))
+            return;
+    }
+}
+
+// The size of a value, for the convergence tests below.
+static HNumber magnitude(const Quantity& value)
+{
+    return CMath::abs(value.numericValue()).real;
+}
+
+// A point of the tanh-sinh rule: its distance to the ends of the interval,
+// as a fraction of half of it, and its weight.
+struct TanhSinhNode {
+    HNumber distance;
+    HNumber weight;
+};
+
+// The points the tanh-sinh rule adds at the level, for the precision. They
+// are the same for every integral, so they are computed once: the first
+// level takes t = 1, 2, ..., each further one the odd multiples of half
+// the previous step. x = tanh(pi/2 sinh(t)) is kept as its distance to 1,
+// which keeps the digits of the points close to the ends.
+static QHash<QPair<int, int>, QVector<TanhSinhNode>> tanhSinhCache;
+static QMutex tanhSinhMutex;
+
+static QVector<TanhSinhNode> tanhSinhNodes(int digits, int level)
+{
+    QMutexLocker locker(&tanhSinhMutex);
+    const QPair<int, int> key(digits, level);
+    const auto cached = tanhSinhCache.constFind(key);
+    if (cached != tanhSinhCache.constEnd())
+        return cached.value();
+    locker.unlock();
+
+    const HNumber tiny = HMath::raise(HNumber(10), HNumber(-2 * digits));
+    const HNumber halfPi = HMath::pi() / HNumber(2);
+    const HNumber step = HMath::raise(HNumber(2), HNumber(-level));
+    QVector<TanhSinhNode> nodes;
+    for (int k = 1; ; k += level == 0 ? 1 : 2) {
+        const HNumber e = HMath::exp(step * HNumber(k));
+        const HNumber u = HMath::exp(halfPi * (e - HNumber(1) / e));
+        TanhSinhNode node;
+        node.distance = HNumber(2) / (u + HNumber(1));
+        node.weight = halfPi * (e + HNumber(1) / e) * HNumber(2) * u
+            / ((u + HNumber(1)) * (u + HNumber(1)));
+        if (node.weight < tiny)
+            break;
+        nodes.append(node);
+    }
+
+    locker.relock();
+    tanhSinhCache.insert(key, nodes);
+    return nodes;
+}
+
+// Integrates from a to b with the tanh-sinh rule: x = tanh(pi/2 sinh(t))
+// maps the interval on the real line, where the integrand falls off so
+// fast that the trapezoidal rule converges quickly, singularities at the
+// ends included. Each level halves the step and adds the points between
+// those of the previous one. Since it about doubles the digits right, two
+// levels agreeing to half the working precision end it. The integrand is
+// given by evaluate(x, value), false when the evaluation failed.
+template<class Evaluate>
+static Quantity integrateTanhSinh(Evaluate evaluate, const Quantity& a,
+                                  const Quantity& b, int digits)
+{
+    static const int MinimumLevels = 3;
+    static const int MaximumLevels = 8;
+    const HNumber tiny = HMath::raise(HNumber(10), HNumber(-digits));
+    const HNumber tolerance = HMath::raise(HNumber(10), HNumber(-digits / 2));
+    const Quantity half = (b - a) / HNumber(2);
+    const HNumber halfSize = magnitude(half);
+
+    Quantity sum;
+    if (!evaluate(a + half, sum))
+        return CMath::nan();
+    sum = sum * (HMath::pi() / HNumber(2));
+    HNumber total = magnitude(sum);
+    Quantity previous;
+    HNumber step(1);
+    for (int level = 0; level <= MaximumLevels; ++level) {
+        for (const TanhSinhNode& node : tanhSinhNodes(digits, level)) {
+            // Points that round to an end are left out, so the ends are
+            // never evaluated.
+            const Quantity left = a + half * node.distance;
+            const Quantity right = b - half * node.distance;
+            const bool hasLeft = left != a;
+            const bool hasRight = right != b;
+            if (!hasLeft && !hasRight)
+                break;
+
+            HNumber term(0);
+            Quantity value;
+            if (hasLeft) {
+                if (!evaluate(left, value))
+                    return CMath::nan();
+                sum += value * node.weight;
+                term = term + magnitude(value) * node.weight;
+            }
+            if (hasRight) {
+                if (!evaluate(right, value))
+                    return CMath::nan();
+                sum += value * node.weight;
+                term = term + magnitude(value) * node.weight;
+            }
+            if (sum.error())
+                return sum;
+            total = total + term;
+            if (term <= tiny * total)
+                break;
+        }
+
+        const Quantity estimate = sum * step * half;
+        if (level >= MinimumLevels
+            && magnitude(estimate - previous)
+                   <= tolerance * total * step * halfSize)
+            return estimate;
+        previous = estimate;
+        step = step / HNumber(2);
+    }
+    return CMath::nan(EvalUnstable);
+}
+
+// Finds a root with the secant method, from the start values x0 and x1,
+// until a step changes the digits of the working precision no longer.
+// Simple roots are found in a few steps, since the right digits grow
+// about 1.6 times with each. The function is given by evaluate(x, value),
+// false when the evaluation failed.
+template<class Evaluate>
+static Quantity solveSecant(Evaluate evaluate, Quantity x0, Quantity x1,
+                            int digits)
+{
+    static const int MaximumSteps = 100;
+    const HNumber tolerance = HMath::raise(HNumber(10), HNumber(5 - digits));
+
+    Quantity f0, f1;
+    if (!evaluate(x0, f0))
+        return CMath::nan();
+    if (f0.isZero())
+        return x0;
+    if (!evaluate(x1, f1))
+        return CMath::nan();
+    for (int i = 0; i < MaximumSteps; ++i) {
+        if (f1.isZero())
+            return x1;
+        if (f1 == f0)
+            break;
+        Quantity x2 = x1 - f1 * (x1 - x0) / (f1 - f0);
+        if (x2.error())
+            return x2;
+        x0 = x1;
+        f0 = f1;
+        x1 = x2;
+        if (!evaluate(x1, f1))
+            return CMath::nan();
+        if (magnitude(x1 - x0) <= tolerance * magnitude(x1))
+            return x1;
+    }
+    return CMath::nan(EvalUnstable);
+}
+
+// Runs a call of a range function, see isRangeFunction(): the body runs
+// once for each integer from the third argument to the fourth, with the
+// loop variable set to it, and its values are reduced as they come, so
+// none is kept. The first two arguments are the placeholders of the body
+// and of the loop variable. The loop variable is not a variable of the
+// session, the counters of the running program hold it. integrate() and
+// solve() run the body for the points their method asks for instead.
+Quantity Evaluator::execRange(Function* function,
+                              const QVector<Opcode>& body,
+                              const QVector<Quantity>& constants,
+                              const QStringList& identifiers,
+                              IdentifierBindings& bindings,
+                              const QVector<Quantity>* arguments,
+                              QVector<Quantity>& counters,
+                              const QVector<Quantity>& args)
+{
+    function->setError(Success);
+    const QString& name = function->identifier();
+    const bool isIntegral = name == QLatin1String("integrate");
+    const bool isRoot = name == QLatin1String("solve");
+    if (isRoot ? args.count() != 3 && args.count() != 4 : args.count() != 4) {
+        function->setError(InvalidParamCount);
+        return CMath::nan(InvalidParamCount);
+    }
+
+    if (isIntegral || isRoot) {
+        const Quantity& start = args.at(2);
+        const bool valid = isIntegral
+            ? start.isReal() && args.at(3).isReal()
+            : !start.isNan() && (args.count() == 3 || !args.at(3).isNan());
+        if (!valid) {
+            function->setError(OutOfDomain);
+            return CMath::nan(OutOfDomain);
+        }
+        if (args.count() == 4 && !start.sameDimension(args.at(3))) {
+            function->setError(InvalidDimension);
+            return CMath::nan(InvalidDimension);
+        }
+
+        const int slot = counters.count();
+        counters.append(Quantity());
+        auto evaluate = [&](const Quantity& x, Quantity& value) {
+            counters[slot] = x;
+            value = exec(body, constants, identifiers, bindings, -1,
+                         arguments, &counters);
+            return m_error.isEmpty();
+        };
+        Quantity result;
+        if (isIntegral)
+            result = integrateTanhSinh(evaluate, start, args.at(3),
+                                       workingPrecision());
+        else {
+            // Without a second start value, one close to the first.
+            const Quantity next = args.count() == 4 ? args.at(3)
+                : start.isZero() ? start + Quantity(HNumber("1e-5"))
+                                 : start * HNumber("1.00001");
+            result = solveSecant(evaluate, start, next, workingPrecision());
+        }
+        counters.removeLast();
+        if (result.error())
+            function->setError(result.error());
+        return result;
+    }
+
+    const Quantity& from = args.at(2);
+    const Quantity& to = args.at(3);
+    if (!from.isInteger() || !to.isInteger()) {
+        function->setError(OutOfDomain);
+        return CMath::nan(OutOfDomain);
+    }
+
+    const bool isSum = name == QLatin1String("sumrange");
+    const bool isProduct = name == QLatin1String("productrange");
+    const bool isMinimum = name == QLatin1String("minrange");
+    RunningStatistics statistics;
+    Quantity result = isProduct ? Quantity(1) : Quantity(0);
+    bool empty = true;
+
+    const HNumber last = to.numericValue().real;
+    const int slot = counters.count();
+    counters.append(Quantity());
+    for (HNumber k = from.numericValue().real; k <= last; k = k + HNumber(1)) {
+        counters[slot] = Quantity(k);
+        const Quantity value = exec(body, constants, identifiers, bindings,
+                                    -1, arguments, &counters);
+        if (!m_error.isEmpty())
+            break;
+
+        if (isSum)
+            statistics.add(value);
+        else if (isProduct)
+            result = result * value;
+        else if (!value.isReal() || (!empty && !value.sameDimension(result))) {
+            result = CMath::nan(!value.isReal() ? OutOfDomain
+                                                : InvalidDimension);
+        } else if (empty || (isMinimum ? value < result : value > result))
+            result = value;
+        empty = false;
+        if (result.error())
+            break;
+    }
+    counters.removeLast();
+
+    if (isSum)
+        result = statistics.sum();
+    else if (empty && !isProduct)
+        result = CMath::nan(OutOfDomain);
+    if (result.error())
+        function->setError(result.error());
+    return result;
+}
+
+// The preview program runs on doubles. Each value carries a bound on its
+// relative error, so the result can be rounded to the digits it got right,
+// or be given up on when too few are left.
+struct PreviewValue {
+    double value;
+    double error;
+};
+
+struct PreviewFunction {
+    const char* name;
+    double (*fn)(double);
+    bool angleArgument;
+    bool angleResult;
+};
+
+static const PreviewFunction previewFunctions[] = {
+    { "abs", ::fabs, false, false },
+    { "arccos", ::acos, false, true },
+    { "arcsin", ::asin, false, true },
+    { "arctan", ::atan, false, true },
+    { "cbrt", ::cbrt, false, false },
+    { "cos", ::cos, true, false },
+    { "cosh", ::cosh, false, false },
+    { "exp", ::exp, false, false },
+    { "lb", ::log2, false, false },
+    { "lg", ::log10, false, false },
+    { "ln", ::log, false, false },
+    { "sin", ::sin, true, false },
+    { "sinh", ::sinh, false, false },
+    { "sqrt", ::sqrt, false, false },
+    { "tan", ::tan, true, false },
+    { "tanh", ::tanh, false, false },
+};
+
+// Rounding error of one double operation, and a few of them for a libm call.
+static const double PreviewRoundoff = DBL_EPSILON / 2;
+static const double PreviewLibmError = 4 * PreviewRoundoff;
+// Fewer correct digits than this and the preview is evaluated in full.
+static const int PreviewMinimumDigits = 12;
+static const double PreviewPi = 3.14159265358979323846;
+// Integers up to this magnitude are exact doubles.
+static const double PreviewExactLimit = 9007199254740992.0;
+
+static const PreviewFunction* findPreviewFunction(const QString& name)
+{
+    for (const PreviewFunction& f : previewFunctions)
+        if (name == QLatin1String(f.name))
+            return &f;
+    return nullptr;
+}
+
+static bool previewValue(const Quantity& q, PreviewValue* v)
+{
+    if (q.isNan() || !q.isReal() || !q.isDimensionless() || q.hasUnit()
+        || !q.format().isNull())
+        return false;
+    const HNumber x = q.numericValue().real;
+    bool ok;
+    v->value = HMath::format(x, HNumber::Format::Scientific()
+                             + HNumber::Format::Precision(DBL_DIG + 2)).toDouble(&ok);
+    if (!ok || !std::isfinite(v->value))
+        return false;
+    if (v->value != 0 && std::fabs(v->value) < DBL_MIN)
+        return false;
+    const bool exact = x.isInteger() && std::fabs(v->value) <= PreviewExactLimit;
+    v->error = exact ? 0 : PreviewRoundoff;
+    return true;
+}
+
+// Checks a computed value. A zero is only taken when it is exact, since
+// nothing is known of the relative error of a rounded one.
+static bool previewResult(double value, double error, PreviewValue* v)
+{
+    if (!std::isfinite(value) || !(error < 1))
+        return false;
+    if (value == 0 ? error != 0 : std::fabs(value) < DBL_MIN)
+        return false;
+    v->value = value;
+    v->error = error;
+    return true;
+}
+
+// Results of exact operands that are exact doubles again keep no error.
+static double previewRounding(const PreviewValue& a, const PreviewValue& b,
+                              double value)
+{
+    if (a.error == 0 && b.error == 0 && std::fabs(value) <= PreviewExactLimit
+        && value == std::trunc(value))
+        return 0;
+    return PreviewRoundoff;
+}
+
+static bool previewAdd(const PreviewValue& a, const PreviewValue& b,
+                       PreviewValue* r)
+{
+    const double value = a.value + b.value;
+    if (value == 0)
+        return a.error == 0 && b.error == 0 && previewResult(0, 0, r);
+    // Cancellation shows up here: the operands' errors grow relative to
+    // a small sum.
+    const double error = (std::fabs(a.value) * a.error
+                          + std::fabs(b.value) * b.error) / std::fabs(value);
+    return previewResult(value, error + previewRounding(a, b, value), r);
+}
+
+static bool previewMul(const PreviewValue& a, const PreviewValue& b,
+                       PreviewValue* r)
+{
+    const double value = a.value * b.value;
+    if (value == 0)
+        return (a.value == 0 || b.value == 0) && previewResult(0, 0, r);
+    return previewResult(value, a.error + b.error + previewRounding(a, b, value), r);
+}
+
+static bool previewDiv(const PreviewValue& a, const PreviewValue& b,
+                       PreviewValue* r)
+{
+    // Leave the division by zero to the full evaluation, which reports it.
+    if (b.value == 0)
+        return false;
+    const double value = a.value / b.value;
+    if (value == 0)
+        return a.value == 0 && previewResult(0, 0, r);
+    return previewResult(value, a.error + b.error + previewRounding(a, b, value), r);
+}
+
+static bool previewPow(const PreviewValue& a, const PreviewValue& b,
+                       PreviewValue* r)
+{
+    const double value = std::pow(a.value, b.value);
+    if (a.value == 0)
+        return b.value > 0 && previewResult(0, 0, r);
+    if (a.value < 0) {
+        // Only an exact integer exponent keeps the result real.
+        if (b.error != 0 || b.value != std::trunc(b.value))
+            return false;
+        return previewResult(value, std::fabs(b.value) * a.error
+                             + previewRounding(a, b, value) + PreviewLibmError, r);
+    }
+    // The relative error of the result is the absolute one of b ln a.
+    const double error = std::fabs(b.value) * a.error
+        + std::fabs(b.value * std::log(a.value)) * b.error;
+    return previewResult(value, error + PreviewLibmError, r);
+}
+
+// Estimates how the relative error of the argument carries over to the
+// result, |x f'(x) / f(x)|. NaN when f is not defined nearby.
+static double previewCondition(double (*fn)(double), double x, double fx)
+{
+    if (x == 0)
+        return 0;
+    const double h = x * 1e-6;
+    return 2 * std::fabs((fn(x + h) - fx) / h * x / fx);
+}
+
+static bool previewFunction(const PreviewFunction* f, PreviewValue x,
+                            PreviewValue* r)
+{
+    const char angleUnit = Settings::instance()->angleUnit;
+    const double angleScale = angleUnit == 'd' ? PreviewPi / 180
+                              : angleUnit == 'g' ? PreviewPi / 200 : 1;
+    if (f->angleArgument && angleScale != 1) {
+        x.value *= angleScale;
+        x.error += 2 * PreviewRoundoff;
+    }
+    double value = f->fn(x.value);
+    if (value == 0)
+        return x.value == 0 && x.error == 0 && previewResult(0, 0, r);
+    const double condition = previewCondition(f->fn, x.value, value);
+    if (!(condition < 1e6))
+        return false;
+    double error = condition * x.error + PreviewLibmError;
+    if (f->angleResult && angleScale != 1) {
+        value /= angleScale;
+        error += 2 * PreviewRoundoff;
+    }
+    return previewResult(value, error, r);
+}
+
+/**
+ * Lowers a compiled program for runPreview(): its constants are converted
+ * to doubles and its identifiers resolved once, so that a user function
+ * called over and over in a preview is not decoded again at each call.
+ * Returns false when the program uses something runPreview() does not
+ * handle. A program with arguments is the body of a user function.
+ */
+bool Evaluator::lowerPreview(const QVector<Opcode>& opcodes,
+                             const QVector<Quantity>& constants,
+                             const QStringList& identifiers,
+                             IdentifierBindings& bindings, int arguments,
+                             PreviewProgram& program) const
+{
+    bind(identifiers, bindings);
+    program.clear();
+    program.reserve(opcodes.count());
+    PreviewValue value;
+    for (int pc = 0; pc < opcodes.count(); ++pc) {
+        const Opcode& opcode = opcodes.at(pc);
+        PreviewStep step;
+        step.type = opcode.type;
+        step.index = opcode.index;
+        switch (opcode.type) {
+            case Opcode::Nop:
+                continue;
+
+            case Opcode::Load:
+                if (!previewValue(constants.at(opcode.index), &value))
+                    return false;
+                step.value = value.value;
+                step.error = value.error;
                 break;
 
-            // Unary operation.
-            case Opcode::Neg:
-                if (stack.count() < 1) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val1 = checkOperatorResult(-val1);
-                stack.push(val1);
+            case Opcode::Arg:
+                if (int(opcode.index) >= arguments)
+                    return false;
                 break;
 
-            // Binary operation: take two values from stack,
-            // do the operation, push the result to stack.
+            case Opcode::Neg:
+            case Opcode::Store:
+            case Opcode::Recall:
+            case Opcode::Sqr:
             case Opcode::Add:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 + val1);
-                stack.push(val2);
-                break;
-
             case Opcode::Sub:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 - val1);
-                stack.push(val2);
-                break;
-
             case Opcode::Mul:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 * val1);
-                stack.push(val2);
-                break;
-
             case Opcode::Div:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 / val1);
-                stack.push(val2);
-                break;
-
             case Opcode::Pow:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(DMath::raise(val2, val1));
-                stack.push(val2);
+            case Opcode::Function:
                 break;
 
-            case Opcode::Fact:
-                if (stack.count() < 1) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val1 = checkOperatorResult(DMath::factorial(val1));
-                stack.push(val1);
+            case Opcode::Ref: {
+                const IdentifierBinding& binding = bindings.targets.at(opcode.index);
+                if (binding.kind == IdentifierBinding::Variable)
+                    step.variable = binding.variable;
+                else if (binding.kind == IdentifierBinding::UserFunction)
+                    step.userFunction = binding.userFunction;
+                else if (const PreviewFunction* f
+                         = findPreviewFunction(identifiers.at(opcode.index)))
+                    step.index = quint32(f - previewFunctions);
+                else
+                    return false;
                 break;
+            }
 
-            case Opcode::Modulo:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 % val1);
-                stack.push(val2);
+            default:
+                return false;
+        }
+        program.append(step);
+    }
+    return true;
+}
+
+// The lowered body of a user function, kept until the bindings of the
+// session change. False when it cannot be run in doubles.
+bool Evaluator::previewProgram(const UserFunction* function,
+                               PreviewProgram& program)
+{
+    const unsigned revision = m_session ? m_session->bindingRevision() : 0;
+    if (m_previewSession != m_session || m_previewRevision != revision) {
+        m_previewPrograms.clear();
+        m_previewSession = m_session;
+        m_previewRevision = revision;
+    }
+
+    auto lowered = m_previewPrograms.constFind(function);
+    if (lowered == m_previewPrograms.constEnd()) {
+        PreviewProgram body;
+        if (!lowerPreview(function->opcodes, function->constants,
+                          function->identifiers, function->bindings,
+                          function->arguments().count(), body))
+        {
+            body.clear();
+        }
+        lowered = m_previewPrograms.insert(function, body);
+    }
+    // A copy, the programs of the functions it calls are added meanwhile.
+    program = lowered.value();
+    return !program.isEmpty();
+}
+
+// Runs a lowered program in hardware doubles, with the given arguments
+// for the body of a user function. Returns false when a value is out of
+// reach of the previews, see execPreview().
+bool Evaluator::runPreview(const PreviewProgram& program,
+                           const PreviewValue* arguments,
+                           PreviewValue* result)
+{
+    QStack<PreviewValue> stack;
+    QVector<PreviewValue> slots;
+    QHash<int, const PreviewStep*> refs;
+    PreviewValue val1, val2, res;
+
+    for (const PreviewStep& step : program) {
+        switch (step.type) {
+            case Opcode::Load:
+                val1.value = step.value;
+                val1.error = step.error;
+                stack.push(val1);
                 break;
 
-            case Opcode::IntDiv:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = checkOperatorResult(val2 / val1);
-                stack.push(DMath::integer(val2));
+            case Opcode::Arg:
+                stack.push(arguments[step.index]);
                 break;
 
-            case Opcode::LSh:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return DMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = val2 << val1;
-                stack.push(val2);
+            case Opcode::Neg:
+                if (stack.count() < 1)
+                    return false;
+                stack.top().value = -stack.top().value;
                 break;
 
-            case Opcode::RSh:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return DMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 = val2 >> val1;
-                stack.push(val2);
+            case Opcode::Store:
+                if (stack.count() < 1)
+                    return false;
+                if (int(step.index) >= slots.count())
+                    slots.resize(step.index + 1);
+                slots[step.index] = stack.top();
                 break;
 
-            case Opcode::BAnd:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return DMath::nan();
-                }
-                val1 = stack.pop();
-                val2 = stack.pop();
-                val2 &= val1;
-                stack.push(val2);
+            case Opcode::Recall:
+                if (int(step.index) >= slots.count())
+                    return false;
+                stack.push(slots.at(step.index));
                 break;
 
-            case Opcode::BOr:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return DMath::nan();
-                }
+            case Opcode::Sqr:
+                if (stack.count() < 1)
+                    return false;
                 val1 = stack.pop();
-                val2 = stack.pop();
-                val2 |= val1;
-                stack.push(val2);
+                if (!previewMul(val1, val1, &res))
+                    return false;
+                stack.push(res);
                 break;
 
-            case Opcode::Conv:
-                if (stack.count() < 2) {
-                    m_error = tr("invalid expression");
-                    return HMath::nan();
-                }
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+                if (stack.count() < 2)
+                    return false;
                 val1 = stack.pop();
                 val2 = stack.pop();
-                if (val1.isZero()) {
-                    m_error = tr("unit must not be zero");
-                    return HMath::nan();
-                }
-                if (!val1.sameDimension(val2)) {
-                    m_error = tr("Conversion failed - dimension mismatch");
-                    return HMath::nan();
-                }
-                val2.setDisplayUnit(val1.numericValue(), opcode.text);
-                stack.push(val2);
+                if (step.type == Opcode::Sub)
+                    val1.value = -val1.value;
+                if ((step.type == Opcode::Add || step.type == Opcode::Sub)
+                    && !previewAdd(val2, val1, &res))
+                    return false;
+                if (step.type == Opcode::Mul && !previewMul(val2, val1, &res))
+                    return false;
+                if (step.type == Opcode::Div && !previewDiv(val2, val1, &res))
+                    return false;
+                if (step.type == Opcode::Pow && !previewPow(val2, val1, &res))
+                    return false;
+                stack.push(res);
                 break;
 
-            // Reference.
             case Opcode::Ref:
-                fname = identifiers.at(index);
-                if (m_assignArg.contains(fname)) {
-                    // Argument.
-                    stack.push(CMath::nan());
-                } else if (hasVariable(fname)) {
-                    // Variable.
-                    stack.push(getVariable(fname).value());
+                if (step.variable) {
+                    if (!previewValue(step.variable->value(), &val1))
+                        return false;
+                    stack.push(val1);
                 } else {
-                    // Function.
-                    function = FunctionRepo::instance()->find(fname);
-                    if (function) {
-                        stack.push(CMath::nan());
-                        refs.insert(stack.count(), fname);
-                    } else if (m_assignFunc) {
-                        // Allow arbitrary identifiers
-                        // when declaring user functions.
-                        stack.push(CMath::nan());
-                        refs.insert(stack.count(), fname);
-                    } else if (hasUserFunction(fname)) {
-                        stack.push(CMath::nan());
-                        refs.insert(stack.count(), fname);
-                    } else {
-                        m_error = "<b>" + fname + "</b>: "
-                                  + tr("unknown function or variable");
-                        return CMath::nan();
-                    }
+                    stack.push(PreviewValue());
+                    refs.insert(stack.count(), &step);
                 }
                 break;
 
-            // Calling function.
-            case Opcode::Function:
-                // Must do this first to avoid crash
-                // when using vars like functions.
+            case Opcode::Function: {
                 if (refs.isEmpty())
                     break;
-
-                fname = refs.take(stack.count() - index);
-                function = FunctionRepo::instance()->find(fname);
-
-                userFunction = nullptr;
-                if (!function) {
-                    // Check if this is a valid user function call.
-                    userFunction = getUserFunction(fname);
-                }
-
-                if (!function && !userFunction && !m_assignFunc) {
-                    m_error = "<b>" + fname + "</b>: "
-                              + tr("unknown function or variable");
-                    return CMath::nan();
+                const PreviewStep* ref = refs.take(stack.count() - step.index);
+                const int count = step.index;
+                if (!ref || stack.count() < count + 1)
+                    return false;
+
+                if (!ref->userFunction) {
+                    if (count != 1)
+                        return false;
+                    val1 = stack.pop();
+                    stack.pop();
+                    if (!previewFunction(&previewFunctions[ref->index], val1, &res))
+                        return false;
+                    stack.push(res);
+                    break;
                 }
 
-                if (stack.count() < index) {
-                    m_error = tr("invalid expression");
-                    return CMath::nan();
+                // Recursion and usage errors are left to the full
+                // evaluation, which reports them.
+                const UserFunction* function = ref->userFunction;
+                PreviewProgram body;
+                if (count != function->arguments().count()
+                    || m_functionsInUse.contains(function)
+                    || !previewProgram(function, body))
+                {
+                    return false;
                 }
-
-                args.clear();
-                for(; index; --index)
-                    args.insert(args.begin(), stack.pop());
-
-                // Remove the NaN we put on the stack (needed to make the user
-                // functions declaration work with arbitrary identifiers).
+                QVarLengthArray<PreviewValue, 8> args(count);
+                for (int i = count; i > 0; --i)
+                    args[i - 1] = stack.pop();
                 stack.pop();
-
-                // Show function signature if user has given no argument (yet).
-                if (userFunction) {
-                    if (!args.count()
-                        && userFunction->arguments().count() != 0)
-                    {
-                        m_error = QString::fromLatin1("<b>%1</b>(%2)").arg(
-                            userFunction->name(),
-                            userFunction->arguments().join(";")
-                        );
-                        return CMath::nan();
-                    }
-                } else if (function) {
-                    if (!args.count()) {
-                        m_error = QString::fromLatin1("<b>%1</b>(%2)").arg(
-                            fname,
-                            function->usage()
-                        );
-                        return CMath::nan();
-                    }
-                }
-
-                if (m_assignFunc) {
-                    // Allow arbitrary identifiers for declaring user functions.
-                    stack.push(CMath::nan());
-                } else if (userFunction) {
-                    stack.push(execUserFunction(userFunction, args));
-                    if (!m_error.isEmpty())
-                        return CMath::nan();
-                } else {
-                    stack.push(function->exec(args));
-                    if (function->error()) {
-                        m_error = stringFromFunctionError(function);
-                        return CMath::nan();
-                    }
-                }
+                m_functionsInUse.append(function);
+                const bool ok = runPreview(body, args.constData(), &res);
+                m_functionsInUse.removeLast();
+                if (!ok)
+                    return false;
+                stack.push(res);
                 break;
+            }
 
             default:
-                break;
+                return false;
         }
     }
 
-    // More than one value in stack? Unsuccessful execution.
-    if (stack.count() != 1) {
-        m_error = tr("invalid expression");
-        return CMath::nan();
+    if (stack.count() != 1 || !refs.isEmpty())
+        return false;
+    *result = stack.pop();
+    return true;
+}
+
+/**
+ * Evaluates the compiled program in hardware doubles, for the previews.
+ * Returns false when the program uses something else than real,
+ * dimensionless numbers, the four operations, powers, the functions of
+ * previewFunctions and user functions made of those, or when the double
+ * result may be off in the digits shown.
+ */
+bool Evaluator::execPreview(const QVector<Opcode>& opcodes,
+                            const QVector<Quantity>& constants,
+                            const QStringList& identifiers,
+                            IdentifierBindings& bindings,
+                            Quantity* result)
+{
+    PreviewProgram program;
+    PreviewValue value;
+    if (!lowerPreview(opcodes, constants, identifiers, bindings, 0, program)
+        || !runPreview(program, nullptr, &value))
+    {
+        return false;
+    }
+
+    // Keep the digits the error bound vouches for, and never let a rounded
+    // integer part show made up digits.
+    QString text;
+    if (value.error == 0)
+        text = QString::number(value.value, 'g', DBL_DIG + 2);
+    else {
+        const int digits = qMin(DBL_DIG, int(-std::log10(value.error)));
+        if (digits < PreviewMinimumDigits
+            || std::fabs(value.value) >= std::pow(10.0, digits))
+            return false;
+        text = QString::number(value.value, 'e', digits - 1);
     }
-    return stack.pop();
+    *result = HNumber(text.toLatin1().constData());
+    return true;
 }
 
 Quantity Evaluator::execUserFunction(const UserFunction* function,
@@ -2215,42 +4816,119 @@ Quantity Evaluator::execUserFunction(const UserFunction* function,
         return CMath::nan();
     }
 
-    if (m_functionsInUse.contains(function->name())) {
+    if (m_functionsInUse.contains(function)) {
            m_error = "<b>" + function->name() + "</b>: "
                      + tr("recursion not supported");
            return CMath::nan();
     }
-    m_functionsInUse.insert(function->name());
 
-    QVector<Opcode> newOpcodes;
-    auto newConstants = function->constants; // Copy.
+    UserFunction::Memo& memo = function->memo;
+    const bool memoize = isMemoizable(function, arguments);
+    if (memoize) {
+        const int index = memo.arguments.indexOf(arguments);
+        if (index >= 0)
+            return memo.results.at(index);
+    }
 
-    // Replace references to function arguments by constants.
-    for (int i = 0; i < function->opcodes.count(); ++i) {
-        Opcode opcode = function->opcodes.at(i);
+    m_functionsInUse.append(function);
 
-        if (opcode.type == Opcode::Ref) {
-            // Check if the identifier is an argument name.
-            QString name = function->identifiers.at(opcode.index);
-            int argIdx = function->arguments().indexOf(name);
-            if (argIdx >= 0) {
-                // Replace the reference by a constant value.
-                opcode = Opcode(Opcode::Load, newConstants.count());
-                newConstants.append(arguments.at(argIdx));
-            }
+    // The body reads its arguments from their slots, see Opcode::Arg.
+    auto result = exec(function->opcodes, function->constants,
+                       function->identifiers, function->bindings,
+                       function->stackDepth, &arguments);
+    if (!m_error.isEmpty()) {
+        // Tell the user where the error happened.
+        m_error.callers.append(function->name());
+    } else if (memoize) {
+        if (memo.arguments.count() < UserFunctionMemoSize) {
+            memo.arguments.append(arguments);
+            memo.results.append(result);
+        } else {
+            memo.arguments[memo.next] = arguments;
+            memo.results[memo.next] = result;
+            memo.next = (memo.next + 1) % UserFunctionMemoSize;
         }
+    }
+
+    m_functionsInUse.removeLast();
+    return result;
+}
 
-        newOpcodes.append(opcode);
+// Whether the result of a user function only depends on its arguments:
+// it refers to no variable but the builtin constants and only calls
+// functions that are pure themselves. The settings it may depend on,
+// like the angle unit, are part of the validity of its memo.
+bool Evaluator::isPure(const UserFunction* function,
+                       QVector<const UserFunction*>& visited) const
+{
+    if (visited.contains(function))
+        return true;
+    visited.append(function);
+
+    bind(function->identifiers, function->bindings);
+    for (int i = 0; i < function->identifiers.count(); ++i) {
+        const IdentifierBinding& binding = function->bindings.targets.at(i);
+        switch (binding.kind) {
+            case IdentifierBinding::Variable:
+                if (binding.variable->type() != Variable::BuiltIn
+                    || binding.variable->identifier() == QLatin1String("ans"))
+                    return false;
+                break;
+            case IdentifierBinding::Function:
+                break;
+            case IdentifierBinding::UserFunction:
+                if (!isPure(binding.userFunction, visited))
+                    return false;
+                break;
+            default:
+                return false;
+        }
     }
+    return true;
+}
 
-    auto result = exec(newOpcodes, newConstants, function->identifiers);
-    if (!m_error.isEmpty()) {
-        // Tell the user where the error happened.
-        m_error = "<b>" + function->name() + "</b>: " + m_error;
+// Whether a call of the user function is looked up in and added to its
+// memo. That is the case for pure functions that call other functions,
+// for which a lookup is cheaper than running the body, and for arguments
+// that are plain numbers, whose results don't carry their format or unit.
+bool Evaluator::isMemoizable(const UserFunction* function,
+                             const QVector<Quantity>& arguments) const
+{
+    if (m_assignFunc || !m_session)
+        return false;
+
+    UserFunction::Memo& memo = function->memo;
+    const char angleUnit = Settings::instance()->angleUnit;
+    const unsigned revision = m_session->bindingRevision();
+    const int precision = workingPrecision();
+    if (!memo.valid || memo.session != m_session || memo.revision != revision
+        || memo.angleUnit != angleUnit || memo.complexMode != DMath::complexMode
+        || memo.precision != precision)
+    {
+        memo = UserFunction::Memo();
+        memo.valid = true;
+        memo.session = m_session;
+        memo.revision = revision;
+        memo.angleUnit = angleUnit;
+        memo.complexMode = DMath::complexMode;
+        memo.precision = precision;
+
+        bool calls = false;
+        for (int i = 0; i < function->opcodes.count() && !calls; ++i)
+            calls = function->opcodes.at(i).type == Opcode::Function;
+        QVector<const UserFunction*> visited;
+        memo.enabled = calls && isPure(function, visited);
     }
 
-    m_functionsInUse.remove(function->name());
-    return result;
+    if (!memo.enabled)
+        return false;
+    for (int i = 0; i < arguments.count(); ++i) {
+        const Quantity& argument = arguments.at(i);
+        if (argument.isNan() || argument.hasUnit()
+            || !argument.format().isNull())
+            return false;
+    }
+    return true;
 }
 
 bool Evaluator::isUserFunctionAssign() const
@@ -2271,6 +4949,98 @@ bool Evaluator::isBuiltInVariable(const QString& id) const
     return m_session->getVariable(id).type() == Variable::BuiltIn;
 }
 
+/**
+ * Evaluates the expression like evalNoAssign(), in hardware doubles when
+ * that is safe. The result is then rounded to the digits a double gets
+ * right, which is fine for the auto-calc previews but not for a result the
+ * user asked for. Falls back to the full precision otherwise, and whenever
+ * anything goes wrong so that the error message is the same.
+ *
+ * A precision below the working precision makes the fallback compute with
+ * that many digits only. Such a rough result is flagged by isPreviewRough()
+ * and should be replaced by a preview at full precision later.
+ */
+Quantity Evaluator::evalPreview(int precision)
+{
+    m_previewRough = false;
+    {
+        WorkingPrecisionScope precision(workingPrecision());
+        if (!compileExpression())
+            return Quantity(0);
+    }
+
+    // The rounded digits would show in a binary, octal or hexadecimal
+    // result, and a double has more than a small working precision.
+    const char format = Settings::instance()->resultFormat;
+    Quantity result;
+    if (!m_assignFunc && format != 'b' && format != 'o' && format != 'h'
+        && workingPrecision() > DBL_DIG
+        && execPreview(m_codes, m_constants, m_identifiers, m_bindings, &result))
+    {
+        return result;
+    }
+    if (precision <= 0 || precision >= workingPrecision())
+        return evalNoAssign();
+
+    // The code compiled for the working precision runs fine with fewer
+    // digits, its constants are just more precise than needed.
+    const int save = m_workingPrecision;
+    m_workingPrecision = precision;
+    result = evalNoAssign();
+    m_workingPrecision = save;
+    m_previewRough = !hasError();
+    return result;
+}
+
+bool Evaluator::isPreviewRough() const
+{
+    return m_previewRough;
+}
+
+/**
+ * Returns the memory the caches of the evaluator take, roughly: the
+ * compiled expressions, the parsed literals, the lowered user functions,
+ * the last scan and the integration points, which all evaluators share.
+ * A compiled expression is counted as twice its text, the cache is not
+ * looked into so as not to change which entries it keeps.
+ */
+qint64 Evaluator::cacheBytes() const
+{
+    qint64 bytes = 0;
+    const QStringList compiled = m_compiledExpressions.keys();
+    for (const QString& key : compiled)
+        bytes += sizeof(CompiledExpression) + 4 * qint64(key.size());
+    const QStringList literals = m_literals.keys();
+    for (const QString& key : literals)
+        bytes += sizeof(Quantity) + 2 * qint64(key.size())
+                 + HMath::workingPrecision();
+    for (const PreviewProgram& program : m_previewPrograms)
+        bytes += program.capacity() * qint64(sizeof(PreviewStep));
+    bytes += 2 * qint64(m_scanCache.text.capacity())
+             + m_scanCache.tokens.count() * qint64(sizeof(Token))
+             + m_scanCache.reaches.capacity() * qint64(sizeof(int));
+
+    QMutexLocker locker(&tanhSinhMutex);
+    for (auto i = tanhSinhCache.constBegin(); i != tanhSinhCache.constEnd(); ++i)
+        bytes += i.value().count() * qint64(2 * (sizeof(HNumber) + i.key().first));
+    return bytes;
+}
+
+/**
+ * Drops the caches cacheBytes() counts. They fill up again as expressions
+ * are evaluated.
+ */
+void Evaluator::trimCaches()
+{
+    m_compiledExpressions.clear();
+    m_literals.clear();
+    m_previewPrograms.clear();
+    m_scanCache = ScanCache();
+
+    QMutexLocker locker(&tanhSinhMutex);
+    tanhSinhCache.clear();
+}
+
 Quantity Evaluator::eval()
 {
     Quantity result = evalNoAssign(); // This sets m_assignId.
@@ -2316,6 +5086,8 @@ Quantity Evaluator::eval()
             userFunction.constants = m_constants;
             userFunction.identifiers = m_identifiers;
             userFunction.opcodes = m_codes;
+            userFunction.stackDepth = m_stackDepth;
+            userFunction.precision = workingPrecision();
 
             setUserFunction(userFunction);
 
@@ -2326,8 +5098,17 @@ Quantity Evaluator::eval()
                 return CMath::nan();
             }
 
-            setVariable(m_assignId, result);
+            Variable variable(m_assignId, result);
+            variable.setExpression(m_expression.section("=", 1, 1).trimmed());
+            if (!m_session) {
+                m_ownSession.reset(new Session);
+                m_session = m_ownSession.data();
+            }
+            m_session->addVariable(variable);
         }
+
+        if (Settings::instance()->autoRecalculation)
+            recalculate(m_assignId);
     }
 
     return result;
@@ -2341,11 +5122,106 @@ Quantity Evaluator::evalUpdateAns()
     return result;
 }
 
+/**
+ * Computes again the user variables whose expressions depend on the given
+ * variable or function, directly or through other definitions, each after
+ * the ones it refers to. A variable that fails keeps its value, those on
+ * a reference cycle are left alone. Returns the variables updated, in the
+ * order they were computed. The current expression is kept.
+ */
+QStringList Evaluator::recalculate(const QString& identifier)
+{
+    QStringList updated;
+    if (!m_session)
+        return updated;
+
+    // What each definition refers to. A variable using ans is not computed
+    // again: ans changes with every result.
+    QHash<QString, QSet<QString>> references;
+    for (const Variable& variable : getUserDefinedVariables()) {
+        if (variable.expression().isEmpty())
+            continue;
+        QSet<QString> names;
+        for (const Token& token : scan(variable.expression()))
+            if (token.isIdentifier())
+                names.insert(token.text());
+        if (!names.contains(QLatin1String("ans")))
+            references.insert(variable.identifier(), names);
+    }
+    for (const UserFunction& function : getUserFunctions()) {
+        QSet<QString> names;
+        for (const QString& name : function.identifiers)
+            if (!function.arguments().contains(name))
+                names.insert(name);
+        references.insert(function.name(), names);
+    }
+
+    QHash<QString, QStringList> dependents;
+    for (auto i = references.constBegin(); i != references.constEnd(); ++i)
+        for (const QString& name : i.value())
+            dependents[name].append(i.key());
+
+    QSet<QString> affected;
+    QStringList pending(identifier);
+    while (!pending.isEmpty()) {
+        const QString name = pending.takeLast();
+        for (const QString& dependent : dependents.value(name)) {
+            if (dependent != identifier && !affected.contains(dependent)) {
+                affected.insert(dependent);
+                pending.append(dependent);
+            }
+        }
+    }
+    if (affected.isEmpty())
+        return updated;
+
+    // Kahn's algorithm: a definition is ready once all the affected ones it
+    // refers to are. Functions pass readiness on without being computed.
+    QHash<QString, int> waiting;
+    QStringList ready;
+    for (const QString& name : affected) {
+        int count = 0;
+        for (const QString& reference : references.value(name))
+            count += affected.contains(reference) ? 1 : 0;
+        waiting.insert(name, count);
+        if (count == 0)
+            ready.append(name);
+    }
+    std::sort(ready.begin(), ready.end());
+
+    const QString savedExpression = m_expression;
+    const QString savedError = m_error;
+    while (!ready.isEmpty()) {
+        const QString name = ready.takeFirst();
+        if (!hasUserFunction(name)) {
+            const QString expression = getVariable(name).expression();
+            setExpression(expression);
+            const Quantity value = evalNoAssign();
+            if (m_error.isEmpty()) {
+                Variable variable(name, value);
+                variable.setExpression(expression);
+                m_session->addVariable(variable);
+                updated.append(name);
+            }
+        }
+        for (const QString& dependent : dependents.value(name))
+            if (affected.contains(dependent) && --waiting[dependent] == 0)
+                ready.append(dependent);
+    }
+
+    setExpression(savedExpression);
+    compileExpression();
+    m_error = savedError;
+    return updated;
+}
+
 void Evaluator::setVariable(const QString& id, Quantity value,
                             Variable::Type type)
 {
-    if (!m_session)
-        m_session = new Session;
+    if (!m_session) {
+        m_ownSession.reset(new Session);
+        m_session = m_ownSession.data();
+    }
     m_session->addVariable(Variable(id, value, type));
 }
 
@@ -2410,8 +5286,19 @@ void Evaluator::unsetAllUserDefinedVariables()
     initializeBuiltInVariables();
 }
 
+static bool isSuperscriptDigit(const QChar& ch)
+{
+    const ushort c = ch.unicode();
+    return c == 0x2070 || c == 0xB9 || c == 0xB2 || c == 0xB3
+        || (c >= 0x2074 && c <= 0x2079);
+}
+
 static void replaceSuperscriptPowersWithCaretEquivalent(QString& expr)
 {
+    // Most expressions have none, skip the regular expression for them.
+    if (std::none_of(expr.constBegin(), expr.constEnd(), isSuperscriptDigit))
+        return;
+
     static const QRegularExpression s_superscriptPowersRE(
         "(\\x{207B})?[\\x{2070}¹²³\\x{2074}-\\x{2079}]+"
     );
@@ -2489,8 +5376,12 @@ const UserFunction* Evaluator::getUserFunction(const QString& fname) const
         return nullptr;
 }
 
-QString Evaluator::autoFix(const QString& expr)
+// The text is scanned once: the closing parentheses are added to its tokens
+// as well, and those stay in the scan cache, where evaluating the fixed text
+// finds them. They are also handed to the caller when it asks for them.
+QString Evaluator::autoFix(const QString& expr, Tokens* fixedTokens)
 {
+    PipelineTrace::Span span("Evaluator::autoFix");
     int par = 0;
     QString result;
 
@@ -2504,42 +5395,55 @@ QString Evaluator::autoFix(const QString& expr)
 
     // Strip trailing equal sign (=).
     while (result.endsWith("="))
-        result = result.left(result.length() - 1);
+        result.chop(1);
 
     replaceSuperscriptPowersWithCaretEquivalent(result);
 
     // Automagically close all parenthesis.
-    Tokens tokens = Evaluator::scan(result);
+    Tokens tokens = scan(result);
     if (tokens.count()) {
         for (int i = 0; i < tokens.count(); ++i)
-            if (tokens.at(i).asOperator() == Token::AssociationStart)
+            if (tokens.at(i).type() == Token::stxOpenPar)
                 ++par;
-            else if (tokens.at(i).asOperator() == Token::AssociationEnd)
+            else if (tokens.at(i).type() == Token::stxClosePar)
                 --par;
 
-        if (par < 0)
-            par = 0;
-
         // If the scanner stops in the middle, do not bother to apply fix.
         const Token& lastToken = tokens.at(tokens.count() - 1);
-        if (lastToken.pos() + lastToken.size() >= result.length())
-            while (par--)
+        if (par > 0 && lastToken.pos() + lastToken.size() >= result.length()) {
+            // A closing parenthesis never joins the token before it, the
+            // tokens are those the scanner would make of the fixed text.
+            const bool valid = tokens.valid();
+            ScanCache& fixed = m_scanCache;
+            while (par--) {
+                if (valid) {
+                    fixed.tokens.append(Token(Token::stxClosePar, ")",
+                                              result.length(), 1));
+                    fixed.reaches.append(result.length() + 1);
+                }
                 result.append(')');
+            }
+            if (valid) {
+                fixed.text = result;
+                tokens = fixed.tokens;
+            } else
+                tokens = scan(result);
+        }
     }
 
     // Special treatment for simple function
     // e.g. "cos" is regarded as "cos(ans)".
-    if (!result.isEmpty()) {
-        Tokens tokens = Evaluator::scan(result);
-
-        if (tokens.count() == 1
-            && tokens.at(0).isIdentifier()
-            && FunctionRepo::instance()->find(tokens.at(0).text()))
-        {
-            result.append("(ans)");
-        }
+    if (tokens.count() == 1
+        && tokens.at(0).isIdentifier()
+        && FunctionRepo::instance()->find(tokens.at(0).text()))
+    {
+        result.append("(ans)");
+        if (fixedTokens)
+            tokens = scan(result);
     }
 
+    if (fixedTokens)
+        *fixedTokens = tokens;
     return result;
 }
 
@@ -2604,6 +5508,12 @@ QString Evaluator::dump()
             case Opcode::Fact:
                 code = "Fact";
                 break;
+            case Opcode::Sqr:
+                code = "Sqr";
+                break;
+            case Opcode::Arg:
+                code = QString("Arg #%1").arg(m_codes.at(i).index);
+                break;
             case Opcode::LSh:
                 code = "LSh";
                 break;
@@ -2616,6 +5526,24 @@ QString Evaluator::dump()
             case Opcode::BOr:
                 code = "BOr";
                 break;
+            case Opcode::Conv:
+                code = QString("Conv #%1").arg(m_codes.at(i).index);
+                break;
+            case Opcode::Unit:
+                code = QString("Unit #%1").arg(m_codes.at(i).index);
+                break;
+            case Opcode::Range:
+                code = QString("Range (%1)").arg(m_codes.at(i).index);
+                break;
+            case Opcode::Counter:
+                code = QString("Counter #%1").arg(m_codes.at(i).index);
+                break;
+            case Opcode::Store:
+                code = QString("Store #%1").arg(m_codes.at(i).index);
+                break;
+            case Opcode::Recall:
+                code = QString("Recall #%1").arg(m_codes.at(i).index);
+                break;
             default:
                 code = "Unknown";
                 break;
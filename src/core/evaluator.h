@@ -29,14 +29,22 @@
 #include "math/cmath.h"
 #include "math/quantity.h"
 
+#include <QCache>
+#include <QElapsedTimer>
 #include <QHash>
+#include <QMap>
 #include <QObject>
-#include <QSet>
+#include <QScopedPointer>
+#include <QStack>
 #include <QString>
 #include <QStringList>
 #include <QVector>
 
+#include <atomic>
+
 class Session;
+struct PreviewValue;
+struct StackList;
 
 class Token {
 public:
@@ -123,23 +131,76 @@ class Evaluator : public QObject {
     using ForceBuiltinVariableErasure = bool;
 
 public:
+    // Version of the compiled code saved with user functions in sessions.
+    // Increase it whenever the opcodes or what compile() makes of an
+    // expression change, so that older code is recompiled from its text.
+    static const int BytecodeVersion = 3;
+
+    // How often something ran while profiling, and for how long in total,
+    // including what it called.
+    struct ProfileEntry {
+        ProfileEntry() : count(0), nsecs(0) { }
+        qint64 count;
+        qint64 nsecs;
+    };
+
+    // What setProfiling() gathers over the evaluations that follow.
+    struct Profile {
+        Profile() : evaluations(0), numberAllocations(0) { }
+        QMap<Opcode::Type, ProfileEntry> opcodes;
+        QMap<QString, ProfileEntry> functions;
+        QMap<QString, ProfileEntry> userFunctions;
+        qint64 evaluations;
+        qint64 numberAllocations;
+    };
+
+    Evaluator();
+    explicit Evaluator(Session*);
+    ~Evaluator();
+
     static Evaluator* instance();
     void reset();
 
     void setSession(Session*);
     const Session* session();
 
+    void setWorkingPrecision(int);
+    int workingPrecision() const;
+    void setTimeout(int msecs);
+    int timeout() const;
+    void cancel();
+    bool isCancelled() const;
+    void setWorkBudget(qint64 units);
+    qint64 workBudget() const;
+    void setMemoryBudget(int numbers);
+    int memoryBudget() const;
+    void setProfiling(bool);
+    bool isProfiling() const;
+    const Profile& profile() const;
+    void resetProfile();
+    QString profileReport() const;
+
+    qint64 cacheBytes() const;
+    void trimCaches();
+
     static bool isSeparatorChar(const QChar&);
     static bool isRadixChar(const QChar&);
     static QString fixNumberRadix(const QString&);
     static QString fixSexagesimal(const QString&, QString& unit);
+    static int stackDepth(const QVector<Opcode>&);
 
-    QString autoFix(const QString&);
+    QString autoFix(const QString&, Tokens* fixedTokens = nullptr);
     QString dump();
     QString error() const;
+    bool hasError() const;
     Quantity eval();
+    QVector<Quantity> evalBatch(const QString& variable,
+                                const QVector<Quantity>& values);
     Quantity evalNoAssign();
+    Quantity evalPreview(int precision = 0);
+    bool isPreviewRough() const;
     Quantity evalUpdateAns();
+    QStringList recalculate(const QString& identifier);
     QString expression() const;
     bool isValid();
     Tokens scan(const QString&) const;
@@ -170,11 +231,41 @@ protected:
     void compile(const Tokens&);
 
 private:
-    Evaluator();
     Q_DISABLE_COPY(Evaluator)
 
+    class CancellationScope;
+    class BudgetScope;
+
+    // What went wrong in the last evaluation. It is only made into text by
+    // error(): while typing, most expressions fail on the way and few of
+    // those messages are shown.
+    struct Failure {
+        enum Kind {
+            None, Message, InvalidExpression, Cancelled, UnknownIdentifier,
+            FunctionUsage, UserFunctionUsage, OperatorError, FunctionError
+        };
+
+        Failure(Kind k = None)
+            : kind(k), code(Success), function(nullptr) { }
+        Failure(const QString& text)
+            : kind(text.isEmpty() ? None : Message), code(Success)
+            , function(nullptr), message(text) { }
+        Failure(const char* text) : Failure(QString::fromUtf8(text)) { }
+        bool isEmpty() const { return kind == None; }
+
+        Kind kind;
+        ::Error code; // OperatorError and FunctionError.
+        const Function* function; // FunctionUsage and FunctionError.
+        QString name; // UnknownIdentifier and the usages.
+        QStringList arguments; // UserFunctionUsage.
+        QString message;
+        QStringList callers; // The user functions it happened in.
+    };
+
+    void clearState();
+
     bool m_dirty;
-    QString m_error;
+    Failure m_error;
     QString m_expression;
     bool m_valid;
     QString m_assignId;
@@ -183,16 +274,135 @@ private:
     QVector<Opcode> m_codes;
     QVector<Quantity> m_constants;
     QStringList m_identifiers;
+    IdentifierBindings m_bindings;
+    int m_stackDepth;
     Session* m_session;
-    QSet<QString> m_functionsInUse;
+    QScopedPointer<Session> m_ownSession;
+    int m_workingPrecision;
+    QVector<const UserFunction*> m_functionsInUse;
+    std::atomic<bool> m_cancelled;
+    int m_timeout;
+    QElapsedTimer m_timer;
+    qint64 m_workBudget;
+    int m_memoryBudget;
+    bool m_profiling;
+    Profile m_profile;
+    bool m_previewRough;
+
+    // What compileExpression() leaves behind for one expression.
+    struct CompiledExpression {
+        bool dirty;
+        bool valid;
+        Failure error;
+        QString assignId;
+        bool assignFunc;
+        QStringList assignArg;
+        QVector<Opcode> codes;
+        QVector<Quantity> constants;
+        QStringList identifiers;
+        int stackDepth;
+    };
+    QCache<QString, CompiledExpression> m_compiledExpressions;
+    const Session* m_compiledSession;
+    unsigned m_compiledRevision;
+
+    // Number literals by their text. Constants picked from the constants
+    // list come back on many lines, and are only parsed the first time.
+    QCache<QString, Quantity> m_literals;
+    const Quantity& literal(const Token&);
+
+    // The last text scan() was asked for. The next one re-lexes only
+    // around the edit, and the same text is not lexed again.
+    struct ScanCache {
+        ScanCache() : radixBoth(false), radix(0) { }
+        QString text;
+        bool radixBoth;
+        char radix;
+        Tokens tokens;
+        QVector<int> reaches; // Last index each token looked at.
+    };
+    mutable ScanCache m_scanCache;
+
+    // A compiled program ready for runPreview(), see lowerPreview(). A Load
+    // carries its constant as a double, a Ref the variable or the user
+    // function it refers to, or else the index of its preview function.
+    struct PreviewStep {
+        Opcode::Type type;
+        quint32 index;
+        double value;
+        double error;
+        const Variable* variable;
+        const UserFunction* userFunction;
+
+        PreviewStep() : type(Opcode::Nop), index(0), value(0), error(0)
+            , variable(nullptr), userFunction(nullptr) { }
+    };
+    typedef QVector<PreviewStep> PreviewProgram;
+    // The user functions lowered so far, empty for those that cannot run in
+    // doubles. They hold for one revision of the bindings of one session.
+    QHash<const UserFunction*, PreviewProgram> m_previewPrograms;
+    const Session* m_previewSession;
+    unsigned m_previewRevision;
 
+    void optimize();
+    void eliminateCommonSubexpressions();
+    bool compileExpression();
+    bool parseExpression();
     const Quantity& checkOperatorResult(const Quantity&);
-    static QString stringFromFunctionError(Function*);
+    static QString stringFromFunctionError(const Function*, Error);
+    void bind(const QStringList& identifiers, IdentifierBindings&) const;
+    void lex(const QString&, const ScanCache* previous, ScanCache&) const;
+    qint64 estimateCost(const QVector<Opcode>& opcodes,
+                        const QVector<Quantity>& constants,
+                        const QStringList& identifiers,
+                        IdentifierBindings& bindings,
+                        QHash<const UserFunction*, qint64>& known) const;
+    qint64 estimateCost(const UserFunction*,
+                        QHash<const UserFunction*, qint64>& known) const;
+    bool isAffordable(int runs);
     Quantity exec(const QVector<Opcode>& opcodes,
                   const QVector<Quantity>& constants,
-                  const QStringList& identifiers);
+                  const QStringList& identifiers,
+                  IdentifierBindings& bindings,
+                  int stackDepth,
+                  const QVector<Quantity>* arguments,
+                  QVector<Quantity>* counters = nullptr);
+    Quantity execRange(Function* function,
+                       const QVector<Opcode>& body,
+                       const QVector<Quantity>& constants,
+                       const QStringList& identifiers,
+                       IdentifierBindings& bindings,
+                       const QVector<Quantity>* arguments,
+                       QVector<Quantity>& counters,
+                       const QVector<Quantity>& args);
+    bool charge(long units);
+    bool applyOperator(const Opcode&, const QVector<Quantity>& constants,
+                       const QStringList& identifiers, Quantity& lhs,
+                       const Quantity& rhs);
+    bool applyToLists(const Opcode&, const QVector<Quantity>& constants,
+                      const QStringList& identifiers, QStack<Quantity>&,
+                      QVector<StackList>&);
+    void execElementwise(Function*, const UserFunction*,
+                         const QVector<Quantity>& scalars,
+                         const QVector<const QVector<Quantity>*>& columns,
+                         const QString& name, QVector<Quantity>& results);
+    bool lowerPreview(const QVector<Opcode>& opcodes,
+                      const QVector<Quantity>& constants,
+                      const QStringList& identifiers,
+                      IdentifierBindings& bindings, int arguments,
+                      PreviewProgram& program) const;
+    bool previewProgram(const UserFunction*, PreviewProgram&);
+    bool runPreview(const PreviewProgram&, const PreviewValue* arguments,
+                    PreviewValue* result);
+    bool execPreview(const QVector<Opcode>& opcodes,
+                     const QVector<Quantity>& constants,
+                     const QStringList& identifiers,
+                     IdentifierBindings& bindings,
+                     Quantity* result);
     Quantity execUserFunction(const UserFunction* function,
                               QVector<Quantity>& arguments);
+    bool isPure(const UserFunction*, QVector<const UserFunction*>&) const;
+    bool isMemoizable(const UserFunction*, const QVector<Quantity>&) const;
     const UserFunction* getUserFunction(const QString&) const;
 
     bool isFunction(Token token) {
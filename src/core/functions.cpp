@@ -23,6 +23,7 @@
 #include "core/functions.h"
 
 #include "core/settings.h"
+#include "core/startuptrace.h"
 #include "math/hmath.h"
 #include "math/cmath.h"
 
@@ -100,6 +101,23 @@
     else if (Settings::instance()->angleUnit == 'g') \
         result = DMath::rad2gon(result);
 
+// In degree and gradian mode, real angles are reduced in their own unit,
+// so that e.g. sin(180) is exactly zero. False for the other cases, which
+// take the conversion to radians.
+static bool sincosAngle(const Quantity& angle, HNumber& sinx, HNumber& cosx)
+{
+    const char unit = Settings::instance()->angleUnit;
+    if ((unit != 'd' && unit != 'g') || !angle.isReal()
+        || !angle.isDimensionless())
+        return false;
+    const HNumber x = angle.numericValue().real;
+    if (unit == 'd')
+        HMath::sincosDegrees(x, sinx, cosx);
+    else
+        HMath::sincosGons(x, sinx, cosx);
+    return true;
+}
+
 static FunctionRepo* s_FunctionRepoInstance = 0;
 
 // FIXME: destructor seems not to be called
@@ -108,6 +126,32 @@ static void s_deleteFunctions()
     delete s_FunctionRepoInstance;
 }
 
+// The error of the last call. It is kept per thread rather than per
+// function, so that evaluators on different threads share the functions.
+static thread_local Error s_functionError = Success;
+
+Error Function::error() const
+{
+    return s_functionError;
+}
+
+void Function::setError(Error error)
+{
+    s_functionError = error;
+}
+
+const QString& Function::name() const
+{
+    FunctionRepo::instance()->resolveTexts();
+    return m_name;
+}
+
+const QString& Function::usage() const
+{
+    FunctionRepo::instance()->resolveTexts();
+    return m_usage;
+}
+
 Quantity Function::exec(const Function::ArgumentList& args)
 {
     if (!m_ptr)
@@ -119,6 +163,139 @@ Quantity Function::exec(const Function::ArgumentList& args)
     return result;
 }
 
+// Adds x to sum, keeping in compensation what the addition rounds
+// away (Neumaier's variant of Kahan summation).
+static void compensatedAdd(HNumber& sum, HNumber& compensation,
+                           const HNumber& x)
+{
+    const HNumber total = sum + x;
+    if (HMath::abs(sum) >= HMath::abs(x))
+        compensation += (sum - total) + x;
+    else
+        compensation += (x - total) + sum;
+    sum = total;
+}
+
+RunningStatistics::RunningStatistics()
+    : m_count(0)
+    , m_error(Success)
+    , m_squares(0)
+    , m_product(1)
+    , m_logarithmic(false)
+    , m_logarithms(0)
+    , m_negative(false)
+    , m_logarithmError(Success)
+{
+    m_sum[0] = m_sum[1] = m_compensation[0] = m_compensation[1] = HNumber(0);
+}
+
+void RunningStatistics::add(const Quantity& x)
+{
+    if (m_count++ == 0)
+        m_first = x;
+
+    const CNumber value = x.numericValue();
+    if (!x.sameDimension(m_first))
+        m_error = DimensionMismatch;
+    if (m_error == Success) {
+        compensatedAdd(m_sum[0], m_compensation[0], value.real);
+        compensatedAdd(m_sum[1], m_compensation[1], value.imag);
+        const CNumber distance = value - m_first.numericValue();
+        m_distances += distance;
+        m_squares += distance.real * distance.real
+                     + distance.imag * distance.imag;
+    }
+
+    if (m_logarithmic) {
+        if (!x.isReal() || !x.isDimensionless() || x.isZero())
+            m_logarithmError = OutOfDomain;
+        else {
+            m_logarithms += HMath::ln(HMath::abs(value.real));
+            m_negative = m_negative != value.real.isNegative();
+        }
+        return;
+    }
+    const Quantity product = m_product * x;
+    const Error error = product.error();
+    if ((error == Overflow || error == Underflow) && m_product.isReal()
+        && m_product.isDimensionless() && x.isReal() && x.isDimensionless())
+    {
+        const HNumber before = m_product.numericValue().real;
+        m_logarithmic = true;
+        m_logarithmError = x.isZero() ? OutOfDomain : Success;
+        m_logarithms = HMath::ln(HMath::abs(before))
+                       + HMath::ln(HMath::abs(value.real));
+        m_negative = before.isNegative() != value.real.isNegative();
+    }
+    m_product = product;
+}
+
+// The value with the dimension, unit and format of the first one.
+Quantity RunningStatistics::shaped(const CNumber& value) const
+{
+    Quantity result(value);
+    result.copyDimension(m_first);
+    result.setDisplayUnit(m_first);
+    result.setFormat(m_first.format());
+    return result;
+}
+
+Quantity RunningStatistics::sum() const
+{
+    if (m_error != Success)
+        return DMath::nan(m_error);
+    return shaped(CNumber(m_sum[0] + m_compensation[0],
+                          m_sum[1] + m_compensation[1]));
+}
+
+Quantity RunningStatistics::mean() const
+{
+    if (m_error != Success || m_count == 0)
+        return DMath::nan(m_error);
+    const HNumber n(m_count);
+    return shaped(CNumber((m_sum[0] + m_compensation[0]) / n,
+                          (m_sum[1] + m_compensation[1]) / n));
+}
+
+// The mean square distance to the mean: the mean square distance to the
+// first value, less the square distance of the mean from it.
+Quantity RunningStatistics::variance() const
+{
+    if (m_error != Success || m_count == 0)
+        return DMath::nan(m_error);
+    const HNumber n(m_count);
+    const HNumber shift = (m_distances.real * m_distances.real
+                           + m_distances.imag * m_distances.imag) / n;
+    HNumber variance = (m_squares - shift) / n;
+    if (variance.isNegative())
+        variance = HNumber(0);
+    Quantity unit(1);
+    unit.copyDimension(m_first);
+    return (Quantity(variance) * unit * unit).setFormat(m_first.format());
+}
+
+Quantity RunningStatistics::product() const
+{
+    return m_product;
+}
+
+Quantity RunningStatistics::geometricMean() const
+{
+    if (m_logarithmic) {
+        if (m_logarithmError != Success || m_negative)
+            return DMath::nan(OutOfDomain);
+        return HMath::exp(m_logarithms / HNumber(m_count));
+    }
+
+    if (m_product <= Quantity(0))
+        return DMath::nan(OutOfDomain);
+    if (m_count == 1)
+        return m_product;
+    if (m_count == 2)
+        return DMath::sqrt(m_product);
+    return DMath::raise(m_product, Quantity(1) / Quantity(m_count));
+}
+
 Quantity function_abs(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
@@ -129,13 +306,17 @@ Quantity function_average(Function* f, const Function::ArgumentList& args)
 {
     /* TODO : complex mode switch for this function */
     ENSURE_MINIMUM_ARGUMENT_COUNT(2);
-    return std::accumulate(args.begin()+1, args.end(), *args.begin()) / Quantity(args.count());
+    RunningStatistics statistics;
+    for (int i = 0; i < args.count(); ++i)
+        statistics.add(args.at(i));
+    return statistics.mean();
 }
 
 Quantity function_absdev(Function* f, const Function::ArgumentList& args)
 {
     /* TODO : complex mode switch for this function */
     ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    // The distances to the mean take a second pass.
     Quantity mean = function_average(f, args);
     if (mean.isNan())
         return mean;   // pass the error along
@@ -203,7 +384,28 @@ Quantity function_gcd(Function* f, const Function::ArgumentList& args)
             f->setError(OutOfDomain);
             return DMath::nan();
         }
-    return std::accumulate(args.begin() + 1, args.end(), args.at(0), DMath::gcd);
+    // Reduces from left to right, once the divisor is 1 the rest cannot
+    // change it.
+    Quantity result = args.at(0);
+    for (int i = 1; i < args.count() && result != 1; ++i)
+        result = DMath::gcd(result, args.at(i));
+    return result;
+}
+
+Quantity function_lcm(Function* f, const Function::ArgumentList& args)
+{
+    /* TODO : complex mode switch for this function */
+    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    for (int i = 0; i < args.count(); ++i)
+        if (!args[i].isInteger()) {
+            f->setError(OutOfDomain);
+            return DMath::nan();
+        }
+    // Once the multiple is 0 the rest cannot change it.
+    Quantity result = args.at(0);
+    for (int i = 1; i < args.count() && !result.isZero(); ++i)
+        result = DMath::lcm(result, args.at(i));
+    return result;
 }
 
 Quantity function_round(Function* f, const Function::ArgumentList& args)
@@ -239,19 +441,10 @@ Quantity function_sqrt(Function* f, const Function::ArgumentList& args)
 Quantity function_variance(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_MINIMUM_ARGUMENT_COUNT(2);
-
-    Quantity mean = function_average(f, args);
-    if (mean.isNan())
-        return mean;
-
-    Quantity acc(DMath::real(args[0] - mean)*DMath::real(args[0] - mean)
-            + DMath::imag(args[0] - mean)*DMath::imag(args[0] - mean));
-    for (int i = 1; i < args.count(); ++i) {
-        Quantity q(args[i] - mean);
-        acc += DMath::real(q)*DMath::real(q) + DMath::imag(q)*DMath::imag(q);
-    }
-
-    return acc / Quantity(args.count());
+    RunningStatistics statistics;
+    for (int i = 0; i < args.count(); ++i)
+        statistics.add(args.at(i));
+    return statistics.variance();
 }
 
 Quantity function_stddev(Function* f, const Function::ArgumentList& args)
@@ -329,6 +522,9 @@ Quantity function_sin(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(sinx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::sin(angle);
 }
@@ -337,6 +533,9 @@ Quantity function_cos(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(cosx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::cos(angle);
 }
@@ -345,6 +544,9 @@ Quantity function_tan(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(sinx / cosx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::tan(angle);
 }
@@ -353,6 +555,9 @@ Quantity function_cot(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(cosx / sinx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::cot(angle);
 }
@@ -361,6 +566,9 @@ Quantity function_sec(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(HNumber(1) / cosx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::sec(angle);
 }
@@ -369,6 +577,9 @@ Quantity function_csc(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_ARGUMENT_COUNT(1);
     Quantity angle = args.at(0);
+    HNumber sinx, cosx;
+    if (sincosAngle(angle, sinx, cosx))
+        return Quantity(HNumber(1) / sinx);
     CONVERT_ARGUMENT_ANGLE(angle);
     return DMath::csc(angle);
 }
@@ -516,20 +727,124 @@ Quantity function_max(Function* f, const Function::ArgumentList& args)
     return *std::max_element(args.begin(), args.end());
 }
 
+// Whether the arguments from the given one on can be ordered: they must
+// be real and of one dimension.
+static Error checkOrderedData(const Function::ArgumentList& args, int first)
+{
+    for (int i = first; i < args.count(); ++i) {
+        if (!args.at(i).isReal())
+            return OutOfDomain;
+        if (!args.at(i).sameDimension(args.at(first)))
+            return InvalidDimension;
+    }
+    return Success;
+}
+
+// The value of the given rank among the values, the least one having rank
+// 0. A fractional rank interpolates between the values next to it. Rather
+// than sorting them, the values are reordered only as far as needed to
+// select the value, which takes linear time on average.
+static Quantity orderStatistic(Function::ArgumentList& values,
+                               const HNumber& rank)
+{
+    const int lower = HMath::floor(rank).toInt();
+    const HNumber fraction = rank - HNumber(lower);
+    std::nth_element(values.begin(), values.begin() + lower, values.end());
+    const Quantity x = values.at(lower);
+    if (fraction.isZero())
+        return x;
+    // The next value is the least of those after the selected one.
+    const Quantity y = *std::min_element(values.begin() + lower + 1,
+                                         values.end());
+    return x + (y - x) * Quantity(fraction);
+}
+
+// The value the fraction p of the way from the least to the greatest of
+// the data following the first argument, as computed by the PERCENTILE
+// function of spreadsheets.
+static Quantity quantile(const Function::ArgumentList& args, const HNumber& p)
+{
+    Function::ArgumentList values = args.mid(1);
+    return orderStatistic(values, p * HNumber(values.count() - 1));
+}
+
 Quantity function_median(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_MINIMUM_ARGUMENT_COUNT(2);
     ENSURE_REAL_ARGUMENTS()
     ENSURE_SAME_DIMENSION()
 
-    Function::ArgumentList sortedArgs = args;
-    std::sort(sortedArgs.begin(), sortedArgs.end());
-
+    Function::ArgumentList values = args;
+    const int middle = (args.count() - 1) / 2;
+    const Quantity lower = orderStatistic(values, HNumber(middle));
     if ((args.count() & 1) == 1)
-        return sortedArgs.at((args.count() - 1) / 2);
+        return lower;
+
+    const Quantity upper = *std::min_element(values.begin() + middle + 1,
+                                             values.end());
+    return (lower + upper) / Quantity(2);
+}
+
+Quantity function_percentile(Function* f, const Function::ArgumentList& args)
+{
+    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    const Error error = checkOrderedData(args, 1);
+    if (error != Success) {
+        f->setError(error);
+        return DMath::nan(error);
+    }
+
+    const Quantity& p = args.at(0);
+    if (!p.isReal() || !p.isDimensionless()
+        || p < Quantity(0) || p > Quantity(1))
+    {
+        f->setError(OutOfDomain);
+        return DMath::nan(OutOfDomain);
+    }
+    return quantile(args, p.numericValue().real);
+}
+
+Quantity function_quartile(Function* f, const Function::ArgumentList& args)
+{
+    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    const Error error = checkOrderedData(args, 1);
+    if (error != Success) {
+        f->setError(error);
+        return DMath::nan(error);
+    }
 
-    const int centerLeft = args.count() / 2 - 1;
-    return (sortedArgs.at(centerLeft) + sortedArgs.at(centerLeft + 1)) / Quantity(2);
+    // 0 and 4 give the least and the greatest value, 2 the median.
+    const Quantity& q = args.at(0);
+    if (!q.isInteger() || !q.isDimensionless()
+        || q < Quantity(0) || q > Quantity(4))
+    {
+        f->setError(OutOfDomain);
+        return DMath::nan(OutOfDomain);
+    }
+    return quantile(args, q.numericValue().real / HNumber(4));
+}
+
+// The most frequent value, the least of them if there are several.
+Quantity function_mode(Function* f, const Function::ArgumentList& args)
+{
+    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    ENSURE_REAL_ARGUMENTS()
+    ENSURE_SAME_DIMENSION()
+
+    Function::ArgumentList values = args;
+    std::sort(values.begin(), values.end());
+    int best = 0;
+    int bestCount = 0;
+    for (int i = 0, count = 1; i < values.count(); ++i, ++count) {
+        if (i + 1 < values.count() && values.at(i + 1) == values.at(i))
+            continue;
+        if (count > bestCount) {
+            best = i;
+            bestCount = count;
+        }
+        count = 0;
+    }
+    return values.at(best);
 }
 
 Quantity function_min(Function* f, const Function::ArgumentList& args)
@@ -543,7 +858,10 @@ Quantity function_min(Function* f, const Function::ArgumentList& args)
 Quantity function_sum(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_MINIMUM_ARGUMENT_COUNT(2);
-    return std::accumulate(args.begin(), args.end(), Quantity(0));
+    RunningStatistics statistics;
+    for (int i = 0; i < args.count(); ++i)
+        statistics.add(args.at(i));
+    return statistics.sum();
 }
 
 Quantity function_product(Function* f, const Function::ArgumentList& args)
@@ -552,24 +870,56 @@ Quantity function_product(Function* f, const Function::ArgumentList& args)
     return std::accumulate(args.begin(), args.end(), Quantity(1), std::multiplies<Quantity>());
 }
 
-Quantity function_geomean(Function* f, const Function::ArgumentList& args)
+// The range functions are run by the evaluator, which compiles their
+// first argument as the body of a loop, see Evaluator::execRange(). They
+// only get here when called without one, e.g. with a single argument.
+static Quantity rangeFunction(Function* f, const Function::ArgumentList& args)
 {
-    /* TODO : complex mode switch for this function */
-    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    ENSURE_ARGUMENT_COUNT(4);
+    f->setError(InvalidParam);
+    return CMath::nan(InvalidParam);
+}
 
-    Quantity result = std::accumulate(args.begin(), args.end(), Quantity(1),
-        std::multiplies<Quantity>());
+Quantity function_sumrange(Function* f, const Function::ArgumentList& args)
+{
+    return rangeFunction(f, args);
+}
 
-    if (result <= Quantity(0))
-        return DMath::nan(OutOfDomain);
+Quantity function_productrange(Function* f, const Function::ArgumentList& args)
+{
+    return rangeFunction(f, args);
+}
 
-    if (args.count() == 1)
-        return result;
+Quantity function_minrange(Function* f, const Function::ArgumentList& args)
+{
+    return rangeFunction(f, args);
+}
 
-    if (args.count() == 2)
-        return DMath::sqrt(result);
+Quantity function_maxrange(Function* f, const Function::ArgumentList& args)
+{
+    return rangeFunction(f, args);
+}
 
-    return  DMath::raise(result, Quantity(1)/Quantity(args.count()));
+Quantity function_integrate(Function* f, const Function::ArgumentList& args)
+{
+    return rangeFunction(f, args);
+}
+
+Quantity function_solve(Function* f, const Function::ArgumentList& args)
+{
+    ENSURE_EITHER_ARGUMENT_COUNT(3, 4);
+    f->setError(InvalidParam);
+    return CMath::nan(InvalidParam);
+}
+
+Quantity function_geomean(Function* f, const Function::ArgumentList& args)
+{
+    /* TODO : complex mode switch for this function */
+    ENSURE_MINIMUM_ARGUMENT_COUNT(2);
+    RunningStatistics statistics;
+    for (int i = 0; i < args.count(); ++i)
+        statistics.add(args.at(i));
+    return statistics.geometricMean();
 }
 
 Quantity function_dec(Function* f, const Function::ArgumentList& args)
@@ -764,6 +1114,12 @@ Quantity function_mod(Function* f, const Function::ArgumentList& args)
     return args.at(0) % args.at(1);
 }
 
+Quantity function_powmod(Function* f, const Function::ArgumentList& args)
+{
+    ENSURE_ARGUMENT_COUNT(3);
+    return DMath::powmod(args.at(0), args.at(1), args.at(2));
+}
+
 Quantity function_ieee754_decode(Function* f, const Function::ArgumentList& args)
 {
     /* TODO : complex mode switch for this function */
@@ -886,16 +1242,22 @@ void FunctionRepo::createFunctions()
     FUNCTION_INSERT(geomean);
     FUNCTION_INSERT(hex);
     FUNCTION_INSERT(int);
+    FUNCTION_INSERT(integrate);
     FUNCTION_INSERT(lngamma);
     FUNCTION_INSERT(max);
+    FUNCTION_INSERT(maxrange);
     FUNCTION_INSERT(min);
+    FUNCTION_INSERT(minrange);
     FUNCTION_INSERT(oct);
     FUNCTION_INSERT(product);
+    FUNCTION_INSERT(productrange);
     FUNCTION_INSERT(round);
     FUNCTION_INSERT(sgn);
+    FUNCTION_INSERT(solve);
     FUNCTION_INSERT(sqrt);
     FUNCTION_INSERT(stddev);
     FUNCTION_INSERT(sum);
+    FUNCTION_INSERT(sumrange);
     FUNCTION_INSERT(trunc);
     FUNCTION_INSERT(variance);
 
@@ -909,6 +1271,7 @@ void FunctionRepo::createFunctions()
 
     // Discrete.
     FUNCTION_INSERT(gcd);
+    FUNCTION_INSERT(lcm);
     FUNCTION_INSERT(ncr);
     FUNCTION_INSERT(npr);
 
@@ -924,10 +1287,13 @@ void FunctionRepo::createFunctions()
     FUNCTION_INSERT(hyperpmf);
     FUNCTION_INSERT(hypervar);
     FUNCTION_INSERT(median);
+    FUNCTION_INSERT(mode);
+    FUNCTION_INSERT(percentile);
     FUNCTION_INSERT(poicdf);
     FUNCTION_INSERT(poimean);
     FUNCTION_INSERT(poipmf);
     FUNCTION_INSERT(poivar);
+    FUNCTION_INSERT(quartile);
 
     // Trigonometry.
     FUNCTION_INSERT(arccos);
@@ -966,6 +1332,7 @@ void FunctionRepo::createFunctions()
     FUNCTION_INSERT(shr);
     FUNCTION_INSERT(idiv);
     FUNCTION_INSERT(mod);
+    FUNCTION_INSERT(powmod);
 
     // IEEE-754.
     FUNCTION_INSERT(ieee754_decode);
@@ -993,10 +1360,28 @@ FunctionRepo* FunctionRepo::instance()
 }
 
 FunctionRepo::FunctionRepo()
+    : m_usagesSet(false)
+    , m_translated(false)
 {
+    StartupTrace::Phase phase("built-in functions");
     createFunctions();
-    setNonTranslatableFunctionUsages();
-    retranslateText();
+}
+
+// Names and usages are only needed by the docks, tool tips and error
+// messages, so they are set when one is first asked for and once more after
+// every language change.
+void FunctionRepo::resolveTexts()
+{
+    QMutexLocker locker(&m_textsMutex);
+    if (m_translated)
+        return;
+    m_translated = true;
+    if (!m_usagesSet) {
+        m_usagesSet = true;
+        setNonTranslatableFunctionUsages();
+    }
+    setFunctionNames();
+    setTranslatableFunctionUsages();
 }
 
 void FunctionRepo::insert(Function* function)
@@ -1051,6 +1436,7 @@ void FunctionRepo::setNonTranslatableFunctionUsages()
     FUNCTION_USAGE(frac, "x");
     FUNCTION_USAGE(gamma, "x");
     FUNCTION_USAGE(gcd, "n<sub>1</sub>; n<sub>2</sub>; ...");
+    FUNCTION_USAGE(lcm, "n<sub>1</sub>; n<sub>2</sub>; ...");
     FUNCTION_USAGE(geomean, "x<sub>1</sub>; x<sub>2</sub>; ...");
     FUNCTION_USAGE(gradians, "x");
     FUNCTION_USAGE(hex, "n");
@@ -1071,6 +1457,7 @@ void FunctionRepo::setNonTranslatableFunctionUsages()
     FUNCTION_USAGE(max, "x<sub>1</sub>; x<sub>2</sub>; ...");
     FUNCTION_USAGE(median, "x<sub>1</sub>; x<sub>2</sub>; ...");
     FUNCTION_USAGE(min, "x<sub>1</sub>; x<sub>2</sub>; ...");
+    FUNCTION_USAGE(mode, "x<sub>1</sub>; x<sub>2</sub>; ...");
     FUNCTION_USAGE(ncr, "x<sub>1</sub>; x<sub>2</sub>");
     FUNCTION_USAGE(not, "n");
     FUNCTION_USAGE(npr, "x<sub>1</sub>; x<sub>2</sub>");
@@ -1109,15 +1496,24 @@ void FunctionRepo::setTranslatableFunctionUsages()
     FUNCTION_USAGE_TR(idiv, tr("dividend; divisor"));
     FUNCTION_USAGE_TR(ieee754_decode, tr("x; exponent_bits; significand_bits [; exponent_bias]"));
     FUNCTION_USAGE_TR(ieee754_encode, tr("x; exponent_bits; significand_bits [; exponent_bias]"));
+    FUNCTION_USAGE_TR(integrate, tr("expression; variable; from; to"));
     FUNCTION_USAGE_TR(log, tr("base; x"));
     FUNCTION_USAGE_TR(mask, "x; bits");
+    FUNCTION_USAGE_TR(maxrange, tr("expression; variable; from; to"));
+    FUNCTION_USAGE_TR(minrange, tr("expression; variable; from; to"));
     FUNCTION_USAGE_TR(mod, tr("value; modulo"));
+    FUNCTION_USAGE_TR(percentile, tr("fraction; x<sub>1</sub>; x<sub>2</sub>; ..."));
     FUNCTION_USAGE_TR(poicdf, tr("events; average_events"));
     FUNCTION_USAGE_TR(poimean, tr("average_events"));
     FUNCTION_USAGE_TR(poipmf, tr("events; average_events"));
     FUNCTION_USAGE_TR(poivar, tr("average_events"));
+    FUNCTION_USAGE_TR(powmod, tr("base; exponent; modulo"));
+    FUNCTION_USAGE_TR(productrange, tr("expression; variable; from; to"));
+    FUNCTION_USAGE_TR(quartile, tr("quarter; x<sub>1</sub>; x<sub>2</sub>; ..."));
     FUNCTION_USAGE_TR(round, tr("x [; precision]"));
     FUNCTION_USAGE_TR(shl, "x; bits");
+    FUNCTION_USAGE_TR(solve, tr("expression; variable; start [; start]"));
+    FUNCTION_USAGE_TR(sumrange, tr("expression; variable; from; to"));
     FUNCTION_USAGE_TR(shr, "x; bits");
     FUNCTION_USAGE_TR(unmask, "x; bits");
 }
@@ -1158,6 +1554,7 @@ void FunctionRepo::setFunctionNames()
     FUNCTION_NAME(frac, tr("Fractional Part"));
     FUNCTION_NAME(gamma, tr("Extension of Factorials [= (x-1)!]"));
     FUNCTION_NAME(gcd, tr("Greatest Common Divisor"));
+    FUNCTION_NAME(lcm, tr("Least Common Multiple"));
     FUNCTION_NAME(geomean, tr("Geometric Mean"));
     FUNCTION_NAME(gradians, tr("Gradians of arc"));
     FUNCTION_NAME(hex, tr("Convert to Hexadecimal Representation"));
@@ -1167,6 +1564,7 @@ void FunctionRepo::setFunctionNames()
     FUNCTION_NAME(hypervar, tr("Hypergeometric Distribution Variance"));
     FUNCTION_NAME(idiv, tr("Integer Quotient"));
     FUNCTION_NAME(int, tr("Integer Part"));
+    FUNCTION_NAME(integrate, tr("Definite Integral"));
     FUNCTION_NAME(imag, tr("Imaginary Part"));
     FUNCTION_NAME(ieee754_decode, tr("Decode IEEE-754 Binary Value"));
     FUNCTION_NAME(ieee754_encode, tr("Encode IEEE-754 Binary Value"));
@@ -1185,21 +1583,28 @@ void FunctionRepo::setFunctionNames()
     FUNCTION_NAME(log, tr("Logarithm to Arbitrary Base"));
     FUNCTION_NAME(mask, tr("Mask to a bit size"));
     FUNCTION_NAME(max, tr("Maximum"));
+    FUNCTION_NAME(maxrange, tr("Maximum over a Range"));
     FUNCTION_NAME(median, tr("Median Value (50th Percentile)"));
     FUNCTION_NAME(min, tr("Minimum"));
     FUNCTION_NAME(mod, tr("Modulo"));
+    FUNCTION_NAME(minrange, tr("Minimum over a Range"));
+    FUNCTION_NAME(mode, tr("Mode (Most Frequent Value)"));
     FUNCTION_NAME(ncr, tr("Combination (Binomial Coefficient)"));
     FUNCTION_NAME(not, tr("Logical NOT"));
     FUNCTION_NAME(npr, tr("Permutation (Arrangement)"));
     FUNCTION_NAME(oct, tr("Convert to Octal Representation"));
     FUNCTION_NAME(or, tr("Logical OR"));
+    FUNCTION_NAME(percentile, tr("Percentile"));
     FUNCTION_NAME(phase, tr("Phase of Complex Number"));
     FUNCTION_NAME(poicdf, tr("Poissonian Cumulative Distribution Function"));
     FUNCTION_NAME(poimean, tr("Poissonian Distribution Mean"));
     FUNCTION_NAME(poipmf, tr("Poissonian Probability Mass Function"));
     FUNCTION_NAME(poivar, tr("Poissonian Distribution Variance"));
     FUNCTION_NAME(polar, tr("Convert to Polar Notation"));
+    FUNCTION_NAME(powmod, tr("Modular Exponentiation"));
     FUNCTION_NAME(product, tr("Product"));
+    FUNCTION_NAME(productrange, tr("Product over a Range"));
+    FUNCTION_NAME(quartile, tr("Quartile"));
     FUNCTION_NAME(radians, tr("Radians"));
     FUNCTION_NAME(real, tr("Real Part"));
     FUNCTION_NAME(round, tr("Rounding"));
@@ -1209,9 +1614,11 @@ void FunctionRepo::setFunctionNames()
     FUNCTION_NAME(sgn, tr("Signum"));
     FUNCTION_NAME(sin, tr("Sine"));
     FUNCTION_NAME(sinh, tr("Hyperbolic Sine"));
+    FUNCTION_NAME(solve, tr("Root of an Equation"));
     FUNCTION_NAME(sqrt, tr("Square Root"));
     FUNCTION_NAME(stddev, tr("Standard Deviation (Square Root of Variance)"));
     FUNCTION_NAME(sum, tr("Sum"));
+    FUNCTION_NAME(sumrange, tr("Sum over a Range"));
     FUNCTION_NAME(tan, tr("Tangent"));
     FUNCTION_NAME(tanh, tr("Hyperbolic Tangent"));
     FUNCTION_NAME(trunc, tr("Truncation"));
@@ -1222,6 +1629,6 @@ void FunctionRepo::setFunctionNames()
 
 void FunctionRepo::retranslateText()
 {
-    setFunctionNames();
-    setTranslatableFunctionUsages();
+    QMutexLocker locker(&m_textsMutex);
+    m_translated = false;
 }
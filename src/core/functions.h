@@ -24,6 +24,7 @@
 #include "math/quantity.h"
 
 #include <QHash>
+#include <QMutex>
 #include <QObject>
 #include <QStringList>
 #include <QVector>
@@ -43,14 +44,15 @@ public:
     { }
 
     const QString& identifier() const { return m_identifier; }
-    const QString& name() const { return m_name; }
-    const QString& usage() const { return m_usage; }
-    Error error() const { return m_error; }
+    // The name and usage are only looked up when first asked for.
+    const QString& name() const;
+    const QString& usage() const;
+    Error error() const;
     Quantity exec(const ArgumentList&);
 
     void setName(const QString& name) { m_name = name; }
     void setUsage(const QString& usage) { m_usage = usage; }
-    void setError(Error error) { m_error = error; }
+    void setError(Error error);
 
 private:
     Q_DISABLE_COPY(Function)
@@ -59,10 +61,45 @@ private:
     QString m_identifier;
     QString m_name;
     QString m_usage;
-    Error m_error;
     FunctionImpl m_ptr;
 };
 
+// Statistics of a sequence of values, gathered in one pass as the values
+// come, so that long or generated sequences need not be kept. The sum is
+// compensated, the variance comes from sums of the distances to the first
+// value. The values must all have the dimension of the first, but for the
+// product, and the results take the format and unit of the first.
+class RunningStatistics {
+public:
+    RunningStatistics();
+
+    void add(const Quantity&);
+    int count() const { return m_count; }
+    Quantity sum() const;
+    Quantity mean() const;
+    Quantity variance() const;
+    Quantity product() const;
+    Quantity geometricMean() const;
+
+private:
+    Quantity shaped(const CNumber&) const;
+
+    Quantity m_first;
+    int m_count;
+    Error m_error;
+    HNumber m_sum[2]; // The real and imaginary parts.
+    HNumber m_compensation[2];
+    CNumber m_distances;
+    HNumber m_squares;
+    Quantity m_product;
+    // Once the product leaves the number range, the geometric mean is
+    // taken from the sum of the logarithms.
+    bool m_logarithmic;
+    HNumber m_logarithms;
+    bool m_negative;
+    Error m_logarithmError;
+};
+
 class FunctionRepo : public QObject {
     Q_OBJECT
 public:
@@ -78,13 +115,19 @@ public slots:
 private:
     Q_DISABLE_COPY(FunctionRepo)
     FunctionRepo();
+    friend class Function;
 
+    void resolveTexts();
     void createFunctions();
     void setFunctionNames();
     void setNonTranslatableFunctionUsages();
     void setTranslatableFunctionUsages();
 
     QHash<QString, Function*> m_functions;
+    // Guards the lazily set texts, functions are shared between threads.
+    QMutex m_textsMutex;
+    bool m_usagesSet;
+    bool m_translated;
 };
 
 #endif // CORE_FUNCTION_H
@@ -44,6 +44,15 @@
 
 ManualServer* ManualServer::s_instance = nullptr;
 
+// Identifies the embedded manual of a language, so that a copy deployed by
+// an earlier run is only replaced when the build or the manual changed.
+static QByteArray deployStamp(const QString& lang)
+{
+    return QByteArray(SPEEDCRUNCH_VERSION) + ' '
+        + QByteArray::number(QFile(QHC_RES_PATH(lang)).size()) + ' '
+        + QByteArray::number(QFile(QCH_RES_PATH(lang)).size());
+}
+
 QString ManualServer::deployDocs()
 {
     QString dest = Settings::getCachePath() + "/manual/";
@@ -67,6 +76,16 @@ QString ManualServer::deployDocs()
         }
     }
 
+    const QByteArray stamp = deployStamp(lang);
+    QFile stampFile(dest + "manual-" + lang + ".stamp");
+    if (QFile::exists(dest + QHC_NAME(lang)) && QFile::exists(dest + QCH_NAME(lang))
+        && stampFile.open(QIODevice::ReadOnly) && stampFile.readAll() == stamp)
+    {
+        return dest + QHC_NAME(lang);
+    }
+    stampFile.close();
+    stampFile.remove();
+
     QFile::remove(dest + QHC_NAME(lang));
     QFile::remove(dest + QCH_NAME(lang));
 
@@ -78,6 +97,9 @@ QString ManualServer::deployDocs()
     QFile qch(dest + QCH_NAME(lang));
     qch.setPermissions(QFile::ReadOwner|QFile::WriteOwner|QFile::ExeOwner);
 
+    if (qhc.exists() && qch.exists() && stampFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        stampFile.write(stamp);
+
     return dest + "manual-" + lang + ".qhc";
 }
 
@@ -89,6 +111,7 @@ void ManualServer::setupHelpEngine()
 {
     QString collectionFile = deployDocs() ;
 
+    delete m_helpEngine;
     m_helpEngine = new QHelpEngineCore(collectionFile, this);
 
     QStringList filters = m_helpEngine->customFilters();
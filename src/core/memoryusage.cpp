@@ -0,0 +1,94 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/memoryusage.h"
+
+#include "core/evaluator.h"
+#include "core/numberformatter.h"
+#include "core/session.h"
+#include "math/hmath.h"
+
+#include <QStringList>
+
+MemoryUsage MemoryUsage::measure(const Session* session, const Evaluator* evaluator)
+{
+    MemoryUsage usage;
+    if (session) {
+        usage.add(QStringLiteral("history"), session->historyBytes());
+        usage.add(QStringLiteral("variables"), session->variablesBytes());
+        usage.add(QStringLiteral("user functions"), session->userFunctionsBytes());
+    }
+    if (evaluator)
+        usage.add(QStringLiteral("evaluator caches"), evaluator->cacheBytes());
+    usage.add(QStringLiteral("formatted results"), NumberFormatter::cacheBytes());
+
+    usage.add(QStringLiteral("number free lists"), HMath::freeListBytes());
+    return usage;
+}
+
+void MemoryUsage::trim(Session* session, Evaluator* evaluator)
+{
+    if (evaluator)
+        evaluator->trimCaches();
+    if (session)
+        session->compact();
+    NumberFormatter::clearCache();
+    HMath::trimFreeLists();
+}
+
+void MemoryUsage::add(const QString& name, qint64 bytes)
+{
+    Item item;
+    item.name = name;
+    item.bytes = bytes;
+    m_items.append(item);
+}
+
+qint64 MemoryUsage::total() const
+{
+    qint64 bytes = 0;
+    for (const Item& item : m_items)
+        bytes += item.bytes;
+    return bytes;
+}
+
+static QString formatBytes(qint64 bytes)
+{
+    if (bytes < 10 * 1024)
+        return QString("%1 B").arg(bytes);
+    if (bytes < 10 * 1024 * 1024)
+        return QString("%1 KiB").arg(bytes / 1024);
+    return QString("%1 MiB").arg(bytes / (1024 * 1024));
+}
+
+QString MemoryUsage::toText() const
+{
+    QStringList lines;
+    for (const Item& item : m_items)
+        lines.append(item.name + QStringLiteral(": ") + formatBytes(item.bytes));
+    lines.append(QStringLiteral("total: ") + formatBytes(total()));
+    return lines.join('\n');
+}
+
+QJsonObject MemoryUsage::toJson() const
+{
+    QJsonObject json;
+    for (const Item& item : m_items)
+        json[item.name] = double(item.bytes);
+    json["total"] = double(total());
+    return json;
+}
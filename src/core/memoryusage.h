@@ -0,0 +1,58 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_MEMORYUSAGE_H
+#define CORE_MEMORYUSAGE_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+class Evaluator;
+class Session;
+
+// The memory a session and the caches of the engine take, by subsystem,
+// and trim(), which gives back what is only kept to go faster. The sizes
+// are estimates from the contents, not counted allocations, and the free
+// lists of numbers are those of the calling thread: each thread keeps its
+// own, bounded ones.
+class MemoryUsage {
+public:
+    struct Item {
+        QString name;
+        qint64 bytes;
+    };
+
+    static MemoryUsage measure(const Session*, const Evaluator*);
+    // Drops the caches of the evaluator and the shared ones, compacts the
+    // session and empties the free lists of the calling thread.
+    static void trim(Session*, Evaluator*);
+
+    // For the caches of the user interface.
+    void add(const QString& name, qint64 bytes);
+    const QVector<Item>& items() const { return m_items; }
+    qint64 total() const;
+    // One line for each item and one for the total.
+    QString toText() const;
+    // The bytes of each item by name, and "total".
+    QJsonObject toJson() const;
+
+private:
+    QVector<Item> m_items;
+};
+
+#endif
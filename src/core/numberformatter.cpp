@@ -19,13 +19,61 @@
 
 #include "core/numberformatter.h"
 
+#include "core/pipelinetrace.h"
 #include "core/settings.h"
 #include "math/quantity.h"
 
+#include <QtCore/QCache>
+#include <QtCore/QDataStream>
+#include <QtCore/QMutex>
+
 static const QChar g_dotChar = QString::fromUtf8("⋅")[0];
 static const QChar g_minusChar = QString::fromUtf8("−")[0];
 
+// The same values are formatted over and over by the result display, the
+// variables dock, the bit field and the status bar. The cache is bounded
+// by the bytes its entries take, roughly.
+static const int FormatCacheBytes = 256 * 1024;
+
+static QCache<QByteArray, QString> formatCache(FormatCacheBytes);
+static QMutex formatCacheMutex;
+
+static QString formatQuantity(Quantity q);
+
 QString NumberFormatter::format(Quantity q)
+{
+    PipelineTrace::Span span("NumberFormatter::format");
+    QByteArray packed;
+    QDataStream stream(&packed, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    q.serialize(stream);
+    const QByteArray key = settingsKey() + '\0' + packed;
+
+    QMutexLocker locker(&formatCacheMutex);
+    if (const QString* cached = formatCache.object(key))
+        return *cached;
+    locker.unlock();
+
+    const QString result = formatQuantity(q);
+    locker.relock();
+    formatCache.insert(key, new QString(result),
+                 key.size() + 2 * result.size() + 2 * int(sizeof(QString)));
+    return result;
+}
+
+qint64 NumberFormatter::cacheBytes()
+{
+    QMutexLocker locker(&formatCacheMutex);
+    return formatCache.totalCost();
+}
+
+void NumberFormatter::clearCache()
+{
+    QMutexLocker locker(&formatCacheMutex);
+    formatCache.clear();
+}
+
+static QString formatQuantity(Quantity q)
 {
     Settings* settings = Settings::instance();
 
@@ -150,3 +198,53 @@ QString NumberFormatter::format(Quantity q)
 
     return result;
 }
+
+// Runs of decimal or hexadecimal digits, as formatted.
+static bool isRunDigit(QChar c)
+{
+    const ushort u = c.unicode();
+    return (u >= '0' && u <= '9') || (u >= 'A' && u <= 'F');
+}
+
+QString NumberFormatter::shorten(const QString& formatted)
+{
+    // The digits kept at each end of a shortened run.
+    const int kept = ShortenedDigits / 4;
+    const int length = formatted.length();
+    QString result;
+    int done = 0;
+    for (int i = 0; i < length;) {
+        if (!isRunDigit(formatted.at(i))) {
+            ++i;
+            continue;
+        }
+        int end = i;
+        while (end < length && isRunDigit(formatted.at(end)))
+            ++end;
+        if (end - i > ShortenedDigits) {
+            result += formatted.mid(done, i + kept - done)
+                + QChar(0x2026) + QLatin1Char('[') + QString::number(end - i)
+                + QLatin1String(" digits]") + QChar(0x2026)
+                + formatted.mid(end - kept, kept);
+            done = end;
+        }
+        i = end;
+    }
+    if (done == 0)
+        return formatted;
+    return result + formatted.mid(done);
+}
+
+QByteArray NumberFormatter::settingsKey()
+{
+    const Settings* settings = Settings::instance();
+    QByteArray key;
+    key.append(settings->resultFormat);
+    key.append(settings->resultFormatComplex);
+    key.append(settings->angleUnit);
+    key.append(settings->radixCharacter());
+    key.append(QByteArray::number(settings->resultPrecision));
+    key.append(':');
+    key.append(QByteArray::number(HMath::workingPrecision()));
+    return key;
+}
@@ -22,12 +22,23 @@
 
 #include "quantity.h"
 
+#include <QtCore/QByteArray>
 #include <QtCore/QString>
 
 struct NumberFormatter {
     static QString format(HNumber &num) { return format(Quantity(num)); }
     static QString format(CNumber &num) { return format(Quantity(num)); }
     static QString format(Quantity);
+    // The settings format() depends on, to tell when results formatted
+    // earlier must be formatted again.
+    static QByteArray settingsKey();
+    // The memory the formatted results kept take, and dropping them.
+    static qint64 cacheBytes();
+    static void clearCache();
+    // The formatted result with each run of more than ShortenedDigits
+    // digits cut to its ends and its length, for display.
+    static QString shorten(const QString& formatted);
+    static const int ShortenedDigits = 64;
 };
 
 #endif
@@ -21,26 +21,72 @@
 #ifndef CORE_OPCODE_H
 #define CORE_OPCODE_H
 
-#include<QString>
+#include<QtGlobal>
+#include<QVector>
 
+class Function;
+class Quantity;
+class Session;
+class UserFunction;
+class Variable;
 
+
+// One instruction of a compiled expression. It is a plain pair of a type
+// and an operand, so programs are contiguous and copied with memcpy. The
+// operand indexes the constants (Load), the identifiers (Ref, and Conv
+// for the text of the unit), the arguments of the user function being
+// run (Arg) or counts arguments (Function). Sqr squares the top of the
+// stack, Pow with an exponent of 2 is compiled to it. Unit is a Conv to a
+// constant target: its operand indexes the constants, where the target
+// already carries the display unit to set. Range starts the first
+// argument of a range function, the body run for each value of the loop
+// variable: its operand counts the instructions of the body that follow.
+// Counter loads the value of the loop variable of the given nesting.
+// Store copies the top of the stack to the given slot, Recall loads it
+// again: a subexpression written more than once is computed once.
 class Opcode
 {
 public:
     enum  Type { Nop, Load, Ref, Function, Add, Sub, Neg, Mul, Div, Pow,
-           Fact, Modulo, IntDiv, LSh, RSh, BAnd, BOr, Conv };
+           Fact, Modulo, IntDiv, LSh, RSh, BAnd, BOr, Conv, Arg, Sqr, Unit,
+           Range, Counter, Store, Recall };
 
     Type type;
-    unsigned index;
-
-    // TODO: this is only needed for Conv Op. Maybe refactor this to a smarter place?
-    // TODO: only keep a pointer to the string
-    QString text;
+    quint32 index;
 
     Opcode() : type(Nop), index(0) {}
     Opcode(Type t) : type(t), index(0) {}
-    Opcode(Type t, QString txt) : type(t), index(0), text(txt) {}
-    Opcode(Type t, unsigned i): type(t), index(i) {}
+    Opcode(Type t, quint32 i): type(t), index(i) {}
+};
+
+Q_DECLARE_TYPEINFO(Opcode, Q_PRIMITIVE_TYPE);
+
+// What an identifier of a compiled expression refers to, so that running
+// it needs no lookup by name. See Evaluator::bind().
+struct IdentifierBinding
+{
+    enum Kind { Unknown, Variable, Function, UserFunction, List };
+
+    Kind kind;
+    const ::Variable* variable;
+    ::Function* function;
+    const ::UserFunction* userFunction;
+    const QVector<Quantity>* list;
+
+    IdentifierBinding()
+        : kind(Unknown), variable(nullptr), function(nullptr), userFunction(nullptr)
+        , list(nullptr) {}
+};
+
+// The bindings of all identifiers of an expression. They hold for one
+// revision of one session.
+struct IdentifierBindings
+{
+    const Session* session;
+    unsigned revision;
+    QVector<IdentifierBinding> targets;
+
+    IdentifierBindings() : session(nullptr), revision(0) {}
 };
 
 #endif // CORE_OPCODE_H
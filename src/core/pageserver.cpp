@@ -24,7 +24,10 @@ QString PageServer::getPageContent(const QString& id)
     if (!maker)
         return QString();
     m_currentPageID = id;
-    return maker();
+    QHash<QString, QString>::const_iterator page = m_pages.constFind(id);
+    if (page != m_pages.constEnd())
+        return page.value();
+    return m_pages[id] = maker();
 }
 
 QString PageServer::getCurrentPageContent()
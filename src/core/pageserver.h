@@ -29,6 +29,8 @@ public:
     explicit PageServer(QObject* parent = 0) : QObject(parent) { }
     QString getPageContent(const QString& id);
     QString getCurrentPageContent();
+    // Drops the pages made so far, e.g. after a language change.
+    void clearPageCache() { m_pages.clear(); }
 
 protected:
     typedef QString (*PageMaker)();
@@ -38,6 +40,7 @@ protected:
 private:
     Q_DISABLE_COPY(PageServer)
     QHash<QString, PageMaker> m_toc;
+    QHash<QString, QString> m_pages;
     QString m_currentPageID;
 };
 
@@ -0,0 +1,191 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/pipelinetrace.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+namespace {
+
+struct Record {
+    const char* name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+// -1 until the environment has been looked at.
+QAtomicInt enabled(-1);
+
+struct TraceState {
+    TraceState() : next(0), count(0)
+    {
+        clock.start();
+        records.resize(PipelineTrace::DefaultCapacity);
+    }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    // The oldest record is at next once the buffer is full.
+    QVector<Record> records;
+    int next;
+    int count;
+};
+
+TraceState& state()
+{
+    static TraceState s;
+    return s;
+}
+
+// Small numbers for the threads, in the order they record a span.
+QAtomicInt threadCount(0);
+thread_local int threadNumber = 0;
+
+int currentThread()
+{
+    if (threadNumber == 0)
+        threadNumber = threadCount.fetchAndAddRelaxed(1) + 1;
+    return threadNumber;
+}
+
+// Chrome trace events are in microseconds.
+double toMicroseconds(qint64 nsecs)
+{
+    return nsecs / 1000.0;
+}
+
+} // namespace
+
+PipelineTrace::Span::Span(const char* name)
+    : m_name(name)
+    , m_start(-1)
+{
+    if (isEnabled())
+        m_start = state().clock.nsecsElapsed();
+}
+
+PipelineTrace::Span::~Span()
+{
+    if (m_start < 0 || !isEnabled())
+        return;
+    TraceState& s = state();
+    const Record record = {m_name, m_start, s.clock.nsecsElapsed() - m_start, currentThread()};
+    QMutexLocker locker(&s.mutex);
+    if (s.records.isEmpty())
+        return;
+    s.records[s.next] = record;
+    s.next = (s.next + 1) % s.records.size();
+    s.count = qMin(s.count + 1, s.records.size());
+}
+
+void PipelineTrace::enable(bool on)
+{
+    state();
+    enabled.storeRelease(on ? 1 : 0);
+}
+
+bool PipelineTrace::isEnabled()
+{
+    int on = enabled.loadAcquire();
+    if (on < 0) {
+        const QByteArray value = qgetenv("SPEEDCRUNCH_TRACE");
+        enabled.testAndSetOrdered(-1, !value.isEmpty() && value != "0" ? 1 : 0);
+        on = enabled.loadAcquire();
+        if (on)
+            state();
+    }
+    return on != 0;
+}
+
+void PipelineTrace::setCapacity(int spans)
+{
+    TraceState& s = state();
+    QMutexLocker locker(&s.mutex);
+    s.records.clear();
+    s.records.resize(qMax(spans, 0));
+    s.records.squeeze();
+    s.next = 0;
+    s.count = 0;
+}
+
+int PipelineTrace::capacity()
+{
+    TraceState& s = state();
+    QMutexLocker locker(&s.mutex);
+    return s.records.size();
+}
+
+int PipelineTrace::count()
+{
+    TraceState& s = state();
+    QMutexLocker locker(&s.mutex);
+    return s.count;
+}
+
+void PipelineTrace::clear()
+{
+    TraceState& s = state();
+    QMutexLocker locker(&s.mutex);
+    s.next = 0;
+    s.count = 0;
+}
+
+QByteArray PipelineTrace::toChromeTrace()
+{
+    TraceState& s = state();
+    QVector<Record> records;
+    {
+        QMutexLocker locker(&s.mutex);
+        records.reserve(s.count);
+        const int first = s.count < s.records.size() ? 0 : s.next;
+        for (int i = 0; i < s.count; ++i)
+            records.append(s.records.at((first + i) % s.records.size()));
+    }
+
+    QJsonArray events;
+    for (const Record& record : records) {
+        QJsonObject event;
+        event["name"] = QString::fromLatin1(record.name);
+        event["ph"] = QStringLiteral("X");
+        event["pid"] = 1;
+        event["tid"] = record.thread;
+        event["ts"] = toMicroseconds(record.start);
+        event["dur"] = toMicroseconds(record.duration);
+        events.append(event);
+    }
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = QStringLiteral("ms");
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool PipelineTrace::save(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(toChromeTrace()) >= 0;
+}
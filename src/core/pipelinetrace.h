@@ -0,0 +1,60 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_PIPELINETRACE_H
+#define CORE_PIPELINETRACE_H
+
+#include <QtGlobal>
+
+class QByteArray;
+class QString;
+
+// Records how long the stages of an evaluation take while the program
+// runs: fixing up, scanning, compiling and executing the expression,
+// formatting the result, highlighting and displaying it. Tracing is off
+// unless the SPEEDCRUNCH_TRACE environment variable is set or enable() is
+// called; a disabled span costs a flag test. The latest spans are kept in
+// a ring buffer, which toChromeTrace() writes in the Chrome trace format
+// (load it in chrome://tracing). Spans may be recorded from any thread.
+class PipelineTrace {
+public:
+    // Times a stage from construction to destruction. Spans can nest.
+    class Span {
+    public:
+        explicit Span(const char* name);
+        ~Span();
+    private:
+        const char* m_name;
+        qint64 m_start;
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+
+    static const int DefaultCapacity = 16384;
+
+    static void enable(bool);
+    static bool isEnabled();
+    // Resizing drops the spans recorded so far.
+    static void setCapacity(int spans);
+    static int capacity();
+    static int count();
+    static void clear();
+    static QByteArray toChromeTrace();
+    static bool save(const QString& fileName);
+};
+
+#endif
@@ -20,9 +20,12 @@
 #include "sessionhistory.h"
 #include "variable.h"
 #include "evaluator.h"
+#include "taskpool.h"
 
+#include <QDataStream>
 #include <QFile>
 #include <QJsonDocument>
+#include <QVector>
 #include <functions.h>
 
 
@@ -68,51 +71,385 @@ void Session::serialize(QJsonObject &json) const
         func_entries.append(curr_entry_obj);
     }
     json["functions"] = func_entries;
+
+    if (m_workingPrecision > 0)
+        json["workingPrecision"] = m_workingPrecision;
+}
+
+// The changes kept for changesSince(), beyond which views are built again.
+static const int MaxChanges = 4096;
+
+// Histories at least this long are decoded on several threads.
+static const int ParallelHistorySize = 2048;
+
+// Stored values outlive the evaluation that made them, and keep only the
+// memory their digits need, see HNumber::squeeze().
+static Variable squeezed(const Variable & var)
+{
+    Variable result(var);
+    Quantity value = var.value();
+    value.squeeze();
+    result.setValue(value);
+    return result;
+}
+
+static QVector<Quantity> squeezed(QVector<Quantity> values)
+{
+    for (Quantity & value : values)
+        value.squeeze();
+    values.squeeze();
+    return values;
+}
+
+static QVector<HistoryEntry> decodeHistory(const QJsonArray & json)
+{
+    const int n = json.size();
+    QVector<HistoryEntry> entries(n);
+    const int threads = TaskGroup::maxThreadCount();
+    if (n < ParallelHistorySize || threads < 2) {
+        for (int i = 0; i < n; ++i)
+            entries[i] = HistoryEntry(json.at(i).toObject());
+        return entries;
+    }
+
+    // Each entry only depends on its own object, so the parts can be
+    // decoded at the same time. Each task gets a copy of the array, the
+    // threads share no instance. The numbers they create all start as
+    // copies of the same bc zero, whose reference count is atomic for
+    // this (see number.c). More parts than threads, as the results
+    // differ in length.
+    TaskGroup group;
+    HistoryEntry * const results = entries.data();
+    const int parts = 4 * threads;
+    for (int i = 0; i < parts; ++i) {
+        const int begin = qint64(n) * i / parts;
+        const int end = qint64(n) * (i + 1) / parts;
+        group.run([json, begin, end, results] {
+            for (int j = begin; j < end; ++j)
+                results[j] = HistoryEntry(json.at(j).toObject());
+        });
+    }
+    group.wait();
+    return entries;
 }
 
 int Session::deSerialize(const QJsonObject &json, bool merge=false)
 {
     QString version = json["version"].toString();
+    const bool journaling = m_journaling;
+    m_journaling = false;
     if(!merge) {
         m_history.clear();
+        m_expressionPool.clear();
+        m_resultPool.clear();
         m_variables.clear();
+        ++m_historyRevision;
+        ++m_bindingRevision;
     }
 
     Evaluator::instance()->initializeBuiltInVariables();
 
     if (json.contains("history")) {
-        QJsonArray hist_obj = json["history"].toArray();
-        int n = hist_obj.size();
-        for(int i=0; i<n; ++i) {
-            m_history.append(HistoryEntry(hist_obj[i].toObject()));
-        }
+        const QVector<HistoryEntry> entries = decodeHistory(json["history"].toArray());
+        m_history.reserve(m_history.size() + entries.size());
+        for(int i=0; i<entries.size(); ++i)
+            m_history.append(intern(entries.at(i)));
     }
 
     if (json.contains("variables")) {
         QJsonArray var_obj = json["variables"].toArray();
         int n = var_obj.size();
+        m_variables.reserve(m_variables.size() + n);
         for(int i=0; i<n; ++i) {
             QJsonObject var = var_obj[i].toObject();
-            m_variables[var["identifier"].toString()].deSerialize(var);
+            Variable & stored = m_variables[var["identifier"].toString()];
+            stored.deSerialize(var);
+            stored = squeezed(stored);
         }
     }
+    ++m_bindingRevision;
 
-    if (json.contains("history")) {
+    // The compiled functions are only kept for the precision they were
+    // compiled with.
+    if (json.contains("workingPrecision"))
+        setWorkingPrecision(json["workingPrecision"].toInt());
+    else if (!merge)
+        m_workingPrecision = 0;
+
+    if (json.contains("functions")) {
         QJsonArray func_obj = json["functions"].toArray();
         int n = func_obj.size();
-        for(int i=0; i<n; ++i) {
-            UserFunction func(func_obj[i].toObject());
-            addUserFunction(func);
-        }
+        QList<UserFunction> functions;
+        functions.reserve(n);
+        for(int i=0; i<n; ++i)
+            functions.append(UserFunction(func_obj[i].toObject()));
+        addUserFunctions(functions);
     }
 
+    resetChanges();
+    m_journaling = journaling;
     return version==SPEEDCRUNCH_VERSION;
 }
 
-void Session::addVariable(const Variable &var)
+static const quint32 BinaryMagic = 0x53435353; // "SCSS"
+static const quint32 BinaryFormatVersion = 4;
+
+void Session::serialize(QDataStream &stream) const
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << BinaryMagic << BinaryFormatVersion << QString(SPEEDCRUNCH_VERSION);
+
+    // The history is written as a table of the distinct expressions, one
+    // of the distinct results, and a pair of indexes for each entry.
+    QHash<QString, quint32> expressions;
+    QHash<QByteArray, quint32> results;
+    QList<QString> expressionTable;
+    QList<QByteArray> resultTable;
+    QVector<quint32> entries;
+    entries.reserve(2 * m_history.size());
+    for (int i = 0; i < m_history.size(); ++i) {
+        const QString expr = m_history.at(i).expr();
+        const QByteArray result = m_history.at(i).packedResult();
+        QHash<QString, quint32>::const_iterator e = expressions.constFind(expr);
+        if (e == expressions.constEnd()) {
+            e = expressions.insert(expr, expressionTable.size());
+            expressionTable.append(expr);
+        }
+        QHash<QByteArray, quint32>::const_iterator r = results.constFind(result);
+        if (r == results.constEnd()) {
+            r = results.insert(result, resultTable.size());
+            resultTable.append(result);
+        }
+        entries << e.value() << r.value();
+    }
+    stream << quint32(expressionTable.size());
+    for (int i = 0; i < expressionTable.size(); ++i)
+        stream << expressionTable.at(i);
+    stream << quint32(resultTable.size());
+    for (int i = 0; i < resultTable.size(); ++i)
+        stream << resultTable.at(i);
+    stream << quint32(m_history.size());
+    for (int i = 0; i < entries.size(); ++i)
+        stream << entries.at(i);
+
+    QList<const Variable*> variables;
+    QHashIterator<QString, Variable> i(m_variables);
+    while (i.hasNext()) {
+        i.next();
+        if (i.value().type() != Variable::BuiltIn || i.value().identifier() == "ans")
+            variables.append(&i.value());
+    }
+    stream << quint32(variables.size());
+    for (int k = 0; k < variables.size(); ++k)
+        variables.at(k)->serialize(stream);
+
+    // Functions are few, they keep their JSON form, compiled code included.
+    stream << quint32(m_userFunctions.size());
+    QHashIterator<QString, UserFunction> j(m_userFunctions);
+    while (j.hasNext()) {
+        j.next();
+        QJsonObject json;
+        j.value().serialize(json);
+        stream << QJsonDocument(json).toJson(QJsonDocument::Compact);
+    }
+
+    stream << qint32(m_workingPrecision);
+}
+
+bool Session::deSerialize(QDataStream &stream, bool merge)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, format, count;
+    QString version;
+    stream >> magic >> format >> version;
+    // Format 3 only lacks the expressions of the variables.
+    if (stream.status() != QDataStream::Ok || magic != BinaryMagic
+        || (format != BinaryFormatVersion && format != 3))
+        return false;
+
+    // Everything is read before the session is touched. The entries share
+    // the strings and results of the tables.
+    QVector<QString> expressions;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString expr;
+        stream >> expr;
+        expressions.append(expr);
+    }
+    QVector<QByteArray> results;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray result;
+        stream >> result;
+        results.append(result);
+    }
+    History history;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        quint32 expr, result;
+        stream >> expr >> result;
+        if (int(expr) >= expressions.size() || int(result) >= results.size()) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        HistoryEntry entry;
+        entry.setExpr(expressions.at(expr));
+        entry.setPackedResult(results.at(result));
+        history.append(entry);
+    }
+
+    QList<Variable> variables;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Variable var;
+        var.deSerialize(stream, format >= 4);
+        variables.append(var);
+    }
+
+    QList<UserFunction> functions;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray json;
+        stream >> json;
+        functions.append(UserFunction(QJsonDocument::fromJson(json).object()));
+    }
+
+    qint32 precision;
+    stream >> precision;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    const bool journaling = m_journaling;
+    m_journaling = false;
+    if (!merge) {
+        m_history.clear();
+        m_expressionPool.clear();
+        m_resultPool.clear();
+        m_variables.clear();
+        ++m_historyRevision;
+        ++m_bindingRevision;
+    }
+    Evaluator::instance()->initializeBuiltInVariables();
+
+    if (m_history.isEmpty()) {
+        m_history = history;
+        m_expressionPool = QSet<QString>::fromList(expressions.toList());
+        m_resultPool = QSet<QByteArray>::fromList(results.toList());
+    } else {
+        m_history.reserve(m_history.size() + history.size());
+        for (int i = 0; i < history.size(); ++i)
+            m_history.append(intern(history.at(i)));
+    }
+    m_variables.reserve(m_variables.size() + variables.size());
+    for (int i = 0; i < variables.size(); ++i)
+        m_variables[variables.at(i).identifier()] = squeezed(variables.at(i));
+    ++m_bindingRevision;
+
+    setWorkingPrecision(precision);
+    addUserFunctions(functions);
+    resetChanges();
+    m_journaling = journaling;
+    return true;
+}
+
+// Records a change, unless it only touches builtin variables. A record
+// for a variable or function replaces the ones for it not taken yet, so
+// that e.g. the updates of ans between two saves leave only the last.
+void Session::journal(const QJsonObject &record, const QString &key)
+{
+    if (!m_journaling)
+        return;
+    if (!key.isEmpty()) {
+        QHash<QString, int>::iterator i = m_journalKeys.find(key);
+        if (i != m_journalKeys.end()) {
+            m_journal[*i].clear();
+            *i = m_journal.size();
+        } else {
+            m_journalKeys.insert(key, m_journal.size());
+        }
+    }
+    m_journal.append(QJsonDocument(record).toJson(QJsonDocument::Compact));
+}
+
+QByteArray Session::takeJournal()
 {
+    QByteArray records;
+    for (int i = 0; i < m_journal.size(); ++i) {
+        if (!m_journal.at(i).isEmpty())
+            records.append(m_journal.at(i)).append('\n');
+    }
+    m_journal.clear();
+    m_journalKeys.clear();
+    return records;
+}
+
+// Applies the records of takeJournal() in order. A line that can't be
+// read, as the last one after a crash while it was written, ends the
+// replay: false is then returned.
+bool Session::replayJournal(const QByteArray &journal)
+{
+    const bool journaling = m_journaling;
+    m_journaling = false;
+    bool complete = true;
+    const QList<QByteArray> lines = journal.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        if (lines.at(i).trimmed().isEmpty())
+            continue;
+        QJsonParseError error;
+        const QJsonDocument doc = QJsonDocument::fromJson(lines.at(i), &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+            complete = false;
+            break;
+        }
+
+        const QJsonObject record = doc.object();
+        const QString op = record["op"].toString();
+        const int index = record["index"].toInt(-1);
+        if (op == "history")
+            addHistoryEntry(HistoryEntry(record["entry"].toObject()));
+        else if (op == "insertHistory" && index >= 0 && index <= m_history.size())
+            insertHistoryEntry(index, HistoryEntry(record["entry"].toObject()));
+        else if (op == "removeHistory" && index >= 0 && index < m_history.size())
+            removeHistoryEntryAt(index);
+        else if (op == "clearHistory")
+            clearHistory();
+        else if (op == "variable")
+            addVariable(Variable(record["variable"].toObject()));
+        else if (op == "removeVariable")
+            removeVariable(record["identifier"].toString());
+        else if (op == "clearVariables")
+            clearVariables();
+        else if (op == "function")
+            addUserFunction(UserFunction(record["function"].toObject()));
+        else if (op == "removeFunction")
+            removeUserFunction(record["name"].toString());
+        else if (op == "clearFunctions")
+            clearUserFunctions();
+    }
+    m_journaling = journaling;
+    return complete;
+}
+
+void Session::addVariable(const Variable &variable)
+{
+    const Variable var = squeezed(variable);
     QString id = var.identifier();
-    m_variables[id] = var;
+    if (m_journaling && (var.type() != Variable::BuiltIn || id == "ans")) {
+        QJsonObject record, json;
+        var.serialize(json);
+        record["op"] = QString("variable");
+        record["variable"] = json;
+        journal(record, "variable:" + id);
+    }
+    VariableContainer::iterator i = m_variables.find(id);
+    if (i != m_variables.end()) {
+        *i = var;
+        noteChange(Change::Changed, Change::Variables, id);
+        return;
+    }
+    m_variables.insert(id, var);
+    ++m_bindingRevision;
+    noteChange(Change::Added, Change::Variables, id);
 }
 
 bool Session::hasVariable(const QString &id) const
@@ -122,12 +459,26 @@ bool Session::hasVariable(const QString &id) const
 
 void Session::removeVariable(const QString &id)
 {
-    m_variables.remove(id);
+    const Variable * var = findVariable(id);
+    if (m_journaling && var && (var->type() != Variable::BuiltIn || id == "ans")) {
+        QJsonObject record;
+        record["op"] = QString("removeVariable");
+        record["identifier"] = id;
+        journal(record, "variable:" + id);
+    }
+    if (m_variables.remove(id))
+        noteChange(Change::Removed, Change::Variables, id);
+    ++m_bindingRevision;
 }
 
 void Session::clearVariables()
 {
+    QJsonObject record;
+    record["op"] = QString("clearVariables");
+    journal(record);
     m_variables.clear();
+    ++m_bindingRevision;
+    resetChanges();
 }
 
 Variable Session::getVariable(const QString &id) const
@@ -135,6 +486,51 @@ Variable Session::getVariable(const QString &id) const
     return m_variables.value(id);
 }
 
+const Variable * Session::findVariable(const QString &id) const
+{
+    VariableContainer::const_iterator i = m_variables.constFind(id);
+    return i == m_variables.constEnd() ? nullptr : &*i;
+}
+
+void Session::addList(const QString &id, const QVector<Quantity> &values)
+{
+    ListContainer::iterator i = m_lists.find(id);
+    if (i != m_lists.end()) {
+        *i = squeezed(values);
+        return;
+    }
+    m_lists.insert(id, squeezed(values));
+    ++m_bindingRevision;
+}
+
+bool Session::hasList(const QString &id) const
+{
+    return m_lists.contains(id);
+}
+
+void Session::removeList(const QString &id)
+{
+    m_lists.remove(id);
+    ++m_bindingRevision;
+}
+
+void Session::clearLists()
+{
+    m_lists.clear();
+    ++m_bindingRevision;
+}
+
+const QVector<Quantity> * Session::findList(const QString &id) const
+{
+    ListContainer::const_iterator i = m_lists.constFind(id);
+    return i == m_lists.constEnd() ? nullptr : &*i;
+}
+
+QStringList Session::listNames() const
+{
+    return m_lists.keys();
+}
+
 QList<Variable> Session::variablesToList() const
 {
     return m_variables.values();
@@ -153,17 +549,38 @@ bool Session::isBuiltInVariable(const QString & id) const
 
 void Session::addHistoryEntry(const HistoryEntry &entry)
 {
-    m_history.append(entry);
+    if (m_journaling) {
+        QJsonObject record, json;
+        entry.serialize(json);
+        record["op"] = QString("history");
+        record["entry"] = json;
+        journal(record);
+    }
+    m_history.append(intern(entry));
 }
 
 void Session::insertHistoryEntry(const int index, const HistoryEntry &entry)
 {
-    m_history.insert(index, entry);
+    if (m_journaling) {
+        QJsonObject record, json;
+        entry.serialize(json);
+        record["op"] = QString("insertHistory");
+        record["index"] = index;
+        record["entry"] = json;
+        journal(record);
+    }
+    m_history.insert(index, intern(entry));
+    ++m_historyRevision;
 }
 
 void Session::removeHistoryEntryAt(const int index)
 {
+    QJsonObject record;
+    record["op"] = QString("removeHistory");
+    record["index"] = index;
+    journal(record);
     m_history.removeAt(index);
+    ++m_historyRevision;
 }
 
 HistoryEntry Session::historyEntryAt(const int index) const
@@ -173,29 +590,250 @@ HistoryEntry Session::historyEntryAt(const int index) const
 
 void Session::clearHistory()
 {
+    QJsonObject record;
+    record["op"] = QString("clearHistory");
+    journal(record);
     m_history.clear();
+    m_expressionPool.clear();
+    m_resultPool.clear();
+    ++m_historyRevision;
+}
+
+// Returns entry with the expression and result of an earlier one when
+// they are equal, so that their data is shared.
+HistoryEntry Session::intern(const HistoryEntry &entry)
+{
+    HistoryEntry shared;
+    shared.setExpr(*m_expressionPool.insert(entry.expr()));
+    shared.setPackedResult(*m_resultPool.insert(entry.packedResult()));
+    return shared;
+}
+
+static qint64 stringBytes(const QString & str)
+{
+    return sizeof(QString) + 2 * qint64(str.capacity());
+}
+
+// A number takes about as much as its packed form, digits and exponent.
+static qint64 quantityBytes(const Quantity & q)
+{
+    QByteArray packed;
+    QDataStream stream(&packed, QIODevice::WriteOnly);
+    q.serialize(stream);
+    return sizeof(Quantity) + packed.size();
+}
+
+qint64 Session::historyBytes() const
+{
+    // The expressions and results are counted once for the entries that
+    // share them.
+    qint64 bytes = m_history.count() * qint64(sizeof(HistoryEntry) + sizeof(void *));
+    for (const QString & expr : m_expressionPool)
+        bytes += stringBytes(expr);
+    for (const QByteArray & result : m_resultPool)
+        bytes += sizeof(QByteArray) + result.capacity();
+    return bytes;
+}
+
+qint64 Session::variablesBytes() const
+{
+    qint64 bytes = 0;
+    for (auto i = m_variables.constBegin(); i != m_variables.constEnd(); ++i)
+        bytes += stringBytes(i.key()) + sizeof(Variable) + quantityBytes(i.value().value());
+    for (auto i = m_lists.constBegin(); i != m_lists.constEnd(); ++i) {
+        bytes += stringBytes(i.key());
+        for (const Quantity & value : i.value())
+            bytes += quantityBytes(value);
+    }
+    return bytes;
+}
+
+qint64 Session::userFunctionsBytes() const
+{
+    qint64 bytes = 0;
+    for (const UserFunction & func : m_userFunctions) {
+        bytes += sizeof(UserFunction) + stringBytes(func.name())
+                 + stringBytes(func.expression()) + stringBytes(func.description())
+                 + func.opcodes.capacity() * qint64(sizeof(Opcode));
+        for (const Quantity & constant : func.constants)
+            bytes += quantityBytes(constant);
+        for (const QString & identifier : func.identifiers)
+            bytes += stringBytes(identifier);
+        for (const QVector<Quantity> & arguments : func.memo.arguments) {
+            for (const Quantity & argument : arguments)
+                bytes += quantityBytes(argument);
+        }
+        for (const Quantity & result : func.memo.results)
+            bytes += quantityBytes(result);
+    }
+    return bytes;
+}
+
+// The pools keep the expressions and results of removed history entries
+// until the history is cleared: they are built again from the entries
+// left.
+void Session::compact()
+{
+    QSet<QString> expressions;
+    QSet<QByteArray> results;
+    expressions.reserve(m_history.count());
+    results.reserve(m_history.count());
+    for (const HistoryEntry & entry : m_history) {
+        expressions.insert(entry.expr());
+        results.insert(entry.packedResult());
+    }
+    m_expressionPool.swap(expressions);
+    m_resultPool.swap(results);
+    m_expressionPool.squeeze();
+    m_resultPool.squeeze();
+    for (auto i = m_variables.begin(); i != m_variables.end(); ++i)
+        i.value() = squeezed(i.value());
+    for (auto i = m_lists.begin(); i != m_lists.end(); ++i)
+        i.value() = squeezed(i.value());
+    m_variables.squeeze();
+    m_userFunctions.squeeze();
+    m_lists.squeeze();
+    m_journalKeys.squeeze();
+    for (auto i = m_userFunctions.begin(); i != m_userFunctions.end(); ++i)
+        i.value().memo = UserFunction::Memo();
+    // Squeezing may move the variables and the functions.
+    ++m_bindingRevision;
+}
+
+// The copy shares the numbers, which other threads may read at the same
+// time, but not the containers: pointers into them are kept while
+// evaluating, and must not move when one of the sessions changes.
+Session Session::snapshot() const
+{
+    Session copy;
+    copy.m_variables.reserve(m_variables.size());
+    for (auto i = m_variables.constBegin(); i != m_variables.constEnd(); ++i)
+        copy.m_variables.insert(i.key(), i.value());
+    copy.m_lists.reserve(m_lists.size());
+    for (auto i = m_lists.constBegin(); i != m_lists.constEnd(); ++i)
+        copy.m_lists.insert(i.key(), i.value());
+    copy.m_userFunctions.reserve(m_userFunctions.size());
+    for (auto i = m_userFunctions.constBegin(); i != m_userFunctions.constEnd(); ++i) {
+        // What the evaluator keeps in a function holds for this session.
+        UserFunction & function = *copy.m_userFunctions.insert(i.key(), i.value());
+        function.bindings = IdentifierBindings();
+        function.memo = UserFunction::Memo();
+    }
+    copy.m_workingPrecision = m_workingPrecision;
+    return copy;
+}
+
+// The revisions go on from those of this session, so that an evaluator
+// does not take what it kept for the old contents for the new ones.
+void Session::adopt(Session &snapshot)
+{
+    m_variables.swap(snapshot.m_variables);
+    m_lists.swap(snapshot.m_lists);
+    m_userFunctions.swap(snapshot.m_userFunctions);
+    m_workingPrecision = snapshot.m_workingPrecision;
+    ++m_userFunctionsRevision;
+    ++m_bindingRevision;
+    resetChanges();
+}
+
+// Functions compiled for the current precision are taken as they are,
+// with a single change of revision, before the others are compiled.
+void Session::addUserFunctions(const QList<UserFunction> &functions)
+{
+    const int precision = m_workingPrecision > 0
+                          ? m_workingPrecision : HMath::defaultWorkingPrecision();
+    QList<UserFunction> uncompiled;
+    m_userFunctions.reserve(m_userFunctions.size() + functions.size());
+    for (int i = 0; i < functions.size(); ++i) {
+        const UserFunction &func = functions.at(i);
+        if (func.opcodes.isEmpty() || (func.precision > 0 && func.precision != precision))
+            uncompiled.append(func);
+        else
+            m_userFunctions[func.name()] = func;
+    }
+    if (uncompiled.size() < functions.size()) {
+        ++m_userFunctionsRevision;
+        ++m_bindingRevision;
+    }
+    for (int i = 0; i < uncompiled.size(); ++i)
+        addUserFunction(uncompiled.at(i));
 }
 
 void Session::addUserFunction(const UserFunction &func)
 {
-    if(func.opcodes.isEmpty()) {
+    const int precision = m_workingPrecision > 0
+                          ? m_workingPrecision : HMath::defaultWorkingPrecision();
+    if(func.opcodes.isEmpty() || (func.precision > 0 && func.precision != precision)) {
         // We need to compile the function, so pretend the user typed it.
         Evaluator::instance()->setExpression(func.name() + "(" + func.arguments().join(";") + ")=" + func.expression());
         Evaluator::instance()->eval();
     } else {
         QString name = func.name();
+        if (m_journaling) {
+            QJsonObject record, json;
+            func.serialize(json);
+            record["op"] = QString("function");
+            record["function"] = json;
+            journal(record, "function:" + name);
+        }
+        const Change::Kind kind = m_userFunctions.contains(name) ? Change::Changed : Change::Added;
         m_userFunctions[name] = func;
+        ++m_userFunctionsRevision;
+        ++m_bindingRevision;
+        noteChange(kind, Change::UserFunctions, name);
     }
 }
 
 void Session::removeUserFunction(const QString &str)
 {
-    m_userFunctions.remove(str);
+    QJsonObject record;
+    record["op"] = QString("removeFunction");
+    record["name"] = str;
+    journal(record, "function:" + str);
+    if (m_userFunctions.remove(str))
+        noteChange(Change::Removed, Change::UserFunctions, str);
+    ++m_userFunctionsRevision;
+    ++m_bindingRevision;
 }
 
 void Session::clearUserFunctions()
 {
+    QJsonObject record;
+    record["op"] = QString("clearFunctions");
+    journal(record);
     m_userFunctions.clear();
+    ++m_userFunctionsRevision;
+    ++m_bindingRevision;
+    resetChanges();
+}
+
+void Session::noteChange(Change::Kind kind, Change::Subject subject, const QString &key)
+{
+    Change change;
+    change.kind = kind;
+    change.subject = subject;
+    change.key = key;
+    m_changes.append(change);
+    ++m_changeCount;
+    if (m_changes.size() > MaxChanges) {
+        m_changes.removeFirst();
+        ++m_changesFrom;
+    }
+}
+
+void Session::resetChanges()
+{
+    m_changes.clear();
+    ++m_changeCount;
+    m_changesFrom = m_changeCount;
+}
+
+bool Session::changesSince(quint64 count, QList<Change> &changes) const
+{
+    if (count < m_changesFrom || count > m_changeCount)
+        return false;
+    changes = m_changes.mid(int(count - m_changesFrom));
+    return true;
 }
 
 bool Session::hasUserFunction(const QString &str) const
@@ -23,24 +23,67 @@
 #include "sessionhistory.h"
 #include "variable.h"
 #include "userfunction.h"
+#include <QByteArray>
 #include <QList>
 #include <QHash>
+#include <QSet>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 #include <QJsonArray>
+#include <QJsonObject>
 
-
+class QDataStream;
 
 class Session {
+public:
+    // A change of the variables or of the user functions, see changesSince().
+    struct Change {
+        enum Kind { Added, Changed, Removed };
+        enum Subject { Variables, UserFunctions };
+        Kind kind;
+        Subject subject;
+        // The identifier of the variable or the name of the function.
+        QString key;
+    };
+
 private:
     typedef QList<HistoryEntry> History ;
     typedef QHash<QString, Variable> VariableContainer;
     typedef QHash<QString, UserFunction> FunctionContainer;
+    typedef QHash<QString, QVector<Quantity> > ListContainer;
     History m_history;
     VariableContainer m_variables;
     FunctionContainer m_userFunctions;
+    ListContainer m_lists;
+    int m_workingPrecision;
+    unsigned m_userFunctionsRevision;
+    unsigned m_bindingRevision;
+    unsigned m_historyRevision;
+    bool m_journaling;
+    // The records not taken yet; those replaced by a later one for the
+    // same variable or function are left empty. m_journalKeys has the
+    // index of the last record for each.
+    QList<QByteArray> m_journal;
+    QHash<QString, int> m_journalKeys;
+    // The distinct expressions and results of the history, which equal
+    // ones share. They are only emptied with the history.
+    QSet<QString> m_expressionPool;
+    QSet<QByteArray> m_resultPool;
+    // The latest changes, the first of them being change number
+    // m_changesFrom. A bulk change drops them all.
+    QList<Change> m_changes;
+    quint64 m_changeCount;
+    quint64 m_changesFrom;
+
+    void journal(const QJsonObject & record, const QString & key = QString());
+    void addUserFunctions(const QList<UserFunction> & functions);
+    HistoryEntry intern(const HistoryEntry & entry);
+    void noteChange(Change::Kind kind, Change::Subject subject, const QString & key);
+    void resetChanges();
 
 public:
-    Session() {}
+    Session() : m_workingPrecision(0), m_userFunctionsRevision(0), m_bindingRevision(0), m_historyRevision(0), m_journaling(false), m_changeCount(0), m_changesFrom(0) {}
     Session(QJsonObject & json);
 
     void load();
@@ -48,6 +91,21 @@ public:
 
     void serialize(QJsonObject &json) const;
     int deSerialize(const QJsonObject & json, bool merge);
+    // The binary form keeps numbers as significand and exponent, and is
+    // much faster to load than JSON. deSerialize() returns false, leaving
+    // the session as it was, if the data is not such a session.
+    void serialize(QDataStream & stream) const;
+    bool deSerialize(QDataStream & stream, bool merge);
+
+    // While journaling, each change of the history, the variables or the
+    // user functions is recorded, but for those made by deSerialize(),
+    // after which a new snapshot is due anyway. takeJournal() hands the records over, one
+    // JSON object per line, to be appended to what replayJournal() reads
+    // back on top of a serialized session.
+    void setJournaling(bool enabled) {m_journaling = enabled;}
+    bool isJournaling() const {return m_journaling;}
+    QByteArray takeJournal();
+    bool replayJournal(const QByteArray & journal);
 
 
     void addVariable(const Variable & var);
@@ -55,15 +113,30 @@ public:
     void removeVariable(const QString & id);
     void clearVariables();
     Variable getVariable(const QString & id) const;
+    const Variable * findVariable(const QString & id) const;
     QList<Variable> variablesToList() const;
     bool isBuiltInVariable(const QString &id) const;
 
+    // Lists of numbers, such as the columns of imported data. They are not
+    // saved with the session. A list passed to a function gives it all its
+    // values as arguments, a variable of the same name hides it.
+    void addList(const QString & id, const QVector<Quantity> & values);
+    bool hasList(const QString & id) const;
+    void removeList(const QString & id);
+    void clearLists();
+    const QVector<Quantity> * findList(const QString & id) const;
+    QStringList listNames() const;
+
     void addHistoryEntry(const HistoryEntry & entry);
     void insertHistoryEntry(const int index, const HistoryEntry & entry);
     void removeHistoryEntryAt(const int index);
     HistoryEntry historyEntryAt(const int index) const;
+    int historyCount() const {return m_history.count();}
     QList<HistoryEntry> historyToList() const {return m_history;}
     void clearHistory();
+    // Changes whenever the history changes other than by adding entries at
+    // its end, so that views of it can add only the new ones otherwise.
+    unsigned historyRevision() const {return m_historyRevision;}
 
     void addUserFunction(const UserFunction & func);
     void removeUserFunction(const QString & str);
@@ -71,6 +144,39 @@ public:
     bool hasUserFunction(const QString & str) const;
     QList<UserFunction> UserFunctionsToList() const;
     const UserFunction * getUserFunction(const QString & fname) const;
+    // Changes whenever a user function is added or removed.
+    unsigned userFunctionsRevision() const {return m_userFunctionsRevision;}
+    // Changes whenever a variable, a list or a user function appears or goes
+    // away. Pointers returned by findVariable(), findList() and
+    // getUserFunction() stay valid until then.
+    unsigned bindingRevision() const {return m_bindingRevision;}
+
+    // Views of the variables and user functions keep the changeCount() they
+    // show, and update themselves with the changes made since, in order.
+    // changesSince() returns false when those are no longer all known, as
+    // after loading or clearing, and the view must be built again.
+    quint64 changeCount() const {return m_changeCount;}
+    bool changesSince(quint64 count, QList<Change> & changes) const;
+
+    // The memory the history, the variables and lists, and the user
+    // functions take, roughly. compact() drops what the history no longer
+    // uses and the spare capacity of the containers.
+    qint64 historyBytes() const;
+    qint64 variablesBytes() const;
+    qint64 userFunctionsBytes() const;
+    void compact();
+
+    // For evaluating on another thread while this session goes on changing,
+    // see EvaluationService. snapshot() copies the variables, the lists,
+    // the user functions and the precision, but not the history, into
+    // containers of its own. adopt() swaps them with those of a snapshot;
+    // changesSince(changeCount()) then lists what is changed after.
+    Session snapshot() const;
+    void adopt(Session & snapshot);
+
+    // 0 means HMath::defaultWorkingPrecision().
+    int workingPrecision() const {return m_workingPrecision;}
+    void setWorkingPrecision(int prec) {m_workingPrecision = prec > 0 ? prec : 0;}
 };
 
 #endif // CORE_SESSION_H
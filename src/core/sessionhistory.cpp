@@ -18,6 +18,8 @@
 
 #include "sessionhistory.h"
 
+#include <QDataStream>
+
 
 HistoryEntry::HistoryEntry(const QJsonObject & json)
 {
@@ -31,7 +33,11 @@ QString HistoryEntry::expr() const
 
 Quantity HistoryEntry::result() const
 {
-    return m_result;
+    if (m_packedResult.isEmpty())
+        return Quantity(0);
+    QDataStream stream(m_packedResult);
+    stream.setVersion(QDataStream::Qt_5_0);
+    return Quantity::deSerialize(stream);
 }
 
 void HistoryEntry::setExpr(const QString & e)
@@ -41,14 +47,17 @@ void HistoryEntry::setExpr(const QString & e)
 
 void HistoryEntry::setResult(const Quantity & n)
 {
-    m_result = n;
+    m_packedResult.clear();
+    QDataStream stream(&m_packedResult, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    n.serialize(stream);
 }
 
 void HistoryEntry::serialize(QJsonObject & json) const
 {
     json["expression"] = m_expr;
     QJsonObject result;
-    m_result.serialize(result);
+    this->result().serialize(result);
     json["result"] = result;
     return;
 }
@@ -61,6 +70,6 @@ void HistoryEntry::deSerialize(const QJsonObject & json)
         m_expr = json["expression"].toString();
 
     if (json.contains("result"))
-        m_result = Quantity(json["result"].toObject());
+        setResult(Quantity(json["result"].toObject()));
     return;
 }
@@ -20,6 +20,7 @@
 #ifndef CORE_SESSIONHISTORY_H
 #define CORE_SESSIONHISTORY_H
 
+#include <QByteArray>
 #include <QJsonArray>
 #include <QString>
 #include <QList>
@@ -31,12 +32,15 @@ class HistoryEntry
 {
 private:
     QString m_expr;
-    Quantity m_result;
+    // The result is only kept in its binary form, decoded each time it is
+    // asked for, so that a long history costs little until it is shown
+    // and equal results can share their data. Empty stands for 0.
+    QByteArray m_packedResult;
 public:
-    HistoryEntry() : m_expr(""), m_result(0) {}
+    HistoryEntry() : m_expr("") {}
     HistoryEntry(const QJsonObject & json);
-    HistoryEntry(const QString & expr, const Quantity & num) : m_expr(expr), m_result(num) {}
-    HistoryEntry(const HistoryEntry & other) :  m_expr(other.m_expr), m_result(other.m_result) {}
+    HistoryEntry(const QString & expr, const Quantity & num) : m_expr(expr) {setResult(num);}
+    HistoryEntry(const HistoryEntry & other) :  m_expr(other.m_expr), m_packedResult(other.m_packedResult) {}
 
     void setExpr(const QString & e);
     void setResult(const Quantity & n);
@@ -44,6 +48,10 @@ public:
     QString expr() const;
     Quantity result() const;
 
+    // See Quantity::serialize(QDataStream&).
+    QByteArray packedResult() const {return m_packedResult;}
+    void setPackedResult(const QByteArray & packed) {m_packedResult = packed;}
+
     void serialize(QJsonObject & json) const;
     void deSerialize(const QJsonObject & json);
 };
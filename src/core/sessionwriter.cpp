@@ -0,0 +1,117 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/sessionwriter.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+SessionWriter::SessionWriter()
+    : m_busy(false)
+    , m_stopping(false)
+{
+}
+
+SessionWriter::~SessionWriter()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_queued.wakeAll();
+    }
+    wait();
+}
+
+void SessionWriter::writeSnapshot(const QString& path, const QByteArray& data,
+                                  const QStringList& obsolete)
+{
+    Write write;
+    write.snapshot = true;
+    write.path = path;
+    write.data = data;
+    write.obsolete = obsolete;
+    enqueue(write);
+}
+
+void SessionWriter::appendJournal(const QString& path, const QByteArray& header,
+                                  const QByteArray& records)
+{
+    Write write;
+    write.snapshot = false;
+    write.path = path;
+    write.header = header;
+    write.data = records;
+    enqueue(write);
+}
+
+void SessionWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_busy || !m_writes.isEmpty())
+        m_written.wait(&m_mutex);
+}
+
+void SessionWriter::enqueue(const Write& write)
+{
+    QMutexLocker locker(&m_mutex);
+    if (write.snapshot)
+        m_writes.clear();
+    m_writes.append(write);
+    m_queued.wakeAll();
+    if (!isRunning())
+        start(QThread::LowPriority);
+}
+
+void SessionWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_writes.isEmpty() && !m_stopping)
+            m_queued.wait(&m_mutex);
+        if (m_writes.isEmpty())
+            return;
+        const Write write = m_writes.takeFirst();
+        m_busy = true;
+        locker.unlock();
+
+        if (write.snapshot) {
+            // QSaveFile syncs the data to disk before it renames the file.
+            QSaveFile file(write.path);
+            if (file.open(QIODevice::WriteOnly)) {
+                file.write(write.data);
+                if (file.commit()) {
+                    for (int i = 0; i < write.obsolete.count(); ++i)
+                        QFile::remove(write.obsolete.at(i));
+                }
+            }
+        } else {
+            QFile file(write.path);
+            if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                if (file.size() == 0)
+                    file.write(write.header);
+                file.write(write.data);
+                file.close();
+            }
+        }
+
+        locker.relock();
+        m_busy = false;
+        if (m_writes.isEmpty())
+            m_written.wakeAll();
+    }
+}
@@ -0,0 +1,74 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_SESSIONWRITER_H
+#define CORE_SESSIONWRITER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+// Writes the files that keep the session across runs on a thread of its
+// own, in the order they are handed over, so that saving a large session
+// doesn't stall the user interface. The data is serialized by the caller.
+class SessionWriter : public QThread {
+public:
+    SessionWriter();
+    // Finishes the pending writes.
+    ~SessionWriter();
+
+    // Replaces the file at path with data, atomically. The writes not
+    // started yet are dropped, as the snapshot has all of them; once it is
+    // on disk, the obsolete files are removed.
+    void writeSnapshot(const QString& path, const QByteArray& data,
+                       const QStringList& obsolete);
+    // Appends records to the journal at path; an empty journal is started
+    // with header.
+    void appendJournal(const QString& path, const QByteArray& header,
+                       const QByteArray& records);
+    // Waits until everything handed over so far is written.
+    void flush();
+
+protected:
+    void run() override;
+
+private:
+    Q_DISABLE_COPY(SessionWriter)
+
+    struct Write {
+        bool snapshot;
+        QString path;
+        QByteArray header;
+        QByteArray data;
+        QStringList obsolete;
+    };
+
+    void enqueue(const Write&);
+
+    QMutex m_mutex;
+    QWaitCondition m_queued;
+    QWaitCondition m_written;
+    QList<Write> m_writes;
+    bool m_busy;
+    bool m_stopping;
+};
+
+#endif // CORE_SESSIONWRITER_H
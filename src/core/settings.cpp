@@ -23,11 +23,10 @@
 
 #include "math/floatconfig.h"
 
+#include <QCoreApplication>
 #include <QDir>
 #include <QLocale>
 #include <QSettings>
-#include <QApplication>
-#include <QFont>
 #include <QtCore/QStandardPaths>
 
 #ifdef Q_OS_WIN
@@ -54,7 +53,7 @@ static const char* DefaultColorScheme = "Terminal";
 QString Settings::getConfigPath()
 {
 #ifdef SPEEDCRUNCH_PORTABLE
-    return QApplication::applicationDirPath();
+    return QCoreApplication::applicationDirPath();
 #elif defined(Q_OS_WIN)
     // On Windows, use AppData/Roaming/SpeedCrunch, the same path as getDataPath.
     return getDataPath();
@@ -70,7 +69,7 @@ QString Settings::getConfigPath()
 QString Settings::getDataPath()
 {
 #ifdef SPEEDCRUNCH_PORTABLE
-    return QApplication::applicationDirPath();
+    return QCoreApplication::applicationDirPath();
 #elif QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
     return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
 #elif defined(Q_OS_WIN)
@@ -100,7 +99,7 @@ QString Settings::getDataPath()
 QString Settings::getCachePath()
 {
 #ifdef SPEEDCRUNCH_PORTABLE
-    return QApplication::applicationDirPath();
+    return QCoreApplication::applicationDirPath();
 #else
     return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
 #endif
@@ -156,6 +155,7 @@ void Settings::load()
 
     autoAns = settings->value(key + QLatin1String("AutoAns"), true).toBool();
     autoCalc = settings->value(key + QLatin1String("AutoCalc"), true).toBool();
+    autoRecalculation = settings->value(key + QLatin1String("AutoRecalculation"), false).toBool();
     autoCompletion = settings->value(key + QLatin1String("AutoCompletion"), true).toBool();
     sessionSave = settings->value(key + QLatin1String("SessionSave"), true).toBool();
     leaveLastExpression = settings->value(key + QLatin1String("LeaveLastExpression"), false).toBool();
@@ -163,6 +163,7 @@ void Settings::load()
     syntaxHighlighting = settings->value(key + QLatin1String("SyntaxHighlighting"), true).toBool();
     autoResultToClipboard = settings->value(key + QLatin1String("AutoResultToClipboard"), false).toBool();
     windowPositionSave = settings->value(key + QLatin1String("WindowPositionSave"), true).toBool();
+    maxThreads = qMax(settings->value(key + QLatin1String("MaxThreads"), 0).toInt(), 0);
     complexNumbers = settings->value(key + QLatin1String("ComplexNumbers"), false).toBool();
 
     digitGrouping = settings->value(key + QLatin1String("DigitGrouping"), 0).toInt();
@@ -186,6 +187,7 @@ void Settings::load()
         resultFormatComplex = cmplxFormat.at(0).toLatin1();
 
     resultPrecision = settings->value(key + QLatin1String("Precision"), -1).toInt();
+    shortenLongResults = settings->value(key + QLatin1String("ShortenLongResults"), true).toBool();
 
     if (resultPrecision > DECPRECISION)
         resultPrecision = DECPRECISION;
@@ -208,7 +210,8 @@ void Settings::load()
     manualWindowGeometry = settings->value(key + QLatin1String("ManualWindowGeometry")).toByteArray();
 
     key = KEY + QLatin1String("/Display/");
-    displayFont = settings->value(key + QLatin1String("DisplayFont"), QFont().toString()).toString();
+    // Empty stands for the default font, core code does not depend on QtGui.
+    displayFont = settings->value(key + QLatin1String("DisplayFont"), QString()).toString();
     colorScheme = settings->value(key + QLatin1String("ColorSchemeName"), DefaultColorScheme).toString();
 
     delete settings;
@@ -229,11 +232,13 @@ void Settings::save()
     settings->setValue(key + QLatin1String("AutoCompletion"), autoCompletion);
     settings->setValue(key + QLatin1String("AutoAns"), autoAns);
     settings->setValue(key + QLatin1String("AutoCalc"), autoCalc);
+    settings->setValue(key + QLatin1String("AutoRecalculation"), autoRecalculation);
     settings->setValue(key + QLatin1String("SyntaxHighlighting"), syntaxHighlighting);
     settings->setValue(key + QLatin1String("DigitGrouping"), digitGrouping);
     settings->setValue(key + QLatin1String("AutoResultToClipboard"), autoResultToClipboard);
     settings->setValue(key + QLatin1String("Language"), language);
     settings->setValue(key + QLatin1String("WindowPositionSave"), windowPositionSave);
+    settings->setValue(key + QLatin1String("MaxThreads"), maxThreads);
     settings->setValue(key + QLatin1String("ComplexNumbers"), complexNumbers);
 
     settings->setValue(key + QLatin1String("AngleMode"), QString(QChar(angleUnit)));
@@ -248,6 +253,7 @@ void Settings::save()
     settings->setValue(key + QLatin1String("Type"), QString(QChar(resultFormat)));
     settings->setValue(key + QLatin1String("ComplexForm"), QString(QChar(resultFormatComplex)));
     settings->setValue(key + QLatin1String("Precision"), resultPrecision);
+    settings->setValue(key + QLatin1String("ShortenLongResults"), shortenLongResults);
 
     key = KEY + QLatin1String("/Layout/");
 
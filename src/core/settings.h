@@ -49,9 +49,12 @@ public:
     char resultFormat;
     int resultPrecision; // See HMath documentation.
     char resultFormatComplex; // 'c' cartesian; 'p' polar.
+    // Long runs of digits are elided in the result display.
+    bool shortenLongResults;
 
     bool autoAns;
     bool autoCalc;
+    bool autoRecalculation;
     bool autoCompletion;
     int digitGrouping;
     bool sessionSave;
@@ -60,6 +63,7 @@ public:
     bool windowAlwaysOnTop;
     bool autoResultToClipboard;
     bool windowPositionSave;
+    int maxThreads; // 0: one per core.
 
     bool constantsDockVisible;
     bool functionsDockVisible;
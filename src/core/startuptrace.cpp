@@ -0,0 +1,168 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/startuptrace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include <cstdio>
+
+namespace {
+
+struct Record {
+    const char* name;
+    qint64 start;
+    qint64 duration; // -1 for marks and phases still running.
+    int depth;
+    bool isMark;
+};
+
+struct TraceState {
+    bool initialized = false;
+    bool enabled = false;
+    QString traceFile;
+    QElapsedTimer clock;
+    QVector<Record> records;
+    int depth = 0;
+};
+
+TraceState& state()
+{
+    static TraceState s;
+    if (!s.initialized) {
+        s.initialized = true;
+        const QByteArray value = qgetenv("SPEEDCRUNCH_TRACE_STARTUP");
+        if (!value.isEmpty()) {
+            s.enabled = true;
+            if (value != "1")
+                s.traceFile = QString::fromLocal8Bit(value);
+            s.clock.start();
+        }
+    }
+    return s;
+}
+
+// Chrome trace events are in microseconds.
+double toMicroseconds(qint64 nsecs)
+{
+    return nsecs / 1000.0;
+}
+
+void writeChromeTrace(const TraceState& s)
+{
+    QJsonArray events;
+    for (const Record& record : s.records) {
+        QJsonObject event;
+        event["name"] = QString::fromLatin1(record.name);
+        event["pid"] = 1;
+        event["tid"] = 1;
+        event["ts"] = toMicroseconds(record.start);
+        if (record.isMark) {
+            event["ph"] = QStringLiteral("i");
+            event["s"] = QStringLiteral("g");
+        } else {
+            event["ph"] = QStringLiteral("X");
+            event["dur"] = toMicroseconds(qMax(record.duration, qint64(0)));
+        }
+        events.append(event);
+    }
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = QStringLiteral("ms");
+
+    QFile file(s.traceFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::fprintf(stderr, "startup trace: cannot write %s\n",
+                     qPrintable(s.traceFile));
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+}
+
+} // namespace
+
+StartupTrace::Phase::Phase(const char* name)
+    : m_index(-1)
+{
+    TraceState& s = state();
+    if (!s.enabled)
+        return;
+    m_index = s.records.size();
+    s.records.append({name, s.clock.nsecsElapsed(), -1, s.depth++, false});
+}
+
+StartupTrace::Phase::~Phase()
+{
+    if (m_index < 0)
+        return;
+    TraceState& s = state();
+    Record& record = s.records[m_index];
+    record.duration = s.clock.nsecsElapsed() - record.start;
+    --s.depth;
+}
+
+void StartupTrace::enable(const QString& traceFile)
+{
+    TraceState& s = state();
+    if (!s.enabled) {
+        s.enabled = true;
+        s.clock.start();
+    }
+    if (!traceFile.isEmpty())
+        s.traceFile = traceFile;
+}
+
+bool StartupTrace::isEnabled()
+{
+    return state().enabled;
+}
+
+void StartupTrace::mark(const char* name)
+{
+    TraceState& s = state();
+    if (s.enabled)
+        s.records.append({name, s.clock.nsecsElapsed(), -1, s.depth, true});
+}
+
+void StartupTrace::finish()
+{
+    TraceState& s = state();
+    if (!s.enabled || s.records.isEmpty())
+        return;
+
+    std::fprintf(stderr, "Startup trace (ms since tracing began):\n");
+    for (const Record& record : s.records) {
+        const int indent = 2 * (record.depth + 1);
+        if (record.isMark)
+            std::fprintf(stderr, "%*s@ %9.3f  %s\n", indent, "",
+                         record.start / 1e6, record.name);
+        else
+            std::fprintf(stderr, "%*s%11.3f  %s (at %.3f)\n", indent, "",
+                         record.duration / 1e6, record.name,
+                         record.start / 1e6);
+    }
+
+    if (!s.traceFile.isEmpty())
+        writeChromeTrace(s);
+    s.records.clear();
+}
@@ -0,0 +1,51 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_STARTUPTRACE_H
+#define CORE_STARTUPTRACE_H
+
+#include <QtGlobal>
+
+class QString;
+
+// Records how long the phases of startup take. Tracing is off unless the
+// SPEEDCRUNCH_TRACE_STARTUP environment variable is set or main() passes
+// the --trace-startup option on to enable(). A summary goes to stderr when
+// finish() is called; if a file name was given instead of "1", the phases
+// are also written there as a Chrome trace (load it in chrome://tracing).
+// Only meant to be used from the GUI thread.
+class StartupTrace {
+public:
+    // Times a phase from construction to destruction. Phases can nest.
+    class Phase {
+    public:
+        explicit Phase(const char* name);
+        ~Phase();
+    private:
+        int m_index;
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+    };
+
+    static void enable(const QString& traceFile);
+    static bool isEnabled();
+    // Records a point in time, e.g. when the event loop first runs.
+    static void mark(const char* name);
+    static void finish();
+};
+
+#endif
@@ -0,0 +1,150 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "core/taskpool.h"
+
+#include "core/settings.h"
+#include "math/floatnum.h"
+#include "math/hmath.h"
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// The tasks of a group, shared with the runners still queued in the pool,
+// which may start after the group is gone and find nothing left to run.
+struct TaskGroup::State {
+    State() : active(0), workingPrecision(HMath::workingPrecision())
+    {
+        float_getcontext(&context);
+    }
+
+    QMutex mutex;
+    QWaitCondition idle;
+    QList<std::function<void()>> pending;
+    int active;
+    QAtomicInt cancelled;
+    floatcontext context;
+    int workingPrecision;
+};
+
+// One is queued in the pool for each task; it runs whichever task of the
+// group is next, if any is left.
+class TaskGroup::Runner : public QRunnable {
+public:
+    explicit Runner(const QSharedPointer<State>& state) : m_state(state) { }
+
+    void run() override
+    {
+        float_setcontext(&m_state->context);
+        HMath::setWorkingPrecision(m_state->workingPrecision);
+        TaskGroup::runNext(*m_state);
+    }
+
+private:
+    const QSharedPointer<State> m_state;
+};
+
+static QThreadPool* pool()
+{
+    static QThreadPool* instance = nullptr;
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+    if (!instance) {
+        instance = new QThreadPool;
+        const int threads = Settings::instance()->maxThreads;
+        instance->setMaxThreadCount(threads > 0 ? threads
+                                                : QThread::idealThreadCount());
+    }
+    return instance;
+}
+
+TaskGroup::TaskGroup(Priority priority)
+    : m_state(new State)
+    , m_priority(priority)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    cancel();
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    if (isCancelled())
+        return;
+    {
+        QMutexLocker locker(&m_state->mutex);
+        m_state->pending.append(std::move(task));
+    }
+    pool()->start(new Runner(m_state), m_priority == Interactive ? 1 : 0);
+}
+
+bool TaskGroup::runNext(State& state)
+{
+    std::function<void()> task;
+    {
+        QMutexLocker locker(&state.mutex);
+        if (state.pending.isEmpty())
+            return false;
+        task = state.pending.takeFirst();
+        ++state.active;
+    }
+    task();
+    QMutexLocker locker(&state.mutex);
+    if (--state.active == 0 && state.pending.isEmpty())
+        state.idle.wakeAll();
+    return true;
+}
+
+void TaskGroup::wait()
+{
+    while (runNext(*m_state))
+        ;
+    QMutexLocker locker(&m_state->mutex);
+    while (m_state->active > 0)
+        m_state->idle.wait(&m_state->mutex);
+}
+
+void TaskGroup::cancel()
+{
+    m_state->cancelled.storeRelease(1);
+    QMutexLocker locker(&m_state->mutex);
+    m_state->pending.clear();
+}
+
+bool TaskGroup::isCancelled() const
+{
+    return m_state->cancelled.loadAcquire() != 0;
+}
+
+int TaskGroup::maxThreadCount()
+{
+    return pool()->maxThreadCount();
+}
+
+void TaskGroup::setMaxThreadCount(int threads)
+{
+    pool()->setMaxThreadCount(threads > 0 ? threads
+                                          : QThread::idealThreadCount());
+}
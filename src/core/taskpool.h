@@ -0,0 +1,66 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef CORE_TASKPOOL_H
+#define CORE_TASKPOOL_H
+
+#include <QSharedPointer>
+
+#include <functional>
+
+// Runs tasks on the worker threads the engine and the user interface share,
+// instead of a thread pool for each feature. Tasks are handed over in
+// groups: waiting for a group runs its tasks not started yet on the waiting
+// thread, so a worker may wait for a group of its own, and cancelling one
+// drops them and tells the running ones through isCancelled(). Interactive
+// groups go before the background ones when waiting for a worker. Each
+// task runs with the floatnum context and the HMath working precision of
+// the thread that made its group.
+// Tasks may read numbers other threads read as well, like the floatnum
+// constants, but must not modify a number, or the session or evaluator
+// holding it, that another thread uses meanwhile (see floatnum.h).
+class TaskGroup {
+public:
+    enum Priority { Background, Interactive };
+
+    explicit TaskGroup(Priority = Interactive);
+    // Cancels the tasks not started yet and waits for the running ones.
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+    void wait();
+    void cancel();
+    bool isCancelled() const;
+
+    // The worker threads, one per core unless Settings::maxThreads or
+    // setMaxThreadCount() limit them.
+    static int maxThreadCount();
+    // 0 is one per core.
+    static void setMaxThreadCount(int);
+
+private:
+    Q_DISABLE_COPY(TaskGroup)
+
+    struct State;
+    class Runner;
+    static bool runNext(State&);
+
+    QSharedPointer<State> m_state;
+    const Priority m_priority;
+};
+
+#endif // CORE_TASKPOOL_H
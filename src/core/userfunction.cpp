@@ -20,12 +20,97 @@
 #include "core/userfunction.h"
 #include "core/evaluator.h"
 #include "core/opcode.h"
+#include "math/floatconfig.h"
 #include <QJsonArray>
 
+// Whether the compiled code refers to constants, identifiers and
+// arguments it has, so that it can run without further checks.
+static bool isValidCode(const QVector<Opcode>& opcodes, int constants,
+                        int identifiers, int arguments)
+{
+    // The slots are stored in order, before they are recalled.
+    int slots = 0;
+    for (int i = 0; i < opcodes.count(); ++i) {
+        const Opcode& opcode = opcodes.at(i);
+        const int index = int(opcode.index);
+        switch (opcode.type) {
+            case Opcode::Load:
+            case Opcode::Unit:
+                if (index < 0 || index >= constants)
+                    return false;
+                break;
+            case Opcode::Ref:
+            case Opcode::Conv:
+                if (index < 0 || index >= identifiers)
+                    return false;
+                break;
+            case Opcode::Arg:
+                if (index < 0 || index >= arguments)
+                    return false;
+                break;
+            case Opcode::Range:
+                if (index < 0 || index >= opcodes.count() - i)
+                    return false;
+                break;
+            case Opcode::Store:
+                if (index < 0 || index > slots)
+                    return false;
+                if (index == slots)
+                    ++slots;
+                break;
+            case Opcode::Recall:
+                if (index < 0 || index >= slots)
+                    return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
 
-//#define SAVE_COMPILED_FORM
+// Reads the compiled code saved by serialize(). Code of another version
+// of the evaluator is left out, the function is then compiled anew.
+static bool readBytecode(const QJsonObject& json, UserFunction& function)
+{
+    if (json["version"].toInt() != Evaluator::BytecodeVersion)
+        return false;
 
+    QVector<Quantity> constants;
+    const QJsonArray constantsJson = json["constants"].toArray();
+    for (int i = 0; i < constantsJson.size(); ++i)
+        constants.append(Quantity(constantsJson.at(i).toObject()));
 
+    QStringList identifiers;
+    const QJsonArray identifiersJson = json["identifiers"].toArray();
+    for (int i = 0; i < identifiersJson.size(); ++i)
+        identifiers.append(identifiersJson.at(i).toString());
+
+    // Pairs of type and operand.
+    QVector<Opcode> opcodes;
+    const QJsonArray codeJson = json["code"].toArray();
+    if (codeJson.isEmpty() || codeJson.size() % 2)
+        return false;
+    for (int i = 0; i < codeJson.size(); i += 2) {
+        const int type = codeJson.at(i).toInt(-1);
+        if (type < Opcode::Nop || type > Opcode::Recall)
+            return false;
+        opcodes.append(Opcode(static_cast<Opcode::Type>(type),
+                              quint32(codeJson.at(i + 1).toInt(-1))));
+    }
+    if (!isValidCode(opcodes, constants.count(), identifiers.count(),
+                     function.arguments().count()))
+    {
+        return false;
+    }
+
+    function.constants = constants;
+    function.identifiers = identifiers;
+    function.opcodes = opcodes;
+    function.stackDepth = Evaluator::stackDepth(opcodes);
+    function.precision = json["precision"].toInt();
+    return true;
+}
 
 UserFunction::UserFunction(const QJsonObject &json) : UserFunction()
 {
@@ -44,15 +129,9 @@ UserFunction::UserFunction(const QJsonObject &json) : UserFunction()
     if(json.contains("description"))
         m_description = json["description"].toString();
 
-    if(json.contains("opcodes")) {
-        const QJsonArray  & codes_json = json["opcodes"].toArray();
-        for(int i=0; i<codes_json.size(); ++i) {
-            Opcode opcode(static_cast<Opcode::Type>(codes_json[i].toObject()["t"].toInt()),  codes_json[i].toObject()["i"].toInt());
-            if(codes_json[i].toObject().contains("text"))
-                opcode.text = codes_json[i].toObject()["text"].toString();
-            opcodes.append(opcode);
-        }
-
+    if(json.contains("bytecode")) {
+        readBytecode(json["bytecode"].toObject(), *this);
+    } else if(json.contains("opcodes")) {
         const QJsonArray & const_json = json["constants"].toArray();
         for(int i=0; i<const_json.size(); ++i) {
             CNumber hn(const_json[i].toObject());
@@ -64,6 +143,23 @@ UserFunction::UserFunction(const QJsonObject &json) : UserFunction()
             identifiers.append(id_json[i].toString());
         }
 
+        const QJsonArray  & codes_json = json["opcodes"].toArray();
+        for(int i=0; i<codes_json.size(); ++i) {
+            const QJsonObject code_json = codes_json[i].toObject();
+            Opcode opcode(static_cast<Opcode::Type>(code_json["t"].toInt()),  code_json["i"].toInt());
+            // Older sessions store the unit of a conversion in the opcode.
+            if(code_json.contains("text")) {
+                identifiers.append(code_json["text"].toString());
+                opcode.index = identifiers.count() - 1;
+            }
+            // and refer to the arguments by name.
+            if(opcode.type == Opcode::Ref && int(opcode.index) < identifiers.count()) {
+                const int arg = m_arguments.indexOf(identifiers.at(opcode.index));
+                if(arg >= 0)
+                    opcode = Opcode(Opcode::Arg, arg);
+            }
+            opcodes.append(opcode);
+        }
     }
 }
 
@@ -118,36 +214,42 @@ void UserFunction::serialize(QJsonObject &json) const
     if(m_description!="")
         json["description"] = m_description;
 
-#ifdef SAVE_COMPILED_FORM
-    // if compiled form is available, save it as well
+    // The compiled form spares compiling the function when the session is
+    // loaded. Readers that don't know it compile the expression instead.
     if(!opcodes.isEmpty()) {
-        QJsonArray opcodes_json;
-        for(int i=0;i<opcodes.size(); ++i) {
-            QJsonObject curr_code_json;
-            const Opcode & curr_code = opcodes.at(i);
-            curr_code_json["t"] = curr_code.type;
-            curr_code_json["i"] = int(curr_code.index);
-            if(curr_code.text != "")
-                curr_code_json["text"] = curr_code.text;
-            opcodes_json.append(curr_code_json);
+        QJsonObject bytecode;
+        bytecode["version"] = Evaluator::BytecodeVersion;
+        bytecode["precision"] = precision;
+
+        QJsonArray code;
+        for(int i=0; i<opcodes.size(); ++i) {
+            code.append(int(opcodes.at(i).type));
+            code.append(int(opcodes.at(i).index));
         }
-        json["opcodes"] = opcodes_json;
+        bytecode["code"] = code;
 
+        // Fixed notation, as used for variables, would drop the digits of
+        // tiny constants.
+        const CNumber::Format format = CNumber::Format::Scientific()
+            + CNumber::Format::Precision(DECPRECISION) + CNumber::Format::Point();
         QJsonArray constants_json;
         for(int i=0; i<constants.size(); ++i) {
             QJsonObject curr_const_json;
             constants.at(i).serialize(curr_const_json);
+            QJsonObject value_json;
+            value_json["value"] = CMath::format(constants.at(i).numericValue(), format);
+            curr_const_json["numeric_value"] = value_json;
             constants_json.append(curr_const_json);
         }
-        json["constants"] = constants_json;
+        bytecode["constants"] = constants_json;
 
         QJsonArray identifiers_json;
-        for(int i=0; i<identifiers.size(); ++i) {
+        for(int i=0; i<identifiers.size(); ++i)
             identifiers_json.append(identifiers.at(i));
-        }
-        json["identifiers"] = identifiers_json;
+        bytecode["identifiers"] = identifiers_json;
+
+        json["bytecode"] = bytecode;
     }
-#endif
 }
 
 void UserFunction::deSerialize(const QJsonObject &json)
@@ -27,6 +27,8 @@
 #include "core/opcode.h"
 #include "math/quantity.h"
 
+class Session;
+
 class UserFunction
 {
 private:
@@ -39,10 +41,36 @@ public:
     QVector<Quantity> constants;
     QStringList identifiers;
     QVector<Opcode> opcodes;
+    // Filled in by the evaluator when the function runs.
+    mutable IdentifierBindings bindings;
+    // See Evaluator::stackDepth(), -1 if not verified.
+    int stackDepth;
+    // The working precision the constants were made with, 0 if unknown.
+    int precision;
+
+    // Results of earlier calls, see Evaluator::execUserFunction(). They
+    // hold for the session state and settings they were computed with.
+    struct Memo {
+        bool valid;
+        const Session* session;
+        unsigned revision;
+        char angleUnit;
+        bool complexMode;
+        int precision;
+        bool enabled;
+        QVector<QVector<Quantity>> arguments;
+        QVector<Quantity> results;
+        int next;
+
+        Memo() : valid(false), session(nullptr), revision(0), angleUnit(0)
+            , complexMode(false), precision(0), enabled(false), next(0) {}
+    };
+    mutable Memo memo;
 
     UserFunction(QString name, QStringList arguments, QString expression)
-        : m_name(name), m_arguments(arguments), m_expression(expression) {}
-    UserFunction() {}
+        : m_name(name), m_arguments(arguments), m_expression(expression)
+        , stackDepth(-1), precision(0) {}
+    UserFunction() : stackDepth(-1), precision(0) {}
     UserFunction(const QJsonObject & json);
 
     QString name() const;
@@ -20,6 +20,8 @@
 
 #include "variable.h"
 
+#include <QDataStream>
+
 
 Variable::Variable(const QJsonObject &json)
 {
@@ -33,6 +35,8 @@ void Variable::serialize(QJsonObject &json) const
     m_value.serialize(value);
     json["value"] = value;
     json["type"] = (m_type==UserDefined) ? QStringLiteral("User") : QStringLiteral("BuiltIn");
+    if (!m_expression.isEmpty())
+        json["expression"] = m_expression;
 }
 
 void Variable::deSerialize(const QJsonObject &json)
@@ -47,5 +51,25 @@ void Variable::deSerialize(const QJsonObject &json)
 
     if (json.contains("value"))
         m_value = Quantity(json["value"].toObject());
+
+    m_expression = json["expression"].toString();
+}
+
+void Variable::serialize(QDataStream &stream) const
+{
+    stream << m_identifier << (m_type == UserDefined);
+    m_value.serialize(stream);
+    stream << m_expression;
+}
+
+void Variable::deSerialize(QDataStream &stream, bool withExpression)
+{
+    bool user;
+    stream >> m_identifier >> user;
+    m_type = user ? UserDefined : BuiltIn;
+    m_value = Quantity::deSerialize(stream);
+    m_expression.clear();
+    if (withExpression)
+        stream >> m_expression;
 }
 
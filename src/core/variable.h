@@ -35,22 +35,30 @@ private:
     QString m_identifier;
     Quantity m_value;
     Type m_type;
+    // The expression it was assigned, to compute it again when what it
+    // refers to changes. Empty for a value set as it is.
+    QString m_expression;
 public:
     Variable() : m_identifier(""), m_value(0), m_type(UserDefined) {}
     Variable(const QJsonObject & json);
     Variable(const QString & id, const Quantity & val, Type t = UserDefined) : m_identifier(id), m_value(val), m_type(t) {}
-    Variable(const Variable & other) :  m_identifier(other.m_identifier), m_value(other.m_value), m_type(other.m_type) {}
+    Variable(const Variable & other) :  m_identifier(other.m_identifier), m_value(other.m_value), m_type(other.m_type), m_expression(other.m_expression) {}
 
     Quantity value() const {return m_value;}
     QString identifier() const {return m_identifier;}
     Type type() const {return m_type;}
+    QString expression() const {return m_expression;}
 
     void setValue(const Quantity & val) {m_value = val;}
     void set_identifier(const QString & str) {m_identifier = str;}
     void set_type(const Type t) {m_type = t;}
+    void setExpression(const QString & expr) {m_expression = expr;}
 
     void serialize(QJsonObject & json) const;
     void deSerialize(const QJsonObject & json);
+    void serialize(QDataStream & stream) const;
+    // Binary sessions of format 3 have no expressions.
+    void deSerialize(QDataStream & stream, bool withExpression = true);
     bool operator==(const Variable& other) const { return m_identifier == other.m_identifier; }
 };
 
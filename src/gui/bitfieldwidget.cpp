@@ -21,6 +21,7 @@
 
 #include "math/quantity.h"
 
+#include <climits>
 #include <cmath>
 
 #include <QGridLayout>
@@ -263,30 +264,33 @@ void BitFieldWidget::resizeEvent(QResizeEvent*)
   this->updateFieldLayout();
 }
 
-void BitFieldWidget::updateBits(const Quantity& number)
+// The lowest 64 bits of the magnitude of an integer, the bits that
+// DMath::format would show in binary. Numbers that fit in an int, which
+// HNumber keeps in a machine word, take a single conversion.
+static quint64 magnitudeBits(const Quantity& number)
 {
-    // Create a binary copy of number
-    // (simply converting it to binary will not work if its base is defined)
-    Quantity binNumber(number);
-    binNumber.setFormat(Quantity::Format::Fixed() + Quantity::Format::Binary() + Quantity(number).format());
-    QString binaryNumberString = DMath::format(binNumber);
-    QListIterator<BitWidget*> bitsIterator(m_bitWidgets);
-
     if (number.isZero() || !number.isInteger())
-        binaryNumberString.clear();
-    else if (number.isNegative())
-        binaryNumberString.remove(0, 3); // Remove '-0b'.
-    else
-        binaryNumberString.remove(0, 2); // Remove '0b'.
-
-    auto iterator = binaryNumberString.end();
-    while (bitsIterator.hasNext()) {
-        if (iterator != binaryNumberString.begin()) {
-            --iterator;
-            bitsIterator.next()->setState(*iterator == '1');
-        } else
-            bitsIterator.next()->setState(false);
+        return 0;
+    HNumber magnitude = HMath::abs(number.numericValue().real);
+    static const HNumber smallLimit(INT_MAX);
+    if (magnitude <= smallLimit)
+        return quint64(magnitude.toInt());
+
+    static const HNumber chunk(16);
+    quint64 bits = 0;
+    for (int shift = 0; shift < 64 && !magnitude.isZero(); shift += 16) {
+        bits |= quint64(HMath::mask(magnitude, chunk).toInt()) << shift;
+        magnitude = magnitude >> chunk;
     }
+    return bits;
+}
+
+void BitFieldWidget::updateBits(const Quantity& number)
+{
+    // Only the bits that differ are set, and so repainted.
+    const quint64 bits = magnitudeBits(number);
+    for (int i = 0; i < m_bitWidgets.count(); ++i)
+        m_bitWidgets.at(i)->setState((bits >> i) & 1);
 }
 
 void BitFieldWidget::onBitChanged()
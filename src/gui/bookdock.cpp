@@ -69,6 +69,7 @@ void BookDock::openPage(const QUrl& url)
 void BookDock::retranslateText()
 {
     setWindowTitle(tr("Formula Book"));
+    m_book->clearPageCache();
     QString content = m_book->getCurrentPageContent();
     if (!content.isNull())
         m_browser->setHtml(content);
@@ -36,6 +36,8 @@
 
 ConstantsWidget::ConstantsWidget(QWidget* parent)
     : QWidget(parent)
+    , m_list(new QTreeWidget(this))
+    , m_search(m_list, 1)
 {
     m_categoryLabel = new QLabel(this);
     m_category = new QComboBox(this);
@@ -65,7 +67,6 @@ ConstantsWidget::ConstantsWidget(QWidget* parent)
     searchLayout->addWidget(m_filter);
     searchLayout->setMargin(0);
 
-    m_list = new QTreeWidget(this);
     m_list->setAutoScroll(true);
     m_list->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     m_list->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
@@ -90,7 +91,7 @@ ConstantsWidget::ConstantsWidget(QWidget* parent)
     m_filterTimer = new QTimer(this);
     m_filterTimer->setInterval(500);
     m_filterTimer->setSingleShot(true);
-    connect(m_filterTimer, SIGNAL(timeout()), SLOT(filter()));
+    connect(m_filterTimer, SIGNAL(timeout()), SLOT(applyFilter()));
 
     m_noMatchLabel = new QLabel(this);
     m_noMatchLabel->setAlignment(Qt::AlignCenter);
@@ -100,8 +101,6 @@ ConstantsWidget::ConstantsWidget(QWidget* parent)
     retranslateText();
 
     setFocusProxy(m_filter);
-
-    filter();
 }
 
 ConstantsWidget::~ConstantsWidget()
@@ -130,21 +129,25 @@ void ConstantsWidget::retranslateText()
         titles << name << unit << value;
     m_list->setHeaderLabels(titles);
 
-    updateList();
+    // Filled from the event loop, so that a dock opened with the window
+    // doesn't hold the window back.
+    QTimer::singleShot(0, this, SLOT(updateList()));
 }
 
 void ConstantsWidget::filter()
 {
     const QList<Constant> &clist = Constants::instance()->list();
     const char radixChar = Settings::instance()->radixCharacter();
-    QString term = m_filter->text();
 
     m_filterTimer->stop();
     setUpdatesEnabled(false);
 
     QString chosenCategory = m_category->currentText();
 
+    // Items are made for all the constants of the category, the search
+    // filter hides those that don't match.
     m_list->clear();
+    m_search.apply(m_filter->text());
     for (int k = 0; k < clist.count(); ++k) {
         QStringList str;
         str << clist.at(k).name;
@@ -170,50 +173,58 @@ void ConstantsWidget::filter()
         if (!include)
             continue;
 
-        QTreeWidgetItem* item = nullptr;
-        if (term.isEmpty())
-            item = new QTreeWidgetItem(m_list, str);
-        else
-            if (str.at(0).contains(term, Qt::CaseInsensitive))
-                item = new QTreeWidgetItem(m_list, str);
-        if (item) {
-            QString tip;
-            tip += QString(QChar(0x200E));
-            tip += QString("<b>%1</b><br>%2").arg( clist.at(k).name, clist.at(k).value);
-            tip += QString(QChar(0x200E));
-            if (!clist.at(k).unit.isEmpty())
-                tip.append(" ").append(clist.at(k).unit);
-            if (radixChar != '.')
-                tip.replace('.', radixChar);
-            tip += QString(QChar(0x200E));
-            item->setToolTip(0, tip);
-            item->setToolTip(1, tip);
-            item->setToolTip(2, tip);
-
-            if (layoutDirection() == Qt::RightToLeft) {
-                item->setTextAlignment(1, Qt::AlignRight);
-                item->setTextAlignment(2, Qt::AlignLeft);
-            } else {
-                item->setTextAlignment(1, Qt::AlignLeft);
-                item->setTextAlignment(2, Qt::AlignLeft);
-            }
+        QTreeWidgetItem* item = new QTreeWidgetItem(m_list, str);
+        QString tip;
+        tip += QString(QChar(0x200E));
+        tip += QString("<b>%1</b><br>%2").arg( clist.at(k).name, clist.at(k).value);
+        tip += QString(QChar(0x200E));
+        if (!clist.at(k).unit.isEmpty())
+            tip.append(" ").append(clist.at(k).unit);
+        if (radixChar != '.')
+            tip.replace('.', radixChar);
+        tip += QString(QChar(0x200E));
+        item->setToolTip(0, tip);
+        item->setToolTip(1, tip);
+        item->setToolTip(2, tip);
+
+        if (layoutDirection() == Qt::RightToLeft) {
+            item->setTextAlignment(1, Qt::AlignRight);
+            item->setTextAlignment(2, Qt::AlignLeft);
+        } else {
+            item->setTextAlignment(1, Qt::AlignLeft);
+            item->setTextAlignment(2, Qt::AlignLeft);
         }
+
+        m_search.add(item);
     }
+    m_list->sortItems(0, Qt::AscendingOrder);
+
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
 
+void ConstantsWidget::applyFilter()
+{
+    m_filterTimer->stop();
+    setUpdatesEnabled(false);
+    m_search.apply(m_filter->text());
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
+void ConstantsWidget::finishUpdate()
+{
     m_list->resizeColumnToContents(0);
     m_list->resizeColumnToContents(1);
     m_list->resizeColumnToContents(2);
 
-    if (m_list->topLevelItemCount() > 0) {
+    if (m_search.hasShownItems()) {
         m_noMatchLabel->hide();
-        m_list->sortItems(0, Qt::AscendingOrder);
     } else {
         m_noMatchLabel->setGeometry(m_list->geometry());
         m_noMatchLabel->show();
         m_noMatchLabel->raise();
     }
-
-    setUpdatesEnabled(true);
 }
 
 void ConstantsWidget::handleItem(QTreeWidgetItem* item)
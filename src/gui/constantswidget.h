@@ -20,6 +20,8 @@
 #ifndef GUI_CONSTANTSWIDGET_H
 #define GUI_CONSTANTSWIDGET_H
 
+#include "gui/treefilter.h"
+
 #include <QWidget>
 
 class QComboBox;
@@ -42,6 +44,7 @@ public slots:
     void handleRadixCharacterChange();
 
 protected slots:
+    void applyFilter();
     void filter();
     void handleItem(QTreeWidgetItem*);
     void retranslateText();
@@ -54,6 +57,8 @@ protected:
 private:
     Q_DISABLE_COPY(ConstantsWidget)
 
+    void finishUpdate();
+
     QComboBox* m_category;
     QLabel* m_categoryLabel;
     QLineEdit* m_filter;
@@ -61,6 +66,7 @@ private:
     QLabel* m_label;
     QTreeWidget* m_list;
     QLabel* m_noMatchLabel;
+    TreeFilter m_search;
 };
 
 #endif
@@ -25,6 +25,7 @@
 #include "core/evaluator.h"
 #include "core/functions.h"
 #include "core/numberformatter.h"
+#include "core/pipelinetrace.h"
 #include "core/settings.h"
 #include "core/session.h"
 
@@ -48,6 +49,22 @@
 
 #include <algorithm>
 
+// How long a preview may take before it is given up, in milliseconds.
+// Previews run on a worker thread, so typing goes on meanwhile, and the
+// next keystroke cancels the one still running.
+static const int AutoCalcTimeout = 1000;
+// The longest an auto-calc waits for the keys typed after it, see
+// scheduleAutoCalc().
+static const int AutoCalcMaxDelay = 250;
+// The digits a preview is first computed with when doubles do not do,
+// before it is refined at the working precision.
+static const int AutoCalcRoughPrecision = 25;
+// An auto-calc cheaper than this, in milliseconds, runs as soon as the
+// pending events are handled. A costlier one waits about as long as it
+// took, so that it is not started and cancelled again for every key held
+// down or typed through an input method.
+static const int AutoCalcFrame = 16;
+
 static void moveCursorToEnd(Editor* editor)
 {
     QTextCursor cursor = editor->textCursor();
@@ -62,9 +79,18 @@ Editor::Editor(QWidget* parent)
     m_currentHistoryIndex = 0;
     m_isAutoCompletionEnabled = true;
     m_completion = new EditorCompletion(this);
+    m_completionIndex.addFunctions(FunctionRepo::instance()->getIdentifiers());
     m_constantCompletion = 0;
     m_completionTimer = new QTimer(this);
     m_isAutoCalcEnabled = true;
+    m_isAutoCalcPending = false;
+    m_isSelectionAutoCalcPending = false;
+    m_isPasting = false;
+    m_autoCalcTimer = new QTimer(this);
+    m_autoCalcCost = 0;
+    m_autoCalcJob = 0;
+    m_isSelectionAutoCalc = false;
+    m_evaluationService = new EvaluationService(this);
     m_highlighter = new SyntaxHighlighter(this);
     m_matchingTimer = new QTimer(this);
     m_shouldPaintCustomCursor = true;
@@ -81,6 +107,10 @@ Editor::Editor(QWidget* parent)
             this, &Editor::autoComplete);
     connect(m_completionTimer, SIGNAL(timeout()), SLOT(triggerAutoComplete()));
     connect(m_matchingTimer, SIGNAL(timeout()), SLOT(doMatchingPar()));
+    connect(m_evaluationService, &EvaluationService::finished,
+            this, &Editor::handleAutoCalcFinished);
+    connect(m_autoCalcTimer, SIGNAL(timeout()), SLOT(runAutoCalc()));
+    m_autoCalcTimer->setSingleShot(true);
     connect(this, &Editor::selectionChanged, this, &Editor::checkSelectionAutoCalc);
     connect(this, &Editor::textChanged, this, &Editor::checkAutoCalc);
     connect(this, &Editor::textChanged, this, &Editor::checkAutoComplete);
@@ -176,7 +206,7 @@ void Editor::setAutoCalcEnabled(bool enable)
 
 void Editor::checkAutoComplete()
 {
-    if (!m_isAutoCompletionEnabled)
+    if (!m_isAutoCompletionEnabled || m_isPasting)
         return;
 
     m_completionTimer->stop();
@@ -187,7 +217,7 @@ void Editor::checkAutoComplete()
 
 void Editor::checkMatching()
 {
-    if (!Settings::instance()->syntaxHighlighting)
+    if (!Settings::instance()->syntaxHighlighting || m_isPasting)
         return;
 
     m_matchingTimer->stop();
@@ -195,9 +225,35 @@ void Editor::checkMatching()
     m_matchingTimer->start();
 }
 
+// Sets off the auto-calc once the events that are already queued have been
+// handled, so that several requests in a row are answered only once. Each
+// request starts the wait again.
+static void scheduleAutoCalc(QTimer* timer, int cost)
+{
+    timer->start(cost < AutoCalcFrame ? 0 : qMin(cost, AutoCalcMaxDelay));
+}
+
 void Editor::checkAutoCalc()
 {
-    if (m_isAutoCalcEnabled)
+    if (!m_isAutoCalcEnabled || m_isPasting)
+        return;
+    m_isAutoCalcPending = true;
+    scheduleAutoCalc(m_autoCalcTimer, m_autoCalcCost);
+}
+
+void Editor::runAutoCalc()
+{
+    const bool selection = m_isSelectionAutoCalcPending && textCursor().hasSelection();
+    const bool expression = m_isAutoCalcPending;
+    m_isAutoCalcPending = false;
+    m_isSelectionAutoCalcPending = false;
+    if (!selection && !expression)
+        return;
+
+    // The cost is known once the result is in, see handleAutoCalcFinished().
+    if (selection)
+        autoCalcSelection();
+    else
         autoCalc();
 }
 
@@ -209,176 +265,113 @@ void Editor::doMatchingPar()
     if (!Settings::instance()->syntaxHighlighting)
         return;
 
+    updateParenthesisPairs();
     doMatchingLeft();
     doMatchingRight();
 }
 
 void Editor::checkSelectionAutoCalc()
 {
-    if (m_isAutoCalcEnabled)
-        autoCalcSelection();
+    if (!m_isAutoCalcEnabled || m_isPasting)
+        return;
+    m_isSelectionAutoCalcPending = true;
+    scheduleAutoCalc(m_autoCalcTimer, m_autoCalcCost);
 }
 
-void Editor::doMatchingLeft()
+// Pairs up the parentheses of the text, so that moving the cursor only
+// has to look up the characters next to it. The pairs are only found
+// again when the text has changed, from the tokens the highlighter scanned
+// it into already.
+void Editor::updateParenthesisPairs()
 {
-    // Tokenize the expression.
-    const int currentPosition = textCursor().position();
+    const QString expression = text();
+    if (expression == m_pairedText && m_parenthesisPairs.size() == expression.length())
+        return;
 
-    // Check for right par.
-    QString subtext = text().left(currentPosition);
-    Tokens tokens = m_evaluator->scan(subtext);
-    if (!tokens.valid() || tokens.count() < 1)
+    m_pairedText = expression;
+    m_parenthesisPairs.fill(-1, expression.length());
+    const Tokens tokens = m_evaluator->scan(expression);
+    if (!tokens.valid())
         return;
-    Token lastToken = tokens.at(tokens.count() - 1);
-
-    // Right par?
-    if (lastToken.type() == Token::stxClosePar
-        && (lastToken.pos() + lastToken.size()) == currentPosition) {
-        // Find the matching left par.
-        unsigned par = 1;
-        int matchPosition = -1;
-        int closeParPos = lastToken.pos() + lastToken.size() - 1;
-
-        for (int i = tokens.count() - 2; i >= 0 && par > 0; --i) {
-            Token matchToken = tokens.at(i);
-            switch (matchToken.type()) {
-                case Token::stxOpenPar : --par; break;
-                case Token::stxClosePar: ++par; break;
-                default:;
-            }
-            matchPosition = matchToken.pos() + matchToken.size() - 1;
-        }
 
-        if (par == 0) {
-            QTextEdit::ExtraSelection hilite1;
-            hilite1.cursor = textCursor();
-            hilite1.cursor.setPosition(matchPosition);
-            hilite1.cursor.setPosition(matchPosition + 1,
-                                       QTextCursor::KeepAnchor);
-            hilite1.format.setBackground(
-                m_highlighter->colorForRole(ColorScheme::Matched));
-
-            QTextEdit::ExtraSelection hilite2;
-            hilite2.cursor = textCursor();
-            hilite2.cursor.setPosition(closeParPos);
-            hilite2.cursor.setPosition(closeParPos + 1,
-                                       QTextCursor::KeepAnchor);
-            hilite2.format.setBackground(
-                m_highlighter->colorForRole(ColorScheme::Matched));
-
-            QList<QTextEdit::ExtraSelection> extras;
-            extras << hilite1;
-            extras << hilite2;
-            setExtraSelections(extras);
+    QVector<int> open;
+    for (int i = 0; i < tokens.count(); ++i) {
+        const Token& token = tokens.at(i);
+        const int position = token.pos() + token.size() - 1;
+        if (position < 0 || position >= expression.length())
+            continue;
+        if (token.type() == Token::stxOpenPar) {
+            open.append(position);
+        } else if (token.type() == Token::stxClosePar && !open.isEmpty()) {
+            const int partner = open.takeLast();
+            m_parenthesisPairs[partner] = position;
+            m_parenthesisPairs[position] = partner;
         }
     }
 }
 
-void Editor::doMatchingRight()
+void Editor::highlightParentheses(int first, int second)
 {
-    // Tokenize the expression.
-    const int currentPosition = textCursor().position();
+    QList<QTextEdit::ExtraSelection> extras;
+    for (int position : { first, second }) {
+        QTextEdit::ExtraSelection hilite;
+        hilite.cursor = textCursor();
+        hilite.cursor.setPosition(position);
+        hilite.cursor.setPosition(position + 1, QTextCursor::KeepAnchor);
+        hilite.format.setBackground(m_highlighter->colorForRole(ColorScheme::Matched));
+        extras << hilite;
+    }
+    setExtraSelections(extras);
+}
 
-    // Check for left par.
-    auto subtext = text().right(text().length() - currentPosition);
-    auto tokens = m_evaluator->scan(subtext);
-    if (!tokens.valid() || tokens.count() < 1)
+void Editor::doMatchingLeft()
+{
+    // Right par just before the cursor?
+    const int closeParPos = textCursor().position() - 1;
+    if (closeParPos < 0 || closeParPos >= m_parenthesisPairs.size())
         return;
-    auto firstToken = tokens.at(0);
-
-    // Left par?
-    if (firstToken.type() == Token::stxOpenPar
-        && (firstToken.pos() + firstToken.size()) == 1)
-    {
-        // Find the matching right par.
-        unsigned par = 1;
-        int k = 0;
-        Token matchToken;
-        int matchPosition = -1;
-        int openParPos = firstToken.pos() + firstToken.size() - 1;
-
-        for (k = 1; k < tokens.count() && par > 0; ++k) {
-            const Token matchToken = tokens.at(k);
-            switch (matchToken.type()) {
-            case Token::stxOpenPar:
-                ++par;
-                break;
-            case Token::stxClosePar:
-                --par;
-                break;
-            default:;
-            }
-            matchPosition = matchToken.pos() + matchToken.size() - 1;
-        }
+    const int matchPosition = m_parenthesisPairs.at(closeParPos);
+    if (matchPosition >= 0 && matchPosition < closeParPos)
+        highlightParentheses(matchPosition, closeParPos);
+}
 
-        if (par == 0) {
-            QTextEdit::ExtraSelection hilite1;
-            hilite1.cursor = textCursor();
-            hilite1.cursor.setPosition(currentPosition+matchPosition);
-            hilite1.cursor.setPosition(currentPosition+matchPosition + 1,
-                                       QTextCursor::KeepAnchor);
-            hilite1.format.setBackground(
-                m_highlighter->colorForRole(ColorScheme::Matched));
-
-            QTextEdit::ExtraSelection hilite2;
-            hilite2.cursor = textCursor();
-            hilite2.cursor.setPosition(currentPosition+openParPos);
-            hilite2.cursor.setPosition(currentPosition+openParPos + 1,
-                                       QTextCursor::KeepAnchor);
-            hilite2.format.setBackground(
-                m_highlighter->colorForRole(ColorScheme::Matched));
-
-            QList<QTextEdit::ExtraSelection> extras;
-            extras << hilite1;
-            extras << hilite2;
-            setExtraSelections(extras);
-        }
-    }
+void Editor::doMatchingRight()
+{
+    // Left par just after the cursor?
+    const int openParPos = textCursor().position();
+    if (openParPos >= m_parenthesisPairs.size())
+        return;
+    const int matchPosition = m_parenthesisPairs.at(openParPos);
+    if (matchPosition > openParPos)
+        highlightParentheses(matchPosition, openParPos);
 }
 
 
 // Matches a list of built-in functions and variables to a fragment of the name.
 QStringList Editor::matchFragment(const QString& id) const
 {
-    // Find matches in function names.
-    const auto fnames = FunctionRepo::instance()->getIdentifiers();
+    // Built-in functions come first, then variables, then user functions.
+    m_completionIndex.update(m_evaluator->session());
+    const auto matches = m_completionIndex.match(id);
     QStringList choices;
-    for (int i = 0; i < fnames.count(); ++i) {
-        if (fnames.at(i).startsWith(id, Qt::CaseInsensitive)) {
-            QString str = fnames.at(i);
-            Function* f = FunctionRepo::instance()->find(str);
-            if (f)
+    for (int i = 0; i < matches.count(); ++i) {
+        const auto& match = matches.at(i);
+        QString str = match.name;
+        switch (match.kind) {
+        case CompletionIndex::BuiltInFunction:
+            if (Function* f = FunctionRepo::instance()->find(str))
                 str.append(':').append(f->name());
-            choices.append(str);
+            break;
+        case CompletionIndex::SessionVariable:
+            str = QString("%1:%2").arg(match.name,
+                NumberFormatter::format(m_evaluator->getVariable(match.name).value()));
+            break;
+        case CompletionIndex::SessionFunction:
+            str = QString("%1:" + tr("User function")).arg(match.name);
+            break;
         }
+        choices.append(str);
     }
-    choices.sort();
-
-    // Find matches in variables names.
-    QStringList vchoices;
-    QList<Variable> variables = m_evaluator->getVariables();
-    for (int i = 0; i < variables.count(); ++i) {
-        if (variables.at(i).identifier().startsWith(id, Qt::CaseInsensitive)) {
-            vchoices.append(QString("%1:%2").arg(
-                variables.at(i).identifier(),
-                NumberFormatter::format(variables.at(i).value())));
-        }
-    }
-    vchoices.sort();
-    choices += vchoices;
-
-    // Find matches in user functions.
-    QStringList ufchoices;
-    auto userFunctions = m_evaluator->getUserFunctions();
-    for (int i = 0; i < userFunctions.count(); ++i) {
-        if (userFunctions.at(i).name().startsWith(id, Qt::CaseInsensitive)) {
-            ufchoices.append(QString("%1:" + tr("User function")).arg(
-                userFunctions.at(i).name()));
-        }
-    }
-    ufchoices.sort();
-    choices += ufchoices;
-
     return choices;
 }
 
@@ -527,18 +520,45 @@ void Editor::autoComplete(const QString& item)
     checkAutoCalc();
 }
 
+// Pastes a line as an edit of the expression, and several lines as a batch
+// of expressions to evaluate. The text is inserted with the highlighting,
+// the parentheses matching, the auto-completion and the auto-calc held off,
+// so that a long paste is not scanned over and over as it goes in. The
+// line pasted is then highlighted and matched once, and its auto-calc is
+// scheduled as for any other edit. No completion is offered
+// for pasted text.
 void Editor::insertFromMimeData(const QMimeData* source)
 {
     QStringList expressions =
         source->text().split("\n", Qt::SkipEmptyParts, Qt::CaseSensitive);
+    for (int i = 0; i < expressions.size(); ++i) {
+        if (expressions.at(i).endsWith('\r'))
+            expressions[i].chop(1);
+    }
+    expressions.removeAll(QString());
+    if (expressions.isEmpty())
+        return;
+
+    m_completionTimer->stop();
+    m_matchingTimer->stop();
+    m_isPasting = true;
+    m_highlighter->suspend();
     if (expressions.size() == 1) {
         // Insert text manually to make sure expression does not contain new line characters
         insert(expressions.at(0));
-        return;
+    } else {
+        for (int i = 0; i < expressions.size(); ++i) {
+            insert(expressions.at(i));
+            evaluate();
+        }
     }
-    for (int i = 0; i < expressions.size(); ++i) {
-        insert(expressions.at(i));
-        evaluate();
+    m_isPasting = false;
+    m_highlighter->resume();
+
+    // Evaluating a batch leaves nothing to look at.
+    if (expressions.size() == 1) {
+        checkMatching();
+        checkAutoCalc();
     }
 }
 
@@ -546,27 +566,54 @@ void Editor::autoCalc()
 {
     if (!m_isAutoCalcEnabled)
         return;
+    PipelineTrace::Span span("Editor::autoCalc");
 
     const auto str = m_evaluator->autoFix(text());
     if (str.isEmpty())
         return;
 
-    // Same reason as above, do not update "ans".
-    m_evaluator->setExpression(str);
-    auto quantity = m_evaluator->evalNoAssign();
+    // Same reason as above, do not update "ans". A preview is answered in
+    // doubles when possible, the full precision is kept for evaluate().
+    // A heavy expression is cut short and left to evaluate(). Otherwise a
+    // rough result is shown first, and the refined one when it comes.
+    m_isSelectionAutoCalc = false;
+    m_roughResult.clear();
+    m_autoCalcClock.start();
+    m_autoCalcJob = m_evaluationService->preview(str, *m_evaluator->session(),
+                                                 AutoCalcRoughPrecision,
+                                                 AutoCalcTimeout);
+}
 
-    if (m_evaluator->error().isEmpty()) {
-        if (quantity.isNan() && m_evaluator->isUserFunctionAssign()) {
-            // Result is not always available when assigning a user function.
+void Editor::handleAutoCalcFinished(const EvaluationService::Result& result)
+{
+    // Only the last request is answered, the others were cancelled by it.
+    if (result.id != m_autoCalcJob || !m_isAutoCalcEnabled)
+        return;
+    if (m_roughResult.isNull())
+        m_autoCalcCost = int(m_autoCalcClock.elapsed());
+
+    const Quantity& quantity = result.value;
+    const bool refined = !m_roughResult.isNull();
+    if (!result.error.isEmpty()) {
+        emit autoCalcMessageAvailable(result.error);
+    } else if (quantity.isNan() && result.userFunctionAssign) {
+        // Result is not always available when assigning a user function.
+        if (m_isSelectionAutoCalc)
+            emit autoCalcMessageAvailable(tr("Selection result: n/a"));
+        else
             emit autoCalcDisabled();
-        } else {
-            auto formatted = NumberFormatter::format(quantity);
-            auto message = tr("Current result: <b>%1</b>").arg(formatted);
+    } else {
+        auto formatted = NumberFormatter::format(quantity);
+        if (!refined || formatted != m_roughResult) {
+            auto message = m_isSelectionAutoCalc ?
+                tr("Selection result: <b>%1</b>").arg(formatted)
+                : tr("Current result: <b>%1</b>").arg(formatted);
             emit autoCalcMessageAvailable(message);
-            emit autoCalcQuantityAvailable(quantity);
         }
-    } else
-        emit autoCalcMessageAvailable(m_evaluator->error());
+        emit autoCalcQuantityAvailable(quantity);
+        if (result.rough)
+            m_roughResult = formatted;
+    }
 }
 
 void Editor::increaseFontPointSize()
@@ -601,22 +648,11 @@ void Editor::autoCalcSelection(const QString& custom)
         return;
 
     // Same reason as above, do not update "ans".
-    m_evaluator->setExpression(str);
-    auto quantity = m_evaluator->evalNoAssign();
-
-    if (m_evaluator->error().isEmpty()) {
-        if (quantity.isNan() && m_evaluator->isUserFunctionAssign()) {
-            // Result is not always available when assigning a user function.
-            auto message = tr("Selection result: n/a");
-            emit autoCalcMessageAvailable(message);
-        } else {
-            auto formatted = NumberFormatter::format(quantity);
-            auto message = tr("Selection result: <b>%1</b>").arg(formatted);
-            emit autoCalcMessageAvailable(message);
-            emit autoCalcQuantityAvailable(quantity);
-        }
-    } else
-        emit autoCalcMessageAvailable(m_evaluator->error());
+    m_isSelectionAutoCalc = true;
+    m_roughResult.clear();
+    m_autoCalcClock.start();
+    m_autoCalcJob = m_evaluationService->preview(str, *m_evaluator->session(),
+                                                 0, AutoCalcTimeout);
 }
 
 void Editor::insertConstant(const QString& constant)
@@ -870,6 +906,21 @@ void Editor::rehighlight()
     setStyleSheet(QString("QPlainTextEdit { background: %1; }").arg(colorName));
 }
 
+void Editor::relayout()
+{
+    m_highlighter->relayout();
+}
+
+qint64 Editor::cacheBytes() const
+{
+    return m_highlighter->cacheBytes();
+}
+
+void Editor::trimCaches()
+{
+    m_highlighter->trimCaches();
+}
+
 void Editor::updateHistory()
 {
     m_history = Evaluator::instance()->session()->historyToList();
@@ -878,6 +929,11 @@ void Editor::updateHistory()
 
 void Editor::stopAutoCalc()
 {
+    m_autoCalcTimer->stop();
+    m_evaluationService->cancelPreviews();
+    m_autoCalcJob = 0;
+    m_isAutoCalcPending = false;
+    m_isSelectionAutoCalcPending = false;
     emit autoCalcDisabled();
 }
 
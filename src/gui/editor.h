@@ -20,9 +20,13 @@
 #ifndef GUI_EDITOR_H
 #define GUI_EDITOR_H
 
+#include "core/completionindex.h"
+#include "core/evaluationservice.h"
 #include "core/sessionhistory.h"
 
+#include <QElapsedTimer>
 #include <QPlainTextEdit>
+#include <QVector>
 
 struct Constant;
 class ConstantCompletion;
@@ -48,6 +52,8 @@ public:
 
     bool isAutoCalcEnabled() const;
     bool isAutoCompletionEnabled() const;
+    qint64 cacheBytes() const;
+    void trimCaches();
     void clearHistory();
     int cursorPosition() const;
     void doBackspace();
@@ -87,6 +93,7 @@ public slots:
     void insert(const QString&);
     void insertConstant(const QString&);
     void rehighlight();
+    void relayout();
     void updateHistory();
     void refreshAutoCalc();
 
@@ -101,8 +108,10 @@ protected slots:
     void doMatchingLeft();
     void doMatchingPar();
     void doMatchingRight();
+    void handleAutoCalcFinished(const EvaluationService::Result&);
     void historyBack();
     void historyForward();
+    void runAutoCalc();
     void triggerAutoComplete();
     void triggerEnter();
 
@@ -118,10 +127,28 @@ protected:
 private:
     Q_DISABLE_COPY(Editor)
 
+    void highlightParentheses(int first, int second);
+    void updateParenthesisPairs();
+
     bool m_isAutoCalcEnabled;
+    // Requests made since the last auto-calc, run together by runAutoCalc().
+    bool m_isAutoCalcPending;
+    bool m_isSelectionAutoCalcPending;
+    // Set while pasting, see insertFromMimeData().
+    bool m_isPasting;
+    QTimer* m_autoCalcTimer;
+    // How long the last auto-calc took, in milliseconds.
+    int m_autoCalcCost;
+    QElapsedTimer m_autoCalcClock;
+    // The preview whose results are shown, 0 if none.
+    int m_autoCalcJob;
+    bool m_isSelectionAutoCalc;
+    EvaluationService* m_evaluationService;
     bool m_shouldBlockAutoCompletionOnce = false;
     bool m_isAutoCompletionEnabled;
     EditorCompletion* m_completion;
+    // Brought up to date by matchFragment().
+    mutable CompletionIndex m_completionIndex;
     QTimer* m_completionTimer;
     ConstantCompletion* m_constantCompletion;
     Evaluator* m_evaluator;
@@ -130,6 +157,12 @@ private:
     QString m_savedCurrentEditor;
     int m_currentHistoryIndex;
     QTimer* m_matchingTimer;
+    // For each character of m_pairedText, the position of the parenthesis
+    // it pairs with, -1 if it isn't one, see updateParenthesisPairs().
+    QString m_pairedText;
+    QVector<int> m_parenthesisPairs;
+    // The rough result of the running preview, null until it is in.
+    QString m_roughResult;
     bool m_shouldPaintCustomCursor;
     const Session * m_session;
 };
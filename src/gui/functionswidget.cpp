@@ -38,6 +38,7 @@ FunctionsWidget::FunctionsWidget(QWidget* parent)
     , m_noMatchLabel(new QLabel(m_functions))
     , m_searchFilter(new QLineEdit(this))
     , m_searchLabel(new QLabel(this))
+    , m_filter(m_functions, 2)
 {
 
     m_filterTimer->setInterval(500);
@@ -76,11 +77,9 @@ FunctionsWidget::FunctionsWidget(QWidget* parent)
 
     retranslateText();
 
-    connect(m_filterTimer, SIGNAL(timeout()), SLOT(updateList()));
+    connect(m_filterTimer, SIGNAL(timeout()), SLOT(applyFilter()));
     connect(m_functions, SIGNAL(itemActivated(QTreeWidgetItem*, int)), SLOT(handleItemActivated(QTreeWidgetItem*, int)));
     connect(m_searchFilter, SIGNAL(textChanged(const QString &)), SLOT(triggerFilter()));
-
-    updateList();
 }
 
 FunctionsWidget::~FunctionsWidget()
@@ -88,16 +87,17 @@ FunctionsWidget::~FunctionsWidget()
     m_filterTimer->stop();
 }
 
+// Items are made for all the functions, the search filter hides those that
+// don't match.
 void FunctionsWidget::updateList()
 {
     setUpdatesEnabled(false);
 
     m_filterTimer->stop();
     m_functions->clear();
-    QString term = m_searchFilter->text();
+
     QStringList functionNames = FunctionRepo::instance()->getIdentifiers();
     FunctionRepo::instance()->retranslateText();
-
     for (int k = 0; k < functionNames.count(); ++k) {
         Function* f = FunctionRepo::instance()->find(functionNames.at(k));
         if (!f)
@@ -106,34 +106,43 @@ void FunctionsWidget::updateList()
         QStringList str;
         str << f->identifier() << f->name();
 
-        if (term.isEmpty()
-            || str.at(0).contains(term, Qt::CaseInsensitive)
-            || str.at(1).contains(term, Qt::CaseInsensitive))
-        {
-            QTreeWidgetItem* item = new QTreeWidgetItem(m_functions, str);
-            if (layoutDirection() == Qt::LeftToRight) {
-                item->setTextAlignment(0, Qt::AlignLeft);
-                item->setTextAlignment(1, Qt::AlignLeft);
-            } else {
-                item->setTextAlignment(0, Qt::AlignRight);
-                item->setTextAlignment(1, Qt::AlignLeft);
-            }
+        QTreeWidgetItem* item = new QTreeWidgetItem(m_functions, str);
+        if (layoutDirection() == Qt::LeftToRight) {
+            item->setTextAlignment(0, Qt::AlignLeft);
+            item->setTextAlignment(1, Qt::AlignLeft);
+        } else {
+            item->setTextAlignment(0, Qt::AlignRight);
+            item->setTextAlignment(1, Qt::AlignLeft);
         }
+        m_filter.add(item);
     }
+    m_functions->sortItems(0, Qt::AscendingOrder);
+
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
 
+void FunctionsWidget::applyFilter()
+{
+    m_filterTimer->stop();
+    setUpdatesEnabled(false);
+    m_filter.apply(m_searchFilter->text());
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
+void FunctionsWidget::finishUpdate()
+{
     m_functions->resizeColumnToContents(0);
     m_functions->resizeColumnToContents(1);
 
-    if (m_functions->topLevelItemCount() > 0) {
+    if (m_filter.hasShownItems()) {
         m_noMatchLabel->hide();
-        m_functions->sortItems(0, Qt::AscendingOrder);
     } else {
         m_noMatchLabel->setGeometry(m_functions->geometry());
         m_noMatchLabel->show();
         m_noMatchLabel->raise();
     }
-
-    setUpdatesEnabled(true);
 }
 
 void FunctionsWidget::retranslateText()
@@ -147,7 +156,9 @@ void FunctionsWidget::retranslateText()
     m_searchLabel->setText(tr("Search"));
     m_noMatchLabel->setText(tr("No match found"));
 
-    updateList();
+    // Filled from the event loop, so that a dock opened with the window
+    // doesn't hold the window back.
+    QTimer::singleShot(0, this, SLOT(updateList()));
 }
 
 QList<QTreeWidgetItem*> FunctionsWidget::selectedItems() const
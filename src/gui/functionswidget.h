@@ -20,6 +20,8 @@
 #ifndef GUI_FUNCTIONSWIDGET_H
 #define GUI_FUNCTIONSWIDGET_H
 
+#include "gui/treefilter.h"
+
 #include <QList>
 #include <QWidget>
 
@@ -48,17 +50,21 @@ protected slots:
     void clearSelection(QTreeWidgetItem*);
     void updateList();
     void retranslateText();
+    void applyFilter();
     void triggerFilter();
 
 private:
     Q_DISABLE_COPY(FunctionsWidget)
 
+    void finishUpdate();
+
     QTimer* m_filterTimer;
     QTreeWidget* m_functions;
     bool m_insertAllItems;
     QLabel* m_noMatchLabel;
     QLineEdit* m_searchFilter;
     QLabel* m_searchLabel;
+    TreeFilter m_filter;
 };
 
 #endif // GUI_FUNCTIONSWIDGET_H
@@ -0,0 +1,123 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#include "gui/historyexporter.h"
+
+#include "core/numberformatter.h"
+#include "core/sessionhistory.h"
+#include "gui/syntaxhighlighter.h"
+#include "math/units.h"
+
+#include <QIODevice>
+
+// Quotes a CSV field when it has to be.
+static QString csvField(const QString& text)
+{
+    if (!text.contains(QLatin1Char(',')) && !text.contains(QLatin1Char('"'))
+        && !text.contains(QLatin1Char('\n')))
+    {
+        return text;
+    }
+    QString quoted = text;
+    quoted.replace(QLatin1Char('"'), QLatin1String("\"\""));
+    return QLatin1Char('"') + quoted + QLatin1Char('"');
+}
+
+// Splits a formatted result into its number and the unit that
+// DMath::format() appended to it.
+static void splitUnit(const Quantity& value, const QString& formatted,
+                      QString* number, QString* unit)
+{
+    Quantity q = value;
+    if (!q.hasUnit() && !q.isDimensionless()) {
+        q.cleanDimension();
+        Units::findUnit(q);
+    }
+    *unit = q.unitName();
+    *number = formatted;
+    if (unit->isEmpty() || !formatted.endsWith(QLatin1Char(' ') + *unit))
+        return;
+    *number = formatted.left(formatted.length() - unit->length() - 1);
+    if (number->startsWith(QLatin1Char('(')) && number->endsWith(QLatin1Char(')')))
+        *number = number->mid(1, number->length() - 2);
+}
+
+HistoryExporter::HistoryExporter(QIODevice* device, Format format,
+                                 SyntaxHighlighter* highlighter)
+    : m_stream(device)
+    , m_format(format)
+    , m_highlighter(highlighter)
+{
+    m_stream.setCodec("UTF-8");
+}
+
+void HistoryExporter::begin()
+{
+    switch (m_format) {
+    case Html: {
+        const QString background = m_highlighter->colorForRole(ColorScheme::Background).name();
+        m_stream << "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n"
+                 << "<style> body {background-color: " << background << ";}</style>\n"
+                 << "</head>\n<body>\n<pre>";
+        break;
+    }
+    case Csv:
+        m_stream << "expression,result,unit\n";
+        break;
+    case PlainText:
+        break;
+    }
+}
+
+void HistoryExporter::write(const HistoryEntry& entry)
+{
+    const Quantity value = entry.result();
+    const QString result = value.isNan() ? QString() : NumberFormatter::format(value);
+
+    switch (m_format) {
+    case PlainText:
+        m_stream << entry.expr() << '\n';
+        if (!value.isNan())
+            m_stream << "= " << result << '\n';
+        m_stream << '\n';
+        break;
+
+    case Html:
+        m_stream << m_highlighter->lineToHtml(entry.expr()) << '\n';
+        if (!value.isNan())
+            m_stream << m_highlighter->lineToHtml(QLatin1String("= ") + result) << '\n';
+        m_stream << '\n';
+        break;
+
+    case Csv: {
+        QString number, unit;
+        if (!value.isNan())
+            splitUnit(value, result, &number, &unit);
+        m_stream << csvField(entry.expr()) << ',' << csvField(number) << ','
+                 << csvField(unit) << '\n';
+        break;
+    }
+    }
+}
+
+bool HistoryExporter::end()
+{
+    if (m_format == Html)
+        m_stream << "</pre>\n</body>\n</html>\n";
+    m_stream.flush();
+    return m_stream.status() == QTextStream::Ok;
+}
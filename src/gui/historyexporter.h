@@ -0,0 +1,49 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+#ifndef GUI_HISTORYEXPORTER_H
+#define GUI_HISTORYEXPORTER_H
+
+#include <QTextStream>
+
+class HistoryEntry;
+class QIODevice;
+class SyntaxHighlighter;
+
+// Writes history entries to a device one at a time, so that exporting a
+// long session never holds the whole document in memory.
+class HistoryExporter {
+public:
+    enum Format { PlainText, Html, Csv };
+
+    // The highlighter gives the colors of the HTML export.
+    HistoryExporter(QIODevice* device, Format format, SyntaxHighlighter* highlighter);
+
+    void begin();
+    void write(const HistoryEntry& entry);
+    // Returns false if the device could not be written to.
+    bool end();
+
+private:
+    Q_DISABLE_COPY(HistoryExporter)
+
+    QTextStream m_stream;
+    Format m_format;
+    SyntaxHighlighter* m_highlighter;
+};
+
+#endif // GUI_HISTORYEXPORTER_H
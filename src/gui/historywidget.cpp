@@ -22,15 +22,68 @@
 #include "core/evaluator.h"
 #include "core/session.h"
 
+#include <QAbstractListModel>
 #include <QEvent>
-#include <QListWidget>
+#include <QListView>
 #include <QVBoxLayout>
 
+// The expressions of the session history. Rows are read from the session as
+// the view shows them, and entries added at the end of the history are
+// inserted as rows rather than starting over.
+class HistoryModel : public QAbstractListModel
+{
+public:
+    explicit HistoryModel(QObject *parent)
+        : QAbstractListModel(parent), m_count(0), m_revision(0) {}
+
+    int rowCount(const QModelIndex &parent) const
+    {
+        return parent.isValid() ? 0 : m_count;
+    }
+
+    QVariant data(const QModelIndex &index, int role) const
+    {
+        const Session *session = Evaluator::instance()->session();
+        if (role != Qt::DisplayRole || !index.isValid() || !session
+            || index.row() >= session->historyCount())
+            return QVariant();
+        return session->historyEntryAt(index.row()).expr();
+    }
+
+    // Returns true if rows were added or the model was reset.
+    bool update()
+    {
+        const Session *session = Evaluator::instance()->session();
+        const int count = session ? session->historyCount() : 0;
+        const unsigned revision = session ? session->historyRevision() : 0;
+        if (revision == m_revision && count == m_count)
+            return false;
+        if (revision == m_revision && count > m_count) {
+            beginInsertRows(QModelIndex(), m_count, count - 1);
+            m_count = count;
+            endInsertRows();
+        } else {
+            beginResetModel();
+            m_count = count;
+            m_revision = revision;
+            endResetModel();
+        }
+        return true;
+    }
+
+private:
+    int m_count;
+    unsigned m_revision;
+};
 
 HistoryWidget::HistoryWidget(QWidget *parent)
     : QWidget(parent)
-    , m_list(new QListWidget(this))
+    , m_model(new HistoryModel(this))
+    , m_list(new QListView(this))
 {
+    m_list->setModel(m_model);
+    m_list->setUniformItemSizes(true);
+    m_list->setEditTriggers(QAbstractItemView::NoEditTriggers);
     m_list->setAlternatingRowColors(true);
     m_list->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
     m_list->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
@@ -41,29 +94,23 @@ HistoryWidget::HistoryWidget(QWidget *parent)
     layout->addWidget(m_list);
     setLayout(layout);
 
-    connect(m_list, SIGNAL(itemActivated(QListWidgetItem *)), SLOT(handleItem(QListWidgetItem *)));
+    connect(m_list, SIGNAL(activated(const QModelIndex &)), SLOT(handleItem(const QModelIndex &)));
 
     updateHistory();
 }
 
 void HistoryWidget::updateHistory()
 {
-    QList<HistoryEntry> hist = Evaluator::instance()->session()->historyToList();
-    m_list->clear();
+    if (!m_model->update())
+        return;
     m_list->clearSelection();
-    QStringList l;
-
-    for(int i=0; i<hist.size(); ++i)
-        l.append(hist[i].expr());
-
-    m_list->addItems(l);
     m_list->scrollToBottom();
 }
 
-void HistoryWidget::handleItem(QListWidgetItem *item)
+void HistoryWidget::handleItem(const QModelIndex &index)
 {
     m_list->clearSelection();
-    emit expressionSelected(item->text());
+    emit expressionSelected(index.data().toString());
 }
 
 void HistoryWidget::changeEvent(QEvent *e)
@@ -73,4 +120,3 @@ void HistoryWidget::changeEvent(QEvent *e)
     else
         QWidget::changeEvent(e);
 }
-
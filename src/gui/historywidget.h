@@ -22,9 +22,9 @@
 
 #include <QWidget>
 
-class QListWidget;
-class QListWidgetItem;
-class HistoryEntry;
+class QListView;
+class QModelIndex;
+class HistoryModel;
 
 class HistoryWidget : public QWidget
 {
@@ -40,7 +40,7 @@ signals:
     void expressionSelected(const QString &);
 
 protected slots:
-    void handleItem(QListWidgetItem *);
+    void handleItem(const QModelIndex &);
 
 protected:
     void changeEvent(QEvent *);
@@ -48,7 +48,8 @@ protected:
 private:
     Q_DISABLE_COPY(HistoryWidget)
 
-    QListWidget *m_list;
+    HistoryModel *m_model;
+    QListView *m_list;
 };
 
 #endif
@@ -22,13 +22,18 @@
 #include "gui/mainwindow.h"
 
 #include "core/constants.h"
+#include "core/dataimport.h"
 #include "core/evaluator.h"
 #include "core/functions.h"
+#include "core/memoryusage.h"
 #include "core/numberformatter.h"
+#include "core/pipelinetrace.h"
 #include "core/settings.h"
 #include "core/session.h"
 #include "core/variable.h"
 #include "core/sessionhistory.h"
+#include "core/sessionwriter.h"
+#include "core/startuptrace.h"
 #include "core/userfunction.h"
 #include "gui/aboutbox.h"
 #include "gui/bitfieldwidget.h"
@@ -40,6 +45,7 @@
 #include "gui/userfunctionlistwidget.h"
 #include "gui/variablelistwidget.h"
 #include "gui/editor.h"
+#include "gui/historyexporter.h"
 #include "gui/historywidget.h"
 #include "gui/manualwindow.h"
 #include "core/manualserver.h"
@@ -67,12 +73,17 @@
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QPushButton>
+#include <QRegularExpression>
 #include <QScrollBar>
 #include <QStatusBar>
 #include <QToolTip>
 #include <QVBoxLayout>
+#include <QDataStream>
+#include <QFileInfo>
 #include <QJsonDocument>
+#include <QUuid>
 
 #ifdef Q_OS_WIN32
 #include "windows.h"
@@ -95,6 +106,7 @@ QTranslator* MainWindow::createTranslator(const QString& langCode)
 
 void MainWindow::createUi()
 {
+    StartupTrace::Phase phase("user interface");
     createActions();
     createActionGroups();
     createActionShortcuts();
@@ -110,9 +122,11 @@ void MainWindow::createUi()
 
 void MainWindow::createActions()
 {
+    m_actions.sessionExportCsv = new QAction(this);
     m_actions.sessionExportHtml = new QAction(this);
     m_actions.sessionExportPlainText = new QAction(this);
     m_actions.sessionImport = new QAction(this);
+    m_actions.sessionImportData = new QAction(this);
     m_actions.sessionLoad = new QAction(this);
     m_actions.sessionQuit = new QAction(this);
     m_actions.sessionSave = new QAction(this);
@@ -139,6 +153,7 @@ void MainWindow::createActions()
     m_actions.settingsAngleUnitCycle = new QAction(this);
     m_actions.settingsBehaviorAlwaysOnTop = new QAction(this);
     m_actions.settingsBehaviorAutoAns = new QAction(this);
+    m_actions.settingsBehaviorAutoRecalculation = new QAction(this);
     m_actions.settingsBehaviorAutoCompletion = new QAction(this);
     m_actions.settingsBehaviorLeaveLastExpression = new QAction(this);
     m_actions.settingsBehaviorPartialResults = new QAction(this);
@@ -173,6 +188,7 @@ void MainWindow::createActions()
     m_actions.settingsResultFormatScientific = new QAction(this);
     m_actions.settingsResultFormatCartesian= new QAction(this);
     m_actions.settingsResultFormatPolar = new QAction(this);
+    m_actions.settingsResultFormatShortenLongResults = new QAction(this);
     m_actions.settingsResultFormatSexagesimal = new QAction(this);
     m_actions.helpManual = new QAction(this);
     m_actions.helpUpdates = new QAction(this);
@@ -180,6 +196,9 @@ void MainWindow::createActions()
     m_actions.helpCommunity = new QAction(this);
     m_actions.helpNews = new QAction(this);
     m_actions.helpDonate = new QAction(this);
+    m_actions.helpMemoryUsage = new QAction(this);
+    m_actions.helpTrace = new QAction(this);
+    m_actions.helpSaveTrace = new QAction(this);
     m_actions.helpAbout = new QAction(this);
     m_actions.contextHelp = new QAction(this);
 
@@ -188,6 +207,7 @@ void MainWindow::createActions()
     m_actions.settingsAngleUnitGradian->setCheckable(true);
     m_actions.settingsBehaviorAlwaysOnTop->setCheckable(true);
     m_actions.settingsBehaviorAutoAns->setCheckable(true);
+    m_actions.settingsBehaviorAutoRecalculation->setCheckable(true);
     m_actions.settingsBehaviorAutoCompletion->setCheckable(true);
     m_actions.settingsBehaviorLeaveLastExpression->setCheckable(true);
     m_actions.settingsBehaviorPartialResults->setCheckable(true);
@@ -223,6 +243,7 @@ void MainWindow::createActions()
     m_actions.settingsResultFormatHexadecimal->setCheckable(true);
     m_actions.settingsResultFormatOctal->setCheckable(true);
     m_actions.settingsResultFormatPolar->setCheckable(true);
+    m_actions.settingsResultFormatShortenLongResults->setCheckable(true);
     m_actions.settingsResultFormatScientific->setCheckable(true);
     m_actions.settingsResultFormatSexagesimal->setCheckable(true);
     m_actions.viewConstants->setCheckable(true);
@@ -235,6 +256,9 @@ void MainWindow::createActions()
     m_actions.viewVariables->setCheckable(true);
     m_actions.viewBitfield->setCheckable(true);
     m_actions.viewUserFunctions->setCheckable(true);
+    m_actions.helpTrace->setCheckable(true);
+    // SPEEDCRUNCH_TRACE may have turned tracing on already.
+    m_actions.helpTrace->setChecked(PipelineTrace::isEnabled());
 
     const auto schemes = ColorScheme::enumerate(); // TODO: use qAsConst().
     for (auto& colorScheme : schemes) {
@@ -249,7 +273,10 @@ void MainWindow::createActions()
 void MainWindow::retranslateText()
 {
     QTranslator* tr = 0;
-    tr = createTranslator(m_settings->language);
+    {
+        StartupTrace::Phase phase("translations");
+        tr = createTranslator(m_settings->language);
+    }
     if (tr) {
         if (m_translator) {
             qApp->removeTranslator(m_translator);
@@ -298,9 +325,11 @@ void MainWindow::setStatusBarText()
 
 void MainWindow::setActionsText()
 {
+    m_actions.sessionExportCsv->setText(MainWindow::tr("&CSV"));
     m_actions.sessionExportHtml->setText(MainWindow::tr("&HTML"));
     m_actions.sessionExportPlainText->setText(MainWindow::tr("Plain &text"));
     m_actions.sessionImport->setText(MainWindow::tr("&Import..."));
+    m_actions.sessionImportData->setText(MainWindow::tr("Import &Data..."));
     m_actions.sessionLoad->setText(MainWindow::tr("&Load..."));
     m_actions.sessionQuit->setText(MainWindow::tr("&Quit"));
     m_actions.sessionSave->setText(MainWindow::tr("&Save..."));
@@ -330,6 +359,7 @@ void MainWindow::setActionsText()
     m_actions.settingsAngleUnitCycle->setText(MainWindow::tr("&Cycle Unit"));
     m_actions.settingsBehaviorAlwaysOnTop->setText(MainWindow::tr("Always on &Top"));
     m_actions.settingsBehaviorAutoAns->setText(MainWindow::tr("Automatic Result &Reuse"));
+    m_actions.settingsBehaviorAutoRecalculation->setText(MainWindow::tr("Automatic Variable Re&calculation"));
     m_actions.settingsBehaviorAutoCompletion->setText(MainWindow::tr("Automatic &Completion"));
     m_actions.settingsBehaviorPartialResults->setText(MainWindow::tr("&Partial Results"));
     m_actions.settingsBehaviorSaveSessionOnExit->setText(MainWindow::tr("Save &History on Exit"));
@@ -363,6 +393,7 @@ void MainWindow::setActionsText()
     m_actions.settingsResultFormatSexagesimal->setText(MainWindow::tr("&Sexagesimal"));
     m_actions.settingsResultFormatCartesian->setText(MainWindow::tr("&Cartesian"));
     m_actions.settingsResultFormatPolar->setText(MainWindow::tr("&Polar"));
+    m_actions.settingsResultFormatShortenLongResults->setText(MainWindow::tr("&Shorten Long Results"));
     m_actions.settingsDisplayFont->setText(MainWindow::tr("&Font..."));
     m_actions.settingsLanguage->setText(MainWindow::tr("&Language..."));
 
@@ -373,6 +404,9 @@ void MainWindow::setActionsText()
     m_actions.helpCommunity->setText(MainWindow::tr("Join &Community"));
     m_actions.helpNews->setText(MainWindow::tr("&News Feed"));
     m_actions.helpDonate->setText(MainWindow::tr("&Donate"));
+    m_actions.helpMemoryUsage->setText(MainWindow::tr("Memory &Usage..."));
+    m_actions.helpTrace->setText(MainWindow::tr("Record Latency &Trace"));
+    m_actions.helpSaveTrace->setText(MainWindow::tr("Save Latency T&race..."));
     m_actions.helpAbout->setText(MainWindow::tr("About &SpeedCrunch"));
 }
 
@@ -468,9 +502,11 @@ void MainWindow::createMenus()
     m_menus.session->addAction(m_actions.sessionSave);
     m_menus.session->addSeparator();
     m_menus.session->addAction(m_actions.sessionImport);
+    m_menus.session->addAction(m_actions.sessionImportData);
     m_menus.sessionExport = m_menus.session->addMenu("");
     m_menus.sessionExport->addAction(m_actions.sessionExportPlainText);
     m_menus.sessionExport->addAction(m_actions.sessionExportHtml);
+    m_menus.sessionExport->addAction(m_actions.sessionExportCsv);
     m_menus.session->addSeparator();
     m_menus.session->addAction(m_actions.sessionQuit);
 
@@ -530,6 +566,9 @@ void MainWindow::createMenus()
     m_menus.complexFormat->addAction(m_actions.settingsResultFormatCartesian);
     m_menus.complexFormat->addAction(m_actions.settingsResultFormatPolar);
 
+    m_menus.resultFormat->addSeparator();
+    m_menus.resultFormat->addAction(m_actions.settingsResultFormatShortenLongResults);
+
     m_menus.inputFormat = m_menus.settings->addMenu("");
 
     m_menus.radixChar = m_menus.inputFormat->addMenu("");
@@ -552,6 +591,7 @@ void MainWindow::createMenus()
     m_menus.behavior->addSeparator();
     m_menus.behavior->addAction(m_actions.settingsBehaviorPartialResults);
     m_menus.behavior->addAction(m_actions.settingsBehaviorAutoAns);
+    m_menus.behavior->addAction(m_actions.settingsBehaviorAutoRecalculation);
     m_menus.behavior->addAction(m_actions.settingsBehaviorAutoCompletion);
     m_menus.behavior->addAction(m_actions.settingsBehaviorSyntaxHighlighting);
 
@@ -587,6 +627,9 @@ void MainWindow::createMenus()
     m_menus.help->addAction(m_actions.helpNews);
     m_menus.help->addAction(m_actions.helpDonate);
     m_menus.help->addSeparator();
+    m_menus.help->addAction(m_actions.helpMemoryUsage);
+    m_menus.help->addAction(m_actions.helpTrace);
+    m_menus.help->addAction(m_actions.helpSaveTrace);
     m_menus.help->addAction(m_actions.helpAbout);
 
     addActions(menuBar()->actions());
@@ -777,7 +820,7 @@ void MainWindow::createVariablesDock(bool takeFocus)
     connect(this, &MainWindow::radixCharacterChanged,
             m_docks.variables->widget(), &VariableListWidget::updateList);
     connect(this, &MainWindow::variablesChanged,
-            m_docks.variables->widget(), &VariableListWidget::updateList);
+            m_docks.variables->widget(), &VariableListWidget::applyChanges);
 
     addTabifiedDock(m_docks.variables, takeFocus);
     m_settings->variablesDockVisible = true;
@@ -797,7 +840,7 @@ void MainWindow::createUserFunctionsDock(bool takeFocus)
     connect(this, &MainWindow::radixCharacterChanged,
             m_docks.userFunctions->widget(), &UserFunctionListWidget::updateList);
     connect(this, &MainWindow::functionsChanged,
-            m_docks.userFunctions->widget(), &UserFunctionListWidget::updateList);
+            m_docks.userFunctions->widget(), &UserFunctionListWidget::applyChanges);
 
     addTabifiedDock(m_docks.userFunctions, takeFocus);
     m_settings->userFunctionsDockVisible = true;
@@ -830,9 +873,11 @@ void MainWindow::deleteDock(QDockWidget* dock)
 
 void MainWindow::createFixedConnections()
 {
+    connect(m_actions.sessionExportCsv, SIGNAL(triggered()), SLOT(exportCsv()));
     connect(m_actions.sessionExportHtml, SIGNAL(triggered()), SLOT(exportHtml()));
     connect(m_actions.sessionExportPlainText, SIGNAL(triggered()), SLOT(exportPlainText()));
     connect(m_actions.sessionImport, SIGNAL(triggered()), SLOT(showSessionImportDialog()));
+    connect(m_actions.sessionImportData, SIGNAL(triggered()), SLOT(showDataImportDialog()));
     connect(m_actions.sessionLoad, SIGNAL(triggered()), SLOT(showSessionLoadDialog()));
     connect(m_actions.sessionQuit, SIGNAL(triggered()), SLOT(close()));
     connect(m_actions.sessionSave, SIGNAL(triggered()), SLOT(saveSessionDialog()));
@@ -865,6 +910,7 @@ void MainWindow::createFixedConnections()
     connect(m_actions.settingsBehaviorAlwaysOnTop, SIGNAL(toggled(bool)), SLOT(setAlwaysOnTopEnabled(bool)));
     connect(m_actions.settingsBehaviorAutoCompletion, SIGNAL(toggled(bool)), SLOT(setAutoCompletionEnabled(bool)));
     connect(m_actions.settingsBehaviorAutoAns, SIGNAL(toggled(bool)), SLOT(setAutoAnsEnabled(bool)));
+    connect(m_actions.settingsBehaviorAutoRecalculation, SIGNAL(toggled(bool)), SLOT(setAutoRecalculationEnabled(bool)));
     connect(m_actions.settingsBehaviorPartialResults, SIGNAL(toggled(bool)), SLOT(setAutoCalcEnabled(bool)));
     connect(m_actions.settingsBehaviorSaveSessionOnExit, SIGNAL(toggled(bool)), SLOT(setSessionSaveEnabled(bool)));
     connect(m_actions.settingsBehaviorSaveWindowPositionOnExit, SIGNAL(toggled(bool)), SLOT(setWindowPositionSaveEnabled(bool)));
@@ -894,6 +940,7 @@ void MainWindow::createFixedConnections()
     connect(m_actions.settingsResultFormatHexadecimal, SIGNAL(triggered()), SLOT(setResultFormatHexadecimal()));
     connect(m_actions.settingsResultFormatOctal, SIGNAL(triggered()), SLOT(setResultFormatOctal()));
     connect(m_actions.settingsResultFormatPolar, SIGNAL(triggered()), SLOT(setResultFormatPolar()));
+    connect(m_actions.settingsResultFormatShortenLongResults, SIGNAL(toggled(bool)), SLOT(setShortenLongResultsEnabled(bool)));
     connect(m_actions.settingsResultFormatSexagesimal, SIGNAL(triggered()), SLOT(setResultFormatSexagesimal()));
     connect(m_actions.settingsResultFormatScientific, SIGNAL(triggered()), SLOT(setResultFormatScientific()));
 
@@ -906,6 +953,9 @@ void MainWindow::createFixedConnections()
     connect(m_actions.helpCommunity, SIGNAL(triggered()), SLOT(openCommunityURL()));
     connect(m_actions.helpNews, SIGNAL(triggered()), SLOT(openNewsURL()));
     connect(m_actions.helpDonate, SIGNAL(triggered()), SLOT(openDonateURL()));
+    connect(m_actions.helpMemoryUsage, SIGNAL(triggered()), SLOT(showMemoryUsage()));
+    connect(m_actions.helpTrace, SIGNAL(toggled(bool)), SLOT(setTraceEnabled(bool)));
+    connect(m_actions.helpSaveTrace, SIGNAL(triggered()), SLOT(saveTrace()));
     connect(m_actions.helpAbout, SIGNAL(triggered()), SLOT(showAboutDialog()));
 
     connect(m_widgets.editor, SIGNAL(autoCalcDisabled()), SLOT(hideStateLabel()));
@@ -936,20 +986,18 @@ void MainWindow::createFixedConnections()
     connect(m_widgets.display, SIGNAL(shiftControlWheelDown()), SLOT(decreaseOpacity()));
     connect(m_widgets.display, SIGNAL(shiftControlWheelUp()), SLOT(increaseOpacity()));
     connect(this, SIGNAL(historyChanged()), m_widgets.display, SLOT(refresh()));
-
-    connect(this, SIGNAL(radixCharacterChanged()), m_widgets.display, SLOT(refresh()));
-    connect(this, SIGNAL(radixCharacterChanged()), m_widgets.editor, SLOT(refreshAutoCalc()));
-    connect(this, SIGNAL(resultFormatChanged()), m_widgets.display, SLOT(refresh()));
-    connect(this, SIGNAL(resultFormatChanged()), m_widgets.editor, SLOT(refreshAutoCalc()));
-    connect(this, SIGNAL(resultPrecisionChanged()), m_widgets.display, SLOT(refresh()));
-    connect(this, SIGNAL(resultPrecisionChanged()), m_widgets.editor, SLOT(refreshAutoCalc()));
-    connect(this, SIGNAL(colorSchemeChanged()), m_widgets.display, SLOT(rehighlight()));
-    connect(this, SIGNAL(colorSchemeChanged()), m_widgets.editor, SLOT(rehighlight()));
+    connect(this, SIGNAL(historyChanged()), m_sessionSaveTimer, SLOT(start()));
+    connect(this, SIGNAL(variablesChanged()), m_sessionSaveTimer, SLOT(start()));
+    connect(this, SIGNAL(functionsChanged()), m_sessionSaveTimer, SLOT(start()));
+
+    connect(this, &MainWindow::radixCharacterChanged, [this]() { updateDisplay(ResultsChanged | LayoutChanged); });
+    connect(this, &MainWindow::resultFormatChanged, [this]() { updateDisplay(ResultsChanged); });
+    connect(this, &MainWindow::resultPrecisionChanged, [this]() { updateDisplay(ResultsChanged); });
+    connect(this, &MainWindow::colorSchemeChanged, [this]() { updateDisplay(ColorsChanged); });
     connect(m_actionGroups.colorScheme, &QActionGroup::hovered, this, &MainWindow::applyColorSchemeFromAction);
     connect(m_menus.colorScheme, &QMenu::aboutToHide, this, &MainWindow::revertColorScheme);
     connect(m_menus.colorScheme, &QMenu::aboutToShow, this, &MainWindow::saveColorSchemeToRevert);
-    connect(this, SIGNAL(syntaxHighlightingChanged()), m_widgets.display, SLOT(rehighlight()));
-    connect(this, SIGNAL(syntaxHighlightingChanged()), m_widgets.editor, SLOT(rehighlight()));
+    connect(this, &MainWindow::syntaxHighlightingChanged, [this]() { updateDisplay(LayoutChanged); });
 
     connect(m_actions.settingsDisplayFont, SIGNAL(triggered()), SLOT(showFontDialog()));
 
@@ -962,6 +1010,7 @@ void MainWindow::createFixedConnections()
 
 void MainWindow::applySettings()
 {
+    StartupTrace::Phase phase("settings and docks");
     emit languageChanged();
 
     setFormulaBookDockVisible(m_settings->formulaBookDockVisible, false);
@@ -1012,6 +1061,8 @@ void MainWindow::applySettings()
     }
 
     m_actions.settingsBehaviorLeaveLastExpression->setChecked(m_settings->leaveLastExpression);
+    m_actions.settingsBehaviorAutoRecalculation->setChecked(m_settings->autoRecalculation);
+    m_actions.settingsResultFormatShortenLongResults->setChecked(m_settings->shortenLongResults);
     m_actions.settingsBehaviorSaveWindowPositionOnExit->setChecked(m_settings->windowPositionSave);
 
 
@@ -1172,29 +1223,82 @@ void MainWindow::saveSettings()
     m_settings->save();
 }
 
-void MainWindow::saveSession(QString & fname)
+// The session saved on exit is kept as a snapshot, rewritten only now and
+// then, and a journal of the changes since, appended to as they happen.
+// The journal starts with the identifier of its snapshot, so that after a
+// crash between the writing of a new snapshot and the removal of the
+// journal, the changes it already includes are not replayed.
+// Files are written by m_sessionWriter, off the GUI thread, once the
+// session stayed unchanged for SessionSaveDelay.
+static const qint64 SessionJournalMinimumSize = 64 * 1024;
+static const int SessionSaveDelay = 1000;
+// How long no expression is evaluated before the caches are dropped.
+static const int IdleTrimDelay = 10 * 60 * 1000;
+
+static QString sessionFilePath(const char* name)
 {
-    QFile file(fname);
-    if (!file.open(QIODevice::WriteOnly)) {
-        return;
-    }
+    QString path = Settings::getDataPath();
+    QDir().mkpath(path);
+    return path + QLatin1Char('/') + QLatin1String(name);
+}
 
+static QByteArray sessionJournalHeader(const QString& id)
+{
+    QJsonObject header;
+    header["snapshot"] = id;
+    return QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n';
+}
 
-    QJsonObject json;
-    m_session->serialize(json);
-    QJsonDocument doc(json);
-    file.write(doc.toJson());
+// Writes a new snapshot of the session and starts its journal afresh.
+void MainWindow::compactSession()
+{
+    m_session->takeJournal();
+    m_sessionJournalId = QUuid::createUuid().toString();
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    m_session->serialize(stream);
+    stream << m_sessionJournalId;
 
-    file.close();
+    QStringList obsolete;
+    obsolete << sessionFilePath("history.journal") << sessionFilePath("history.json");
+    m_sessionWriter->writeSnapshot(sessionFilePath("history.dat"), data, obsolete);
+}
+
+// Appends the changes of the session since the last call to its journal.
+// Once the journal outgrows the snapshot, both are replaced by a new
+// snapshot, so that saving costs about as much as the new data.
+void MainWindow::saveSessionJournal()
+{
+    m_sessionSaveTimer->stop();
+    if (!m_session->isJournaling())
+        return;
+    const QByteArray records = m_session->takeJournal();
+    if (!m_settings->sessionSave || records.isEmpty())
+        return;
+
+    const QString journal = sessionFilePath("history.journal");
+    const qint64 snapshotSize = QFileInfo(sessionFilePath("history.dat")).size();
+    if (m_sessionJournalId.isEmpty()
+        || QFileInfo(journal).size() > qMax(snapshotSize, SessionJournalMinimumSize))
+    {
+        compactSession();
+        return;
+    }
+
+    m_sessionWriter->appendJournal(journal, sessionJournalHeader(m_sessionJournalId), records);
 }
 
 MainWindow::MainWindow()
     : QMainWindow()
 {
+    StartupTrace::Phase phase("main window");
 
     m_session = new Session();
     m_constants = Constants::instance();
-    m_evaluator = Evaluator::instance();
+    {
+        StartupTrace::Phase phase("evaluator");
+        m_evaluator = Evaluator::instance();
+    }
     m_functions = FunctionRepo::instance();
     m_evaluator->setSession(m_session);
     m_evaluator->initializeBuiltInVariables();
@@ -1220,6 +1324,19 @@ MainWindow::MainWindow()
 
     m_copyWidget = 0;
 
+    m_sessionWriter = new SessionWriter;
+    m_sessionSaveTimer = new QTimer(this);
+    m_sessionSaveTimer->setSingleShot(true);
+    m_sessionSaveTimer->setInterval(SessionSaveDelay);
+    connect(m_sessionSaveTimer, SIGNAL(timeout()), SLOT(saveSessionJournal()));
+    m_idleTrimTimer = new QTimer(this);
+    m_idleTrimTimer->setSingleShot(true);
+    m_idleTrimTimer->setInterval(IdleTrimDelay);
+    connect(m_idleTrimTimer, SIGNAL(timeout()), SLOT(trimMemory()));
+    m_evaluationService = new EvaluationService(this);
+    connect(m_evaluationService, &EvaluationService::finished,
+            this, &MainWindow::handleEvaluationFinished);
+
     createUi();
     applySettings();
 
@@ -1241,6 +1358,7 @@ MainWindow::~MainWindow()
         deleteFunctionsDock();
     if (m_docks.history)
         deleteHistoryDock();
+    delete m_sessionWriter;
     delete m_session;
 }
 
@@ -1251,6 +1369,50 @@ void MainWindow::showAboutDialog()
     dialog.exec();
 }
 
+void MainWindow::showMemoryUsage()
+{
+    MemoryUsage usage = MemoryUsage::measure(m_session, m_evaluator);
+    usage.add(QStringLiteral("result display"), m_widgets.display->cacheBytes());
+    usage.add(QStringLiteral("editor"), m_widgets.editor->cacheBytes());
+
+    QMessageBox box(this);
+    box.setWindowTitle(tr("Memory Usage"));
+    box.setText(tr("Memory taken by the session and the caches, roughly:"));
+    box.setInformativeText(usage.toText());
+    QPushButton* trim = box.addButton(tr("&Trim Caches"), QMessageBox::ActionRole);
+    box.addButton(QMessageBox::Close);
+    box.exec();
+    if (box.clickedButton() == trim)
+        trimMemory();
+}
+
+// The spans of the latest evaluations, see PipelineTrace.
+void MainWindow::setTraceEnabled(bool enabled)
+{
+    PipelineTrace::enable(enabled);
+}
+
+void MainWindow::saveTrace()
+{
+    QString fname = QFileDialog::getSaveFileName(this, tr("Save Latency Trace"),
+        documentsLocation(), tr("Chrome trace (*.json)"));
+
+    if (fname.isEmpty())
+        return;
+
+    if (!PipelineTrace::save(fname))
+        QMessageBox::critical(this, tr("Error"), tr("Can't write to file %1").arg(fname));
+}
+
+// The caches fill up again as expressions are evaluated and shown.
+void MainWindow::trimMemory()
+{
+    m_idleTrimTimer->stop();
+    MemoryUsage::trim(m_session, m_evaluator);
+    m_widgets.display->trimCaches();
+    m_widgets.editor->trimCaches();
+}
+
 void MainWindow::clearHistory()
 {
     m_session->clearHistory();
@@ -1297,6 +1459,7 @@ void MainWindow::increaseOpacity()
 void MainWindow::deleteVariables()
 {
     m_session->clearVariables();
+    saveSessionJournal();
 
     if (m_settings->variablesDockVisible)
         m_docks.variables->widget()->updateList();
@@ -1305,6 +1468,7 @@ void MainWindow::deleteVariables()
 void MainWindow::deleteUserFunctions()
 {
     m_session->clearUserFunctions();
+    saveSessionJournal();
 
     if (m_settings->userFunctionsDockVisible)
         m_docks.userFunctions->widget()->updateList();
@@ -1340,6 +1504,27 @@ void MainWindow::setResultPrecisionAutomatic()
     setResultPrecision(-1);
 }
 
+// Brings the display and the editor up to date with a settings change,
+// redoing only what depends on the settings changed: the formatted
+// results, the layout of the highlighted text, or only its colors. The
+// display formats and highlights the visible part first.
+void MainWindow::updateDisplay(int changes)
+{
+    if (changes & ResultsChanged) {
+        // A new page of results is highlighted as it is shown.
+        m_widgets.display->refresh();
+        m_widgets.editor->refreshAutoCalc();
+    }
+    if (changes & ColorsChanged) {
+        m_widgets.display->rehighlight();
+        m_widgets.editor->rehighlight();
+    } else if (changes & LayoutChanged) {
+        if (!(changes & ResultsChanged))
+            m_widgets.display->relayout();
+        m_widgets.editor->relayout();
+    }
+}
+
 void MainWindow::applySelectedColorScheme()
 {
     m_settings->colorScheme = m_actionGroups.colorScheme->checkedAction()->data().toString();
@@ -1407,6 +1592,9 @@ void MainWindow::showSessionLoadDialog()
     QByteArray data = file.readAll();
     QJsonDocument doc(QJsonDocument::fromJson(data));
     m_session->deSerialize(doc.object(), merge);
+    // Loading is not journaled.
+    if (m_settings->sessionSave && m_session->isJournaling())
+        compactSession();
 
     file.close();
     emit historyChanged();
@@ -1483,7 +1671,7 @@ void MainWindow::showSessionImportDialog()
         m_evaluator->setExpression(str);
 
         Quantity result = m_evaluator->evalUpdateAns();
-        if (!m_evaluator->error().isEmpty()) {
+        if (m_evaluator->hasError()) {
             if (!ignoreAll) {
                 QMessageBox::StandardButton button =
                     QMessageBox::warning(this, tr("Error"), tr("Ignore error?") + "\n" + m_evaluator->error(),
@@ -1517,6 +1705,62 @@ void MainWindow::showSessionImportDialog()
         activateWindow();
 }
 
+// Reads the columns of a file into lists, which are named after the
+// heading of the file where that makes a free identifier.
+void MainWindow::showDataImportDialog()
+{
+    const QStringList filters = QStringList()
+        << tr("Comma-separated values (*.csv)")
+        << tr("Tab-separated values (*.tsv *.txt)")
+        << tr("Binary doubles (*.bin *.dat)")
+        << tr("All Files (*)");
+    QString filter;
+    QString fname = QFileDialog::getOpenFileName(this, tr("Import Data"), QString(),
+                                                 filters.join(";;"), &filter);
+    if (fname.isEmpty())
+        return;
+
+    DataImport::Format format;
+    const QString suffix = QFileInfo(fname).suffix().toLower();
+    switch (filters.indexOf(filter)) {
+    case 0: format = DataImport::Csv; break;
+    case 1: format = DataImport::Tsv; break;
+    case 2: format = DataImport::Doubles; break;
+    default:
+        if (suffix == "tsv" || suffix == "txt")
+            format = DataImport::Tsv;
+        else if (suffix == "bin" || suffix == "dat")
+            format = DataImport::Doubles;
+        else
+            format = DataImport::Csv;
+        break;
+    }
+
+    QList<DataImport::Column> columns;
+    QString error;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool read = DataImport::read(fname, format, columns, error);
+    QApplication::restoreOverrideCursor();
+    if (!read) {
+        QMessageBox::critical(this, tr("Error"),
+                              tr("Can't import data from file %1").arg(fname) + "\n" + error);
+        return;
+    }
+
+    static const QRegularExpression identifierRE("^[A-Za-z_][A-Za-z0-9_]*$");
+    QStringList lists;
+    for (int i = 0; i < columns.count(); ++i) {
+        QString name = columns.at(i).name;
+        if (!identifierRE.match(name).hasMatch() || m_session->hasVariable(name)
+            || m_session->hasUserFunction(name) || FunctionRepo::instance()->find(name))
+            name = QString("data%1").arg(i + 1);
+        m_session->addList(name, columns.at(i).values);
+        lists.append(tr("%1 (%n values)", "", columns.at(i).values.count()).arg(name));
+    }
+    QMessageBox::information(this, tr("Import Data"),
+                             tr("Imported lists: %1").arg(lists.join(", ")));
+}
+
 void MainWindow::setAlwaysOnTopEnabled(bool b)
 {
     m_settings->windowAlwaysOnTop = b;
@@ -1535,6 +1779,11 @@ void MainWindow::setAutoAnsEnabled(bool b)
     m_settings->autoAns = b;
 }
 
+void MainWindow::setAutoRecalculationEnabled(bool b)
+{
+    m_settings->autoRecalculation = b;
+}
+
 void MainWindow::setAutoCalcEnabled(bool b)
 {
     m_settings->autoCalc = b;
@@ -1590,6 +1839,8 @@ void MainWindow::setAutoResultToClipboardEnabled(bool b)
 
 void MainWindow::setComplexNumbers(bool b)
 {
+    m_evaluationService->cancel();
+    m_widgets.editor->stopAutoCalc();
     m_settings->complexNumbers = b;
     emit radixCharacterChanged();   // FIXME ?
     m_evaluator->initializeBuiltInVariables();
@@ -1601,6 +1852,8 @@ void MainWindow::setAngleModeDegree()
     if (m_settings->angleUnit == 'd')
         return;
 
+    m_evaluationService->cancel();
+    m_widgets.editor->stopAutoCalc();
     m_settings->angleUnit = 'd';
 
     if (m_status.angleUnit)
@@ -1615,6 +1868,8 @@ void MainWindow::setAngleModeRadian()
     if (m_settings->angleUnit == 'r')
         return;
 
+    m_evaluationService->cancel();
+    m_widgets.editor->stopAutoCalc();
     m_settings->angleUnit = 'r';
 
     if (m_status.angleUnit)
@@ -1629,6 +1884,8 @@ void MainWindow::setAngleModeGradian()
     if (m_settings->angleUnit == 'g')
         return;
 
+    m_evaluationService->cancel();
+    m_widgets.editor->stopAutoCalc();
     m_settings->angleUnit = 'g';
 
     if (m_status.angleUnit)
@@ -1647,6 +1904,55 @@ inline static QString documentsLocation()
 #endif
 }
 
+// Writes the whole history, not only what the display shows, keeping the
+// window responsive with a progress dialog that can cancel the export.
+void MainWindow::exportHistory(int format, const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        QMessageBox::critical(this, tr("Error"), tr("Can't write to file %1").arg(fileName));
+        return;
+    }
+
+    const QList<HistoryEntry> history = m_session->historyToList();
+    QProgressDialog progress(tr("Exporting session..."), tr("Cancel"), 0, history.count(), this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    HistoryExporter exporter(&file, HistoryExporter::Format(format),
+                             m_widgets.display->highlighter());
+    exporter.begin();
+    for (int i = 0; i < history.count(); ++i) {
+        if (i % 100 == 0) {
+            progress.setValue(i);
+            if (progress.wasCanceled())
+                break;
+        }
+        exporter.write(history.at(i));
+    }
+
+    const bool written = exporter.end();
+    file.close();
+    if (progress.wasCanceled()) {
+        file.remove();
+        return;
+    }
+    progress.setValue(history.count());
+    if (!written)
+        QMessageBox::critical(this, tr("Error"), tr("Can't write to file %1").arg(fileName));
+}
+
+void MainWindow::exportCsv()
+{
+    QString fname = QFileDialog::getSaveFileName(this, tr("Export session as CSV"),
+        documentsLocation(), tr("CSV file (*.csv)"));
+
+    if (fname.isEmpty())
+        return;
+
+    exportHistory(HistoryExporter::Csv, fname);
+}
+
 void MainWindow::exportHtml()
 {
     QString fname = QFileDialog::getSaveFileName(this, tr("Export session as HTML"),
@@ -1655,17 +1961,7 @@ void MainWindow::exportHtml()
     if (fname.isEmpty())
         return;
 
-    QFile file(fname);
-    if (!file.open(QIODevice::WriteOnly)) {
-        QMessageBox::critical(this, tr("Error"), tr("Can't write to file %1").arg(fname));
-        return;
-    }
-
-    QTextStream stream(& file);
-    stream.setCodec("UTF-8");
-    stream << m_widgets.display->exportHtml();
-
-    file.close();
+    exportHistory(HistoryExporter::Html, fname);
 }
 
 void MainWindow::exportPlainText()
@@ -1676,20 +1972,7 @@ void MainWindow::exportPlainText()
     if (fname.isEmpty())
         return;
 
-    QFile file(fname);
-    if (!file.open(QIODevice::WriteOnly)) {
-        QMessageBox::critical(this, tr("Error"), tr("Can't write to file %1").arg(fname));
-        return;
-    }
-
-    QByteArray text;
-    QTextStream stream(&text, QIODevice::WriteOnly | QIODevice::Text);
-    stream.setCodec("UTF-8");
-    stream << m_widgets.display->document()->toPlainText();
-    stream.flush();
-
-    file.write(text);
-    file.close();
+    exportHistory(HistoryExporter::PlainText, fname);
 }
 
 void MainWindow::setWidgetsDirection()
@@ -2025,6 +2308,15 @@ void MainWindow::setResultFormatPolar()
     emit resultFormatChanged();
 }
 
+void MainWindow::setShortenLongResultsEnabled(bool b)
+{
+    if (m_settings->shortenLongResults == b)
+        return;
+
+    m_settings->shortenLongResults = b;
+    emit resultFormatChanged();
+}
+
 void MainWindow::setResultFormatScientific()
 {
     setResultFormat('e');
@@ -2157,18 +2449,38 @@ void MainWindow::copy()
 }
 
 void MainWindow::restoreSession() {
-    QString data_path = Settings::getDataPath();
-    QDir qdir;
-    qdir.mkpath(data_path);
-    data_path.append("/history.json");
-
-    QFile file(data_path);
-    if (!file.open(QIODevice::ReadOnly))
-        return;
+    StartupTrace::Phase phase("session restore");
+    QFile file(sessionFilePath("history.dat"));
+    QFile journal(sessionFilePath("history.journal"));
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        if (m_session->deSerialize(stream, true))
+            stream >> m_sessionJournalId;
+    } else {
+        // Sessions of older versions are kept as JSON.
+        file.setFileName(sessionFilePath("history.json"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            journal.remove();
+            m_session->setJournaling(true);
+            return;
+        }
+        QJsonDocument doc(QJsonDocument::fromJson(file.readAll()));
+        m_session->deSerialize(doc.object(), true);
+        m_sessionJournalId = doc.object()["journal"].toString();
+    }
 
-    QByteArray data = file.readAll();
-    QJsonDocument doc(QJsonDocument::fromJson(data));
-    m_session->deSerialize(doc.object(), true);
+    // A journal of another snapshot is left over from a crash, the changes
+    // in it are already in this one.
+    if (journal.open(QIODevice::ReadOnly)) {
+        const bool current = !m_sessionJournalId.isEmpty()
+            && journal.readLine() == sessionJournalHeader(m_sessionJournalId);
+        if (current)
+            m_session->replayJournal(journal.readAll());
+        journal.close();
+        if (!current)
+            journal.remove();
+    }
+    m_session->setJournaling(true);
 
     file.close();
     emit historyChanged();
@@ -2180,26 +2492,40 @@ void MainWindow::restoreSession() {
 
 void MainWindow::evaluateEditorExpression()
 {
+    PipelineTrace::Span span("MainWindow::evaluateEditorExpression");
     QString expr = m_evaluator->autoFix(m_widgets.editor->text());
 
     if (expr.isEmpty())
         return;
 
-    m_evaluator->setExpression(expr);
-    Quantity result = m_evaluator->evalUpdateAns();
+    // The next one has to see what this one assigns, so it waits for it.
+    if (m_evaluationService->isBusy(EvaluationService::Evaluation)) {
+        showStateLabel(tr("Still evaluating the previous expression"));
+        return;
+    }
+
+    // Previews started before no longer matter.
+    m_widgets.editor->stopAutoCalc();
+    m_evaluationService->evaluate(expr, *m_session);
+}
 
-    if (!m_evaluator->error().isEmpty()) {
-        showStateLabel(m_evaluator->error());
+// Picks up evaluateEditorExpression() once the worker is done.
+void MainWindow::handleEvaluationFinished(const EvaluationService::Result& evaluation)
+{
+    if (!evaluation.error.isEmpty()) {
+        showStateLabel(evaluation.error);
         return;
     }
 
-    if (m_evaluator->isUserFunctionAssign()) {
+    evaluation.apply(m_session);
+    Quantity result = evaluation.value;
+    if (evaluation.userFunctionAssign) {
         result = CMath::nan();
         emit functionsChanged();
     } else if (result.isNan())
         return;
 
-    m_session->addHistoryEntry(HistoryEntry(expr, result));
+    m_session->addHistoryEntry(HistoryEntry(evaluation.expression, result));
     emit historyChanged();
     emit variablesChanged();
 
@@ -2209,15 +2535,19 @@ void MainWindow::evaluateEditorExpression()
     if (m_settings->autoResultToClipboard)
         copyResultToClipboard();
 
-    if (m_settings->leaveLastExpression)
-        m_widgets.editor->selectAll();
-    else
-        m_widgets.editor->clear();
+    // What was typed since is kept.
+    if (m_evaluator->autoFix(m_widgets.editor->text()) == evaluation.expression) {
+        if (m_settings->leaveLastExpression)
+            m_widgets.editor->selectAll();
+        else
+            m_widgets.editor->clear();
+    }
 
     m_widgets.editor->stopAutoCalc();
     m_widgets.editor->stopAutoComplete();
     if (!result.isNan())
         m_conditions.autoAns = true;
+    m_idleTrimTimer->start();
 }
 
 void MainWindow::clearTextEditSelection(QPlainTextEdit* edit)
@@ -2276,11 +2606,11 @@ void MainWindow::handleEditorTextChange()
 {
     clearTextEditSelection(m_widgets.display);
     if (m_conditions.autoAns && m_settings->autoAns) {
-        QString expr = m_evaluator->autoFix(m_widgets.editor->text());
+        Tokens tokens;
+        QString expr = m_evaluator->autoFix(m_widgets.editor->text(), &tokens);
         if (expr.isEmpty())
             return;
 
-        Tokens tokens = m_evaluator->scan(expr);
         if (tokens.count() == 1) {
             bool operatorCondition =
                 tokens.at(0).asOperator() == Token::Addition
@@ -2347,11 +2677,12 @@ void MainWindow::closeEvent(QCloseEvent* e)
     }
     saveSettings();
     if(m_settings->sessionSave) {
-        QString data_path = Settings::getDataPath();
-        QDir qdir;
-        qdir.mkpath(data_path);
-        data_path.append("/history.json");
-        saveSession(data_path);
+        // Without a journal, the session was not restored at start.
+        if (m_session->isJournaling())
+            saveSessionJournal();
+        else
+            compactSession();
+        m_sessionWriter->flush();
     }
     e->accept();
 }
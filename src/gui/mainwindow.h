@@ -21,6 +21,7 @@
 #ifndef GUI_MAINWINDOW_H
 #define GUI_MAINWINDOW_H
 
+#include "core/evaluationservice.h"
 #include "gui/keypad.h"
 #include "math/quantity.h"
 
@@ -43,6 +44,7 @@ class ManualWindow;
 class ManualServer;
 class ResultDisplay;
 class Session;
+class SessionWriter;
 class Settings;
 class UserFunctionListWidget;
 class Variable;
@@ -53,6 +55,7 @@ class QHBoxLayout;
 class QLabel;
 class QPlainTextEdit;
 class QPushButton;
+class QTimer;
 class QTranslator;
 class QVBoxLayout;
 
@@ -92,6 +95,7 @@ private slots:
     void deleteVariables();
     void deleteUserFunctions();
     void evaluateEditorExpression();
+    void exportCsv();
     void exportHtml();
     void exportPlainText();
     void handleAutoCalcMessageAvailable(const QString&);
@@ -102,6 +106,7 @@ private slots:
     void handleEditorTextChange();
     void handleDisplaySelectionChange();
     void handleEditorSelectionChange();
+    void handleEvaluationFinished(const EvaluationService::Result&);
     void handleManualClosed();
     void handleDockWidgetVisibilityChanged(bool visible);
     void hideStateLabel();
@@ -120,14 +125,19 @@ private slots:
     void retranslateText();
     void revertColorScheme();
     void saveColorSchemeToRevert();
+    void saveSessionJournal();
+    void saveTrace();
+    void trimMemory();
     void saveSessionDialog();
     void selectEditorExpression();
     void setAlwaysOnTopEnabled(bool);
+    void setTraceEnabled(bool);
     void setAngleModeDegree();
     void setAngleModeRadian();
     void setAngleModeGradian();
     void setAutoAnsEnabled(bool);
     void setAutoCalcEnabled(bool);
+    void setAutoRecalculationEnabled(bool);
     void setAutoCompletionEnabled(bool);
     void setBitfieldVisible(bool);
     void setConstantsDockVisible(bool, bool takeFocus = true);
@@ -154,6 +164,7 @@ private slots:
     void setResultFormatPolar();
     void setResultFormatScientific();
     void setResultFormatSexagesimal();
+    void setShortenLongResultsEnabled(bool);
     void setResultPrecision15Digits();
     void setResultPrecision2Digits();
     void setResultPrecision3Digits();
@@ -171,11 +182,13 @@ private slots:
     void setWindowPositionSaveEnabled(bool);
     void setWidgetsDirection();
     void showAboutDialog();
+    void showMemoryUsage();
     void showStateLabel(const QString&);
     void showFontDialog();
     void showLanguageChooserDialog();
     void showManualWindow();
     void showContextHelp();
+    void showDataImportDialog();
     void showReadyMessage();
     void showResultFormatContextMenu(const QPoint&);
     void showSessionImportDialog();
@@ -189,6 +202,15 @@ protected:
 private:
     Q_DISABLE_COPY(MainWindow)
 
+    // What a settings change leaves stale in the display and the editor,
+    // see updateDisplay().
+    enum DisplayChange {
+        ResultsChanged = 0x1, // The formatted results.
+        LayoutChanged = 0x2,  // The color roles and spacing of the text.
+        ColorsChanged = 0x4   // The colors of the roles.
+    };
+    void updateDisplay(int changes);
+
     void clearTextEditSelection(QPlainTextEdit*);
     void addTabifiedDock(QDockWidget*, bool takeFocus, Qt::DockWidgetArea = Qt::RightDockWidgetArea);
     void deleteDock(QDockWidget*);
@@ -225,7 +247,8 @@ private:
     void deleteVariablesDock();
     void deleteUserFunctionsDock();
     void saveSettings();
-    void saveSession(QString &fname);
+    void compactSession();
+    void exportHistory(int format, const QString& fileName);
     void setActionsText();
     void setMenusText();
     void setStatusBarText();
@@ -236,6 +259,8 @@ private:
         QAction* sessionLoad;
         QAction* sessionSave;
         QAction* sessionImport;
+        QAction* sessionImportData;
+        QAction* sessionExportCsv;
         QAction* sessionExportHtml;
         QAction* sessionExportPlainText;
         QAction* sessionQuit;
@@ -276,6 +301,7 @@ private:
         QAction* settingsResultFormatOctal;
         QAction* settingsResultFormatCartesian;
         QAction* settingsResultFormatPolar;
+        QAction* settingsResultFormatShortenLongResults;
         QAction* settingsResultFormatHexadecimal;
         QAction* settingsResultFormatSexagesimal;
         QAction* settingsAngleUnitRadian;
@@ -292,6 +318,7 @@ private:
         QAction* settingsBehaviorDigitGroupingTwoSpaces;
         QAction* settingsBehaviorDigitGroupingThreeSpaces;
         QAction* settingsBehaviorAutoAns;
+        QAction* settingsBehaviorAutoRecalculation;
         QAction* settingsBehaviorLeaveLastExpression;
         QAction* settingsBehaviorAlwaysOnTop;
         QAction* settingsBehaviorAutoResultToClipboard;
@@ -311,6 +338,9 @@ private:
         QAction* helpCommunity;
         QAction* helpNews;
         QAction* helpDonate;
+        QAction* helpMemoryUsage;
+        QAction* helpTrace;
+        QAction* helpSaveTrace;
         QAction* helpAbout;
         QAction* contextHelp;
     } m_actions;
@@ -381,6 +411,8 @@ private:
 
     Constants* m_constants;
     Evaluator* m_evaluator;
+    // Evaluates what is entered off the GUI thread.
+    EvaluationService* m_evaluationService;
     FunctionRepo* m_functions;
     Settings* m_settings;
     Session* m_session;
@@ -388,6 +420,13 @@ private:
     QPlainTextEdit* m_copyWidget;
     ManualServer* m_manualServer;
     QString m_colorSchemeToRevert;
+    // Names the snapshot of the session, which the journal starts with.
+    QString m_sessionJournalId;
+    SessionWriter* m_sessionWriter;
+    QTimer* m_sessionSaveTimer;
+    // Gives back the memory of the caches once no expression was evaluated
+    // for a while, see trimMemory().
+    QTimer* m_idleTrimTimer;
 };
 
 #endif // GUI_MAINWINDOW_H
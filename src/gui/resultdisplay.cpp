@@ -20,6 +20,7 @@
 
 #include "core/functions.h"
 #include "core/numberformatter.h"
+#include "core/pipelinetrace.h"
 #include "core/settings.h"
 #include "gui/syntaxhighlighter.h"
 #include "math/cmath.h"
@@ -33,6 +34,14 @@
 #include <QClipboard>
 #include <QPainter>
 #include <QScrollBar>
+#include <QTextCursor>
+
+// Only the most recent entries of a long history are formatted at first,
+// older ones are added a page at a time when scrolled up to.
+static const int HistoryPageSize = 500;
+// Enough formatted results to go back and forth between a few result
+// formats without formatting a page again.
+static const int ResultCacheSize = 8 * HistoryPageSize;
 
 ResultDisplay::ResultDisplay(QWidget* parent)
     : QPlainTextEdit(parent)
@@ -41,6 +50,9 @@ ResultDisplay::ResultDisplay(QWidget* parent)
     , m_scrollDirection(0)
     , m_isScrollingPageOnly(false)
     , m_count(0)
+    , m_firstShown(0)
+    , m_historyRevision(0)
+    , m_results(ResultCacheSize)
 {
     setViewportMargins(0, 0, 0, 0);
     setBackgroundRole(QPalette::Base);
@@ -49,15 +61,72 @@ ResultDisplay::ResultDisplay(QWidget* parent)
     setReadOnly(true);
     setFocusPolicy(Qt::NoFocus);
     setWordWrapMode(QTextOption::WrapAnywhere);
+
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(showOlderEntries()));
+}
+
+// The results are shortened or not, as well.
+static QByteArray displayKey()
+{
+    return NumberFormatter::settingsKey()
+        + (Settings::instance()->shortenLongResults ? "+" : "-");
+}
+
+// Long results are shortened to what fits a few lines, the full text is
+// formatted again from the value when copied or exported.
+QString ResultDisplay::resultText(const Quantity& value)
+{
+    const QString formatted = NumberFormatter::format(value);
+    if (!Settings::instance()->shortenLongResults)
+        return formatted;
+    const QString shortened = NumberFormatter::shorten(formatted);
+    if (shortened.length() != formatted.length())
+        m_fullResults.insert(shortened, formatted);
+    return shortened;
+}
+
+QString ResultDisplay::entryText(const HistoryEntry& entry)
+{
+    QString text = entry.expr() + QLatin1Char('\n');
+    const QByteArray key = m_settingsKey + '\0' + entry.packedResult();
+    QString* result = m_results.object(key);
+    if (!result) {
+        const Quantity value = entry.result();
+        result = new QString;
+        if (!value.isNan())
+            *result = QLatin1String("= ") + resultText(value) + QLatin1Char('\n');
+        m_results.insert(key, result);
+    }
+    return text + *result + QLatin1Char('\n');
+}
+
+// The formatted results and the layouts of the highlighter. The full text
+// of the shortened results is kept for as long as they may be shown.
+qint64 ResultDisplay::cacheBytes() const
+{
+    qint64 bytes = m_highlighter->cacheBytes();
+    const QList<QByteArray> keys = m_results.keys();
+    for (const QByteArray& key : keys)
+        bytes += key.size() + sizeof(QString) + HMath::workingPrecision() * 2;
+    for (auto i = m_fullResults.constBegin(); i != m_fullResults.constEnd(); ++i)
+        bytes += 2 * qint64(i.key().size() + i.value().size());
+    return bytes;
+}
+
+void ResultDisplay::trimCaches()
+{
+    m_results.clear();
+    m_highlighter->trimCaches();
 }
 
 void ResultDisplay::append(const QString& expression, Quantity& value)
 {
+    PipelineTrace::Span span("ResultDisplay::append");
     ++m_count;
 
     appendPlainText(expression);
     if (!value.isNan())
-        appendPlainText(QLatin1String("= ") + NumberFormatter::format(value));
+        appendPlainText(QLatin1String("= ") + resultText(value));
     appendPlainText(QLatin1String(""));
 }
 
@@ -66,42 +135,82 @@ int ResultDisplay::count() const
     return m_count;
 }
 
-QString ResultDisplay::exportHtml() const
-{
-    QString str;
-    m_highlighter->asHtml(str);
-    return str;
-}
-
 void ResultDisplay::rehighlight()
 {
     m_highlighter->update();
     updateScrollBarStyleSheet();
 }
 
+void ResultDisplay::relayout()
+{
+    m_highlighter->relayout();
+}
+
 
 void ResultDisplay::clear()
 {
     m_count = 0;
+    m_firstShown = 0;
     setPlainText(QLatin1String(""));
 }
 
 
+// Entries added at the end of the history since the last refresh are
+// appended to what is shown; the page is only formatted again when the
+// history was changed otherwise or the result format changed.
 void ResultDisplay::refresh()
 {
+    const Session* session = Evaluator::instance()->session();
+    const QList<HistoryEntry> history = session->historyToList();
+    const QByteArray settingsKey = displayKey();
+    QString text;
+
+    if (m_count > 0 && m_count <= history.count()
+        && session->historyRevision() == m_historyRevision
+        && settingsKey == m_settingsKey)
+    {
+        for (int i = m_count; i < history.count(); ++i)
+            text += entryText(history.at(i));
+        m_count = history.count();
+        if (!text.isEmpty()) {
+            text.chop(1);
+            appendPlainText(text);
+        }
+        return;
+    }
+
+    // Appended rather than set, so that the view stays at the bottom.
     clear();
-    QList<HistoryEntry> history = Evaluator::instance()->session()->historyToList();
+    m_historyRevision = session->historyRevision();
+    m_settingsKey = settingsKey;
+    const int first = qMax(0, history.count() - HistoryPageSize);
+    for (int i = first; i < history.count(); ++i)
+        text += entryText(history.at(i));
+    text.chop(1);
+    appendPlainText(text);
     m_count = history.count();
+    m_firstShown = first;
+}
 
-    for(int i=0; i<m_count; ++i) {
-        QString expression = history[i].expr();
-        Quantity value = history[i].result();
-        appendPlainText(expression);
-        if (!value.isNan())
-            appendPlainText(QLatin1String("= ") + NumberFormatter::format(value));
-        appendPlainText(QLatin1String(""));
-    }
+void ResultDisplay::showOlderEntries()
+{
+    QScrollBar* bar = verticalScrollBar();
+    if (m_firstShown == 0 || bar->value() != bar->minimum())
+        return;
 
+    const QList<HistoryEntry> history = Evaluator::instance()->session()->historyToList();
+    const int first = qMax(0, qMin(m_firstShown, history.count()) - HistoryPageSize);
+    QString text;
+    for (int i = first; i < m_firstShown && i < history.count(); ++i)
+        text += entryText(history.at(i));
+    m_firstShown = first;
+
+    // Keep the view where it was.
+    const int maximum = bar->maximum();
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::Start);
+    cursor.insertText(text);
+    bar->setValue(bar->value() + bar->maximum() - maximum);
 }
 
 void ResultDisplay::scrollLines(int numberOfLines)
@@ -206,7 +315,7 @@ void ResultDisplay::mouseDoubleClickEvent(QMouseEvent*)
     QString resultMarker = QLatin1String("= ");
     if (text.startsWith(resultMarker))
         text.remove(resultMarker);
-    emit expressionSelected(text);
+    emit expressionSelected(m_fullResults.value(text, text));
 }
 
 void ResultDisplay::timerEvent(QTimerEvent* event)
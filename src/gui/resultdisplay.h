@@ -20,6 +20,8 @@
 #define GUI_RESULTDISPLAY_H
 
 #include <QBasicTimer>
+#include <QCache>
+#include <QHash>
 #include <QPlainTextEdit>
 
 class Quantity;
@@ -38,7 +40,9 @@ public:
     void appendHistory(const QStringList& expressions, const QStringList& results);
     int count() const;
     bool isEmpty() const { return m_count==0; }
-    QString exportHtml() const;
+    SyntaxHighlighter* highlighter() const { return m_highlighter; }
+    qint64 cacheBytes() const;
+    void trimCaches();
 
 signals:
     void shiftWheelDown();
@@ -54,6 +58,7 @@ public slots:
     void decreaseFontPointSize();
     void increaseFontPointSize();
     void rehighlight();
+    void relayout();
     void refresh();
     void scrollLines(int);
     void scrollLineUp();
@@ -74,15 +79,30 @@ protected:
     void stopActiveScrollingAnimation();
     void updateScrollBarStyleSheet();
 
+protected slots:
+    void showOlderEntries();
+
 private:
     Q_DISABLE_COPY(ResultDisplay)
 
+    QString entryText(const HistoryEntry&);
+    QString resultText(const Quantity&);
+
     SyntaxHighlighter* m_highlighter;
     QBasicTimer m_scrollTimer;
     int m_scrolledLines;
     int m_scrollDirection;
     bool m_isScrollingPageOnly;
     int m_count;
+    // Index of the oldest history entry shown.
+    int m_firstShown;
+    // What the entries shown were formatted from, see refresh().
+    unsigned m_historyRevision;
+    QByteArray m_settingsKey;
+    // Formatted results by settings key and packed result.
+    QCache<QByteArray, QString> m_results;
+    // The full text of the results shortened for display.
+    QHash<QString, QString> m_fullResults;
 };
 
 #endif
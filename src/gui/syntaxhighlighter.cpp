@@ -23,19 +23,43 @@
 
 #include "core/evaluator.h"
 #include "core/functions.h"
+#include "core/pipelinetrace.h"
+#include "core/session.h"
 #include "core/settings.h"
 
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QJsonObject>
 #include <QLatin1String>
 #include <QApplication>
 #include <QPalette>
 #include <QPlainTextEdit>
+#include <QTextBlock>
 #include <QTextDocument>
-#include <QTextDocumentFragment>
 
 static const constexpr auto COLOR_SCHEME_EXTENSION = "json";
 
+// A block layout has a byte per character, with the color role of the
+// character in the low bits and SpacedDigit set for the digits that start
+// a group.
+static const char RoleMask = 0x3f;
+static const char SpacedDigit = 0x40;
+// Enough for the pages a result display shows and the editor.
+static const int LayoutCacheSize = 16384;
+// In documents with more blocks, those not laid out yet are first shown
+// in the default color and highlighted a slice of time at a time, the
+// visible ones first, so that a long history shows at once.
+static const int LaterBlockCount = 256;
+static const int LaterSliceMs = 10;
+
+namespace {
+
+// Marks the blocks left to highlight later.
+class LaterBlockData : public QTextBlockUserData {
+};
+
+} // namespace
+
 static const QVector<QString> colorSchemeSearchPaths()
 {
     static QVector<QString> searchPaths;
@@ -141,6 +165,12 @@ ColorScheme ColorScheme::loadByName(const QString& name)
 
 SyntaxHighlighter::SyntaxHighlighter(QPlainTextEdit* edit)
     : QSyntaxHighlighter(edit)
+    , m_formats(nullptr)
+    , m_layouts(LayoutCacheSize)
+    , m_laterBlock(0)
+    , m_laterAll(false)
+    , m_highlightingLater(false)
+    , m_isSuspended(false)
 {
     setDocument(edit->document());
     update();
@@ -150,69 +180,196 @@ void SyntaxHighlighter::setColorScheme(ColorScheme&& colorScheme) {
     m_colorScheme = colorScheme;
 }
 
-void SyntaxHighlighter::highlightBlock(const QString& text)
+// What the layout of a block depends on besides its text.
+static QByteArray layoutKey()
 {
-    // Default color for the text
-    setFormat(0, text.length(), colorForRole(ColorScheme::Number));
+    const Settings* settings = Settings::instance();
+    const Session* session = Evaluator::instance()->session();
+    QByteArray key;
+    key.append(settings->isRadixCharacterBoth() ? '*' : settings->radixCharacter());
+    key.append(settings->digitGrouping > 0 ? 'g' : '-');
+    key.append(QByteArray::number(quintptr(session)));
+    key.append(':');
+    key.append(QByteArray::number(session ? session->userFunctionsRevision() : 0));
+    return key;
+}
 
-    if (!Settings::instance()->syntaxHighlighting)
-        return;
+static void fillRole(QByteArray& layout, int start, int count, ColorScheme::Role role)
+{
+    const int end = qMin(start + count, layout.size());
+    for (int i = qMax(start, 0); i < end; ++i)
+        layout[i] = char(role);
+}
+
+// Scans text once for the color role of each character. Blocks seen
+// before, like those of the history when the color scheme changes, reuse
+// their layout.
+QByteArray SyntaxHighlighter::layoutBlock(const QString& text) const
+{
+    // Default color for the text
+    QByteArray layout(text.length(), char(ColorScheme::Number));
 
     if (text.startsWith(QLatin1String("="))) {
-        setFormat(0, 1, colorForRole(ColorScheme::Operator));
-        setFormat(1, text.length(), colorForRole(ColorScheme::Result));
+        fillRole(layout, 0, 1, ColorScheme::Operator);
+        fillRole(layout, 1, text.length(), ColorScheme::Result);
         if (Settings::instance()->digitGrouping > 0)
-            groupDigits(text, 1, text.length() - 1);
-        return;
+            groupDigits(text, 1, text.length() - 1, layout);
+        return layout;
     }
 
     int questionMarkIndex = text.indexOf('?');
     if (questionMarkIndex != -1)
-        setFormat(questionMarkIndex, text.length(), colorForRole(ColorScheme::Comment));
+        fillRole(layout, questionMarkIndex, text.length(), ColorScheme::Comment);
 
-    Tokens tokens = Evaluator::instance()->scan(text);
+    const Tokens tokens = Evaluator::instance()->scan(text);
+    const QStringList functionNames = FunctionRepo::instance()->getIdentifiers();
 
     for (int i = 0; i < tokens.count(); ++i) {
         const Token& token = tokens.at(i);
-        const QString tokenText = token.text().toLower();
-        QStringList functionNames = FunctionRepo::instance()->getIdentifiers();
-        QColor color;
+        ColorScheme::Role role;
 
         switch (token.type()) {
         case Token::stxNumber:
         case Token::stxUnknown:
-            color = colorForRole(ColorScheme::Number);
+            role = ColorScheme::Number;
             // TODO: color thousand separators differently? It might help troubleshooting issues
             break;
 
         case Token::stxOperator:
-            color = colorForRole(ColorScheme::Operator);
+            role = ColorScheme::Operator;
             break;
 
         case Token::stxSep:
-            color = colorForRole(ColorScheme::Separator);
+            role = ColorScheme::Separator;
             break;
 
         case Token::stxOpenPar:
         case Token::stxClosePar:
-            color = colorForRole(ColorScheme::Parens);
+            role = ColorScheme::Parens;
             break;
 
         case Token::stxIdentifier:
-            color = colorForRole(ColorScheme::Variable);
+            role = ColorScheme::Variable;
             if (Evaluator::instance()->hasUserFunction(token.text())
-                || functionNames.contains(tokenText, Qt::CaseInsensitive))
-                color = colorForRole(ColorScheme::Function);
+                || functionNames.contains(token.text(), Qt::CaseInsensitive))
+                role = ColorScheme::Function;
             break;
 
         default:
-            break;
+            continue;
         };
 
-        setFormat(token.pos(), token.size(), color);
+        fillRole(layout, token.pos(), token.size(), role);
         if (token.type() == Token::stxNumber && Settings::instance()->digitGrouping > 0)
-            groupDigits(text, token.pos(), token.size());
+            groupDigits(text, token.pos(), token.size(), layout);
     }
+    return layout;
+}
+
+void SyntaxHighlighter::highlightBlock(const QString& text)
+{
+    if (m_isSuspended && !m_formats)
+        return;
+    PipelineTrace::Span span("SyntaxHighlighter::highlightBlock");
+
+    if (currentBlockUserData())
+        setCurrentBlockUserData(nullptr);
+
+    if (!Settings::instance()->syntaxHighlighting) {
+        // Default color for the text
+        applyFormat(0, text.length(), colorForRole(ColorScheme::Number));
+        return;
+    }
+
+    const QByteArray key = layoutKey();
+    if (key != m_layoutKey) {
+        m_layouts.clear();
+        m_layoutKey = key;
+    }
+    QByteArray layout;
+    if (const QByteArray* cached = m_layouts.object(text)) {
+        layout = *cached;
+    } else if (!m_formats && !m_highlightingLater
+               && document()->blockCount() > LaterBlockCount) {
+        applyFormat(0, text.length(), colorForRole(ColorScheme::Number));
+        setCurrentBlockUserData(new LaterBlockData);
+        const int number = currentBlock().blockNumber();
+        if (!m_laterTimer.isActive()) {
+            m_laterBlock = number;
+            m_laterTimer.start(0, this);
+        } else if (number < m_laterBlock) {
+            m_laterBlock = number;
+        }
+        return;
+    } else {
+        layout = layoutBlock(text);
+        m_layouts.insert(text, new QByteArray(layout));
+    }
+
+    // A single format for each run of characters laid out alike.
+    // Size of the space between groups (100 means no space).
+    const qreal spacing = 100 + 40 * Settings::instance()->digitGrouping;
+    for (int start = 0; start < layout.size(); ) {
+        int end = start + 1;
+        while (end < layout.size() && layout.at(end) == layout.at(start))
+            ++end;
+        QTextCharFormat format;
+        format.setForeground(colorForRole(ColorScheme::Role(layout.at(start) & RoleMask)));
+        if (layout.at(start) & SpacedDigit)
+            format.setFontLetterSpacing(spacing);
+        applyFormat(start, end - start, format);
+        start = end;
+    }
+}
+
+void SyntaxHighlighter::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != m_laterTimer.timerId()) {
+        QSyntaxHighlighter::timerEvent(event);
+        return;
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    m_highlightingLater = true;
+
+    const QPlainTextEdit* edit = static_cast<QPlainTextEdit*>(parent());
+    QTextBlock block = edit->cursorForPosition(QPoint(0, 0)).block();
+    const int lastVisible =
+        edit->cursorForPosition(QPoint(0, edit->viewport()->height())).block().blockNumber();
+    for (; block.isValid() && block.blockNumber() <= lastVisible; block = block.next()) {
+        if (m_laterAll || block.userData())
+            rehighlightBlock(block);
+    }
+
+    block = document()->findBlockByNumber(m_laterBlock);
+    for (; block.isValid() && elapsed.elapsed() < LaterSliceMs; block = block.next()) {
+        if (m_laterAll || block.userData())
+            rehighlightBlock(block);
+    }
+
+    m_highlightingLater = false;
+    if (block.isValid())
+        m_laterBlock = block.blockNumber();
+    else {
+        m_laterTimer.stop();
+        m_laterAll = false;
+    }
+}
+
+// Highlights a large document again from m_laterTimer, the visible blocks
+// first, so that a settings change does not stall on the whole history.
+void SyntaxHighlighter::rehighlightVisibleFirst()
+{
+    if (document()->blockCount() <= LaterBlockCount) {
+        m_laterTimer.stop();
+        m_laterAll = false;
+        rehighlight();
+        return;
+    }
+    m_laterAll = true;
+    m_laterBlock = 0;
+    m_laterTimer.start(0, this);
 }
 
 void SyntaxHighlighter::update()
@@ -227,16 +384,52 @@ void SyntaxHighlighter::update()
     pal.setColor(QPalette::Inactive, QPalette::Base, backgroundColor);
     parentWidget->setPalette(pal);
 
-    rehighlight();
+    rehighlightVisibleFirst();
+}
+
+// Applies a change of the settings the layout of the text depends on,
+// like the digit grouping, keeping the color scheme.
+void SyntaxHighlighter::relayout()
+{
+    rehighlightVisibleFirst();
+}
+
+// The layouts kept take twice the text for their key and a byte for each
+// character. The cache is only looked at by key, which keeps its order.
+qint64 SyntaxHighlighter::cacheBytes() const
+{
+    qint64 bytes = 0;
+    const QList<QString> keys = m_layouts.keys();
+    for (const QString& key : keys)
+        bytes += 3 * qint64(key.size()) + 2 * qint64(sizeof(QString));
+    return bytes;
+}
+
+void SyntaxHighlighter::trimCaches()
+{
+    m_layouts.clear();
+}
+
+// Leaves the text changed until resume() unhighlighted.
+void SyntaxHighlighter::suspend()
+{
+    m_isSuspended = true;
+}
+
+void SyntaxHighlighter::resume()
+{
+    if (!m_isSuspended)
+        return;
+    m_isSuspended = false;
+    rehighlightVisibleFirst();
 }
 
-void SyntaxHighlighter::formatDigitsGroup(const QString& text, int start, int end, bool invert, int size)
+void SyntaxHighlighter::formatDigitsGroup(const QString& text, int start, int end, bool invert, int size,
+                                          QByteArray& layout) const
 {
     Q_ASSERT(start <= end);
     Q_ASSERT(size > 0);
 
-    qreal spacing = 100; // Size of the space between groups (100 means no space).
-    spacing += 40 * Settings::instance()->digitGrouping;
     int inc = !invert ? -1 : 1;
     if(!invert)
     {
@@ -260,10 +453,8 @@ void SyntaxHighlighter::formatDigitsGroup(const QString& text, int start, int en
             ++count;
             if (count == size)
             {
-                // Only change the letter spacing from the format and keep the other properties.
-                QTextCharFormat fmt = format(start);
-                fmt.setFontLetterSpacing(spacing);
-                setFormat(start, 1, fmt);
+                // Only change the letter spacing and keep the color.
+                layout[start] = char(layout.at(start) | SpacedDigit);
                 count = 0; // Reset
                 // TODO: if the next character is a separator, do not add spacing?
             }
@@ -271,7 +462,7 @@ void SyntaxHighlighter::formatDigitsGroup(const QString& text, int start, int en
     }
 }
 
-void SyntaxHighlighter::groupDigits(const QString& text, int pos, int length)
+void SyntaxHighlighter::groupDigits(const QString& text, int pos, int length, QByteArray& layout) const
 {
     // Used to find out which characters belong to which radixes.
     static int charType[128] = { 0 };
@@ -334,7 +525,7 @@ void SyntaxHighlighter::groupDigits(const QString& text, int pos, int length)
 
                 if (endOfNumber) {
                     // End of current number found, start grouping the digits.
-                    formatDigitsGroup(text, s, i, invertGroup, groupSize);
+                    formatDigitsGroup(text, s, i, invertGroup, groupSize, layout);
                     s = -1; // Reset.
                 }
             }
@@ -374,65 +565,48 @@ void SyntaxHighlighter::groupDigits(const QString& text, int pos, int length)
 
     // Group the last digits if the string finishes with the number.
     if (s >= 0) {
-        formatDigitsGroup(text, s, endPos, invertGroup, groupSize);
+        formatDigitsGroup(text, s, endPos, invertGroup, groupSize, layout);
     }
 }
 
 
-// Original code snippet from StackOverflow.
-// http://stackoverflow.com/questions/15280452/how-can-i-get-highlighted-text-from-a-qsyntaxhighlighter-into-an-html-string
-void SyntaxHighlighter::asHtml(QString& html)
+// Returns line as HTML, with the colors it gets in a highlighted document.
+QString SyntaxHighlighter::lineToHtml(const QString& line)
 {
-    // Create a new document from all the selected text document.
-    QTextCursor cursor(document());
-    cursor.select(QTextCursor::Document);
-    QTextDocument* tempDocument(new QTextDocument);
-    Q_ASSERT(tempDocument);
-    QTextCursor tempCursor(tempDocument);
-
-    tempCursor.insertFragment(cursor.selection());
-    tempCursor.select(QTextCursor::Document);
-    // Set the default foreground for the inserted characters.
-    QTextCharFormat textfmt = tempCursor.charFormat();
-    textfmt.setForeground(Qt::gray);
-    tempCursor.setCharFormat(textfmt);
-
-    // Apply the additional formats set by the syntax highlighter
-    QTextBlock start = document()->findBlock(cursor.selectionStart());
-    QTextBlock end = document()->findBlock(cursor.selectionEnd());
-    end = end.next();
-    const int selectionStart = cursor.selectionStart();
-    const int endOfDocument = tempDocument->characterCount() - 1;
-    for(QTextBlock current = start; current.isValid() && current != end; current = current.next()) {
-        const QTextLayout* layout(current.layout());
-
-        foreach(const QTextLayout::FormatRange &range, layout->formats()) {
-            const int start = current.position() + range.start - selectionStart;
-            const int end = start + range.length;
-            if(end <= 0 || start >= endOfDocument)
-                continue;
-            tempCursor.setPosition(qMax(start, 0));
-            tempCursor.setPosition(qMin(end, endOfDocument), QTextCursor::KeepAnchor);
-            tempCursor.setCharFormat(range.format);
-        }
+    QVector<QTextCharFormat> formats(line.length());
+    m_formats = &formats;
+    highlightBlock(line);
+    m_formats = nullptr;
+
+    QString html;
+    for (int start = 0; start < line.length(); ) {
+        int end = start + 1;
+        while (end < line.length() && formats.at(end).foreground() == formats.at(start).foreground())
+            ++end;
+        html += QString("<span style=\"color:%1\">%2</span>")
+            .arg(formats.at(start).foreground().color().name(),
+                 line.mid(start, end - start).toHtmlEscaped());
+        start = end;
     }
+    return html;
+}
 
-    // Reset the user states since they are not interesting
-    for(QTextBlock block = tempDocument->begin(); block.isValid(); block = block.next())
-        block.setUserState(-1);
-
-    // Make sure the text appears pre-formatted, and set the background we want.
-    tempCursor.select(QTextCursor::Document);
-    QTextBlockFormat blockFormat = tempCursor.blockFormat();
-    blockFormat.setNonBreakableLines(true);
-    blockFormat.setBackground(colorForRole(ColorScheme::Background));
-    tempCursor.setBlockFormat(blockFormat);
-
-    // Finally retreive the syntax higlighted and formatted html.
-    html = tempCursor.selection().toHtml("UTF-8");
-    delete tempDocument;
+// While lineToHtml() runs, formats go to m_formats instead of a block
+// of the document.
+void SyntaxHighlighter::applyFormat(int start, int count, const QTextCharFormat& format)
+{
+    if (!m_formats) {
+        setFormat(start, count, format);
+        return;
+    }
+    const int end = qMin(start + count, m_formats->size());
+    for (int i = qMax(start, 0); i < end; ++i)
+        (*m_formats)[i] = format;
+}
 
-    // Inject CSS, so to avoid a white margin
-    html.replace("<head>", QString("<head> <style> body {background-color: %1;}</style>")
-                                    .arg(colorForRole(ColorScheme::Background).name()));
+void SyntaxHighlighter::applyFormat(int start, int count, const QColor& color)
+{
+    QTextCharFormat format;
+    format.setForeground(color);
+    applyFormat(start, count, format);
 }
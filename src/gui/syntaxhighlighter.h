@@ -20,8 +20,11 @@
 #ifndef GUI_SYNTAXHIGHLIGHTER_H
 #define GUI_SYNTAXHIGHLIGHTER_H
 
+#include <QtCore/QBasicTimer>
+#include <QtCore/QCache>
 #include <QtCore/QJsonDocument>
 #include <QSyntaxHighlighter>
+#include <QVector>
 
 class QPlainTextEdit;
 
@@ -66,18 +69,46 @@ public:
     QColor colorForRole(ColorScheme::Role role) const { return m_colorScheme.colorForRole(role); }
 
     void update();
+    void relayout();
+    void suspend();
+    void resume();
+    qint64 cacheBytes() const;
+    void trimCaches();
     virtual void highlightBlock(const QString&);
-    void asHtml(QString& html);
+    QString lineToHtml(const QString& line);
+
+protected:
+    virtual void timerEvent(QTimerEvent*);
 
 private:
     Q_DISABLE_COPY(SyntaxHighlighter)
     SyntaxHighlighter();
     SyntaxHighlighter(QObject*);
     SyntaxHighlighter(QTextDocument*);
-    void groupDigits(const QString& text, int pos, int length);
-    void formatDigitsGroup(const QString& text, int start, int end, bool invert, int size);
+    QByteArray layoutBlock(const QString& text) const;
+    void groupDigits(const QString& text, int pos, int length, QByteArray& layout) const;
+    void formatDigitsGroup(const QString& text, int start, int end, bool invert, int size,
+                           QByteArray& layout) const;
+    void applyFormat(int start, int count, const QTextCharFormat& format);
+    void applyFormat(int start, int count, const QColor& color);
+    void rehighlightVisibleFirst();
 
     ColorScheme m_colorScheme;
+    QVector<QTextCharFormat>* m_formats;
+    // Layouts of the blocks highlighted, by text, see layoutBlock(). They
+    // are dropped when m_layoutKey no longer matches the settings.
+    QCache<QString, QByteArray> m_layouts;
+    QByteArray m_layoutKey;
+    // Large documents get the blocks not laid out yet highlighted from
+    // m_laterTimer, starting from block number m_laterBlock, or all blocks
+    // from there if m_laterAll is set.
+    QBasicTimer m_laterTimer;
+    int m_laterBlock;
+    bool m_laterAll;
+    bool m_highlightingLater;
+    // Set while the text changes in bulk, which is highlighted once on
+    // resume().
+    bool m_isSuspended;
 };
 
 #endif
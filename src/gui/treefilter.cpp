@@ -0,0 +1,62 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#include "gui/treefilter.h"
+
+#include <QTreeWidget>
+
+// Where an item keeps the folded text of its columns.
+static const int SearchRole = Qt::UserRole + 1;
+
+void TreeFilter::add(QTreeWidgetItem* item) const
+{
+    QString text;
+    for (int column = 0; column < m_columns; ++column)
+        text += item->text(column).toCaseFolded() + QLatin1Char('\n');
+    item->setData(0, SearchRole, text);
+    if (!m_term.isEmpty())
+        item->setHidden(!matches(item));
+}
+
+void TreeFilter::apply(const QString& term)
+{
+    const QString folded = term.toCaseFolded();
+    // Items without the former term don't have this one either.
+    const bool narrowing = folded.contains(m_term);
+    m_term = folded;
+    for (int i = 0; i < m_tree->topLevelItemCount(); ++i) {
+        QTreeWidgetItem* item = m_tree->topLevelItem(i);
+        if (narrowing && item->isHidden())
+            continue;
+        item->setHidden(!matches(item));
+    }
+}
+
+bool TreeFilter::hasShownItems() const
+{
+    for (int i = 0; i < m_tree->topLevelItemCount(); ++i) {
+        if (!m_tree->topLevelItem(i)->isHidden())
+            return true;
+    }
+    return false;
+}
+
+bool TreeFilter::matches(const QTreeWidgetItem* item) const
+{
+    return m_term.isEmpty() || item->data(0, SearchRole).toString().contains(m_term);
+}
@@ -0,0 +1,48 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+
+#ifndef GUI_TREEFILTER_H
+#define GUI_TREEFILTER_H
+
+#include <QString>
+
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// Hides the items of a tree widget whose text doesn't contain a search term.
+// The text of an item is case folded once, when it is added, and a term
+// that extends the one applied before only looks at the items still shown.
+class TreeFilter {
+public:
+    // Items are searched in their first columns columns.
+    TreeFilter(QTreeWidget* tree, int columns) : m_tree(tree), m_columns(columns) {}
+
+    // For each item put in the tree, which is hidden if it doesn't match.
+    void add(QTreeWidgetItem*) const;
+    void apply(const QString& term);
+    bool hasShownItems() const;
+
+private:
+    bool matches(const QTreeWidgetItem*) const;
+
+    QTreeWidget* m_tree;
+    int m_columns;
+    QString m_term;
+};
+
+#endif // GUI_TREEFILTER_H
@@ -21,6 +21,7 @@
 #include "gui/userfunctionlistwidget.h"
 
 #include "core/evaluator.h"
+#include "core/session.h"
 #include "core/settings.h"
 
 #include <QtCore/QEvent>
@@ -33,6 +34,7 @@
 #include <QTreeWidget>
 #include <QVBoxLayout>
 
+static int sortedIndex(const QTreeWidget*, const QString&);
 
 UserFunctionListWidget::UserFunctionListWidget(QWidget* parent)
     : QWidget(parent)
@@ -41,6 +43,8 @@ UserFunctionListWidget::UserFunctionListWidget(QWidget* parent)
     , m_noMatchLabel(new QLabel(m_userFunctions))
     , m_searchFilter(new QLineEdit(this))
     , m_searchLabel(new QLabel(this))
+    , m_filter(m_userFunctions, 2)
+    , m_changeCount(0)
 {
     m_filterTimer->setInterval(500);
     m_filterTimer->setSingleShot(true);
@@ -89,15 +93,13 @@ UserFunctionListWidget::UserFunctionListWidget(QWidget* parent)
 
     retranslateText();
 
-    connect(m_filterTimer, SIGNAL(timeout()), SLOT(updateList()));
+    connect(m_filterTimer, SIGNAL(timeout()), SLOT(applyFilter()));
     connect(m_searchFilter, SIGNAL(textChanged(const QString&)), SLOT(triggerFilter()));
     connect(m_userFunctions, SIGNAL(itemActivated(QTreeWidgetItem*, int)), SLOT(activateItem()));
     connect(m_insertAction, SIGNAL(triggered()), SLOT(activateItem()));
     connect(m_editAction, SIGNAL(triggered()), SLOT(editItem()));
     connect(m_deleteAction, SIGNAL(triggered()), SLOT(deleteItem()));
     connect(m_deleteAllAction, SIGNAL(triggered()), SLOT(deleteAllItems()));
-
-    updateList();
 }
 
 UserFunctionListWidget::~UserFunctionListWidget()
@@ -111,38 +113,85 @@ void UserFunctionListWidget::updateList()
 
     m_filterTimer->stop();
     m_userFunctions->clear();
-    QString term = m_searchFilter->text();
+    m_items.clear();
+    const Session* session = Evaluator::instance()->session();
+    m_changeCount = session ? session->changeCount() : 0;
     QList<UserFunction> userFunctions = Evaluator::instance()->getUserFunctions();
 
     for (int i = 0; i < userFunctions.count(); ++i) {
-        QString fname = userFunctions.at(i).name() + "(" + userFunctions.at(i).arguments().join(";")  + ")";
-
-        QStringList namesAndValues;
-        namesAndValues << fname << userFunctions.at(i).expression();
-
-        if (term.isEmpty()
-            || namesAndValues.at(0).contains(term, Qt::CaseInsensitive)
-            || namesAndValues.at(1).contains(term, Qt::CaseInsensitive))
-        {
-            QTreeWidgetItem* item = new QTreeWidgetItem(m_userFunctions, namesAndValues);
-            item->setTextAlignment(0, Qt::AlignLeft | Qt::AlignVCenter);
-            item->setTextAlignment(1, Qt::AlignLeft | Qt::AlignVCenter);
+        QTreeWidgetItem* item = createItem(userFunctions.at(i));
+        m_userFunctions->addTopLevelItem(item);
+        m_filter.add(item);
+        m_items.insert(userFunctions.at(i).name(), item);
+    }
+    m_userFunctions->sortItems(0, Qt::AscendingOrder);
+
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
+void UserFunctionListWidget::applyChanges()
+{
+    const Session* session = Evaluator::instance()->session();
+    QList<Session::Change> changes;
+    if (!session || !session->changesSince(m_changeCount, changes)) {
+        updateList();
+        return;
+    }
+    m_changeCount = session->changeCount();
+
+    bool changed = false;
+    for (int i = 0; i < changes.count(); ++i) {
+        const Session::Change& change = changes.at(i);
+        if (change.subject != Session::Change::UserFunctions)
+            continue;
+        if (!changed) {
+            setUpdatesEnabled(false);
+            changed = true;
         }
+        delete m_items.take(change.key);
+        if (change.kind == Session::Change::Removed
+            || !session->hasUserFunction(change.key))
+            continue;
+        QTreeWidgetItem* item = createItem(*session->getUserFunction(change.key));
+        m_userFunctions->insertTopLevelItem(
+            sortedIndex(m_userFunctions, item->text(0)), item);
+        m_filter.add(item);
+        m_items.insert(change.key, item);
+    }
+
+    if (changed) {
+        finishUpdate();
+        setUpdatesEnabled(true);
     }
+}
 
+// The search filter hides or shows the item afterwards.
+QTreeWidgetItem* UserFunctionListWidget::createItem(const UserFunction& function) const
+{
+    QString fname = function.name() + "(" + function.arguments().join(";")  + ")";
+
+    QStringList namesAndValues;
+    namesAndValues << fname << function.expression();
+
+    QTreeWidgetItem* item = new QTreeWidgetItem(namesAndValues);
+    item->setTextAlignment(0, Qt::AlignLeft | Qt::AlignVCenter);
+    item->setTextAlignment(1, Qt::AlignLeft | Qt::AlignVCenter);
+    return item;
+}
+
+void UserFunctionListWidget::finishUpdate()
+{
     m_userFunctions->resizeColumnToContents(0);
     m_userFunctions->resizeColumnToContents(1);
 
-    if (m_userFunctions->topLevelItemCount() > 0) {
+    if (m_filter.hasShownItems())
         m_noMatchLabel->hide();
-        m_userFunctions->sortItems(0, Qt::AscendingOrder);
-    } else {
+    else {
         m_noMatchLabel->setGeometry(m_userFunctions->geometry());
         m_noMatchLabel->show();
         m_noMatchLabel->raise();
     }
-
-    setUpdatesEnabled(true);
 }
 
 void UserFunctionListWidget::retranslateText()
@@ -191,7 +240,7 @@ void UserFunctionListWidget::deleteItem()
     if (!currentItem() || m_userFunctions->selectedItems().isEmpty())
         return;
     Evaluator::instance()->unsetUserFunction(getUserFunctionName(currentItem()));
-    updateList();
+    applyChanges();
 }
 
 void UserFunctionListWidget::deleteAllItems()
@@ -200,6 +249,15 @@ void UserFunctionListWidget::deleteAllItems()
     updateList();
 }
 
+void UserFunctionListWidget::applyFilter()
+{
+    m_filterTimer->stop();
+    setUpdatesEnabled(false);
+    m_filter.apply(m_searchFilter->text());
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
 void UserFunctionListWidget::triggerFilter()
 {
     m_filterTimer->stop();
@@ -228,3 +286,18 @@ void UserFunctionListWidget::keyPressEvent(QKeyEvent* event)
     }
     event->accept();
 }
+
+// Where an item goes in the list, sorted by name like sortItems() does.
+static int sortedIndex(const QTreeWidget* tree, const QString& name)
+{
+    int low = 0;
+    int high = tree->topLevelItemCount();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (tree->topLevelItem(middle)->text(0).localeAwareCompare(name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
@@ -20,6 +20,9 @@
 #ifndef GUI_USERFUNCTIONLISTWIDGET_H
 #define GUI_USERFUNCTIONLISTWIDGET_H
 
+#include "gui/treefilter.h"
+
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QWidget>
 
@@ -30,6 +33,7 @@ class QLineEdit;
 class QTimer;
 class QTreeWidget;
 class QTreeWidgetItem;
+class UserFunction;
 
 class UserFunctionListWidget : public QWidget
 {
@@ -48,6 +52,9 @@ signals:
 
 public slots:
     void updateList();
+    // Only updates the items of the functions changed since the last
+    // update, see Session::changesSince().
+    void applyChanges();
     void retranslateText();
 
 protected slots:
@@ -55,6 +62,7 @@ protected slots:
     void editItem();
     void deleteItem();
     void deleteAllItems();
+    void applyFilter();
     void triggerFilter();
 
 protected:
@@ -64,6 +72,9 @@ protected:
 private:
     Q_DISABLE_COPY(UserFunctionListWidget)
 
+    QTreeWidgetItem* createItem(const UserFunction&) const;
+    void finishUpdate();
+
     QTimer* m_filterTimer;
     QTreeWidget* m_userFunctions;
     QAction* m_insertAction;
@@ -73,6 +84,11 @@ private:
     QLabel* m_noMatchLabel;
     QLineEdit* m_searchFilter;
     QLabel* m_searchLabel;
+    TreeFilter m_filter;
+    // The items shown, by function name, as of the change count of the
+    // session.
+    QHash<QString, QTreeWidgetItem*> m_items;
+    quint64 m_changeCount;
 };
 
 #endif
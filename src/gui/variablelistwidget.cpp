@@ -21,6 +21,7 @@
 #include "gui/variablelistwidget.h"
 
 #include "core/evaluator.h"
+#include "core/session.h"
 #include "core/settings.h"
 #include "core/numberformatter.h"
 
@@ -35,6 +36,7 @@
 #include <QVBoxLayout>
 
 static QString formatValue(const Quantity &value);
+static int sortedIndex(const QTreeWidget*, const QString&);
 
 VariableListWidget::VariableListWidget(QWidget* parent)
     : QWidget(parent)
@@ -43,6 +45,8 @@ VariableListWidget::VariableListWidget(QWidget* parent)
     , m_noMatchLabel(new QLabel(m_variables))
     , m_searchFilter(new QLineEdit(this))
     , m_searchLabel(new QLabel(this))
+    , m_filter(m_variables, 2)
+    , m_changeCount(0)
 {
     m_filterTimer->setInterval(500);
     m_filterTimer->setSingleShot(true);
@@ -89,14 +93,12 @@ VariableListWidget::VariableListWidget(QWidget* parent)
 
     retranslateText();
 
-    connect(m_filterTimer, SIGNAL(timeout()), SLOT(updateList()));
+    connect(m_filterTimer, SIGNAL(timeout()), SLOT(applyFilter()));
     connect(m_searchFilter, SIGNAL(textChanged(const QString&)), SLOT(triggerFilter()));
     connect(m_variables, SIGNAL(itemActivated(QTreeWidgetItem*, int)), SLOT(activateItem()));
     connect(m_insertAction, SIGNAL(triggered()), SLOT(activateItem()));
     connect(m_deleteAction, SIGNAL(triggered()), SLOT(deleteItem()));
     connect(m_deleteAllAction, SIGNAL(triggered()), SLOT(deleteAllItems()));
-
-    updateList();
 }
 
 VariableListWidget::~VariableListWidget()
@@ -110,38 +112,84 @@ void VariableListWidget::updateList()
 
     m_filterTimer->stop();
     m_variables->clear();
-    QString term = m_searchFilter->text();
+    m_items.clear();
+    const Session* session = Evaluator::instance()->session();
+    m_changeCount = session ? session->changeCount() : 0;
     QList<Variable> variables = Evaluator::instance()->getUserDefinedVariables();
 
     for (int i = 0; i < variables.count(); ++i) {
-        QString varName = variables.at(i).identifier();
-
-        QStringList namesAndValues;
-        namesAndValues << varName << formatValue(variables.at(i).value());
-
-        if (term.isEmpty()
-            || namesAndValues.at(0).contains(term, Qt::CaseInsensitive)
-            || namesAndValues.at(1).contains(term, Qt::CaseInsensitive))
-        {
-            QTreeWidgetItem* item = new QTreeWidgetItem(m_variables, namesAndValues);
-            item->setTextAlignment(0, Qt::AlignLeft | Qt::AlignVCenter);
-            item->setTextAlignment(1, Qt::AlignLeft | Qt::AlignVCenter);
+        QTreeWidgetItem* item = createItem(variables.at(i));
+        m_variables->addTopLevelItem(item);
+        m_filter.add(item);
+        m_items.insert(variables.at(i).identifier(), item);
+    }
+    m_variables->sortItems(0, Qt::AscendingOrder);
+
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
+void VariableListWidget::applyChanges()
+{
+    const Session* session = Evaluator::instance()->session();
+    QList<Session::Change> changes;
+    if (!session || !session->changesSince(m_changeCount, changes)) {
+        updateList();
+        return;
+    }
+    m_changeCount = session->changeCount();
+
+    bool changed = false;
+    for (int i = 0; i < changes.count(); ++i) {
+        const Session::Change& change = changes.at(i);
+        if (change.subject != Session::Change::Variables)
+            continue;
+        if (!changed) {
+            setUpdatesEnabled(false);
+            changed = true;
         }
+        delete m_items.take(change.key);
+        const Variable* variable = session->findVariable(change.key);
+        if (change.kind == Session::Change::Removed || !variable
+            || variable->type() == Variable::BuiltIn)
+            continue;
+        QTreeWidgetItem* item = createItem(*variable);
+        m_variables->insertTopLevelItem(sortedIndex(m_variables, change.key), item);
+        m_filter.add(item);
+        m_items.insert(change.key, item);
+    }
+
+    if (changed) {
+        finishUpdate();
+        setUpdatesEnabled(true);
     }
+}
+
+// The value is only formatted here, the search filter hides or shows the
+// item afterwards.
+QTreeWidgetItem* VariableListWidget::createItem(const Variable& variable) const
+{
+    QStringList namesAndValues;
+    namesAndValues << variable.identifier() << formatValue(variable.value());
 
+    QTreeWidgetItem* item = new QTreeWidgetItem(namesAndValues);
+    item->setTextAlignment(0, Qt::AlignLeft | Qt::AlignVCenter);
+    item->setTextAlignment(1, Qt::AlignLeft | Qt::AlignVCenter);
+    return item;
+}
+
+void VariableListWidget::finishUpdate()
+{
     m_variables->resizeColumnToContents(0);
     m_variables->resizeColumnToContents(1);
 
-    if (m_variables->topLevelItemCount() > 0) {
+    if (m_filter.hasShownItems())
         m_noMatchLabel->hide();
-        m_variables->sortItems(0, Qt::AscendingOrder);
-    } else {
+    else {
         m_noMatchLabel->setGeometry(m_variables->geometry());
         m_noMatchLabel->show();
         m_noMatchLabel->raise();
     }
-
-    setUpdatesEnabled(true);
 }
 
 void VariableListWidget::retranslateText()
@@ -177,7 +225,7 @@ void VariableListWidget::deleteItem()
     if (!currentItem() || m_variables->selectedItems().isEmpty())
         return;
     Evaluator::instance()->unsetVariable(currentItem()->text(0));
-    updateList();
+    applyChanges();
 }
 
 void VariableListWidget::deleteAllItems()
@@ -186,6 +234,15 @@ void VariableListWidget::deleteAllItems()
     updateList();
 }
 
+void VariableListWidget::applyFilter()
+{
+    m_filterTimer->stop();
+    setUpdatesEnabled(false);
+    m_filter.apply(m_searchFilter->text());
+    finishUpdate();
+    setUpdatesEnabled(true);
+}
+
 void VariableListWidget::triggerFilter()
 {
     m_filterTimer->stop();
@@ -216,3 +273,18 @@ static QString formatValue(const Quantity& value)
 {
     return NumberFormatter::format(value);
 }
+
+// Where an item goes in the list, sorted by name like sortItems() does.
+static int sortedIndex(const QTreeWidget* tree, const QString& name)
+{
+    int low = 0;
+    int high = tree->topLevelItemCount();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (tree->topLevelItem(middle)->text(0).localeAwareCompare(name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
@@ -20,6 +20,9 @@
 #ifndef GUI_VARIABLELISTWIDGET_H
 #define GUI_VARIABLELISTWIDGET_H
 
+#include "gui/treefilter.h"
+
+#include <QHash>
 #include <QList>
 #include <QWidget>
 
@@ -47,12 +50,16 @@ signals:
 
 public slots:
     void updateList();
+    // Only updates the items of the variables changed since the last
+    // update, see Session::changesSince().
+    void applyChanges();
     void retranslateText();
 
 protected slots:
     void activateItem();
     void deleteItem();
     void deleteAllItems();
+    void applyFilter();
     void triggerFilter();
 
 protected:
@@ -62,6 +69,9 @@ protected:
 private:
     Q_DISABLE_COPY(VariableListWidget)
 
+    QTreeWidgetItem* createItem(const Variable&) const;
+    void finishUpdate();
+
     QTimer* m_filterTimer;
     QTreeWidget* m_variables;
     QAction* m_insertAction;
@@ -70,6 +80,10 @@ private:
     QLabel* m_noMatchLabel;
     QLineEdit* m_searchFilter;
     QLabel* m_searchLabel;
+    TreeFilter m_filter;
+    // The items shown, by identifier, as of the change count of the session.
+    QHash<QString, QTreeWidgetItem*> m_items;
+    quint64 m_changeCount;
 };
 
 #endif
@@ -17,22 +17,48 @@
 // the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
 // Boston, MA 02110-1301, USA.
 
+#include "core/startuptrace.h"
 #include "gui/mainwindow.h"
 
 #include <QCoreApplication>
 #include <QApplication>
+#include <QTimer>
+
+#include <cstring>
 
 int main(int argc, char* argv[])
 {
+    // --trace-startup[=FILE] is the same as SPEEDCRUNCH_TRACE_STARTUP.
+    for (int i = 1; i < argc; ++i) {
+        static const char option[] = "--trace-startup";
+        const size_t length = sizeof(option) - 1;
+        if (std::strncmp(argv[i], option, length) == 0
+            && (argv[i][length] == '\0' || argv[i][length] == '='))
+        {
+            StartupTrace::enable(argv[i][length] == '='
+                ? QString::fromLocal8Bit(argv[i] + length + 1)
+                : QString());
+        }
+    }
+
+    StartupTrace::mark("main");
     QApplication application(argc, argv);
+    StartupTrace::mark("application created");
 
     QCoreApplication::setApplicationName("SpeedCrunch");
     QCoreApplication::setOrganizationDomain("speedcrunch.org");
 
     MainWindow window;
-    window.show();
+    {
+        StartupTrace::Phase phase("show main window");
+        window.show();
+    }
+    if (StartupTrace::isEnabled())
+        QTimer::singleShot(0, [] { StartupTrace::mark("event loop running"); });
 
     application.connect(&application, SIGNAL(lastWindowClosed()), &application, SLOT(quit()));
 
-    return application.exec();
+    const int result = application.exec();
+    StartupTrace::finish();
+    return result;
 }
@@ -27,12 +27,22 @@
 #include "floatconvert.h"
 #include "hmath.h"
 
+#include <QDataStream>
 #include <QString>
 #include <QStringList>
 
 #include <stdlib.h>
 #include <string.h>
 
+#include <utility>
+
+// Wraps the result of a real-only computation. A NaN is copied to both
+// parts, so real and imag keep carrying the same error.
+static CNumber fromReal(const HNumber& x)
+{
+    return x.isNan() ? CNumber(x, x) : CNumber(x);
+}
+
 /**
  * Creates a new complex number.
  */
@@ -68,6 +78,15 @@ CNumber::CNumber(const CNumber& cn)
 {
 }
 
+/**
+ * Takes over the value of another complex number.
+ */
+CNumber::CNumber(CNumber&& cn)
+    : real(std::move(cn.real))
+    , imag(std::move(cn.imag))
+{
+}
+
 /**
  * Creates a new number from an integer value.
  */
@@ -171,6 +190,20 @@ CNumber CNumber::deSerialize(const QJsonObject& json)
     return result;
 }
 
+void CNumber::serialize(QDataStream& stream) const
+{
+    real.serialize(stream);
+    imag.serialize(stream);
+}
+
+CNumber CNumber::deSerialize(QDataStream& stream)
+{
+    CNumber result;
+    result.real = HNumber::deSerialize(stream);
+    result.imag = HNumber::deSerialize(stream);
+    return result;
+}
+
 /**
  * Returns a NaN (Not a Number) with error set to
  * passed parameter.
@@ -193,6 +226,15 @@ Error CNumber::error() const
     return real.error();
 }
 
+/**
+ * Releases the memory both parts do not need, see HNumber::squeeze().
+ */
+void CNumber::squeeze()
+{
+    real.squeeze();
+    imag.squeeze();
+}
+
 /**
  * Assigns from another complex number.
  */
@@ -203,6 +245,16 @@ CNumber& CNumber::operator=(const CNumber& cn)
     return *this;
 }
 
+/**
+ * Takes over the value of another complex number.
+ */
+CNumber& CNumber::operator=(CNumber&& cn)
+{
+    real = std::move(cn.real);
+    imag = std::move(cn.imag);
+    return *this;
+}
+
 /**
  * Adds another complex number.
  */
@@ -246,9 +298,19 @@ CNumber& CNumber::operator-=(const CNumber& num)
  */
 CNumber CNumber::operator*(const CNumber& num) const
 {
+    if (num.isReal()) {
+        if (isReal())
+            return fromReal(real * num.real);
+        return CNumber(real * num.real, imag * num.real);
+    }
+    if (isReal())
+        return CNumber(real * num.real, real * num.imag);
+    // Gauss's form with three multiplications needs three more additions.
+    // An addition costs about half a multiplication at working precision,
+    // so the four multiplications are kept. Each part is rounded once.
     CNumber result;
-    result.real = real*num.real - imag*num.imag;
-    result.imag = imag*num.real + real*num.imag;
+    result.real = HMath::sumOfProducts(real, num.real, -imag, num.imag);
+    result.imag = HMath::sumOfProducts(imag, num.real, real, num.imag);
     return result;
 }
 
@@ -278,11 +340,21 @@ CNumber CNumber::operator/(const CNumber& num) const
 {
     if (num.isZero())
         return CMath::nan(ZeroDivide);
-    else {
+    else if (num.isReal()) {
+        if (isReal())
+            return fromReal(real / num.real);
+        return CNumber(real / num.real, imag / num.real);
+    } else if (num.real.isZero()) {
+        // (a+bj)/dj = b/d - (a/d)j, without the norm.
+        return CNumber(imag / num.imag, -(real / num.imag));
+    } else {
         CNumber result;
-        HNumber divider = num.real*num.real + num.imag*num.imag;
-        result.real = (real*num.real + imag*num.imag) / divider;
-        result.imag = (imag*num.real - real*num.imag) / divider;
+        HNumber divider = HMath::sumOfProducts(num.real, num.real,
+                                               num.imag, num.imag);
+        result.real = HMath::sumOfProducts(real, num.real, imag, num.imag)
+                      / divider;
+        result.imag = HMath::sumOfProducts(imag, num.real, -real, num.imag)
+                      / divider;
         return result;
     }
 }
@@ -486,7 +558,7 @@ QString CMath::format(const CNumber& cn, CNumber::Format format)
  */
 CNumber CMath::abs(const CNumber& n)
 {
-    return HMath::sqrt(n.real * n.real + n.imag * n.imag);
+    return HMath::hypot(n.real, n.imag);
 }
 
 /*
@@ -502,12 +574,17 @@ CNumber CMath::conj(const CNumber& n)
  */
 CNumber CMath::sqrt(const CNumber& n)
 {
+    if (n.isReal())
+        return n.real.isNegative() ? CNumber(0, HMath::sqrt(-n.real))
+                                   : fromReal(HMath::sqrt(n.real));
+
     CNumber result;
     HNumber s = (n.imag.isPositive() || n.imag.isZero()) ? 1 : -1;
 
     // cf https://en.wikipedia.org/wiki/Square_root#Square_roots_of_negative_and_complex_numbers.
-    result.real =     HMath::sqrt((abs(n).real + n.real) / 2);
-    result.imag = s * HMath::sqrt((abs(n).real - n.real) / 2);
+    const HNumber norm = HMath::hypot(n.real, n.imag);
+    result.real =     HMath::sqrt((norm + n.real) / 2);
+    result.imag = s * HMath::sqrt((norm - n.real) / 2);
 
     return result;
 }
@@ -517,6 +594,9 @@ CNumber CMath::sqrt(const CNumber& n)
  */
 CNumber CMath::raise(const CNumber& n1, int n)
 {
+    // Zero keeps going through ln(), which reports the domain error.
+    if (n1.isReal() && !n1.real.isZero())
+        return fromReal(HMath::raise(n1.real, n));
     return CMath::exp(CMath::ln(n1) * n);
 }
 
@@ -527,6 +607,9 @@ CNumber CMath::raise(const CNumber& n1, const CNumber& n2)
 {
     if (n1.isZero() && (n2.real > 0))
       return CNumber(0);
+    // Negative bases may have complex roots, leave them to the complex path.
+    if (n1.isPositive() && n2.isReal())
+        return fromReal(HMath::raise(n1.real, n2.real));
     return CMath::exp(CMath::ln(n1) * n2);
 }
 
@@ -535,8 +618,12 @@ CNumber CMath::raise(const CNumber& n1, const CNumber& n2)
  */
 CNumber CMath::exp(const CNumber& x)
 {
+    if (x.isReal())
+        return fromReal(HMath::exp(x.real));
     HNumber abs = HMath::exp(x.real);
-    return CNumber(abs*HMath::cos(x.imag), abs*HMath::sin(x.imag));
+    HNumber s, c;
+    HMath::sincos(x.imag, s, c);
+    return CNumber(abs*c, abs*s);
 }
 
 /**
@@ -563,7 +650,7 @@ CNumber CMath::ln(const CNumber& x)
     }
     // Else, complex number
     else {
-        HNumber abs = CMath::abs(x).real;
+        HNumber abs = HMath::hypot(x.real, x.imag);
         result.real = HMath::ln(abs);
         // Principal Value logarithm
         // https://en.wikipedia.org/wiki/Complex_logarithm#Definition_of_principal_value
@@ -603,8 +690,13 @@ CNumber CMath::log(const CNumber& base, const CNumber& x)
  */
 CNumber CMath::sin(const CNumber& x)
 {
+    if (x.isReal())
+        return fromReal(HMath::sin(x.real));
     // cf. https://en.wikipedia.org/wiki/Sine#Sine_with_a_complex_argument.
-    return CNumber(HMath::sin(x.real) * HMath::cosh(x.imag), HMath::cos(x.real) * HMath::sinh(x.imag));
+    HNumber s, c, sh, ch;
+    HMath::sincos(x.real, s, c);
+    HMath::sinhcosh(x.imag, sh, ch);
+    return CNumber(s * ch, c * sh);
 }
 
 /**
@@ -612,8 +704,13 @@ CNumber CMath::sin(const CNumber& x)
  */
 CNumber CMath::cos(const CNumber& x)
 {
+    if (x.isReal())
+        return fromReal(HMath::cos(x.real));
     // Expanded using Wolfram Mathematica 9.0.
-    return CNumber(HMath::cos(x.real) * HMath::cosh(x.imag), -HMath::sin(x.real) * HMath::sinh(x.imag));
+    HNumber s, c, sh, ch;
+    HMath::sincos(x.real, s, c);
+    HMath::sinhcosh(x.imag, sh, ch);
+    return CNumber(c * ch, -s * sh);
 }
 
 /**
@@ -621,7 +718,12 @@ CNumber CMath::cos(const CNumber& x)
  */
 CNumber CMath::tan(const CNumber& x)
 {
-    return CMath::sin(x) / CMath::cos(x);
+    if (x.isReal())
+        return fromReal(HMath::tan(x.real));
+    HNumber s, c, sh, ch;
+    HMath::sincos(x.real, s, c);
+    HMath::sinhcosh(x.imag, sh, ch);
+    return CNumber(s * ch, c * sh) / CNumber(c * ch, -s * sh);
 }
 
 /**
@@ -629,6 +731,8 @@ CNumber CMath::tan(const CNumber& x)
  */
 CNumber CMath::sinh(const CNumber& x)
 {
+    if (x.isReal())
+        return fromReal(HMath::sinh(x.real));
     return (exp(x) - exp(-x)) / HNumber(2);
 }
 
@@ -637,6 +741,8 @@ CNumber CMath::sinh(const CNumber& x)
  */
 CNumber CMath::cosh(const CNumber& x)
 {
+    if (x.isReal())
+        return fromReal(HMath::cosh(x.real));
     return (exp(x) + exp(-x)) / HNumber(2);
 }
 
@@ -869,7 +975,9 @@ REAL_WRAPPER_CMATH_NUM(frac, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM(floor, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM(ceil, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM_NUM(gcd, OutOfDomain)
+REAL_WRAPPER_CMATH_NUM_NUM(lcm, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM_NUM(idiv, OutOfDomain)
+REAL_WRAPPER_CMATH_NUM_NUM_NUM(powmod, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM_INT(round, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM_INT(trunc, OutOfDomain)
 REAL_WRAPPER_CMATH_NUM(cbrt, OutOfDomain)
@@ -48,6 +48,7 @@ public:
     CNumber(const HNumber&);
     CNumber(const HNumber&, const HNumber&);
     CNumber(const CNumber&);
+    CNumber(CNumber&&);
     CNumber(int);
     CNumber(const char*);
     CNumber(const QJsonObject&);
@@ -64,11 +65,15 @@ public:
 
     void serialize(QJsonObject&) const;
     static CNumber deSerialize(const QJsonObject&);
+    void serialize(QDataStream&) const;
+    static CNumber deSerialize(QDataStream&);
 
     int toInt() const; // Removed, too problematic for complex numbers.
     Error error() const;
+    void squeeze();
 
     CNumber& operator=(const CNumber&);
+    CNumber& operator=(CNumber&&);
     CNumber operator+(const CNumber&) const;
     CNumber& operator+=(const CNumber&);
     CNumber& operator-=(const CNumber&);
@@ -139,7 +144,9 @@ public:
     static CNumber floor(const CNumber&);
     static CNumber ceil(const CNumber&);
     static CNumber gcd(const CNumber&, const CNumber&);
+    static CNumber lcm(const CNumber&, const CNumber&);
     static CNumber idiv(const CNumber&, const CNumber&);
+    static CNumber powmod(const CNumber&, const CNumber&, const CNumber&);
     static CNumber round(const CNumber&, int prec = 0);
     static CNumber trunc(const CNumber&, int prec = 0);
     static CNumber sqrt(const CNumber&);
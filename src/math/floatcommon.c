@@ -237,20 +237,29 @@ leadingdigits(
 
 int
 float_abscmp(
-  floatnum x,
-  floatnum y)
+  cfloatnum x,
+  cfloatnum y)
 {
-  signed char sx, sy;
-  int result;
-
-  sx = float_getsign(x);
-  sy = float_getsign(y);
-  float_abs(x);
-  float_abs(y);
-  result = float_cmp(x, y);
-  float_setsign(x, sx);
-  float_setsign(y, sy);
-  return result;
+  floatstruct ax, ay;
+  bc_struct bx, by;
+
+  /* the signs are dropped in shallow copies, the operands (often
+     constants) may be read by other threads at the same time */
+  ax = *x;
+  ay = *y;
+  if (x->significand != NULL)
+  {
+    bx = *x->significand;
+    ax.significand = &bx;
+  }
+  if (y->significand != NULL)
+  {
+    by = *y->significand;
+    ay.significand = &by;
+  }
+  float_abs(&ax);
+  float_abs(&ay);
+  return float_cmp(&ax, &ay);
 }
 
 int
@@ -404,7 +413,7 @@ static float _ipwr(float x, int exp){
     x = 1;
   while (e >>= 1){
     pwr *= pwr;
-    if ((exp & 1) != 0)
+    if ((e & 1) != 0)
       x *= pwr;
   }
   return exp < 0? 1/x : x;
@@ -72,7 +72,7 @@ char float_divi(floatnum quotient, cfloatnum dividend,
 
 /* convenience wrapper for float_cmp: compares the absolute value of
    both operands */
-int float_abscmp(floatnum x, floatnum y);
+int float_abscmp(cfloatnum x, cfloatnum y);
 
 /* convenience wrapper for float_div, returns 1/<x> */
 char float_reciprocal(floatnum x, int digits);
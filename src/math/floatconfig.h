@@ -130,6 +130,9 @@
 #  define MAXDIGITS 130
 #  define MATHPRECISION 130
 #  define LOGICRANGE 96
+#  define SERIESSPLITDIGITS 50
+#  define LNAGMDIGITS 60
+#  define EXPNEWTONDIGITS 50
 #endif
 
 #define MAXBITS_IN_EXP (sizeof(int)*8-2)
@@ -157,6 +160,34 @@
 
 #define EXPMIN (-EXPMAX - 1)
 
+/* the number of digits the constants of the math library (pi, ln 2 ...)
+   are stored with. The tables in floatconst.c cover the default
+   settings; if a build raises MATHPRECISION beyond them, the constants
+   are computed on first use instead (see floatconstcalc.c) */
+#ifndef CONSTPRECISION
+# define CONSTPRECISION \
+  (MATHPRECISION + 14 < MAXDIGITS? MATHPRECISION + 14 : MAXDIGITS)
+#endif
+
+/* from this precision on, the series of floatseries.c are summed up by
+   binary splitting instead of term by term */
+#ifndef SERIESSPLITDIGITS
+# define SERIESSPLITDIGITS 400
+#endif
+
+/* from this precision on, ln is evaluated by the arithmetic-geometric
+   mean. With the square root of number.c costing some 8
+   multiplications, the AGM catches up with the series at about
+   16000 digits only. */
+#ifndef LNAGMDIGITS
+# define LNAGMDIGITS 16000
+#endif
+
+/* from this precision on, exp is evaluated by a Newton iteration on ln */
+#ifndef EXPNEWTONDIGITS
+# define EXPNEWTONDIGITS 500
+#endif
+
 #define EXPZERO ((int)((-1) << (sizeof(int)*8-1)))
 #define EXPNAN ((int)(~EXPZERO))
 
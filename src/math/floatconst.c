@@ -30,6 +30,16 @@
 *************************************************************************/
 
 #include "floatconst.h"
+#include "floatconstcalc.h"
+#include "floatcommon.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
 
 static char sExp[] =
 "2.7182818284""5904523536""0287471352""6624977572""4709369995"
@@ -281,12 +291,457 @@ floatstruct c2DivSqrtPi;
 floatstruct cMinus0_4;
 floatstruct cUnsignedBound;
 
-int erfcdigits = 0;
-floatstruct erfccoeff[MAXERFCIDX];
-floatstruct erfcalpha;
-floatstruct erfcalphasqr;
-floatstruct erfct2;
-floatstruct erfct3;
+/* Only the small integers and cUnsignedBound are set up by
+   floatmath_init. Every other group of constants is parsed the first
+   time a function asks for it via floatmath_needxxx. A group is built
+   under a lock, and its ready flag is published with release semantics
+   afterwards, so that the common path is a single acquire load. */
+
+#define GROUP_LOGS      0
+#define GROUP_PI        1
+#define GROUP_BERNOULLI 2
+#define GROUPCOUNT      3
+
+static int groupready[GROUPCOUNT];
+
+#if defined(_WIN32)
+static SRWLOCK grouplock = SRWLOCK_INIT;
+# define _lockgroups() AcquireSRWLockExclusive(&grouplock)
+# define _unlockgroups() ReleaseSRWLockExclusive(&grouplock)
+#else
+static pthread_mutex_t grouplock = PTHREAD_MUTEX_INITIALIZER;
+# define _lockgroups() pthread_mutex_lock(&grouplock)
+# define _unlockgroups() pthread_mutex_unlock(&grouplock)
+#endif
+
+#if defined(_MSC_VER)
+/* MSVC gives volatile accesses acquire/release semantics */
+# define _isready(group) (*(volatile int*)&groupready[group])
+# define _setready(group, value) (*(volatile int*)&groupready[group] = (value))
+#else
+# define _isready(group) __atomic_load_n(&groupready[group], __ATOMIC_ACQUIRE)
+# define _setready(group, value) \
+  __atomic_store_n(&groupready[group], (value), __ATOMIC_RELEASE)
+#endif
+
+/* the number of significant digits in a table entry */
+static int
+_tabledigits(
+  const char* value)
+{
+  int result;
+
+  for (; *value == '0' || *value == '.'; ++value);
+  for (result = 0; *value != '\0'; ++value)
+    if (*value != '.')
+      ++result;
+  return result;
+}
+
+/* tables too short for CONSTPRECISION are replaced by a computed value */
+static void
+_setconst(
+  floatnum c,
+  const char* value,
+  constid which)
+{
+  if (_tabledigits(value) >= CONSTPRECISION)
+    float_setscientific(c, value, NULLTERMINATED);
+  else
+    floatconst_value(c, which, CONSTPRECISION);
+}
+
+static void
+_buildlogs()
+{
+  _setconst(&cExp, sExp, CONST_E);
+  _setconst(&cLn2, sLn2, CONST_LN2);
+  _setconst(&cLn3, sLn3, CONST_LN3);
+  _setconst(&cLn7, sLn7, CONST_LN7);
+  _setconst(&cLn10, sLn10, CONST_LN10);
+  _setconst(&cPhi, sPhi, CONST_PHI);
+}
+
+static void
+_buildpi()
+{
+  _setconst(&cPi, sPi, CONST_PI);
+  _setconst(&cPiDiv2, sPiDiv2, CONST_PIDIV2);
+  _setconst(&cPiDiv4, sPiDiv4, CONST_PIDIV4);
+  _setconst(&c2Pi, s2Pi, CONST_2PI);
+  _setconst(&c1DivPi, s1DivPi, CONST_1DIVPI);
+  _setconst(&cSqrtPi, sSqrtPi, CONST_SQRTPI);
+  _setconst(&cLnSqrt2PiMinusHalf, sLnSqrt2PiMinusHalf,
+            CONST_LNSQRT2PIMINUSHALF);
+  _setconst(&c1DivSqrtPi, s1DivSqrtPi, CONST_1DIVSQRTPI);
+  _setconst(&c2DivSqrtPi, s2DivSqrtPi, CONST_2DIVSQRTPI);
+}
+
+static void
+_buildbernoulli()
+{
+  int i;
+
+  for (i = -1; ++i < MAXBERNOULLIIDX;)
+  {
+    float_setscientific(&cBernoulliNum[i], sBernoulli[2*i], NULLTERMINATED);
+    float_setscientific(&cBernoulliDen[i], sBernoulli[2*i+1], NULLTERMINATED);
+  }
+}
+
+static void
+_needgroup(
+  int group)
+{
+  int save;
+  Error err;
+
+  if (_isready(group))
+    return;
+  _lockgroups();
+  if (!groupready[group])
+  {
+    /* building a group must not leave traces in the
+       caller's precision or error state */
+    save = maxdigits;
+    maxdigits = MAXDIGITS;
+    err = float_geterror();
+    switch (group)
+    {
+    case GROUP_LOGS: _buildlogs(); break;
+    case GROUP_PI: _buildpi(); break;
+    case GROUP_BERNOULLI: _buildbernoulli(); break;
+    }
+    float_geterror();
+    float_seterror(err);
+    maxdigits = save;
+    _setready(group, 1);
+  }
+  _unlockgroups();
+}
+
+void
+floatmath_needlogs()
+{
+  _needgroup(GROUP_LOGS);
+}
+
+void
+floatmath_needpi()
+{
+  _needgroup(GROUP_PI);
+}
+
+void
+floatmath_needbernoulli()
+{
+  _needgroup(GROUP_BERNOULLI);
+}
+
+/* 1/(2pi) for the argument reduction in floattrig.c, kept as the
+   digits after the decimal point. It grows on demand, at least
+   doubling its length, and lives until floatmath_exit */
+static bc_num invtwopi = NULL;
+static int invtwopiscale = 0;
+
+bc_num
+floatmath_invtwopidigits(
+  int first,
+  int count)
+{
+  bc_num result, two;
+  bc_num v;
+  unsigned char* digits;
+  int scale;
+
+  _lockgroups();
+  scale = first + count - 1;
+  if (scale > invtwopiscale)
+  {
+    if (scale < 2*invtwopiscale)
+      scale = 2*invtwopiscale;
+    v = floatconst_bcvalue(CONST_1DIVPI, scale + 1);
+    bc_init_num(&two);
+    bc_int2num(&two, 2);
+    if (invtwopi == NULL)
+      bc_init_num(&invtwopi);
+    bc_divide(v, two, &invtwopi, scale);
+    invtwopiscale = scale;
+    bc_free_num(&two);
+    bc_free_num(&v);
+  }
+  digits = (unsigned char*)invtwopi->n_value + invtwopi->n_len + first - 1;
+  for (; count > 1 && *digits == 0; --count)
+    ++digits;
+  result = bc_new_num(count, 0);
+  memcpy(result->n_value, digits, count);
+  _unlockgroups();
+  return result;
+}
+
+/* the coefficients B(2i)/(2i(2i-1)) of the asymptotic series of the
+   Binet function in floatgamma.c. Each one is kept with the highest
+   precision asked for so far. The Bernoulli numbers beyond the table
+   follow from the tangent numbers T(i):
+     B(2i) = (-1)^(i-1) 2i T(i) / (4^i (4^i - 1)),
+   which are integers and are cached exactly */
+static floatstruct* binetcoef = NULL;
+static int* binetcoefdigits = NULL;
+static int binetcoefcount = 0;
+static bc_num* tangents = NULL;
+static int tangentcount = 0;
+
+/* T(1) .. T(n) by the algorithm of Brent and Harvey, which gets along
+   with additions and multiplications by small integers */
+static void
+_calctangents(
+  int n)
+{
+  bc_num f, tmp;
+  int j, k;
+
+  for (k = -1; ++k < tangentcount;)
+    bc_free_num(&tangents[k]);
+  free(tangents);
+  tangents = (bc_num*)malloc(n * sizeof(bc_num));
+  bc_init_num(&f);
+  bc_init_num(&tmp);
+  tangents[0] = bc_copy_num(_one_);
+  for (k = 0; ++k < n;)
+  {
+    bc_int2num(&f, k);
+    bc_init_num(&tangents[k]);
+    bc_multiply(tangents[k-1], f, &tangents[k], 0);
+  }
+  /* T(j) = (j-k) T(j-1) + (j-k+2) T(j), 1-based */
+  for (k = 1; ++k <= n;)
+    for (j = k - 1; ++j <= n;)
+    {
+      bc_int2num(&f, j - k);
+      bc_multiply(tangents[j-2], f, &tmp, 0);
+      bc_int2num(&f, j - k + 2);
+      bc_multiply(tangents[j-1], f, &tangents[j-1], 0);
+      bc_add(tangents[j-1], tmp, &tangents[j-1], 0);
+    }
+  tangentcount = n;
+  bc_free_num(&f);
+  bc_free_num(&tmp);
+}
+
+/* the leading <digits> digits of the integer <n> */
+static void
+_bcinttofloat(
+  floatnum x,
+  bc_num n,
+  int digits)
+{
+  char* buf;
+  int lg, i;
+
+  lg = n->n_len < digits? n->n_len : digits;
+  buf = (char*)malloc(lg);
+  for (i = -1; ++i < lg;)
+    buf[i] = n->n_value[i] + '0';
+  float_setsignificand(x, NULL, buf, lg);
+  float_setexponent(x, n->n_len - 1);
+  free(buf);
+}
+
+static void
+_calcbinetcoef(
+  floatnum dest,
+  int i,
+  int digits)
+{
+  floatstruct tmp;
+  bc_num pow4, den, f;
+
+  float_create(&tmp);
+  if (i <= MAXBERNOULLIIDX)
+  {
+    float_muli(&tmp, &cBernoulliDen[i-1], 2*i*(2*i-1), EXACT);
+    float_div(dest, &cBernoulliNum[i-1], &tmp, digits);
+  }
+  else
+  {
+    if (i > tangentcount)
+      _calctangents(i < 2*tangentcount? 2*tangentcount : i);
+    bc_init_num(&f);
+    bc_init_num(&pow4);
+    bc_init_num(&den);
+    bc_int2num(&f, 4);
+    bc_int2num(&den, i);
+    bc_raise(f, den, &pow4, 0);
+    bc_sub(pow4, _one_, &den, 0);
+    bc_multiply(den, pow4, &den, 0);
+    bc_int2num(&f, 2*i - 1);
+    bc_multiply(den, f, &den, 0);
+    _bcinttofloat(dest, tangents[i-1], digits + 2);
+    _bcinttofloat(&tmp, den, digits + 2);
+    float_div(dest, dest, &tmp, digits);
+    if ((i & 1) == 0)
+      float_neg(dest);
+    bc_free_num(&f);
+    bc_free_num(&pow4);
+    bc_free_num(&den);
+  }
+  float_free(&tmp);
+}
+
+void
+floatmath_binetcoef(
+  floatnum dest,
+  int i,
+  int digits)
+{
+  int save, n;
+  Error err;
+
+  floatmath_needbernoulli();
+  _lockgroups();
+  if (i > binetcoefcount)
+  {
+    n = i < 2*binetcoefcount? 2*binetcoefcount : i;
+    binetcoef = (floatstruct*)realloc(binetcoef, n * sizeof(floatstruct));
+    binetcoefdigits = (int*)realloc(binetcoefdigits, n * sizeof(int));
+    for (; binetcoefcount < n; ++binetcoefcount)
+    {
+      float_create(&binetcoef[binetcoefcount]);
+      binetcoefdigits[binetcoefcount] = 0;
+    }
+  }
+  if (binetcoefdigits[i-1] < digits)
+  {
+    save = maxdigits;
+    maxdigits = MAXDIGITS;
+    err = float_geterror();
+    _calcbinetcoef(&binetcoef[i-1], i, digits);
+    binetcoefdigits[i-1] = digits;
+    float_geterror();
+    float_seterror(err);
+    maxdigits = save;
+  }
+  float_copy(dest, &binetcoef[i-1], digits);
+  _unlockgroups();
+}
+
+/* the erfc coefficient sets in use, at most one per precision.
+   When the table is full, the set used least recently and not in use
+   is dropped. A set that finds no slot is only handed to its builder,
+   and freed on release */
+static erfccoefs* erfcsets[ERFCSETCOUNT];
+static unsigned erfcclock = 0;
+
+static void
+_freeerfcset(
+  erfccoefs* set)
+{
+  int i;
+
+  float_free(&set->alpha);
+  float_free(&set->alphasqr);
+  for (i = -1; ++i < set->count;)
+    float_free(&set->coeff[i]);
+  free(set);
+}
+
+erfccoefs*
+floatmath_lookuperfc(
+  int digits)
+{
+  erfccoefs* result;
+  int i;
+
+  result = NULL;
+  _lockgroups();
+  for (i = -1; result == NULL && ++i < ERFCSETCOUNT;)
+    if (erfcsets[i] != NULL && erfcsets[i]->digits == digits)
+    {
+      result = erfcsets[i];
+      ++result->users;
+      result->lastuse = ++erfcclock;
+    }
+  _unlockgroups();
+  return result;
+}
+
+erfccoefs*
+floatmath_publisherfc(
+  erfccoefs* set)
+{
+  erfccoefs* result;
+  int i, slot;
+
+  result = set;
+  slot = -1;
+  set->users = 1;
+  set->cached = 0;
+  _lockgroups();
+  for (i = -1; result == set && ++i < ERFCSETCOUNT;)
+    if (erfcsets[i] != NULL && erfcsets[i]->digits == set->digits)
+      /* another thread was faster */
+      result = erfcsets[i];
+  if (result == set)
+  {
+    for (i = -1; slot < 0 && ++i < ERFCSETCOUNT;)
+      if (erfcsets[i] == NULL)
+        slot = i;
+    if (slot < 0)
+      /* evict the least recently used set no one holds */
+      for (i = -1; ++i < ERFCSETCOUNT;)
+        if (erfcsets[i]->users == 0
+            && (slot < 0 || erfcsets[i]->lastuse < erfcsets[slot]->lastuse))
+          slot = i;
+    if (slot >= 0)
+    {
+      if (erfcsets[slot] != NULL)
+        _freeerfcset(erfcsets[slot]);
+      erfcsets[slot] = set;
+      set->cached = 1;
+    }
+  }
+  else
+    ++result->users;
+  result->lastuse = ++erfcclock;
+  _unlockgroups();
+  if (result != set)
+    _freeerfcset(set);
+  return result;
+}
+
+void
+floatmath_releaseerfc(
+  erfccoefs* set)
+{
+  _lockgroups();
+  if (--set->users == 0 && !set->cached)
+    _freeerfcset(set);
+  _unlockgroups();
+}
+
+void
+floatmath_clearerfc()
+{
+  int i;
+
+  _lockgroups();
+  for (i = -1; ++i < ERFCSETCOUNT;)
+    if (erfcsets[i] != NULL && erfcsets[i]->users == 0)
+    {
+      _freeerfcset(erfcsets[i]);
+      erfcsets[i] = NULL;
+    }
+  _unlockgroups();
+}
+
+void
+floatmath_warmup()
+{
+  int i;
+
+  for (i = -1; ++i < GROUPCOUNT;)
+    _needgroup(i);
+}
 
 void
 floatmath_init()
@@ -311,56 +766,33 @@ floatmath_init()
   float_setinteger(&cMinus20, -20);
   float_create(&c1Div2);
   float_setscientific(&c1Div2, ".5", NULLTERMINATED);
+  float_create(&cMinus0_4);
+  float_setscientific(&cMinus0_4, "-.4", NULLTERMINATED);
+  float_create(&cUnsignedBound);
+  float_copy(&cUnsignedBound, &c1, EXACT);
+  for (i = -1; ++i < 2*(int)sizeof(unsigned);)
+    float_mul(&cUnsignedBound, &c16, &cUnsignedBound, EXACT);
+  /* the lazy groups start as NaN until they are asked for */
   float_create(&cExp);
-  float_setscientific(&cExp, sExp, NULLTERMINATED);
   float_create(&cLn2);
-  float_setscientific(&cLn2, sLn2, NULLTERMINATED);
   float_create(&cLn3);
-  float_setscientific(&cLn3, sLn3, NULLTERMINATED);
   float_create(&cLn7);
-  float_setscientific(&cLn7, sLn7, NULLTERMINATED);
   float_create(&cLn10);
-  float_setscientific(&cLn10, sLn10, NULLTERMINATED);
   float_create(&cPhi);
-  float_setscientific(&cPhi, sPhi, NULLTERMINATED);
   float_create(&cPi);
-  float_setscientific(&cPi, sPi, NULLTERMINATED);
   float_create(&cPiDiv2);
-  float_setscientific(&cPiDiv2, sPiDiv2, NULLTERMINATED);
   float_create(&cPiDiv4);
-  float_setscientific(&cPiDiv4, sPiDiv4, NULLTERMINATED);
   float_create(&c2Pi);
-  float_setscientific(&c2Pi, s2Pi, NULLTERMINATED);
   float_create(&c1DivPi);
-  float_setscientific(&c1DivPi, s1DivPi, NULLTERMINATED);
   float_create(&cSqrtPi);
-  float_setscientific(&cSqrtPi, sSqrtPi, NULLTERMINATED);
   float_create(&cLnSqrt2PiMinusHalf);
-  float_setscientific(&cLnSqrt2PiMinusHalf, sLnSqrt2PiMinusHalf,
-                      NULLTERMINATED);
   float_create(&c1DivSqrtPi);
-  float_setscientific(&c1DivSqrtPi, s1DivSqrtPi, NULLTERMINATED);
   float_create(&c2DivSqrtPi);
-  float_setscientific(&c2DivSqrtPi, s2DivSqrtPi, NULLTERMINATED);
-  float_create(&cMinus0_4);
-  float_setscientific(&cMinus0_4, "-.4", NULLTERMINATED);
   for (i = -1; ++i < MAXBERNOULLIIDX;)
   {
     float_create(&cBernoulliNum[i]);
     float_create(&cBernoulliDen[i]);
-    float_setscientific(&cBernoulliNum[i], sBernoulli[2*i], NULLTERMINATED);
-    float_setscientific(&cBernoulliDen[i], sBernoulli[2*i+1], NULLTERMINATED);
   }
-  float_create(&cUnsignedBound);
-  float_copy(&cUnsignedBound, &c1, EXACT);
-  for (i = -1; ++i < 2*(int)sizeof(unsigned);)
-    float_mul(&cUnsignedBound, &c16, &cUnsignedBound, EXACT);
-  for (i = -1; ++i < MAXERFCIDX;)
-    float_create(&erfccoeff[i]);
-  float_create(&erfcalpha);
-  float_create(&erfcalphasqr);
-  float_create(&erfct2);
-  float_create(&erfct3);
   float_setprecision(save);
 }
 
@@ -399,10 +831,36 @@ floatmath_exit()
     float_free(&cBernoulliDen[i]);
   }
   float_free(&cUnsignedBound);
-  for (i = -1; ++i < MAXERFCIDX;)
-    float_free(&erfccoeff[i]);
-  float_free(&erfcalpha);
-  float_free(&erfcalphasqr);
-  float_free(&erfct2);
-  float_free(&erfct3);
+  floatconst_clearcache();
+  _lockgroups();
+  if (invtwopi != NULL)
+    bc_free_num(&invtwopi);
+  invtwopi = NULL;
+  invtwopiscale = 0;
+  for (i = -1; ++i < binetcoefcount;)
+    float_free(&binetcoef[i]);
+  free(binetcoef);
+  free(binetcoefdigits);
+  binetcoef = NULL;
+  binetcoefdigits = NULL;
+  binetcoefcount = 0;
+  for (i = -1; ++i < tangentcount;)
+    bc_free_num(&tangents[i]);
+  free(tangents);
+  tangents = NULL;
+  tangentcount = 0;
+  for (i = -1; ++i < ERFCSETCOUNT;)
+    if (erfcsets[i] != NULL)
+    {
+      if (erfcsets[i]->users == 0)
+        _freeerfcset(erfcsets[i]);
+      else
+        erfcsets[i]->cached = 0;
+      erfcsets[i] = NULL;
+    }
+  _unlockgroups();
+  _lockgroups();
+  for (i = -1; ++i < GROUPCOUNT;)
+    _setready(i, 0);
+  _unlockgroups();
 }
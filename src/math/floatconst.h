@@ -36,6 +36,7 @@
 
 #define MAXBERNOULLIIDX 68
 #define MAXERFCIDX 80
+#define ERFCSETCOUNT 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -68,16 +69,58 @@ extern floatstruct cBernoulliNum[68];
 extern floatstruct cBernoulliDen[68];
 extern floatstruct cUnsignedBound;
 
-extern int erfcdigits;
-extern floatstruct erfccoeff[MAXERFCIDX];
-extern floatstruct erfcalpha;
-extern floatstruct erfcalphasqr;
-extern floatstruct erfct2;
-extern floatstruct erfct3;
+/* the coefficients of erfcsum for one precision: alpha and
+   exp(-k*k*alpha*alpha), k = 1 .. count. The numbers never change
+   once a set is published, so several threads may read them at once */
+typedef struct
+{
+  int digits;
+  int count;
+  floatstruct alpha;
+  floatstruct alphasqr;
+  floatstruct coeff[MAXERFCIDX];
+  /* bookkeeping of the cache */
+  int users;
+  int cached;
+  unsigned lastuse;
+} erfccoefs;
 
 void floatmath_init();
 void floatmath_exit();
 
+/* the groups of constants not set up by floatmath_init. Any
+   function using one of them calls the matching floatmath_needxxx
+   first; floatmath_warmup builds them all at once */
+void floatmath_needlogs();     /* cExp, cPhi, cLn2, cLn3, cLn7, cLn10 */
+void floatmath_needpi();       /* cPi and the constants derived from it */
+void floatmath_needbernoulli();/* cBernoulliNum, cBernoulliDen */
+void floatmath_warmup();
+
+/* returns the integer made of the digits <first> .. <first>+<count>-1
+   after the decimal point of 1/(2pi) (leading zeros dropped). The
+   digits are computed on demand and cached; the caller owns the
+   result */
+bc_num floatmath_invtwopidigits(int first, int count);
+
+/* sets <dest> to B(2i)/(2i(2i-1)), the coefficient of the i-th term
+   (i >= 1) of the asymptotic Binet series, rounded to <digits>
+   significant digits. The coefficients are cached and computed on
+   demand, there is no limit on i */
+void floatmath_binetcoef(floatnum dest, int i, int digits);
+
+/* the cache of erfc coefficient sets, keyed by precision.
+   floatmath_lookuperfc returns the set for <digits>, or NULL if there
+   is none. Otherwise the caller builds one, and hands it to
+   floatmath_publisherfc, which returns the set to use: <set> itself,
+   or one for the same precision another thread published meanwhile.
+   Either way, the caller owns a reference to the result, which it
+   returns with floatmath_releaseerfc. floatmath_clearerfc drops all
+   sets not in use */
+erfccoefs* floatmath_lookuperfc(int digits);
+erfccoefs* floatmath_publisherfc(erfccoefs* set);
+void floatmath_releaseerfc(erfccoefs* set);
+void floatmath_clearerfc();
+
 #ifdef __cplusplus
 }
 #endif
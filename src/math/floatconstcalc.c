@@ -0,0 +1,522 @@
+/* floatconstcalc.c: computing the mathematical constants to any precision */
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License , or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; see the file COPYING.  If not, write to:
+
+      The Free Software Foundation, Inc.
+      59 Temple Place, Suite 330
+      Boston, MA 02111-1307 USA.
+
+*************************************************************************/
+
+/* The tables in floatconst.c cover the default MATHPRECISION. This
+   module computes the constants to any number of digits instead, working
+   on bc_num directly, since the floatnum operations stop at MAXDIGITS.
+
+   The series are summed by binary splitting: the terms of a range are
+   combined into a few big integers, so that there is a single division
+   at the end, and the cost is dominated by a handful of multiplications
+   of balanced operands.
+
+   pi     Chudnovsky, about 14 digits per term
+   e      sum of 1/k!
+   ln p   Machin-like formulas for p = 2, 3, 5, 7 in atanh(1/251),
+          atanh(1/449), atanh(1/4801) and atanh(1/8749)
+   phi    (1 + sqrt 5) / 2
+*/
+
+#include "floatconstcalc.h"
+#include "floatnum.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* digits computed beyond the requested scale, covering the truncation
+   errors of the final combination of series */
+#define GUARDDIGITS 10
+
+typedef struct {
+  bc_num value;
+  int scale;
+} t_constcache;
+
+static t_constcache cache[CONSTCOUNT];
+
+static bc_num
+_bcint(
+  int value)
+{
+  bc_num result;
+
+  bc_init_num(&result);
+  bc_int2num(&result, value);
+  return result;
+}
+
+/* a copy of <x> cut down to <scale> digits after the decimal point */
+static bc_num
+_truncate(
+  bc_num x,
+  int scale)
+{
+  bc_num result;
+
+  if (scale >= x->n_scale)
+    return bc_copy_num(x);
+  result = bc_new_num(x->n_len, scale);
+  result->n_sign = x->n_sign;
+  memcpy(result->n_value, x->n_value, x->n_len + scale);
+  return result;
+}
+
+static void
+_store(
+  constid which,
+  bc_num value,
+  int scale)
+{
+  bc_free_num(&cache[which].value);
+  cache[which].value = value;
+  cache[which].scale = scale;
+}
+
+/*************************   pi   *************************/
+
+/* P, Q and T of the Chudnovsky series for the terms n1 <= k < n2:
+   pi = 426880 sqrt(10005) Q(0,n) / T(0,n) */
+static void
+_chudnovsky(
+  int n1,
+  int n2,
+  bc_num c3div24,
+  bc_num* P,
+  bc_num* Q,
+  bc_num* T)
+{
+  bc_num P2, Q2, T2, tmp;
+  int m;
+
+  if (n2 - n1 == 1)
+  {
+    bc_init_num(Q);
+    bc_init_num(T);
+    if (n1 == 0)
+    {
+      *P = _bcint(1);
+      bc_int2num(Q, 1);
+    }
+    else
+    {
+      /* p(k) = -(6k-5)(2k-1)(6k-1), q(k) = k^3 640320^3/24 */
+      *P = _bcint(-(6*n1-5));
+      tmp = _bcint(2*n1-1);
+      bc_multiply(*P, tmp, P, 0);
+      bc_free_num(&tmp);
+      tmp = _bcint(6*n1-1);
+      bc_multiply(*P, tmp, P, 0);
+      bc_free_num(&tmp);
+      tmp = _bcint(n1);
+      bc_multiply(tmp, tmp, Q, 0);
+      bc_multiply(*Q, tmp, Q, 0);
+      bc_multiply(*Q, c3div24, Q, 0);
+      bc_free_num(&tmp);
+    }
+    /* a(k) = 13591409 + 545140134k */
+    tmp = _bcint(545140134);
+    T2 = _bcint(n1);
+    bc_multiply(tmp, T2, T, 0);
+    bc_free_num(&tmp);
+    bc_free_num(&T2);
+    tmp = _bcint(13591409);
+    bc_add(*T, tmp, T, 0);
+    bc_free_num(&tmp);
+    bc_multiply(*T, *P, T, 0);
+    return;
+  }
+  m = (n1 + n2) / 2;
+  _chudnovsky(n1, m, c3div24, P, Q, T);
+  _chudnovsky(m, n2, c3div24, &P2, &Q2, &T2);
+  /* T = T1 Q2 + P1 T2 */
+  bc_init_num(&tmp);
+  bc_multiply(*T, Q2, &tmp, 0);
+  bc_multiply(*P, T2, T, 0);
+  bc_add(tmp, *T, T, 0);
+  bc_multiply(*P, P2, P, 0);
+  bc_multiply(*Q, Q2, Q, 0);
+  bc_free_num(&tmp);
+  bc_free_num(&P2);
+  bc_free_num(&Q2);
+  bc_free_num(&T2);
+}
+
+static bc_num
+_calcpi(
+  int scale)
+{
+  bc_num P, Q, T, c3div24, root, result;
+
+  bc_init_num(&c3div24);
+  bc_str2num(&c3div24, "10939058860032000", 0);
+  _chudnovsky(0, scale / 14 + 2, c3div24, &P, &Q, &T);
+  root = _bcint(10005);
+  bc_sqrt(&root, scale);
+  bc_multiply(Q, root, &Q, scale);
+  bc_free_num(&root);
+  root = _bcint(426880);
+  bc_multiply(Q, root, &Q, scale);
+  bc_init_num(&result);
+  bc_divide(Q, T, &result, scale);
+  bc_free_num(&root);
+  bc_free_num(&c3div24);
+  bc_free_num(&P);
+  bc_free_num(&Q);
+  bc_free_num(&T);
+  return result;
+}
+
+/*************************   e   *************************/
+
+/* Q and T of sum 1/k! for n1 <= k < n2, so that
+   e = T(0,n) / Q(0,n) */
+static void
+_expsplit(
+  int n1,
+  int n2,
+  bc_num* Q,
+  bc_num* T)
+{
+  bc_num Q2, T2;
+  int m;
+
+  if (n2 - n1 == 1)
+  {
+    *Q = _bcint(n1 == 0? 1 : n1);
+    *T = _bcint(1);
+    return;
+  }
+  m = (n1 + n2) / 2;
+  _expsplit(n1, m, Q, T);
+  _expsplit(m, n2, &Q2, &T2);
+  /* T = T1 Q2 + T2 */
+  bc_multiply(*T, Q2, T, 0);
+  bc_add(*T, T2, T, 0);
+  bc_multiply(*Q, Q2, Q, 0);
+  bc_free_num(&Q2);
+  bc_free_num(&T2);
+}
+
+static bc_num
+_calce(
+  int scale)
+{
+  bc_num Q, T, result;
+  double lgfactorial;
+  int n;
+
+  /* the remainder of the series after n terms is below 2/n! */
+  lgfactorial = 0;
+  for (n = 1; lgfactorial < scale + 1; ++n)
+    lgfactorial += log10((double)n);
+  _expsplit(0, n + 1, &Q, &T);
+  bc_init_num(&result);
+  bc_divide(T, Q, &result, scale);
+  bc_free_num(&Q);
+  bc_free_num(&T);
+  return result;
+}
+
+/*************************   ln   *************************/
+
+/* Q, B and T of atanh(1/x) = sum 1/((2k+1) x^(2k+1)) for
+   n1 <= k < n2, so that atanh(1/x) = T(0,n) / (B(0,n) Q(0,n)) */
+static void
+_atanhsplit(
+  int x,
+  int n1,
+  int n2,
+  bc_num* Q,
+  bc_num* B,
+  bc_num* T)
+{
+  bc_num Q2, B2, T2, tmp;
+  int m;
+
+  if (n2 - n1 == 1)
+  {
+    *Q = _bcint(n1 == 0? x : x*x);
+    *B = _bcint(2*n1+1);
+    *T = _bcint(1);
+    return;
+  }
+  m = (n1 + n2) / 2;
+  _atanhsplit(x, n1, m, Q, B, T);
+  _atanhsplit(x, m, n2, &Q2, &B2, &T2);
+  /* T = T1 B2 Q2 + B1 T2 */
+  bc_init_num(&tmp);
+  bc_multiply(B2, Q2, &tmp, 0);
+  bc_multiply(*T, tmp, T, 0);
+  bc_multiply(*B, T2, &tmp, 0);
+  bc_add(*T, tmp, T, 0);
+  bc_multiply(*B, B2, B, 0);
+  bc_multiply(*Q, Q2, Q, 0);
+  bc_free_num(&tmp);
+  bc_free_num(&Q2);
+  bc_free_num(&B2);
+  bc_free_num(&T2);
+}
+
+static bc_num
+_atanhinv(
+  int x,
+  int scale)
+{
+  bc_num Q, B, T, result;
+
+  _atanhsplit(x, 0, (int)(scale / (2 * log10((double)x))) + 2, &Q, &B, &T);
+  bc_multiply(B, Q, &B, 0);
+  bc_init_num(&result);
+  bc_divide(T, B, &result, scale);
+  bc_free_num(&Q);
+  bc_free_num(&B);
+  bc_free_num(&T);
+  return result;
+}
+
+/* the arguments and the coefficients of ln 2, ln 3, ln 5 and ln 7 */
+static int lnargs[4] = { 251, 449, 4801, 8749 };
+static int lncoef[4][4] = {
+  { 144, 54, -38, 62 },
+  { 228, 86, -60, 98 },
+  { 334, 126, -88, 144 },
+  { 404, 152, -106, 174 }
+};
+
+/* all four logarithms share the atanh values, so they are cached
+   together */
+static void
+_calclogs(
+  int scale)
+{
+  bc_num atanhs[4];
+  bc_num ln[4];
+  bc_num tmp;
+  int i, j;
+
+  for (j = 0; j < 4; ++j)
+    atanhs[j] = _atanhinv(lnargs[j], scale);
+  for (i = 0; i < 4; ++i)
+  {
+    bc_init_num(&ln[i]);
+    for (j = 0; j < 4; ++j)
+    {
+      tmp = _bcint(lncoef[i][j]);
+      bc_multiply(atanhs[j], tmp, &tmp, scale);
+      bc_add(ln[i], tmp, &ln[i], scale);
+      bc_free_num(&tmp);
+    }
+  }
+  /* ln 10 = ln 2 + ln 5 */
+  bc_add(ln[0], ln[2], &ln[2], scale);
+  _store(CONST_LN2, ln[0], scale);
+  _store(CONST_LN3, ln[1], scale);
+  _store(CONST_LN10, ln[2], scale);
+  _store(CONST_LN7, ln[3], scale);
+  for (j = 0; j < 4; ++j)
+    bc_free_num(&atanhs[j]);
+}
+
+static bc_num _get(constid which, int scale);
+
+/* ln y for any y > 0 by the arithmetic-geometric mean: for
+   s = y 2^m > 10^(w/2), ln s = pi / (2 AGM(1, 4/s)) with an error
+   below 10^-w, and ln y = ln s - m ln 2. The first AGM steps see
+   4/s with w/2 leading zeros, hence the scale of w + w/2 digits */
+static bc_num
+_lnagm(
+  bc_num y,
+  int scale)
+{
+  bc_num a, b, tmp, result;
+  int w, m, wscale;
+
+  /* ln s ~ 1.15 w and m ln 2 cost a few digits to cancellation */
+  w = scale + 2 * (int)log10((double)scale + 10) + 4;
+  wscale = w + w / 2 + 2;
+  m = (int)((w / 2 + 1) * 3.3219281) + 1;
+  bc_init_num(&b);
+  bc_init_num(&result);
+  tmp = _bcint(m);
+  bc_raise(_two_, tmp, &b, 0);
+  bc_multiply(b, y, &b, wscale);
+  bc_free_num(&tmp);
+  tmp = _bcint(4);
+  bc_divide(tmp, b, &b, wscale);
+  a = bc_copy_num(_one_);
+  for (;;)
+  {
+    bc_sub(a, b, &tmp, wscale);
+    if (bc_is_near_zero(tmp, w))
+      break;
+    bc_add(a, b, &tmp, wscale);
+    bc_multiply(a, b, &b, wscale);
+    bc_sqrt(&b, wscale);
+    bc_divide(tmp, _two_, &a, wscale);
+  }
+  bc_add(a, b, &tmp, wscale);
+  bc_divide(_get(CONST_PI, w), tmp, &result, w);
+  bc_free_num(&tmp);
+  tmp = _bcint(m);
+  bc_multiply(_get(CONST_LN2, w), tmp, &tmp, w);
+  bc_sub(result, tmp, &result, scale);
+  bc_free_num(&a);
+  bc_free_num(&b);
+  bc_free_num(&tmp);
+  return result;
+}
+
+/*********************   the cache   *********************/
+
+static void _calc(constid which, int scale);
+
+/* the cached value of <which>, computed with at least <scale> digits */
+static bc_num
+_get(
+  constid which,
+  int scale)
+{
+  if (cache[which].value == NULL || cache[which].scale < scale)
+    _calc(which, scale);
+  return cache[which].value;
+}
+
+static void
+_calc(
+  constid which,
+  int scale)
+{
+  bc_num result, tmp;
+
+  bc_init_num(&result);
+  switch (which)
+  {
+  case CONST_PI:
+    bc_free_num(&result);
+    result = _calcpi(scale);
+    break;
+  case CONST_PIDIV2:
+    bc_divide(_get(CONST_PI, scale), _two_, &result, scale);
+    break;
+  case CONST_PIDIV4:
+    bc_divide(_get(CONST_PIDIV2, scale), _two_, &result, scale);
+    break;
+  case CONST_2PI:
+    bc_multiply(_get(CONST_PI, scale), _two_, &result, scale);
+    break;
+  case CONST_1DIVPI:
+    bc_divide(_one_, _get(CONST_PI, scale), &result, scale);
+    break;
+  case CONST_SQRTPI:
+    bc_free_num(&result);
+    result = bc_copy_num(_get(CONST_PI, scale));
+    bc_sqrt(&result, scale);
+    break;
+  case CONST_1DIVSQRTPI:
+    bc_divide(_one_, _get(CONST_SQRTPI, scale), &result, scale);
+    break;
+  case CONST_2DIVSQRTPI:
+    bc_multiply(_get(CONST_1DIVSQRTPI, scale), _two_, &result, scale);
+    break;
+  case CONST_LNSQRT2PIMINUSHALF:
+    /* (ln 2 + ln pi - 1) / 2 */
+    bc_free_num(&result);
+    /* a reference, _lnagm may replace the cached pi */
+    tmp = bc_copy_num(_get(CONST_PI, scale));
+    result = _lnagm(tmp, scale);
+    bc_free_num(&tmp);
+    bc_add(result, _get(CONST_LN2, scale), &result, scale);
+    bc_sub(result, _one_, &result, scale);
+    bc_divide(result, _two_, &result, scale);
+    break;
+  case CONST_E:
+    bc_free_num(&result);
+    result = _calce(scale);
+    break;
+  case CONST_PHI:
+    bc_free_num(&result);
+    result = _bcint(5);
+    bc_sqrt(&result, scale);
+    bc_add(result, _one_, &result, scale);
+    bc_divide(result, _two_, &result, scale);
+    break;
+  case CONST_LN2:
+  case CONST_LN3:
+  case CONST_LN7:
+  case CONST_LN10:
+    bc_free_num(&result);
+    _calclogs(scale);
+    return;
+  default:
+    break;
+  }
+  _store(which, result, scale);
+}
+
+bc_num
+floatconst_bcvalue(
+  constid which,
+  int scale)
+{
+  if (scale < 0)
+    scale = 0;
+  return _truncate(_get(which, scale + GUARDDIGITS), scale);
+}
+
+char
+floatconst_value(
+  floatnum dest,
+  constid which,
+  int digits)
+{
+  bc_num value;
+  char* buf;
+  int i, lg, leadingzeros;
+
+  if (digits <= 0 || digits > maxdigits)
+    return _seterror(dest, InvalidPrecision);
+  /* all constants are between 0.1 and 10 */
+  value = floatconst_bcvalue(which, digits + 2);
+  lg = value->n_len + value->n_scale;
+  buf = (char*)malloc(lg + 1);
+  for (i = 0; i < value->n_len; ++i)
+    buf[i] = BCD_CHAR(value->n_value[i]);
+  buf[value->n_len] = '.';
+  for (i = value->n_len; i < lg; ++i)
+    buf[i+1] = BCD_CHAR(value->n_value[i]);
+  float_setsignificand(dest, &leadingzeros, buf, lg + 1);
+  float_setexponent(dest, value->n_len - 1 - leadingzeros);
+  free(buf);
+  bc_free_num(&value);
+  return float_round(dest, dest, digits, TONEAREST);
+}
+
+void
+floatconst_clearcache()
+{
+  int i;
+
+  for (i = 0; i < CONSTCOUNT; ++i)
+  {
+    bc_free_num(&cache[i].value);
+    cache[i].scale = 0;
+  }
+}
@@ -0,0 +1,71 @@
+/* floatconstcalc.h: computing the mathematical constants to any precision */
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License , or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; see the file COPYING.  If not, write to:
+
+      The Free Software Foundation, Inc.
+      59 Temple Place, Suite 330
+      Boston, MA 02111-1307 USA.
+
+*************************************************************************/
+
+#ifndef FLOATCONSTCALC_H
+# define FLOATCONSTCALC_H
+
+#include "floatnum.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  CONST_PI,
+  CONST_PIDIV2,
+  CONST_PIDIV4,
+  CONST_2PI,
+  CONST_1DIVPI,
+  CONST_SQRTPI,
+  CONST_1DIVSQRTPI,
+  CONST_2DIVSQRTPI,
+  CONST_LNSQRT2PIMINUSHALF,
+  CONST_E,
+  CONST_PHI,
+  CONST_LN2,
+  CONST_LN3,
+  CONST_LN7,
+  CONST_LN10,
+  CONSTCOUNT
+} constid;
+
+/* returns a new bc_num holding the constant <which> with <scale>
+   digits after the decimal point, truncated. The caller owns the
+   result. Each constant is cached at the highest scale asked for so
+   far, a request for fewer digits is served from the cache.
+   Like the rest of floatnum, this is not reentrant; floatconst.c
+   serializes its calls */
+bc_num floatconst_bcvalue(constid which, int scale);
+
+/* sets <dest> to the constant <which>, rounded to <digits> significant
+   digits. <digits> is limited by the current precision (maxdigits),
+   not by MATHPRECISION. Returns 0 and sets <dest> to NaN on an
+   invalid precision */
+char floatconst_value(floatnum dest, constid which, int digits);
+
+/* releases the cache */
+void floatconst_clearcache();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLOATCONSTCALC_H */
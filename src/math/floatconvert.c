@@ -35,6 +35,12 @@
 #include "floatipower.h"
 #include <stdlib.h>
 
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
 typedef struct{
   t_number_desc n;
   t_longint l;
@@ -61,27 +67,165 @@ _digitblock(
   return result;
 }
 
-Error
-_floatnum2longint(
+/* Longer integers are converted by divide and conquer: the value is
+   split into a high and a low part at a power of the target radix,
+   both halves are converted recursively and the high part is scaled by
+   a cached power. Below these sizes (in decimal digits for
+   _floatnum2longint, in words for _longint2floatnum) the plain Horner
+   scheme is faster. */
+#define DC_DECDIGITS 36
+#define DC_WORDS 4
+
+/* 10^(9*2^k) as longints, and (2^32)^(2^k) as floatnums, created on
+   first use. They are shared by all threads: the entries below a count
+   never change, new ones are added under the lock, like the constants
+   of floatconst.c */
+static t_longint decpowers[8];
+static int decpowercount = 0;
+static floatstruct wordpowers[8];
+static int wordpowercount = 0;
+
+#if defined(_WIN32)
+static SRWLOCK powerlock = SRWLOCK_INIT;
+# define _lockpowers() AcquireSRWLockExclusive(&powerlock)
+# define _unlockpowers() ReleaseSRWLockExclusive(&powerlock)
+#else
+static pthread_mutex_t powerlock = PTHREAD_MUTEX_INITIALIZER;
+# define _lockpowers() pthread_mutex_lock(&powerlock)
+# define _unlockpowers() pthread_mutex_unlock(&powerlock)
+#endif
+
+#if defined(_MSC_VER)
+# define _getcount(count) (*(volatile int*)&(count))
+# define _setcount(count, value) (*(volatile int*)&(count) = (value))
+#else
+# define _getcount(count) __atomic_load_n(&(count), __ATOMIC_ACQUIRE)
+# define _setcount(count, value) \
+  __atomic_store_n(&(count), (value), __ATOMIC_RELEASE)
+#endif
+
+static t_longint*
+_decpower(
+  int k)
+{
+  t_longint* result;
+  int count;
+
+  result = &decpowers[k];
+  if (_getcount(decpowercount) > k)
+    return result;
+  _lockpowers();
+  for (count = decpowercount; count <= k; ++count)
+  {
+    if (count == 0)
+    {
+      decpowers[0].length = 0;
+      _longintadd(&decpowers[0], 1000000000);
+    }
+    else if (!_longintmulint(&decpowers[count],
+                             &decpowers[count-1],
+                             &decpowers[count-1]))
+    {
+      result = NULL;
+      break;
+    }
+    _setcount(decpowercount, count + 1);
+  }
+  _unlockpowers();
+  return result;
+}
+
+static floatnum
+_wordpower(
+  int k)
+{
+  int save;
+  int count;
+
+  if (_getcount(wordpowercount) > k)
+    return &wordpowers[k];
+  _lockpowers();
+  /* the cache outlives the caller, so it must not depend on the
+     precision the caller happens to run with */
+  save = maxdigits;
+  maxdigits = MAXDIGITS;
+  for (count = wordpowercount; count <= k; ++count)
+  {
+    float_create(&wordpowers[count]);
+    if (count == 0)
+      float_copy(&wordpowers[0], &cUnsignedBound, EXACT);
+    else
+      float_mul(&wordpowers[count], &wordpowers[count-1],
+                &wordpowers[count-1], EXACT);
+    _setcount(wordpowercount, count + 1);
+  }
+  maxdigits = save;
+  _unlockpowers();
+  return &wordpowers[k];
+}
+
+/* converts the <count> decimal digits of <f> starting at <ofs> */
+static Error
+_digits2longint(
   t_longint* longint,
-  floatnum f)
+  floatnum f,
+  int ofs,
+  int count)
 {
-  int digits;
-  int i;
-  unsigned factor;
+  t_longint high, low;
+  t_longint* pwr;
+  Error result;
+  int i, k, lg;
+  unsigned carry;
 
   longint->length = 0;
-  digits = float_getexponent(f) + 1;
-  i = digits % 9;
-  _longintadd(longint, _digitblock(f, 0, i));
-  factor = 1000000000;
-  while (i < digits)
+  if (count <= DC_DECDIGITS)
+  {
+    i = count % 9;
+    _longintadd(longint, _digitblock(f, ofs, i));
+    while (i < count)
+    {
+      if (_longintmul(longint, 1000000000)
+          || _longintadd(longint, _digitblock(f, ofs + i, 9)))
+        return IOConversionOverflow;
+      i += 9;
+    }
+    return Success;
+  }
+  for (k = 0; (18 << k) < count; ++k);
+  lg = 9 << k;
+  if ((result = _digits2longint(&high, f, ofs, count - lg)) != Success
+      || (result = _digits2longint(&low, f, ofs + count - lg, lg)) != Success)
+    return result;
+  pwr = _decpower(k);
+  if (pwr == NULL || !_longintmulint(longint, &high, pwr))
+    return IOConversionOverflow;
+  lg = longint->length;
+  for (; lg < low.length; ++lg)
+    longint->value[lg] = 0;
+  carry = 0;
+  for (i = 0; i < low.length; ++i)
+    carry += _longarrayadd(longint->value + i, lg - i, low.value[i]);
+  if (carry != 0)
   {
-    if (_longintmul(longint, factor)
-        || _longintadd(longint, _digitblock(f, i, 9)))
+    if (lg >= (int)UARRAYLG - 1)
       return IOConversionOverflow;
-    i += 9;
+    longint->value[lg++] = carry;
   }
+  longint->length = lg;
+  return Success;
+}
+
+Error
+_floatnum2longint(
+  t_longint* longint,
+  floatnum f)
+{
+  Error result;
+
+  result = _digits2longint(longint, f, 0, float_getexponent(f) + 1);
+  if (result != Success)
+    return result;
   /* extra element for floatlong operations */
   *(longint->value+longint->length) = 0;
   return Success;
@@ -97,28 +241,44 @@ _setunsigned(
     float_add(f, f, &cUnsignedBound, EXACT);
 }
 
-void
-_longint2floatnum(
+/* converts the <lg> words at <value>, least significant first */
+static void
+_words2floatnum(
   floatnum f,
-  t_longint* longint)
+  unsigned* value,
+  int lg)
 {
   floatstruct tmp;
-  int idx;
+  int k;
 
   float_setzero(f);
-  if(longint->length == 0)
-    return;
   float_create(&tmp);
-  idx = longint->length - 1;
-  for (; idx >= 0; --idx)
+  if (lg <= DC_WORDS)
+    for (; --lg >= 0;)
+    {
+      _setunsigned(&tmp, value[lg]);
+      float_mul(f, f, &cUnsignedBound, EXACT);
+      float_add(f, f, &tmp, EXACT);
+    }
+  else
   {
-    _setunsigned(&tmp, longint->value[idx]);
-    float_mul(f, f, &cUnsignedBound, EXACT);
+    for (k = 0; (2 << k) < lg; ++k);
+    _words2floatnum(f, value + (1 << k), lg - (1 << k));
+    float_mul(f, f, _wordpower(k), EXACT);
+    _words2floatnum(&tmp, value, 1 << k);
     float_add(f, f, &tmp, EXACT);
   }
   float_free(&tmp);
 }
 
+void
+_longint2floatnum(
+  floatnum f,
+  t_longint* longint)
+{
+  _words2floatnum(f, longint->value, longint->length);
+}
+
 /**************************   io routines   **************************/
 
 static int
@@ -34,6 +34,7 @@
 #include "floatcommon.h"
 #include "floatexp.h"
 #include "math.h"
+#include <stdlib.h>
 
 /*
   The Taylor expansion of sqrt(pi)*erf(x)/2 around x = 0.
@@ -138,63 +139,82 @@ erfcasymptotic(floatnum x,
 
    relative error for 100-digit evaluation < 5e-100 */
 
+/* builds the coefficient set of erfcsum for <digits>. alpha need not
+   be high precision, any alpha near the one evaluated here would do.
+   The exp(-k*k*alpha*alpha) are evaluated iteratively, and as they
+   finally decay rapidly, with a shrinking working precision, until
+   they no longer contribute */
+static erfccoefs*
+_builderfccoefs(
+  int digits)
+{
+  erfccoefs* set;
+  floatstruct t2, t3;
+  int workprec;
+
+  set = (erfccoefs*)malloc(sizeof(erfccoefs));
+  set->digits = digits;
+  float_create(&set->alpha);
+  float_create(&set->alphasqr);
+  float_create(&t2);
+  float_create(&t3);
+  float_setfloat(&set->alpha, M_PI / aprxsqrt((digits + 4) * M_LN10));
+  float_round(&set->alpha, &set->alpha, 3, TONEAREST);
+  float_mul(&set->alphasqr, &set->alpha, &set->alpha, EXACT);
+  float_copy(&t2, &set->alphasqr, EXACT);
+  float_neg(&t2);
+  _exp(&t2, digits + 3); /* exp(-alpha*alpha) */
+  float_mul(&t3, &t2, &t2, digits + 3); /* exp(-2*alpha*alpha) */
+  float_create(&set->coeff[0]);
+  float_copy(&set->coeff[0], &t2, EXACT);
+  set->count = 1;
+  workprec = digits + float_getexponent(&t2) + 1;
+  while (workprec > 0 && set->count < MAXERFCIDX - 1)
+  {
+    float_mul(&t2, &t2, &t3, workprec + 3);
+    float_create(&set->coeff[set->count]);
+    float_mul(&set->coeff[set->count], &t2, &set->coeff[set->count-1],
+              workprec + 3);
+    workprec = digits + float_getexponent(&set->coeff[set->count]) + 1;
+    ++set->count;
+  }
+  float_free(&t2);
+  float_free(&t3);
+  return set;
+}
+
 char
 erfcsum(floatnum x, /* should be the square of the parameter to erfc */
+        floatnum alpha, /* receives the alpha used */
         int digits)
 {
   int i;
-  int workprec = 0;
+  int workprec;
   floatstruct sum, smd;
+  erfccoefs* set;
   floatnum Ei;
 
-  if (digits > erfcdigits)
-  {
-    /* cannot re-use last evaluation's intermediate results */
-    for (i = MAXERFCIDX; --i >= 0;)
-      /* clear all exp(-k*k*alpha*alpha) to indicate their absence */
-      float_free(&erfccoeff[i]);
-    /* current precision */
-    erfcdigits = digits;
-    /* create new alpha appropriate for the desired precision
-    This alpha need not be high precision, any alpha near the
-    one evaluated here would do */
-    float_setfloat(&erfcalpha, M_PI / aprxsqrt((digits + 4) * M_LN10));
-    float_round(&erfcalpha, &erfcalpha, 3, TONEAREST);
-
-    float_mul(&erfcalphasqr, &erfcalpha, &erfcalpha, EXACT);
-    /* the exp(-k*k*alpha*alpha) are later evaluated iteratively.
-    Initiate the iteration here */
-    float_copy(&erfct2, &erfcalphasqr, EXACT);
-    float_neg(&erfct2);
-    _exp(&erfct2, digits + 3); /* exp(-alpha*alpha) */
-    float_copy(erfccoeff, &erfct2, EXACT); /* start value */
-    float_mul(&erfct3, &erfct2, &erfct2, digits + 3); /* exp(-2*alpha*alpha) */
-  }
+  set = floatmath_lookuperfc(digits);
+  if (set == NULL)
+    set = floatmath_publisherfc(_builderfccoefs(digits));
   float_create(&sum);
   float_create(&smd);
   float_setzero(&sum);
-  for (i = 0; ++i < MAXERFCIDX;)
+  for (i = 0; ++i <= set->count;)
   {
-    Ei = &erfccoeff[i-1];
-    if (float_isnan(Ei))
-    {
-      /* if exp(-i*i*alpha*alpha) is not available, evaluate it from
-      the coefficient of the last summand */
-      float_mul(&erfct2, &erfct2, &erfct3, workprec + 3);
-      float_mul(Ei, &erfct2, &erfccoeff[i-2], workprec + 3);
-    }
-    /* Ei finally decays rapidly. save some time by adjusting the
-    working precision */
+    Ei = &set->coeff[i-1];
     workprec = digits + float_getexponent(Ei) + 1;
     if (workprec <= 0)
       break;
     /* evaluate the summand exp(-i*i*alpha*alpha)/(i*i*alpha*alpha+x) */
-    float_muli(&smd, &erfcalphasqr, i*i, workprec);
+    float_muli(&smd, &set->alphasqr, i*i, workprec);
     float_add(&smd, x, &smd, workprec + 2);
     float_div(&smd, Ei, &smd, workprec + 1);
     /* add summand to the series */
     float_add(&sum, &sum, &smd, digits + 3);
   }
+  float_copy(alpha, &set->alpha, EXACT);
+  floatmath_releaseerfc(set);
   float_move(x, &sum);
   float_free(&smd);
   return 1;
@@ -270,6 +290,7 @@ _erf(
   int workprec;
   signed char sign;
 
+  floatmath_needpi();
   sign = float_getsign(x);
   float_abs(x);
   if (float_cmp(x, &c1Div2) > 0)
@@ -293,10 +314,12 @@ _erfc(
   floatnum x,
   int digits)
 {
-  floatstruct tmp, t2, t3;
+  floatstruct tmp, t2, t3, alpha;
   int expx, prec;
   char result;
 
+  floatmath_needlogs();
+  floatmath_needpi();
   if (float_cmp(x, &c1Div2) <= 0)
   {
     /* use erfc(x) = 1 - erf(x) for small or negative x */
@@ -337,9 +360,10 @@ _erfc(
     result = 1;
     float_create(&t2);
     float_create(&t3);
+    float_create(&alpha);
     float_mul(&t2, x, x, digits + 2);
     float_copy(&tmp, &t2, EXACT);
-    erfcsum(&tmp, digits);
+    erfcsum(&tmp, &alpha, digits);
     float_add(&tmp, &tmp, &tmp, digits + 1);
     float_copy(&t3, &t2, EXACT);
     float_reciprocal(&t2, digits + 1);
@@ -347,18 +371,18 @@ _erfc(
     float_neg(&t3);
     _exp(&t3, digits + 2);
     float_mul(&t3, &t3, &tmp, digits + 2);
-    float_mul(&tmp, &erfcalpha, x, digits + 2);
+    float_mul(&tmp, &alpha, x, digits + 2);
     float_mul(&t3, &tmp, &t3, digits + 3);
     float_mul(&t3, &c1DivPi, &t3, digits + 2);
     /* quick estimate to find the right working precision */
-    float_div(&tmp, x, &erfcalpha, 4);
+    float_div(&tmp, x, &alpha, 4);
     float_mul(&tmp, &tmp, &c2Pi, 4);
     float_div(&tmp, &tmp, &cLn10, 4);
     prec = digits - float_getexponent(&t3) - float_asinteger(&tmp) + 1;
     /* add correction term */
     if (prec > 0)
     {
-      float_div(&tmp, x, &erfcalpha, prec + 3);
+      float_div(&tmp, x, &alpha, prec + 3);
       float_mul(&tmp, &tmp, &c2Pi, prec + 4);
       _exp(&tmp, prec);
       float_sub(&tmp, &c1, &tmp, prec);
@@ -366,6 +390,7 @@ _erfc(
       float_add(&t3, &t3, &tmp, digits + 1);
     }
     float_free(&t2);
+    float_free(&alpha);
     float_move(x, &t3);
   }
   float_free(&tmp);
@@ -32,6 +32,7 @@
 #include "floatcommon.h"
 #include "floatseries.h"
 #include "floatexp.h"
+#include "floatlog.h"
 
 /* uses the addition theorem
    cosh(2x)-1 == 2*(cosh x - 1)*(cosh x + 1)
@@ -130,6 +131,29 @@ _expminus1lt1(
   float_free(&tmp);
 }
 
+/* exp(x) for 0.1 <= x < ln 10 at high precision: y = exp(x) with
+   half the digits, then a Newton step y <- y (1 + x - ln y) doubles
+   the number of correct digits. Cheaper than the series from
+   EXPNEWTONDIGITS on, because ln needs no square roots */
+static void
+_expnewton(
+  floatnum x,
+  int digits)
+{
+  floatstruct y, tmp;
+
+  float_create(&y);
+  float_create(&tmp);
+  float_copy(&y, x, digits / 2 + 2);
+  _expltln10(&y, digits / 2 + 2);
+  float_copy(&tmp, &y, EXACT);
+  _ln(&tmp, digits + 2);
+  float_sub(&tmp, x, &tmp, digits + 2);
+  float_muladd(x, &tmp, &y, &y, digits + 1);
+  float_free(&y);
+  float_free(&tmp);
+}
+
 /* exp(x) for 0 <= x < ln 10
    relative error < 5e-100 */
 void
@@ -142,6 +166,12 @@ _expltln10(
   char sgnf;
 
   expx = float_getexponent(x);
+  if (digits >= EXPNEWTONDIGITS && expx >= -1)
+  {
+    _expnewton(x, digits);
+    return;
+  }
+  floatmath_needlogs();
   factor = 1;
   if (expx >= -1)
   {
@@ -188,6 +218,7 @@ _exp(
   int expx, extra;
   char ok;
 
+  floatmath_needlogs();
   if (float_iszero(x))
   {
     float_copy(x, &c1, EXACT);
@@ -244,6 +275,7 @@ _0_5exp(
   floatnum x,
   int digits)
 {
+  floatmath_needlogs();
   float_sub(x, x, &cLn2, digits + (3*logexp(x)/10)+1);
   return _exp(x, digits);
 }
@@ -339,6 +371,57 @@ _sinh(
   return 1;
 }
 
+/* sinh(x) and cosh(x) for all x from a single evaluation of
+   cosh x - 1 (|x| < 1) or exp |x|. On return, x holds sinh x,
+   c holds cosh x. Overflow is indicated by the return value (0, if
+   error) */
+char
+_sinhcosh(
+  floatnum x,
+  floatnum c,
+  int digits)
+{
+  floatstruct tmp;
+  signed char sgn;
+  int expx;
+
+  sgn = float_getsign(x);
+  float_abs(x);
+  if (float_getexponent(x) < 0 || float_iszero(x))
+  {
+    float_copy(c, x, EXACT);
+    if (2*float_getexponent(x)+2 <= -digits || float_iszero(x))
+      /* for small x: sinh x approx.== x, cosh x approx.== 1 */
+      float_setzero(c);
+    else
+    {
+      _coshminus1lt1(c, digits);
+      float_copy(x, c, EXACT);
+      _sinhfromcoshminus1(x, digits);
+    }
+    float_add(c, c, &c1, digits);
+  }
+  else
+  {
+    if (!_0_5exp(x, digits))
+      return 0;
+    /* exp(x)/2 +/- exp(-x)/2 */
+    float_copy(c, x, EXACT);
+    expx = float_getexponent(x);
+    if (2*expx < digits)
+    {
+      float_create(&tmp);
+      float_muli(&tmp, x, 4, digits-2*expx);
+      float_reciprocal(&tmp, digits-2*expx);
+      float_add(c, c, &tmp, digits+1);
+      float_sub(x, x, &tmp, digits+1);
+      float_free(&tmp);
+    }
+  }
+  float_setsign(x, sgn);
+  return 1;
+}
+
 /* tanh(x) for |x| <= 0.5.
    relative error for 100 digit results is < 7e-100 */
 void
@@ -401,6 +484,7 @@ _power10(
 {
   int exp;
 
+  floatmath_needlogs();
   if (float_isinteger(x))
   {
     exp = float_asinteger(x);
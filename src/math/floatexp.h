@@ -48,6 +48,7 @@ char _coshminus1(floatnum x, int digits);
 void _tanhlt0_5(floatnum x, int digits);
 char _tanhminus1gt0(floatnum x, int digits);
 char _sinh(floatnum x, int digits);
+char _sinhcosh(floatnum x, floatnum c, int digits);
 void _tanhgt0_5(floatnum x, int digits);
 char _power10(floatnum exponent, int digits);
 
@@ -36,14 +36,29 @@
 #include "floatexp.h"
 #include "floattrig.h"
 
+/* returns the number of summands needed in the asymptotic
+   series to guarantee <digits> precision. Each extra summand
+   yields roughly extra 1.8 digits. This is derived under the
+   assumption, that the costs of an extra factor in the rising
+   pochhammer symbol are about the same than those of an extra
+   summand in the series */
+static int
+_findorder(
+  int digits)
+{
+  return (5*digits + 5)/9;
+}
+
 /* asymptotic series of the Binet function
    for x >= 77 and a 100 digit computation, the
    relative error is < 9e-100.
    the series converges, if x and digits comply to
-     100 >= digits >= 2
+     digits >= 2
      x >= sqrt((digits*ln 10 + 0.5*ln 2)/1.0033).
    As a special case, for digits == 1, convergence is guaranteed,
-   if x >= 1.8. */
+   if x >= 1.8.
+   The coefficients come from floatmath_binetcoef, which extends its
+   cache as far as the precision requires */
 
 char
 binetasymptotic(floatnum x,
@@ -53,8 +68,9 @@ binetasymptotic(floatnum x,
   floatstruct sum;
   floatstruct smd;
   floatstruct pwr;
-  int i, workprec;
+  int i, workprec, maxorder;
 
+  floatmath_needbernoulli();
   if (float_getexponent(x) >= digits)
   {
     /* if x is very big, ln(gamma(x)) is
@@ -73,26 +89,27 @@ binetasymptotic(floatnum x,
   float_setzero(&sum);
   float_div(&smd, &c1, &c12, digits+1);
   workprec = digits - 2*float_getexponent(x)+3;
+  /* leave some headroom for an x a bit smaller than _minx */
+  maxorder = _findorder(digits) + 12;
   i = 1;
   if (workprec > 0)
   {
     float_mul(&recsqr, x, x, workprec);
     float_reciprocal(&recsqr, workprec);
     while (float_getexponent(&smd) > -digits-1
-           && ++i <= MAXBERNOULLIIDX)
+           && ++i <= maxorder)
     {
       workprec = digits + float_getexponent(&smd) + 3;
       float_add(&sum, &sum, &smd, digits+1);
       float_mul(&pwr, &recsqr, &pwr, workprec);
-      float_muli(&smd, &cBernoulliDen[i-1], 2*i*(2*i-1), workprec);
-      float_div(&smd, &pwr, &smd, workprec);
-      float_mul(&smd, &smd, &cBernoulliNum[i-1], workprec);
+      floatmath_binetcoef(&smd, i, workprec);
+      float_mul(&smd, &smd, &pwr, workprec);
     }
   }
   else
     /* sum reduces to the first summand*/
     float_move(&sum, &smd);
-  if (i > MAXBERNOULLIIDX)
+  if (i > maxorder)
       /* x was not big enough for the asymptotic
     series to converge sufficiently */
     float_setnan(x);
@@ -102,20 +119,7 @@ binetasymptotic(floatnum x,
   float_free(&smd);
   float_free(&sum);
   float_free(&recsqr);
-  return i <= MAXBERNOULLIIDX;
-}
-
-/* returns the number of summands needed in the asymptotic
-   series to guarantee <digits> precision. Each extra summand
-   yields roughly extra 1.8 digits. This is derived under the
-   assumption, that the costs of an extra factor in the rising
-   pochhammer symbol are about the same than those of an extra
-   summand in the series */
-static int
-_findorder(
-  int digits)
-{
-  return (5*digits + 5)/9;
+  return i <= maxorder;
 }
 
 /* returns how big x has to be to let the asymptotic series
@@ -174,6 +178,8 @@ _pochhammer_su(
   case 1:
     break;
   default:
+    if (float_cancelled())
+      return 0;
     float_create(&factor);
     float_addi(&factor, x, n >> 1, digits+2);
     result = _pochhammer_su(x, n >> 1, digits)
@@ -196,6 +202,7 @@ _lngammabigx(
   floatstruct tmp1, tmp2;
   char result;
 
+  floatmath_needpi();
   result = 0;
   float_create(&tmp1);
   float_create(&tmp2);
@@ -243,6 +250,7 @@ _lngamma_prim(
   char result;
   char odd;
 
+  floatmath_needpi();
   *infinity = 0;
   if (float_getsign(x) > 0)
     return _lngamma_prim_xgt0(x, revfactor, digits);
@@ -352,6 +360,7 @@ _gammaint(
 {
   int ofs;
 
+  floatmath_needpi();
   if (float_getexponent(integer) >=2)
     return _gammagtminus20(integer, digits);
   ofs = float_asinteger(integer);
@@ -455,16 +464,18 @@ _pochhammer_i(
   if (float_isinteger(x))
   {
     result = -1;
-    float_neg((floatnum)n);
-    if (float_getsign(x) <= 0 && float_cmp(x, n) > 0)
+    /* x is compared to -n without negating n, which is const and
+       may be read by other threads at the same time */
+    if (float_getsign(x) <= 0 && float_getsign(n) > 0
+        && float_abscmp(x, n) < 0)
       /* x and x+n have opposite signs, meaning 0 is
          among the factors */
       result = _setzero(x);
-    else if (float_getsign(x) > 0 && float_cmp(x, n) <= 0)
+    else if (float_getsign(x) > 0 && float_getsign(n) < 0
+             && float_abscmp(x, n) <= 0)
       /* x and x+n have opposite signs, meaning at one point
       you have to divide by 0 */
       result = _seterror(x, ZeroDivide);
-    float_neg((floatnum)n);
     if (result >= 0)
       return result;
   }
@@ -159,6 +159,7 @@ float_lg(
   floatstruct tmp;
   int expx;
 
+  floatmath_needlogs();
   if (!chckmathparam(x, digits))
     return 0;
   if (float_getsign(x) <= 0)
@@ -179,6 +180,7 @@ float_lb(
   floatnum x,
   int digits)
 {
+  floatmath_needlogs();
   if (!chckmathparam(x, digits))
     return 0;
   if (float_getsign(x) <= 0)
@@ -265,6 +267,23 @@ float_sinh(
   return _seterror(x, Overflow);
 }
 
+char
+float_sinhcosh(
+  floatnum x,
+  floatnum c,
+  int digits)
+{
+  if (!chckmathparam(x, digits))
+  {
+    float_setnan(c);
+    return 0;
+  }
+  if (_sinhcosh(x, c, digits))
+    return 1;
+  float_setnan(c);
+  return _seterror(x, Overflow);
+}
+
 char
 float_tanh(
   floatnum x,
@@ -395,6 +414,26 @@ float_sin(
   return 1;
 }
 
+char
+float_sincos(
+  floatnum x,
+  floatnum c,
+  int digits)
+{
+  if (!chckmathparam(x, digits))
+  {
+    float_setnan(c);
+    return 0;
+  }
+  if (float_getexponent(x) >= DECPRECISION - 1 || !_trigreduce(x, digits))
+  {
+    float_setnan(c);
+    return _seterror(x, EvalUnstable);
+  }
+  _sincos(x, c, digits);
+  return 1;
+}
+
 char
 float_tan(
   floatnum x,
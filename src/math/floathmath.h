@@ -147,6 +147,15 @@ char float_coshminus1(floatnum x, int digits);
            InvalidPrecision (digits > MATHPRECISION) */
 char float_sinh(floatnum x, int digits);
 
+/* evaluates sinh(x) and cosh(x) at once, sinh(x) is returned in x,
+   cosh(x) in c. This is cheaper than calling float_sinh and float_cosh
+   separately.
+   In case of an error, x and c are set to NaN and 0 is returned.
+   Errors: Overflow
+           NaNOperand
+           InvalidPrecision (digits > MATHPRECISION) */
+char float_sinhcosh(floatnum x, floatnum c, int digits);
+
 /* evaluates tanh(x).
    In case of an error, x is set to NaN and 0 is returned.
    Errors: NaNOperand
@@ -230,6 +239,14 @@ char float_sin(floatnum x, int digits);
            InvalidPrecision (digits > MATHPRECISION) */
 char float_cos(floatnum x, int digits);
 
+/* evaluates sin x and cos x at once, sin x is returned in x, cos x
+   in c. Both share one argument reduction and one series evaluation.
+   In case of an error, x and c are set to NaN and 0 is returned.
+   Errors: EvalUnstable
+           NaNOperand
+           InvalidPrecision (digits > MATHPRECISION) */
+char float_sincos(floatnum x, floatnum c, int digits);
+
 /* evaluates cos x - 1. In the neighbourhood of x==0, when
    cos x approx.== 1, this function yields better results
    than float_cos.
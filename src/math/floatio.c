@@ -884,14 +884,20 @@ _decodecomplement(
   return param->cmpltag;
 }
 
-static void
+/* appends token to the output at buf, and returns the new end */
+static char*
 _cattoken(
   char* buf,
-  char* token,
+  const char* token,
   char enable)
 {
-  if (enable && !_isempty(token))
-    strcat(buf, token);
+  int lg;
+
+  if (!enable || _isempty(token))
+    return buf;
+  lg = strlen(token);
+  memcpy(buf, token, lg);
+  return buf + lg;
 }
 
 int
@@ -1017,28 +1023,31 @@ cattokens(
   }
   if (sz <= bufsz)
   {
-    *buf = '\0';
     cbuf[0] = _decodesign(tokens->sign);
-    _cattoken(buf, cbuf, printsign);
-    _cattoken(buf, basetag, printbasetag);
-    _cattoken(buf, cmpltag, printcmpl);
-    _cattoken(buf, "0", printleading0);
-    _cattoken(buf, tokens->intpart.buf, 1);
+    buf = _cattoken(buf, cbuf, printsign);
+    buf = _cattoken(buf, basetag, printbasetag);
+    buf = _cattoken(buf, cmpltag, printcmpl);
+    buf = _cattoken(buf, "0", printleading0);
+    buf = _cattoken(buf, tokens->intpart.buf, 1);
     cbuf[0] = dot;
-    _cattoken(buf, cbuf, printdot);
+    buf = _cattoken(buf, cbuf, printdot);
     if (fraclg > 0)
-      strncat(buf, tokens->fracpart.buf, fraclg);
+    {
+      memcpy(buf, tokens->fracpart.buf, fraclg);
+      buf += fraclg;
+    }
     if (printexp)
     {
       cbuf[0] = *expbegin;
-      _cattoken(buf, cbuf, printexpbegin);
+      buf = _cattoken(buf, cbuf, printexpbegin);
       cbuf[0] = _decodesign(tokens->exp < 0? -1:1);
-      _cattoken(buf, cbuf, printexpsign);
-      _cattoken(buf, expbasetag, printexpbase);
-      strcat(buf, expBuf.buf);
+      buf = _cattoken(buf, cbuf, printexpsign);
+      buf = _cattoken(buf, expbasetag, printexpbase);
+      buf = _cattoken(buf, expBuf.buf, 1);
       cbuf[0] = *expend;
-      _cattoken(buf, cbuf, printexpend);
+      buf = _cattoken(buf, cbuf, printexpend);
     }
+    *buf = '\0';
   }
   return sz;
 }
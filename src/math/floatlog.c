@@ -138,6 +138,7 @@ _lnguess(
   int digits,
   int idx)
 {
+  floatmath_needlogs();
   _addcoef(dest, _lincombtbl[idx].c2-_lincombtbl[idx].c5, &cLn2, digits);
   _addcoef(dest, _lincombtbl[idx].c3, &cLn3, digits);
   _addcoef(dest, _lincombtbl[idx].c7, &cLn7, digits);
@@ -159,7 +160,7 @@ _lnreduce(
   floatnum lnguess,
   int digits)
 {
-  floatstruct tmp1, tmp2;
+  floatstruct tmp1;
   int idx;
   int expx;
   signed char pos;
@@ -169,7 +170,6 @@ _lnreduce(
   if (expx < -2)
     return;
   float_create(&tmp1);
-  float_create(&tmp2);
 
   idx = leadingdigits(x, 3 + expx) + 39;
   if (idx < 0)
@@ -179,12 +179,10 @@ _lnreduce(
   float_setinteger(&tmp1, _factor(idx));
   float_setexponent(&tmp1, -pos);
   float_sub(&tmp1, &tmp1, &c1, EXACT);
-  float_mul(&tmp2, x, &tmp1, digits);
-  float_add(&tmp1, &tmp1, &tmp2, digits+1);
+  float_muladd(&tmp1, x, &tmp1, &tmp1, digits+1);
   float_add(x, x, &tmp1, digits);
   _lnguess(lnguess, digits+4, idx);
   float_free(&tmp1);
-  float_free(&tmp2);
   return;
 }
 
@@ -203,6 +201,72 @@ _lnxplus1lt1(
   float_free(&lnfactor);
 }
 
+/* ln x for x > 0 by the arithmetic-geometric mean: with
+   s = x * 10^k > 10^(w/2), ln s = pi / (2 AGM(1, 4/s)) has a
+   relative error below 10^-w, and ln x = ln s - k ln 10.
+   The AGM converges quadratically, so it takes O(log w) square roots
+   only, and from LNAGMDIGITS on this is faster than the series.
+   k ln 10 is about 1.15 w, so the subtraction costs log10 w digits,
+   and more, if x is close to 1. Returns 0 without touching x, if
+   the working precision is not available */
+static char
+_lnagm(
+  floatnum x,
+  int digits)
+{
+  floatstruct a, b, tmp;
+  int w, k, expa;
+
+  float_create(&tmp);
+  float_sub(&tmp, x, &c1, 2);
+  if (float_iszero(&tmp))
+  {
+    float_free(&tmp);
+    float_setzero(x);
+    return 1;
+  }
+  w = digits + 4;
+  for (k = digits; k > 0; k /= 10)
+    ++w;
+  if (float_getexponent(&tmp) < -1)
+    w -= float_getexponent(&tmp) + 1;
+  if (w > maxdigits)
+  {
+    float_free(&tmp);
+    return 0;
+  }
+  floatmath_needpi();
+  floatmath_needlogs();
+  float_create(&a);
+  float_create(&b);
+  k = w / 2 + 1 - float_getexponent(x);
+  float_copy(&b, x, w);
+  float_setexponent(&b, w / 2 + 1);
+  float_setinteger(&tmp, 4);
+  float_div(&b, &tmp, &b, w);
+  float_copy(&a, &c1, EXACT);
+  for (;;)
+  {
+    float_sub(&tmp, &a, &b, w);
+    expa = float_getexponent(&a);
+    /* (a-b)^2/(8a) is the error of taking the arithmetic mean now */
+    if (float_iszero(&tmp) || 2 * (float_getexponent(&tmp) - expa) < -w)
+      break;
+    float_add(&tmp, &a, &b, w + 1);
+    float_mul(&b, &a, &b, w + 1);
+    float_sqrt(&b, w);
+    float_mul(&a, &tmp, &c1Div2, w);
+  }
+  float_add(&tmp, &a, &b, w);
+  float_div(&a, &cPi, &tmp, w);
+  float_muli(&tmp, &cLn10, k, w);
+  float_sub(x, &a, &tmp, digits + 1);
+  float_free(&a);
+  float_free(&b);
+  float_free(&tmp);
+  return 1;
+}
+
 /* the general purpose routine evaluating ln(x) for all
    positive arguments. It uses multiplication and division to
    reduce the argument to a value near 1. The factors are
@@ -230,6 +294,9 @@ _ln(
   char coef3;
   char dgt;
 
+  if (digits >= LNAGMDIGITS && _lnagm(x, digits))
+    return;
+  floatmath_needlogs();
   float_create(&tmp);
   coef10 = float_getexponent(x);
 
@@ -341,6 +408,7 @@ _artanh(
 {
   signed char sgn;
 
+  floatmath_needlogs();
   sgn = float_getsign(x);
   float_abs(x);
   if (float_cmp(x, &c1Div2) <= 0)
@@ -397,8 +465,7 @@ _arsinh(
     _ln2x(x, digits);
   else
   {
-    float_mul(&tmp, x, x, digits + (expxsqr>=0? 0 : expxsqr));
-    float_add(&tmp, &tmp, &c1, digits+1);
+    float_muladd(&tmp, x, x, &c1, digits+1);
     float_sqrt(&tmp, digits);
     if (float_getexponent(x) < 0)
     {
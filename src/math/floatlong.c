@@ -30,17 +30,36 @@
 *************************************************************************/
 
 #include "floatlong.h"
+#include <limits.h>
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
 
 #define HALFSIZE (sizeof(unsigned) * 4)
 #define LOWMASK ((1 << HALFSIZE) - 1)
 #define MSB (1 << (2*HALFSIZE-1))
 
+/* With 32 bit unsigned, an unsigned long long holds a full product of
+   two words plus two more words, so sums and products need not be
+   split into halves. The split versions remain for other word sizes. */
+#if UINT_MAX == 0xFFFFFFFFu && ULLONG_MAX / UINT_MAX > UINT_MAX
+# define DOUBLEWORD
+typedef unsigned long long t_doubleword;
+#endif
+
 /***************  functions handling a single unsigned  ********************/
 
 int
 _findfirstbit(
   unsigned value)
 {
+#if defined(__GNUC__) || defined(__clang__)
+  return value == 0? -1 : (int)BITS_IN_UNSIGNED - 1 - __builtin_clz(value);
+#elif defined(_MSC_VER)
+  unsigned long idx;
+
+  return _BitScanReverse(&idx, value)? (int)idx : -1;
+#else
   int result;
 
   result = -1;
@@ -50,6 +69,7 @@ _findfirstbit(
     ++result;
   }
   return result;
+#endif
 }
 
 /* pre: value != 0 */
@@ -57,6 +77,14 @@ static int
 _revfindfirstbit(
   unsigned value)
 {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(value);
+#elif defined(_MSC_VER)
+  unsigned long idx;
+
+  _BitScanForward(&idx, value);
+  return (int)idx;
+#else
   int result;
 
   result = 0;
@@ -66,10 +94,12 @@ _revfindfirstbit(
     ++result;
   }
   return result;
+#endif
 }
 
 /*******************  double unsigned functions  ********************/
 
+#ifndef DOUBLEWORD
 static void
 _longsplit(
   unsigned value,
@@ -87,12 +117,21 @@ _longcat(
 {
   return (high << HALFSIZE) + low;
 }
+#endif
 
 char
 _longadd(
   unsigned* s1,
   unsigned* s2)
 {
+#ifdef DOUBLEWORD
+  t_doubleword sum;
+
+  sum = (t_doubleword)*s1 + *s2;
+  *s1 = (unsigned)sum;
+  *s2 = (unsigned)(sum >> BITS_IN_UNSIGNED);
+  return *s2 == 0;
+#else
   unsigned s1h, s1l, s2h, s2l;
 
   _longsplit(*s1, &s1l, &s1h);
@@ -103,6 +142,7 @@ _longadd(
   _longsplit(s1h, &s1h, s2);
   *s1 = _longcat(s1l, s1h);
   return *s2 == 0;
+#endif
 }
 
 char
@@ -110,6 +150,14 @@ _longmul(
   unsigned* f1,
   unsigned* f2)
 {
+#ifdef DOUBLEWORD
+  t_doubleword product;
+
+  product = (t_doubleword)*f1 * *f2;
+  *f1 = (unsigned)product;
+  *f2 = (unsigned)(product >> BITS_IN_UNSIGNED);
+  return *f2 == 0;
+#else
   unsigned f1h, f1l, f2h, f2l;
 
   _longsplit(*f1, &f1l, &f1h);
@@ -124,6 +172,7 @@ _longmul(
   _longadd(f1, &f1l);
   *f2 += f1l + (f2l << HALFSIZE) + f1h;
   return *f2 == 0;
+#endif
 }
 
 unsigned
@@ -156,8 +205,19 @@ _longarrayadd(
   int lg,
   unsigned incr)
 {
+#ifdef DOUBLEWORD
+  t_doubleword sum;
+
+  for(; lg-- > 0 && incr != 0; ++uarray)
+  {
+    sum = (t_doubleword)*uarray + incr;
+    *uarray = (unsigned)sum;
+    incr = (unsigned)(sum >> BITS_IN_UNSIGNED);
+  }
+#else
   for(; lg-- > 0 && incr != 0;)
     _longadd(uarray++, &incr);
+#endif
   return incr;
 }
 
@@ -167,6 +227,19 @@ _longarraymul(
   int lg,
   unsigned factor)
 {
+#ifdef DOUBLEWORD
+  t_doubleword product;
+  unsigned carry;
+
+  carry = 0;
+  for (; lg-- > 0; ++uarray)
+  {
+    product = (t_doubleword)*uarray * factor + carry;
+    *uarray = (unsigned)product;
+    carry = (unsigned)(product >> BITS_IN_UNSIGNED);
+  }
+  return carry;
+#else
   unsigned ovfl, carry;
 
   carry = 0;
@@ -179,6 +252,7 @@ _longarraymul(
     _longadd(uarray++, &carry);
   }
   return carry + ovfl;
+#endif
 }
 
 unsigned
@@ -281,6 +355,53 @@ _longintmul(
   return ovfl;
 }
 
+/* <product> becomes <f1> * <f2>. <product> must be different
+   from both factors. Returns 0 on overflow */
+char
+_longintmulint(
+  t_longint* product,
+  t_longint* f1,
+  t_longint* f2)
+{
+#ifdef DOUBLEWORD
+  t_doubleword sum;
+  unsigned carry;
+#else
+  t_uarray row;
+#endif
+  int i, j;
+
+  if (f1->length + f2->length >= (int)UARRAYLG)
+    return 0;
+  product->length = f1->length + f2->length;
+  for (i = product->length; i >= 0; --i)
+    product->value[i] = 0;
+  for (j = 0; j < f2->length; ++j)
+  {
+#ifdef DOUBLEWORD
+    /* a word product plus two words cannot overflow a double word */
+    carry = 0;
+    for (i = 0; i < f1->length; ++i)
+    {
+      sum = (t_doubleword)f1->value[i] * f2->value[j]
+            + product->value[i+j] + carry;
+      product->value[i+j] = (unsigned)sum;
+      carry = (unsigned)(sum >> BITS_IN_UNSIGNED);
+    }
+    product->value[f1->length + j] = carry;
+#else
+    for (i = 0; i < f1->length; ++i)
+      row[i] = f1->value[i];
+    row[f1->length] = _longarraymul(row, f1->length, f2->value[j]);
+    for (i = 0; i <= f1->length; ++i)
+      _longarrayadd(product->value + i + j, product->length - i - j, row[i]);
+#endif
+  }
+  while (product->length > 0 && product->value[product->length-1] == 0)
+    --product->length;
+  return 1;
+}
+
 char
 _longintsetsize(
   t_longint* l,
@@ -316,10 +437,10 @@ _checkadd(
   }
   if (s2 < 0)
   {
-    u1 = -*s1;
-    u2 = -s2;
+    u1 = 0u - (unsigned)*s1;
+    u2 = 0u - (unsigned)s2;
     _longadd(&u1, &u2);
-    *s1 = -(int)u1;
+    *s1 = (int)(0u - u1);
     return u2 == 0 && *s1 < 0;
   }
   u1 = *s1;
@@ -343,19 +464,19 @@ _checkmul(
   else
   {
     sgn = -1;
-    x1 = -*f1;
+    x1 = 0u - (unsigned)*f1;
   }
   if (f2 >= 0)
     x2 = f2;
   else
   {
     sgn = -sgn;
-    x2 = -f2;
+    x2 = 0u - (unsigned)f2;
   }
   _longmul(&x1, &x2);
   if (sgn < 0)
   {
-    *f1 = -(int)x1;
+    *f1 = (int)(0u - x1);
     return (x2 == 0 && x1 <= msb);
   }
   *f1 = (int)x1;
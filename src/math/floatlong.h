@@ -68,6 +68,7 @@ unsigned _lastnonzerobit(t_longint* l);
 char _longintsetsize(t_longint* l, unsigned bitlength);
 unsigned _longintadd(t_longint* l, unsigned summand);
 unsigned _longintmul(t_longint* l, unsigned factor);
+char _longintmulint(t_longint* product, t_longint* f1, t_longint* f2);
 
 #ifdef __cplusplus
 }
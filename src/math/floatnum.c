@@ -43,11 +43,18 @@
 
 #define NOSPECIALVALUE 1
 
-int maxdigits = MAXDIGITS;
-
-Error float_error;
-int expmax = EXPMAX;
-int expmin = EXPMIN;
+/* the evaluation state, one set per thread */
+FLOAT_THREADLOCAL int maxdigits = MAXDIGITS;
+
+static FLOAT_THREADLOCAL Error float_error = Success;
+static FLOAT_THREADLOCAL int expmax = EXPMAX;
+static FLOAT_THREADLOCAL int expmin = EXPMIN;
+static FLOAT_THREADLOCAL float_cancelcheck cancelcheck = NULL;
+static FLOAT_THREADLOCAL void* canceldata = NULL;
+static FLOAT_THREADLOCAL long workbudget = 0;
+static FLOAT_THREADLOCAL long workdone = 0;
+static FLOAT_THREADLOCAL long numberbudget = 0;
+static FLOAT_THREADLOCAL long numberbase = 0;
 
 /*  general helper routines  */
 
@@ -245,6 +252,84 @@ float_setprecision(
   return result;
 }
 
+void
+float_getcontext(
+  floatcontext* ctx)
+{
+  ctx->maxdigits = maxdigits;
+  ctx->maxexp = expmax;
+  ctx->error = float_error;
+}
+
+void
+float_setcontext(
+  const floatcontext* ctx)
+{
+  float_setprecision(ctx->maxdigits);
+  float_setrange(ctx->maxexp);
+  float_error = ctx->error;
+}
+
+void
+float_setcancelcheck(
+  float_cancelcheck check,
+  void* data)
+{
+  cancelcheck = check;
+  canceldata = data;
+}
+
+void
+float_setbudget(
+  long work,
+  long numbers)
+{
+  bc_alloc_stats stats;
+
+  bc_get_alloc_stats(&stats);
+  workbudget = work > 0? work : 0;
+  workdone = 0;
+  numberbudget = numbers > 0? numbers : 0;
+  numberbase = stats.live;
+}
+
+long
+float_workdone()
+{
+  return workdone;
+}
+
+static char
+_overbudget()
+{
+  bc_alloc_stats stats;
+
+  if (workbudget != 0 && workdone > workbudget)
+    return 1;
+  if (numberbudget == 0)
+    return 0;
+  bc_get_alloc_stats(&stats);
+  return stats.live - numberbase > numberbudget;
+}
+
+char
+float_charge(
+  long units)
+{
+  if (workbudget != 0)
+    workdone += units;
+  return !_overbudget();
+}
+
+char
+float_cancelled()
+{
+  if (!_overbudget() && (!cancelcheck || !cancelcheck(canceldata)))
+    return 0;
+  float_seterror(TooExpensive);
+  return 1;
+}
+
 /* checking the limits on exponents */
 char
 float_isvalidexp(
@@ -565,15 +650,13 @@ _corr_trailing_zeros(
   _hidelast(f, _bscandigit(f, _scaleof(f), 0));
 }
 
-static char hexdigits[] = "0123456789ABCDEF";
-
 int
 float_getsignificand(
   char* buf,
   int bufsz,
   cfloatnum f)
 {
-  int idx, lg;
+  int lg;
 
   if (bufsz <= 0)
     return 0;
@@ -587,10 +670,8 @@ float_getsignificand(
     *buf = '0';
     return 1;
   }
-  idx = -1;
   lg = _min(bufsz, float_getlength(f));
-  for(; ++idx < lg;)
-    *(buf++) = hexdigits[(int)float_getdigit(f, idx)];
+  bc_digits2ascii(buf, _valueof(f), lg);
   return lg;
 }
 
@@ -673,6 +754,26 @@ void _setvalue_(floatnum f)
 }
 #endif
 
+/* converts the n characters at buf to the digits at *dest,
+   as long as *lg is positive, and checks the others only */
+static int
+_ascii2digits(
+  char** dest,
+  int* lg,
+  const char* buf,
+  int n)
+{
+  int count;
+
+  count = _max(_min(*lg, n), 0);
+  if (!bc_ascii2digits(*dest, buf, count)
+      || !bc_ascii2digits(NULL, buf + count, n - count))
+    return FALSE;
+  *dest += count;
+  *lg -= count;
+  return TRUE;
+}
+
 int
 float_setsignificand(
   floatnum f,
@@ -687,7 +788,7 @@ float_setsignificand(
   char* bcp;
   int zeros;
   int lg;
-  char c;
+  int head;
 
   float_setnan(f);
   if (bufsz == NULLTERMINATED)
@@ -703,7 +804,7 @@ float_setsignificand(
 
   dot = memchr(buf, '.', bufsz);
   /* do not accept more than 1 dots */
-  if (dot != NULL && memchr(dot + 1, '.', bufsz - (dot - buf)) != NULL)
+  if (dot != NULL && memchr(dot + 1, '.', bufsz - (dot - buf) - 1) != NULL)
     return -1;
 
   last = buf + bufsz; /* points behind the input buffer */
@@ -758,20 +859,14 @@ float_setsignificand(
   /* copy lg digits into bc_num buffer,
      scan the rest for invalid characters */
   bcp = _valueof(f);
-  for(; --bufsz >= 0;)
+  head = dot != NULL && dot >= b? dot - b : bufsz;
+  if (!_ascii2digits(&bcp, &lg, b, head)
+      || (head < bufsz
+          && !_ascii2digits(&bcp, &lg, dot + 1, bufsz - head - 1)))
   {
-    c = *(b++);
-    if (c != '.') /* ignore a dot */
-    {
-      if (c < '0' || c > '9')
-      {
-        /* invalid character */
-        float_setnan(f);
-        return -1;
-      }
-      if (--lg >= 0)
-        *(bcp++) = c - '0';
-    }
+    /* invalid character */
+    float_setnan(f);
+    return -1;
   }
 
   if (leadingzeros != NULL)
@@ -965,6 +1060,16 @@ float_move(
   }
 }
 
+void
+float_shrink(
+  floatnum f)
+{
+  if (_is_special(f))
+    return;
+  _corr_trailing_zeros(f);
+  bc_shrink_num(f->significand);
+}
+
 /* creates a copy of <source> and assigns it to
    <dest>. The significand is guaranteed to have
    <scale>+1 digits. The <dest> significand is
@@ -1014,7 +1119,10 @@ float_copy(
   cfloatnum source,
   int digits)
 {
-  int scale, save;
+  bc_struct bc;
+  floatstruct tmp;
+  floatnum s;
+  int scale;
 
   if (digits == EXACT)
     digits = _max(1, float_getlength(source));
@@ -1028,13 +1136,18 @@ float_copy(
   }
   else
   {
-    // invariant: source has to be restored, if it is != dest
-    scale = _min(digits - 1, _scaleof(source));
-    save = _limit_scale((floatnum)source, scale);
-    _corr_trailing_zeros((floatnum)source);
-    _scaled_clone(dest, source, EXACT);
+    /* source is const, and may be read by other threads at the same
+       time, so digits are hidden in a working copy */
+    s = dest;
     if (dest != source)
-      _setscale(source, save);
+    {
+      _copyfn(&tmp, source, &bc);
+      s = &tmp;
+    }
+    scale = _min(digits - 1, _scaleof(s));
+    _limit_scale(s, scale);
+    _corr_trailing_zeros(s);
+    _scaled_clone(dest, s, EXACT);
   }
   return TRUE;
 }
@@ -1549,7 +1662,9 @@ float_sub(
   cfloatnum subtrahend,
   int scale)
 {
-  int result;
+  bc_struct bc;
+  floatstruct tmp;
+
   if (minuend == subtrahend)
   {
     /* changing the sign of one operand would change that of
@@ -1558,12 +1673,43 @@ float_sub(
       return FALSE;
     _setzero(dest);
   }
-  /* do not use float_neg, because it may change float_error */
-  float_setsign((floatnum)subtrahend, -float_getsign(subtrahend));
-  result = float_add(dest, minuend, subtrahend, scale);
-  if (dest != subtrahend)
-    float_setsign((floatnum)subtrahend, -float_getsign(subtrahend));
-  return result;
+  /* do not use float_neg, because it may change float_error.
+     The sign is changed on a working copy, unless subtrahend is
+     overwritten anyway */
+  if (dest == subtrahend)
+  {
+    float_setsign(dest, -float_getsign(dest));
+    return float_add(dest, minuend, dest, scale);
+  }
+  _copyfn(&tmp, subtrahend, &bc);
+  float_setsign(&tmp, -float_getsign(&tmp));
+  return float_add(dest, minuend, &tmp, scale);
+}
+
+/* checks whether f is +/-10^k, i.e. its significand is the single
+   digit 1 */
+static char
+_ispowerof10(
+  cfloatnum f)
+{
+  return !_is_special(f) && _scaleof(f) == 0 && *_valueof(f) == 1;
+}
+
+/* the product or quotient of <x> and a power of ten with exponent
+   <exp> and sign <sign>: a copy of <x>, truncated to <digits> as
+   bc_multiply and bc_divide would do, and moved by <exp> places */
+static char
+_scalebypowerof10(
+  floatnum dest,
+  cfloatnum x,
+  int exp,
+  signed char sign,
+  int digits)
+{
+  float_copy(dest, x, _min(digits, float_getlength(x)));
+  dest->exponent = exp;
+  float_setsign(dest, sign * float_getsign(dest));
+  return _normalize(dest);
 }
 
 char
@@ -1573,9 +1719,11 @@ float_mul(
   cfloatnum factor2,
   int digits)
 {
+  bc_struct bc1, bc2;
+  floatstruct tmp1, tmp2;
+  floatnum f1, f2;
   int result;
   int fullscale;
-  int savescale1, savescale2;
   int scale;
 
   /* handle a bunch of special cases */
@@ -1596,20 +1744,110 @@ float_mul(
     /* scale too large */
     return _seterror(dest, InvalidPrecision);
 
-  /* limit the scale of the operands to sane sizes */
-  savescale1 = _limit_scale((floatnum)factor1, scale);
-  savescale2 = _limit_scale((floatnum)factor2, scale);
+  /* unit prefixes and the like only move the point */
+  if (_ispowerof10(factor1))
+    return _scalebypowerof10(dest, factor2,
+                             factor1->exponent + factor2->exponent,
+                             float_getsign(factor1), scale + 1);
+  if (_ispowerof10(factor2))
+    return _scalebypowerof10(dest, factor1,
+                             factor1->exponent + factor2->exponent,
+                             float_getsign(factor2), scale + 1);
+
+  /* the work is that of the digits multiplied, which may be fewer
+     than those of the product */
+  if (!float_charge((long)_min(float_getlength(factor1), scale + 1)
+                    * _min(float_getlength(factor2), scale + 1)))
+    return _seterror(dest, TooExpensive);
+
+  /* limit the scale of the operands to sane sizes. The operands are
+     const, and may be read by other threads at the same time, so this
+     is done on working copies of those not overwritten anyway */
+  f1 = dest;
+  f2 = dest;
+  if (dest != factor1)
+  {
+    _copyfn(&tmp1, factor1, &bc1);
+    f1 = &tmp1;
+  }
+  if (dest != factor2)
+  {
+    _copyfn(&tmp2, factor2, &bc2);
+    f2 = &tmp2;
+  }
+  _limit_scale(f1, scale);
+  _limit_scale(f2, scale);
 
   /* multiply */
   dest->exponent = factor1->exponent + factor2->exponent;
-  bc_multiply(factor1->significand, factor2->significand, &(dest->significand), scale);
+  bc_multiply(f1->significand, f2->significand, &(dest->significand), scale);
   result = _normalize(dest);
+  return result;
+}
 
-  /* reverse order is necessary in case factor1 == factor2 */
-  if (dest != factor2)
-    _setscale(factor2, savescale2);
-  if (dest != factor1)
-    _setscale(factor1, savescale1);
+/* the precision the products of float_muladd and float_dot are kept
+   to: exact for factors of up to `digits' digits, so the sum with them
+   is rounded only once. */
+static int
+_productdigits(
+  int digits)
+{
+  if (digits == EXACT || digits > (maxdigits - 2) / 2)
+    return maxdigits;
+  return 2 * digits + 2;
+}
+
+char
+float_muladd(
+  floatnum dest,
+  cfloatnum factor1,
+  cfloatnum factor2,
+  cfloatnum summand,
+  int digits)
+{
+  floatstruct product;
+  char result;
+
+  if (!_checkdigits(digits, EXACT))
+    return _setnan(dest);
+  float_create(&product);
+  result = float_mul(&product, factor1, factor2, _productdigits(digits))
+           && float_add(dest, &product, summand, digits);
+  if (!result)
+    float_setnan(dest);
+  float_free(&product);
+  return result;
+}
+
+char
+float_dot(
+  floatnum dest,
+  int count,
+  cfloatnum* factors1,
+  cfloatnum* factors2,
+  int digits)
+{
+  floatstruct sum, product;
+  int prec, i;
+  char result;
+
+  if (!_checkdigits(digits, EXACT) || count <= 0)
+    return _seterror(dest, count <= 0? InvalidParam : InvalidPrecision);
+  prec = _productdigits(digits);
+  float_create(&sum);
+  float_create(&product);
+  float_setzero(&sum);
+  result = TRUE;
+  /* all but the last product are summed without rounding, as far as
+     maxdigits allows, the last addition rounds to the result */
+  for (i = 0; result && i < count; ++i)
+    result = float_mul(&product, factors1[i], factors2[i], prec)
+             && float_add(i == count - 1? dest : &sum, &sum, &product,
+                          i == count - 1? digits : maxdigits);
+  if (!result)
+    float_setnan(dest);
+  float_free(&sum);
+  float_free(&product);
   return result;
 }
 
@@ -1620,8 +1858,10 @@ float_div(
   cfloatnum divisor,
   int digits)
 {
+  bc_struct bc1, bc2;
+  floatstruct tmp1, tmp2;
+  floatnum f1, f2;
   int result;
-  int savescale1, savescale2;
   int exp;
 
   /* handle a bunch of special cases */
@@ -1648,27 +1888,41 @@ float_div(
   if(digits > maxdigits)
     return _seterror(dest, InvalidPrecision);
 
-  /* limit the scale of the operands to sane sizes */
-  savescale1 = _limit_scale((floatnum)dividend, digits);
-  savescale2 = _limit_scale((floatnum)divisor, digits);
+  if (_ispowerof10(divisor))
+    return _scalebypowerof10(dest, dividend, exp, float_getsign(divisor),
+                             digits + 1);
+
+  if (!float_charge((long)(digits + 1) * (digits + 1)))
+    return _seterror(dest, TooExpensive);
+
+  /* limit the scale of the operands to sane sizes, on working copies
+     as in float_mul */
+  f1 = dest;
+  f2 = dest;
+  if (dest != dividend)
+  {
+    _copyfn(&tmp1, dividend, &bc1);
+    f1 = &tmp1;
+  }
+  if (dest != divisor)
+  {
+    _copyfn(&tmp2, divisor, &bc2);
+    f2 = &tmp2;
+  }
+  _limit_scale(f1, digits);
+  _limit_scale(f2, digits);
 
   /* divide */
   result = TRUE;
   dest->exponent = exp;
-  bc_divide(dividend->significand,
-            divisor->significand,
+  bc_divide(f1->significand,
+            f2->significand,
             &(dest->significand),
             digits);
   if (bc_is_zero(dest->significand))
     float_setzero(dest);
   else
     result = _normalize(dest);
-
-  /* reverse order is necessary in case divisor == dividend */
-  if (dest != divisor)
-    _setscale(divisor, savescale2);
-  if (dest != dividend)
-    _setscale(dividend, savescale1);
   return result;
 }
 
@@ -1741,6 +1995,68 @@ float_divmod(
   return TRUE;
 }
 
+/* returns a new bc_num holding the integer <x> */
+static bc_num
+_int2bc(
+  cfloatnum x)
+{
+  bc_num result;
+
+  if (float_iszero(x))
+    return bc_copy_num(_zero_);
+  result = bc_new_num(x->exponent + 1, 0);
+  memcpy(result->n_value, _valueof(x), float_getlength(x));
+  result->n_sign = float_getsign(x) < 0? MINUS : PLUS;
+  return result;
+}
+
+static char
+_isint(
+  cfloatnum x)
+{
+  return float_iszero(x) || float_getlength(x) <= x->exponent + 1;
+}
+
+char
+float_raisemod(
+  floatnum dest,
+  cfloatnum base,
+  cfloatnum exponent,
+  cfloatnum modulus)
+{
+  bc_num b, e, m, r;
+
+  if (!_checknan(base) || !_checknan(exponent) || !_checknan(modulus))
+    return _setnan(dest);
+  if (!_isint(base) || !_isint(exponent) || !_isint(modulus))
+    return _seterror(dest, InvalidParam);
+  if (float_iszero(modulus))
+    return _seterror(dest, ZeroDivide);
+  if (float_getsign(exponent) < 0)
+    return _seterror(dest, OutOfDomain);
+  if (base->exponent >= maxdigits || exponent->exponent >= maxdigits
+      || modulus->exponent >= maxdigits)
+    return _seterror(dest, TooExpensive);
+
+  b = _int2bc(base);
+  e = _int2bc(exponent);
+  m = _int2bc(modulus);
+  r = NULL;
+  bc_raisemod(b, e, m, &r, 0);
+  bc_free_num(&b);
+  bc_free_num(&e);
+  bc_free_num(&m);
+  float_setnan(dest);
+  if (bc_is_zero(r))
+  {
+    bc_free_num(&r);
+    return _setzero(dest);
+  }
+  dest->significand = r;
+  dest->exponent = 0;
+  return _normalize(dest);
+}
+
 char
 float_sqrt(floatnum value, int digits)
 {
@@ -1769,3 +2085,51 @@ float_sqrt(floatnum value, int digits)
     value->exponent = -((1-value->exponent) >> 1);
   return TRUE;
 }
+
+char
+float_hypot(
+  floatnum dest,
+  cfloatnum x,
+  cfloatnum y,
+  int digits)
+{
+  bc_struct bc1, bc2;
+  floatstruct a, b;
+  cfloatnum f[2];
+  int exp;
+
+  if (!_checkdigits(digits, NOSPECIALVALUE)
+      || !_checknan(x) || !_checknan(y))
+    return _setnan(dest);
+  if (float_iszero(x)
+      || (!float_iszero(y) && x->exponent < y->exponent))
+  {
+    f[0] = x;
+    x = y;
+    y = f[0];
+  }
+  /* y is too small to show in the result */
+  if (float_iszero(y) || x->exponent - y->exponent > digits + 1)
+  {
+    float_copy(dest, x, EXACT);
+    float_abs(dest);
+    return TRUE;
+  }
+
+  /* move the larger operand to [1, 10), so the squares neither
+     overflow nor underflow, and move the result back */
+  exp = x->exponent;
+  _copyfn(&a, x, &bc1);
+  _copyfn(&b, y, &bc2);
+  a.exponent = 0;
+  b.exponent = y->exponent - exp;
+  f[0] = &a;
+  f[1] = &b;
+  if (!float_dot(dest, 2, f, f, _min(digits + 2, maxdigits))
+      || !float_sqrt(dest, digits))
+    return _setnan(dest);
+  if (!float_isvalidexp(dest->exponent + exp))
+    return _seterror(dest, Overflow);
+  dest->exponent += exp;
+  return TRUE;
+}
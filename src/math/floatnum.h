@@ -47,7 +47,31 @@
 extern "C" {
 #endif
 
-extern int maxdigits;
+#if defined(_MSC_VER)
+# define FLOAT_THREADLOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+# define FLOAT_THREADLOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+# define FLOAT_THREADLOCAL _Thread_local
+#else
+# define FLOAT_THREADLOCAL
+#endif
+
+/* the precision limit of the calling thread, see float_setprecision.
+   Like the exponent range and the error state, it is kept per thread,
+   so that several threads can evaluate independently. The routines
+   never change a cfloatnum operand, not even for a while, so constants
+   like cPi may be read by several threads at once; a number one thread
+   writes must not be used by another meanwhile */
+extern FLOAT_THREADLOCAL int maxdigits;
+
+/* a snapshot of the evaluation state of a thread: precision limit,
+   exponent range and pending error */
+typedef struct {
+  int maxdigits;
+  int maxexp;
+  Error error;
+} floatcontext;
 
 typedef struct {
   bc_num significand;
@@ -60,16 +84,20 @@ typedef struct {
 typedef floatstruct* floatnum;
 typedef const floatstruct* cfloatnum;
 
+/* asked by long running computations whether they should give up.
+   A non-zero return value aborts the computation */
+typedef int (*float_cancelcheck)(void* data);
+
 typedef enum {TONEAREST, TOZERO, TOINFINITY, TOPLUSINFINITY, TOMINUSINFINITY} roundmode;
 
 /* initializes this module. Has to be called prior to the first
    use of any of the following functions */
 void floatnum_init();
 
-/* sets the error to `code' unless it is already set */
+/* sets the error of the calling thread to `code' unless it is already set */
 void float_seterror(Error code);
 
-/* gets the last error and clears the error afterwards */
+/* gets the last error of the calling thread and clears the error afterwards */
 Error float_geterror();
 
 /* returns the current overflow limit. It is the maximum possible
@@ -102,6 +130,48 @@ int float_getprecision();
    This function never reports an error */
 int float_setprecision(int digits);
 
+/* copies the evaluation state of the calling thread into `ctx'.
+   The error state is left unchanged.
+   This function never reports an error */
+void float_getcontext(floatcontext* ctx);
+
+/* replaces the evaluation state of the calling thread with `ctx'.
+   Precision and range are limited as in float_setprecision and
+   float_setrange. Use it to give a worker thread the settings of the
+   thread that started it, or to restore a state saved with
+   float_getcontext.
+   This function never reports an error */
+void float_setcontext(const floatcontext* ctx);
+
+/* installs `check' as the cancellation test of the calling thread.
+   `data' is passed to it unchanged. Pass NULL to remove the test.
+   This function never reports an error */
+void float_setcancelcheck(float_cancelcheck check, void* data);
+
+/* limits the work of the calling thread from now on. `work' counts
+   digit operations: a multiplication or division of n digit operands
+   costs n*n units. `numbers' limits the numbers allocated after this
+   call and still alive, so it bounds the memory in use. 0 removes a
+   limit. Once a budget is exceeded, multiplications and divisions fail
+   with TooExpensive, and so does float_cancelled.
+   This function never reports an error */
+void float_setbudget(long work, long numbers);
+
+/* returns the work units charged since the last float_setbudget. Work
+   is only counted while a work budget is set.
+   This function never reports an error */
+long float_workdone();
+
+/* charges `units' of work to the budget of the calling thread. Returns
+   0 if a budget is exceeded then, 1 otherwise.
+   This function never reports an error */
+char float_charge(long units);
+
+/* polled by long running loops. Returns 1 and sets the error
+   TooExpensive, if the cancellation test of the calling thread asks
+   to stop or a budget is exceeded, 0 otherwise */
+char float_cancelled();
+
 /* checks whether the submitted exponent is within the current overflow and
    underflow limits.
    This function never reports an error */
@@ -278,6 +348,14 @@ char float_copy(floatnum dest, cfloatnum source, int digits);
    This function never reports an error */
 void float_move(floatnum dest, floatnum source);
 
+/* releases the memory of `f' not needed to hold its value: trailing
+   zeros are cut off, and the significand is moved to a buffer of
+   exactly its length. The value of `f' is not changed. Meant for
+   values that are kept for a long time, since a later operation on
+   `f' may need to allocate anew.
+   This function never reports an error */
+void float_shrink(floatnum f);
+
 /* changes the value of `f' to -`f'. Has no effect on zero or NaN.
    A return value of 0 indicates an error.
    errors: NaNOperand  */
@@ -381,6 +459,26 @@ char float_sub(floatnum dest, cfloatnum minuend, cfloatnum subtrahend,
 char float_mul(floatnum dest, cfloatnum factor1, cfloatnum factor2,
   int digits);
 
+/* multiplies both factors and adds `summand' to the product, storing
+   the result in `dest'. `dest' may coincide with any operand. The
+   product is not rounded, for factors of up to `digits' digits, so the
+   result is rounded once, like that of float_add, to `digits' or
+   `digits'+1 digits, or, if `digits' == EXACT, to full scale (if
+   possible). The conditions and errors are those of float_mul and
+   float_add. */
+char float_muladd(floatnum dest, cfloatnum factor1, cfloatnum factor2,
+  cfloatnum summand, int digits);
+
+/* stores the sum of the `count' products factors1[i]*factors2[i] in
+   `dest', which may coincide with any operand. As with float_muladd,
+   the products and their partial sums are not rounded, up to
+   `maxdigits' digits, and only the result is, to `digits' or
+   `digits'+1 digits. `count' must be positive.
+   The conditions and errors are those of float_mul and float_add, and
+   a `count' <= 0 is an InvalidParam. */
+char float_dot(floatnum dest, int count, cfloatnum* factors1,
+  cfloatnum* factors2, int digits);
+
 /* divides `dividend' by `divisor' and stores the result in `dest'. `dest'
    may coincide with either operand (or even both). The result is
    evaluated to `digits' or `digits'+1 digits, or, if `digits' == INTQUOT,
@@ -425,6 +523,25 @@ char float_div(floatnum dest, cfloatnum dividend, cfloatnum divisor,
 char float_divmod(floatnum quotient, floatnum remainder, cfloatnum dividend,
   cfloatnum divisor, int digits);
 
+/* computes `base' raised to the power of `exponent', reduced modulo
+   `modulus', and stores the result in `dest'. `dest' may coincide with
+   any operand. All operands have to be integers, and the result is exact
+   and takes the sign of the power, like in float_divmod. The intermediate
+   powers are never materialized, so huge exponents are cheap.
+   NaN is returned, if
+   - (at least) one operand is NaN, or not an integer;
+   - the modulus is zero;
+   - the exponent is negative;
+   - an operand has more than `maxdigits' digits.
+   A return value of 0 indicates an error.
+   errors: NaNOperand
+           InvalidParam
+           TooExpensive
+           OutOfDomain
+           ZeroDivide */
+char float_raisemod(floatnum dest, cfloatnum base, cfloatnum exponent,
+  cfloatnum modulus);
+
 /* computes the sqare root of `value' to `digits' or `digits'+1 digits.
    `digits' == EXACT is not allowed, even if the argument is a square.
    NaN is returned, if
@@ -437,6 +554,20 @@ char float_divmod(floatnum quotient, floatnum remainder, cfloatnum dividend,
            OutOfDomain */
 char float_sqrt(floatnum value, int digits);
 
+/* computes sqrt(x*x + y*y) to `digits' or `digits'+1 digits, and stores
+   it in `dest', which may coincide with any operand. The operands are
+   scaled by their exponent, so the result is only out of range if it
+   does not fit itself.
+   NaN is returned, if
+   - an operand is NaN,
+   - `digits' exceeds `maxdigits'
+   - the result overflows.
+   A return value 0 indicates an error.
+   errors: NaNOperand
+           InvalidPrecision
+           Overflow */
+char float_hypot(floatnum dest, cfloatnum x, cfloatnum y, int digits);
+
 /* a few convenience functions used everywhere */
 
 char _setnan(floatnum result);
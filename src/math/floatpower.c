@@ -41,8 +41,11 @@ _raise(
   cfloatnum exponent,
   int digits)
 {
+  floatstruct tmp;
   int iexp;
   int extra;
+  int prec;
+  char result;
 
   extra = float_getexponent(exponent);
   if (digits + extra > maxdigits)
@@ -53,6 +56,25 @@ _raise(
     if (float_iszero(exponent) || iexp !=  0)
       return _raisei(x, iexp, digits+extra);
   }
+  else
+  {
+    /* x^(k+1/2) = x^k * sqrt(x), without a logarithm */
+    float_create(&tmp);
+    float_add(&tmp, exponent, exponent, EXACT);
+    iexp = float_isinteger(&tmp)?
+           leadingdigits(&tmp, float_getexponent(&tmp) + 1) : 0;
+    if (iexp != 0)
+    {
+      prec = extra > 0? digits+extra : digits;
+      float_copy(&tmp, x, prec);
+      result = float_sqrt(&tmp, prec)
+               && _raisei(x, (iexp - 1) / 2, prec)
+               && float_mul(x, x, &tmp, prec);
+      float_free(&tmp);
+      return result;
+    }
+    float_free(&tmp);
+  }
   if (digits + extra > MATHPRECISION)
     extra = MATHPRECISION - digits;
   _ln(x, digits+extra);
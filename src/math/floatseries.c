@@ -32,12 +32,309 @@
 #include "floatconst.h"
 #include "floatcommon.h"
 #include "floatexp.h"
+#include <stdlib.h>
+#include <string.h>
 
 /* Though all these serieses can be used with arguments |x| < 1 or
    even more, the computation time increases rapidly with x.
    Tests show, that for 100 digit results, it is best to limit x
    to |x| < 0.01..0.02, and use reduction formulas for greater x */
 
+/*============================   binary splitting   ======================*/
+
+/* For long results, summing up term by term costs a full precision
+   multiplication per term. Instead, the series are split into short
+   chunks of the argument (x = a1 + a2 + ..., where a chunk has about
+   as many digits as it has leading zeros), and each chunk series is
+   summed up over integers by binary splitting, with a single final
+   division. An argument a = m*10^(-s) yields the terms
+
+     a(k)/b(k) * p(1)*...*p(k) / (q(1)*...*q(k)),
+     p(k) = +/- m*m,  q(k) = qi(k)*10^(2*s),
+
+   with qi(k), b(k) depending on the series */
+
+typedef enum { SPLIT_ATAN, SPLIT_COS, SPLIT_SIN } t_splitkind;
+
+typedef struct {
+  bc_num p;
+  bc_num q;
+  bc_num b;
+  bc_num t;
+  int qexp;
+} t_split;
+
+/* appends <shift> zeros to the integer <n> */
+static void
+_bcshift(
+  bc_num* n,
+  int shift)
+{
+  bc_num r;
+
+  if (shift == 0 || bc_is_zero(*n))
+    return;
+  r = bc_new_num((*n)->n_len + shift, 0);
+  r->n_sign = (*n)->n_sign;
+  memcpy(r->n_value, (*n)->n_value, (*n)->n_len);
+  memset(r->n_value + (*n)->n_len, 0, shift);
+  bc_free_num(n);
+  *n = r;
+}
+
+static void
+_bctofloat(
+  floatnum x,
+  bc_num n)
+{
+  char* buf;
+  int lg, i, leadingzeros;
+
+  if (bc_is_zero(n))
+  {
+    float_setzero(x);
+    return;
+  }
+  lg = n->n_len + n->n_scale;
+  buf = (char*)malloc(lg);
+  for (i = 0; i < lg; ++i)
+    buf[i] = n->n_value[i] + '0';
+  float_setsignificand(x, &leadingzeros, buf, lg);
+  float_setexponent(x, n->n_len - 1 - leadingzeros);
+  float_setsign(x, n->n_sign == MINUS? -1 : 1);
+  free(buf);
+}
+
+/* the terms n1 <= k < n2. <needp> is 0, if the caller does not use
+   the product of the p(k) */
+static void
+_split(
+  t_split* r,
+  int n1,
+  int n2,
+  bc_num p,
+  int qexp,
+  t_splitkind kind,
+  char needp)
+{
+  t_split l, h;
+  bc_num tmp;
+  int m;
+
+  if (n2 - n1 == 1)
+  {
+    r->p = bc_copy_num(p);
+    r->t = bc_copy_num(p);
+    bc_init_num(&r->q);
+    bc_init_num(&r->b);
+    switch (kind)
+    {
+    case SPLIT_ATAN:
+      bc_int2num(&r->q, 1);
+      bc_int2num(&r->b, 2*n1 + 1);
+      break;
+    case SPLIT_COS:
+      bc_int2num(&r->q, (2*n1 - 1) * (2*n1));
+      bc_int2num(&r->b, 1);
+      break;
+    default:
+      bc_int2num(&r->q, (2*n1) * (2*n1 + 1));
+      bc_int2num(&r->b, 1);
+    }
+    r->qexp = qexp;
+    return;
+  }
+  m = (n1 + n2) / 2;
+  _split(&l, n1, m, p, qexp, kind, 1);
+  _split(&h, m, n2, p, qexp, kind, needp);
+  /* T = B(h)*Q(h)*T(l) + B(l)*P(l)*T(h) */
+  bc_init_num(&tmp);
+  bc_init_num(&r->t);
+  bc_multiply(h.b, h.q, &tmp, 0);
+  bc_multiply(tmp, l.t, &tmp, 0);
+  _bcshift(&tmp, h.qexp);
+  bc_multiply(l.b, l.p, &r->t, 0);
+  bc_multiply(r->t, h.t, &r->t, 0);
+  bc_add(r->t, tmp, &r->t, 0);
+  bc_init_num(&r->p);
+  if (needp)
+    bc_multiply(l.p, h.p, &r->p, 0);
+  bc_init_num(&r->q);
+  bc_multiply(l.q, h.q, &r->q, 0);
+  bc_init_num(&r->b);
+  bc_multiply(l.b, h.b, &r->b, 0);
+  r->qexp = l.qexp + h.qexp;
+  bc_free_num(&tmp);
+  bc_free_num(&l.p);
+  bc_free_num(&l.q);
+  bc_free_num(&l.b);
+  bc_free_num(&l.t);
+  bc_free_num(&h.p);
+  bc_free_num(&h.q);
+  bc_free_num(&h.b);
+  bc_free_num(&h.t);
+}
+
+/* sets <x> to the sum over k >= 1 of
+   SPLIT_ATAN: (+/- a*a)^k / (2k+1)
+   SPLIT_COS:  (+/- a*a)^k / (2k)!
+   SPLIT_SIN:  (+/- a*a)^k / (2k+1)!
+   <a> must be a short chunk with |a| < 0.01 */
+static void
+_splitsum(
+  floatnum x,
+  cfloatnum a,
+  int digits,
+  t_splitkind kind,
+  char alternating)
+{
+  t_split r;
+  floatstruct den;
+  bc_num m;
+  char* buf;
+  int lg, scale, terms;
+
+  lg = float_getlength(a);
+  scale = lg - 1 - float_getexponent(a);
+  /* |a| < 10^(exp+1), so every term adds 2*(-exp-1) digits */
+  terms = (digits + 2) / (2 * (-float_getexponent(a) - 1)) + 1;
+  buf = (char*)malloc(lg + 1);
+  float_getsignificand(buf, lg, a);
+  buf[lg] = 0;
+  bc_init_num(&m);
+  bc_str2num(&m, buf, 0);
+  free(buf);
+  bc_multiply(m, m, &m, 0);
+  if (alternating)
+    m->n_sign = MINUS;
+  _split(&r, 1, terms + 1, m, 2 * scale, kind, 0);
+  bc_multiply(r.b, r.q, &r.q, 0);
+  float_create(&den);
+  _bctofloat(x, r.t);
+  _bctofloat(&den, r.q);
+  float_div(x, x, &den, digits);
+  float_addexp(x, -r.qexp);
+  float_free(&den);
+  bc_free_num(&m);
+  bc_free_num(&r.p);
+  bc_free_num(&r.q);
+  bc_free_num(&r.b);
+  bc_free_num(&r.t);
+}
+
+/* arctan/artanh x = arctan/artanh a + arctan/artanh((x-a)/(1+/-ax)).
+   Each chunk a takes as many digits as it has leading zeros, so the
+   remainder roughly doubles its leading zeros in every step */
+static void
+_arctansplit(
+  floatnum x,
+  int digits,
+  char alternating)
+{
+  floatstruct rem, a, smd, sum, tmp;
+  int prec, expx;
+
+  prec = digits + 3;
+  expx = float_getexponent(x);
+  float_create(&rem);
+  float_create(&a);
+  float_create(&smd);
+  float_create(&sum);
+  float_create(&tmp);
+  float_copy(&rem, x, prec);
+  float_setzero(&sum);
+  while (!float_iszero(&rem)
+         && 2*(float_getexponent(&rem)+1) >= -digits
+         && float_getexponent(&rem) >= expx - prec)
+  {
+    float_round(&a, &rem, -float_getexponent(&rem), TOZERO);
+    _splitsum(&smd, &a, prec, SPLIT_ATAN, alternating);
+    float_muladd(&smd, &smd, &a, &a, prec);
+    float_add(&sum, &sum, &smd, prec);
+    /* 1 -/+ a*rem */
+    if (!alternating)
+      float_neg(&rem);
+    float_muladd(&tmp, &a, &rem, &c1, prec);
+    if (!alternating)
+      float_neg(&rem);
+    float_sub(&rem, &rem, &a, EXACT);
+    float_div(&rem, &rem, &tmp, prec);
+  }
+  /* arctan/artanh rem is approx.== rem */
+  float_add(x, &sum, &rem, digits+1);
+  float_free(&rem);
+  float_free(&a);
+  float_free(&smd);
+  float_free(&sum);
+  float_free(&tmp);
+}
+
+/* cos/cosh(u+a) - 1 = C + c + C*c -/+ S*s,
+   sin/sinh(u+a) = S + s + S*c + C*s,
+   where C = cos/cosh u - 1, S = sin/sinh u, c and s the same of a.
+   The chunks a are taken from x (x = a1 + a2 + ...) as in
+   _arctansplit */
+static void
+_cosminus1split(
+  floatnum x,
+  int digits,
+  char alternating)
+{
+  floatstruct rem, a, c, sn, cs, ss, tmp;
+  cfloatnum factors1[6], factors2[6];
+  int prec, expx;
+
+  prec = digits + 3;
+  expx = float_getexponent(x);
+  float_create(&rem);
+  float_create(&a);
+  float_create(&c);
+  float_create(&sn);
+  float_create(&cs);
+  float_create(&ss);
+  float_create(&tmp);
+  /* C*c + S*s, then S*c + C*s + S*1 + s*1 */
+  factors1[0] = &cs; factors2[0] = &c;
+  factors1[1] = &ss; factors2[1] = &sn;
+  factors1[2] = &ss; factors2[2] = &c;
+  factors1[3] = &cs; factors2[3] = &sn;
+  factors1[4] = &ss; factors2[4] = &c1;
+  factors1[5] = &sn; factors2[5] = &c1;
+  float_copy(&rem, x, prec);
+  float_setzero(&cs);
+  float_setzero(&ss);
+  while (!float_iszero(&rem) && float_getexponent(&rem) >= expx - prec)
+  {
+    float_round(&a, &rem, -float_getexponent(&rem), TOZERO);
+    float_sub(&rem, &rem, &a, EXACT);
+    _splitsum(&c, &a, prec, SPLIT_COS, alternating);
+    _splitsum(&sn, &a, prec, SPLIT_SIN, alternating);
+    float_muladd(&sn, &sn, &a, &a, prec);
+    /* C*c -/+ S*s, and S + S*c + C*s + s, each rounded once */
+    if (alternating)
+      float_neg(&sn);
+    float_dot(&tmp, 2, factors1, factors2, prec);
+    if (alternating)
+      float_neg(&sn);
+    float_dot(&ss, 4, factors1 + 2, factors2 + 2, prec);
+    float_add(&cs, &cs, &c, prec);
+    float_add(&cs, &cs, &tmp, prec);
+  }
+  /* the rest changes cos u - 1 by -/+ S*rem */
+  if (alternating)
+    float_neg(&rem);
+  float_muladd(x, &ss, &rem, &cs, digits+1);
+  float_free(&rem);
+  float_free(&a);
+  float_free(&c);
+  float_free(&sn);
+  float_free(&cs);
+  float_free(&ss);
+  float_free(&tmp);
+}
+
+/*============================   term by term   ==========================*/
+
 /* the Taylor series of arctan/arctanh x at x == 0. For small
    |x| < 0.01 this series converges very fast, yielding 4 or
    more digits of the result with every summand. The working
@@ -78,6 +375,11 @@ arctanseries(
   if (float_iszero(x) || 2*expx < -digits)
     /* for very tiny arguments arctan/arctanh x is approx.== x */
     return;
+  if (digits >= SERIESSPLITDIGITS && expx <= -1)
+  {
+    _arctansplit(x, digits, alternating);
+    return;
+  }
   float_create(&xsqr);
   float_create(&pwr);
   float_create(&smd);
@@ -133,6 +435,14 @@ cosminus1series(
   floatstruct sum, smd;
   int expsqrx, pwrsz, addsz, i;
 
+  /* two chunk series per step, so this pays off later than arctan */
+  if (digits >= 2*SERIESSPLITDIGITS && !float_iszero(x)
+      && float_getexponent(x) <= -2
+      && 2*float_getexponent(x) >= -digits)
+  {
+    _cosminus1split(x, digits, alternating);
+    return 1;
+  }
   expsqrx = 2 * float_getexponent(x);
   float_setexponent(x, 0);
   float_mul(x, x, x, digits+1);
@@ -33,6 +33,7 @@
 #include "floatseries.h"
 #include "floatconst.h"
 #include "floatcommon.h"
+#include <stdlib.h>
 
 /* evaluates arctan x for |x| <= 1
    relative error for a 100 digit result is 6e-100 */
@@ -50,8 +51,7 @@ _arctanlt1(
   reductions = 0;
   while(float_getexponent(x) >= -2)
   {
-    float_mul(&tmp, x, x, digits);
-    float_add(&tmp, &tmp, &c1, digits+2);
+    float_muladd(&tmp, x, x, &c1, digits+2);
     float_sqrt(&tmp, digits);
     float_add(&tmp, &tmp, &c1, digits+1);
     float_div(x, x, &tmp, digits);
@@ -73,6 +73,7 @@ _arctan(
 {
   signed char sgn;
 
+  floatmath_needpi();
   if (float_abscmp(x, &c1) > 0)
   {
     sgn = float_getsign(x);
@@ -120,8 +121,8 @@ _arcsinlt0_5(
   if (2*float_getexponent(x) < -digits)
     return;
   float_create(&tmp);
-  float_mul(&tmp, x, x, digits);
-  float_sub(&tmp, &c1, &tmp, digits);
+  float_muladd(&tmp, x, x, &cMinus1, digits);
+  float_neg(&tmp);
   float_sqrt(&tmp, digits);
   float_div(x, x, &tmp, digits+1);
   _arctanlt1(x, digits);
@@ -138,6 +139,7 @@ _arccos(
 {
   signed char sgn;
 
+  floatmath_needpi();
   sgn = float_getsign(x);
   float_abs(x);
   if (float_cmp(x, &c1Div2) > 0)
@@ -180,6 +182,7 @@ _arcsin(
 {
   signed char sgn;
 
+  floatmath_needpi();
   if (float_abscmp(x, &c1Div2) <= 0)
     _arcsinlt0_5(x, digits);
   else
@@ -287,6 +290,7 @@ _cos(
 {
   signed char sgn;
 
+  floatmath_needpi();
   float_abs(x);
   sgn = 1;
   if (float_cmp(x, &cPiDiv2) > 0)
@@ -334,6 +338,7 @@ _sin(
 {
   signed char sgn;
 
+  floatmath_needpi();
   sgn = float_getsign(x);
   float_abs(x);
   if (float_cmp(x, &cPiDiv2) > 0)
@@ -352,6 +357,58 @@ _sin(
   float_setsign(x, sgn);
 }
 
+/* evaluates sin x and cos x for |x| <= pi from a single
+   cos - 1 series. On return, x holds sin x, c holds cos x */
+void
+_sincos(
+  floatnum x,
+  floatnum c,
+  int digits)
+{
+  floatstruct tmp;
+  signed char sgn, csgn;
+  char swap;
+
+  floatmath_needpi();
+  sgn = float_getsign(x);
+  float_abs(x);
+  csgn = 1;
+  if (float_cmp(x, &cPiDiv2) > 0)
+  {
+    csgn = -1;
+    float_sub(x, &cPi, x, digits+1);
+  }
+  /* for pi/4 < x <= pi/2, sin and cos swap their roles */
+  swap = float_cmp(x, &cPiDiv4) > 0;
+  if (swap)
+    float_sub(x, &cPiDiv2, x, digits+1);
+  float_copy(c, x, EXACT);
+  if (2*float_getexponent(x)+2 < -digits || float_iszero(x))
+    /* for small x: sin x approx.== x, cos x approx.== 1 */
+    float_setzero(c);
+  else
+  {
+    /* |sin x| = sqrt((1-cos x)*(2 + cos x-1)) */
+    float_create(&tmp);
+    _cosminus1ltPiDiv4(c, digits);
+    float_add(&tmp, c, &c2, digits+1);
+    float_mul(x, c, &tmp, digits+1);
+    float_abs(x);
+    float_sqrt(x, digits);
+    float_free(&tmp);
+  }
+  float_add(c, c, &c1, digits);
+  if (swap)
+  {
+    float_create(&tmp);
+    float_move(&tmp, x);
+    float_move(x, c);
+    float_move(c, &tmp);
+  }
+  float_setsign(x, sgn);
+  float_setsign(c, csgn);
+}
+
 /* evaluates tan x for |x| <= pi.
    A return value of 0 indicates
    that x = +/- pi/2 within
@@ -364,6 +421,7 @@ _tan(
 {
   signed char sgn;
 
+  floatmath_needpi();
   sgn = float_getsign(x);
   float_abs(x);
   if (float_cmp(x, &cPiDiv2) > 0)
@@ -385,33 +443,93 @@ _tan(
   return 1;
 }
 
+/* reduces x modulo 2pi (Payne-Hanek). With x = m*10^q, m an integer,
+   x/(2pi) mod 1 depends on the digits of 1/(2pi) from place q+1 on
+   only, the leading ones yield integer multiples of x. So the work
+   depends on the length of x and the precision, not on its magnitude.
+   Near a multiple of pi/2 (where sin, cos or tan get small), the
+   reduction is repeated with the digits lost to cancellation added.
+   The digits of 1/(2pi) are cached in floatconst.c */
+
+#define TRIGGUARD 6
+
+static void
+_fracinvtwopi(
+  floatnum f,
+  bc_num m,
+  int q,
+  int scale)
+{
+  bc_num w;
+  char* buf;
+  int first, lg, i, leadingzeros;
+
+  first = q >= 0? q + 1 : 1;
+  w = floatmath_invtwopidigits(first, scale - first + 1);
+  bc_multiply(m, w, &w, 0);
+  /* the last scale - q digits are the fraction of x/(2pi) */
+  lg = scale - q;
+  buf = (char*)malloc(lg);
+  for (i = 0; i < lg; ++i)
+    buf[lg - i - 1] = i < w->n_len? w->n_value[w->n_len - i - 1] + '0' : '0';
+  float_setsignificand(f, &leadingzeros, buf, lg);
+  if (!float_iszero(f))
+    float_setexponent(f, -1 - leadingzeros);
+  free(buf);
+  bc_free_num(&w);
+}
+
 char
 _trigreduce(
   floatnum x,
   int digits)
 {
-  floatstruct tmp;
-  int expx, save;
+  floatstruct f, h;
+  bc_num m;
+  char* buf;
   signed char sgn;
-  char odd;
+  int expx, lg, q, scale, lost, prec;
 
+  floatmath_needpi();
   if (float_abscmp(x, &cPi) <= 0)
     return 1;
   expx = float_getexponent(x);
-  if (expx > float_getlength(&cPi) - digits)
+  if (expx > MAXDIGITS)
     return 0;
-  save = float_setprecision(MAXDIGITS);
-  float_create(&tmp);
   sgn = float_getsign(x);
-  float_abs(x);
-  float_divmod(&tmp, x, x, &cPi, INTQUOT);
-  float_setprecision(save);
-  odd = float_isodd(&tmp);
-  if (odd)
-    float_sub(x, x, &cPi, digits+1);
+  lg = float_getlength(x);
+  q = expx - lg + 1;
+  buf = (char*)malloc(lg + 1);
+  float_getsignificand(buf, lg, x);
+  buf[lg] = 0;
+  bc_init_num(&m);
+  bc_str2num(&m, buf, 0);
+  free(buf);
+  float_create(&f);
+  float_create(&h);
+  scale = expx + digits + TRIGGUARD;
+  _fracinvtwopi(&f, m, q, scale);
+  /* the distance to the nearest multiple of pi/2, in units of pi/2 */
+  float_muli(&h, &f, 4, digits);
+  float_frac(&h);
+  if (float_cmp(&h, &c1Div2) > 0)
+    float_sub(&h, &c1, &h, digits);
+  lost = float_iszero(&h)? digits : -float_getexponent(&h) - 1;
+  if (lost > 0)
+    _fracinvtwopi(&f, m, q, scale + lost);
+  if (float_cmp(&f, &c1Div2) > 0)
+    float_sub(&f, &f, &c1, EXACT);
+  /* the callers subtract x from pi/2 or pi, keep the digits
+     this cancels */
+  prec = digits + 1 + lost;
+  if (prec > maxdigits)
+    prec = maxdigits;
+  float_mul(x, &f, &c2Pi, prec);
   if (sgn < 0)
     float_neg(x);
-  float_free(&tmp);
+  float_free(&f);
+  float_free(&h);
+  bc_free_num(&m);
   return 1;
 }
 
@@ -422,6 +540,7 @@ _sinpix(
 {
   char odd;
 
+  floatmath_needpi();
   odd = float_isodd(x);
   float_frac(x);
   float_mul(x, &cPi, x, digits+1);
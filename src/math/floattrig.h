@@ -50,6 +50,7 @@ void _sinltPiDiv4(floatnum x, int digits);
 void _tanltPiDiv4(floatnum x, int digits);
 void _cos(floatnum x, int digits);
 void _sin(floatnum x, int digits);
+void _sincos(floatnum x, floatnum c, int digits);
 char _tan(floatnum x, int digits);
 char _cosminus1(floatnum x, int digits);
 char _trigreduce(floatnum x, int digits);
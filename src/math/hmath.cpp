@@ -26,20 +26,43 @@
 #include "floathmath.h"
 #include "rational.h"
 
+#include <QAtomicInt>
+#include <QDataStream>
 #include <QMap>
+#include <QMutex>
 #include <QString>
 #include <QStringList>
+#include <QVarLengthArray>
 
+#include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <sstream>
+#include <utility>
 
 #define RATIONAL_TOL HNumber("1e-20")
 
-//TODO make this configurable
-#define HMATH_WORKING_PREC (DECPRECISION + 3)
-#define HMATH_EVAL_PREC (HMATH_WORKING_PREC + 2)
+// The working precision is set at runtime, see HMath::setWorkingPrecision.
+// Results are rounded to HMATH_WORKING_PREC digits, the float_* calls
+// are evaluated with HMATH_EVAL_PREC, which adds the guard digits.
+#define HMATH_DEFAULT_WORKING_PREC (DECPRECISION + 3)
+#define HMATH_MIN_WORKING_PREC 6
+#define HMATH_WORKING_PREC s_workingPrec
+#define HMATH_EVAL_PREC s_evalPrec
+
+static constexpr int guardDigits(int prec)
+{
+    return 2 + prec / 100;
+}
+
+// Per thread like the floatnum context, so that evaluations running on
+// several threads at once may use different precisions.
+static FLOAT_THREADLOCAL int s_workingPrec = HMATH_DEFAULT_WORKING_PREC;
+static FLOAT_THREADLOCAL int s_evalPrec = HMATH_DEFAULT_WORKING_PREC
+                        + guardDigits(HMATH_DEFAULT_WORKING_PREC);
 
 //TODO should go into a separate format file
 // default scale for fall back in formatting
@@ -82,12 +105,12 @@ static char checkSub(floatnum dest, cfloatnum s1, cfloatnum s2, int digits)
 
 static void h_init()
 {
-    static bool h_initialized = false;
-    if (!h_initialized) {
-        h_initialized = true;
-        //TODO related to formats, get rid of it.
-        float_stdconvert();
-    }
+    // The floatnum precision, range and error state are per thread, the
+    // conversion tables are not. A local static is initialized once, even
+    // when several threads get here at the same time.
+    //TODO related to formats, get rid of it.
+    static const bool h_initialized = (float_stdconvert(), true);
+    Q_UNUSED(h_initialized);
 }
 
 static void checkpoleorzero(floatnum result, floatnum x)
@@ -113,37 +136,241 @@ static char roundResult(floatnum x)
 
 /*---------------------------   HNumberPrivate   --------------------*/
 
+static const int SmallDigits = 18;
+
+// The integral part of a number in [-2^64, 2^64) in the two's complement
+// form of floatlogic.c: the low 64 bits, and the sign all higher bits
+// repeat. Bitwise operations work on it without a t_longint.
+struct LogicWord {
+    quint64 bits;
+    bool negative;
+};
+
+// The value of one or more numbers: copies of a number share it until one
+// of them is changed, see HNumber::detach().
 class HNumberPrivate
 {
 public:
     HNumberPrivate();
     ~HNumberPrivate();
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+    floatnum fnum();
+    bool isNan() const;
+    bool setSmall(qint64 value);
+    bool toLogicWord(LogicWord* word) const;
+    void setLogicWord(const LogicWord& word);
     //TODO make this a variant
-    floatstruct fnum;
     Error error;
+    // Integers of up to SmallDigits digits are kept in smallValue, without
+    // a floatstruct. fnum() converts them when a float_* call needs them,
+    // also for a value other threads read at the same time.
+    std::atomic<bool> isSmall;
+    qint64 smallValue;
+    // The numbers sharing the value.
+    QAtomicInt ref;
+
+private:
+    floatstruct m_fnum;
 };
 
+// Every intermediate result creates and destroys an HNumberPrivate. Freed
+// ones are kept on a list of the calling thread and handed out again, so
+// that most of them never reach the heap. Like the free list of number.c,
+// the list is bounded and lives as long as its thread.
+namespace {
+
+struct FreePrivate {
+    FreePrivate* next;
+};
+
+const int MaxFreePrivates = 1024;
+thread_local FreePrivate* freePrivates = nullptr;
+thread_local int freePrivateCount = 0;
+
+}
+
+void* HNumberPrivate::operator new(size_t size)
+{
+    if (freePrivates && size == sizeof(HNumberPrivate)) {
+        FreePrivate* p = freePrivates;
+        freePrivates = p->next;
+        --freePrivateCount;
+        return p;
+    }
+    return ::operator new(size);
+}
+
+void HNumberPrivate::operator delete(void* p)
+{
+    if (!p)
+        return;
+    if (freePrivateCount >= MaxFreePrivates) {
+        ::operator delete(p);
+        return;
+    }
+    FreePrivate* f = static_cast<FreePrivate*>(p);
+    f->next = freePrivates;
+    freePrivates = f;
+    ++freePrivateCount;
+}
+
 HNumberPrivate::HNumberPrivate()
   : error(Success)
+  , isSmall(false)
+  , smallValue(0)
+  , ref(1)
 {
     h_init();
-    float_create(&fnum);
+    float_create(&m_fnum);
 }
 
 HNumberPrivate::~HNumberPrivate()
 {
-    float_free(&fnum);
+    float_free(&m_fnum);
+}
+
+// Returns the value as a floatnum, which the caller may modify. A small
+// integer is converted first and stops being small. Values read by several
+// threads, like the units, are converted by the first one to need it: the
+// lock keeps the others from converting at the same time, and they find
+// the floatstruct complete once isSmall is cleared.
+floatnum HNumberPrivate::fnum()
+{
+    if (isSmall.load(std::memory_order_acquire)) {
+        static QMutex mutex;
+        QMutexLocker locker(&mutex);
+        if (isSmall.load(std::memory_order_relaxed)) {
+            char buf[24];
+            sprintf(buf, "%lld", static_cast<long long>(smallValue));
+            float_setscientific(&m_fnum, buf, NULLTERMINATED);
+            isSmall.store(false, std::memory_order_release);
+        }
+    }
+    return &m_fnum;
+}
+
+bool HNumberPrivate::isNan() const
+{
+    return !isSmall && float_isnan(&m_fnum);
+}
+
+// Results are rounded to the working precision, so a small integer must
+// not have more digits than that.
+static qint64 smallLimit()
+{
+    static const qint64 powers[] = {
+        1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL,
+        10000000LL, 100000000LL, 1000000000LL, 10000000000LL,
+        100000000000LL, 1000000000000LL, 10000000000000LL,
+        100000000000000LL, 1000000000000000LL, 10000000000000000LL,
+        100000000000000000LL, 1000000000000000000LL
+    };
+    return powers[qMin(HMATH_WORKING_PREC, SmallDigits)];
+}
+
+// Stores value as a small integer. Returns false, leaving the number
+// unchanged, if it is too large for that.
+bool HNumberPrivate::setSmall(qint64 value)
+{
+    qint64 limit = smallLimit();
+    if (value >= limit || value <= -limit)
+        return false;
+    float_setnan(&m_fnum);
+    error = Success;
+    isSmall.store(true, std::memory_order_relaxed);
+    smallValue = value;
+    return true;
+}
+
+// Gets the integral part of the number, truncated like _floatnum2logic()
+// does. Returns false for NaN and for values outside the word range.
+bool HNumberPrivate::toLogicWord(LogicWord* word) const
+{
+    if (isSmall) {
+        word->bits = quint64(smallValue);
+        word->negative = smallValue < 0;
+        return true;
+    }
+    if (float_isnan(&m_fnum))
+        return false;
+    quint64 magnitude = 0;
+    if (!float_iszero(&m_fnum)) {
+        const quint64 max = std::numeric_limits<quint64>::max();
+        for (int i = 0; i <= float_getexponent(&m_fnum); ++i) {
+            quint64 digit = quint64(float_getdigit(&m_fnum, i));
+            if (magnitude > (max - digit) / 10)
+                return false;
+            magnitude = magnitude * 10 + digit;
+        }
+    }
+    // Like _floatnum2logic(), a negative fraction above -1 gives -1.
+    word->negative = float_getsign(&m_fnum) < 0;
+    word->bits = word->negative ? (magnitude ? ~magnitude + 1 : ~magnitude)
+                                : magnitude;
+    return true;
+}
+
+// Stores a word result, as a small integer if it has few enough digits.
+void HNumberPrivate::setLogicWord(const LogicWord& word)
+{
+    quint64 magnitude = word.negative ? ~word.bits + 1 : word.bits;
+    if (magnitude < quint64(smallLimit()) && (magnitude != 0 || !word.negative)) {
+        setSmall(word.negative ? -qint64(magnitude) : qint64(magnitude));
+        return;
+    }
+    char buf[24];
+    if (magnitude == 0) // -2^64 wraps around.
+        strcpy(buf, "-18446744073709551616");
+    else
+        sprintf(buf, "%s%llu", word.negative ? "-" : "",
+                static_cast<unsigned long long>(magnitude));
+    isSmall.store(false, std::memory_order_relaxed);
+    error = Success;
+    float_setscientific(&m_fnum, buf, NULLTERMINATED);
+    roundResult(&m_fnum);
+}
+
+// Small operands stay below 10^18 in magnitude, so that sums and
+// differences of two of them cannot overflow, and neither can negation.
+static bool mulSmall(qint64 a, qint64 b, qint64* r)
+{
+    qint64 ua = a < 0 ? -a : a;
+    qint64 ub = b < 0 ? -b : b;
+    if (ua != 0 && ub > std::numeric_limits<qint64>::max() / ua)
+        return false;
+    *r = a * b;
+    return true;
+}
+
+// Raises a small integer to a non-negative power by squaring, as long as
+// the intermediate results fit.
+static bool powSmall(qint64 base, qint64 exponent, qint64* r)
+{
+    qint64 power = 1;
+    for (;;) {
+        if ((exponent & 1) != 0 && !mulSmall(power, base, &power))
+            return false;
+        exponent >>= 1;
+        if (exponent == 0)
+            break;
+        if (!mulSmall(base, base, &base))
+            return false;
+    }
+    *r = power;
+    return true;
 }
 
 typedef char (*Float1ArgND)(floatnum x);
 typedef char (*Float1Arg)(floatnum x, int digits);
 typedef char (*Float2ArgsND)(floatnum result, cfloatnum p1, cfloatnum p2);
 typedef char (*Float2Args)(floatnum result, cfloatnum p1, cfloatnum p2, int digits);
+typedef char (*Float1Arg2Results)(floatnum x, floatnum y, int digits);
 
 static Error checkNaNParam(const HNumberPrivate& v1,
                             const HNumberPrivate* v2 = 0)
 {
-    if (!float_isnan(&v1.fnum) && (!v2 || !float_isnan(&v2->fnum)))
+    if (!v1.isNan() && (!v2 || !v2->isNan()))
         return Success;
     Error error = v1.error;
     if (error == Success && v2)
@@ -151,10 +378,11 @@ static Error checkNaNParam(const HNumberPrivate& v1,
     return error == 0? NoOperand : error;
 }
 
+// Moves the pending error of the calling thread into dest.
 void roundSetError(HNumberPrivate* dest)
 {
     dest->error = float_geterror();
-    floatnum dfnum = &dest->fnum;
+    floatnum dfnum = dest->fnum();
     if (dest->error != Success)
         float_setnan(dfnum);
     if (!float_isnan(dfnum))
@@ -165,8 +393,8 @@ void call2Args(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2, Flo
 {
     dest->error = checkNaNParam(*n1, n2);
     if (dest->error == Success) {
-        floatnum dfnum = &dest->fnum;
-        func(dfnum, &n1->fnum, &n2->fnum, HMATH_EVAL_PREC);
+        floatnum dfnum = dest->fnum();
+        func(dfnum, n1->fnum(), n2->fnum(), HMATH_EVAL_PREC);
         roundSetError(dest);
     }
 }
@@ -175,8 +403,8 @@ void call2ArgsND(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2, F
 {
     dest->error = checkNaNParam(*n1, n2);
     if (dest->error == Success) {
-        floatnum dfnum = &dest->fnum;
-        func(dfnum, &n1->fnum, &n2->fnum);
+        floatnum dfnum = dest->fnum();
+        func(dfnum, n1->fnum(), n2->fnum());
         roundSetError(dest);
     }
 }
@@ -185,8 +413,8 @@ void call1Arg(HNumberPrivate* dest, HNumberPrivate* n, Float1Arg func)
 {
     dest->error = checkNaNParam(*n);
     if (dest->error == Success) {
-        floatnum dfnum = &dest->fnum;
-        float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+        floatnum dfnum = dest->fnum();
+        float_copy(dfnum, n->fnum(), HMATH_EVAL_PREC);
         func(dfnum, HMATH_EVAL_PREC);
         roundSetError(dest);
     }
@@ -196,21 +424,46 @@ void call1ArgPoleCheck(HNumberPrivate* dest, HNumberPrivate* n, Float1Arg func)
 {
     dest->error = checkNaNParam(*n);
     if (dest->error == Success) {
-        floatnum dfnum = &dest->fnum;
-        float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+        floatnum dfnum = dest->fnum();
+        float_copy(dfnum, n->fnum(), HMATH_EVAL_PREC);
         if (func(dfnum, HMATH_EVAL_PREC))
-          checkpoleorzero(dfnum, &n->fnum);
+          checkpoleorzero(dfnum, n->fnum());
         roundSetError(dest);
     }
 }
 
+// Evaluates func on a copy of n in dest1, func stores its second result in
+// dest2. Both results see the same error.
+void call1Arg2Results(HNumberPrivate* dest1, HNumberPrivate* dest2,
+                      HNumberPrivate* n, Float1Arg2Results func, bool poleCheck)
+{
+    dest1->error = checkNaNParam(*n);
+    if (dest1->error != Success) {
+        dest2->error = dest1->error;
+        float_setnan(dest2->fnum());
+        return;
+    }
+    floatnum dfnum1 = dest1->fnum();
+    floatnum dfnum2 = dest2->fnum();
+    float_copy(dfnum1, n->fnum(), HMATH_EVAL_PREC);
+    if (func(dfnum1, dfnum2, HMATH_EVAL_PREC) && poleCheck) {
+        checkpoleorzero(dfnum1, n->fnum());
+        checkpoleorzero(dfnum2, n->fnum());
+    }
+    Error error = float_geterror();
+    float_seterror(error);
+    roundSetError(dest1);
+    float_seterror(error);
+    roundSetError(dest2);
+}
+
 void call1ArgND(HNumberPrivate* dest, HNumberPrivate* n, Float1ArgND func)
 {
     dest->error = checkNaNParam(*n);
     if (dest->error == Success)
     {
-        floatnum dfnum = &dest->fnum;
-        float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+        floatnum dfnum = dest->fnum();
+        float_copy(dfnum, n->fnum(), HMATH_EVAL_PREC);
         func(dfnum);
         roundSetError(dest);
     }
@@ -246,11 +499,20 @@ HNumber::HNumber() : d(new HNumberPrivate)
 }
 
 /**
- * Copies from another number.
+ * Copies from another number. The value is shared until one of them
+ * changes, the copy costs no digits.
+ */
+HNumber::HNumber(const HNumber& hn) : d(hn.d)
+{
+    d->ref.ref();
+}
+
+/**
+ * Takes over the value of another number, which is left as NaN.
  */
-HNumber::HNumber(const HNumber& hn) : d(new HNumberPrivate)
+HNumber::HNumber(HNumber&& hn) : d(hn.d)
 {
-    operator=(hn);
+    hn.d = new HNumberPrivate;
 }
 
 /**
@@ -258,7 +520,8 @@ HNumber::HNumber(const HNumber& hn) : d(new HNumberPrivate)
  */
 HNumber::HNumber(int i) : d(new HNumberPrivate)
 {
-    float_setinteger(&d->fnum, i);
+    d->isSmall.store(true, std::memory_order_relaxed);
+    d->smallValue = i;
 }
 
 /**
@@ -269,7 +532,7 @@ HNumber::HNumber(const char* str) : d(new HNumberPrivate)
     t_itokens tokens;
 
     if ((d->error = parse(&tokens, &str)) == Success && *str == 0)
-        d->error = float_in(&d->fnum, &tokens);
+        d->error = float_in(d->fnum(), &tokens);
     float_geterror();
 }
 
@@ -284,7 +547,49 @@ HNumber::HNumber(const QJsonObject& json)
  */
 HNumber::~HNumber()
 {
-    delete d;
+    if (!d->ref.deref())
+        delete d;
+}
+
+/**
+ * Gives this number a value of its own, before it is changed in place.
+ * Copies share the value, and the float_* calls change a destination
+ * they are handed; the results of the operators are new numbers and need
+ * no detach().
+ */
+void HNumber::detach()
+{
+    if (d->ref.loadAcquire() == 1)
+        return;
+    HNumberPrivate* copy = new HNumberPrivate;
+    if (!d->isSmall)
+        float_copy(copy->fnum(), d->fnum(), EXACT);
+    copy->error = d->error;
+    copy->isSmall.store(d->isSmall, std::memory_order_relaxed);
+    copy->smallValue = d->smallValue;
+    if (!d->ref.deref())
+        delete d;
+    d = copy;
+}
+
+/**
+ * Releases the memory the value does not need, for a number that is kept
+ * for a long time, like a variable. Integers that fit become small, the
+ * significand of other numbers loses its trailing zeros and is moved to
+ * a buffer of its exact length. The value is not changed, rounding it to
+ * fewer digits is up to the caller.
+ */
+void HNumber::squeeze()
+{
+    if (d->isSmall || d->isNan())
+        return;
+    detach();
+    floatnum f = d->fnum();
+    LogicWord word;
+    if (float_isinteger(f) && float_getexponent(f) < SmallDigits
+        && d->toLogicWord(&word) && d->setSmall(qint64(word.bits)))
+        return;
+    float_shrink(f);
 }
 
 /**
@@ -300,7 +605,7 @@ Error HNumber::error() const
  */
 bool HNumber::isNan() const
 {
-    return float_isnan(&d->fnum) != 0;
+    return d->isNan();
 }
 
 /**
@@ -308,7 +613,9 @@ bool HNumber::isNan() const
  */
 bool HNumber::isZero() const
 {
-    return float_iszero(&d->fnum) != 0;
+    if (d->isSmall)
+        return d->smallValue == 0;
+    return float_iszero(d->fnum()) != 0;
 }
 
 /**
@@ -316,7 +623,9 @@ bool HNumber::isZero() const
  */
 bool HNumber::isPositive() const
 {
-    return float_getsign(&d->fnum) > 0;
+    if (d->isSmall)
+        return d->smallValue > 0;
+    return float_getsign(d->fnum()) > 0;
 }
 
 /**
@@ -324,7 +633,9 @@ bool HNumber::isPositive() const
  */
 bool HNumber::isNegative() const
 {
-    return float_getsign(&d->fnum) < 0;
+    if (d->isSmall)
+        return d->smallValue < 0;
+    return float_getsign(d->fnum()) < 0;
 }
 
 /**
@@ -332,7 +643,7 @@ bool HNumber::isNegative() const
  */
 bool HNumber::isInteger() const
 {
-    return float_isinteger(&d->fnum) != 0;
+    return d->isSmall || float_isinteger(d->fnum()) != 0;
 }
 
 void HNumber::serialize(QJsonObject& json) const
@@ -351,6 +662,83 @@ HNumber HNumber::deSerialize(const QJsonObject& json)
     return result;
 }
 
+namespace {
+
+enum BinaryTag { BinaryNan, BinarySmall, BinaryFloat };
+
+}
+
+// A tag is followed by the error of a NaN, the value of a small integer,
+// or the sign, exponent and significand of any other number, with two
+// decimal digits to a byte.
+void HNumber::serialize(QDataStream& stream) const
+{
+    if (d->isSmall) {
+        stream << quint8(BinarySmall) << qint64(d->smallValue);
+        return;
+    }
+    if (d->isNan()) {
+        stream << quint8(BinaryNan) << qint32(d->error);
+        return;
+    }
+
+    const floatnum f = d->fnum();
+    const int length = float_getlength(f);
+    QByteArray packed((length + 1) / 2, 0);
+    for (int i = 0; i < length; ++i)
+        packed[i / 2] = packed.at(i / 2) | (float_getdigit(f, i) << (i % 2 ? 0 : 4));
+    stream << quint8(BinaryFloat) << qint8(float_getsign(f))
+           << qint32(float_getexponent(f)) << qint32(length) << packed;
+}
+
+HNumber HNumber::deSerialize(QDataStream& stream)
+{
+    HNumber result;
+    quint8 tag;
+    stream >> tag;
+    if (tag == BinarySmall) {
+        qint64 value;
+        stream >> value;
+        if (stream.status() == QDataStream::Ok && !result.d->setSmall(value)) {
+            // Too many digits for the current working precision.
+            char buf[24];
+            sprintf(buf, "%lld", static_cast<long long>(value));
+            float_setscientific(result.d->fnum(), buf, NULLTERMINATED);
+        }
+    } else if (tag == BinaryNan) {
+        qint32 error;
+        stream >> error;
+        result.d->error = Error(error);
+    } else if (tag == BinaryFloat) {
+        qint8 sign;
+        qint32 exponent, length;
+        QByteArray packed;
+        stream >> sign >> exponent >> length >> packed;
+        if (stream.status() != QDataStream::Ok || length < 0
+            || packed.size() != (length + 1) / 2)
+        {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return HNumber();
+        }
+        const floatnum f = result.d->fnum();
+        if (length == 0) {
+            float_setzero(f);
+            return result;
+        }
+        QByteArray digits(length, '0');
+        for (int i = 0; i < length; ++i)
+            digits[i] = '0' + ((quint8(packed.at(i / 2)) >> (i % 2 ? 0 : 4)) & 0xF);
+        float_setsignificand(f, nullptr, digits.constData(), length);
+        float_setexponent(f, exponent);
+        float_setsign(f, sign);
+    } else {
+        stream.setStatus(QDataStream::ReadCorruptData);
+    }
+    if (stream.status() != QDataStream::Ok)
+        return HNumber();
+    return result;
+}
+
 /**
  * Returns the number as an int.
  * It is meant to convert small (integer) numbers only and no
@@ -358,7 +746,9 @@ HNumber HNumber::deSerialize(const QJsonObject& json)
  */
 int HNumber::toInt() const
 {
-    return float_asinteger(&d->fnum);
+    if (d->isSmall)
+        return static_cast<int>(d->smallValue);
+    return float_asinteger(d->fnum());
 }
 
 /**
@@ -366,10 +756,20 @@ int HNumber::toInt() const
  */
 HNumber& HNumber::operator=(const HNumber& hn)
 {
-    d->error = hn.error();
-
-    float_copy(&d->fnum, &hn.d->fnum, EXACT);
+    hn.d->ref.ref();
+    if (!d->ref.deref())
+        delete d;
+    d = hn.d;
+    return *this;
+}
 
+/**
+ * Takes over the value of another number. The other number receives the
+ * old value of this one.
+ */
+HNumber& HNumber::operator=(HNumber&& hn)
+{
+    std::swap(d, hn.d);
     return *this;
 }
 
@@ -384,6 +784,9 @@ HNumber HNumber::operator+(const HNumber& num) const
     if (num.isZero())
         return *this;
     HNumber result;
+    if (d->isSmall && num.d->isSmall
+        && result.d->setSmall(d->smallValue + num.d->smallValue))
+        return result;
     call2Args(result.d, d, num.d, checkAdd);
     return result;
 }
@@ -402,6 +805,9 @@ HNumber& HNumber::operator+=(const HNumber& num)
 HNumber operator-(const HNumber& n1, const HNumber& n2)
 {
     HNumber result;
+    if (n1.d->isSmall && n2.d->isSmall
+        && result.d->setSmall(n1.d->smallValue - n2.d->smallValue))
+        return result;
     call2Args(result.d, n1.d, n2.d, checkSub);
     return result;
 }
@@ -420,6 +826,11 @@ HNumber& HNumber::operator-=(const HNumber& num)
 HNumber HNumber::operator*(const HNumber& num) const
 {
     HNumber result;
+    qint64 product;
+    if (d->isSmall && num.d->isSmall
+        && mulSmall(d->smallValue, num.d->smallValue, &product)
+        && result.d->setSmall(product))
+        return result;
     call2Args(result.d, d, num.d, float_mul);
     return result;
 }
@@ -456,6 +867,10 @@ HNumber& HNumber::operator/=(const HNumber& num)
 HNumber HNumber::operator%(const HNumber& num) const
 {
     HNumber result;
+    // Both truncate the quotient towards zero.
+    if (d->isSmall && num.d->isSmall && num.d->smallValue != 0
+        && result.d->setSmall(d->smallValue % num.d->smallValue))
+        return result;
     call2Args(result.d, d, num.d, modwrap);
     return result;
 }
@@ -465,7 +880,9 @@ HNumber HNumber::operator%(const HNumber& num) const
  */
 int HNumber::compare(const HNumber& other) const
 {
-    int result = float_relcmp(&d->fnum, &other.d->fnum, HMATH_EVAL_PREC-1);
+    if (d->isSmall && other.d->isSmall)
+        return d->smallValue < other.d->smallValue ? -1 : d->smallValue > other.d->smallValue;
+    int result = float_relcmp(d->fnum(), other.d->fnum(), HMATH_EVAL_PREC-1);
     float_geterror(); // clears error, if one operand was a NaN
     return result;
 }
@@ -525,6 +942,12 @@ bool operator!=(const HNumber& l, const HNumber& r)
 HNumber HNumber::operator&(const HNumber& num) const
 {
     HNumber result;
+    LogicWord x, y;
+    if (d->toLogicWord(&x) && num.d->toLogicWord(&y)) {
+        LogicWord r = { x.bits & y.bits, x.negative && y.negative };
+        result.d->setLogicWord(r);
+        return result;
+    }
     call2ArgsND(result.d, d, num.d, float_and);
     return result;
 }
@@ -545,6 +968,12 @@ HNumber& HNumber::operator&=(const HNumber& num)
 HNumber HNumber::operator|(const HNumber& num) const
 {
     HNumber result;
+    LogicWord x, y;
+    if (d->toLogicWord(&x) && num.d->toLogicWord(&y)) {
+        LogicWord r = { x.bits | y.bits, x.negative || y.negative };
+        result.d->setLogicWord(r);
+        return result;
+    }
     call2ArgsND(result.d, d, num.d, float_or);
     return result;
 }
@@ -565,6 +994,12 @@ HNumber& HNumber::operator|=(const HNumber& num)
 HNumber HNumber::operator^(const HNumber& num) const
 {
     HNumber result;
+    LogicWord x, y;
+    if (d->toLogicWord(&x) && num.d->toLogicWord(&y)) {
+        LogicWord r = { x.bits ^ y.bits, x.negative != y.negative };
+        result.d->setLogicWord(r);
+        return result;
+    }
     call2ArgsND(result.d, d, num.d, float_xor);
     return result;
 }
@@ -585,6 +1020,12 @@ HNumber& HNumber::operator^=(const HNumber& num)
 HNumber HNumber::operator~() const
 {
     HNumber result;
+    LogicWord x;
+    if (d->toLogicWord(&x)) {
+        LogicWord r = { ~x.bits, !x.negative };
+        result.d->setLogicWord(r);
+        return result;
+    }
     call1ArgND(result.d, d, float_not);
     return result;
 }
@@ -595,6 +1036,8 @@ HNumber HNumber::operator~() const
 HNumber operator-(const HNumber& x)
 {
     HNumber result;
+    if (x.d->isSmall && result.d->setSmall(-x.d->smallValue))
+        return result;
     call1ArgND(result.d, x.d, float_neg);
     return result;
 }
@@ -609,6 +1052,18 @@ HNumber operator-(const HNumber& x)
 HNumber HNumber::operator<<(const HNumber& num) const
 {
     HNumber result;
+    LogicWord x, count;
+    if (num.isInteger() && num.d->toLogicWord(&count) && !count.negative
+        && count.bits > 0 && count.bits < 64 && d->toLogicWord(&x)) {
+        // The bits shifted out of the word must all repeat the sign.
+        const int n = int(count.bits);
+        const quint64 out = x.bits >> (64 - n);
+        if (out == (x.negative ? (Q_UINT64_C(1) << n) - 1 : 0)) {
+            LogicWord r = { x.bits << n, x.negative };
+            result.d->setLogicWord(r);
+            return result;
+        }
+    }
     call2ArgsND(result.d, d, num.d, float_shl);
     return result;
 }
@@ -624,6 +1079,15 @@ HNumber HNumber::operator<<(const HNumber& num) const
 HNumber HNumber::operator>>(const HNumber& num) const
 {
     HNumber result;
+    LogicWord x, count;
+    if (num.isInteger() && num.d->toLogicWord(&count) && !count.negative
+        && count.bits > 0 && count.bits < 64 && d->toLogicWord(&x)) {
+        const int n = int(count.bits);
+        const quint64 fill = x.negative ? ~Q_UINT64_C(0) << (64 - n) : 0;
+        LogicWord r = { x.bits >> n | fill, x.negative };
+        result.d->setLogicWord(r);
+        return result;
+    }
     call2ArgsND(result.d, d, num.d, float_shr);
     return result;
 }
@@ -740,13 +1204,15 @@ HNumber::Format HNumber::Format::Sexagesimal()
 
 namespace {
 
-char* _doFormat(cfloatnum x, signed char base, signed char expbase, char outmode, int prec, unsigned flags)
+// The text is assembled in a buffer on the stack, and converted to UTF-16
+// only once. A null string means the format failed.
+QString _doFormat(cfloatnum x, signed char base, signed char expbase, char outmode, int prec, unsigned flags)
 {
     t_otokens tokens;
     char intbuf[BINPRECISION+1];
     char fracbuf[BINPRECISION+1];
     int sz = 0;
-    char* str = nullptr;
+    QString str;
     switch (base) {
     case 2:
         sz = BINPRECISION+1;
@@ -772,8 +1238,9 @@ char* _doFormat(cfloatnum x, signed char base, signed char expbase, char outmode
     if (float_out(&tokens, &tmp, prec, base, outmode) == Success)
     {
         sz = cattokens(nullptr, -1, &tokens, expbase, flags);
-        str = (char*)malloc(sz);
-        cattokens(str, sz, &tokens, expbase, flags);
+        QVarLengthArray<char, 2 * BINPRECISION> text(sz);
+        cattokens(text.data(), sz, &tokens, expbase, flags);
+        str = QString::fromLatin1(text.constData(), sz - 1);
     }
     float_free(&tmp);
     return str;
@@ -781,9 +1248,8 @@ char* _doFormat(cfloatnum x, signed char base, signed char expbase, char outmode
 
 /**
  * Formats the given number as string, using specified decimal digits.
- * Note that the returned string must be freed.
  */
-char* formatFixed(cfloatnum x, int prec, int base = 10)
+QString formatFixed(cfloatnum x, int prec, int base = 10)
 {
     unsigned flags = IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT + IO_FLAG_SUPPRESS_EXPZERO;
     if (base != 10)
@@ -792,15 +1258,14 @@ char* formatFixed(cfloatnum x, int prec, int base = 10)
         flags |= IO_FLAG_SUPPRESS_TRL_ZERO;
         prec = HMATH_MAX_SHOWN;
     }
-    char* result = _doFormat(x, base, base, IO_MODE_FIXPOINT, prec, flags);
-    return result ? result : _doFormat(x, base, base, IO_MODE_SCIENTIFIC, HMATH_MAX_SHOWN, flags);
+    QString result = _doFormat(x, base, base, IO_MODE_FIXPOINT, prec, flags);
+    return !result.isNull() ? result : _doFormat(x, base, base, IO_MODE_SCIENTIFIC, HMATH_MAX_SHOWN, flags);
 }
 
 /**
  * Formats the given number as string, in scientific format.
- * Note that the returned string must be freed.
  */
-char* formatScientific(cfloatnum x, int prec, int base = 10)
+QString formatScientific(cfloatnum x, int prec, int base = 10)
 {
     unsigned flags = IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT + IO_FLAG_SUPPRESS_EXPPLUS;
     if (base != 10)
@@ -814,9 +1279,8 @@ char* formatScientific(cfloatnum x, int prec, int base = 10)
 
 /**
  * Formats the given number as string, in engineering notation.
- * Note that the returned string must be freed.
  */
-char* formatEngineering(cfloatnum x, int prec, int base = 10)
+QString formatEngineering(cfloatnum x, int prec, int base = 10)
 {
     unsigned flags = IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_EXPPLUS;
     if (base != 10)
@@ -830,14 +1294,13 @@ char* formatEngineering(cfloatnum x, int prec, int base = 10)
 
 /**
  * Formats the given number as string, using specified decimal digits.
- * Note that the returned string must be freed.
  */
-char* formatGeneral(cfloatnum x, int prec, int base = 10)
+QString formatGeneral(cfloatnum x, int prec, int base = 10)
 {
     // find the exponent and the factor
     int expd = float_getexponent(x);
 
-    char* str;
+    QString str;
     if (expd > 5)
         str = formatScientific(x, prec, base);
     else if (expd < -4)
@@ -858,7 +1321,7 @@ char* formatGeneral(cfloatnum x, int prec, int base = 10)
  */
 QString HMath::format(const HNumber& hn, HNumber::Format format)
 {
-    char* rs = 0;
+    QString rs;
 
     if (format.precision < 0)  // This includes PrecisionNull
         format.precision = -1;
@@ -883,25 +1346,58 @@ QString HMath::format(const HNumber& hn, HNumber::Format format)
 
     switch (format.mode) {
     case HNumber::Format::Mode::Fixed:
-        rs = formatFixed(&hn.d->fnum, format.precision, base);
+        rs = formatFixed(hn.d->fnum(), format.precision, base);
         break;
     case HNumber::Format::Mode::Scientific:
-        rs = formatScientific(&hn.d->fnum, format.precision, base) ;
+        rs = formatScientific(hn.d->fnum(), format.precision, base) ;
         break;
     case HNumber::Format::Mode::Engineering:
-        rs = formatEngineering(&hn.d->fnum, format.precision, base);
+        rs = formatEngineering(hn.d->fnum(), format.precision, base);
         break;
     case HNumber::Format::Mode::Sexagesimal:
-        rs = formatFixed(&hn.d->fnum, format.precision, base);
+        rs = formatFixed(hn.d->fnum(), format.precision, base);
         break;
     case HNumber::Format::Mode::General:
     default:
-        rs = formatGeneral(&hn.d->fnum, format.precision, base);
+        rs = formatGeneral(hn.d->fnum(), format.precision, base);
     }
 
-    QString result(rs);
-    free(rs);
-    return result;
+    return rs;
+}
+
+// The constants and the angle conversion factors at the evaluation
+// precision. They are built on first use and again whenever the working
+// precision changes, and kept per thread like the rest of the floatnum
+// state, so handing them out copies nothing.
+struct HMath::Constants {
+    int precision = -1;
+    HNumber pi, e, phi;
+    HNumber degToRad, radToDeg, gonToRad, radToGon;
+    HNumber halfSqrt2, halfSqrt3; // sin(45°) and sin(60°).
+};
+
+const HMath::Constants& HMath::constants()
+{
+    static thread_local Constants c;
+    if (c.precision != HMATH_EVAL_PREC) {
+        floatmath_needpi();
+        floatmath_needlogs();
+        // Numbers copied from the old constants keep their values.
+        c.pi.detach();
+        c.e.detach();
+        c.phi.detach();
+        float_copy(c.pi.d->fnum(), &cPi, HMATH_EVAL_PREC);
+        float_copy(c.e.d->fnum(), &cExp, HMATH_EVAL_PREC);
+        float_copy(c.phi.d->fnum(), &cPhi, HMATH_EVAL_PREC);
+        c.degToRad = c.pi / HNumber(180);
+        c.radToDeg = HNumber(180) / c.pi;
+        c.gonToRad = c.pi / HNumber(200);
+        c.radToGon = HNumber(200) / c.pi;
+        c.halfSqrt2 = sqrt(HNumber(2)) / HNumber(2);
+        c.halfSqrt3 = sqrt(HNumber(3)) / HNumber(2);
+        c.precision = HMATH_EVAL_PREC;
+    }
+    return c;
 }
 
 /**
@@ -909,7 +1405,7 @@ QString HMath::format(const HNumber& hn, HNumber::Format format)
  */
 HNumber HMath::rad2deg(const HNumber& angle)
 {
-    return angle * (HNumber(180) / HMath::pi());
+    return angle.isZero() ? angle : angle * constants().radToDeg;
 }
 
 /**
@@ -917,7 +1413,7 @@ HNumber HMath::rad2deg(const HNumber& angle)
  */
 HNumber HMath::deg2rad(const HNumber& angle)
 {
-    return angle * (HMath::pi() / HNumber(180));
+    return angle.isZero() ? angle : angle * constants().degToRad;
 }
 
 /**
@@ -925,7 +1421,7 @@ HNumber HMath::deg2rad(const HNumber& angle)
  */
 HNumber HMath::rad2gon(const HNumber& angle)
 {
-    return angle * (HNumber(200) / HMath::pi());
+    return angle.isZero() ? angle : angle * constants().radToGon;
 }
 
 /**
@@ -933,37 +1429,106 @@ HNumber HMath::rad2gon(const HNumber& angle)
  */
 HNumber HMath::gon2rad(const HNumber& angle)
 {
-    return angle * (HMath::pi() / HNumber(200));
+    return angle.isZero() ? angle : angle * constants().gonToRad;
+}
+
+/**
+ * Returns the number of significant digits results of the calling thread
+ * are rounded to.
+ */
+int HMath::workingPrecision()
+{
+    return HMATH_WORKING_PREC;
+}
+
+/**
+ * Returns the working precision used when none is set.
+ */
+int HMath::defaultWorkingPrecision()
+{
+    return HMATH_DEFAULT_WORKING_PREC;
+}
+
+/**
+ * Returns the highest working precision the floatnum functions can
+ * serve, guard digits included.
+ */
+int HMath::maxWorkingPrecision()
+{
+    int prec = MATHPRECISION - 2;
+    while (prec + guardDigits(prec) > MATHPRECISION)
+        --prec;
+    return prec;
+}
+
+/**
+ * Sets the number of significant digits results of the calling thread
+ * are rounded to. The guard digits are derived from it. A value <= 0 restores the default,
+ * others are clamped to the supported range. Returns the previous
+ * working precision.
+ */
+int HMath::setWorkingPrecision(int prec)
+{
+    int save = HMATH_WORKING_PREC;
+    if (prec <= 0)
+        prec = HMATH_DEFAULT_WORKING_PREC;
+    else if (prec < HMATH_MIN_WORKING_PREC)
+        prec = HMATH_MIN_WORKING_PREC;
+    else if (prec > maxWorkingPrecision())
+        prec = maxWorkingPrecision();
+    s_workingPrec = prec;
+    s_evalPrec = prec + guardDigits(prec);
+    return save;
+}
+
+/**
+ * Returns the heap the calling thread keeps for numbers to come: the freed
+ * HNumberPrivates and the free lists of number.c.
+ */
+long HMath::freeListBytes()
+{
+    bc_alloc_stats stats;
+    bc_get_alloc_stats(&stats);
+    return freePrivateCount * long(sizeof(HNumberPrivate)) + stats.cached_bytes;
+}
+
+/**
+ * Returns the free lists of the calling thread to the heap. They fill up
+ * again as numbers are freed.
+ */
+void HMath::trimFreeLists()
+{
+    while (freePrivates) {
+        FreePrivate* p = freePrivates;
+        freePrivates = p->next;
+        ::operator delete(p);
+    }
+    freePrivateCount = 0;
+    bc_trim_free_list();
 }
 
 /**
  * Returns the constant e (Euler's number).
  */
-HNumber HMath::e()
+const HNumber& HMath::e()
 {
-    HNumber value;
-    float_copy(&value.d->fnum, &cExp, HMATH_EVAL_PREC);
-    return value;
+    return constants().e;
 }
 
 /**
  * Returns the constant Pi.
  */
-HNumber HMath::pi()
+const HNumber& HMath::pi()
 {
-    HNumber value;
-    float_copy(&value.d->fnum, &cPi, HMATH_EVAL_PREC);
-    return value;
+    return constants().pi;
 }
 
 /**
  * Returns the constant Phi (golden number).
  */
-HNumber HMath::phi()
+const HNumber& HMath::phi()
 {
-    HNumber value;
-    float_copy(&value.d->fnum, &cPhi, HMATH_EVAL_PREC);
-    return value;
+    return constants().phi;
 }
 
 /**
@@ -982,7 +1547,7 @@ HNumber HMath::nan(Error error)
  */
 HNumber HMath::max(const HNumber& n1, const HNumber& n2)
 {
-    switch (float_cmp(&n1.d->fnum, &n2.d->fnum))
+    switch (float_cmp(n1.d->fnum(), n2.d->fnum()))
     {
         case 0:
         case 1:  return n1;
@@ -996,7 +1561,7 @@ HNumber HMath::max(const HNumber& n1, const HNumber& n2)
  */
 HNumber HMath::min(const HNumber& n1, const HNumber& n2)
 {
-    switch (float_cmp(&n1.d->fnum, &n2.d->fnum))
+    switch (float_cmp(n1.d->fnum(), n2.d->fnum()))
     {
         case 0:
         case 1:  return n2;
@@ -1011,6 +1576,8 @@ HNumber HMath::min(const HNumber& n1, const HNumber& n2)
 HNumber HMath::abs(const HNumber& n)
 {
     HNumber result;
+    if (n.d->isSmall && result.d->setSmall(n.d->smallValue < 0 ? -n.d->smallValue : n.d->smallValue))
+        return result;
     call1ArgND(result.d, n.d, float_abs);
     return result;
 }
@@ -1023,7 +1590,8 @@ HNumber HMath::round(const HNumber& n, int prec)
     if (n.isNan())
         return HMath::nan(checkNaNParam(*n.d));
     HNumber result(n);
-    floatnum rnum = &result.d->fnum;
+    result.detach();
+    floatnum rnum = result.d->fnum();
     int exp = float_getexponent(rnum);
 
     // Avoid exponent overflow later.
@@ -1047,7 +1615,8 @@ HNumber HMath::trunc(const HNumber& n, int prec)
     if (n.isNan())
         return HMath::nan(checkNaNParam(*n.d));
     HNumber result(n);
-    floatnum rnum = &result.d->fnum;
+    result.detach();
+    floatnum rnum = result.d->fnum();
     int exp = float_getexponent(rnum);
     // Avoid exponent overflow later on.
     if (prec > HMATH_WORKING_PREC && exp > 0)
@@ -1088,7 +1657,8 @@ HNumber HMath::frac(const HNumber& n)
 
 #define RETURN_IF_NEAR_INT \
     HNumber nearest_int(n); \
-    float_roundtoint(&nearest_int.d->fnum, TONEAREST); \
+    nearest_int.detach(); \
+    float_roundtoint(nearest_int.d->fnum(), TONEAREST); \
     /* Note: float_relcmp doesn't work here, because it's doesn't check the relative */ \
     /* tolerance if exponents are not the same. */ \
     /* FIXME: Put this value as parameter. */ \
@@ -1106,7 +1676,8 @@ HNumber HMath::floor(const HNumber& n)
     RETURN_IF_NEAR_INT;
     // Actual rounding, if needed.
     HNumber r(n);
-    float_roundtoint(&r.d->fnum, TOMINUSINFINITY);
+    r.detach();
+    float_roundtoint(r.d->fnum(), TOMINUSINFINITY);
     return r;
 }
 
@@ -1119,10 +1690,70 @@ HNumber HMath::ceil(const HNumber& n)
     RETURN_IF_NEAR_INT;
     // Actual rounding, if needed.
     HNumber r(n);
-    float_roundtoint(&r.d->fnum, TOPLUSINFINITY);
+    r.detach();
+    float_roundtoint(r.d->fnum(), TOPLUSINFINITY);
     return r;
 }
 
+// The value of a non-negative integer below 10^18.
+static quint64 toWord(cfloatnum x)
+{
+    quint64 value = 0;
+    if (float_iszero(x))
+        return value;
+    for (int i = 0; i <= float_getexponent(x); ++i)
+        value = value * 10 + quint64(float_getdigit(x, i));
+    return value;
+}
+
+// Sets dest to the greatest common divisor of the integers x and y.
+// Euclid's steps run on floatnums, without an HNumber per step, until both
+// numbers are below 10^18. The rest is left to the binary GCD on machine
+// words.
+static char integerGcd(floatnum dest, cfloatnum x, cfloatnum y)
+{
+    floatstruct s1, s2, s3, q;
+    float_create(&s1);
+    float_create(&s2);
+    float_create(&s3);
+    float_create(&q);
+    floatnum a = &s1;
+    floatnum b = &s2;
+    floatnum r = &s3;
+    char result = float_copy(a, x, EXACT) && float_copy(b, y, EXACT);
+    float_abs(a);
+    float_abs(b);
+    while (result && !float_iszero(b)
+           && (float_getexponent(a) >= 18 || float_getexponent(b) >= 18)) {
+        result = !float_cancelled()
+            && float_divmod(&q, r, a, b, INTQUOT);
+        floatnum t = a;
+        a = b;
+        b = r;
+        r = t;
+    }
+    if (result) {
+        if (float_iszero(b))
+            float_copy(dest, a, EXACT);
+        else {
+            char buf[24];
+            sprintf(buf, "%llu", static_cast<unsigned long long>(
+                Rational::gcd(toWord(a), toWord(b))));
+            float_setscientific(dest, buf, NULLTERMINATED);
+        }
+    }
+    float_free(&s1);
+    float_free(&s2);
+    float_free(&s3);
+    float_free(&q);
+    return result;
+}
+
+static char gcdwrap(floatnum result, cfloatnum p1, cfloatnum p2, int /*digits*/)
+{
+    return integerGcd(result, p1, p2);
+}
+
 /**
  * Returns the greatest common divisor of n1 and n2.
  */
@@ -1135,26 +1766,28 @@ HNumber HMath::gcd(const HNumber& n1, const HNumber& n2)
         return HMath::nan(TypeMismatch);
     }
 
-    HNumber a = abs(n1);
-    HNumber b = abs(n2);
-
-    if (a == 0)
-        return b;
-    if (b == 0)
-        return a;
-
-    // Run Euclidean algorithm.
-    while (true) {
-        a = a % b;
-
-        if (a == 0)
-            return b;
-
-        b = b % a;
-
-        if (b == 0)
-            return a;
+    HNumber result;
+    if (n1.d->isSmall && n2.d->isSmall) {
+        const qint64 a = n1.d->smallValue;
+        const qint64 b = n2.d->smallValue;
+        result.d->setSmall(qint64(Rational::gcd(a < 0 ? -a : a,
+                                                b < 0 ? -b : b)));
+        return result;
     }
+    call2Args(result.d, n1.d, n2.d, gcdwrap);
+    return result;
+}
+
+/**
+ * Returns the least common multiple of n1 and n2, which is 0 if one of
+ * them is 0.
+ */
+HNumber HMath::lcm(const HNumber& n1, const HNumber& n2)
+{
+    HNumber divisor = gcd(n1, n2);
+    if (divisor.isNan() || divisor.isZero())
+        return divisor;
+    return abs(idiv(n1, divisor) * n2);
 }
 
 /**
@@ -1163,12 +1796,97 @@ HNumber HMath::gcd(const HNumber& n1, const HNumber& n2)
 HNumber HMath::idiv(const HNumber& dividend, const HNumber& divisor)
 {
     HNumber result;
+    if (dividend.d->isSmall && divisor.d->isSmall && divisor.d->smallValue != 0
+        && result.d->setSmall(dividend.d->smallValue / divisor.d->smallValue))
+        return result;
     call2ArgsND(result.d, dividend.d, divisor.d, idivwrap);
     if (result.error() == TooExpensive)
         result.d->error = Overflow;
     return result;
 }
 
+/**
+ * Returns sqrt(x*x + y*y), without overflowing or underflowing in the
+ * squares.
+ */
+HNumber HMath::hypot(const HNumber& x, const HNumber& y)
+{
+    if (x.isZero())
+        return abs(y);
+    if (y.isZero())
+        return abs(x);
+    HNumber result;
+    call2Args(result.d, x.d, y.d, float_hypot);
+    return result;
+}
+
+/**
+ * Returns a*b + c*d. The products are not rounded, so the sum is rounded
+ * only once and loses no digits when they cancel. A cancellation beyond
+ * the working precision still gives zero, as with a subtraction.
+ */
+HNumber HMath::sumOfProducts(const HNumber& a, const HNumber& b,
+                             const HNumber& c, const HNumber& d)
+{
+    HNumber result;
+    qint64 p, q;
+    if (a.d->isSmall && b.d->isSmall && c.d->isSmall && d.d->isSmall
+        && mulSmall(a.d->smallValue, b.d->smallValue, &p)
+        && mulSmall(c.d->smallValue, d.d->smallValue, &q)
+        && (q >= 0 ? p <= std::numeric_limits<qint64>::max() - q
+                   : p >= std::numeric_limits<qint64>::min() - q)
+        && result.d->setSmall(p + q))
+        return result;
+    result.d->error = checkNaNParam(*a.d, b.d);
+    if (result.d->error == Success)
+        result.d->error = checkNaNParam(*c.d, d.d);
+    if (result.d->error != Success)
+        return result;
+
+    cfloatnum factors1[2] = { a.d->fnum(), c.d->fnum() };
+    cfloatnum factors2[2] = { b.d->fnum(), d.d->fnum() };
+    floatnum r = result.d->fnum();
+    if (float_dot(r, 2, factors1, factors2, HMATH_EVAL_PREC)
+        && !float_iszero(r) && !float_iszero(factors1[0])
+        && !float_iszero(factors2[0]) && !float_iszero(factors1[1])
+        && !float_iszero(factors2[1]))
+    {
+        // The exponents of the products, give or take one.
+        const int expr = float_getexponent(r);
+        const int exp1 = float_getexponent(factors1[0])
+                         + float_getexponent(factors2[0]);
+        const int exp2 = float_getexponent(factors1[1])
+                         + float_getexponent(factors2[1]);
+        if (exp1 - expr >= HMATH_WORKING_PREC - 1
+            || exp2 - expr >= HMATH_WORKING_PREC - 1)
+            float_setzero(r);
+    }
+    roundSetError(result.d);
+    return result;
+}
+
+/**
+ * Returns base raised to the power of exp, reduced modulo mod. All
+ * arguments must be integers, and the result is exact. It is not rounded
+ * to the working precision, so moduli up to the full significand length
+ * are kept intact.
+ */
+HNumber HMath::powmod(const HNumber& base, const HNumber& exp, const HNumber& mod)
+{
+    Error error = checkNaNParam(*base.d, exp.d);
+    if (error == Success)
+        error = checkNaNParam(*mod.d);
+    if (error != Success)
+        return HMath::nan(error);
+    if (!base.isInteger() || !exp.isInteger() || !mod.isInteger())
+        return HMath::nan(TypeMismatch);
+
+    HNumber result;
+    float_raisemod(result.d->fnum(), base.d->fnum(), exp.d->fnum(), mod.d->fnum());
+    result.d->error = float_geterror();
+    return result;
+}
+
 /**
  * Returns the square root of n. If n is negative, returns NaN.
  */
@@ -1189,7 +1907,7 @@ HNumber HMath::cbrt(const HNumber& n)
     if (n.isZero())
         return n;
     HNumber r;
-    floatnum rnum = &r.d->fnum;
+    floatnum rnum = r.d->fnum();
 
     // iterations to approximate result
     // X[i+1] = (2/3)X[i] + n / (3 * X[i]^2))
@@ -1199,7 +1917,7 @@ HNumber HMath::cbrt(const HNumber& n)
     floatstruct a, q;
     float_create(&a);
     float_create(&q);
-    float_copy(&a, &n.d->fnum, HMATH_EVAL_PREC);
+    float_copy(&a, n.d->fnum(), HMATH_EVAL_PREC);
     signed char sign = float_getsign(&a);
     float_abs(&a);
     int expn = float_getexponent(&a);
@@ -1230,7 +1948,7 @@ HNumber HMath::cbrt(const HNumber& n)
     float_setsign(rnum, sign);
     float_addexp(rnum, expn);
 
-    roundResult(&r.d->fnum);
+    roundResult(r.d->fnum());
     return r;
 }
 
@@ -1240,7 +1958,11 @@ HNumber HMath::cbrt(const HNumber& n)
 HNumber HMath::raise(const HNumber& n1, int n)
 {
     HNumber r;
-    float_raisei(&r.d->fnum, &n1.d->fnum, n, HMATH_EVAL_PREC);
+    qint64 power;
+    if (n1.d->isSmall && n >= 0 && (n1.d->smallValue != 0 || n != 0)
+        && powSmall(n1.d->smallValue, n, &power) && r.d->setSmall(power))
+        return r;
+    float_raisei(r.d->fnum(), n1.d->fnum(), n, HMATH_EVAL_PREC);
     roundSetError(r.d);
     return r;
 }
@@ -1251,6 +1973,12 @@ HNumber HMath::raise(const HNumber& n1, int n)
 HNumber HMath::raise(const HNumber& n1, const HNumber& n2)
 {
     HNumber result;
+    qint64 power;
+    if (n1.d->isSmall && n2.d->isSmall && n2.d->smallValue >= 0
+        && (n1.d->smallValue != 0 || n2.d->smallValue != 0)
+        && powSmall(n1.d->smallValue, n2.d->smallValue, &power)
+        && result.d->setSmall(power))
+        return result;
     HNumber temp = n1;
     Rational exp;
     bool change_sgn=false;
@@ -1345,6 +2073,82 @@ HNumber HMath::cos(const HNumber& x)
     return result;
 }
 
+/**
+ * Computes the sine and the cosine of x at once. Note that x must be in
+ * radians. Cheaper than calling sin() and cos() separately.
+ */
+void HMath::sincos(const HNumber& x, HNumber& sinx, HNumber& cosx)
+{
+    HNumber s, c;
+    call1Arg2Results(s.d, c.d, x.d, float_sincos, true);
+    sinx = s;
+    cosx = c;
+}
+
+// The sine and cosine of an angle of which 4 * quarter make a full turn.
+// The angle is reduced to the first quadrant in its own unit, which is
+// exact in decimal, multiples of a third and a half of the quadrant give
+// exact values, and only the remainder is converted to radians.
+void HMath::sincosQuadrants(const HNumber& x, const HNumber& quarter,
+                            const HNumber& toRadians, HNumber& sinx,
+                            HNumber& cosx)
+{
+    const HNumber turn = quarter * HNumber(4);
+    HNumber r = x % turn;
+    if (r.isNan()) {
+        sinx = cosx = r;
+        return;
+    }
+    if (r.isNegative())
+        r += turn;
+    int quadrant = 0;
+    while (quadrant < 3 && r >= quarter) {
+        r -= quarter;
+        ++quadrant;
+    }
+
+    const Constants& c = constants();
+    HNumber s, co;
+    if (r.isZero()) {
+        s = 0;
+        co = 1;
+    } else if (r * HNumber(3) == quarter) {
+        s = HNumber("0.5");
+        co = c.halfSqrt3;
+    } else if (r * HNumber(2) == quarter) {
+        s = co = c.halfSqrt2;
+    } else if (r * HNumber(3) == quarter * HNumber(2)) {
+        s = c.halfSqrt3;
+        co = HNumber("0.5");
+    } else
+        sincos(r * toRadians, s, co);
+
+    switch (quadrant) {
+    case 0: sinx = s; cosx = co; break;
+    case 1: sinx = co; cosx = -s; break;
+    case 2: sinx = -s; cosx = -co; break;
+    default: sinx = -co; cosx = s; break;
+    }
+}
+
+/**
+ * Computes the sine and the cosine of x given in degrees. Multiples of
+ * 30° and 45° give exact results.
+ */
+void HMath::sincosDegrees(const HNumber& x, HNumber& sinx, HNumber& cosx)
+{
+    sincosQuadrants(x, HNumber(90), constants().degToRad, sinx, cosx);
+}
+
+/**
+ * Computes the sine and the cosine of x given in gons. Multiples of 50 gon
+ * give exact results.
+ */
+void HMath::sincosGons(const HNumber& x, HNumber& sinx, HNumber& cosx)
+{
+    sincosQuadrants(x, HNumber(100), constants().gonToRad, sinx, cosx);
+}
+
 /**
  * Returns the tangent of x. Note that x must be in radians.
  */
@@ -1450,6 +2254,18 @@ HNumber HMath::cosh(const HNumber& x)
     return result;
 }
 
+/**
+ * Computes the hyperbolic sine and cosine of x at once. Cheaper than
+ * calling sinh() and cosh() separately.
+ */
+void HMath::sinhcosh(const HNumber& x, HNumber& sinhx, HNumber& coshx)
+{
+    HNumber s, c;
+    call1Arg2Results(s.d, c.d, x.d, float_sinhcosh, false);
+    sinhx = s;
+    coshx = c;
+}
+
 /**
  * Returns the hyperbolic tangent of x.
  */
@@ -1517,7 +2333,35 @@ HNumber HMath::sgn(const HNumber& x)
 {
     if (x.isNan())
         return HMath::nan(checkNaNParam(*x.d));
-    return float_getsign(&x.d->fnum);
+    return float_getsign(x.d->fnum());
+}
+
+// The longest product of consecutive integers evaluated by multiplying,
+// longer ones are left to the Gamma function.
+static const int MaxProductTerms = 1000;
+
+// Sets x to lo*(lo+1)*...*(lo+count-1), lo an integer. The range is split
+// in halves, so that the factors multiplied are about the same size and the
+// fast multiplication pays off. Products of at most <digits> digits are
+// exact.
+static char rangeProduct(floatnum x, cfloatnum lo, int count, int digits)
+{
+    if (count <= 0)
+        return float_copy(x, &c1, EXACT);
+    if (count == 1)
+        return x == lo || float_copy(x, lo, EXACT);
+    if (float_cancelled())
+        return 0;
+
+    floatstruct upper;
+    float_create(&upper);
+    const int half = count / 2;
+    char result = float_addi(&upper, lo, half, EXACT)
+        && rangeProduct(&upper, &upper, count - half, digits)
+        && rangeProduct(x, lo, half, digits)
+        && float_mul(x, x, &upper, digits);
+    float_free(&upper);
+    return result;
 }
 
 /**
@@ -1540,14 +2384,29 @@ HNumber HMath::nCr(const HNumber& n, const HNumber& r)
     HNumber r2 = n - r1;
 
     if (r1 >= 0) {
-        if (n.isInteger() && r1.isInteger() && n <= 1000 && r1 <= 50)
-            return factorial(n, r2+1) / factorial(r1, 1);
+        if (n.isInteger() && r1.isInteger() && r1 <= MaxProductTerms) {
+            // (r2+1)*...*n / r1!, exact while the numerator fits in
+            // MAXDIGITS digits.
+            const int count = r1.toInt();
+            const HNumber lo = r2 + 1;
+            HNumber result;
+            floatnum rnum = result.d->fnum();
+            floatstruct fr;
+            float_create(&fr);
+            rangeProduct(rnum, lo.d->fnum(), count, MAXDIGITS)
+                && rangeProduct(&fr, &c1, count, MAXDIGITS)
+                && float_div(rnum, rnum, &fr, HMATH_EVAL_PREC);
+            float_free(&fr);
+            roundSetError(result.d);
+            return result;
+        }
         HNumber result(n);
-        floatnum rnum = &result.d->fnum;
+        result.detach();
+        floatnum rnum = result.d->fnum();
         floatstruct fn, fr;
         float_create(&fn);
         float_create(&fr);
-        float_copy(&fr, &r1.d->fnum, HMATH_EVAL_PREC);
+        float_copy(&fr, r1.d->fnum(), HMATH_EVAL_PREC);
         float_copy(&fn, rnum, EXACT);
         float_sub(rnum, rnum, &fr, HMATH_EVAL_PREC)
             && float_add(&fn, &fn, &c1, HMATH_EVAL_PREC)
@@ -1588,22 +2447,96 @@ HNumber HMath::nPr(const HNumber& n, const HNumber& r)
  */
 HNumber HMath::factorial(const HNumber& x, const HNumber& base)
 {
+    // Integers are multiplied, exactly while the result fits in MAXDIGITS
+    // digits.
+    if (x.isInteger() && base.isInteger() && base > 0) {
+        const HNumber count = x - base + 1;
+        if (!count.isNegative() && count <= MaxProductTerms) {
+            HNumber result;
+            rangeProduct(result.d->fnum(), base.d->fnum(), count.toInt(),
+                         MAXDIGITS);
+            roundSetError(result.d);
+            return result;
+        }
+    }
+
     floatstruct tmp;
-    if (float_cmp(&c1, &base.d->fnum) == 0) {
+    if (float_cmp(&c1, base.d->fnum()) == 0) {
         HNumber result;
         call1Arg(result.d, x.d, float_factorial);
         return result;
     }
     float_create(&tmp);
     HNumber r(base);
-    float_sub(&tmp, &x.d->fnum, &base.d->fnum, HMATH_EVAL_PREC)
+    r.detach();
+    float_sub(&tmp, x.d->fnum(), base.d->fnum(), HMATH_EVAL_PREC)
     && float_add(&tmp, &tmp, &c1, HMATH_EVAL_PREC)
-    && float_pochhammer(&r.d->fnum, &tmp, HMATH_EVAL_PREC);
+    && float_pochhammer(r.d->fnum(), &tmp, HMATH_EVAL_PREC);
     roundSetError(r.d);
     float_free(&tmp);
     return r;
 }
 
+// A loop count, clamped to int. The loops below end early long before
+// such a count is reached.
+static int loopCount(const HNumber& x)
+{
+    if (x.isNegative())
+        return 0;
+    return x > std::numeric_limits<int>::max()
+        ? std::numeric_limits<int>::max() : x.toInt();
+}
+
+// Adds up to <count> terms to <sum>, which holds the first one on entry.
+// The terms have consecutive indices, from <start> in steps of <step>
+// (1 or -1), and each is the one before times the ratio that
+// ratio(r, i, next, digits) sets for the step from index i to next. The
+// ratios must shrink along the way, as they do for the distributions
+// below when walking away from the mode. Then, once a ratio r is below 1,
+// the terms left add up to less than the last one divided by 1-r, and the
+// loop ends as soon as that no longer shows in the sum. For the large
+// counts this is after a number of terms in the order of sqrt(count). The
+// sum carries a guard digit per decimal digit of <count>, to keep the
+// rounding errors of the additions out of the result.
+template<class Ratio>
+static char sumRecurrence(floatnum sum, cfloatnum start, int step, int count,
+                          Ratio ratio)
+{
+    int digits = HMATH_EVAL_PREC + 1;
+    for (int c = count; c > 0; c /= 10)
+        ++digits;
+    digits = qMin(digits, MAXDIGITS);
+
+    floatstruct term, r, i, next, rest;
+    float_create(&term);
+    float_create(&r);
+    float_create(&i);
+    float_create(&next);
+    float_create(&rest);
+    char result = float_copy(&term, sum, EXACT)
+        && float_copy(&i, start, EXACT);
+    for (int n = 0; result && n < count && !float_iszero(&term); ++n) {
+        result = !float_cancelled()
+            && float_addi(&next, &i, step, EXACT)
+            && ratio(&r, &i, &next, digits)
+            && float_mul(&term, &term, &r, digits)
+            && float_add(sum, sum, &term, digits)
+            && float_copy(&i, &next, EXACT);
+        if (result && float_cmp(&r, &c1) < 0
+            && float_getexponent(&term) < float_getexponent(sum) - digits
+            && float_sub(&rest, &c1, &r, 3)
+            && float_getexponent(&term) - float_getexponent(&rest)
+               < float_getexponent(sum) - digits)
+            break;
+    }
+    float_free(&term);
+    float_free(&r);
+    float_free(&i);
+    float_free(&next);
+    float_free(&rest);
+    return result;
+}
+
 static bool checkpn(const HNumber& p, const HNumber& n)
 {
     return n.isInteger() && !n.isNegative() && !p.isNan() && !p.isNegative() && p <= 1;
@@ -1651,7 +2584,6 @@ HNumber HMath::binomialPmf(const HNumber& k, const HNumber& n, const HNumber& p)
  */
 HNumber HMath::binomialCdf(const HNumber& k, const HNumber& n, const HNumber& p)
 {
-    // FIXME: Use the regularized incomplete Beta function to avoid the potentially very expensive loop.
     if (!k.isInteger() || n.isNan())
         return HMath::nan();
 
@@ -1677,15 +2609,42 @@ HNumber HMath::binomialCdf(const HNumber& k, const HNumber& n, const HNumber& p)
     if (k + k > n && k + one >= p * (n + one))
         return one - binomialCdf(n - k - one, n, pcompl);
 
-    // loop adding binomialPdf
-    HNumber result(summand);
-    for (HNumber i(0); i < k;) {
-        summand *= p * (n-i);
-        i += one;
-        summand /= pcompl * i;
-        result += summand;
+    // The sum starts at the largest term and walks away from the mode.
+    // Below the mode it goes down from pdf(k), otherwise it takes the tail
+    // beyond k, going up from pdf(k+1), and returns its complement.
+    const HNumber odds = p / pcompl;
+    floatnum oddsnum = odds.d->fnum();
+    floatnum nnum = n.d->fnum();
+    if (k + one < p * (n + one)) {
+        // pdf(next) = pdf(i) * i / ((n-next) * p/(1-p))
+        HNumber result = binomialPmf(k, n, p);
+        result.detach();
+        sumRecurrence(result.d->fnum(), k.d->fnum(), -1, loopCount(k),
+                      [=](floatnum r, cfloatnum i, cfloatnum next, int digits) {
+            floatstruct tmp;
+            float_create(&tmp);
+            char ok = float_sub(&tmp, nnum, next, digits)
+                && float_mul(&tmp, &tmp, oddsnum, digits)
+                && float_div(r, i, &tmp, digits);
+            float_free(&tmp);
+            return ok;
+        });
+        roundSetError(result.d);
+        return result;
     }
-    return result;
+
+    // pdf(next) = pdf(i) * p/(1-p) * (n-i) / next
+    const HNumber first = k + one;
+    HNumber tail = binomialPmf(first, n, p);
+    tail.detach();
+    sumRecurrence(tail.d->fnum(), first.d->fnum(), 1, loopCount(n - first),
+                  [=](floatnum r, cfloatnum i, cfloatnum next, int digits) {
+        return float_sub(r, nnum, i, digits)
+            && float_mul(r, r, oddsnum, digits)
+            && float_div(r, r, next, digits);
+    });
+    roundSetError(tail.d);
+    return one - tail;
 }
 
 /**
@@ -1787,14 +2746,52 @@ HNumber HMath::hypergeometricCdf(const HNumber& k, const HNumber& N, const HNumb
     //   if (k + k > n)
     //     return one - hypergeometricCdf(n - k - 1, N, N - M, n);
 
-    HNumber result = summand;
-    for (; i < k;) {
-        summand *= (M - i) * (n - i);
-        i += one;
-        summand /= i * (i - c);
-        result += summand;
+    // As for binomialCdf, the sum walks away from the mode, down from
+    // pdf(k) or up from pdf(k+1) for the complement.
+    floatnum Mnum = M.d->fnum();
+    floatnum nnum = n.d->fnum();
+    floatnum cnum = c.d->fnum();
+    if (k < floor((n + one) * (M + one) / (N + 2))) {
+        // pdf(next) = pdf(i) * i*(i-c) / ((M-next)*(n-next))
+        HNumber result = hypergeometricPmf(k, N, M, n);
+        result.detach();
+        sumRecurrence(result.d->fnum(), k.d->fnum(), -1, loopCount(k - i),
+                      [=](floatnum r, cfloatnum i, cfloatnum next, int digits) {
+            floatstruct tmp;
+            float_create(&tmp);
+            char ok = float_sub(r, i, cnum, digits)
+                && float_mul(r, r, i, digits)
+                && float_sub(&tmp, Mnum, next, digits)
+                && float_div(r, r, &tmp, digits)
+                && float_sub(&tmp, nnum, next, digits)
+                && float_div(r, r, &tmp, digits);
+            float_free(&tmp);
+            return ok;
+        });
+        roundSetError(result.d);
+        return result;
     }
-    return result;
+
+    // pdf(next) = pdf(i) * (M-i)*(n-i) / (next*(next-c))
+    const HNumber first = k + one;
+    HNumber tail = hypergeometricPmf(first, N, M, n);
+    tail.detach();
+    sumRecurrence(tail.d->fnum(), first.d->fnum(), 1,
+                  loopCount(min(M, n) - first),
+                  [=](floatnum r, cfloatnum i, cfloatnum next, int digits) {
+        floatstruct tmp;
+        float_create(&tmp);
+        char ok = float_sub(r, Mnum, i, digits)
+            && float_sub(&tmp, nnum, i, digits)
+            && float_mul(r, r, &tmp, digits)
+            && float_div(r, r, next, digits)
+            && float_sub(&tmp, next, cnum, digits)
+            && float_div(r, r, &tmp, digits);
+        float_free(&tmp);
+        return ok;
+    });
+    roundSetError(tail.d);
+    return one - tail;
 }
 
 /**
@@ -1873,7 +2870,6 @@ HNumber HMath::poissonPmf(const HNumber& k, const HNumber& l)
  */
 HNumber HMath::poissonCdf(const HNumber& k, const HNumber& l)
 {
-    // FIXME: Use the incomplete gamma function to avoid a potentially expensive loop.
     if (!k.isInteger() || l.isNan() || l.isNegative())
         return HMath::nan();
 
@@ -1884,14 +2880,32 @@ HNumber HMath::poissonCdf(const HNumber& k, const HNumber& l)
     if (l.isZero())
         return one;
 
-    HNumber summand = one;
-    HNumber result = one;
-    for (HNumber i = one; i <= k; i += one) {
-        summand *= l / i;
-        result += summand;
+    // As for binomialCdf, the sum walks away from the mode, down from
+    // pdf(k) or up from pdf(k+1) for the complement.
+    floatnum lnum = l.d->fnum();
+    if (k < l) {
+        // pdf(next) = pdf(i) * i/l
+        HNumber result = poissonPmf(k, l);
+        result.detach();
+        sumRecurrence(result.d->fnum(), k.d->fnum(), -1, loopCount(k),
+                      [=](floatnum r, cfloatnum i, cfloatnum, int digits) {
+            return float_div(r, i, lnum, digits);
+        });
+        roundSetError(result.d);
+        return result;
     }
-    result = exp(-l) * result;
-    return result;
+
+    // pdf(next) = pdf(i) * l/next
+    const HNumber first = k + one;
+    HNumber tail = poissonPmf(first, l);
+    tail.detach();
+    sumRecurrence(tail.d->fnum(), first.d->fnum(), 1,
+                  std::numeric_limits<int>::max(),
+                  [=](floatnum r, cfloatnum, cfloatnum next, int digits) {
+        return float_div(r, lnum, next, digits);
+    });
+    roundSetError(tail.d);
+    return one - tail;
 }
 
 /**
@@ -1999,6 +3013,29 @@ HNumber HMath::decodeIeee754(const HNumber& val, const HNumber& exp_bits, const
         || !exp_bias.isInteger())
         return HMath::nan();
 
+    // Formats of up to 64 bits, which include binary16, binary32 and
+    // binary64, take the fields apart on a machine word and scale the
+    // integer significand by a power of two once.
+    LogicWord word;
+    if (exp_bits + significand_bits < 64 && exp_bits <= 30
+        && HMath::abs(exp_bias) < (1 << 30)
+        && val.d->toLogicWord(&word) && !word.negative) {
+        const int expBits = exp_bits.toInt();
+        const int sigBits = significand_bits.toInt();
+        const quint64 expMax = (Q_UINT64_C(1) << expBits) - 1;
+        const quint64 exp = word.bits >> sigBits & expMax;
+        LogicWord fraction = { word.bits & ((Q_UINT64_C(1) << sigBits) - 1), false };
+        if (exp == expMax)
+            return fraction.bits == 0 ? HNumber() : HMath::nan();
+        if (exp != 0)
+            fraction.bits |= Q_UINT64_C(1) << sigBits;
+        const int scale = int(qMax<quint64>(exp, 1)) - exp_bias.toInt() - sigBits;
+        HNumber result;
+        result.d->setLogicWord(fraction);
+        result *= HMath::raise(HNumber(2), scale);
+        return (word.bits >> (expBits + sigBits) & 1) ? -result : result;
+    }
+
     HNumber sign(HMath::mask(val >> (exp_bits + significand_bits), 1).isZero() ? 1 : -1);
     HNumber exp = HMath::mask(val >> significand_bits, exp_bits);
     // <=> '0.' b_x b_x-1 b_x-2 ... b_0
@@ -2020,6 +3057,17 @@ HNumber HMath::decodeIeee754(const HNumber& val, const HNumber& exp_bits, const
     return sign * (significand + 1) * HMath::raise(2, exp - exp_bias); // Normalised value.
 }
 
+// An estimate of floor(log2(x)) for x > 0, off by at most one, taken from
+// the decimal exponent and the leading digits.
+static HNumber binaryExponent(cfloatnum f)
+{
+    double leading = 0;
+    for (int i = 0; i < 15; ++i)
+        leading = leading * 10 + float_getdigit(f, i);
+    double log2 = (float_getexponent(f) - 14) * 3.321928094887362 + std::log2(leading);
+    return HNumber(int(std::floor(qBound(-1e9, log2, 1e9))));
+}
+
 /**
  * Encode a value in a IEEE-754 binary representation with the default exponent bias
  */
@@ -2059,26 +3107,19 @@ HNumber HMath::encodeIeee754(const HNumber& val, const HNumber& exp_bits, const
     } else {
         // Regular input value.
         sign_bit = val.isNegative() ? 1 : 0;
-        // Determine exponent.
-        HNumber search_min = min_exp;
-        HNumber search_max = max_exp;
-        exponent = HMath::ceil((search_max - search_min) / 2) + search_min;
-        significand = HMath::abs(val) * HMath::raise(2, -exponent);
-
-        do {
-            if (significand >= 1 && significand < 2) {
-                // Integer part is 1, stop here.
-                break;
-            } else if (significand >= 2) {
-                // Increase exponent.
-                search_min = exponent + 1;
-            } else if (significand < 1) {
-                // Decrease exponent.
-                search_max = exponent - 1;
-            }
-            exponent = HMath::ceil((search_max - search_min) / 2) + search_min;
-            significand = HMath::abs(val) * HMath::raise(2, -exponent);
-        } while (exponent != min_exp && exponent != max_exp);
+        // Determine exponent: estimate it from the decimal one, then step
+        // until the integer part is 1, or a bound of the format is reached.
+        HNumber magnitude = HMath::abs(val);
+        exponent = HMath::min(HMath::max(binaryExponent(magnitude.d->fnum()), min_exp), max_exp);
+        significand = magnitude * HMath::raise(2, -exponent);
+        while (significand >= 2 && exponent < max_exp) {
+            exponent += 1;
+            significand = magnitude * HMath::raise(2, -exponent);
+        }
+        while (significand < 1 && exponent > min_exp) {
+            exponent -= 1;
+            significand = magnitude * HMath::raise(2, -exponent);
+        }
 
         HNumber rounded = HMath::round(significand * HMath::raise(2, significand_bits));
         HNumber intpart = HMath::integer(rounded * HMath::raise(2, -significand_bits));
@@ -2132,8 +3173,8 @@ HNumber HMath::parse_str(const char* str_in, const char** str_out) {
     delete x.d;
 
     x.d = new HNumberPrivate;
-    if ((x.d->error = parse(&tokens, &str)) == Success)
-    x.d->error = float_in(&x.d->fnum, &tokens);
+    if ((x.d->error = ::parse(&tokens, &str)) == Success)
+    x.d->error = float_in(x.d->fnum(), &tokens);
     float_geterror();
 
     /* Store remaining of the string */
@@ -2143,7 +3184,47 @@ HNumber HMath::parse_str(const char* str_in, const char** str_out) {
     return x;
 }
 
+/**
+ * Parses a number from UTF-16 text, as parse_str() does from ASCII. Plain
+ * decimal integers that fit become small numbers at once, the other forms
+ * are narrowed to ASCII on the stack, if they are short, and then parsed.
+ * Characters outside ASCII end the number.
+ */
+HNumber HMath::parse(const QChar* text, int length)
+{
+    if (length > 0 && length <= 18) {
+        qint64 value = 0;
+        int i = 0;
+        for (; i < length; ++i) {
+            const ushort c = text[i].unicode();
+            if (c < '0' || c > '9')
+                break;
+            value = value * 10 + (c - '0');
+        }
+        HNumber result;
+        if (i == length && result.d->setSmall(value))
+            return result;
+    }
+
+    char buffer[128];
+    QByteArray longText;
+    char* ascii = buffer;
+    if (length >= int(sizeof(buffer))) {
+        longText.resize(length + 1);
+        ascii = longText.data();
+    }
+    int count = 0;
+    while (count < length && text[count].unicode() < 0x80) {
+        ascii[count] = char(text[count].unicode());
+        ++count;
+    }
+    ascii[count] = 0;
+    return parse_str(ascii, nullptr);
+}
+
 bool HNumber::isNearZero() const
 {
-    return float_iszero(&(d->fnum)) || float_getexponent(&(d->fnum)) <= -80;
+    if (d->isSmall)
+        return d->smallValue == 0;
+    return float_iszero(d->fnum()) || float_getexponent(d->fnum()) <= -80;
 }
@@ -30,6 +30,7 @@
 
 class HMath;
 class HNumberPrivate;
+class QDataStream;
 class CNumber;
 class CMath;
 class Rational;
@@ -50,6 +51,7 @@ class HNumber {
 public:
     HNumber();
     HNumber(const HNumber&);
+    HNumber(HNumber&&);
     HNumber(int);
     HNumber(const char*);
     HNumber(const QJsonObject&);
@@ -64,11 +66,17 @@ public:
 
     void serialize(QJsonObject&) const;
     static HNumber deSerialize(const QJsonObject&);
+    // All digits are kept, unlike in the JSON form.
+    void serialize(QDataStream&) const;
+    static HNumber deSerialize(QDataStream&);
 
     int toInt() const;
     Error error() const;
 
+    void squeeze();
+
     HNumber& operator=(const HNumber&);
+    HNumber& operator=(HNumber&&);
     HNumber operator+(const HNumber&) const;
     HNumber& operator+=(const HNumber&);
     HNumber& operator-=(const HNumber&);
@@ -90,6 +98,7 @@ public:
 private:
     HNumberPrivate* d;
 
+    void detach();
     int compare(const HNumber&) const;
 
 public:
@@ -132,10 +141,19 @@ public:
     static QString format(const HNumber&, HNumber::Format = HNumber::Format());
     // PARSING
     static HNumber parse_str(const char*, const char** out);
+    static HNumber parse(const QChar*, int length);
+    // PRECISION
+    static int workingPrecision();
+    static int defaultWorkingPrecision();
+    static int maxWorkingPrecision();
+    static int setWorkingPrecision(int);
+    // MEMORY
+    static long freeListBytes();
+    static void trimFreeLists();
     // CONSTANTS
-    static HNumber e();
-    static HNumber phi();
-    static HNumber pi();
+    static const HNumber& e();
+    static const HNumber& phi();
+    static const HNumber& pi();
     static HNumber nan(Error = Success);
     // GENERAL MATH
     static HNumber rad2deg(const HNumber&);
@@ -150,7 +168,12 @@ public:
     static HNumber floor(const HNumber&);
     static HNumber ceil(const HNumber&);
     static HNumber gcd(const HNumber&, const HNumber&);
+    static HNumber lcm(const HNumber&, const HNumber&);
     static HNumber idiv(const HNumber&, const HNumber&);
+    static HNumber sumOfProducts(const HNumber& a, const HNumber& b,
+                                 const HNumber& c, const HNumber& d);
+    static HNumber hypot(const HNumber&, const HNumber&);
+    static HNumber powmod(const HNumber& base, const HNumber& exp, const HNumber& mod);
     static HNumber round(const HNumber&, int prec = 0);
     static HNumber trunc(const HNumber&, int prec = 0);
     static HNumber sqrt(const HNumber&);
@@ -166,6 +189,7 @@ public:
     static HNumber log(const HNumber& base, const HNumber& x);
     static HNumber sinh(const HNumber&);
     static HNumber cosh(const HNumber&);
+    static void sinhcosh(const HNumber&, HNumber& sinh, HNumber& cosh);
     static HNumber tanh(const HNumber&);
     static HNumber arsinh(const HNumber&);
     static HNumber arcosh(const HNumber&);
@@ -173,6 +197,9 @@ public:
     // TRIGONOMETRY
     static HNumber sin(const HNumber&);
     static HNumber cos(const HNumber&);
+    static void sincos(const HNumber&, HNumber& sin, HNumber& cos);
+    static void sincosDegrees(const HNumber&, HNumber& sin, HNumber& cos);
+    static void sincosGons(const HNumber&, HNumber& sin, HNumber& cos);
     static HNumber tan(const HNumber&);
     static HNumber cot(const HNumber&);
     static HNumber sec(const HNumber&);
@@ -213,6 +240,13 @@ public:
     static HNumber encodeIeee754(const HNumber&, const HNumber& exp_bits, const HNumber& significand_bits);
     static HNumber encodeIeee754(const HNumber&, const HNumber& exp_bits, const HNumber& significand_bits,
                                  const HNumber& exp_bias);
+
+private:
+    struct Constants;
+    static const Constants& constants();
+    static void sincosQuadrants(const HNumber&, const HNumber& quarter,
+                                const HNumber& toRadians, HNumber& sin,
+                                HNumber& cos);
 };
 
 std::ostream& operator<<(std::ostream&, const HNumber&);
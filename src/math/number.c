@@ -44,7 +44,9 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>/* Prototypes needed for external utility routines. */
+#include <ctype.h>
+#include <math.h>
+#include <time.h>/* Prototypes needed for external utility routines. */
 
 #define bc_rt_warn rt_warn
 #define bc_rt_error rt_error
@@ -74,29 +76,285 @@ bc_num _zero_;
 bc_num _one_;
 bc_num _two_;
 
-static bc_num _bc_Free_list = NULL;
+/* Released bc_struct headers are kept for reuse in a free list.  Each
+   thread has its own list, so that the number package can be used from
+   several threads.  A thread ending its work should call
+   bc_trim_free_list, otherwise its list is lost on exit. */
+
+#if defined(_MSC_VER)
+#define BC_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define BC_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define BC_THREAD_LOCAL _Thread_local
+#else
+#define BC_THREAD_LOCAL
+#endif
 
-/* new_num allocates a number and sets fields to known values. */
+#ifndef BC_FREE_LIST_CAP
+#define BC_FREE_LIST_CAP 1024
+#endif
 
-bc_num
-bc_new_num (length, scale)
-     int length, scale;
+/* Reference counts are changed atomically, so that a number may be
+   shared between threads, as _zero_, _one_ and _two_ are.  A count of 1
+   belongs to the caller alone, no other thread can change it. */
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define _bc_refs(num) (*(volatile long *) &(num)->n_refs)
+#define _bc_ref_inc(num) _InterlockedIncrement ((volatile long *) &(num)->n_refs)
+#define _bc_ref_dec(num) _InterlockedDecrement ((volatile long *) &(num)->n_refs)
+#elif defined(__GNUC__) || defined(__clang__)
+#define _bc_refs(num) __atomic_load_n (&(num)->n_refs, __ATOMIC_ACQUIRE)
+#define _bc_ref_inc(num) __atomic_add_fetch (&(num)->n_refs, 1, __ATOMIC_RELAXED)
+#define _bc_ref_dec(num) __atomic_sub_fetch (&(num)->n_refs, 1, __ATOMIC_ACQ_REL)
+#else
+#define _bc_refs(num) ((num)->n_refs)
+#define _bc_ref_inc(num) (++(num)->n_refs)
+#define _bc_ref_dec(num) (--(num)->n_refs)
+#endif
+
+static int _bc_Free_cap = BC_FREE_LIST_CAP;
+static BC_THREAD_LOCAL bc_num _bc_Free_list = NULL;
+static BC_THREAD_LOCAL bc_alloc_stats _bc_Stats;
+
+static void _bc_select_digit_kernels (void);
+
+/* Hands out a bc_struct header, preferably from the free list. */
+
+static bc_num
+_bc_new_struct (void)
 {
   bc_num temp;
 
+  _bc_Stats.allocations++;
   if (_bc_Free_list != NULL) {
     temp = _bc_Free_list;
     _bc_Free_list = temp->n_next;
+    _bc_Stats.free_list_hits++;
+    _bc_Stats.free_list_length--;
   } else {
     temp = (bc_num) malloc (sizeof(bc_struct));
     if (temp == NULL) bc_out_of_memory ();
   }
+  if (++_bc_Stats.live > _bc_Stats.peak_live)
+    _bc_Stats.peak_live = _bc_Stats.live;
+  return temp;
+}
+
+/* Evaluation arenas.  While an arena is open on a thread, the digits of
+   new numbers are cut from large chunks by bumping a pointer, and
+   releasing them costs nothing.  Closing the arena frees all chunks at
+   once, after the digits of numbers still referenced have been moved to
+   the heap.  Headers are not moved, so bc_num pointers stay valid.
+
+   Every digit buffer is preceded by a bc_digit_header, so that
+   bc_free_num can tell arena digits from heap digits. */
+
+typedef struct bc_digit_header
+    {
+      int size;		/* Bytes of digits following the header. */
+      int kind;		/* BC_DIGITS_HEAP, _ARENA or _BLOCK. */
+    } bc_digit_header;
+
+#define BC_DIGITS_HEAP  0
+#define BC_DIGITS_ARENA 1
+#define BC_DIGITS_BLOCK 2
+
+/* Digit blocks.  Outside arenas, digits up to BC_BLOCK_DIGITS long, which
+   covers the numbers at evaluation precision and their products, live in
+   blocks of that fixed capacity.  Released blocks are kept in a list per
+   thread, like the headers, so the common numbers never reach malloc. */
+
+#ifndef BC_BLOCK_DIGITS
+#define BC_BLOCK_DIGITS 256
+#endif
+
+static BC_THREAD_LOCAL char *_bc_Block_list = NULL;
+
+typedef struct bc_arena_chunk
+    {
+      struct bc_arena_chunk *next;
+      size_t size;
+      size_t used;
+    } bc_arena_chunk;
+
+#define BC_ARENA_CHUNK 65536
+#define BC_ARENA_ALIGN(n) (((n) + sizeof(bc_digit_header) - 1) \
+                           / sizeof(bc_digit_header) * sizeof(bc_digit_header))
+
+static BC_THREAD_LOCAL int _bc_Arena_depth = 0;
+static BC_THREAD_LOCAL bc_arena_chunk *_bc_Arena_chunks = NULL;
+/* The numbers that received arena digits.  Entries may be stale (freed
+   or reused), which bc_arena_end detects. */
+static BC_THREAD_LOCAL bc_num *_bc_Arena_nums = NULL;
+static BC_THREAD_LOCAL int _bc_Arena_count = 0;
+static BC_THREAD_LOCAL int _bc_Arena_cap = 0;
+
+#define _bc_digit_header(ptr) (((bc_digit_header *) (ptr)) - 1)
+
+static char *
+_bc_arena_alloc (size_t size)
+{
+  bc_arena_chunk *chunk;
+  char *result;
+
+  size = BC_ARENA_ALIGN (size + sizeof (bc_digit_header));
+  chunk = _bc_Arena_chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    chunk = (bc_arena_chunk *) malloc (sizeof (bc_arena_chunk)
+                                       + MAX (size, BC_ARENA_CHUNK));
+    if (chunk == NULL) { bc_out_of_memory (); return NULL; }
+    chunk->size = MAX (size, BC_ARENA_CHUNK);
+    chunk->used = 0;
+    chunk->next = _bc_Arena_chunks;
+    _bc_Arena_chunks = chunk;
+  }
+  result = (char *) (chunk + 1) + chunk->used;
+  chunk->used += size;
+  _bc_Stats.arena_bytes += size;
+  return result;
+}
+
+/* Allocates SIZE bytes of digit storage for NUM. */
+
+static char *
+_bc_alloc_digits (bc_num num, int size)
+{
+  bc_digit_header *header;
+
+  if (_bc_Arena_depth > 0) {
+    if (_bc_Arena_count == _bc_Arena_cap) {
+      _bc_Arena_cap = MAX (2 * _bc_Arena_cap, 256);
+      _bc_Arena_nums = (bc_num *) realloc (_bc_Arena_nums,
+                                           _bc_Arena_cap * sizeof (bc_num));
+      if (_bc_Arena_nums == NULL) bc_out_of_memory ();
+    }
+    _bc_Arena_nums[_bc_Arena_count++] = num;
+    header = (bc_digit_header *) _bc_arena_alloc (size);
+    header->kind = BC_DIGITS_ARENA;
+  } else if (size <= BC_BLOCK_DIGITS) {
+    if (_bc_Block_list != NULL) {
+      header = _bc_digit_header (_bc_Block_list);
+      _bc_Block_list = *(char **) _bc_Block_list;
+      _bc_Stats.block_hits++;
+      _bc_Stats.block_list_length--;
+    } else {
+      header = (bc_digit_header *) malloc (sizeof (bc_digit_header)
+                                           + BC_BLOCK_DIGITS);
+      if (header == NULL) { bc_out_of_memory (); return NULL; }
+    }
+    header->kind = BC_DIGITS_BLOCK;
+  } else {
+    header = (bc_digit_header *) malloc (sizeof (bc_digit_header) + size);
+    if (header == NULL) { bc_out_of_memory (); return NULL; }
+    header->kind = BC_DIGITS_HEAP;
+  }
+  header->size = size;
+  return (char *) (header + 1);
+}
+
+static void
+_bc_free_digits (char *ptr)
+{
+  switch (_bc_digit_header (ptr)->kind) {
+  case BC_DIGITS_ARENA:
+    break;
+  case BC_DIGITS_BLOCK:
+    if (_bc_Stats.block_list_length < _bc_Free_cap) {
+      *(char **) ptr = _bc_Block_list;
+      _bc_Block_list = ptr;
+      _bc_Stats.block_list_length++;
+      break;
+    }
+    /* Fall through. */
+  default:
+    free (_bc_digit_header (ptr));
+  }
+}
+
+/* Opens an arena on the calling thread.  Arenas nest; only the
+   outermost pair of bc_arena_begin and bc_arena_end takes effect. */
+
+void
+bc_arena_begin ()
+{
+  _bc_Arena_depth++;
+}
+
+/* Closes the arena opened by the matching bc_arena_begin.  Numbers
+   created inside the arena and still referenced get their digits
+   copied to the heap. */
+
+void
+bc_arena_end ()
+{
+  bc_arena_chunk *chunk;
+  bc_num num, temp;
+  char *ptr;
+  int ix, size;
+
+  if (_bc_Arena_depth == 0 || --_bc_Arena_depth > 0)
+    return;
+
+  for (ix = 0; ix < _bc_Arena_count; ix++) {
+    num = _bc_Arena_nums[ix];
+    if (num->n_refs <= 0 || num->n_ptr == NULL
+        || _bc_digit_header (num->n_ptr)->kind != BC_DIGITS_ARENA)
+      continue;
+    size = _bc_digit_header (num->n_ptr)->size;
+    ptr = _bc_alloc_digits (num, size);
+    memcpy (ptr, num->n_ptr, size);
+    num->n_value = ptr + (num->n_value - num->n_ptr);
+    num->n_ptr = ptr;
+    _bc_Stats.arena_survivors++;
+  }
+  _bc_Arena_count = 0;
+
+  while (_bc_Arena_chunks != NULL) {
+    chunk = _bc_Arena_chunks;
+    _bc_Arena_chunks = chunk->next;
+    free (chunk);
+  }
+
+  /* Headers were not freed while the arena was open. */
+  while (_bc_Stats.free_list_length > _bc_Free_cap) {
+    temp = _bc_Free_list;
+    _bc_Free_list = temp->n_next;
+    free (temp);
+    _bc_Stats.free_list_length--;
+  }
+}
+
+static void
+_bc_release_struct (bc_num num)
+{
+  _bc_Stats.live--;
+  /* Inside an arena, headers are recycled but never freed, so the
+     arena's bookkeeping never points to released memory. */
+  if (_bc_Stats.free_list_length >= _bc_Free_cap && _bc_Arena_depth == 0) {
+    free (num);
+    return;
+  }
+  num->n_next = _bc_Free_list;
+  _bc_Free_list = num;
+  _bc_Stats.free_list_length++;
+}
+
+/* new_num allocates a number and sets fields to known values. */
+
+bc_num
+bc_new_num (length, scale)
+     int length, scale;
+{
+  bc_num temp;
+
+  temp = _bc_new_struct ();
   temp->n_sign = PLUS;
   temp->n_len = length;
   temp->n_scale = scale;
   temp->n_refs = 1;
-  temp->n_ptr = (char *) malloc (length+scale+1);
-  if (temp->n_ptr == NULL) bc_out_of_memory();
+  temp->n_ptr = _bc_alloc_digits (temp, length+scale+1);
   temp->n_value = temp->n_ptr;
   memset (temp->n_ptr, 0, length+scale);
   return temp;
@@ -109,17 +367,119 @@ void
 bc_free_num (num)
     bc_num *num;
 {
+  int refs;
+
   if (*num == NULL) return;
-  (*num)->n_refs--;
-  if ((*num)->n_refs == 0) {
+  refs = _bc_refs (*num);
+  if (refs > 1)
+    refs = _bc_ref_dec (*num);
+  else if (refs == 1)
+    (*num)->n_refs = refs = 0;
+  if (refs == 0) {
     if ((*num)->n_ptr)
-      free ((*num)->n_ptr);
-    (*num)->n_next = _bc_Free_list;
-    _bc_Free_list = *num;
+      _bc_free_digits ((*num)->n_ptr);
+    _bc_release_struct (*num);
   }
   *num = NULL;
 }
 
+/* Gives NUM digit storage of exactly the length of its value, dropping
+   the hidden digits and the unused part of a digit block.  The value is
+   not changed.  Meant for numbers kept a long time; a shared number, and
+   a number inside an arena, are left as they are. */
+
+void
+bc_shrink_num (num)
+     bc_num num;
+{
+  char *ptr;
+  int size;
+
+  if (num->n_refs != 1 || num->n_ptr == NULL || _bc_Arena_depth > 0)
+    return;
+  size = num->n_len + num->n_scale + 1;
+  if (num->n_value == num->n_ptr
+      && _bc_digit_header (num->n_ptr)->kind == BC_DIGITS_HEAP
+      && _bc_digit_header (num->n_ptr)->size <= size)
+    return;
+  ptr = (char *) malloc (sizeof (bc_digit_header) + size);
+  if (ptr == NULL) return;
+  ((bc_digit_header *) ptr)->kind = BC_DIGITS_HEAP;
+  ((bc_digit_header *) ptr)->size = size;
+  ptr += sizeof (bc_digit_header);
+  memcpy (ptr, num->n_value, size - 1);
+  ptr[size - 1] = 0;
+  _bc_free_digits (num->n_ptr);
+  num->n_ptr = ptr;
+  num->n_value = ptr;
+}
+
+/* Allocation statistics of the calling thread.  A number released by
+   another thread than the one that created it is accounted to the
+   releasing thread. */
+
+void
+bc_get_alloc_stats (stats)
+     bc_alloc_stats *stats;
+{
+  *stats = _bc_Stats;
+  stats->cached_bytes = stats->free_list_length * (long) sizeof (bc_struct)
+    + stats->block_list_length * (long) (sizeof (bc_digit_header)
+                                         + BC_BLOCK_DIGITS);
+}
+
+void
+bc_reset_alloc_stats ()
+{
+  _bc_Stats.allocations = 0;
+  _bc_Stats.free_list_hits = 0;
+  _bc_Stats.arena_bytes = 0;
+  _bc_Stats.arena_survivors = 0;
+  _bc_Stats.block_hits = 0;
+  _bc_Stats.peak_live = _bc_Stats.live;
+}
+
+/* Sets the maximum number of headers kept in each thread's free list,
+   and of digit blocks in its block list.  Returns the previous setting.
+   Free lists longer than a new, smaller cap shrink as numbers are
+   allocated, block lists stop growing; bc_trim_free_list empties both
+   at once. */
+
+int
+bc_set_free_list_cap (cap)
+     int cap;
+{
+  int result;
+
+  result = _bc_Free_cap;
+  _bc_Free_cap = MAX (cap, 0);
+  return result;
+}
+
+/* Returns all headers in the free list of the calling thread, and its
+   released digit blocks, to the heap. */
+
+void
+bc_trim_free_list ()
+{
+  bc_num temp;
+  char *block;
+
+  while (_bc_Free_list != NULL) {
+    temp = _bc_Free_list;
+    _bc_Free_list = temp->n_next;
+    free (temp);
+  }
+  _bc_Stats.free_list_length = 0;
+
+  while (_bc_Block_list != NULL) {
+    block = _bc_Block_list;
+    _bc_Block_list = *(char **) block;
+    free (_bc_digit_header (block));
+  }
+  _bc_Stats.block_list_length = 0;
+}
+
 
 /* Intitialize the number package! */
 
@@ -131,6 +491,7 @@ bc_init_numbers ()
   _one_->n_value[0] = 1;
   _two_  = bc_new_num (1,0);
   _two_->n_value[0] = 2;
+  _bc_select_digit_kernels ();
 }
 
 
@@ -140,7 +501,7 @@ bc_num
 bc_copy_num (num)
      bc_num num;
 {
-  num->n_refs++;
+  _bc_ref_inc (num);
   return num;
 }
 
@@ -354,6 +715,473 @@ bc_is_near_zero (num, scale)
 }
 
 
+/* Digit kernels for addition and subtraction.  Both operate on N
+   aligned digits (most significant first), take a carry (borrow)
+   into the last digit and return the carry (borrow) out of the first
+   one.  The vectorized variants add all lanes independently and then
+   resolve the carries in further passes, each of which moves every
+   pending carry one digit to the left.  Carries rarely ripple through
+   more than a few nines, and the final scalar sweep handles the rest. */
+
+#define BC_CARRY_PASSES 6
+
+static int
+_bc_add_digits_scalar (const char *a, const char *b, char *r, int n,
+                       int carry)
+{
+  int val;
+
+  while (n-- > 0)
+    {
+      val = a[n] + b[n] + carry;
+      carry = val > BASE-1;
+      r[n] = carry ? val - BASE : val;
+    }
+  return carry;
+}
+
+static int
+_bc_sub_digits_scalar (const char *a, const char *b, char *r, int n,
+                       int borrow)
+{
+  int val;
+
+  while (n-- > 0)
+    {
+      val = a[n] - b[n] - borrow;
+      borrow = val < 0;
+      r[n] = borrow ? val + BASE : val;
+    }
+  return borrow;
+}
+
+/* Resolves digits in the range 0..2*BASE-1 (addition) or -BASE..BASE-1
+   (subtraction) one by one.  Returns the carry out of the first digit. */
+static int
+_bc_normalize_digits (signed char *r, int n, int carry)
+{
+  int val;
+
+  while (n-- > 0)
+    {
+      val = r[n] + carry;
+      carry = val > BASE-1 ? 1 : val < 0 ? -1 : 0;
+      r[n] = val - carry * BASE;
+    }
+  return carry;
+}
+
+/* Character kernels: the digits 0..9 to the characters '0'..'9' and
+   back.  The latter returns FALSE if one of the N characters is not a
+   decimal digit, and only checks them if DEST is NULL. */
+
+static void
+_bc_digits2ascii_scalar (char *dest, const char *digits, int n)
+{
+  while (n-- > 0)
+    *dest++ = *digits++ + '0';
+}
+
+static int
+_bc_ascii2digits_scalar (char *dest, const char *chars, int n)
+{
+  unsigned char val;
+
+  while (n-- > 0)
+    {
+      val = (unsigned char) (*chars++ - '0');
+      if (val > BASE-1)
+        return FALSE;
+      if (dest != NULL)
+        *dest++ = val;
+    }
+  return TRUE;
+}
+
+static int (*_bc_add_digits) (const char *, const char *, char *, int, int)
+  = _bc_add_digits_scalar;
+static int (*_bc_sub_digits) (const char *, const char *, char *, int, int)
+  = _bc_sub_digits_scalar;
+static void (*_bc_to_ascii) (char *, const char *, int)
+  = _bc_digits2ascii_scalar;
+static int (*_bc_from_ascii) (char *, const char *, int)
+  = _bc_ascii2digits_scalar;
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BC_HAVE_SSE2
+
+/* LANES is a multiple of 16.  The first N-M digits are the vector part,
+   so that the vector loads of the next digit stay inside R. */
+static int
+_bc_add_digits_sse2 (const char *a, const char *b, char *r, int n,
+                     int carry)
+{
+  __m128i v, g, gn, any;
+  const __m128i nine = _mm_set1_epi8 (BASE-1);
+  const __m128i ten = _mm_set1_epi8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 16) * 16;
+  carry = _bc_add_digits_scalar (a + m, b + m, r + m, n - m, carry);
+  if (m == 0)
+    return carry;
+  for (i = 0; i < m; i += 16)
+    _mm_storeu_si128 ((__m128i *) (r + i),
+                      _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *) (a + i)),
+                                    _mm_loadu_si128 ((const __m128i *) (b + i))));
+  r[m-1] += carry;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += r[0] > BASE-1;
+      any = _mm_setzero_si128 ();
+      for (i = 0; i < m; i += 16)
+        {
+          v = _mm_loadu_si128 ((const __m128i *) (r + i));
+          g = _mm_cmpgt_epi8 (v, nine);
+          gn = _mm_cmpgt_epi8 (_mm_loadu_si128 ((const __m128i *) (r + i + 1)),
+                               nine);
+          v = _mm_sub_epi8 (_mm_sub_epi8 (v, _mm_and_si128 (g, ten)), gn);
+          _mm_storeu_si128 ((__m128i *) (r + i), v);
+          any = _mm_or_si128 (any, g);
+        }
+      if (_mm_movemask_epi8 (any) == 0)
+        return out;
+    }
+  return out + _bc_normalize_digits ((signed char *) r, m, 0);
+}
+
+static int
+_bc_sub_digits_sse2 (const char *a, const char *b, char *r, int n,
+                     int borrow)
+{
+  __m128i v, g, gn, any;
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i ten = _mm_set1_epi8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 16) * 16;
+  borrow = _bc_sub_digits_scalar (a + m, b + m, r + m, n - m, borrow);
+  if (m == 0)
+    return borrow;
+  for (i = 0; i < m; i += 16)
+    _mm_storeu_si128 ((__m128i *) (r + i),
+                      _mm_sub_epi8 (_mm_loadu_si128 ((const __m128i *) (a + i)),
+                                    _mm_loadu_si128 ((const __m128i *) (b + i))));
+  r[m-1] -= borrow;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += ((signed char *) r)[0] < 0;
+      any = zero;
+      for (i = 0; i < m; i += 16)
+        {
+          v = _mm_loadu_si128 ((const __m128i *) (r + i));
+          g = _mm_cmplt_epi8 (v, zero);
+          gn = _mm_cmplt_epi8 (_mm_loadu_si128 ((const __m128i *) (r + i + 1)),
+                               zero);
+          v = _mm_add_epi8 (_mm_add_epi8 (v, _mm_and_si128 (g, ten)), gn);
+          _mm_storeu_si128 ((__m128i *) (r + i), v);
+          any = _mm_or_si128 (any, g);
+        }
+      if (_mm_movemask_epi8 (any) == 0)
+        return out;
+    }
+  return out - _bc_normalize_digits ((signed char *) r, m, 0);
+}
+
+static void
+_bc_digits2ascii_sse2 (char *dest, const char *digits, int n)
+{
+  const __m128i zero = _mm_set1_epi8 ('0');
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    _mm_storeu_si128 ((__m128i *) (dest + i),
+                      _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *) (digits + i)),
+                                    zero));
+  _bc_digits2ascii_scalar (dest + i, digits + i, n - i);
+}
+
+/* The characters below '0' wrap around to large unsigned values. */
+static int
+_bc_ascii2digits_sse2 (char *dest, const char *chars, int n)
+{
+  __m128i v;
+  const __m128i zero = _mm_set1_epi8 ('0');
+  const __m128i nine = _mm_set1_epi8 (BASE-1);
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      v = _mm_sub_epi8 (_mm_loadu_si128 ((const __m128i *) (chars + i)), zero);
+      if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_min_epu8 (v, nine), v))
+          != 0xFFFF)
+        return FALSE;
+      if (dest != NULL)
+        _mm_storeu_si128 ((__m128i *) (dest + i), v);
+    }
+  return _bc_ascii2digits_scalar (dest != NULL ? dest + i : NULL, chars + i,
+                                  n - i);
+}
+#endif /* SSE2 */
+
+#if defined(BC_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BC_HAVE_AVX2
+
+__attribute__((target("avx2"))) static int
+_bc_add_digits_avx2 (const char *a, const char *b, char *r, int n,
+                     int carry)
+{
+  __m256i v, g, gn, any;
+  const __m256i nine = _mm256_set1_epi8 (BASE-1);
+  const __m256i ten = _mm256_set1_epi8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 32) * 32;
+  if (m == 0)
+    return _bc_add_digits_sse2 (a, b, r, n, carry);
+  carry = _bc_add_digits_scalar (a + m, b + m, r + m, n - m, carry);
+  for (i = 0; i < m; i += 32)
+    _mm256_storeu_si256 ((__m256i *) (r + i),
+                         _mm256_add_epi8 (_mm256_loadu_si256 ((const __m256i *) (a + i)),
+                                          _mm256_loadu_si256 ((const __m256i *) (b + i))));
+  r[m-1] += carry;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += r[0] > BASE-1;
+      any = _mm256_setzero_si256 ();
+      for (i = 0; i < m; i += 32)
+        {
+          v = _mm256_loadu_si256 ((const __m256i *) (r + i));
+          g = _mm256_cmpgt_epi8 (v, nine);
+          gn = _mm256_cmpgt_epi8 (_mm256_loadu_si256 ((const __m256i *) (r + i + 1)),
+                                  nine);
+          v = _mm256_sub_epi8 (_mm256_sub_epi8 (v, _mm256_and_si256 (g, ten)), gn);
+          _mm256_storeu_si256 ((__m256i *) (r + i), v);
+          any = _mm256_or_si256 (any, g);
+        }
+      if (_mm256_movemask_epi8 (any) == 0)
+        return out;
+    }
+  return out + _bc_normalize_digits ((signed char *) r, m, 0);
+}
+
+__attribute__((target("avx2"))) static int
+_bc_sub_digits_avx2 (const char *a, const char *b, char *r, int n,
+                     int borrow)
+{
+  __m256i v, g, gn, any;
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i ten = _mm256_set1_epi8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 32) * 32;
+  if (m == 0)
+    return _bc_sub_digits_sse2 (a, b, r, n, borrow);
+  borrow = _bc_sub_digits_scalar (a + m, b + m, r + m, n - m, borrow);
+  for (i = 0; i < m; i += 32)
+    _mm256_storeu_si256 ((__m256i *) (r + i),
+                         _mm256_sub_epi8 (_mm256_loadu_si256 ((const __m256i *) (a + i)),
+                                          _mm256_loadu_si256 ((const __m256i *) (b + i))));
+  r[m-1] -= borrow;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += ((signed char *) r)[0] < 0;
+      any = zero;
+      for (i = 0; i < m; i += 32)
+        {
+          v = _mm256_loadu_si256 ((const __m256i *) (r + i));
+          g = _mm256_cmpgt_epi8 (zero, v);
+          gn = _mm256_cmpgt_epi8 (zero,
+                                  _mm256_loadu_si256 ((const __m256i *) (r + i + 1)));
+          v = _mm256_add_epi8 (_mm256_add_epi8 (v, _mm256_and_si256 (g, ten)), gn);
+          _mm256_storeu_si256 ((__m256i *) (r + i), v);
+          any = _mm256_or_si256 (any, g);
+        }
+      if (_mm256_movemask_epi8 (any) == 0)
+        return out;
+    }
+  return out - _bc_normalize_digits ((signed char *) r, m, 0);
+}
+#endif /* AVX2 */
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BC_HAVE_NEON
+
+static int
+_bc_add_digits_neon (const char *a, const char *b, char *r, int n,
+                     int carry)
+{
+  int8x16_t v, g, gn;
+  uint8x16_t any;
+  const int8x16_t nine = vdupq_n_s8 (BASE-1);
+  const int8x16_t ten = vdupq_n_s8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 16) * 16;
+  carry = _bc_add_digits_scalar (a + m, b + m, r + m, n - m, carry);
+  if (m == 0)
+    return carry;
+  for (i = 0; i < m; i += 16)
+    vst1q_s8 ((int8_t *) (r + i), vaddq_s8 (vld1q_s8 ((const int8_t *) (a + i)),
+                                            vld1q_s8 ((const int8_t *) (b + i))));
+  r[m-1] += carry;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += ((signed char *) r)[0] > BASE-1;
+      any = vdupq_n_u8 (0);
+      for (i = 0; i < m; i += 16)
+        {
+          v = vld1q_s8 ((const int8_t *) (r + i));
+          g = vreinterpretq_s8_u8 (vcgtq_s8 (v, nine));
+          gn = vreinterpretq_s8_u8 (vcgtq_s8 (vld1q_s8 ((const int8_t *) (r + i + 1)),
+                                              nine));
+          v = vsubq_s8 (vsubq_s8 (v, vandq_s8 (g, ten)), gn);
+          vst1q_s8 ((int8_t *) (r + i), v);
+          any = vorrq_u8 (any, vreinterpretq_u8_s8 (g));
+        }
+      if (vmaxvq_u8 (any) == 0)
+        return out;
+    }
+  return out + _bc_normalize_digits ((signed char *) r, m, 0);
+}
+
+static int
+_bc_sub_digits_neon (const char *a, const char *b, char *r, int n,
+                     int borrow)
+{
+  int8x16_t v, g, gn;
+  uint8x16_t any;
+  const int8x16_t zero = vdupq_n_s8 (0);
+  const int8x16_t ten = vdupq_n_s8 (BASE);
+  int m, i, pass, out;
+
+  m = ((n - 1) / 16) * 16;
+  borrow = _bc_sub_digits_scalar (a + m, b + m, r + m, n - m, borrow);
+  if (m == 0)
+    return borrow;
+  for (i = 0; i < m; i += 16)
+    vst1q_s8 ((int8_t *) (r + i), vsubq_s8 (vld1q_s8 ((const int8_t *) (a + i)),
+                                            vld1q_s8 ((const int8_t *) (b + i))));
+  r[m-1] -= borrow;
+
+  out = 0;
+  for (pass = 0; pass < BC_CARRY_PASSES; pass++)
+    {
+      out += ((signed char *) r)[0] < 0;
+      any = vdupq_n_u8 (0);
+      for (i = 0; i < m; i += 16)
+        {
+          v = vld1q_s8 ((const int8_t *) (r + i));
+          g = vreinterpretq_s8_u8 (vcltq_s8 (v, zero));
+          gn = vreinterpretq_s8_u8 (vcltq_s8 (vld1q_s8 ((const int8_t *) (r + i + 1)),
+                                              zero));
+          v = vaddq_s8 (vaddq_s8 (v, vandq_s8 (g, ten)), gn);
+          vst1q_s8 ((int8_t *) (r + i), v);
+          any = vorrq_u8 (any, vreinterpretq_u8_s8 (g));
+        }
+      if (vmaxvq_u8 (any) == 0)
+        return out;
+    }
+  return out - _bc_normalize_digits ((signed char *) r, m, 0);
+}
+
+static void
+_bc_digits2ascii_neon (char *dest, const char *digits, int n)
+{
+  const uint8x16_t zero = vdupq_n_u8 ('0');
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    vst1q_u8 ((uint8_t *) (dest + i),
+              vaddq_u8 (vld1q_u8 ((const uint8_t *) (digits + i)), zero));
+  _bc_digits2ascii_scalar (dest + i, digits + i, n - i);
+}
+
+static int
+_bc_ascii2digits_neon (char *dest, const char *chars, int n)
+{
+  uint8x16_t v;
+  const uint8x16_t zero = vdupq_n_u8 ('0');
+  const uint8x16_t nine = vdupq_n_u8 (BASE-1);
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      v = vsubq_u8 (vld1q_u8 ((const uint8_t *) (chars + i)), zero);
+      if (vminvq_u8 (vcleq_u8 (v, nine)) == 0)
+        return FALSE;
+      if (dest != NULL)
+        vst1q_u8 ((uint8_t *) (dest + i), v);
+    }
+  return _bc_ascii2digits_scalar (dest != NULL ? dest + i : NULL, chars + i,
+                                  n - i);
+}
+#endif /* NEON */
+
+/* Picks the widest digit kernels the running CPU supports.  BC_SIMD=0 in
+   the environment forces the scalar loops. */
+static void
+_bc_select_digit_kernels (void)
+{
+  const char *env;
+
+  env = getenv ("BC_SIMD");
+  if (env != NULL && *env == '0')
+    return;
+#if defined(BC_HAVE_SSE2)
+  _bc_to_ascii = _bc_digits2ascii_sse2;
+  _bc_from_ascii = _bc_ascii2digits_sse2;
+#elif defined(BC_HAVE_NEON)
+  _bc_to_ascii = _bc_digits2ascii_neon;
+  _bc_from_ascii = _bc_ascii2digits_neon;
+#endif
+#if defined(BC_HAVE_AVX2)
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      _bc_add_digits = _bc_add_digits_avx2;
+      _bc_sub_digits = _bc_sub_digits_avx2;
+      return;
+    }
+#endif
+#if defined(BC_HAVE_SSE2)
+  _bc_add_digits = _bc_add_digits_sse2;
+  _bc_sub_digits = _bc_sub_digits_sse2;
+#elif defined(BC_HAVE_NEON)
+  _bc_add_digits = _bc_add_digits_neon;
+  _bc_sub_digits = _bc_sub_digits_neon;
+#endif
+}
+
+/* Writes the N digits at DIGITS as the characters '0'..'9' to DEST. */
+void
+bc_digits2ascii (char *dest, const char *digits, int n)
+{
+  _bc_to_ascii (dest, digits, n);
+}
+
+/* Converts the N characters '0'..'9' at CHARS to the digits 0..9 at DEST,
+   which may be NULL to check the characters only.  Returns FALSE if one
+   of them is not a decimal digit, DEST is then partly written. */
+int
+bc_ascii2digits (char *dest, const char *chars, int n)
+{
+  return _bc_from_ascii (dest, chars, n);
+}
+
 /* Perform addition: N1 is added to N2 and the value is
    returned.  The signs of N1 and N2 are ignored.
    SCALE_MIN is to set the minimum scale of the result. */
@@ -403,21 +1231,13 @@ _bc_do_add (n1, n2, scale_min)
   /* Now add the remaining fraction part and equal size integer parts. */
   n1bytes += n1->n_len;
   n2bytes += n2->n_len;
-  carry = 0;
-  while ((n1bytes > 0) && (n2bytes > 0))
-    {
-      *sumptr = *n1ptr-- + *n2ptr-- + carry;
-      if (*sumptr > (BASE-1))
-	{
-	   carry = 1;
-	   *sumptr -= BASE;
-	}
-      else
-	carry = 0;
-      sumptr--;
-      n1bytes--;
-      n2bytes--;
-    }
+  count = MIN (n1bytes, n2bytes);
+  n1ptr -= count;
+  n2ptr -= count;
+  sumptr -= count;
+  carry = _bc_add_digits (n1ptr+1, n2ptr+1, sumptr+1, count, 0);
+  n1bytes -= count;
+  n2bytes -= count;
 
   /* Now add carry the longer integer part. */
   if (n1bytes == 0)
@@ -510,18 +1330,11 @@ _bc_do_sub (n1, n2, scale_min)
 
   /* Now do the equal length scale and integer parts. */
 
-  for (count = 0; count < min_len + min_scale; count++)
-    {
-      val = *n1ptr-- - *n2ptr-- - borrow;
-      if (val < 0)
-	{
-	  val += BASE;
-	  borrow = 1;
-	}
-      else
-	borrow = 0;
-      *diffptr-- = val;
-    }
+  count = min_len + min_scale;
+  n1ptr -= count;
+  n2ptr -= count;
+  diffptr -= count;
+  borrow = _bc_sub_digits (n1ptr+1, n2ptr+1, diffptr+1, count, borrow);
 
   /* If n1 has more digits then n2, we now do that subtract. */
   if (diff_len != min_len)
@@ -643,39 +1456,172 @@ bc_add (n1, n2, result, scale_min)
   *result = sum;
 }
 
-/* Recursive vs non-recursive multiply crossover ranges. */
+/* Recursive vs non-recursive multiply crossover ranges.  Both count the
+   digits of the two operands together.  The defaults were measured with
+   bc_calibrate_mul on current hardware; a build may override them in
+   muldigits.h, and an application may re-run the calibration at startup. */
 #if defined(MULDIGITS)
 #include "muldigits.h"
-#else
-#define MUL_BASE_DIGITS 80
+#endif
+#ifndef MUL_BASE_DIGITS
+#define MUL_BASE_DIGITS 3200
+#endif
+#ifndef MUL_TOOM3_DIGITS
+#define MUL_TOOM3_DIGITS 16000
 #endif
 
 int mul_base_digits = MUL_BASE_DIGITS;
+int mul_toom3_digits = MUL_TOOM3_DIGITS;
 #define MUL_SMALL_DIGITS mul_base_digits/4
 
-/* Multiply utility routines */
+/* Multiply utility routines */
+
+static bc_num
+new_sub_num (length, scale, value)
+     int length, scale;
+     char *value;
+{
+  bc_num temp;
+
+  temp = _bc_new_struct ();
+  temp->n_sign = PLUS;
+  temp->n_len = length;
+  temp->n_scale = scale;
+  temp->n_refs = 1;
+  temp->n_ptr = NULL;
+  temp->n_value = value;
+  return temp;
+}
+
+/* Packed limb arithmetic.  The public representation stores one decimal
+   digit per byte, and floatnum relies on being able to address single
+   digits inside n_value.  The quadratic kernels, however, pack their
+   operands into little endian base 10^9 limbs first, so the inner loops
+   touch 81 times fewer digit pairs. */
+
+#define BC_LIMB_DIGITS 9
+#define BC_LIMB_BASE 1000000000u
+
+typedef unsigned int bc_limb;
+
+/* Below this many digits in either operand, packing costs more than
+   it saves. */
+#define MUL_LIMB_DIGITS 12
+
+int mul_limb_digits = MUL_LIMB_DIGITS;
+
+
+static int
+_bc_limbcount (int len)
+{
+  return (len + BC_LIMB_DIGITS - 1) / BC_LIMB_DIGITS;
+}
+
+/* Packs the LEN digits at DIGITS (most significant first) into LIMBS
+   (least significant first).  Returns the number of limbs written. */
+static int
+_bc_pack_limbs (const char *digits, int len, bc_limb *limbs)
+{
+  const char *ptr;
+  int count, lg, ix;
+  bc_limb val;
+
+  ptr = digits + len;
+  count = 0;
+  while (len > 0)
+    {
+      lg = MIN (len, BC_LIMB_DIGITS);
+      ptr -= lg;
+      val = 0;
+      for (ix = 0; ix < lg; ix++)
+        val = val * BASE + ptr[ix];
+      limbs[count++] = val;
+      len -= lg;
+    }
+  return count;
+}
+
+/* Unpacks NLIMBS limbs into exactly LEN digits (most significant first).
+   Digits above LEN must be zero. */
+static void
+_bc_unpack_limbs (const bc_limb *limbs, int nlimbs, char *digits, int len)
+{
+  char *ptr;
+  bc_limb val;
+  int ix, lg;
+
+  ptr = digits + len;
+  for (ix = 0; ix < nlimbs && len > 0; ix++)
+    {
+      val = limbs[ix];
+      for (lg = MIN (len, BC_LIMB_DIGITS); lg > 0; lg--, len--)
+        {
+          *--ptr = val % BASE;
+          val /= BASE;
+        }
+    }
+  if (len > 0)
+    memset (digits, 0, len);
+}
 
-static bc_num
-new_sub_num (length, scale, value)
-     int length, scale;
-     char *value;
+/* Schoolbook product of two limb arrays.  RESULT must have room for
+   NA+NB limbs and must not overlap the operands.  The limb pairs of the
+   lowest SKIP columns (i+j < SKIP) are left out, see _bc_short_mul. */
+static void
+_bc_limb_mul (const bc_limb *a, int na, const bc_limb *b, int nb,
+              bc_limb *result, int skip)
 {
-  bc_num temp;
+  unsigned long long t;
+  bc_limb carry, ai;
+  int i, j;
 
-  if (_bc_Free_list != NULL) {
-    temp = _bc_Free_list;
-    _bc_Free_list = temp->n_next;
-  } else {
-    temp = (bc_num) malloc (sizeof(bc_struct));
-    if (temp == NULL) bc_out_of_memory ();
-  }
-  temp->n_sign = PLUS;
-  temp->n_len = length;
-  temp->n_scale = scale;
-  temp->n_refs = 1;
-  temp->n_ptr = NULL;
-  temp->n_value = value;
-  return temp;
+  memset (result, 0, (na + nb) * sizeof (bc_limb));
+  for (i = 0; i < na; i++)
+    {
+      ai = a[i];
+      if (ai == 0)
+        continue;
+      carry = 0;
+      for (j = MAX (skip - i, 0); j < nb; j++)
+        {
+          t = (unsigned long long) ai * b[j] + result[i+j] + carry;
+          carry = (bc_limb) (t / BC_LIMB_BASE);
+          result[i+j] = (bc_limb) (t - (unsigned long long) carry * BC_LIMB_BASE);
+        }
+      result[i+nb] = carry;
+    }
+}
+
+/* Multiplies the integers formed by the N1LEN digits at N1 and the N2LEN
+   digits at N2 using packed limbs.  The product is written right aligned
+   into the PRODLEN digits at PROD.  SKIP is passed to _bc_limb_mul. */
+static void
+_bc_limb_simp_mul (const char *n1, int n1len, const char *n2, int n2len,
+                   char *prod, int prodlen, int skip)
+{
+  bc_limb stack[64];
+  bc_limb *buf, *l1, *l2, *lp;
+  int nl1, nl2, size;
+
+  nl1 = _bc_limbcount (n1len);
+  nl2 = _bc_limbcount (n2len);
+  size = 2 * (nl1 + nl2);
+  if (size <= (int) (sizeof (stack) / sizeof (bc_limb)))
+    buf = stack;
+  else
+    {
+      buf = (bc_limb *) malloc (size * sizeof (bc_limb));
+      if (buf == NULL) bc_out_of_memory ();
+    }
+  l1 = buf;
+  l2 = l1 + nl1;
+  lp = l2 + nl2;
+  _bc_pack_limbs (n1, n1len, l1);
+  _bc_pack_limbs (n2, n2len, l2);
+  _bc_limb_mul (l1, nl1, l2, nl2, lp, skip);
+  _bc_unpack_limbs (lp, nl1 + nl2, prod, prodlen);
+  if (buf != stack)
+    free (buf);
 }
 
 static void
@@ -691,6 +1637,13 @@ _bc_simp_mul (bc_num n1, int n1len, bc_num n2, int n2len, bc_num *prod,
 
   *prod = bc_new_num (prodlen, 0);
 
+  if (n1len >= mul_limb_digits && n2len >= mul_limb_digits)
+    {
+      _bc_limb_simp_mul (n1->n_value, n1len, n2->n_value, n2len,
+                         (*prod)->n_value, prodlen, 0);
+      return;
+    }
+
   n1end = (char *) (n1->n_value + n1len - 1);
   n2end = (char *) (n2->n_value + n2len - 1);
   pvptr = (char *) ((*prod)->n_value + prodlen - 1);
@@ -772,6 +1725,148 @@ _bc_shift_addsub (bc_num accum, bc_num val, int shift, int sub)
   }
 }
 
+static void _bc_rec_mul (bc_num u, int ulen, bc_num v, int vlen,
+                         bc_num *prod, int full_scale);
+
+/* Returns the COUNT digits of the integer U (ULEN digits) that start at
+   the digit with weight 10^FROM, as a number sharing U's storage. */
+static bc_num
+_bc_digit_slice (bc_num u, int ulen, int from, int count)
+{
+  bc_num slice;
+  int start;
+
+  start = ulen - from - count;
+  if (start < 0)
+    {
+      count += start;
+      start = 0;
+    }
+  if (count <= 0)
+    return bc_copy_num (_zero_);
+  slice = new_sub_num (count, 0, u->n_value + start);
+  _bc_rm_leading_zeros (slice);
+  return slice;
+}
+
+/* Signed product of two integers, used for the point-wise products
+   of the Toom-Cook evaluation. */
+static void
+_bc_signed_mul (bc_num n1, bc_num n2, bc_num *prod)
+{
+  bc_num pval;
+
+  if (bc_is_zero (n1) || bc_is_zero (n2))
+    {
+      bc_free_num (prod);
+      *prod = bc_copy_num (_zero_);
+      return;
+    }
+  _bc_rec_mul (n1, n1->n_len, n2, n2->n_len, &pval, 0);
+  _bc_rm_leading_zeros (pval);
+  pval->n_sign = (n1->n_sign == n2->n_sign ? PLUS : MINUS);
+  bc_free_num (prod);
+  *prod = pval;
+}
+
+/* Evaluates the 3 part polynomial P2*x^2 + P1*x + P0 at x = 1, -1, -2. */
+static void
+_bc_toom3_eval (bc_num p0, bc_num p1, bc_num p2,
+                bc_num *at1, bc_num *atm1, bc_num *atm2)
+{
+  bc_num t = NULL;
+
+  bc_add (p0, p2, &t, 0);
+  bc_add (t, p1, at1, 0);
+  bc_sub (t, p1, atm1, 0);
+  bc_add (*atm1, p2, atm2, 0);
+  bc_add (*atm2, *atm2, atm2, 0);
+  bc_sub (*atm2, p0, atm2, 0);
+  bc_free_num (&t);
+}
+
+/* Toom-Cook 3-way multiplication.  U and V are split into three parts
+   of N digits each, the product polynomial is evaluated at
+   0, 1, -1, -2 and infinity, and the five coefficients are recovered
+   with Bodrato's interpolation sequence.  All coefficients of the
+   product of two polynomials with non-negative coefficients are
+   non-negative, so they can be accumulated with _bc_shift_addsub. */
+static void
+_bc_toom3_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num *prod)
+{
+  bc_num u0, u1, u2, v0, v1, v2;
+  bc_num pu1, pum1, pum2, pv1, pvm1, pvm2;
+  bc_num r0, r1, r2, r3, r4, rm1, rm2;
+  bc_num three;
+  int n;
+
+  n = (MAX(ulen, vlen) + 2) / 3;
+
+  u0 = _bc_digit_slice (u, ulen, 0, n);
+  u1 = _bc_digit_slice (u, ulen, n, n);
+  u2 = _bc_digit_slice (u, ulen, 2*n, ulen);
+  v0 = _bc_digit_slice (v, vlen, 0, n);
+  v1 = _bc_digit_slice (v, vlen, n, n);
+  v2 = _bc_digit_slice (v, vlen, 2*n, vlen);
+
+  pu1 = pum1 = pum2 = pv1 = pvm1 = pvm2 = NULL;
+  r0 = r1 = r2 = r3 = r4 = rm1 = rm2 = NULL;
+  _bc_toom3_eval (u0, u1, u2, &pu1, &pum1, &pum2);
+  _bc_toom3_eval (v0, v1, v2, &pv1, &pvm1, &pvm2);
+
+  /* Point-wise products. */
+  _bc_signed_mul (u0, v0, &r0);
+  _bc_signed_mul (pu1, pv1, &r1);
+  _bc_signed_mul (pum1, pvm1, &rm1);
+  _bc_signed_mul (pum2, pvm2, &rm2);
+  _bc_signed_mul (u2, v2, &r4);
+
+  /* Interpolation. */
+  three = NULL;
+  bc_int2num (&three, 3);
+  bc_sub (rm2, r1, &r3, 0);
+  bc_divide (r3, three, &r3, 0);
+  bc_sub (r1, rm1, &r1, 0);
+  bc_divide (r1, _two_, &r1, 0);
+  bc_sub (rm1, r0, &r2, 0);
+  bc_sub (r2, r3, &r3, 0);
+  bc_divide (r3, _two_, &r3, 0);
+  bc_add (r3, r4, &r3, 0);
+  bc_add (r3, r4, &r3, 0);
+  bc_add (r2, r1, &r2, 0);
+  bc_sub (r2, r4, &r2, 0);
+  bc_sub (r1, r3, &r1, 0);
+
+  /* Recomposition. */
+  *prod = bc_new_num (ulen+vlen+1, 0);
+  _bc_shift_addsub (*prod, r0, 0, 0);
+  _bc_shift_addsub (*prod, r1, n, 0);
+  _bc_shift_addsub (*prod, r2, 2*n, 0);
+  _bc_shift_addsub (*prod, r3, 3*n, 0);
+  _bc_shift_addsub (*prod, r4, 4*n, 0);
+
+  bc_free_num (&u0);
+  bc_free_num (&u1);
+  bc_free_num (&u2);
+  bc_free_num (&v0);
+  bc_free_num (&v1);
+  bc_free_num (&v2);
+  bc_free_num (&pu1);
+  bc_free_num (&pum1);
+  bc_free_num (&pum2);
+  bc_free_num (&pv1);
+  bc_free_num (&pvm1);
+  bc_free_num (&pvm2);
+  bc_free_num (&r0);
+  bc_free_num (&r1);
+  bc_free_num (&r2);
+  bc_free_num (&r3);
+  bc_free_num (&r4);
+  bc_free_num (&rm1);
+  bc_free_num (&rm2);
+  bc_free_num (&three);
+}
+
 /* Recursive divide and conquer multiply algorithm.
    Based on
    Let u = u0 + u1*(b^n)
@@ -798,6 +1893,13 @@ _bc_rec_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num *prod,
     return;
   }
 
+  /* Large and roughly balanced operands go to Toom-Cook 3-way. */
+  if ((ulen+vlen) >= mul_toom3_digits
+      && 3*MIN(ulen, vlen) > 2*MAX(ulen, vlen)) {
+    _bc_toom3_mul (u, ulen, v, vlen, prod);
+    return;
+  }
+
   /* Calculate n -- the u and v split point in digits. */
   n = (MAX(ulen, vlen)+1) / 2;
 
@@ -875,27 +1977,73 @@ _bc_rec_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num *prod,
   bc_free_num (&d2);
 }
 
-/* The multiply routine.  N2 times N1 is put int PROD with the scale of
-   the result being MIN(N2 scale+N1 scale, MAX (SCALE, N2 scale, N1 scale)).
-   */
+/* Short products.  When the last CUT digits of the product are dropped,
+   the limb pairs far below them need not be multiplied.  The pairs of the
+   lowest SKIP columns add up to less than SKIP * BC_LIMB_BASE^(SKIP+1),
+   so if the digits of the partial product between that bound and the
+   cut are not all nines, the missing part cannot carry into the digits
+   kept, and these are those of the full product.  Otherwise FALSE is
+   returned, and the caller computes the full product.  Only the
+   schoolbook tier is shortened, the recursive ones split their operands
+   into halves or thirds, and each part needs its full product. */
 
-void
-bc_multiply (n1, n2, prod, scale)
-     bc_num n1, n2, *prod;
-     int scale;
+/* Digits between the bound and the cut, to make the fall back rare. */
+#define MUL_SHORT_GUARD_DIGITS 3
+
+static int
+_bc_short_mul (bc_num n1, int n1len, bc_num n2, int n2len, int cut,
+               bc_num *prod)
+{
+  int skip, low, prodlen, ix;
+
+  if (n1len < mul_limb_digits || n2len < mul_limb_digits
+      || ((n1len+n2len) >= mul_base_digits
+          && n1len >= MUL_SMALL_DIGITS && n2len >= MUL_SMALL_DIGITS))
+    return FALSE;
+
+  /* The bound has BC_LIMB_DIGITS*(SKIP+1) digits, and those of SKIP. */
+  skip = cut / BC_LIMB_DIGITS;
+  for (;;)
+    {
+      low = BC_LIMB_DIGITS * (skip + 1);
+      for (ix = skip; ix > 0; ix /= 10)
+        low++;
+      if (skip < 2 || low + MUL_SHORT_GUARD_DIGITS <= cut)
+        break;
+      skip--;
+    }
+  if (skip < 2)
+    return FALSE;
+
+  prodlen = n1len + n2len + 1;
+  *prod = bc_new_num (prodlen, 0);
+  _bc_limb_simp_mul (n1->n_value, n1len, n2->n_value, n2len,
+                     (*prod)->n_value, prodlen, skip);
+  for (ix = low; ix < cut; ix++)
+    if ((*prod)->n_value[prodlen - 1 - ix] != BASE - 1)
+      return TRUE;
+  bc_free_num (prod);
+  return FALSE;
+}
+
+/* The product of N1 and N2, truncated to PROD_SCALE digits after the
+   decimal point, which may be fewer than those of the operands. */
+static void
+_bc_multiply_trunc (bc_num n1, bc_num n2, bc_num *prod, int prod_scale)
 {
   bc_num pval;
   int len1, len2;
-  int full_scale, prod_scale;
+  int full_scale;
 
   /* Initialize things. */
   len1 = n1->n_len + n1->n_scale;
   len2 = n2->n_len + n2->n_scale;
   full_scale = n1->n_scale + n2->n_scale;
-  prod_scale = MIN(full_scale,MAX(scale,MAX(n1->n_scale,n2->n_scale)));
+  prod_scale = MIN(full_scale, prod_scale);
 
   /* Do the multiply */
-  _bc_rec_mul (n1, len1, n2, len2, &pval, full_scale);
+  if (!_bc_short_mul (n1, len1, n2, len2, full_scale - prod_scale, &pval))
+    _bc_rec_mul (n1, len1, n2, len2, &pval, full_scale);
 
   /* Assign to prod and clean up the number. */
   pval->n_sign = ( n1->n_sign == n2->n_sign ? PLUS : MINUS );
@@ -909,6 +2057,106 @@ bc_multiply (n1, n2, prod, scale)
   *prod = pval;
 }
 
+/* The multiply routine.  N2 times N1 is put int PROD with the scale of
+   the result being MIN(N2 scale+N1 scale, MAX (SCALE, N2 scale, N1 scale)).
+   */
+
+void
+bc_multiply (n1, n2, prod, scale)
+     bc_num n1, n2, *prod;
+     int scale;
+{
+  _bc_multiply_trunc (n1, n2, prod,
+                      MAX(scale, MAX(n1->n_scale, n2->n_scale)));
+}
+
+/* Multiplier calibration.  Times products of N digit operands until
+   the measurement covers a few milliseconds and returns the average
+   time of one product. */
+
+static double
+_bc_time_mul (bc_num n1, bc_num n2)
+{
+  bc_num prod = NULL;
+  clock_t start, elapsed;
+  long reps, ix;
+
+  reps = 1;
+  for (;;)
+    {
+      start = clock ();
+      for (ix = 0; ix < reps; ix++)
+        _bc_rec_mul (n1, n1->n_len, n2, n2->n_len, &prod, 0), bc_free_num (&prod);
+      elapsed = clock () - start;
+      if (elapsed >= CLOCKS_PER_SEC / 500 || reps >= (1L << 24))
+        return (double) elapsed / reps;
+      reps *= 2;
+    }
+}
+
+static bc_num
+_bc_calibration_operand (int digits, unsigned *seed)
+{
+  bc_num num;
+  int ix;
+
+  num = bc_new_num (digits, 0);
+  for (ix = 0; ix < digits; ix++)
+    {
+      *seed = *seed * 1103515245u + 12345u;
+      num->n_value[ix] = (*seed >> 16) % BASE;
+    }
+  if (num->n_value[0] == 0)
+    num->n_value[0] = 1;
+  return num;
+}
+
+/* Finds the operand size at which one level of the faster algorithm
+   beats the slower one.  *THRESHOLD is the switch to the faster
+   algorithm.  Returns the crossover in combined digits, or 0. */
+static int
+_bc_find_crossover (int *threshold, int first, int last)
+{
+  bc_num n1, n2;
+  unsigned seed = 4711;
+  double slow, fast;
+  int digits, result;
+
+  result = 0;
+  for (digits = first; digits <= last && result == 0; digits += digits/4)
+    {
+      n1 = _bc_calibration_operand (digits, &seed);
+      n2 = _bc_calibration_operand (digits, &seed);
+      *threshold = INT_MAX;
+      slow = _bc_time_mul (n1, n2);
+      /* Only the top level uses the faster algorithm. */
+      *threshold = 2*digits;
+      fast = _bc_time_mul (n1, n2);
+      if (fast < slow)
+        result = 2*digits;
+      bc_free_num (&n1);
+      bc_free_num (&n2);
+    }
+  return result;
+}
+
+/* Measures the crossover points of the multiplier on the running
+   machine and stores them in mul_base_digits and mul_toom3_digits.
+   Takes a fraction of a second.  A tier that never wins within the
+   tested range is switched off by a threshold above that range. */
+
+void
+bc_calibrate_mul ()
+{
+  int found;
+
+  mul_toom3_digits = INT_MAX;
+  found = _bc_find_crossover (&mul_base_digits, 16, 8000);
+  mul_base_digits = found ? found : 16000;
+  found = _bc_find_crossover (&mul_toom3_digits, mul_base_digits, 32000);
+  mul_toom3_digits = found ? found : 64000;
+}
+
 /* Some utility routines for the divide:  First a one digit multiply.
    NUM (with SIZE digits) is multiplied by DIGIT and the result is
    placed into RESULT.  It is written so that NUM and RESULT can be
@@ -949,6 +2197,152 @@ _one_mult (num, size, digit, result)
 }
 
 
+/* Division by a Newton-Raphson reciprocal.  Above div_newton_digits
+   digits in both the divisor and the quotient, the reciprocal of the
+   divisor is refined from a double precision seed, doubling the number
+   of correct digits in each step, and the quotient is obtained by one
+   multiplication.  A final correction against the exact remainder makes
+   the result identical to the one of the long division below. */
+
+#ifndef DIV_NEWTON_DIGITS
+#define DIV_NEWTON_DIGITS 20
+#endif
+
+int div_newton_digits = DIV_NEWTON_DIGITS;
+
+/* Makes an integer of the first LEN digits in DIGITS, followed by SHIFT
+   zeros. */
+static bc_num
+_bc_digits2int (const char *digits, int len, int shift)
+{
+  bc_num num;
+
+  if (len <= 0)
+    return bc_copy_num (_zero_);
+  num = bc_new_num (len + shift, 0);
+  memcpy (num->n_value, digits, len);
+  _bc_rm_leading_zeros (num);
+  return num;
+}
+
+/* Computes an approximation of 1/B, B being the fraction 0.DIGITS with
+   LEN digits and a first digit different from 0, to SCALE digits. */
+static bc_num
+_bc_newton_reciprocal (const char *digits, int len, int scale)
+{
+  bc_num b, bview, y, t;
+  char seed[40];
+  double bd;
+  int prec, ix;
+
+  b = bc_new_num (1, len);
+  memcpy (b->n_value + 1, digits, len);
+
+  bd = 0;
+  for (ix = MIN (len, 17); --ix >= 0;)
+    bd = (bd + digits[ix]) / BASE;
+  sprintf (seed, "%.14f", 1.0 / bd);
+  y = NULL;
+  bc_str2num (&y, seed, 14);
+
+  t = NULL;
+  prec = 12;
+  while (prec < scale)
+    {
+      prec = MIN (2 * prec, scale);
+      bview = new_sub_num (1, MIN (len, prec + 2), b->n_value);
+      /* y = y + y*(1 - b*y) */
+      bc_multiply (bview, y, &t, prec + 2);
+      bc_sub (_one_, t, &t, prec + 2);
+      bc_multiply (y, t, &t, prec + 2);
+      bc_add (y, t, &y, prec + 2);
+      if (y->n_scale > prec + 2)
+        y->n_scale = prec + 2;
+      bc_free_num (&bview);
+    }
+  bc_free_num (&t);
+  bc_free_num (&b);
+  return y;
+}
+
+static void
+_bc_newton_divide (bc_num n1, bc_num n2, bc_num *quot, int scale)
+{
+  bc_num a, b, y, q, r, t;
+  char *bptr;
+  int alen, blen, shift, qlen, qdigits;
+
+  /* The integer divisor, without trailing zeros. */
+  bptr = n2->n_value;
+  blen = n2->n_len + n2->n_scale;
+  while (*bptr == 0 && blen > 1)
+    {
+      bptr++;
+      blen--;
+    }
+  shift = -n2->n_scale;
+  while (blen > 1 && bptr[blen-1] == 0)
+    {
+      blen--;
+      shift++;
+    }
+  /* Now |N2| = B * 10^shift.  Find the integer A, such that the
+     quotient is floor (A / B) / 10^scale. */
+  alen = n1->n_len + n1->n_scale;
+  shift = scale - n1->n_scale - shift;
+  if (shift >= 0)
+    a = _bc_digits2int (n1->n_value, alen, shift);
+  else
+    a = _bc_digits2int (n1->n_value, alen + shift, 0);
+  b = _bc_digits2int (bptr, blen, 0);
+
+  qdigits = a->n_len - b->n_len + 1;
+  if (bc_is_zero (a) || qdigits <= 0)
+    q = bc_copy_num (_zero_);
+  else
+    {
+      /* q = floor (A * y / 10^blen), y being about 10^blen / B.  The
+         fraction of A * y is not needed, which shortens the product. */
+      y = _bc_newton_reciprocal (b->n_value, b->n_len, qdigits + 2);
+      t = NULL;
+      _bc_multiply_trunc (a, y, &t, 0);
+      qlen = t->n_len - b->n_len;
+      q = _bc_digits2int (t->n_value, qlen, 0);
+      bc_free_num (&t);
+      bc_free_num (&y);
+
+      /* Correct the last digits against the exact remainder. */
+      r = NULL;
+      bc_multiply (q, b, &r, 0);
+      bc_sub (a, r, &r, 0);
+      while (bc_is_neg (r))
+        {
+          bc_sub (q, _one_, &q, 0);
+          bc_add (r, b, &r, 0);
+        }
+      while (bc_compare (r, b) >= 0)
+        {
+          bc_add (q, _one_, &q, 0);
+          bc_sub (r, b, &r, 0);
+        }
+      bc_free_num (&r);
+    }
+
+  /* Place the decimal point. */
+  qlen = q->n_len;
+  t = bc_new_num (MAX (qlen - scale, 1), scale);
+  if (!bc_is_zero (q))
+    memcpy (t->n_value + t->n_len + scale - qlen, q->n_value, qlen);
+  t->n_sign = (n1->n_sign == n2->n_sign ? PLUS : MINUS);
+  if (bc_is_zero (t)) t->n_sign = PLUS;
+
+  bc_free_num (&a);
+  bc_free_num (&b);
+  bc_free_num (&q);
+  bc_free_num (quot);
+  *quot = t;
+}
+
 /* The full division routine. This computes N1 / N2.  It returns
    0 if the division is ok and the result is in QUOT.  The number of
    digits after the decimal point is SCALE. It returns -1 if division
@@ -988,6 +2382,14 @@ bc_divide (n1, n2, quot, scale)
 	}
     }
 
+  /* Long operands: use the reciprocal. */
+  if (n2->n_len + n2->n_scale >= div_newton_digits
+      && n1->n_len - n2->n_len + scale >= div_newton_digits)
+    {
+      _bc_newton_divide (n1, n2, quot, scale);
+      return 0;
+    }
+
   /* Set up the divide.  Move the decimal point on n1 by n2's scale.
      Remember, zeros on the end of num2 are wasted effort for dividing. */
   scale2 = n2->n_scale;
@@ -1196,6 +2598,153 @@ bc_modulo (num1, num2, result, scale)
   return bc_divmod (num1, num2, NULL, result, scale);
 }
 
+/* Largest window of the sliding-window exponentiation, in bits. */
+#define BC_WINDOW_MAX 6
+
+/* Stores the binary digits of the integer NUM, least significant first,
+   in a malloc'ed array placed in BITS, and returns their count. */
+static int
+_bc_num2bits (bc_num num, char **bits)
+{
+  char *digits, *out;
+  int len, first, nbits, ix, cur, rem;
+
+  len = num->n_len;
+  digits = (char *) malloc (len);
+  out = (char *) malloc (4 * len);
+  if (digits == NULL || out == NULL) bc_out_of_memory ();
+  memcpy (digits, num->n_value, len);
+  first = 0;
+  while (first < len && digits[first] == 0)
+    first++;
+  nbits = 0;
+  while (first < len)
+    {
+      rem = 0;
+      for (ix = first; ix < len; ix++)
+        {
+          cur = rem * BASE + digits[ix];
+          digits[ix] = cur >> 1;
+          rem = cur & 1;
+        }
+      out[nbits++] = rem;
+      while (first < len && digits[first] == 0)
+        first++;
+    }
+  free (digits);
+  *bits = out;
+  return nbits;
+}
+
+/* Barrett reduction: replaces X by X mod M.  X has to be below
+   10^(2*K), K being the number of digits of M, and MU is the
+   precomputed floor (10^(2*K) / M).  Only two multiplications are
+   needed, and at most two subtractions correct the estimate. */
+static void
+_bc_barrett_reduce (bc_num *x, bc_num m, bc_num mu, int k)
+{
+  bc_num q, t;
+
+  if ((*x)->n_len < k)
+    return;
+  q = _bc_digits2int ((*x)->n_value, (*x)->n_len - (k - 1), 0);
+  t = NULL;
+  bc_multiply (q, mu, &t, 0);
+  bc_free_num (&q);
+  q = _bc_digits2int (t->n_value, t->n_len - (k + 1), 0);
+  bc_multiply (q, m, &t, 0);
+  bc_sub (*x, t, x, 0);
+  while (bc_compare (*x, m) >= 0)
+    bc_sub (*x, m, x, 0);
+  bc_free_num (&q);
+  bc_free_num (&t);
+}
+
+static void
+_bc_mulmod (bc_num a, bc_num b, bc_num *dest, bc_num m, bc_num mu, int k)
+{
+  bc_multiply (a, b, dest, 0);
+  _bc_barrett_reduce (dest, m, mu, k);
+}
+
+/* BASE^EXPO mod MOD for integers, EXPO > 0.  The exponent is scanned
+   from the top in windows of up to BC_WINDOW_MAX bits ending in a one
+   bit, each costing one multiplication by a precomputed odd power of
+   the base.  The remainder takes the sign of the power, like
+   bc_modulo. */
+static bc_num
+_bc_window_raisemod (bc_num base, bc_num expo, bc_num mod)
+{
+  bc_num table[1 << (BC_WINDOW_MAX - 1)];
+  bc_num m, mu, b, sq, acc;
+  char *bits;
+  int k, nbits, w, ix, jx, val, tsize;
+
+  m = _bc_digits2int (mod->n_value, mod->n_len, 0);
+  k = m->n_len;
+  mu = bc_new_num (2 * k + 1, 0);
+  mu->n_value[0] = 1;
+  bc_divide (mu, m, &mu, 0);
+  b = _bc_digits2int (base->n_value, base->n_len, 0);
+  if (bc_compare (b, m) >= 0)
+    bc_modulo (b, m, &b, 0);
+
+  nbits = _bc_num2bits (expo, &bits);
+  w = nbits > 512 ? 6 : nbits > 160 ? 5 : nbits > 48 ? 4
+      : nbits > 12 ? 3 : 1;
+
+  /* table[i] = b^(2i+1) */
+  tsize = 1 << (w - 1);
+  table[0] = bc_copy_num (b);
+  sq = NULL;
+  if (tsize > 1)
+    _bc_mulmod (b, b, &sq, m, mu, k);
+  for (ix = 1; ix < tsize; ix++)
+    {
+      table[ix] = NULL;
+      _bc_mulmod (table[ix-1], sq, &table[ix], m, mu, k);
+    }
+
+  acc = NULL;
+  ix = nbits - 1;
+  while (ix >= 0)
+    {
+      if (bits[ix] == 0)
+        {
+          _bc_mulmod (acc, acc, &acc, m, mu, k);
+          ix--;
+          continue;
+        }
+      jx = MAX (ix - w + 1, 0);
+      while (bits[jx] == 0)
+        jx++;
+      val = 0;
+      for (; ix >= jx; ix--)
+        {
+          val = 2 * val + bits[ix];
+          if (acc != NULL)
+            _bc_mulmod (acc, acc, &acc, m, mu, k);
+        }
+      if (acc == NULL)
+        acc = bc_copy_num (table[val >> 1]);
+      else
+        _bc_mulmod (acc, table[val >> 1], &acc, m, mu, k);
+    }
+
+  for (ix = 0; ix < tsize; ix++)
+    bc_free_num (&table[ix]);
+  if (sq != NULL)
+    bc_free_num (&sq);
+  free (bits);
+  bc_free_num (&b);
+  bc_free_num (&mu);
+  bc_free_num (&m);
+  if (base->n_sign == MINUS && (expo->n_value[expo->n_len-1] & 1) != 0
+      && !bc_is_zero (acc))
+    acc->n_sign = MINUS;
+  return acc;
+}
+
 /* Raise BASE to the EXPO power, reduced modulo MOD.  The result is
    placed in RESULT.  If a EXPO is not an integer,
    only the integer part is used.  */
@@ -1234,18 +2783,30 @@ bc_raisemod (base, expo, mod, result, scale)
       bc_rt_warn ("non-zero scale in modulus");
 
   /* Do the calculation. */
-  rscale = MAX(scale, base->n_scale);
-  while ( !bc_is_zero(exponent) )
+  if (base->n_scale == 0 && mod->n_scale == 0)
     {
-      (void) bc_divmod (exponent, _two_, &exponent, &parity, 0);
-      if ( !bc_is_zero(parity) )
+      /* Integers reduce through a precomputed reciprocal. */
+      if (!bc_is_zero (exponent))
 	{
-	  bc_multiply (temp, power, &temp, rscale);
-	  (void) bc_modulo (temp, mod, &temp, scale);
+	  bc_free_num (&temp);
+	  temp = _bc_window_raisemod (base, exponent, mod);
 	}
+    }
+  else
+    {
+      rscale = MAX(scale, base->n_scale);
+      while ( !bc_is_zero(exponent) )
+	{
+	  (void) bc_divmod (exponent, _two_, &exponent, &parity, 0);
+	  if ( !bc_is_zero(parity) )
+	    {
+	      bc_multiply (temp, power, &temp, rscale);
+	      (void) bc_modulo (temp, mod, &temp, scale);
+	    }
 
-      bc_multiply (power, power, &power, rscale);
-      (void) bc_modulo (power, mod, &power, scale);
+	  bc_multiply (power, power, &power, rscale);
+	  (void) bc_modulo (power, mod, &power, scale);
+	}
     }
 
   /* Assign the value. */
@@ -1341,6 +2902,92 @@ bc_raise (num1, num2, result, scale)
    bc_free_num (&power);
 }
 
+/* Precision (in digits of the root) up to which the square root is
+   seeded directly from a hardware double. */
+#define SQRT_SEED_DIGITS 14
+
+/* Returns floor (sqrt (A)) for an integer A > 0.  The root is built
+   from the leading digits of A, roughly doubling the number of correct
+   digits in each Newton step, so only the last step runs at full
+   length.  Two guard digits per step keep the error of the truncated
+   steps bounded. */
+static bc_num
+_bc_isqrt (bc_num a)
+{
+  bc_num x, xs, ak, q, r;
+  char seed[40];
+  double ad;
+  int prec[32];
+  int alen, steps, ix;
+
+  alen = a->n_len;
+  prec[0] = (alen + 1) / 2;
+  steps = 0;
+  while (prec[steps] > SQRT_SEED_DIGITS)
+    {
+      prec[steps+1] = prec[steps] / 2 + 2;
+      steps++;
+    }
+
+  /* The seed, corrected to the exact root of the leading digits. */
+  ak = _bc_digits2int (a->n_value, alen - 2 * (prec[0] - prec[steps]), 0);
+  ad = 0;
+  for (ix = 0; ix < ak->n_len; ix++)
+    ad = ad * BASE + ak->n_value[ix];
+  sprintf (seed, "%.0f", floor (sqrt (ad)));
+  x = NULL;
+  bc_str2num (&x, seed, 0);
+  r = NULL;
+  bc_multiply (x, x, &r, 0);
+  while (bc_compare (r, ak) > 0)
+    {
+      bc_sub (x, _one_, &x, 0);
+      bc_multiply (x, x, &r, 0);
+    }
+  bc_add (x, _one_, &r, 0);
+  bc_multiply (r, r, &r, 0);
+  while (bc_compare (r, ak) <= 0)
+    {
+      bc_add (x, _one_, &x, 0);
+      bc_add (x, _one_, &r, 0);
+      bc_multiply (r, r, &r, 0);
+    }
+  bc_free_num (&ak);
+
+  /* x = (x + AK/x) / 2, AK being the leading digits of A that match the
+     next precision.  From any positive start the truncated step never
+     falls below floor (sqrt (AK)). */
+  q = NULL;
+  xs = NULL;
+  for (ix = steps; --ix >= 0;)
+    {
+      ak = _bc_digits2int (a->n_value, alen - 2 * (prec[0] - prec[ix]), 0);
+      bc_free_num (&xs);
+      xs = _bc_digits2int (x->n_value, x->n_len, prec[ix] - prec[ix+1]);
+      bc_divide (ak, xs, &q, 0);
+      bc_add (xs, q, &q, 0);
+      bc_divide (q, _two_, &x, 0);
+      bc_free_num (&ak);
+    }
+  bc_free_num (&xs);
+  bc_free_num (&q);
+
+  /* Remove the excess of the last step: (x-1)^2 = x^2 - 2x + 1. */
+  if (steps > 0)
+    {
+      bc_multiply (x, x, &r, 0);
+      bc_sub (a, r, &r, 0);
+      while (bc_is_neg (r))
+        {
+          bc_add (r, x, &r, 0);
+          bc_sub (x, _one_, &x, 0);
+          bc_add (r, x, &r, 0);
+        }
+    }
+  bc_free_num (&r);
+  return x;
+}
+
 /* Take the square root NUM and return it in NUM with SCALE digits
    after the decimal place. */
 
@@ -1349,9 +2996,8 @@ bc_sqrt (num, scale)
      bc_num *num;
      int scale;
 {
-  int rscale, cmp_res, done;
-  int cscale;
-  bc_num guess, guess1, point5, diff;
+  int rscale, cmp_res, rlen;
+  bc_num a, root, result;
 
   /* Initial checks. */
   cmp_res = bc_compare (*num, _zero_);
@@ -1374,61 +3020,22 @@ bc_sqrt (num, scale)
       return 1;
     }
 
-  /* Initialize the variables. */
+  /* sqrt (NUM) * 10^rscale = sqrt (NUM * 10^(2*rscale)), and the
+     integer under the root is exact, since rscale >= n_scale. */
   rscale = MAX (scale, (*num)->n_scale);
-  bc_init_num(&guess);
-  bc_init_num(&guess1);
-  bc_init_num(&diff);
-  point5 = bc_new_num (1,1);
-  point5->n_value[1] = 5;
-
-
-  /* Calculate the initial guess. */
-  if (cmp_res < 0)
-    {
-      /* The number is between 0 and 1.  Guess should start at 1. */
-      guess = bc_copy_num (_one_);
-      cscale = (*num)->n_scale;
-    }
-  else
-    {
-      /* The number is greater than 1.  Guess should start at 10^(exp/2). */
-      bc_int2num (&guess,10);
-
-      bc_int2num (&guess1,(*num)->n_len);
-      bc_multiply (guess1, point5, &guess1, 0);
-      guess1->n_scale = 0;
-      bc_raise (guess, guess1, &guess, 0);
-      bc_free_num (&guess1);
-      cscale = 3;
-    }
-
-  /* Find the square root using Newton's algorithm. */
-  done = FALSE;
-  while (!done)
-    {
-      bc_free_num (&guess1);
-      guess1 = bc_copy_num (guess);
-      bc_divide (*num, guess, &guess, cscale);
-      bc_add (guess, guess1, &guess, 0);
-      bc_multiply (guess, point5, &guess, cscale);
-      bc_sub (guess, guess1, &diff, cscale+1);
-      if (bc_is_near_zero (diff, cscale))
-	{
-	  if (cscale < rscale+1)
-	    cscale = MIN (cscale*3, rscale+1);
-	  else
-	    done = TRUE;
-	}
-    }
-
-  /* Assign the number and clean up. */
+  a = _bc_digits2int ((*num)->n_value, (*num)->n_len + (*num)->n_scale,
+                      2 * rscale - (*num)->n_scale);
+  root = _bc_isqrt (a);
+
+  /* Place the decimal point and clean up. */
+  rlen = root->n_len;
+  result = bc_new_num (MAX (rlen - rscale, 1), rscale);
+  memcpy (result->n_value + result->n_len + rscale - rlen, root->n_value,
+          rlen);
+  bc_free_num (&a);
+  bc_free_num (&root);
   bc_free_num (num);
-  bc_divide (guess,_one_,num,rscale);
-  bc_free_num (&guess);
-  bc_free_num (&guess1);
-  bc_free_num (&point5);
-  bc_free_num (&diff);
+  *num = result;
   return 1;
 }
 
@@ -1436,12 +3043,6 @@ bc_sqrt (num, scale)
 /* The following routines provide output for bcd numbers package
    using the rules of POSIX bc for output. */
 
-/* This structure is used for saving digits in the conversion process. */
-typedef struct stk_rec {
-	long  digit;
-	struct stk_rec *next;
-} stk_rec;
-
 /* The reference string for digits. */
 static char ref_str[] = "0123456789ABCDEF";
 
@@ -1476,6 +3077,48 @@ bc_out_long (val, size, space, out_char)
     (*out_char) (digits[ix]);
 }
 
+/* Integer parts with fewer decimal digits are converted to another
+   base by repeated division. */
+#define BC_RADIX_DC_DIGITS 40
+
+/* Stores the 2^K digits of the integer NUM in the base POWERS[0], most
+   significant first and padded with leading zeros, in DIGITS.  POWERS[k]
+   holds POWERS[0]^(2^k), and NUM has to be below POWERS[K].  Long
+   numbers are split in halves by one division, so the conversion costs
+   a few long divisions instead of one short division per digit. */
+static void
+_bc_radix_digits (bc_num num, bc_num *powers, int k, long *digits)
+{
+  bc_num high, low;
+  int ix;
+
+  if (k == 0 || num->n_len <= BC_RADIX_DC_DIGITS)
+    {
+      high = bc_copy_num (num);
+      bc_init_num (&low);
+      for (ix = (1 << k); --ix >= 0;)
+	{
+	  if (bc_is_zero (high))
+	    {
+	      digits[ix] = 0;
+	      continue;
+	    }
+	  bc_divmod (high, powers[0], &high, &low, 0);
+	  digits[ix] = bc_num2long (low);
+	}
+      bc_free_num (&high);
+      bc_free_num (&low);
+      return;
+    }
+  bc_init_num (&high);
+  bc_init_num (&low);
+  bc_divmod (num, powers[k-1], &high, &low, 0);
+  _bc_radix_digits (high, powers, k-1, digits);
+  _bc_radix_digits (low, powers, k-1, digits + (1 << (k-1)));
+  bc_free_num (&high);
+  bc_free_num (&low);
+}
+
 /* Output of a bcd number.  NUM is written in base O_BASE using OUT_CHAR
    as the routine to do the actual output of the characters. */
 
@@ -1491,9 +3134,10 @@ bc_out_num (num, o_base, out_char, leading_zero)
      int leading_zero;
 {
   char *nptr;
-  int  index, fdigit, pre_space;
-  stk_rec *digits, *temp;
-  bc_num int_part, frac_part, base, cur_dig, t_num, max_o_digit;
+  int  index, fdigit, pre_space, kpow, ndigits;
+  long *odigits;
+  bc_num powers[32];
+  bc_num int_part, frac_part, base, t_num, max_o_digit;
 
   /* The negative sign if needed. */
   if (num->n_sign == MINUS) (*out_char) ('-');
@@ -1530,11 +3174,9 @@ bc_out_num (num, o_base, out_char, leading_zero)
 	  (*out_char) ('0');
 
 	/* The number is some other base. */
-	digits = NULL;
 	bc_init_num (&int_part);
 	bc_divide (num, _one_, &int_part, 0);
 	bc_init_num (&frac_part);
-	bc_init_num (&cur_dig);
 	bc_init_num (&base);
 	bc_sub (num, int_part, &frac_part, 0);
 	/* Make the INT_PART and FRAC_PART positive. */
@@ -1545,32 +3187,32 @@ bc_out_num (num, o_base, out_char, leading_zero)
 	bc_int2num (&max_o_digit, o_base-1);
 
 
-	/* Get the digits of the integer part and push them on a stack. */
-	while (!bc_is_zero (int_part))
-	  {
-	    bc_modulo (int_part, base, &cur_dig, 0);
-	    temp = (stk_rec *) malloc (sizeof(stk_rec));
-	    if (temp == NULL) bc_out_of_memory();
-	    temp->digit = bc_num2long (cur_dig);
-	    temp->next = digits;
-	    digits = temp;
-	    bc_divide (int_part, base, &int_part, 0);
-	  }
-
-	/* Print the digits on the stack. */
-	if (digits != NULL)
+	/* Get the digits of the integer part, using the squares of the
+	   base to split it. */
+	if (!bc_is_zero (int_part))
 	  {
-	    /* Output the digits. */
-	    while (digits != NULL)
+	    powers[0] = bc_copy_num (base);
+	    for (kpow = 0; bc_compare (powers[kpow], int_part) <= 0; kpow++)
 	      {
-		temp = digits;
-		digits = digits->next;
-		if (o_base <= 16)
-		  (*out_char) (ref_str[ (int) temp->digit]);
-		else
-		  bc_out_long (temp->digit, max_o_digit->n_len, 1, out_char);
-		free (temp);
+		powers[kpow+1] = NULL;
+		bc_multiply (powers[kpow], powers[kpow], &powers[kpow+1], 0);
 	      }
+	    ndigits = 1 << kpow;
+	    odigits = (long *) malloc (ndigits * sizeof (long));
+	    if (odigits == NULL) bc_out_of_memory();
+	    _bc_radix_digits (int_part, powers, kpow, odigits);
+
+	    /* Print the digits, without the leading zeros. */
+	    for (index = 0; odigits[index] == 0; index++)
+	      ;
+	    for (; index < ndigits; index++)
+	      if (o_base <= 16)
+		(*out_char) (ref_str[ (int) odigits[index]]);
+	      else
+		bc_out_long (odigits[index], max_o_digit->n_len, 1, out_char);
+	    free (odigits);
+	    while (kpow >= 0)
+	      bc_free_num (&powers[kpow--]);
 	  }
 
 	/* Get and print the digits of the fraction part. */
@@ -1599,7 +3241,6 @@ bc_out_num (num, o_base, out_char, leading_zero)
 	bc_free_num (&int_part);
 	bc_free_num (&frac_part);
 	bc_free_num (&base);
-	bc_free_num (&cur_dig);
 	bc_free_num (&max_o_digit);
       }
 }
@@ -65,6 +65,23 @@ typedef struct bc_struct
     } bc_struct;
 
 
+/* Allocation counters of the calling thread, see bc_get_alloc_stats. */
+
+typedef struct bc_alloc_stats
+    {
+      long allocations;		/* bc_num headers handed out. */
+      long free_list_hits;	/* Those of them taken from the free list. */
+      long live;		/* Headers currently in use. */
+      long peak_live;		/* Maximum of live since the last reset. */
+      long free_list_length;	/* Headers waiting in the free list. */
+      long arena_bytes;		/* Digit storage cut from arenas. */
+      long arena_survivors;	/* Numbers moved out of closing arenas. */
+      long block_hits;		/* Digit blocks taken from the block list. */
+      long block_list_length;	/* Digit blocks waiting in the block list. */
+      long cached_bytes;	/* Heap held by both lists. */
+    } bc_alloc_stats;
+
+
 /* The base used in storing the numbers in n_value above.
    Currently this MUST be 10. */
 
@@ -99,6 +116,12 @@ extern bc_num _zero_;
 extern bc_num _one_;
 extern bc_num _two_;
 
+/* Multiplication crossover points, counting the digits of both operands:
+   schoolbook below mul_base_digits, Karatsuba below mul_toom3_digits,
+   Toom-Cook 3-way above.  See bc_calibrate_mul. */
+extern int mul_base_digits;
+extern int mul_toom3_digits;
+
 
 /* Function Prototypes */
 
@@ -120,12 +143,30 @@ _PROTOTYPE(void bc_free_num, (bc_num *num));
 
 _PROTOTYPE(bc_num bc_copy_num, (bc_num num));
 
+_PROTOTYPE(void bc_shrink_num, (bc_num num));
+
+_PROTOTYPE(void bc_get_alloc_stats, (bc_alloc_stats *stats));
+
+_PROTOTYPE(void bc_reset_alloc_stats, (void));
+
+_PROTOTYPE(int bc_set_free_list_cap, (int cap));
+
+_PROTOTYPE(void bc_trim_free_list, (void));
+
+_PROTOTYPE(void bc_arena_begin, (void));
+
+_PROTOTYPE(void bc_arena_end, (void));
+
 _PROTOTYPE(void bc_init_num, (bc_num *num));
 
 _PROTOTYPE(void bc_str2num, (bc_num *num, char *str, int scale));
 
 _PROTOTYPE(char *bc_num2str, (bc_num num));
 
+_PROTOTYPE(void bc_digits2ascii, (char *dest, const char *digits, int n));
+
+_PROTOTYPE(int bc_ascii2digits, (char *dest, const char *chars, int n));
+
 _PROTOTYPE(void bc_int2num, (bc_num *num, int val));
 
 _PROTOTYPE(long bc_num2long, (bc_num num));
@@ -144,6 +185,8 @@ _PROTOTYPE(void bc_sub, (bc_num n1, bc_num n2, bc_num *result, int scale_min));
 
 _PROTOTYPE(void bc_multiply, (bc_num n1, bc_num n2, bc_num *prod, int scale));
 
+_PROTOTYPE(void bc_calibrate_mul, (void));
+
 _PROTOTYPE(int bc_divide, (bc_num n1, bc_num n2, bc_num *quot, int scale));
 
 _PROTOTYPE(int bc_modulo, (bc_num num1, bc_num num2, bc_num *result,
@@ -26,8 +26,11 @@
 #include "rational.h"
 #include "units.h"
 
+#include <QDataStream>
 #include <QStringList>
 
+#include <utility>
+
 #define RATIONAL_TOL HNumber("1e-20")
 
 #define ENSURE_DIMENSIONLESS(x) \
@@ -117,23 +120,45 @@ Quantity operator/(const CNumber& l, const Quantity& r)
     return Quantity(l) / r;
 }
 
+// The names of the base dimensions of Units, indexed like m_exponents.
+static const char* const baseDimensionNames[] = {
+    "length", "time", "mass", "el. current", "amount", "temperature",
+    "luminous intensity", "information"
+};
+
+static int baseDimensionIndex(const QString& name)
+{
+    for (int i = 0; i < int(sizeof(baseDimensionNames) / sizeof(baseDimensionNames[0])); ++i)
+        if (name == QLatin1String(baseDimensionNames[i]))
+            return i;
+    return -1;
+}
+
 Quantity::Quantity()
     : m_numericValue(0)
-    , m_unit(nullptr)
+    , m_dimensionMask(0)
     , m_unitName("")
 {
 }
 
 Quantity::Quantity(const Quantity& other)
     : m_numericValue(other.m_numericValue)
-    , m_dimension(other.m_dimension)
-    , m_unit(nullptr)
+    , m_dimensionMask(0)
+    , m_unit(other.m_unit)
     , m_unitName(other.m_unitName)
     , m_format(other.m_format)
 {
-    if (other.hasUnit())
-        this->m_unit = new CNumber(other.unit());
-    cleanDimension();
+    copyDimension(other);
+}
+
+Quantity::Quantity(Quantity&& other)
+    : m_numericValue(std::move(other.m_numericValue))
+    , m_dimensionMask(0)
+    , m_unit(std::move(other.m_unit))
+    , m_unitName(std::move(other.m_unitName))
+    , m_format(std::move(other.m_format))
+{
+    copyDimension(other);
 }
 
 Quantity::Quantity(int i)
@@ -160,7 +185,6 @@ Quantity::Quantity(const CNumber& c)
 
 Quantity::~Quantity()
 {
-    delete m_unit;
 }
 
 bool Quantity::isNan() const
@@ -195,7 +219,7 @@ bool Quantity::isInteger() const
 
 bool Quantity::hasUnit() const
 {
-    return this->m_unit != NULL;
+    return !m_unit.isNull();
 }
 
 CNumber Quantity::unit() const
@@ -223,12 +247,21 @@ Quantity& Quantity::setDisplayUnit(const CNumber unit, const QString& name)
         *this = DMath::nan(InvalidDimension);
     else {
         stripUnits();
-        m_unit = new CNumber(unit);
+        m_unit = QSharedPointer<const CNumber>(new CNumber(unit));
         m_unitName = name;
     }
     return *this;
 }
 
+// Takes over the display unit of other, sharing rather than copying it.
+Quantity& Quantity::setDisplayUnit(const Quantity& other)
+{
+    stripUnits();
+    m_unit = other.m_unit;
+    m_unitName = other.m_unitName;
+    return *this;
+}
+
 Quantity& Quantity::setFormat(Format c)
 {
     m_format = c;
@@ -237,68 +270,167 @@ Quantity& Quantity::setFormat(Format c)
 
 void Quantity::stripUnits()
 {
-    delete m_unit;
-    m_unit = nullptr;
+    m_unit.clear();
     m_unitName = "";
 }
 
 bool Quantity::hasDimension() const
 {
-    return !this->m_dimension.empty();
+    return m_dimensionMask != 0;
 }
 
 /*
- * Unlike hasDimension(), this does a clean up first, i.e. it
- * checks for redundant exponents.
+ * The exponents are kept clean, so this is the same as !hasDimension().
  */
 bool Quantity::isDimensionless() const
 {
-    Quantity temp(*this);
-    temp.cleanDimension();
-    return m_dimension.empty();
+    return m_dimensionMask == 0;
 }
 
 QMap<QString, Rational> Quantity::getDimension() const
 {
-    Quantity temp(*this);
-    temp.cleanDimension();
-    return temp.m_dimension;
+    QMap<QString, Rational> result(m_otherDimension);
+    for (int i = 0; i < BaseDimensionCount; ++i)
+        if (m_dimensionMask & (1u << i))
+            result.insert(baseDimensionNames[i], m_exponents[i]);
+    return result;
 }
 
 void Quantity::modifyDimension(const QString& key, const Rational& exponent)
 {
+    int i = baseDimensionIndex(key);
+    if (i >= 0) {
+        m_exponents[i] = exponent;
+        if (exponent.isZero())
+            m_dimensionMask &= ~(1u << i);
+        else
+            m_dimensionMask |= 1u << i;
+        return;
+    }
     if (exponent.isZero())
-        m_dimension.remove(key);
+        m_otherDimension.remove(key);
+    else
+        m_otherDimension.insert(key, exponent);
+    if (m_otherDimension.isEmpty())
+        m_dimensionMask &= ~unsigned(OtherDimensionBit);
     else
-        m_dimension.insert(key, exponent);
+        m_dimensionMask |= OtherDimensionBit;
 }
 
 void Quantity::copyDimension(const Quantity& other)
 {
     clearDimension();
-    this->m_dimension = other.m_dimension;
+    m_dimensionMask = other.m_dimensionMask;
+    for (int i = 0; i < BaseDimensionCount; ++i)
+        if (m_dimensionMask & (1u << i))
+            m_exponents[i] = other.m_exponents[i];
+    m_otherDimension = other.m_otherDimension;
 }
 
 void Quantity::clearDimension()
 {
-    this->m_dimension.clear();
+    for (int i = 0; i < BaseDimensionCount; ++i)
+        if (m_dimensionMask & (1u << i))
+            m_exponents[i] = Rational();
+    m_dimensionMask = 0;
+    m_otherDimension.clear();
 }
 
-// Note: Does NOT clean the dimension vector first.
-// The calling function must do so on its own.
 bool Quantity::sameDimension(const Quantity& other) const
 {
-    return this->m_dimension == other.m_dimension;
+    if (m_dimensionMask != other.m_dimensionMask)
+        return false;
+    for (int i = 0; i < BaseDimensionCount; ++i)
+        if ((m_dimensionMask & (1u << i)) && m_exponents[i] != other.m_exponents[i])
+            return false;
+    return !(m_dimensionMask & OtherDimensionBit)
+        || m_otherDimension == other.m_otherDimension;
+}
+
+// Packs the dimension into one integer, 8 bits per base dimension: the
+// numerator in the low 5 bits (two's complement), the denominator minus
+// one in the upper 3. Two quantities with a signature have the same
+// dimension if and only if their signatures are equal. Returns false if
+// an exponent does not fit, or the quantity has dimensions outside the
+// base set.
+bool Quantity::dimensionSignature(quint64* signature) const
+{
+    *signature = 0;
+    if (m_dimensionMask & OtherDimensionBit)
+        return false;
+    for (int i = 0; i < BaseDimensionCount; ++i) {
+        if (!(m_dimensionMask & (1u << i)))
+            continue;
+        qint64 num = m_exponents[i].numerator();
+        qint64 denom = m_exponents[i].denominator();
+        if (num < -16 || num > 15 || denom < 1 || denom > 8)
+            return false;
+        quint64 field = quint64(num & 0x1f) | quint64(denom - 1) << 5;
+        *signature |= field << (8 * i);
+    }
+    return true;
 }
 
+// The base exponents are always clean, only the other dimensions may
+// have picked up zero exponents.
 void Quantity::cleanDimension()
 {
-    auto i = m_dimension.begin();
-    while (i != m_dimension.end()) {
+    if (!(m_dimensionMask & OtherDimensionBit))
+        return;
+    auto i = m_otherDimension.begin();
+    while (i != m_otherDimension.end()) {
         if (i.value().isZero())
-            i = m_dimension.erase(i);
+            i = m_otherDimension.erase(i);
+        else
+            ++i;
+    }
+    if (m_otherDimension.isEmpty())
+        m_dimensionMask &= ~unsigned(OtherDimensionBit);
+}
+
+// Adds the exponents of other to these, or subtracts them.
+void Quantity::addDimension(const Quantity& other, bool subtract)
+{
+    for (int i = 0; i < BaseDimensionCount; ++i) {
+        if (!(other.m_dimensionMask & (1u << i)))
+            continue;
+        if (subtract)
+            m_exponents[i] -= other.m_exponents[i];
         else
+            m_exponents[i] += other.m_exponents[i];
+        if (m_exponents[i].isZero())
+            m_dimensionMask &= ~(1u << i);
+        else
+            m_dimensionMask |= 1u << i;
+    }
+    if (other.m_dimensionMask & OtherDimensionBit) {
+        auto i = other.m_otherDimension.constBegin();
+        while (i != other.m_otherDimension.constEnd()) {
+            Rational exp = m_otherDimension.value(i.key(), Rational(0));
+            if (subtract)
+                exp -= i.value();
+            else
+                exp += i.value();
+            modifyDimension(i.key(), exp);
             ++i;
+        }
+    }
+}
+
+// Multiplies all exponents by factor.
+void Quantity::scaleDimension(const Rational& factor)
+{
+    if (factor.isZero()) {
+        clearDimension();
+        return;
+    }
+    for (int i = 0; i < BaseDimensionCount; ++i)
+        if (m_dimensionMask & (1u << i))
+            m_exponents[i] *= factor;
+    auto i = m_otherDimension.begin();
+    while (i != m_otherDimension.end()) {
+        i.value() *= factor;
+        ++i;
     }
 }
 
@@ -310,8 +442,9 @@ void Quantity::serialize(QJsonObject& json) const
 
     if (hasDimension()) {
         QJsonObject dim_json;
-        auto i = m_dimension.constBegin();
-        while (i != m_dimension.constEnd()) {
+        const auto dimension = getDimension();
+        auto i = dimension.constBegin();
+        while (i != dimension.constEnd()) {
             const auto& exp = i.value();
             const auto& name = i.key();
             dim_json[name] = exp.toString();
@@ -344,7 +477,7 @@ Quantity Quantity::deSerialize(const QJsonObject& json)
     result.stripUnits();
     if (json.contains("unit")) {
         QJsonObject unit_json = json["unit"].toObject();
-        result.m_unit = new CNumber(unit_json);
+        result.m_unit = QSharedPointer<const CNumber>(new CNumber(unit_json));
     }
     if (json.contains("unit_name"))
         result.m_unitName = json["unit_name"].toString();
@@ -364,22 +497,86 @@ Quantity Quantity::deSerialize(const QJsonObject& json)
     return result;
 }
 
+void Quantity::serialize(QDataStream& stream) const
+{
+    m_numericValue.serialize(stream);
+
+    const auto dimension = getDimension();
+    stream << quint32(dimension.count());
+    for (auto i = dimension.constBegin(); i != dimension.constEnd(); ++i)
+        stream << i.key() << i.value().numerator() << i.value().denominator();
+
+    stream << hasUnit();
+    if (hasUnit()) {
+        m_unit->serialize(stream);
+        stream << m_unitName;
+    }
+    m_format.serialize(stream);
+}
+
+Quantity Quantity::deSerialize(QDataStream& stream)
+{
+    Quantity result;
+    result.m_numericValue = CNumber::deSerialize(stream);
+
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString name;
+        qint64 num, denom;
+        stream >> name >> num >> denom;
+        if (denom <= 0) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        result.modifyDimension(name, Rational(num, denom));
+    }
+
+    bool unit;
+    stream >> unit;
+    if (unit) {
+        result.m_unit = QSharedPointer<const CNumber>(new CNumber(CNumber::deSerialize(stream)));
+        stream >> result.m_unitName;
+    }
+    result.m_format = Quantity::Format::deSerialize(stream);
+    return result;
+}
+
 Error Quantity::error() const
 {
     return m_numericValue.error();
 }
 
+// The unit is shared between copies and left alone.
+void Quantity::squeeze()
+{
+    m_numericValue.squeeze();
+}
+
 Quantity& Quantity::operator=(const Quantity& other)
 {
+    if (this == &other)
+        return *this;
     m_numericValue = other.m_numericValue;
-    m_dimension = other.m_dimension;
+    copyDimension(other);
     m_format = other.m_format;
     stripUnits();
     if(other.hasUnit()) {
-        m_unit = new CNumber(*other.m_unit);
+        m_unit = other.m_unit;
         m_unitName = other.m_unitName;
     }
-    cleanDimension();
+    return *this;
+}
+
+Quantity& Quantity::operator=(Quantity&& other)
+{
+    if (this == &other)
+        return *this;
+    m_numericValue = std::move(other.m_numericValue);
+    copyDimension(other);
+    m_format = std::move(other.m_format);
+    std::swap(m_unit, other.m_unit);
+    std::swap(m_unitName, other.m_unitName);
     return *this;
 }
 
@@ -412,16 +609,7 @@ Quantity Quantity::operator*(const Quantity& other) const
     result.m_numericValue *= other.m_numericValue;
     if (!other.isDimensionless()) {
         result.stripUnits();
-        auto i = other.m_dimension.constBegin();
-        while (i != other.m_dimension.constEnd()) {
-            const auto& exp = i.value();
-            const auto& name = i.key();
-            if (!result.m_dimension.contains(name))
-                result.m_dimension[name] = Rational(0);
-            result.m_dimension[name] += exp;
-            ++i;
-        }
-        result.cleanDimension();
+        result.addDimension(other, false);
     }
     return result;
 }
@@ -449,16 +637,7 @@ Quantity Quantity::operator/(const Quantity& other) const
     result.m_numericValue /= other.m_numericValue;
     if (!other.isDimensionless()) {
         result.stripUnits();
-        auto i = other.m_dimension.constBegin();
-        while (i != other.m_dimension.constEnd()) {
-            const auto& exp = i.value();
-            const auto& name = i.key();
-            if (!result.m_dimension.contains(name))
-                result.m_dimension[name] = Rational(0);
-            result.m_dimension[name] -= exp;
-            ++i;
-        }
-        result.cleanDimension();
+        result.addDimension(other, true);
     }
     return result;
 }
@@ -682,6 +861,25 @@ Quantity::Format Quantity::Format::deSerialize(const QJsonObject& json)
     return result;
 }
 
+void Quantity::Format::serialize(QDataStream& stream) const
+{
+    stream << quint8(mode) << quint8(base) << quint8(notation) << qint32(precision);
+}
+
+Quantity::Format Quantity::Format::deSerialize(QDataStream& stream)
+{
+    quint8 mode, base, notation;
+    qint32 precision;
+    stream >> mode >> base >> notation >> precision;
+
+    Format result;
+    result.mode = mode <= quint8(Mode::Sexagesimal) ? Mode(mode) : Mode::Null;
+    result.base = base <= quint8(Base::Hexadecimal) ? Base(base) : Base::Null;
+    result.notation = notation <= quint8(Notation::Polar) ? Notation(notation) : Notation::Null;
+    result.precision = precision;
+    return result;
+}
+
 bool Quantity::Format::isNull() const
 {
     return (mode == Mode::Null && base == Base::Null && precision == PrecisionNull && notation == Notation::Null);
@@ -800,7 +998,9 @@ WRAPPER_DMATH_1(erf)
 WRAPPER_DMATH_1(erfc)
 
 WRAPPER_DMATH_2(gcd)
+WRAPPER_DMATH_2(lcm)
 WRAPPER_DMATH_2(idiv)
+WRAPPER_DMATH_3(powmod)
 
 Quantity DMath::round(const Quantity& n, int prec)
 {
@@ -908,12 +1108,9 @@ Quantity DMath::phase(const Quantity& n)
 Quantity DMath::sqrt(const Quantity& n)
 {
     Quantity result(COMPLEX_WRAP_1(sqrt, n.m_numericValue));
-    auto i = n.m_dimension.constBegin();
-    while (i != n.m_dimension.constEnd()) {
-        auto& exp = i.value();
-        auto& name = i.key();
-        result.modifyDimension(name, exp * Rational(1,2));
-        ++i;
+    if (!n.isDimensionless()) {
+        result.copyDimension(n);
+        result.scaleDimension(Rational(1,2));
     }
     return result;
 }
@@ -921,12 +1118,9 @@ Quantity DMath::sqrt(const Quantity& n)
 Quantity DMath::cbrt(const Quantity& n)
 {
     Quantity result(COMPLEX_WRAP_1(cbrt, n.m_numericValue));
-    auto i = n.m_dimension.constBegin();
-    while (i != n.m_dimension.constEnd()) {
-        auto& exp = i.value();
-        auto& name = i.key();
-        result.modifyDimension(name, exp * Rational(1,3));
-        ++i;
+    if (!n.isDimensionless()) {
+        result.copyDimension(n);
+        result.scaleDimension(Rational(1,3));
     }
     return result;
 }
@@ -937,12 +1131,9 @@ Quantity DMath::raise(const Quantity& n1, int n)
     result.m_numericValue = complexMode ?
         CMath::raise(n1.m_numericValue, n)
         : CNumber(HMath::raise(n1.m_numericValue.real, n));
-    auto i = n1.m_dimension.constBegin();
-    while (i != n1.m_dimension.constEnd()) {
-        auto& exp = i.value();
-        auto& name = i.key();
-        result.modifyDimension(name, exp * n);
-        ++i;
+    if (!n1.isDimensionless()) {
+        result.copyDimension(n1);
+        result.scaleDimension(Rational(n, 1));
     }
     return result;
 }
@@ -969,11 +1160,8 @@ Quantity DMath::raise(const Quantity& n1, const Quantity& n2)
         return DMath::nan(OutOfDomain);
 
     // Compute new dimension.
-    auto i = n1.m_dimension.constBegin();
-    while (i != n1.m_dimension.constEnd()) {
-        result.modifyDimension(i.key(), i.value()*exponent);
-        ++i;
-    }
+    result.copyDimension(n1);
+    result.scaleDimension(exponent);
     return result;
 }
 
@@ -28,9 +28,11 @@
 #include "core/errors.h"
 
 #include <QMap>
+#include <QSharedPointer>
 
 class CNumber;
 class HNumber;
+class QDataStream;
 class QJsonObject;
 class QString;
 class Rational;
@@ -57,6 +59,7 @@ class Quantity {
 public:
     Quantity();
     Quantity(const Quantity&);
+    Quantity(Quantity&&);
     Quantity(int);
     Quantity(const QJsonObject&);
     Quantity(const HNumber&);
@@ -75,6 +78,7 @@ public:
     QString unitName() const;
     CNumber numericValue() const;
     Quantity& setDisplayUnit(const CNumber unit, const QString& name);
+    Quantity& setDisplayUnit(const Quantity& other);
     void stripUnits();
     bool hasDimension() const;
     bool isDimensionless() const;
@@ -83,14 +87,19 @@ public:
     void copyDimension(const Quantity&);
     void clearDimension();
     bool sameDimension(const Quantity& other) const;
+    bool dimensionSignature(quint64* signature) const;
     void cleanDimension();
 
     void serialize(QJsonObject&) const;
     static Quantity deSerialize(const QJsonObject&);
+    void serialize(QDataStream&) const;
+    static Quantity deSerialize(QDataStream&);
 
     Error error() const;
+    void squeeze();
 
     Quantity& operator=(const Quantity&);
+    Quantity& operator=(Quantity&&);
     Quantity operator+(const Quantity&) const;
     Quantity& operator+=(const Quantity&);
     Quantity& operator-=(const Quantity&);
@@ -122,6 +131,8 @@ public:
 
         void serialize(QJsonObject&) const;
         static Format deSerialize(const QJsonObject&);
+        void serialize(QDataStream&) const;
+        static Format deSerialize(QDataStream&);
         bool isNull() const;
     };
 
@@ -129,9 +140,25 @@ public:
     Quantity& setFormat(Format);
 
 private:
+    enum {
+        // The base dimensions of Units, see baseDimensionNames in quantity.cpp.
+        BaseDimensionCount = 8,
+        // Set in m_dimensionMask if m_otherDimension is not empty.
+        OtherDimensionBit = 1u << BaseDimensionCount
+    };
+
+    void addDimension(const Quantity& other, bool subtract);
+    void scaleDimension(const Rational& factor);
+
     CNumber m_numericValue;
-    QMap<QString, Rational> m_dimension;
-    CNumber* m_unit;
+    // Bit i is set if m_exponents[i] is not zero, so that a dimensionless
+    // quantity has a mask of 0. Exponents without their bit are zero.
+    unsigned m_dimensionMask;
+    Rational m_exponents[BaseDimensionCount];
+    // Dimensions with other names, e.g. read from a session file.
+    QMap<QString, Rational> m_otherDimension;
+    // Shared between copies, a unit is never modified once set.
+    QSharedPointer<const CNumber> m_unit;
     QString m_unitName;
     Format m_format;
 };
@@ -162,7 +189,9 @@ public:
     static Quantity floor(const Quantity&);
     static Quantity ceil(const Quantity&);
     static Quantity gcd(const Quantity&, const Quantity&);
+    static Quantity lcm(const Quantity&, const Quantity&);
     static Quantity idiv(const Quantity&, const Quantity&);
+    static Quantity powmod(const Quantity&, const Quantity&, const Quantity&);
     static Quantity round(const Quantity&, int prec = 0);
     static Quantity trunc(const Quantity&, int prec = 0);
     static Quantity sqrt(const Quantity&);
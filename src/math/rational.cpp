@@ -24,7 +24,70 @@
 #include <QString>
 #include <QStringList>
 #include <limits.h>
+#include <limits>
 
+// Checked 64-bit arithmetic: each returns true if the result does not fit.
+static bool addOverflows(qint64 a, qint64 b, qint64* r)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_add_overflow(a, b, r);
+#else
+    if ((b > 0 && a > std::numeric_limits<qint64>::max() - b)
+        || (b < 0 && a < std::numeric_limits<qint64>::min() - b))
+        return true;
+    *r = a + b;
+    return false;
+#endif
+}
+
+static bool mulOverflows(qint64 a, qint64 b, qint64* r)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_mul_overflow(a, b, r);
+#else
+    const qint64 max = std::numeric_limits<qint64>::max();
+    const qint64 min = std::numeric_limits<qint64>::min();
+    if (a != 0 && b != 0) {
+        if ((a == -1 && b == min) || (b == -1 && a == min))
+            return true;
+        if (a > 0 ? (b > 0 ? a > max / b : b < min / a)
+                  : (b > 0 ? a < min / b : a < max / b))
+            return true;
+    }
+    *r = a * b;
+    return false;
+#endif
+}
+
+static quint64 magnitude(qint64 x)
+{
+    return x < 0 ? 0 - quint64(x) : quint64(x);
+}
+
+// Binary GCD: shifts and subtractions only.
+quint64 Rational::gcd(quint64 a, quint64 b)
+{
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    int shift = 0;
+    while (((a | b) & 1) == 0) {
+        a >>= 1;
+        b >>= 1;
+        ++shift;
+    }
+    while ((a & 1) == 0)
+        a >>= 1;
+    do {
+        while ((b & 1) == 0)
+            b >>= 1;
+        if (a > b)
+            qSwap(a, b);
+        b -= a;
+    } while (b != 0);
+    return a << shift;
+}
 
 void Rational::normalize()
 {
@@ -36,10 +99,17 @@ void Rational::normalize()
         m_denom=1;
         return;
     }
-    int g = gcd(abs(m_num), abs(m_denom));
+    if(m_denom==1)
+        return;
+    qint64 g = qint64(gcd(magnitude(m_num), magnitude(m_denom)));
     m_num /= g;
     m_denom /= g;
     if(m_denom<0) {
+        if(m_num==std::numeric_limits<qint64>::min()
+           || m_denom==std::numeric_limits<qint64>::min()) {
+            m_valid = false;
+            return;
+        }
         m_num = -m_num;
         m_denom = -m_denom;
     }
@@ -47,7 +117,15 @@ void Rational::normalize()
 
 int Rational::compare(const Rational &other) const
 {
-    return m_num*other.m_denom - m_denom*other.m_num;
+    if(m_denom==other.m_denom)
+        return m_num<other.m_num ? -1 : m_num>other.m_num;
+    qint64 l, r;
+    if(!mulOverflows(m_num, other.m_denom, &l) && !mulOverflows(m_denom, other.m_num, &r))
+        return l<r ? -1 : l>r;
+    // The cross products do not fit, the quotients are far enough apart.
+    long double diff = static_cast<long double>(m_num)/m_denom
+        - static_cast<long double>(other.m_num)/other.m_denom;
+    return diff<0 ? -1 : diff>0;
 }
 
 
@@ -63,19 +141,20 @@ Rational::Rational(const HNumber &num) :
         m_num = 0;
         return;
     }
-    if(HMath::abs(num)>HNumber(INT_MAX) || HMath::abs(num)<HNumber(1)/HNumber(INT_MAX)) {
-        m_valid = false;
+    if(num.isInteger() && HMath::abs(num)<=HNumber(INT_MAX)) {
+        m_num = num.toInt();
         return;
     }
-    if(num.isInteger()) {
-        m_num = num.toInt();
+    if(HMath::abs(num)>HNumber(INT_MAX) || HMath::abs(num)<HNumber(1)/HNumber(INT_MAX)) {
+        m_valid = false;
         return;
     }
     const unsigned long long MAXD = INT_MAX/2; // maximal denominator
     unsigned long long p0=0, q0=1, p1=1, q1=0;
     HNumber val(HMath::abs(num));
     while(true) {
-        long a = HMath::floor(val).toInt();
+        HNumber whole = HMath::floor(val);
+        long a = whole.toInt();
         unsigned long long q2 = q0 + a*q1;
         if(q2>MAXD)
             break;
@@ -84,8 +163,9 @@ Rational::Rational(const HNumber &num) :
         q0 = temp3;
         p1 = temp1 + a*temp2;
         q1 = q2;
-        if(HMath::frac(val).isZero()) break;
-        val = HNumber(1)/HMath::frac(val);
+        HNumber frac = val - whole;
+        if(frac.isZero()) break;
+        val = HNumber(1)/frac;
         if(val>HNumber(MAXD)) break;
     }
 
@@ -108,6 +188,10 @@ Rational::Rational(const double &num):
         m_valid = false;
         return;
     }
+    if (num==std::trunc(num)) {
+        m_num = static_cast<qint64>(num);
+        return;
+    }
     const long long MAXD = INT_MAX/2; // maximal denominator
     long long p0=0, q0=1, p1=1, q1=0;
 
@@ -142,45 +226,89 @@ Rational::Rational(const QString &str) : m_num(0), m_denom(1), m_valid(true)
     QStringList l = str.split("/");
     if(l.size()==1) {
         bool ok;
-        m_num = l.at(0).toInt(&ok);
+        m_num = l.at(0).toLongLong(&ok);
         if(!ok) {
             m_valid=false;
             return;
         }
     } else if(l.size()==2) {
         bool ok;
-        m_num = l.at(0).toInt(&ok);
+        m_num = l.at(0).toLongLong(&ok);
         if(!ok) {
             m_valid=false;
             return;
         }
-        m_denom = l.at(1).toInt(&ok);
+        m_denom = l.at(1).toLongLong(&ok);
         if(!ok) {
             m_valid=false;
             return;
         }
+        normalize();
     }
 }
 
+// Integer operands, which is how nearly every unit exponent looks, need
+// neither a common denominator nor a normalization. A result that does
+// not fit in 64 bits is invalid.
 Rational Rational::operator*(const Rational &other) const
 {
-    return Rational(this->m_num * other.m_num, this->m_denom * other.m_denom);
+    if(!m_valid || !other.m_valid)
+        return Rational(1,0);
+    Rational result;
+    if(m_denom==1 && other.m_denom==1) {
+        if(mulOverflows(m_num, other.m_num, &result.m_num))
+            return Rational(1,0);
+        return result;
+    }
+    // Reducing crosswise first leaves a normalized product.
+    qint64 g1 = qint64(gcd(magnitude(m_num), magnitude(other.m_denom)));
+    qint64 g2 = qint64(gcd(magnitude(other.m_num), magnitude(m_denom)));
+    if(mulOverflows(m_num/g1, other.m_num/g2, &result.m_num)
+       || mulOverflows(m_denom/g2, other.m_denom/g1, &result.m_denom))
+        return Rational(1,0);
+    return result;
 }
 
 Rational Rational::operator/(const Rational &other) const
 {
     if(other.isZero()) return Rational(1,0); // Rational(1,0) will set m_valid=false
-    return Rational(this->m_num / other.m_num, this->m_denom / other.m_denom);
+    if(other.m_num==std::numeric_limits<qint64>::min())
+        return Rational(1,0);
+    Rational inverse;
+    inverse.m_num = other.m_num<0 ? -other.m_denom : other.m_denom;
+    inverse.m_denom = other.m_num<0 ? -other.m_num : other.m_num;
+    inverse.m_valid = other.m_valid;
+    return operator*(inverse);
 }
 
 Rational Rational::operator+(const Rational &other) const
 {
-    return Rational(this->m_num*other.m_denom + this->m_denom*other.m_num, this->m_denom*other.m_denom);
+    if(!m_valid || !other.m_valid)
+        return Rational(1,0);
+    Rational result;
+    if(m_denom==1 && other.m_denom==1) {
+        if(addOverflows(m_num, other.m_num, &result.m_num))
+            return Rational(1,0);
+        return result;
+    }
+    qint64 g = qint64(gcd(quint64(m_denom), quint64(other.m_denom)));
+    qint64 l, r;
+    if(mulOverflows(m_num, other.m_denom/g, &l)
+       || mulOverflows(other.m_num, m_denom/g, &r)
+       || addOverflows(l, r, &result.m_num)
+       || mulOverflows(m_denom, other.m_denom/g, &result.m_denom))
+        return Rational(1,0);
+    result.normalize();
+    return result;
 }
 
 Rational Rational::operator-(const Rational &other) const
 {
-    return Rational(this->m_num*other.m_denom - this->m_denom*other.m_num, this->m_denom*other.m_denom);
+    if(other.m_num==std::numeric_limits<qint64>::min())
+        return Rational(1,0);
+    Rational negated(other);
+    negated.m_num = -other.m_num;
+    return operator+(negated);
 }
 
 Rational &Rational::operator=(const Rational &other)
@@ -216,9 +344,10 @@ bool Rational::operator<(const Rational &other) const
     return compare(other)<0;
 }
 
+// Both sides are normalized, so equal values have equal terms.
 bool Rational::operator==(const Rational &other) const
 {
-    return compare(other) == 0;
+    return m_num==other.m_num && m_denom==other.m_denom;
 }
 
 bool Rational::operator>(const Rational &other) const
@@ -245,8 +374,10 @@ QString Rational::toString() const
 
 HNumber Rational::toHNumber() const
 {
-    HNumber num(m_num);
-    HNumber denom(m_denom);
+    HNumber num = (m_num>=INT_MIN && m_num<=INT_MAX) ? HNumber(int(m_num))
+        : HNumber(QByteArray::number(m_num).constData());
+    HNumber denom = m_denom<=INT_MAX ? HNumber(int(m_denom))
+        : HNumber(QByteArray::number(m_denom).constData());
     return num/denom;
 
 }
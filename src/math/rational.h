@@ -19,16 +19,17 @@
 #ifndef RATIONAL_H
 #define RATIONAL_H
 
+#include <QtGlobal>
+
 class HNumber;
 class QString;
 
 class Rational
 {
-    int m_num;
-    int m_denom;
+    qint64 m_num;
+    qint64 m_denom;
     bool m_valid;
 
-    inline int gcd(int a, int b) const {return (b==0) ? a : gcd(b, a%b);}
     void normalize();
     int compare(const Rational & other) const;
 
@@ -37,10 +38,12 @@ public:
     Rational(const HNumber &num);
     Rational(const double &num);
     Rational(const QString & str);
-    Rational(const int a, const int b) : m_num(a), m_denom(b), m_valid(true) {normalize();}
+    Rational(const qint64 a, const qint64 b) : m_num(a), m_denom(b), m_valid(true) {normalize();}
+
+    static quint64 gcd(quint64 a, quint64 b);
 
-    int numerator() const {return m_num;}
-    int denominator() const {return m_denom;}
+    qint64 numerator() const {return m_num;}
+    qint64 denominator() const {return m_denom;}
 
     Rational operator*(const Rational & other) const;
     Rational operator/(const Rational & other) const;
@@ -25,46 +25,40 @@
 #include <QString>
 #include <QStringList>
 
+// Each unit is computed on its first use and kept unchanged from then on.
+// A local static is initialized exactly once, also when several threads
+// ask for it at the same time, and later calls return it without a lookup.
 #define UNIT_CACHE(name, value) \
-    const Quantity Units::name() \
+    const Quantity& Units::name() \
     { \
-        if (!m_cache.contains(#name)) \
-            m_cache[#name] = value; \
-        return (m_cache[#name]); \
+        static const Quantity unit(value); \
+        return unit; \
     }
 
 #define BASE_UNIT_CACHE(name, dimension) \
-    const Quantity Units::name() \
+    const Quantity& Units::name() \
     { \
-        if (!m_cache.contains(#name)) { \
-            Quantity name(1); \
-            name.modifyDimension(dimension, 1); \
-            m_cache[#name] = name; \
-        } \
-        return m_cache[#name]; \
+        static const Quantity unit(baseUnit(dimension)); \
+        return unit; \
     }
 
-QHash<QMap<QString, Rational>, Unit> Units::m_matchLookup;
-QMap<QString, Quantity> Units::m_cache;
-
-
-void Units::pushUnit(Quantity q, QString name)
+static Quantity baseUnit(const char* dimension)
 {
-    q.cleanDimension();
-    Unit u(name, q);
-    m_matchLookup.insert(q.getDimension(), u);
+    Quantity unit(1);
+    unit.modifyDimension(dimension, 1);
+    return unit;
 }
 
-unsigned int qHash(QMap<QString, Rational> dimension)
+QHash<quint64, Unit> Units::m_matchLookup;
+
+
+void Units::pushUnit(Quantity q, QString name)
 {
-    QStringList keyList(dimension.keys());
-    QString blob("");
-    keyList.sort();
-    for (int i = 0; i < keyList.size(); ++i) {
-        keyList[i].append(dimension[keyList[i]].toString());
-        blob.append(keyList[i]);
-    }
-    return qHash(blob);
+    quint64 signature;
+    bool ok = q.dimensionSignature(&signature);
+    Q_ASSERT(ok);
+    Q_UNUSED(ok);
+    m_matchLookup.insert(signature, Unit(name, q));
 }
 
 /*
@@ -115,9 +109,12 @@ void Units::findUnit(Quantity& q)
         initTable();
 
     // Match derived units.
-    if (m_matchLookup.contains(q.getDimension())) {
-        Unit temp(m_matchLookup[q.getDimension()]);
-        q.setDisplayUnit(temp.value.numericValue(), temp.name);
+    quint64 signature;
+    auto match = m_matchLookup.constEnd();
+    if (q.dimensionSignature(&signature))
+        match = m_matchLookup.constFind(signature);
+    if (match != m_matchLookup.constEnd()) {
+        q.setDisplayUnit(match.value().value.numericValue(), match.value().name);
     } else {
         // Autogenerate unit name (product of base units).
         auto dimension = q.getDimension();
@@ -68,17 +68,25 @@ macx {
 
 
 HEADERS += core/book.h \
+           core/completionindex.h \
            core/constants.h \
+           core/dataimport.h \
+           core/evaluationservice.h \
            core/evaluator.h \
            core/functions.h \
            core/session.h \
            core/errors.h \
            core/numberformatter.h \
            core/manualserver.h\
+           core/memoryusage.h \
            core/pageserver.h \
+           core/pipelinetrace.h \
            core/settings.h \
            core/opcode.h \
            core/sessionhistory.h \
+           core/sessionwriter.h \
+           core/startuptrace.h \
+           core/taskpool.h \
            core/variable.h \
            core/userfunction.h \
            gui/aboutbox.h \
@@ -88,6 +96,7 @@ HEADERS += core/book.h \
            gui/resultdisplay.h \
            gui/editor.h \
            gui/functionswidget.h \
+           gui/historyexporter.h \
            gui/historywidget.h \
            gui/genericdock.h \
            gui/keypad.h \
@@ -96,10 +105,12 @@ HEADERS += core/book.h \
            gui/manualwindow.h \
            gui/mainwindow.h \
            gui/syntaxhighlighter.h \
+           gui/treefilter.h \
            math/cmath.h \
            math/floatcommon.h \
            math/floatconfig.h \
            math/floatconst.h \
+           math/floatconstcalc.h \
            math/floatconvert.h \
            math/floaterf.h \
            math/floatexp.h \
@@ -124,15 +135,23 @@ HEADERS += core/book.h \
 
 SOURCES += main.cpp \
            core/book.cpp \
+           core/completionindex.cpp \
            core/constants.cpp \
+           core/dataimport.cpp \
+           core/evaluationservice.cpp \
            core/evaluator.cpp \
            core/functions.cpp \
            core/numberformatter.cpp \
            core/manualserver.cpp\
+           core/memoryusage.cpp \
            core/pageserver.cpp \
+           core/pipelinetrace.cpp \
            core/settings.cpp \
            core/session.cpp \
            core/sessionhistory.cpp \
+           core/sessionwriter.cpp \
+           core/startuptrace.cpp \
+           core/taskpool.cpp \
            core/variable.cpp \
            core/userfunction.cpp \
            core/opcode.cpp \
@@ -143,15 +162,18 @@ SOURCES += main.cpp \
            gui/resultdisplay.cpp \
            gui/editor.cpp \
            gui/functionswidget.cpp \
+           gui/historyexporter.cpp \
            gui/historywidget.cpp \
            gui/keypad.cpp \
            gui/syntaxhighlighter.cpp \
+           gui/treefilter.cpp \
            gui/variablelistwidget.cpp \
            gui/userfunctionlistwidget.cpp \
            gui/mainwindow.cpp \
            gui/manualwindow.cpp \
            math/floatcommon.c \
            math/floatconst.c \
+           math/floatconstcalc.c \
            math/floatconvert.c \
            math/floaterf.c \
            math/floatexp.c \
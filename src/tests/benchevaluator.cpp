@@ -0,0 +1,373 @@
+// This file is part of the SpeedCrunch project
+// Copyright (C) 2004-2006 Ariya Hidayat <ariya@kde.org>
+// Copyright (C) 2007-2009, 2013, 2016 @heldercorreia
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+// Times the evaluator stages on a fixed corpus of expressions: scanning,
+// compiling (without the compiled expression cache), executing the compiled
+// code and formatting the result. Each stage is repeated until the time
+// budget (default 100 ms, set with --time) is spent, and the mean time per
+// call is reported, along with the numbers allocated per execution and the
+// evaluations per second of the whole pipeline.
+//
+// --cases adds the cases of a file, one per line: a name, a tab and the
+// expression. Lines starting with # are comments. fuzzevaluator saves the
+// slowest expressions it finds in that form, in the group "fuzz".
+//
+// usage: benchevaluator [--csv | --json] [--time ms] [--filter name]
+//                       [--cases file]
+
+#include "core/evaluator.h"
+#include "core/numberformatter.h"
+#include "core/session.h"
+#include "core/settings.h"
+#include "math/number.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+enum OutputFormat { Text, Csv, Json };
+
+struct Case {
+    QString name;
+    QString group;
+    // Evaluated once before timing, to define variables and functions.
+    QStringList setup;
+    QString expression;
+};
+
+struct Timing {
+    Timing() : iterations(0), nsecs(0), allocations(0) { }
+    qint64 iterations;
+    double nsecs;
+    double allocations;
+};
+
+static qint64 budget = 100 * 1000 * 1000;
+
+// "1.25 + 2.25 + ...", with <count> terms and the given separator.
+static QString numbers(const QString& separator, int count)
+{
+    QStringList terms;
+    for (int i = 1; i <= count; ++i)
+        terms.append(QString::number(i) + QLatin1String(".25"));
+    return terms.join(separator);
+}
+
+static QString trigTerms(int count)
+{
+    QStringList terms;
+    for (int i = 1; i <= count; ++i)
+        terms.append(QString("sin(%1/7)*cos(%1/11)").arg(i));
+    return terms.join(" + ");
+}
+
+static QVector<Case> corpus()
+{
+    QVector<Case> cases;
+    Case c;
+
+    c = Case();
+    c.name = "arithmetic"; c.group = "basic";
+    c.expression = "(1.5 + 2.25) * 3 - 7 / 4 ^ 2";
+    cases.append(c);
+
+    c = Case();
+    c.name = "transcendental"; c.group = "basic";
+    c.expression = "sin(0.5) + ln(2) * exp(1.25) - sqrt(2)";
+    cases.append(c);
+
+    c = Case();
+    c.name = "length"; c.group = "units";
+    c.expression = "5 foot + 3 inch -> centi meter";
+    cases.append(c);
+
+    c = Case();
+    c.name = "speed"; c.group = "units";
+    c.expression = "100 kilo meter / hour -> mile / hour";
+    cases.append(c);
+
+    c = Case();
+    c.name = "energy"; c.group = "units";
+    c.expression = "2 kilogram * (3 meter / second)^2 / 2 -> joule";
+    cases.append(c);
+
+    c = Case();
+    c.name = "calls"; c.group = "userfunctions";
+    c.setup << "bench_sq(x) = x * x"
+            << "bench_hyp(a; b) = sqrt(bench_sq(a) + bench_sq(b))"
+            << "bench_norm(a; b; c) = bench_hyp(bench_hyp(a; b); c)";
+    c.expression = "bench_norm(1; 2; 3) + bench_norm(4; 5; 6)";
+    cases.append(c);
+
+    c = Case();
+    c.name = "sheet"; c.group = "userfunctions";
+    c.setup << "rate = 0.035" << "years = 30"
+            << "bench_payment(p; r; n) = p * r / (1 - (1 + r)^(-n))"
+            << "bench_monthly(p) = bench_payment(p; rate / 12; years * 12)";
+    c.expression = "bench_monthly(250000) * years * 12 - 250000";
+    cases.append(c);
+
+    c = Case();
+    c.name = "range"; c.group = "userfunctions";
+    c.setup << "bench_term(k) = 1 / k^2";
+    c.expression = "sumrange(bench_term(k); k; 1; 200)";
+    cases.append(c);
+
+    c = Case();
+    c.name = "average"; c.group = "statistics";
+    c.expression = "average(" + numbers(";", 100) + ")";
+    cases.append(c);
+
+    c = Case();
+    c.name = "stddev"; c.group = "statistics";
+    c.expression = "stddev(" + numbers(";", 100) + ")";
+    cases.append(c);
+
+    c = Case();
+    c.name = "median"; c.group = "statistics";
+    c.expression = "median(" + numbers(";", 100) + ")";
+    cases.append(c);
+
+    c = Case();
+    c.name = "arithmetic"; c.group = "complex";
+    c.expression = "(3 + 4j) * (1 - 2j) / (2 + 1j)";
+    cases.append(c);
+
+    c = Case();
+    c.name = "functions"; c.group = "complex";
+    c.expression = "exp(1j * pi / 3) + ln(-2) + sqrt(-9)";
+    cases.append(c);
+
+    c = Case();
+    c.name = "hex"; c.group = "radix";
+    c.expression = "hex(xor(0xDEADBEEF; 0x12345678))";
+    cases.append(c);
+
+    c = Case();
+    c.name = "bin"; c.group = "radix";
+    c.expression = "bin(or(shl(0b1011; 40); 0b1111))";
+    cases.append(c);
+
+    c = Case();
+    c.name = "sum"; c.group = "long";
+    c.expression = numbers(" + ", 500);
+    cases.append(c);
+
+    c = Case();
+    c.name = "trig"; c.group = "long";
+    c.expression = trigTerms(100);
+    cases.append(c);
+
+    c = Case();
+    c.name = "nested"; c.group = "long";
+    c.expression = QString(100, '(') + "1" + QString(100, ')') + " * 2";
+    cases.append(c);
+
+    return cases;
+}
+
+static bool readCases(const char* fileName, QVector<Case>& cases)
+{
+    QFile file(QString::fromLocal8Bit(fileName));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    while (!file.atEnd()) {
+        const QString line = QString::fromUtf8(file.readLine()).trimmed();
+        const int tab = line.indexOf('\t');
+        if (line.isEmpty() || line.startsWith('#') || tab <= 0)
+            continue;
+        Case c;
+        c.name = line.left(tab);
+        c.group = "fuzz";
+        c.expression = line.mid(tab + 1).trimmed();
+        cases.append(c);
+    }
+    return true;
+}
+
+// Calls the body in batches, doubling the batch size until the budget is
+// spent.
+template<class Body>
+static Timing measure(Body body)
+{
+    Timing timing;
+    bc_alloc_stats before, after;
+    bc_get_alloc_stats(&before);
+    QElapsedTimer clock;
+    clock.start();
+    qint64 batch = 1;
+    qint64 elapsed;
+    do {
+        for (qint64 i = 0; i < batch; ++i)
+            body();
+        timing.iterations += batch;
+        batch *= 2;
+        elapsed = clock.nsecsElapsed();
+    } while (elapsed < budget);
+    bc_get_alloc_stats(&after);
+    timing.nsecs = double(elapsed) / timing.iterations;
+    timing.allocations =
+        double(after.allocations - before.allocations) / timing.iterations;
+    return timing;
+}
+
+static void report(OutputFormat format, const Case& c, const Timing& scan,
+                   const Timing& compile, const Timing& exec,
+                   const Timing& formatting, QJsonArray& records)
+{
+    // Compiling includes scanning, the report keeps the stages apart.
+    const double compileNsecs = qMax(compile.nsecs - scan.nsecs, 0.0);
+    const double total = compile.nsecs + exec.nsecs + formatting.nsecs;
+    const double throughput = total > 0 ? 1e9 / total : 0;
+    const QByteArray name = QString(c.group + '/' + c.name).toUtf8();
+
+    switch (format) {
+    case Csv:
+        if (records.isEmpty())
+            printf("case,length,scan_ns,compile_ns,exec_ns,format_ns,"
+                   "numbers_per_exec,evals_per_sec\n");
+        printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f\n", name.constData(),
+               c.expression.length(), scan.nsecs, compileNsecs, exec.nsecs,
+               formatting.nsecs, exec.allocations, throughput);
+        break;
+    case Json:
+        break;
+    default:
+        printf("%-26s %6d chars %11.1f %11.1f %11.1f %11.1f ns %8.1f numbers"
+               " %10.0f/s\n", name.constData(), c.expression.length(),
+               scan.nsecs, compileNsecs, exec.nsecs, formatting.nsecs,
+               exec.allocations, throughput);
+    }
+    fflush(stdout);
+
+    QJsonObject record;
+    record["case"] = QString::fromUtf8(name);
+    record["length"] = c.expression.length();
+    record["scan_ns"] = scan.nsecs;
+    record["compile_ns"] = compileNsecs;
+    record["exec_ns"] = exec.nsecs;
+    record["format_ns"] = formatting.nsecs;
+    record["numbers_per_exec"] = exec.allocations;
+    record["evals_per_sec"] = throughput;
+    records.append(record);
+}
+
+static bool run(OutputFormat format, const Case& c, QJsonArray& records)
+{
+    Session session;
+    Evaluator evaluator(&session);
+    evaluator.initializeBuiltInVariables();
+
+    for (const QString& line : c.setup) {
+        evaluator.setExpression(line);
+        evaluator.eval();
+        if (evaluator.hasError()) {
+            fprintf(stderr, "%s/%s: setup \"%s\" fails: %s\n",
+                    qPrintable(c.group), qPrintable(c.name), qPrintable(line),
+                    qPrintable(evaluator.error()));
+            return false;
+        }
+    }
+
+    // Never time an error path.
+    evaluator.setExpression(c.expression);
+    const Quantity result = evaluator.evalNoAssign();
+    if (evaluator.hasError()) {
+        fprintf(stderr, "%s/%s fails: %s, skipped\n", qPrintable(c.group),
+                qPrintable(c.name), qPrintable(evaluator.error()));
+        return false;
+    }
+
+    const Timing scan = measure([&] { evaluator.scan(c.expression); });
+    const Timing compile = measure([&] {
+        evaluator.setExpression(c.expression);
+        evaluator.isValid();
+    });
+    const Timing exec = measure([&] { evaluator.evalNoAssign(); });
+    const Timing formatting = measure([&] { NumberFormatter::format(result); });
+    report(format, c, scan, compile, exec, formatting, records);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    OutputFormat format = Text;
+    const char* filter = nullptr;
+    QVector<Case> cases = corpus();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0)
+            format = Csv;
+        else if (strcmp(argv[i], "--json") == 0)
+            format = Json;
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+            budget = qint64(atof(argv[++i]) * 1000 * 1000);
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--cases") == 0 && i + 1 < argc) {
+            if (!readCases(argv[++i], cases)) {
+                fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [--csv | --json] [--time ms] "
+                            "[--filter name] [--cases file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The defaults of a fresh installation, with complex numbers on for the
+    // complex cases.
+    Settings* settings = Settings::instance();
+    settings->angleUnit = 'r';
+    settings->setRadixCharacter('.');
+    settings->complexNumbers = true;
+    DMath::complexMode = true;
+
+    if (format == Text)
+        printf("%-26s %12s %11s %11s %11s %11s\n", "case", "length", "scan",
+               "compile", "exec", "format");
+
+    QJsonArray records;
+    int failures = 0;
+    for (const Case& c : cases) {
+        if (filter && !QString(c.group + '/' + c.name).contains(filter))
+            continue;
+        if (!run(format, c, records))
+            ++failures;
+    }
+
+    if (format == Json) {
+        QJsonObject document;
+        document["precision"] = settings->resultPrecision;
+        document["results"] = records;
+        printf("%s", QJsonDocument(document).toJson().constData());
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+/* benchfloatnum.c: timing of the number.c and floatnum primitives. */
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License , or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; see the file COPYING.  If not, write to:
+
+      The Free Software Foundation, Inc.
+      59 Temple Place, Suite 330
+      Boston, MA 02111-1307 USA.
+
+*************************************************************************/
+
+/*======================================================================
+
+                               BENCHMARKS
+
+  Every operation is repeated until the time budget (default 200 ms,
+  set with --time) is spent, and the mean time per call is reported.
+  Operands are pseudo-random, but the same on every run, so results of
+  different builds can be compared line by line.
+
+  With --calibrate, the crossover points of the multiplier are measured
+  first (see bc_calibrate_mul), used for the run and reported, in the
+  form muldigits.h takes them.
+
+  usage: benchfloatnum [--csv | --json] [--time ms] [--filter name]
+                       [--calibrate]
+
+=======================================================================*/
+
+#include "math/number.h"
+#include "math/floatconst.h"
+#include "math/floatcommon.h"
+#include "math/floathmath.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum { OUT_TEXT, OUT_CSV, OUT_JSON } outformat;
+
+typedef char (*Float1Fn)(floatnum x, int digits);
+
+typedef struct {
+  const char* name;
+  Float1Fn fn;
+  const char* arg;
+} transcendental;
+
+/* the arguments stay well inside the domain and away from points where
+   an algorithm takes a shortcut */
+static transcendental transcendentals[] = {
+  {"float_exp", float_exp, "0.7324031556"},
+  {"float_expminus1", float_expminus1, "0.7324031556"},
+  {"float_ln", float_ln, "2.7324031556"},
+  {"float_lnxplus1", float_lnxplus1, "0.7324031556"},
+  {"float_lg", float_lg, "2.7324031556"},
+  {"float_lb", float_lb, "2.7324031556"},
+  {"float_power10", float_power10, "0.7324031556"},
+  {"float_sinh", float_sinh, "0.7324031556"},
+  {"float_cosh", float_cosh, "0.7324031556"},
+  {"float_tanh", float_tanh, "0.7324031556"},
+  {"float_arsinh", float_arsinh, "0.7324031556"},
+  {"float_arcosh", float_arcosh, "1.7324031556"},
+  {"float_artanh", float_artanh, "0.7324031556"},
+  {"float_sin", float_sin, "0.7324031556"},
+  {"float_cos", float_cos, "0.7324031556"},
+  {"float_tan", float_tan, "0.7324031556"},
+  {"float_arcsin", float_arcsin, "0.7324031556"},
+  {"float_arccos", float_arccos, "0.7324031556"},
+  {"float_arctan", float_arctan, "0.7324031556"},
+  {"float_gamma", float_gamma, "3.7324031556"},
+  {"float_lngamma", float_lngamma, "3.7324031556"},
+  {"float_erf", float_erf, "0.7324031556"},
+  {"float_erfc", float_erfc, "0.7324031556"},
+};
+
+static int precisions[] = { 10, 25, 50, 78, 100, 150, 250 };
+
+static outformat format = OUT_TEXT;
+static double budget = 0.2;
+static const char* filter = NULL;
+static int records = 0;
+static unsigned seed = 20071;
+
+static void randomdigits(char* buf, int lg)
+{
+  int i;
+
+  for (i = 0; i < lg; ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = '0' + (seed >> 16) % 10;
+  }
+  if (lg > 0 && buf[0] == '0')
+    buf[0] = '1';
+  buf[lg] = 0;
+}
+
+/* a bc_num with <lg> digits, one of them before the decimal point */
+static bc_num bcoperand(int lg)
+{
+  char buf[MAXDIGITS + 3];
+  bc_num result;
+
+  randomdigits(buf + 1, lg);
+  buf[0] = buf[1];
+  buf[1] = '.';
+  bc_init_num(&result);
+  bc_str2num(&result, buf, lg);
+  return result;
+}
+
+static void floatoperand(floatnum x, int lg)
+{
+  char buf[MAXDIGITS + 3];
+
+  randomdigits(buf + 1, lg);
+  buf[0] = buf[1];
+  buf[1] = '.';
+  float_setasciiz(x, buf);
+}
+
+static int selected(const char* name)
+{
+  return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static void report(const char* name, int digits, long iterations,
+                   double seconds)
+{
+  double ns;
+
+  ns = seconds * 1e9 / iterations;
+  switch (format)
+  {
+  case OUT_CSV:
+    if (records == 0)
+      printf("operation,digits,iterations,ns_per_op\n");
+    printf("%s,%d,%ld,%.1f\n", name, digits, iterations, ns);
+    break;
+  case OUT_JSON:
+    printf("%s\n    {\"operation\": \"%s\", \"digits\": %d, "
+           "\"iterations\": %ld, \"ns_per_op\": %.1f}",
+           records == 0? "" : ",", name, digits, iterations, ns);
+    break;
+  default:
+    printf("%-18s %4d digits %12.1f ns\n", name, digits, ns);
+  }
+  fflush(stdout);
+  ++records;
+}
+
+/* calls the benchmark body in batches, doubling the batch size until
+   the budget is spent */
+#define BENCH(name, digits, body)                                   \
+  do {                                                              \
+    long _iter, _i, _batch;                                         \
+    clock_t _start;                                                 \
+    double _elapsed;                                                \
+    if (!selected(name)) break;                                     \
+    _iter = 0;                                                      \
+    _batch = 1;                                                     \
+    _start = clock();                                               \
+    do {                                                            \
+      for (_i = 0; _i < _batch; ++_i) { body; }                     \
+      _iter += _batch;                                              \
+      _batch *= 2;                                                  \
+      _elapsed = (double)(clock() - _start) / CLOCKS_PER_SEC;       \
+    } while (_elapsed < budget);                                    \
+    report(name, digits, _iter, _elapsed);                          \
+  } while (0)
+
+static void bench_bc(int digits)
+{
+  bc_num a, b, r;
+
+  a = bcoperand(digits);
+  b = bcoperand(digits);
+  bc_init_num(&r);
+  BENCH("bc_add", digits, bc_add(a, b, &r, 0));
+  BENCH("bc_multiply", digits, bc_multiply(a, b, &r, digits));
+  BENCH("bc_divide", digits, bc_divide(a, b, &r, digits));
+  BENCH("bc_sqrt", digits,
+        bc_free_num(&r); r = bc_copy_num(a); bc_sqrt(&r, digits));
+  bc_free_num(&a);
+  bc_free_num(&b);
+  bc_free_num(&r);
+}
+
+static void bench_float(int digits)
+{
+  floatstruct x, y, r;
+
+  float_create(&x);
+  float_create(&y);
+  float_create(&r);
+  floatoperand(&x, digits);
+  floatoperand(&y, digits);
+  BENCH("float_add", digits, float_add(&r, &x, &y, digits));
+  BENCH("float_mul", digits, float_mul(&r, &x, &y, digits));
+  BENCH("float_div", digits, float_div(&r, &x, &y, digits));
+  float_free(&x);
+  float_free(&y);
+  float_free(&r);
+}
+
+static void bench_transcendental(transcendental* t, int digits)
+{
+  floatstruct arg, x;
+
+  float_create(&arg);
+  float_create(&x);
+  float_setasciiz(&arg, t->arg);
+  /* never time an error path */
+  float_copy(&x, &arg, EXACT);
+  if (!t->fn(&x, digits))
+    fprintf(stderr, "%s fails at %d digits, skipped\n", t->name, digits);
+  else
+    BENCH(t->name, digits,
+          float_copy(&x, &arg, EXACT); t->fn(&x, digits));
+  float_free(&arg);
+  float_free(&x);
+}
+
+int main(int argc, char* argv[])
+{
+  int i, p;
+  int nprec;
+  int calibrate = 0;
+
+  for (i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--csv") == 0)
+      format = OUT_CSV;
+    else if (strcmp(argv[i], "--json") == 0)
+      format = OUT_JSON;
+    else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+      budget = atof(argv[++i]) / 1000;
+    else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+      filter = argv[++i];
+    else if (strcmp(argv[i], "--calibrate") == 0)
+      calibrate = 1;
+    else
+    {
+      fprintf(stderr, "usage: %s [--csv | --json] [--time ms] "
+                      "[--filter name] [--calibrate]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  floatmath_init();
+  float_stdconvert();
+
+  if (calibrate)
+  {
+    bc_calibrate_mul();
+    /* on stderr, so that the table stays as it is */
+    if (format != OUT_JSON)
+      fprintf(stderr, "#define MUL_BASE_DIGITS %d\n#define MUL_TOOM3_DIGITS %d\n",
+              mul_base_digits, mul_toom3_digits);
+  }
+
+  if (format == OUT_JSON)
+  {
+    printf("{\n  \"maxdigits\": %d,\n  \"mathprecision\": %d,\n",
+           MAXDIGITS, MATHPRECISION);
+    if (calibrate)
+      printf("  \"mul_base_digits\": %d,\n  \"mul_toom3_digits\": %d,\n",
+             mul_base_digits, mul_toom3_digits);
+    printf("  \"results\": [");
+  }
+  nprec = sizeof(precisions) / sizeof(precisions[0]);
+  for (p = 0; p < nprec; ++p)
+  {
+    bench_bc(precisions[p]);
+    bench_float(precisions[p]);
+    /* the higher functions are limited to MATHPRECISION digits */
+    if (precisions[p] <= MATHPRECISION)
+      for (i = 0; i < (int)(sizeof(transcendentals) / sizeof(transcendentals[0])); ++i)
+        bench_transcendental(&transcendentals[i], precisions[p]);
+  }
+  if (format == OUT_JSON)
+    printf("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,4 @@
+include(common.pri)
+
+SOURCES += benchfloatnum.c
+TARGET = benchfloatnum
@@ -0,0 +1,348 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+// Times what a user waits for in the main window, on a synthetic session
+// restored at startup: from a keystroke to the auto-calc preview, from
+// Enter to the result in the display, and from a change of the display
+// settings to the refreshed history. The interactions are scripted with
+// Qt Test and each one is repeated (default 50 times, set with
+// --samples); the report gives the percentiles of the latencies.
+//
+// The settings and the session live in the Qt Test locations, see
+// QStandardPaths::setTestModeEnabled(), so a user's own are not touched.
+//
+// usage: benchgui [--csv | --json] [--samples n] [--history n]
+//                 [--variables n] [--functions n] [--filter name]
+
+#include "core/session.h"
+#include "core/settings.h"
+#include "core/sessionhistory.h"
+#include "gui/editor.h"
+#include "gui/mainwindow.h"
+#include "gui/resultdisplay.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtTest/QTest>
+#include <QApplication>
+#include <QTextDocument>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+enum OutputFormat { Text, Csv, Json };
+
+struct SessionSize {
+    int history;
+    int variables;
+    int functions;
+};
+
+static int samples = 50;
+// A preview or a result that has not come after this long counts as missing.
+static const int PreviewTimeout = 5000;
+
+// Writes a session of the given size where MainWindow restores it from.
+static bool writeSession(const SessionSize& size)
+{
+    Session session;
+    for (int i = 0; i < size.history; ++i) {
+        const QString expr = QString("%1.25 * sqrt(%1) + bench_v%2").arg(i).arg(i % qMax(size.variables, 1));
+        session.addHistoryEntry(HistoryEntry(expr, Quantity(HNumber(i) + HNumber("0.25"))));
+    }
+    for (int i = 0; i < size.variables; ++i)
+        session.addVariable(Variable(QString("bench_v%1").arg(i), Quantity(HNumber(i) / HNumber(7))));
+    for (int i = 0; i < size.functions; ++i)
+        session.addUserFunction(UserFunction(QString("bench_f%1").arg(i), QStringList("x"),
+                                             QString("x * %1 + 1").arg(i)));
+
+    const QString path = Settings::getDataPath();
+    QDir().mkpath(path);
+    QFile::remove(path + "/history.journal");
+    QFile::remove(path + "/history.json");
+    QFile file(path + "/history.dat");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QDataStream stream(&file);
+    session.serialize(stream);
+    stream << QString();
+    return stream.status() == QDataStream::Ok;
+}
+
+// Latency percentiles, in milliseconds.
+struct Latencies {
+    Latencies() : count(0), missing(0), p50(0), p90(0), p99(0), max(0) { }
+    int count;
+    int missing;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+static double percentile(const QVector<double>& sorted, double p)
+{
+    const int index = qBound(0, int(p * sorted.count() + 0.5) - 1, sorted.count() - 1);
+    return sorted.at(index);
+}
+
+// Runs the interaction, which returns its latency in milliseconds or a
+// negative value if it did not complete, the given number of times.
+static Latencies measure(std::function<double()> interaction)
+{
+    QVector<double> times;
+    Latencies latencies;
+    for (int i = 0; i < samples; ++i) {
+        const double msecs = interaction();
+        if (msecs < 0)
+            ++latencies.missing;
+        else
+            times.append(msecs);
+    }
+    std::sort(times.begin(), times.end());
+    latencies.count = times.count();
+    if (!times.isEmpty()) {
+        latencies.p50 = percentile(times, 0.5);
+        latencies.p90 = percentile(times, 0.9);
+        latencies.p99 = percentile(times, 0.99);
+        latencies.max = times.last();
+    }
+    return latencies;
+}
+
+static double msecsSince(const QElapsedTimer& clock)
+{
+    return clock.nsecsElapsed() / 1e6;
+}
+
+// From typing the last digit of an expression to the preview of its value.
+static double keystrokeToPreview(Editor* editor, int i)
+{
+    editor->setText(QString("bench_v%1 * 3 + ").arg(i % 10));
+    editor->moveCursor(QTextCursor::End);
+    QApplication::processEvents();
+
+    // Quantity is no meta type, so the signal quits a loop of our own
+    // rather than going to a QSignalSpy.
+    QEventLoop loop;
+    bool shown = false;
+    const QMetaObject::Connection connection =
+        QObject::connect(editor, &Editor::autoCalcQuantityAvailable, [&] {
+            shown = true;
+            loop.quit();
+        });
+    QTimer::singleShot(PreviewTimeout, &loop, SLOT(quit()));
+    QElapsedTimer clock;
+    clock.start();
+    QTest::keyClick(editor, Qt::Key(Qt::Key_0 + i % 10), Qt::NoModifier);
+    if (!shown)
+        loop.exec();
+    const double msecs = msecsSince(clock);
+    QObject::disconnect(connection);
+    return shown ? msecs : -1;
+}
+
+// From Enter to the result at the end of the display.
+static double enterToResult(Editor* editor, ResultDisplay* display, int i)
+{
+    editor->setText(QString("%1.5 * bench_v%2 + sqrt(%1)").arg(i).arg(i % 10));
+    QApplication::processEvents();
+    const int blocks = display->document()->blockCount();
+    QElapsedTimer clock;
+    clock.start();
+    // The expression is evaluated on a worker thread, the result is shown
+    // once the loop hands it over.
+    QEventLoop loop;
+    QTextDocument* document = display->document();
+    const QMetaObject::Connection connection =
+        QObject::connect(document, &QTextDocument::blockCountChanged, [&](int count) {
+            if (count > blocks)
+                loop.quit();
+        });
+    QTimer::singleShot(PreviewTimeout, &loop, SLOT(quit()));
+    QTest::keyClick(editor, Qt::Key_Return);
+    if (document->blockCount() <= blocks)
+        loop.exec();
+    const double msecs = msecsSince(clock);
+    QObject::disconnect(connection);
+    QApplication::processEvents();
+    return document->blockCount() > blocks ? msecs : -1;
+}
+
+// From a settings change to the history shown again; the slot is one of
+// the private ones of MainWindow that the menus trigger.
+static double settingsRefresh(MainWindow* window, const char* slot)
+{
+    QElapsedTimer clock;
+    clock.start();
+    if (!QMetaObject::invokeMethod(window, slot))
+        return -1;
+    QApplication::processEvents();
+    return msecsSince(clock);
+}
+
+static void report(OutputFormat format, const QString& name, const SessionSize& size,
+                   const Latencies& latencies, QJsonArray& records)
+{
+    const QByteArray utf8 = name.toUtf8();
+    switch (format) {
+    case Csv:
+        if (records.isEmpty())
+            printf("case,history,samples,missing,p50_ms,p90_ms,p99_ms,max_ms\n");
+        printf("%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n", utf8.constData(), size.history,
+               latencies.count, latencies.missing, latencies.p50, latencies.p90,
+               latencies.p99, latencies.max);
+        break;
+    case Json:
+        break;
+    default:
+        printf("%-28s %8d %8d %10.3f %10.3f %10.3f %10.3f ms\n", utf8.constData(),
+               size.history, latencies.count, latencies.p50, latencies.p90,
+               latencies.p99, latencies.max);
+        if (latencies.missing > 0)
+            printf("%-28s %d samples did not complete\n", "", latencies.missing);
+    }
+    fflush(stdout);
+
+    QJsonObject record;
+    record["case"] = name;
+    record["history"] = size.history;
+    record["samples"] = latencies.count;
+    record["missing"] = latencies.missing;
+    record["p50_ms"] = latencies.p50;
+    record["p90_ms"] = latencies.p90;
+    record["p99_ms"] = latencies.p99;
+    record["max_ms"] = latencies.max;
+    records.append(record);
+}
+
+static int usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--csv | --json] [--samples n] [--history n]\n"
+                    "       [--variables n] [--functions n] [--filter name]\n", program);
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("SpeedCrunch");
+    QCoreApplication::setOrganizationDomain("speedcrunch.org");
+    QStandardPaths::setTestModeEnabled(true);
+
+    OutputFormat format = Text;
+    SessionSize size = {10000, 100, 20};
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0)
+            format = Csv;
+        else if (strcmp(argv[i], "--json") == 0)
+            format = Json;
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            samples = qMax(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc)
+            size.history = qMax(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--variables") == 0 && i + 1 < argc)
+            size.variables = qMax(atoi(argv[++i]), 10);
+        else if (strcmp(argv[i], "--functions") == 0 && i + 1 < argc)
+            size.functions = qMax(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else
+            return usage(argv[0]);
+    }
+
+    // The defaults of a fresh installation, restoring the session.
+    Settings* settings = Settings::instance();
+    settings->sessionSave = true;
+    settings->autoCalc = true;
+    settings->angleUnit = 'r';
+    settings->resultFormat = 'f';
+    settings->save();
+    if (!writeSession(size)) {
+        fprintf(stderr, "cannot write the session to %s\n", qPrintable(Settings::getDataPath()));
+        return 1;
+    }
+
+    MainWindow window;
+    window.show();
+    if (!QTest::qWaitForWindowExposed(&window)) {
+        fprintf(stderr, "the main window is not shown\n");
+        return 1;
+    }
+    Editor* editor = window.findChild<Editor*>();
+    ResultDisplay* display = window.findChild<ResultDisplay*>();
+    if (!editor || !display) {
+        fprintf(stderr, "the editor or the result display is missing\n");
+        return 1;
+    }
+    editor->setFocus();
+
+    if (format == Text)
+        printf("%-28s %8s %8s %10s %10s %10s %10s\n", "case", "history", "samples",
+               "p50", "p90", "p99", "max");
+
+    struct Case {
+        const char* name;
+        std::function<double(int)> interaction;
+    };
+    const Case cases[] = {
+        {"editor/keystroke-preview", [editor](int i) { return keystrokeToPreview(editor, i); }},
+        {"editor/enter-result", [editor, display](int i) { return enterToResult(editor, display, i); }},
+        {"settings/result-format", [&window](int) { return settingsRefresh(&window, "cycleResultFormats"); }},
+        {"settings/angle-unit", [&window](int) { return settingsRefresh(&window, "cycleAngleUnits"); }},
+        {"settings/font-size", [&window](int i) {
+             return settingsRefresh(&window, i % 2 ? "decreaseDisplayFontPointSize"
+                                                   : "increaseDisplayFontPointSize");
+         }},
+    };
+
+    QJsonArray records;
+    for (const Case& c : cases) {
+        if (filter && !strstr(c.name, filter))
+            continue;
+        int i = 0;
+        const Latencies latencies = measure([&] { return c.interaction(i++); });
+        report(format, QString::fromLatin1(c.name), size, latencies, records);
+    }
+
+    if (format == Json) {
+        QJsonObject document;
+        document["samples"] = samples;
+        document["history"] = size.history;
+        document["variables"] = size.variables;
+        document["functions"] = size.functions;
+        document["results"] = records;
+        printf("%s", QJsonDocument(document).toJson().constData());
+    }
+
+    // Nothing of the run is kept for the next one.
+    settings->sessionSave = false;
+    return 0;
+}
@@ -16,23 +16,30 @@ DEPENDPATH += . \
 
 INCLUDEPATH += . .. ../math ../core ../gui
 
-HEADERS += ../core/book.h \
+HEADERS += ../core/batch.h \
+           ../core/book.h \
            ../core/constants.h \
+           ../core/evaluationservice.h \
            ../core/evaluator.h \
            ../core/functions.h \
            ../core/session.h \
            ../core/errors.h \
            ../core/manualserver.h \
+           ../core/memoryusage.h \
            ../core/numberformatter.h \
            ../core/pageserver.h \
+           ../core/pipelinetrace.h \
            ../core/settings.h \
            ../core/opcode.h \
            ../core/sessionhistory.h \
+           ../core/startuptrace.h \
+           ../core/taskpool.h \
            ../core/variable.h \
            ../core/userfunction.h \
            ../math/floatcommon.h \
            ../math/floatconfig.h \
            ../math/floatconst.h \
+           ../math/floatconstcalc.h \
            ../math/floatconvert.h \
            ../math/floaterf.h \
            ../math/floatexp.h \
@@ -55,21 +62,30 @@ HEADERS += ../core/book.h \
            ../math/units.h \
            ../gui/manualwindow.h
 
-SOURCES += ../core/book.cpp \
+SOURCES += ../core/batch.cpp \
+           ../core/book.cpp \
+           ../core/completionindex.cpp \
            ../core/constants.cpp \
+           ../core/dataimport.cpp \
+           ../core/evaluationservice.cpp \
            ../core/evaluator.cpp \
            ../core/functions.cpp \
            ../core/manualserver.cpp \
+           ../core/memoryusage.cpp \
            ../core/numberformatter.cpp \
            ../core/pageserver.cpp \
+           ../core/pipelinetrace.cpp \
            ../core/settings.cpp \
            ../core/session.cpp \
            ../core/sessionhistory.cpp \
+           ../core/startuptrace.cpp \
+           ../core/taskpool.cpp \
            ../core/variable.cpp \
            ../core/userfunction.cpp \
            ../core/opcode.cpp \
            ../math/floatcommon.c \
            ../math/floatconst.c \
+           ../math/floatconstcalc.c \
            ../math/floatconvert.c \
            ../math/floaterf.c \
            ../math/floatexp.c \
@@ -0,0 +1,294 @@
+// This file is part of the SpeedCrunch project
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; see the file COPYING.  If not, write to
+// the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+// Boston, MA 02110-1301, USA.
+
+// Looks for the expressions that take the evaluator longest. Random
+// expressions are built from the operators the scanner knows and the
+// built-in functions, biased towards the inputs that hurt: huge exponents,
+// arguments next to the poles of tan and gamma, large nCr, deep nesting
+// and chains of superscripts. Each one runs with a time limit (default
+// 2000 ms, set with --timeout) and a memory budget (--numbers, see
+// Evaluator::setMemoryBudget()). The slowest ones (10, set with --keep)
+// are then minimized, dropping the tokens whose removal leaves them about
+// as slow, and written as cases for "benchevaluator --cases".
+//
+// usage: fuzzevaluator [--seed n] [--count n] [--timeout ms]
+//                      [--numbers n] [--keep n] [--output file]
+
+#include "core/evaluator.h"
+#include "core/functions.h"
+#include "core/session.h"
+#include "core/settings.h"
+#include "math/number.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+struct Run {
+    Run() : msecs(0), peakNumbers(0), overBudget(false) { }
+    QString expression;
+    double msecs;
+    long peakNumbers;
+    bool overBudget;
+    QString error;
+};
+
+static int timeout = 2000;
+static int memoryBudget = 1000000;
+
+class Generator {
+public:
+    Generator(unsigned seed)
+        : m_random(seed)
+        , m_functions(FunctionRepo::instance()->getIdentifiers())
+    { }
+
+    QString expression() { return expression(0); }
+
+private:
+    int pick(int n) { return std::uniform_int_distribution<int>(0, n - 1)(m_random); }
+    bool chance(int percent) { return pick(100) < percent; }
+
+    QString number()
+    {
+        switch (pick(8)) {
+        case 0: return QString::number(pick(10));
+        case 1: return QString::number(pick(1000000)) + '.' + QString::number(pick(1000));
+        case 2: return QString("1e%1").arg(pick(2) ? pick(1000000) : -pick(1000000));
+        case 3: return QString("9.99e%1").arg(pick(100000000));
+        case 4: return "0x" + QString::number(pick(1 << 30), 16).toUpper();
+        case 5: return QString::number(pick(100000)) + "!";
+        case 6: return QString("1e-%1").arg(pick(80));
+        default: return QString::number(pick(100) + 1);
+        }
+    }
+
+    // The arguments next to which the functions are slowest.
+    QString pathological()
+    {
+        switch (pick(6)) {
+        case 0: return QString("tan(pi/2 %1 1e-%2)").arg(pick(2) ? '+' : '-').arg(pick(80));
+        case 1: return QString("gamma(-%1 + 1e-%2)").arg(pick(1000)).arg(pick(80));
+        case 2: return QString("lngamma(1e%1)").arg(pick(100));
+        case 3: return QString("ncr(1e%1; %2)").arg(pick(12)).arg(pick(100000));
+        case 4: return QString("npr(%1; %2)").arg(pick(1000000)).arg(pick(100000));
+        default: return QString("erfc(%1)").arg(pick(100000));
+        }
+    }
+
+    QString superscripts()
+    {
+        static const QString digits = QString::fromUtf8("⁰¹²³⁴⁵⁶⁷⁸⁹");
+        QString chain;
+        for (int i = pick(12) + 1; i > 0; --i)
+            chain += digits.at(pick(10));
+        return chain;
+    }
+
+    QString call(int depth)
+    {
+        QStringList arguments;
+        for (int i = pick(3) + 1; i > 0; --i)
+            arguments.append(expression(depth + 1));
+        return m_functions.at(pick(m_functions.count())) + '(' + arguments.join("; ") + ')';
+    }
+
+    QString expression(int depth)
+    {
+        static const char* const operators[] = {
+            " + ", " - ", " * ", " / ", " \\ ", "^", " << ", " >> ", " & ", " | "
+        };
+        if (depth > 6)
+            return number();
+        switch (pick(9)) {
+        case 0: return number();
+        case 1: return pathological();
+        case 2: return m_functions.isEmpty() ? number() : call(depth);
+        case 3: {
+            const int nesting = chance(20) ? pick(500) + 1 : pick(4) + 1;
+            return QString(nesting, '(') + expression(depth + 1) + QString(nesting, ')');
+        }
+        case 4: return expression(depth + 1) + superscripts();
+        case 5: return '-' + expression(depth + 1);
+        case 6: return '(' + expression(depth + 1) + ")!";
+        default:
+            return expression(depth + 1)
+                + operators[pick(sizeof(operators) / sizeof(operators[0]))]
+                + expression(depth + 1);
+        }
+    }
+
+    std::mt19937 m_random;
+    QStringList m_functions;
+};
+
+static Run run(Evaluator& evaluator, const QString& expression)
+{
+    Run result;
+    result.expression = expression;
+    bc_reset_alloc_stats();
+    QElapsedTimer clock;
+    clock.start();
+    evaluator.setExpression(expression);
+    evaluator.evalNoAssign();
+    result.msecs = clock.nsecsElapsed() / 1e6;
+    bc_alloc_stats stats;
+    bc_get_alloc_stats(&stats);
+    result.peakNumbers = stats.peak_live;
+    result.overBudget = result.msecs >= timeout || evaluator.isCancelled();
+    result.error = evaluator.error();
+    return result;
+}
+
+// The evaluations minimize() may spend on one expression.
+static const int MaxMinimizeRuns = 300;
+
+// Drops ranges of tokens, longest first, as long as the expression takes
+// at least half as long as before. Whatever the rest of the expression
+// does, the cliff is then in the tokens left.
+static Run minimize(Evaluator& evaluator, const Run& slowest)
+{
+    Run best = slowest;
+    const double threshold = slowest.msecs / 2;
+    int runs = 0;
+    for (int chunk = evaluator.scan(best.expression).count() / 2; chunk >= 1; chunk /= 2) {
+        bool shrunk = true;
+        while (shrunk && runs < MaxMinimizeRuns) {
+            shrunk = false;
+            const Tokens tokens = evaluator.scan(best.expression);
+            for (int first = 0; first + chunk <= tokens.count(); first += chunk) {
+                const int start = tokens.at(first).pos();
+                const Token& last = tokens.at(first + chunk - 1);
+                const int end = last.pos() + last.size();
+                if (start < 0 || end <= start)
+                    continue;
+                const QString candidate = best.expression.left(start) + best.expression.mid(end);
+                if (candidate.trimmed().isEmpty() || !evaluator.scan(candidate).valid())
+                    continue;
+                const Run attempt = run(evaluator, candidate);
+                ++runs;
+                if (attempt.msecs >= threshold && attempt.msecs > 0) {
+                    best = attempt;
+                    shrunk = true;
+                    break;
+                }
+                if (runs >= MaxMinimizeRuns)
+                    break;
+            }
+        }
+    }
+    return best;
+}
+
+static int usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--seed n] [--count n] [--timeout ms]\n"
+                    "       [--numbers n] [--keep n] [--output file]\n", program);
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    unsigned seed = 1;
+    int count = 2000;
+    int keep = 10;
+    const char* output = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = unsigned(strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+            count = qMax(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+            timeout = qMax(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--numbers") == 0 && i + 1 < argc)
+            memoryBudget = qMax(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc)
+            keep = qMax(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else
+            return usage(argv[0]);
+    }
+
+    // The defaults of a fresh installation, like benchevaluator.
+    Settings* settings = Settings::instance();
+    settings->angleUnit = 'r';
+    settings->setRadixCharacter('.');
+    settings->complexNumbers = true;
+    DMath::complexMode = true;
+
+    Session session;
+    Evaluator evaluator(&session);
+    evaluator.initializeBuiltInVariables();
+    evaluator.setTimeout(timeout);
+    evaluator.setMemoryBudget(memoryBudget);
+
+    Generator generator(seed);
+    QVector<Run> runs;
+    int overBudget = 0;
+    for (int i = 0; i < count; ++i) {
+        const Run result = run(evaluator, generator.expression());
+        overBudget += result.overBudget;
+        runs.append(result);
+        if ((i + 1) % 100 == 0)
+            fprintf(stderr, "%d expressions, %d over budget\r", i + 1, overBudget);
+    }
+    fprintf(stderr, "\n");
+
+    std::sort(runs.begin(), runs.end(),
+              [](const Run& a, const Run& b) { return a.msecs > b.msecs; });
+    runs.resize(qMin(keep, runs.count()));
+
+    QFile file;
+    if (output) {
+        file.setFileName(QString::fromLocal8Bit(output));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            fprintf(stderr, "%s: cannot write %s\n", argv[0], output);
+            return 1;
+        }
+    } else
+        file.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    out << "# fuzzevaluator --seed " << seed << " --count " << count
+        << " --timeout " << timeout << " --numbers " << memoryBudget << '\n';
+
+    for (int i = 0; i < runs.count(); ++i) {
+        const Run& slow = runs.at(i);
+        const Run minimized = minimize(evaluator, slow);
+        out << "# " << QString::number(slow.msecs, 'f', 1) << " ms, "
+            << QString::number(minimized.msecs, 'f', 1) << " ms minimized, "
+            << minimized.peakNumbers << " numbers"
+            << (minimized.overBudget ? ", over budget" : "");
+        if (!minimized.error.isEmpty())
+            out << ", " << minimized.error;
+        out << '\n' << "seed" << seed << '-' << (i + 1) << '\t' << minimized.expression << '\n';
+        out.flush();
+    }
+    return 0;
+}
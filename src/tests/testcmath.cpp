@@ -234,6 +234,11 @@ void test_op()
     CHECK_PRECISE(CNumber(3) / CNumber(7), "0.42857142857142857142857142857142857142857142857143");
     CHECK_PRECISE(CNumber(4) / CNumber(7), "0.57142857142857142857142857142857142857142857142857");
     CHECK_PRECISE(CNumber(1) / CNumber(9), "0.11111111111111111111111111111111111111111111111111");
+    CHECK(CNumber("3+9j") / CNumber(3), "1+3j");
+    CHECK(CNumber("4+6j") / CNumber("2j"), "3-2j");
+    CHECK(CNumber(6) / CNumber("3j"), "-2j");
+    CHECK(CNumber("6+8j") / CNumber("3+4j"), "2");
+    CHECK(CNumber("1+1j") / CNumber("NaN"), "NaN");
 
     // Multiplication.
     CHECK(CNumber(0)* CNumber(0), "0");
@@ -245,6 +250,11 @@ void test_op()
     CHECK(CNumber("1.5")* CNumber("1.5"), "2.25");
     CHECK(CNumber(4) * CNumber("NaN"), "NaN");
     CHECK(CNumber("NaN") * CNumber(4), "NaN");
+    CHECK(CNumber(2) * CNumber("1.5+2j"), "3+4j");
+    CHECK(CNumber("1.5+2j") * CNumber(-2), "-3-4j");
+    CHECK(CNumber("2j") * CNumber("3+1j"), "-2+6j");
+    CHECK(CNumber("3+4j") * CNumber("1-2j"), "11-2j");
+    CHECK(CNumber("1+1j") * CNumber("NaN"), "NaN");
 }
 
 void test_functions()
@@ -259,6 +269,9 @@ void test_functions()
     CHECK(CMath::abs("-100"), "100");
     CHECK(CMath::abs("-3.14159"), "3.14159");
     CHECK(CMath::abs("-0.00000014159"), "0.00000014159");
+    CHECK(CMath::abs("-3+4j"), "5");
+    CHECK(CMath::abs("3e400000000-4e400000000j"), "5e400000000");
+    CHECK(CMath::sqrt("3e400000000+4e400000000j"), "2e200000000+1e200000000j");
 
     CHECK(CMath::conj("NaN"), "NaN");
     CHECK(CMath::conj("1"), "1");
@@ -358,6 +371,7 @@ void test_functions()
 
     CHECK(CMath::sqrt("NaN"), "NaN");
     CHECK(CMath::sqrt(-1), "1j");
+    CHECK(CMath::sqrt(-4), "2j");
     CHECK(CMath::sqrt(0), "0");
     CHECK(CMath::sqrt(1), "1");
     CHECK(CMath::sqrt(4), "2");
@@ -473,6 +487,8 @@ void test_functions()
     CHECK(CMath::raise(10, 2), "100");
     CHECK(CMath::raise(10, 3), "1000");
     CHECK(CMath::raise(10, 4), "10000");
+    CHECK(CMath::raise(-2, 3), "-8");
+    CHECK(CMath::raise(-2, -2), "0.25");
     CHECK(CMath::raise("2", "2"), "4");
     CHECK(CMath::raise("3", "3"), "27");
     CHECK(CMath::raise("4", "4"), "256");
@@ -976,6 +992,11 @@ void test_functions()
     CHECK(CMath::decodeIeee754("0x77", "4", "3", "-2"), "122880");
     CHECK(CMath::decodeIeee754("0x5", "2", "1"), "3");
     CHECK_PRECISE(CMath::decodeIeee754("0x3ffd5555555555555555555555555555", "15", "112"), "0.33333333333333333333333333333333331728391713010637");
+    CHECK_PRECISE(CMath::decodeIeee754("0x400921fb54442d18", "11", "52"), "3.14159265358979311599796346854418516159057617187500");
+    CHECK_FORMAT(Format::Scientific() + Format::Precision(20), CMath::decodeIeee754("0x1", "11", "52"), "4.94065645841246544177e-324");
+    CHECK(CMath::decodeIeee754("0x8000000000000000", "11", "52"), "0");
+    CHECK(CMath::decodeIeee754("0x7bff", "5", "10"), "65504");
+    CHECK(CMath::decodeIeee754("0x3c00", "5", "10"), "1");
 
     CHECK(CMath::encodeIeee754("NaN", "NaN", "NaN"), "NaN");
     CHECK(CMath::encodeIeee754("1", "NaN", "NaN"), "NaN");
@@ -992,6 +1013,9 @@ void test_functions()
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("9999999999999999999999999999999999", "5", "10"), "0x7C00");
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("-0.1", "8", "23"), "0xBDCCCCCD");
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("-0.1", "11", "52"), "0xBFB999999999999A");
+    CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("1.5e38", "8", "23"), "0x7EE1B1E6");
+    CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("-1.2455232e38", "8", "23"), "0xFEBB67CF");
+    CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("4.9406564584124654e-324", "11", "52"), "0x1");
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("16.1253528594970703125", "8", "23"), "0x418100B9");
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("1", "4", "3", "-2"), "0x1");
     CHECK_FORMAT(Format::Hexadecimal() + Format::Fixed(), CMath::encodeIeee754("7", "4", "3", "-2"), "0x7");
@@ -73,6 +73,11 @@ void test_rational()
     CHECK_STRING(Rational(HNumber("-1235000")/HNumber("78950000")).toString().toStdString(), "-247/15790");
     CHECK_STRING(Rational(0.).toString().toStdString(), "0");
     CHECK_STRING(Rational(HNumber(0)).toString().toStdString(), "0");
+    CHECK_STRING((Rational(1,2) + Rational(1,3)).toString().toStdString(), "5/6");
+    CHECK_STRING((Rational(1,2) / Rational(-3,4)).toString().toStdString(), "-2/3");
+    CHECK_STRING((Rational(3,1) * Rational(-2,1)).toString().toStdString(), "-6");
+    CHECK_STRING((Rational(Q_INT64_C(1) << 40, 1) * Rational(3,1)).toString().toStdString(), "3298534883328");
+    CHECK((Rational(Q_INT64_C(1) << 40, 1) * Rational(Q_INT64_C(1) << 40, 1)).isValid() ? Quantity(1) : Quantity(0), "0");
 }
 
 void test_create()
@@ -104,6 +109,17 @@ void test_basic()
     CHECK(DMath::raise(Units::meter(), Quantity(0)),"1");
     CHECK(DMath::raise(Units::meter(), 0) + DMath::raise(Units::second(), 0),"2");
     CHECK(DMath::raise(Units::meter(), Quantity(0)) + DMath::raise(Units::second(), Quantity(0)),"2");
+
+    // Exponents cancelling out, and dimensions outside the base set.
+    CHECK(Units::meter()*Units::second()/Units::meter()/Units::second() + Quantity(1), "2");
+    CHECK(Quantity(int((Units::meter()/Units::meter()).isDimensionless())), "1");
+    Quantity b(2);
+    b.modifyDimension("length", 1);
+    b.modifyDimension("money", 1);
+    Quantity c(3);
+    c.modifyDimension("money", 1);
+    CHECK(Quantity(int(b.sameDimension(c*Units::meter()))), "1");
+    CHECK(Quantity(int((b/c).getDimension() == Units::meter().getDimension())), "1");
 }
 
 void test_functions()
@@ -17,12 +17,24 @@
 // the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
 // Boston, MA 02110-1301, USA.
 
+#include "core/batch.h"
+#include "core/completionindex.h"
+#include "core/dataimport.h"
+#include "core/evaluationservice.h"
 #include "core/evaluator.h"
 #include "core/settings.h"
 #include "core/numberformatter.h"
+#include "core/pipelinetrace.h"
+#include "core/session.h"
+#include "core/taskpool.h"
 #include "tests/testcommon.h"
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
 
 #include <string>
 #include <iostream>
@@ -39,6 +51,8 @@ static int eval_new_failed_tests = 0;
 #define CHECK_AUTOFIX(s,p) checkAutoFix(__FILE__,__LINE__,#s,s,p)
 #define CHECK_DIV_BY_ZERO(s) checkDivisionByZero(__FILE__,__LINE__,#s,s)
 #define CHECK_EVAL(x,y) checkEval(__FILE__,__LINE__,#x,x,y)
+#define CHECK_PREVIEW(x,y) checkPreview(__FILE__,__LINE__,#x,x,y)
+#define CHECK_BATCH(x,v,l,y) checkBatch(__FILE__,__LINE__,#x,x,v,l,y)
 #define CHECK_EVAL_FORMAT(x,y) checkEval(__FILE__,__LINE__,#x,x,y,0,false,true)
 #define CHECK_EVAL_KNOWN_ISSUE(x,y,n) checkEval(__FILE__,__LINE__,#x,x,y,n)
 #define CHECK_EVAL_PRECISE(x,y) checkEvalPrecise(__FILE__,__LINE__,#x,x,y)
@@ -51,8 +65,25 @@ static void checkAutoFix(const char* file, int line, const char* msg, const char
 {
     ++eval_total_tests;
 
-    string r = eval->autoFix(QString(expr)).toStdString();
+    Tokens tokens;
+    const QString text = eval->autoFix(QString(expr), &tokens);
+    string r = text.toStdString();
     DisplayErrorOnMismatch(file, line, msg, r, fixed, eval_failed_tests, eval_new_failed_tests);
+
+    // The tokens handed back are those a scan of the fixed text makes.
+    ++eval_total_tests;
+    eval->scan(QString());
+    const Tokens expected = eval->scan(text);
+    string got, want;
+    for (const Token& token : tokens)
+        got += QString("%1:%2@%3+%4 ").arg(token.type()).arg(token.text())
+                   .arg(token.pos()).arg(token.size()).toStdString();
+    for (const Token& token : expected)
+        want += QString("%1:%2@%3+%4 ").arg(token.type()).arg(token.text())
+                    .arg(token.pos()).arg(token.size()).toStdString();
+    if (tokens.valid() != expected.valid())
+        got += "(validity differs)";
+    DisplayErrorOnMismatch(file, line, msg, got, want, eval_failed_tests, eval_new_failed_tests);
 }
 
 static void checkDivisionByZero(const char* file, int line, const char* msg, const QString& expr)
@@ -62,7 +93,7 @@ static void checkDivisionByZero(const char* file, int line, const char* msg, con
     eval->setExpression(expr);
     Quantity rn = eval->evalUpdateAns();
 
-    if (eval->error().isEmpty()) {
+    if (!eval->hasError()) {
         ++eval_failed_tests;
         cerr << file << "[" << line << "]\t" << msg << endl
              << "\tError: " << "division by zero not caught" << endl;
@@ -77,7 +108,7 @@ static void checkEval(const char* file, int line, const char* msg, const QString
     eval->setExpression(expr);
     Quantity rn = eval->evalUpdateAns();
 
-    if (!eval->error().isEmpty()) {
+    if (eval->hasError()) {
         if (!shouldFail) {
             ++eval_failed_tests;
             cerr << file << "[" << line << "]\t" << msg;
@@ -109,6 +140,34 @@ static void checkEval(const char* file, int line, const char* msg, const QString
     }
 }
 
+static void checkPreview(const char* file, int line, const char* msg, const QString& expr, const char* expected)
+{
+    ++eval_total_tests;
+
+    eval->setExpression(expr);
+    Quantity rn = eval->evalPreview();
+
+    string result = eval->error().isEmpty() ? DMath::format(rn, Format::Fixed()).toStdString()
+                                            : eval->error().toStdString();
+    DisplayErrorOnMismatch(file, line, msg, result, expected, eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+static void checkBatch(const char* file, int line, const char* msg, const QString& expr,
+                       const QString& variable, const QVector<Quantity>& values, const char* expected)
+{
+    ++eval_total_tests;
+
+    eval->setExpression(expr);
+    const QVector<Quantity> results = eval->evalBatch(variable, values);
+
+    QStringList list;
+    for (int i = 0; i < results.count(); ++i)
+        list.append(DMath::format(results.at(i), Format::Fixed()));
+    string result = eval->error().isEmpty() ? list.join(" ").toStdString()
+                                            : eval->error().toStdString();
+    DisplayErrorOnMismatch(file, line, msg, result, expected, eval_failed_tests, eval_new_failed_tests, 0);
+}
+
 static void checkEvalPrecise(const char* file, int line, const char* msg, const QString& expr, const char* expected)
 {
     ++eval_total_tests;
@@ -125,6 +184,11 @@ static void checkEvalPrecise(const char* file, int line, const char* msg, const
 void test_constants()
 {
     CHECK_EVAL("1", "1");
+
+    // The same literal on several lines, as pasted from the constants list.
+    CHECK_EVAL("6.62607004e-34 * 1e34", "6.62607004");
+    CHECK_EVAL("6.62607004e-34 * 2e34", "13.25214008");
+    CHECK_EVAL("-6.62607004e-34 * 1e34", "-6.62607004");
 }
 
 void test_exponentiation()
@@ -272,6 +336,17 @@ void test_binary()
     CHECK_EVAL("1 meter -> meter - 2meter", "-1 (meter - 2meter)");
     CHECK_EVAL("1 meter -> meter", "1 meter");
     CHECK_EVAL("1 (10 meter) -> meter", "10 meter");
+    CHECK_EVAL_FAIL("1 meter -> second");
+    CHECK_EVAL_FAIL("1 meter -> 0 meter");
+    CHECK_USERFUNC_SET("conv1(x) = x -> centimeter");
+    CHECK_EVAL("conv1(2 meter)", "200 centimeter");
+    CHECK_EVAL_FAIL("conv1(2 second)");
+    eval->unsetUserFunction("conv1");
+
+    // Constant subexpressions are computed at compile time.
+    CHECK_EVAL("2*pi/360*180 - pi", "0");
+    CHECK_EVAL("(1+2)^2 * 2", "18");
+    CHECK_EVAL("sqrt(16) + sum(1; 2; 3)", "10");
 }
 
 void test_divide_by_zero()
@@ -669,6 +744,9 @@ void test_function_stat()
     CHECK_EVAL("SUM(-100;-1)", "-101");
     CHECK_EVAL("SUM(1;2;3;4;5;6)", "21");
     CHECK_EVAL("SUM(1;-2;3;-4;5;-6)", "-3");
+    // What the additions round away is kept.
+    CHECK_EVAL("SUM(1e80;1;-1e80)", "1");
+    CHECK_EVAL("SUM(1 meter;2 meter)", "3 meter");
 
     CHECK_EVAL_FAIL("PRODUCT(-1)");
     CHECK_EVAL("PRODUCT(100;0)", "0");
@@ -705,9 +783,105 @@ void test_function_stat()
 
     CHECK_EVAL("VARIANCE(1;-1)", "1");
     CHECK_EVAL("VARIANCE(5 meter; 13 meter)", "16 meter²");
+    CHECK_EVAL("VARIANCE(1e40+1;1e40+3;1e40+5)", "2.66666666666666666667");
+    CHECK_EVAL("STDDEV(2;4;4;4;5;5;7;9)", "2");
+
+    CHECK_EVAL("MEDIAN(3;1;2)", "2");
+    CHECK_EVAL("MEDIAN(4;1;3;2)", "2.5");
+    CHECK_EVAL("MEDIAN(5;5;1;9;5)", "5");
+    CHECK_EVAL("MEDIAN(2 meter;1 meter)", "1.5 meter");
+    CHECK_EVAL_FAIL("MEDIAN(1;1 meter)");
+    CHECK_EVAL("PERCENTILE(0;5;1;3;2;4)", "1");
+    CHECK_EVAL("PERCENTILE(0.25;5;1;3;2;4)", "2");
+    CHECK_EVAL("PERCENTILE(0.9;5;1;3;2;4)", "4.6");
+    CHECK_EVAL("PERCENTILE(1;5;1;3;2;4)", "5");
+    CHECK_EVAL_FAIL("PERCENTILE(1.5;1;2)");
+    CHECK_EVAL_FAIL("PERCENTILE(0.5)");
+    CHECK_EVAL("QUARTILE(1;1;2;3;4)", "1.75");
+    CHECK_EVAL("QUARTILE(2;1;2;3;4)", "2.5");
+    CHECK_EVAL("QUARTILE(4;1;2;3;4)", "4");
+    CHECK_EVAL_FAIL("QUARTILE(0.5;1;2;3;4)");
+    CHECK_EVAL("MODE(1;2;2;3)", "2");
+    CHECK_EVAL("MODE(3;1;3;1;2)", "1");
+    CHECK_EVAL("MODE(4;3)", "3");
     // for complex tests of VARIANCE see test_complex
 }
 
+void test_function_range()
+{
+    CHECK_EVAL("sumrange(k; k; 1; 100)", "5050");
+    CHECK_EVAL("sumrange(k^2; k; 1; 10)", "385");
+    CHECK_EVAL("sumrange(1/2^k; k; 1; 3)", "0.875");
+    CHECK_EVAL("sumrange(k meter; k; 1; 3)", "6 meter");
+    CHECK_EVAL("productrange(k; k; 1; 10)", "3628800");
+    CHECK_EVAL("maxrange(-(k-3)^2; k; 0; 10)", "0");
+    CHECK_EVAL("minrange(k^2 - 4*k; k; -5; 5)", "-4");
+    CHECK_EVAL("1 + 2*sumrange(2*3*k; k; 1; 2)", "37");
+
+    // Empty ranges.
+    CHECK_EVAL("sumrange(k; k; 5; 4)", "0");
+    CHECK_EVAL("productrange(k; k; 5; 4)", "1");
+    CHECK_EVAL_FAIL("minrange(k; k; 5; 4)");
+
+    // Nested loops, in the body or in the bounds.
+    CHECK_EVAL("sumrange(sumrange(j*k; j; 1; k); k; 1; 3)", "25");
+    CHECK_EVAL("sumrange(k; k; 1; sumrange(j; j; 1; 3))", "21");
+    CHECK_EVAL("sumrange(productrange(k; k; 1; n); n; 1; 4)", "33");
+
+    // The loop variable hides variables of the same name.
+    CHECK_EVAL("range1 = 7", "7");
+    CHECK_EVAL("sumrange(range1; range1; 1; 2)", "3");
+    CHECK_EVAL("range1", "7");
+    CHECK_EVAL("sumrange(range1*k; k; 1; 2)", "21");
+
+    CHECK_USERFUNC_SET("range2(n) = sumrange(k^2; k; 1; n)");
+    CHECK_EVAL("range2(10)", "385");
+    CHECK_USERFUNC_SET("range3(n) = productrange(n; n; 1; 3) + n");
+    CHECK_EVAL("range3(10)", "16");
+
+    CHECK_EVAL_FAIL("sumrange(k; 2; 1; 3)");
+    CHECK_EVAL_FAIL("sumrange(k; sin; 1; 3)");
+    CHECK_EVAL_FAIL("sumrange(k; k; 1)");
+    CHECK_EVAL_FAIL("sumrange(k; k; 1; 2.5)");
+    CHECK_EVAL_FAIL("sumrange(k; k; 1; 2; 3)");
+    CHECK_EVAL_FAIL("sumrange(k)");
+    CHECK_EVAL_FAIL("maxrange(k meter + k; k; 1; 2)");
+}
+
+void test_function_numerical()
+{
+    CHECK_EVAL("integrate(x^2; x; 0; 3)", "9");
+    CHECK_EVAL("integrate(x^2; x; 3; 0)", "-9");
+    CHECK_EVAL("integrate(x^2; x; 2; 2)", "0");
+    CHECK_EVAL("integrate(1/(1 + x^2); x; 0; 1) * 4",
+               "3.14159265358979323846");
+    CHECK_EVAL("integrate(1/sqrt(x); x; 0; 4)", "4");
+    CHECK_EVAL("integrate(ln(x); x; 0; 1)", "-1");
+    CHECK_EVAL("integrate(2*x; x; 0 meter; 3 meter)", "9 meter²");
+    CHECK_EVAL("integrate(integrate(x*y; y; 0; 2); x; 0; 1)", "1");
+    CHECK_EVAL_FAIL("integrate(x; x; 0)");
+    CHECK_EVAL_FAIL("integrate(x; x; 0; 1 meter)");
+    CHECK_EVAL_FAIL("integrate(x; x; 0; 1j)");
+
+    CHECK_EVAL("solve(x^2 - 4; x; 1)", "2");
+    CHECK_EVAL("solve(x^2 - 4; x; -1)", "-2");
+    CHECK_EVAL("solve(x^3 - 27; x; 1; 10)", "3");
+    CHECK_EVAL("solve(x^2 - 2; x; 1)^2", "2");
+    CHECK_EVAL("solve(exp(x) - 1; x; 0)", "0");
+    CHECK_EVAL("solve(x^2 - 9 meter²; x; 1 meter)", "3 meter");
+    CHECK_EVAL_FAIL("solve(x^2 + 1; x; 1)");
+    CHECK_EVAL_FAIL("solve(x; x)");
+    CHECK_EVAL_FAIL("solve(x; x; 1 meter; 2)");
+
+    // The body is compiled once, user functions and variables included.
+    CHECK_EVAL("numerical1 = 2", "2");
+    CHECK_USERFUNC_SET("numerical2(x) = numerical1 * x");
+    CHECK_EVAL("integrate(numerical2(x); x; 0; 1)", "1");
+    CHECK_EVAL("solve(numerical2(x) - 8; x; 1)", "4");
+    eval->unsetUserFunction("numerical2");
+    eval->unsetVariable("numerical1");
+}
+
 void test_function_logic()
 {
     CHECK_EVAL_FAIL("and(1)");
@@ -735,6 +909,20 @@ void test_function_discrete()
     CHECK_EVAL("gcd(12;18)", "6");
     CHECK_EVAL("gcd(36;56;210)", "2");
     CHECK_EVAL("gcd(28;120;126)", "2");
+    CHECK_EVAL("gcd(2^90*3; 2^64*5)", "18446744073709551616");
+    CHECK_EVAL_FAIL("gcd(7;5;1 meter)");
+    CHECK_EVAL_FAIL("gcd(7;1.5)");
+    CHECK_EVAL("lcm(4;6)", "12");
+    CHECK_EVAL("lcm(4;6;10)", "60");
+    CHECK_EVAL("lcm(-4;6)", "12");
+    CHECK_EVAL("lcm(0;6;7)", "0");
+    CHECK_EVAL_FAIL("lcm(4)");
+    CHECK_EVAL_FAIL("lcm(4;0.5)");
+
+    CHECK_EVAL("powmod(4;13;497)", "445");
+    CHECK_EVAL("powmod(2;10^14;999999999999)", "96932702428");
+    CHECK_EVAL_FAIL("powmod(2;3)");
+    CHECK_EVAL_FAIL("powmod(2;0.5;7)");
 
     CHECK_EVAL("ncr(-3;-1)", "0");
     CHECK_EVAL("ncr(-3;0)", "1");
@@ -937,6 +1125,805 @@ void test_user_functions()
     //       contains at least one component whose value can not be known at definition time
     //       (e.g., reference to user function arguments or to user/builtin functions).
     CHECK_EVAL("func1()", "20");    // = 2 * 5
+
+    // Check the same text evaluated again sees new definitions
+    CHECK_EVAL_FAIL("func4(2)");
+    CHECK_USERFUNC_SET("func4(a) = a + 1");
+    CHECK_EVAL("func4(2)", "3");
+    CHECK_USERFUNC_SET("func4(a) = a + 2");
+    CHECK_EVAL("func4(2)", "4");
+    CHECK_EVAL("var2 = 2", "2");
+    CHECK_EVAL("var2 * 3", "6");
+    CHECK_EVAL("var2 = 5", "5");
+    CHECK_EVAL("var2 * 3", "15");
+    CHECK_EVAL_FAIL("var3 + 1");
+    CHECK_EVAL("var3 = 1", "1");
+    CHECK_EVAL("var3 + 1", "2");
+    CHECK_USERFUNC_SET("func5(x) = x * var3");
+    CHECK_EVAL("func5(2)", "2");
+    CHECK_EVAL("var3 = 4", "4");
+    CHECK_EVAL("func5(2)", "8");
+
+    // Arguments shadow variables and are passed per call
+    CHECK_EVAL("var4 = 10", "10");
+    CHECK_USERFUNC_SET("func6(var4; y) = var4 - y");
+    CHECK_EVAL("func6(3; 1)", "2");
+    CHECK_EVAL("func6(func6(5; 1); 1)", "3");
+    CHECK_EVAL("sum(func6(1; 0); func6(2; 0); func6(3; 0))", "6");
+    CHECK_EVAL("var4", "10");
+
+    // Results of calls are remembered until something they depend on changes
+    CHECK_USERFUNC_SET("memo1(x) = sqrt(x) * 2");
+    CHECK_USERFUNC_SET("memo2(x) = memo1(x) + memo1(x - 1)");
+    CHECK_EVAL("memo2(4)", "7.46410161513775458705");
+    CHECK_EVAL("memo2(4)", "7.46410161513775458705");
+    CHECK_USERFUNC_SET("memo1(x) = sqrt(x)");
+    CHECK_EVAL("memo2(4) - 2 - sqrt(3)", "0");
+    CHECK_EVAL("var5 = 2", "2");
+    CHECK_USERFUNC_SET("memo3(x) = sqrt(x) * var5");
+    CHECK_EVAL("memo3(4)", "4");
+    CHECK_EVAL("var5 = 3", "3");
+    CHECK_EVAL("memo3(4)", "6");
+}
+
+void test_batch()
+{
+    CHECK_BATCH("batch1^2 + 1", "batch1", QVector<Quantity>({1, 2, 3}), "2 5 10");
+    CHECK_EVAL_FAIL("batch1");
+    CHECK_EVAL("batch2 = 5", "5");
+    CHECK_BATCH("batch2 * 2 + batch1", "batch2", QVector<Quantity>({1, 2}),
+                "<b>batch1</b>: unknown function or variable");
+    CHECK_BATCH("sqrt(batch2) * 2", "batch2", QVector<Quantity>({1, 4, 9}), "2 4 6");
+    CHECK_EVAL("batch2", "5");
+    CHECK_BATCH("pi * 2", "pi", QVector<Quantity>({1}),
+                "pi is a reserved name, please choose another");
+}
+
+void test_instances()
+{
+    // Evaluators keep their state apart.
+    Evaluator other;
+    eval->setExpression("6 * 7");
+    other.setExpression("2 * pi");
+    const string first = DMath::format(other.evalNoAssign(), Format::Fixed()).toStdString();
+    const string second = DMath::format(eval->evalNoAssign(), Format::Fixed()).toStdString();
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "2 * pi", first, "6.28318530717958647693",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "6 * 7", second, "42",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+
+    CHECK_EVAL("instance1 = 1", "1");
+    other.setExpression("instance1");
+    other.evalNoAssign();
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "instance1", other.error().toStdString(),
+                           "<b>instance1</b>: unknown function or variable",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_session_parallel()
+{
+    // Long histories are decoded in parts, and must come back in order.
+    // Enough threads for the parts to be decoded at the same time, also
+    // on a single core.
+    Session session;
+    const int count = 5000;
+    for (int i = 0; i < count; ++i)
+        session.addHistoryEntry(HistoryEntry(QString::number(i), Quantity(HNumber(i) / HNumber(7))));
+    QJsonObject json;
+    session.serialize(json);
+
+    const int threads = TaskGroup::maxThreadCount();
+    TaskGroup::setMaxThreadCount(4);
+    Session loaded;
+    loaded.deSerialize(json, false);
+    TaskGroup::setMaxThreadCount(threads);
+    const QList<HistoryEntry> history = loaded.historyToList();
+    const QJsonArray entries = json["history"].toArray();
+    int mismatches = history.count() == count ? 0 : count;
+    for (int i = 0; i < history.count() && !mismatches; ++i) {
+        if (history.at(i).expr() != QString::number(i)
+            || history.at(i).result() != HistoryEntry(entries.at(i).toObject()).result())
+            ++mismatches;
+    }
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "session parallel",
+                           QString::number(mismatches).toStdString(), "0",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+static QString changesToString(const QList<Session::Change>& changes)
+{
+    static const char* const kinds[] = {"+", "~", "-"};
+    QStringList result;
+    for (int i = 0; i < changes.count(); ++i)
+        result.append(kinds[changes.at(i).kind] + changes.at(i).key);
+    return result.join(" ");
+}
+
+void test_session_changes()
+{
+    Session session;
+    const quint64 start = session.changeCount();
+    session.addVariable(Variable("change1", Quantity(1)));
+    session.addVariable(Variable("change1", Quantity(2)));
+    session.addVariable(Variable("change2", Quantity(3)));
+    session.removeVariable("change1");
+    session.removeVariable("change3");
+    QList<Session::Change> changes;
+    const bool known = session.changesSince(start, changes);
+    const quint64 middle = session.changeCount();
+    QList<Session::Change> none;
+    const bool nothing = session.changesSince(middle, none);
+    session.clearVariables();
+    QList<Session::Change> dropped;
+    const bool reset = session.changesSince(middle, dropped);
+
+    const QString state = QString("%1 %2 %3 %4 %5").arg(known).arg(changesToString(changes))
+        .arg(nothing && none.isEmpty()).arg(reset)
+        .arg(changes.count() == 4 && changes.at(0).subject == Session::Change::Variables);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "session changes", state.toStdString(),
+                           "1 +change1 ~change1 +change2 -change1 1 0 1",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_session_history_revision()
+{
+    Session session;
+    const unsigned start = session.historyRevision();
+    session.addHistoryEntry(HistoryEntry("1+1", Quantity(2)));
+    const bool appended = session.historyRevision() == start;
+    session.insertHistoryEntry(0, HistoryEntry("2", Quantity(2)));
+    const bool inserted = session.historyRevision() != start;
+    const unsigned middle = session.historyRevision();
+    session.removeHistoryEntryAt(1);
+    const bool removed = session.historyRevision() != middle;
+
+    const QString state = QString("%1 %2 %3").arg(appended).arg(inserted).arg(removed);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "history revision", state.toStdString(),
+                           "1 1 1", eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_memory_usage()
+{
+    // Compacting drops the pooled texts of removed entries, and leaves the
+    // history as it was.
+    Session session;
+    for (int i = 0; i < 100; ++i)
+        session.addHistoryEntry(HistoryEntry(QString("%1+0.5").arg(i), Quantity(i)));
+    for (int i = 0; i < 99; ++i)
+        session.removeHistoryEntryAt(0);
+    const qint64 before = session.historyBytes();
+    session.compact();
+    const qint64 after = session.historyBytes();
+    const HistoryEntry entry = session.historyEntryAt(0);
+    QString state = QString("%1 %2 %3").arg(after > 0 && after < before)
+        .arg(entry.expr()).arg(DMath::format(entry.result(), Format::Fixed()));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "compact history", state.toStdString(),
+                           "1 99+0.5 99", eval_failed_tests, eval_new_failed_tests, 0);
+
+    // The caches fill up again after a trim.
+    Batch batch;
+    batch.evaluate("memory_f(x) = x^2 + 1");
+    batch.evaluate("memory_f(3)");
+    const MemoryUsage usage = batch.memoryUsage();
+    batch.trimMemory();
+    const QString result = batch.evaluate("memory_f(4)");
+    const QJsonObject json = usage.toJson();
+    state = QString("%1 %2 %3").arg(json["total"].toDouble() == double(usage.total()))
+        .arg(json["user functions"].toDouble() > 0).arg(result);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "trim memory", state.toStdString(),
+                           "1 1 17", eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_pipeline_trace()
+{
+    // Nothing is recorded while tracing is off, and the ring buffer keeps
+    // the latest spans, oldest first.
+    const bool wasEnabled = PipelineTrace::isEnabled();
+    PipelineTrace::enable(false);
+    PipelineTrace::setCapacity(3);
+    Batch batch;
+    batch.evaluate("1+1");
+    const int idle = PipelineTrace::count();
+    PipelineTrace::enable(true);
+    for (int i = 0; i < 3; ++i) {
+        PipelineTrace::Span span("test");
+        PipelineTrace::Span inner("inner");
+    }
+    { PipelineTrace::Span span("last"); }
+    const QJsonArray events = QJsonDocument::fromJson(PipelineTrace::toChromeTrace())
+        .object()["traceEvents"].toArray();
+    QStringList names;
+    for (const QJsonValue& event : events)
+        names.append(event.toObject()["name"].toString());
+    QString state = QString("%1 %2 %3").arg(idle).arg(PipelineTrace::count()).arg(names.join(","));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "trace ring", state.toStdString(),
+                           "0 3 inner,test,last", eval_failed_tests, eval_new_failed_tests, 0);
+
+    // An evaluation records its stages.
+    PipelineTrace::setCapacity(PipelineTrace::DefaultCapacity);
+    batch.evaluate("trace_f(x) = x*2");
+    batch.evaluate("trace_f(21) + 0.5");
+    names.clear();
+    for (const QJsonValue& event : QJsonDocument::fromJson(PipelineTrace::toChromeTrace())
+             .object()["traceEvents"].toArray()) {
+        const QJsonObject object = event.toObject();
+        if (object["ph"].toString() == "X" && object["dur"].toDouble() >= 0)
+            names.append(object["name"].toString());
+    }
+    state = QString("%1 %2 %3").arg(names.contains("Evaluator::scan"))
+        .arg(names.contains("Evaluator::compile")).arg(names.contains("Evaluator::exec"));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "trace stages", state.toStdString(),
+                           "1 1 1", eval_failed_tests, eval_new_failed_tests, 0);
+    PipelineTrace::clear();
+    PipelineTrace::enable(wasEnabled);
+}
+
+static QString matchesToString(const QList<CompletionIndex::Entry>& matches)
+{
+    QStringList names;
+    for (int i = 0; i < matches.count(); ++i)
+        names.append(matches.at(i).name);
+    return names.join(",");
+}
+
+void test_completion_index()
+{
+    Session session;
+    CompletionIndex index;
+    index.addFunctions(QStringList() << "sin" << "sinh" << "sqrt" << "Sigma");
+    session.addVariable(Variable("sides", Quantity(4)));
+    index.update(&session);
+    const QString first = matchesToString(index.match("SI"));
+    session.addVariable(Variable("sa", Quantity(1)));
+    session.addVariable(Variable("sides", Quantity(5)));
+    session.removeVariable("sides");
+    index.update(&session);
+    const QString second = matchesToString(index.match("s"));
+    session.clearVariables();
+    index.update(&session);
+
+    const QString state = QString("%1 %2 %3 %4").arg(first, second)
+        .arg(index.match("x").count()).arg(index.count());
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "completion index", state.toStdString(),
+                           "Sigma,sin,sinh,sides Sigma,sin,sinh,sqrt,sa 0 4",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_function_texts()
+{
+    FunctionRepo* repo = FunctionRepo::instance();
+    const QString first = repo->find("sin")->name() + ":" + repo->find("sin")->usage();
+    repo->retranslateText();
+    const QString second = repo->find("log")->name() + ":" + repo->find("log")->usage();
+
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "function texts",
+                           (first + " " + second).toStdString(),
+                           "Sine:x Logarithm to Arbitrary Base:base; x",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_batch_lines()
+{
+    Batch batch(Batch::Csv);
+    QStringList lines;
+    lines << batch.header();
+    const char* const input[] = {"x=2", "", "x*3", "f(a)=a+1", "f(x)", "nosuch", "ans*2"};
+    for (const char* line : input) {
+        const QString output = batch.evaluate(line);
+        if (!output.isNull())
+            lines << output;
+    }
+    lines << QString("%1 %2").arg(batch.errorCount()).arg(batch.session().historyCount());
+    lines << Batch(Batch::JsonLines).evaluate("1+1");
+    Batch script(Batch::Csv, "a,b.txt");
+    lines << script.header() << script.evaluate("2*3");
+
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "batch", lines.join("|").toStdString(),
+                           "line,expression,result,error|1,x=2,2,|3,x*3,6,|4,f(a)=a+1,,|5,f(x),3,"
+                           "|6,nosuch,,nosuch: unknown function or variable|7,ans*2,6,|1 5"
+                           "|{\"expression\":\"1+1\",\"line\":1,\"result\":\"2\"}"
+                           "|file,line,expression,result,error|\"a,b.txt\",1,2*3,6,",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_batch_parallel()
+{
+    // Scripts on threads of their own, as speedcrunch-cli --jobs runs them,
+    // share the floatnum constants and must not see each other's work.
+    const char* const script[] = {
+        "x = 7", "x * pi", "pi / x", "x - pi", "sqrt(2) * e", "sin(x) + cos(pi / x)",
+        "ln(x) * gamma(2.5)", "erfc(x / 3)", "f(a) = a * pi + 1", "f(x) - f(1)"
+    };
+    const auto run = [&script](int precision) {
+        Batch batch(Batch::Plain);
+        batch.setWorkingPrecision(precision);
+        QStringList lines;
+        for (const char* line : script)
+            lines << batch.evaluate(line);
+        return lines.join("|");
+    };
+    // Half of the scripts run at another precision, which must not leak
+    // into the others.
+    const int precisions[] = { 0, 12 };
+    const QString expected[] = { run(precisions[0]), run(precisions[1]) };
+
+    const int threads = TaskGroup::maxThreadCount();
+    TaskGroup::setMaxThreadCount(4);
+    QAtomicInt mismatches(0);
+    {
+        TaskGroup group;
+        for (int i = 0; i < 8; ++i) {
+            group.run([&, i] {
+                for (int j = 0; j < 20; ++j) {
+                    if (run(precisions[i % 2]) != expected[i % 2])
+                        mismatches.ref();
+                }
+            });
+        }
+        group.wait();
+    }
+    TaskGroup::setMaxThreadCount(threads);
+
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "batch parallel",
+                           QString::number(mismatches.loadAcquire()).toStdString(), "0",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "batch parallel precisions",
+                           (expected[0] != expected[1]) ? "differ" : "equal", "differ",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_evaluation_service()
+{
+    EvaluationService service;
+    QList<EvaluationService::Result> results;
+    QObject::connect(&service, &EvaluationService::finished,
+                     [&results](const EvaluationService::Result& result) {
+                         results.append(result);
+                     });
+
+    // A keystroke cancels the preview of the one before, only the last is
+    // answered.
+    const Session* session = eval->session();
+    service.preview("sumrange(1 / k^2; k; 1; 1000000)", *session, 0, 60000);
+    const int last = service.preview("6 * 7", *session);
+    service.waitForDone();
+    QStringList previews;
+    for (const EvaluationService::Result& result : results) {
+        previews << QString("%1 %2").arg(result.id == last)
+                                    .arg(DMath::format(result.value, Format::Fixed()));
+    }
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "service preview",
+                           previews.join("|").toStdString(), "1 42",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+
+    // An evaluation changes its snapshot, and the session once applied.
+    Session copy = session->snapshot();
+    results.clear();
+    service.evaluate("service1 = 6 * 7", copy);
+    service.waitForDone();
+    const bool before = copy.hasVariable("service1");
+    if (!results.isEmpty())
+        results.first().apply(&copy);
+    QString evaluated = QString("%1 %2").arg(before).arg(results.count());
+    if (copy.hasVariable("service1")) {
+        evaluated += " " + DMath::format(copy.getVariable("service1").value(), Format::Fixed())
+                   + " " + DMath::format(copy.getVariable("ans").value(), Format::Fixed());
+    }
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "service evaluate",
+                           evaluated.toStdString(), "0 1 42 42",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_lists()
+{
+    QList<DataImport::Column> columns;
+    QString error;
+    const QByteArray csv("elapsed, \"reading\"\r\n0,1.5\n1,-2e1\n\n2,4\n3,\n");
+    const bool parsed = DataImport::parse(csv.constData(), csv.size(),
+                                          DataImport::Csv, columns, error);
+    QList<DataImport::Column> rejected;
+    QString rejectedError;
+    const QByteArray bad("1\t2\n3\tx\n");
+    DataImport::parse(bad.constData(), bad.size(), DataImport::Tsv, rejected,
+                      rejectedError);
+    QList<DataImport::Column> doubles;
+    const double values[] = {0.5, -3, 1e300};
+    DataImport::parse(reinterpret_cast<const char*>(values), sizeof(values),
+                      DataImport::Doubles, doubles, error);
+    const QString imported = QString("%1 %2 %3 %4 %5 %6 %7 %8")
+        .arg(parsed).arg(columns.value(0).name).arg(columns.value(1).name)
+        .arg(columns.value(0).values.count()).arg(columns.value(1).values.count())
+        .arg(rejected.count()).arg(rejectedError)
+        .arg(doubles.count() == 1 && doubles.at(0).values.count() == 3
+             && doubles.at(0).values.at(1) == Quantity(-3));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "import", imported.toStdString(),
+                           "1 elapsed reading 4 3 0 line 2: 'x' is not a number 1",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+    if (columns.count() != 2)
+        return;
+
+    // Lists give their values to the functions they are passed to, and
+    // operators and the functions that take fewer values run element by
+    // element on them.
+    Session session;
+    Evaluator other(&session);
+    session.addList(columns.at(0).name, columns.at(0).values);
+    session.addList(columns.at(1).name, columns.at(1).values);
+    other.setExpression("sq(x) = x * x");
+    other.eval();
+    const char* expressions[][2] = {
+        {"sum(elapsed)", "6"},
+        {"average(elapsed)", "1.5"},
+        {"sum(reading)", "-14.5"},
+        {"median(elapsed; 10)", "2"},
+        {"max(7; reading)", "7"},
+        {"elapsed", "<b>elapsed</b>: a list can only be an argument of a function"},
+        {"elapsed * 2", "<b>elapsed</b>: a list can only be an argument of a function"},
+        {"sum(reading + 1)", "-11.5"},
+        {"sum(2 * elapsed)", "12"},
+        {"sum(-elapsed)", "-6"},
+        {"sum(elapsed^2)", "14"},
+        {"sum(elapsed * elapsed + 1)", "18"},
+        {"max(abs(reading - 10))", "30"},
+        {"sum(round(reading; 0))", "-14"},
+        {"sum(sq(elapsed))", "14"},
+        {"sum(elapsed * reading)", "<b>reading</b>: the lists have different lengths"},
+        {"1 -> elapsed", "<b>elapsed</b>: a list can not be a unit"},
+    };
+    for (const auto& expression : expressions) {
+        other.setExpression(expression[0]);
+        const Quantity value = other.evalNoAssign();
+        const QString result = other.hasError()
+            ? other.error() : DMath::format(value, Format::Fixed());
+        ++eval_total_tests;
+        DisplayErrorOnMismatch(__FILE__, __LINE__, expression[0],
+                               result.toStdString(), expression[1],
+                               eval_failed_tests, eval_new_failed_tests, 0);
+    }
+
+    other.setExpression("x * 2");
+    const QVector<Quantity> batch = other.evalBatch("x", *session.findList("elapsed"));
+    QStringList results;
+    for (int i = 0; i < batch.count(); ++i)
+        results.append(DMath::format(batch.at(i), Format::Fixed()));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "batch of a list",
+                           results.join(" ").toStdString(), "0 2 4 6",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+static string tokensToString(const Tokens& tokens)
+{
+    QString result = tokens.valid() ? "valid:" : "invalid:";
+    for (int i = 0; i < tokens.count(); ++i)
+        result += QString(" %1@%2+%3").arg(tokens.at(i).text())
+                  .arg(tokens.at(i).pos()).arg(tokens.at(i).size());
+    return result.toStdString();
+}
+
+void test_session_journal()
+{
+    Session session;
+    session.setJournaling(true);
+    session.addHistoryEntry(HistoryEntry("1+1", Quantity(2)));
+    session.addVariable(Variable("journal1", Quantity(1)));
+    session.addVariable(Variable("journal1", Quantity(3)));
+    QByteArray journal = session.takeJournal();
+
+    // Setting a variable twice leaves a single record.
+    Session replayed;
+    const bool complete = replayed.replayJournal(journal);
+    Session torn;
+    const bool tornComplete = torn.replayJournal(journal + "{\"op\":\"his");
+
+    // What is merged in is left to the next snapshot.
+    QJsonObject json;
+    replayed.serialize(json);
+    session.deSerialize(json, true);
+    const QString state = QString("%1 %2 %3 %4 %5 %6 %7 %8")
+        .arg(journal.count('\n'))
+        .arg(complete)
+        .arg(replayed.historyToList().count())
+        .arg(replayed.hasVariable("journal1")
+             && replayed.getVariable("journal1").value() == Quantity(3))
+        .arg(tornComplete)
+        .arg(torn.historyToList().count())
+        .arg(session.takeJournal().isEmpty())
+        .arg(session.historyToList().count());
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "session journal", state.toStdString(),
+                           "2 1 1 1 0 1 1 2", eval_failed_tests,
+                           eval_new_failed_tests, 0);
+}
+
+void test_session_binary()
+{
+    Session session;
+    session.addHistoryEntry(HistoryEntry("pi", Quantity(HMath::pi())));
+    session.addHistoryEntry(HistoryEntry("pi", Quantity(HMath::pi())));
+    Quantity length = Quantity(HNumber("-2.5e-40"));
+    length.modifyDimension("length", Rational(1, 2));
+    session.addVariable(Variable("binary1", length));
+    CHECK_USERFUNC_SET("binary2(x) = x + 1");
+    const QList<UserFunction> functions = eval->getUserFunctions();
+    for (int i = 0; i < functions.count(); ++i) {
+        if (functions.at(i).name() == "binary2")
+            session.addUserFunction(functions.at(i));
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    session.serialize(out);
+
+    Session loaded;
+    QDataStream in(data);
+    const bool complete = loaded.deSerialize(in, false);
+    QByteArray torn = data.left(data.size() / 2);
+    QDataStream tornIn(torn);
+    Session unchanged;
+    const bool tornComplete = unchanged.deSerialize(tornIn, false);
+    const Variable variable = loaded.getVariable("binary1");
+
+    // Results loaded but never shown are saved again as they were.
+    QByteArray again;
+    QDataStream againOut(&again, QIODevice::WriteOnly);
+    loaded.serialize(againOut);
+    Session reloaded;
+    QDataStream againIn(again);
+    reloaded.deSerialize(againIn, false);
+
+    // Equal expressions and results share their data.
+    const QList<HistoryEntry> history = loaded.historyToList();
+    const bool shared = history.count() == 2
+        && history.at(0).expr().constData() == history.at(1).expr().constData()
+        && history.at(0).packedResult().constData() == history.at(1).packedResult().constData();
+    const QString state = QString("%1 %2 %3 %4 %5 %6 %7 %8")
+        .arg(complete)
+        .arg(loaded.historyToList().count() == 2
+             && loaded.historyToList().at(0).result() == Quantity(HMath::pi()))
+        .arg(variable.value() == length && variable.value().sameDimension(length))
+        .arg(loaded.hasUserFunction("binary2"))
+        .arg(tornComplete)
+        .arg(unchanged.historyToList().count())
+        .arg(reloaded.historyToList().count() == 2
+             && reloaded.historyToList().at(1).result() == Quantity(HMath::pi()))
+        .arg(shared);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "session binary", state.toStdString(),
+                           "1 1 1 1 0 0 1 1", eval_failed_tests,
+                           eval_new_failed_tests, 0);
+    eval->unsetUserFunction("binary2");
+}
+
+void test_scan()
+{
+    // Each text is scanned right after the previous one, as when typing,
+    // and must give the tokens of a scan from scratch.
+    static const char* edits[] = {
+        "12 + 3", "12 + 34", "1 + 34", "sin(1 + 34)", "sin(1e + 34)",
+        "sin(1e+ + 34)", "sin(1e+2 + 34)", "10\xC2\xB0 + 0x10",
+        "10\xC2\xB0" "30' + 0x10", "1 2 3", "1 + 2 ? comment", "1 + 2 ? 3",
+        "x = 0b101 << 2", "x = 0b101 <<2", "", "3!"
+    };
+    for (unsigned i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+        const QString text = QString::fromUtf8(edits[i]);
+        Evaluator fresh;
+        ++eval_total_tests;
+        DisplayErrorOnMismatch(__FILE__, __LINE__, edits[i],
+                               tokensToString(eval->scan(text)),
+                               tokensToString(fresh.scan(text)).c_str(),
+                               eval_failed_tests, eval_new_failed_tests, 0);
+    }
+}
+
+void test_is_valid()
+{
+    static const char* texts[] = { "1 + 2", "1 +", "", "sin(1) * 2" };
+    QString validity;
+    for (unsigned i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+        eval->setExpression(texts[i]);
+        validity += eval->isValid() ? '1' : '0';
+    }
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "isValid()",
+                           validity.toStdString(), "1001",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+}
+
+void test_profile()
+{
+    eval->setProfiling(true);
+    eval->resetProfile();
+    CHECK_USERFUNC_SET("profile1(x) = x * 2");
+    eval->resetProfile();
+    CHECK_EVAL("sin(0) + profile1(3)", "6");
+    eval->setProfiling(false);
+    CHECK_EVAL("sin(0) + 1", "1");
+
+    const Evaluator::Profile& profile = eval->profile();
+    const QString counts = QString("%1 %2 %3 %4 %5").arg(profile.evaluations)
+        .arg(profile.functions.value("sin").count)
+        .arg(profile.userFunctions.value("profile1").count)
+        .arg(profile.opcodes.value(Opcode::Add).count)
+        .arg(profile.opcodes.value(Opcode::Mul).count);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "profile counts",
+                           counts.toStdString(), "1 1 1 1 1",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "profile allocations",
+                           profile.numberAllocations > 0 ? "yes" : "no", "yes",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+    eval->unsetUserFunction("profile1");
+    eval->resetProfile();
+}
+
+void test_common_subexpressions()
+{
+    CHECK_EVAL("cse_a = 3", "3");
+    CHECK_EVAL("cse_b = 4", "4");
+    CHECK_EVAL("sqrt(cse_a^2 + cse_b^2) * 2 - sqrt(cse_a^2 + cse_b^2)", "5");
+    CHECK_EVAL("(cse_a + 1) * (cse_a + 1) + (cse_a + 1) + (cse_a + 1)^2", "36");
+    CHECK_EVAL("sqrt(cse_a^2 + cse_b^2) + (cse_a^2 + cse_b^2)", "30");
+    CHECK_EVAL("sumrange((k + cse_a) * (k + cse_a); k; 1; 2) + (1 + cse_a) * (1 + cse_a)", "57");
+    CHECK_DIV_BY_ZERO("1 / (cse_a - 3) + 1 / (cse_a - 3)");
+    CHECK_USERFUNC_SET("cse1(x; y) = sqrt(x^2 + y^2) + sqrt(x^2 + y^2) / 2");
+    CHECK_EVAL("cse1(3; 4)", "7.5");
+    CHECK_EVAL("cse1(cse_a; cse_b) - cse1(cse_a; cse_b) / 3", "5");
+
+    // The repeated copy is recalled, the one within it isn't kept apart.
+    eval->setExpression("sqrt(cse_a^2 + cse_b^2) * 2 - sqrt(cse_a^2 + cse_b^2)");
+    const QString code = eval->dump();
+    const QString counts = QString("%1 %2").arg(code.count("Store"))
+        .arg(code.count("Recall"));
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "shared subexpressions",
+                           counts.toStdString(), "1 1",
+                           eval_failed_tests, eval_new_failed_tests, 0);
+
+    eval->unsetUserFunction("cse1");
+    eval->unsetVariable("cse_a");
+    eval->unsetVariable("cse_b");
+}
+
+void test_recalculation()
+{
+    Settings* settings = Settings::instance();
+    const bool autoRecalculation = settings->autoRecalculation;
+
+    settings->autoRecalculation = true;
+    CHECK_EVAL("recalc_a = 2", "2");
+    CHECK_EVAL("recalc_b = recalc_a * 3", "6");
+    CHECK_USERFUNC_SET("recalc_f(x) = x + recalc_a");
+    CHECK_EVAL("recalc_c = recalc_b + recalc_f(1)", "9");
+    CHECK_EVAL("recalc_a = 5", "5");
+    CHECK_EVAL("recalc_b", "15");
+    CHECK_EVAL("recalc_c", "21");
+    CHECK_USERFUNC_SET("recalc_f(x) = x * 10");
+    CHECK_EVAL("recalc_c", "25");
+    // A failing definition keeps its value.
+    CHECK_EVAL("recalc_d = 1 / recalc_a", "0.2");
+    CHECK_EVAL("recalc_a = 0", "0");
+    CHECK_EVAL("recalc_d", "0.2");
+    CHECK_EVAL("recalc_b", "0");
+
+    // The expression is kept with the session.
+    Variable variable = eval->getVariable("recalc_b");
+    QJsonObject json;
+    variable.serialize(json);
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "variable expression",
+                           Variable(json).expression().toStdString(),
+                           "recalc_a * 3", eval_failed_tests,
+                           eval_new_failed_tests, 0);
+
+    settings->autoRecalculation = false;
+    CHECK_EVAL("recalc_a = 7", "7");
+    CHECK_EVAL("recalc_b", "0");
+
+    settings->autoRecalculation = autoRecalculation;
+    eval->unsetUserFunction("recalc_f");
+    eval->unsetVariable("recalc_a");
+    eval->unsetVariable("recalc_b");
+    eval->unsetVariable("recalc_c");
+    eval->unsetVariable("recalc_d");
+}
+
+void test_timeout()
+{
+    // A timeout that is not reached, and a cancellation requested before
+    // the evaluation started, leave it alone.
+    eval->setTimeout(60000);
+    CHECK_EVAL("timeout1 = 6 * 7", "42");
+    eval->setTimeout(0);
+    eval->cancel();
+    CHECK_EVAL("timeout1 + 1", "43");
+}
+
+void test_bytecode()
+{
+    CHECK_USERFUNC_SET("bytecode1(x) = x * 1e-60 + pi");
+    UserFunction function;
+    const QList<UserFunction> functions = eval->getUserFunctions();
+    for (int i = 0; i < functions.count(); ++i) {
+        if (functions.at(i).name() == "bytecode1")
+            function = functions.at(i);
+    }
+
+    // The saved code is loaded as is, the tiny constant included.
+    QJsonObject json;
+    function.serialize(json);
+    const UserFunction loaded(json);
+    QJsonObject bytecode = json["bytecode"].toObject();
+    bytecode["version"] = Evaluator::BytecodeVersion + 1;
+    json["bytecode"] = bytecode;
+    const UserFunction stale(json);
+    const QString state = QString("%1 %2 %3 %4")
+        .arg(loaded.opcodes.count() == function.opcodes.count())
+        .arg(loaded.stackDepth == function.stackDepth)
+        .arg(loaded.precision == eval->workingPrecision())
+        .arg(stale.opcodes.isEmpty());
+    ++eval_total_tests;
+    DisplayErrorOnMismatch(__FILE__, __LINE__, "bytecode", state.toStdString(),
+                           "1 1 1 1", eval_failed_tests,
+                           eval_new_failed_tests, 0);
+
+    eval->unsetUserFunction("bytecode1");
+    eval->setUserFunction(loaded);
+    CHECK_EVAL("bytecode1(2e60)", "5.14159265358979323846");
+    eval->unsetUserFunction("bytecode1");
+}
+
+void test_budget()
+{
+    // A budget that suffices leaves the evaluation alone.
+    eval->setWorkBudget(10000000);
+    eval->setMemoryBudget(1000);
+    CHECK_EVAL("budgetv = 6 * 7", "42");
+    CHECK_USERFUNC_SET("budget0(x) = x * budgetv");
+    CHECK_USERFUNC_SET("budget1(x) = budget0(x) + budget0(x + 1) "
+                       "+ budget0(x + 2) + budget0(x + 3)");
+    CHECK_USERFUNC_SET("budget2(x) = budget1(x) + budget1(x + 1) "
+                       "+ budget1(x + 2) + budget1(x + 3)");
+    CHECK_USERFUNC_SET("budget3(x) = budget2(x) + budget2(x + 1) "
+                       "+ budget2(x + 2) + budget2(x + 3)");
+    CHECK_USERFUNC_SET("budget4(x) = budget3(x) + budget3(x + 1) "
+                       "+ budget3(x + 2) + budget3(x + 3)");
+    CHECK_USERFUNC_SET("budget5(x) = budget4(x) + budget4(x + 1) "
+                       "+ budget4(x + 2) + budget4(x + 3)");
+    CHECK_USERFUNC_SET("budget6(x) = budget5(x) + budget5(x + 1) "
+                       "+ budget5(x + 2) + budget5(x + 3)");
+    CHECK_USERFUNC_SET("budget7(x) = budget6(x) + budget6(x + 1) "
+                       "+ budget6(x + 2) + budget6(x + 3)");
+    CHECK_USERFUNC_SET("budget8(x) = budget7(x) + budget7(x + 1) "
+                       "+ budget7(x + 2) + budget7(x + 3)");
+    CHECK_EVAL("budget1(1)", "420");
+    // Each level of nesting takes four times the work of the one below,
+    // the runaway ones are rejected before they run.
+    CHECK_EVAL_FAIL("budget8(1)");
+    eval->setWorkBudget(1);
+    CHECK_EVAL_FAIL("budgetv + 1");
+    eval->setWorkBudget(0);
+    eval->setMemoryBudget(0);
+    CHECK_EVAL("budgetv + 1", "43");
 }
 
 void test_complex()
@@ -977,6 +1964,10 @@ void test_angle_mode(Settings* settings)
     settings->angleUnit = 'd';
     Evaluator::instance()->initializeAngleUnits();
     CHECK_EVAL("sin(180)", "0");
+    CHECK_EVAL("sin(-30)", "-0.5");
+    CHECK_EVAL("cos(36000000000000000000000000000000120)", "-0.5");
+    CHECK_EVAL("tan(135)", "-1");
+    CHECK_EVAL_FAIL("tan(90)");
     CHECK_EVAL("arcsin(-1)", "-90");
     CHECK_EVAL_FAIL("sin(1j)");
     CHECK_EVAL("arcsin(-2)", "-90+75.4561292902168920041j");
@@ -985,10 +1976,18 @@ void test_angle_mode(Settings* settings)
     CHECK_EVAL("gradian","0.9");
     CHECK_EVAL("gon","0.9");
     CHECK_EVAL_KNOWN_ISSUE("arcsin(0.25)", "14.47751218592992387877", 781);
+    CHECK_USERFUNC_SET("angle1(x) = x + sin(90) * 2^2");
+    CHECK_EVAL("angle1(1)", "5");
+    CHECK_USERFUNC_SET("angle2(x) = x degree -> radian");
+    CHECK_EVAL("angle2(180)", "3.14159265358979323846 radian");
 
     settings->angleUnit = 'g';
     Evaluator::instance()->initializeAngleUnits();
     CHECK_EVAL("sin(200)", "0");
+    CHECK_EVAL("cos(300)", "0");
+    CHECK_EVAL("sec(-200)", "-1");
+    CHECK_EVAL("angle1(1) - (1 + sin(90) * 4)", "0");
+    CHECK_EVAL("angle2(180)", "3.14159265358979323846 radian");
     CHECK_EVAL("arcsin(-1)", "-100");
     CHECK_EVAL_FAIL("sin(1j)");
     CHECK_EVAL("arcsin(-2)", "-100+83.84014365579654667122j");
@@ -1059,6 +2058,73 @@ void test_implicit_multiplication()
     CHECK_EVAL_FAIL("pi (2)");
 }
 
+void test_working_precision()
+{
+    eval->setWorkingPrecision(10);
+    CHECK_EVAL("1/3", "0.3333333333");
+    CHECK_EVAL("sqrt(2)", "1.414213562");
+    CHECK_EVAL("exp(1)", "2.718281828");
+    CHECK_EVAL("1/3 - 0.3333333333", "0");
+
+    eval->setWorkingPrecision(0);
+    CHECK_EVAL("1/3", "0.33333333333333333333");
+    CHECK_EVAL("1/3 - 0.3333333333", "0.00000000003333333333");
+}
+
+void test_preview()
+{
+    Settings::instance()->resultFormat = 'f';
+    // Answered in doubles.
+    CHECK_PREVIEW("1+2", "3");
+    CHECK_PREVIEW("0.1+0.2", "0.3");
+    CHECK_PREVIEW("1/3", "0.333333333333333");
+    CHECK_PREVIEW("2^10", "1024");
+    CHECK_PREVIEW("-2^3", "-8");
+    CHECK_PREVIEW("sqrt(2)", "1.4142135623731");
+    CHECK_PREVIEW("ln(10)", "2.30258509299405");
+    // Too few digits left in doubles, evaluated in full.
+    CHECK_PREVIEW("sin(pi)", "0");
+    CHECK_PREVIEW("1e20+1-1e20", "1");
+    CHECK_PREVIEW("0.1+0.2-0.3", "0");
+    CHECK_PREVIEW("2^64", "18446744073709551616");
+    CHECK_PREVIEW("10!", "3628800");
+    CHECK_PREVIEW("1/0", "division by zero");
+
+    // User functions are run in doubles too, through the bodies lowered
+    // at their first call.
+    CHECK_USERFUNC_SET("preview_third(x) = x / 3");
+    CHECK_USERFUNC_SET("preview_hyp(a; b) = sqrt(a^2 + b^2)");
+    CHECK_USERFUNC_SET("preview_norm(a; b; c) = preview_hyp(preview_hyp(a; b); c)");
+    CHECK_USERFUNC_SET("preview_fact(n) = n!");
+    CHECK_PREVIEW("preview_third(1)", "0.333333333333333");
+    CHECK_PREVIEW("preview_third(1) + preview_third(2)", "1");
+    CHECK_PREVIEW("preview_norm(1; 2; 2)", "3");
+    CHECK_PREVIEW("preview_fact(10)", "3628800");
+    CHECK_PREVIEW("preview_third(preview_fact(3))", "2");
+    eval->unsetUserFunction("preview_third");
+    eval->unsetUserFunction("preview_hyp");
+    eval->unsetUserFunction("preview_norm");
+    eval->unsetUserFunction("preview_fact");
+
+    // A rough preview makes the fallback with fewer digits, and says so.
+    static const char* rough[][3] = {
+        { "1+2", "3", "exact" },
+        { "2^64", "18446744073709551616", "rough" },
+        { "1/0", "division by zero", "exact" }
+    };
+    for (unsigned i = 0; i < sizeof(rough) / sizeof(rough[0]); ++i) {
+        eval->setExpression(rough[i][0]);
+        const Quantity rn = eval->evalPreview(25);
+        const string result = (eval->hasError()
+            ? eval->error() : DMath::format(rn, Format::Fixed())).toStdString()
+            + (eval->isPreviewRough() ? " rough" : " exact");
+        ++eval_total_tests;
+        DisplayErrorOnMismatch(__FILE__, __LINE__, rough[i][0], result,
+                               (string(rough[i][1]) + " " + rough[i][2]).c_str(),
+                               eval_failed_tests, eval_new_failed_tests, 0);
+    }
+}
+
 void test_format()
 {
     CHECK_EVAL("bin(123)", "0b1111011");
@@ -1066,6 +2132,23 @@ void test_format()
     CHECK_EVAL("hex(123)", "0x7B");
 
     CHECK_EVAL("polar(3+4j)", "5 * exp(j*0.92729521800161223243)");
+
+    // The result display cuts long runs of digits.
+    static const char* shortened[][2] = {
+        { "0xFFFF", "0xFFFF" },
+        { "0b1000000000000000000000000000000000000000000000000000000000000000",
+          "0b1000000000000000000000000000000000000000000000000000000000000000" },
+        { "0b10000000000000000000000000000000000000000000000000000000000000001",
+          "0b1000000000000000…[65 digits]…0000000000000001" },
+        { "-0x123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789.5",
+          "-0x123456789ABCDEF0…[73 digits]…ABCDEF0123456789.5" },
+    };
+    for (unsigned i = 0; i < sizeof(shortened) / sizeof(shortened[0]); ++i) {
+        ++eval_total_tests;
+        DisplayErrorOnMismatch(__FILE__, __LINE__, shortened[i][0],
+                               NumberFormatter::shorten(QString::fromUtf8(shortened[i][0])).toStdString(),
+                               shortened[i][1], eval_failed_tests, eval_new_failed_tests, 0);
+    }
 }
 
 
@@ -1109,6 +2192,8 @@ int main(int argc, char* argv[])
     test_function_basic();
     test_function_trig();
     test_function_stat();
+    test_function_range();
+    test_function_numerical();
     test_function_logic();
     test_function_discrete();
     test_function_simplified();
@@ -1122,8 +2207,33 @@ int main(int argc, char* argv[])
     test_comments();
 
     test_user_functions();
+    test_batch();
+    test_instances();
+    test_timeout();
+    test_budget();
+    test_bytecode();
+    test_session_journal();
+    test_session_binary();
+    test_session_parallel();
+    test_session_changes();
+    test_session_history_revision();
+    test_memory_usage();
+    test_pipeline_trace();
+    test_completion_index();
+    test_function_texts();
+    test_batch_lines();
+    test_batch_parallel();
+    test_evaluation_service();
+    test_lists();
+    test_scan();
+    test_is_valid();
+    test_profile();
+    test_common_subexpressions();
+    test_recalculation();
 
     test_implicit_multiplication();
+    test_working_precision();
+    test_preview();
 
     settings->complexNumbers = true;
     DMath::complexMode = true;
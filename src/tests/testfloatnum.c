@@ -37,6 +37,7 @@
 /* a few tests depend on 32 bit integer size, fix this in future!! */
 
 #include "math/floatconst.h"
+#include "math/floatconstcalc.h"
 #include "math/floatcommon.h"
 #include "math/floatlog.h"
 #include "math/floatexp.h"
@@ -48,16 +49,25 @@
 #include "math/floatlogic.h"
 #include "math/floaterf.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+# include <pthread.h>
+#endif
 
 #ifdef _FLOATNUMTEST
 
 /* From math/floaterf.c */
 char erfseries(floatnum x, int digits);
-char erfcsum(floatnum x, int digits);
+char erfcsum(floatnum x, floatnum alpha, int digits);
 char erfcasymptotic(floatnum x, int digits);
 /* From math/floatgamma.c */
 char binetasymptotic(floatnum x, int digits);
+/* From math/number.c */
+extern int mul_limb_digits;
+extern int mul_base_digits;
+extern int mul_toom3_digits;
+extern int div_newton_digits;
 
 #define msbu (1u << (sizeof(unsigned)*8-1))
 #define maxu (msbu + (msbu-1))
@@ -1823,6 +1833,68 @@ static int test_move()
   return 1;
 }
 
+static int tc_shrink(const char* value, int digits, const char* result)
+{
+  floatstruct f;
+  bc_alloc_stats before, after;
+  char retvalue;
+  char buf[50];
+
+  float_create(&f);
+  float_setasciiz(&f, value);
+  /* hides the digits beyond <digits> in the significand */
+  float_copy(&f, &f, digits);
+  bc_get_alloc_stats(&before);
+  float_shrink(&f);
+  bc_get_alloc_stats(&after);
+  float_getscientific(buf, sizeof(buf), &f);
+  retvalue = strcmp(buf, result) == 0;
+  if (!float_isnan(&f) && !float_iszero(&f))
+    /* the digit block went back to its list */
+    retvalue = retvalue
+               && f.significand->n_value == f.significand->n_ptr
+               && f.significand->n_scale == float_getlength(&f) - 1
+               && after.block_list_length == before.block_list_length + 1;
+  float_free(&f);
+  return retvalue;
+}
+
+static int test_shrink()
+{
+  int i;
+  floatstruct g;
+  int refs;
+  char* ptr;
+  static struct{
+    const char* value; int digits; const char* result;
+  } testcases[] = {
+    {"NaN", 3, "NaN"},
+    {"0", 3, "0"},
+    {"1", 3, "1.e0"},
+    {"-12300", 5, "-1.23e4"},
+    {"1.234567890123", 4, "1.234e0"},
+    {"1.205", 3, "1.2e0"},
+    {"1.234567890123e-100", 15, "1.234567890123e-100"},
+  };
+
+  printf("testing float_shrink\n");
+
+  for(i = -1; ++i < sizeof(testcases)/sizeof(testcases[0]);)
+    if(!tc_shrink(testcases[i].value, testcases[i].digits,
+                  testcases[i].result))
+      return tc_fail(i);
+  /* a shared significand is left alone */
+  refs = _one_->n_refs;
+  g.significand = bc_copy_num(_one_);
+  g.exponent = 0;
+  ptr = _one_->n_ptr;
+  float_shrink(&g);
+  if (_one_->n_ptr != ptr || _one_->n_refs != refs + 1)
+    return 0;
+  float_free(&g);
+  return _one_->n_refs == refs;
+}
+
 static int tc_round(const char* value, int digits, const char* up,
                     const char* down, int roundflags, Error error)
 {
@@ -2270,6 +2342,9 @@ static int test_mul()
   if (!tc_mul("underflow\n", minexp(nmb, "4e"), "0.2", EXACT, "NaN")) return FALSE;
   if (!tc_mul("big underflow\n", minexp(nmb, "1e"), nmb, EXACT, "NaN")) return FALSE;
   if (!tc_mul("scale overflow\n", "1.2345678901", "1.2345678901", EXACT, "NaN")) return FALSE;
+  if (!tc_mul("power of ten\n", "1e3", "-1.2345678", 4, "-1.234e3")) return FALSE;
+  if (!tc_mul("power of ten, second\n", "1.2345678", "1e-9", EXACT, "1.2345678e-9")) return FALSE;
+  if (!tc_mul("power of ten, overflow\n", maxexp(nmb, "5e"), "1e1", EXACT, "NaN")) return FALSE;
   printf("%s\n", "in place mul, first");
   float_setscientific(&v1, "2", NULLTERMINATED);
   float_setscientific(&v2, "-3", NULLTERMINATED);
@@ -2292,6 +2367,657 @@ static int test_mul()
   return TRUE;
 }
 
+static int tc_muladd(char* msg, char* val1, char* val2, char* val3,
+                     int digits, char* result)
+{
+  floatstruct v1, v2, v3, r;
+  char buf[30];
+  char ok;
+
+  float_create(&v1);
+  float_create(&v2);
+  float_create(&v3);
+  float_create(&r);
+  printf("%s", msg);
+  float_setscientific(&v1, val1, NULLTERMINATED);
+  float_setscientific(&v2, val2, NULLTERMINATED);
+  float_setscientific(&v3, val3, NULLTERMINATED);
+  float_muladd(&r, &v1, &v2, &v3, digits);
+  float_getscientific(buf, 30, &r);
+  ok = strcmp(buf, result) == 0;
+  if (!ok)
+    printf("got %s, expected %s\n", buf, result);
+  float_free(&v1);
+  float_free(&v2);
+  float_free(&v3);
+  float_free(&r);
+  return ok;
+}
+
+static int test_muladd()
+{
+  floatstruct a, b, c, d;
+  cfloatnum f1[2], f2[2];
+  char buf[30];
+
+  printf("\ntesting float_muladd\n");
+  if (!tc_muladd("NaN\n", "NaN", "1", "1", 3, "NaN")) return FALSE;
+  if (!tc_muladd("NaN summand\n", "1", "1", "NaN", 3, "NaN")) return FALSE;
+  if (!tc_muladd("2 * 3 + 4\n", "2", "3", "4", EXACT, "1.e1")) return FALSE;
+  if (!tc_muladd("0 * 3 + 4\n", "0", "3", "4", EXACT, "4.e0")) return FALSE;
+  /* 1.234567^2 = 1.524155677489, a rounded product would cancel */
+  if (!tc_muladd("cancellation\n", "1.234567", "1.234567", "-1.524155", 7,
+                 "6.77489e-7")) return FALSE;
+  printf("%s\n", "in place muladd");
+  float_create(&a);
+  float_setscientific(&a, "3", NULLTERMINATED);
+  float_muladd(&a, &a, &a, &a, EXACT);
+  float_getscientific(buf, 30, &a);
+  if (strcmp(buf, "1.2e1") != 0) return FALSE;
+
+  printf("\ntesting float_dot\n");
+  float_create(&b);
+  float_create(&c);
+  float_create(&d);
+  float_setscientific(&a, "1.234567", NULLTERMINATED);
+  float_setscientific(&b, "1", NULLTERMINATED);
+  float_setscientific(&c, "-1.524155", NULLTERMINATED);
+  f1[0] = &a; f2[0] = &a;
+  f1[1] = &b; f2[1] = &c;
+  float_dot(&d, 2, f1, f2, 7);
+  float_getscientific(buf, 30, &d);
+  if (strcmp(buf, "6.77489e-7") != 0) return FALSE;
+  printf("%s\n", "in place dot");
+  float_dot(&a, 2, f1, f2, 7);
+  float_getscientific(buf, 30, &a);
+  if (strcmp(buf, "6.77489e-7") != 0) return FALSE;
+  printf("%s\n", "no terms");
+  float_geterror();
+  if (float_dot(&d, 0, f1, f2, 7) || !float_isnan(&d)
+      || float_geterror() != InvalidParam) return FALSE;
+  float_free(&a);
+  float_free(&b);
+  float_free(&c);
+  float_free(&d);
+  return TRUE;
+}
+
+static unsigned bcseed = 12345;
+
+static void randomdigits(char* buf, int lg)
+{
+  int i;
+
+  for (i = 0; i < lg; ++i)
+  {
+    bcseed = bcseed * 1103515245 + 12345;
+    buf[i] = '0' + (bcseed >> 16) % 10;
+  }
+  if (lg > 0 && buf[0] == '0')
+    buf[0] = '1';
+  buf[lg] = 0;
+}
+
+/* compares the product of the multiplier tiers selected by the
+   crossover points <base> and <toom3> with the digit-by-digit schoolbook
+   product */
+static int tc_bcmul(int lg1, int lg2, int base, int toom3)
+{
+  char* buf1;
+  char* buf2;
+  bc_num n1, n2, p1, p2;
+  int savelimb, savebase, savetoom3, ok;
+
+  buf1 = (char*)malloc(lg1 + 1);
+  buf2 = (char*)malloc(lg2 + 1);
+  randomdigits(buf1, lg1);
+  randomdigits(buf2, lg2);
+  bc_init_num(&n1);
+  bc_init_num(&n2);
+  bc_init_num(&p1);
+  bc_init_num(&p2);
+  bc_str2num(&n1, buf1, 0);
+  bc_str2num(&n2, buf2, 0);
+  savelimb = mul_limb_digits;
+  savebase = mul_base_digits;
+  savetoom3 = mul_toom3_digits;
+  mul_limb_digits = 100000;
+  mul_base_digits = 100000;
+  mul_toom3_digits = 100000;
+  bc_multiply(n1, n2, &p1, 0);
+  mul_limb_digits = savelimb;
+  mul_base_digits = base;
+  mul_toom3_digits = toom3;
+  bc_multiply(n1, n2, &p2, 0);
+  mul_base_digits = savebase;
+  mul_toom3_digits = savetoom3;
+  ok = bc_compare(p1, p2) == 0;
+  bc_free_num(&n1);
+  bc_free_num(&n2);
+  bc_free_num(&p1);
+  bc_free_num(&p2);
+  free(buf1);
+  free(buf2);
+  return ok;
+}
+
+static int test_bcmul()
+{
+  int lg1, lg2;
+
+  printf("\ntesting bc_multiply\n");
+  for (lg1 = 1; lg1 <= 300; lg1 += 7)
+    for (lg2 = 1; lg2 <= 300; lg2 += 11)
+      if (!tc_bcmul(lg1, lg2, mul_base_digits, mul_toom3_digits)
+          || !tc_bcmul(lg1, lg2, 60, 100000)
+          || !tc_bcmul(lg1, lg2, 40, 90))
+      {
+        printf("mismatch for %d * %d digits\n", lg1, lg2);
+        return FALSE;
+      }
+  return TRUE;
+}
+
+/* the crossover points bc_calibrate_mul measures must give the same
+   products as the schoolbook multiplication, with operands long enough
+   to reach the faster tiers */
+static int test_bccalibrate()
+{
+  int savebase, savetoom3, base, toom3, ok;
+
+  printf("testing bc_calibrate_mul\n");
+  savebase = mul_base_digits;
+  savetoom3 = mul_toom3_digits;
+  bc_calibrate_mul();
+  base = mul_base_digits;
+  toom3 = mul_toom3_digits;
+  mul_base_digits = savebase;
+  mul_toom3_digits = savetoom3;
+  ok = base >= 16 && toom3 >= base
+       && tc_bcmul(base/2 + 7, base/2 + 3, base, toom3)
+       && tc_bcmul(base, base/3 + 1, base, toom3);
+  /* beyond this, the schoolbook product takes too long */
+  if (toom3 <= 20000)
+    ok = ok && tc_bcmul(toom3/2 + 5, toom3/2 + 1, base, toom3)
+         && tc_bcmul(toom3, toom3/4, base, toom3);
+  return ok;
+}
+
+/* compares the truncated product with the one of the digit-by-digit
+   schoolbook product. The operands have <lg1> and <lg2> digits,
+   <scale1> and <scale2> of them after the decimal point, and are all
+   nines if <nines> is set, so the short product falls back to the full
+   one */
+static int tc_bcshortmul(int lg1, int scale1, int lg2, int scale2, int scale,
+                         int nines)
+{
+  char buf1[400];
+  char buf2[400];
+  bc_num n1, n2, p1, p2;
+  int savelimb, ok;
+
+  randomdigits(buf1, lg1);
+  randomdigits(buf2, lg2);
+  if (nines)
+  {
+    memset(buf1, '9', lg1);
+    memset(buf2, '9', lg2);
+  }
+  memmove(buf1 + lg1 - scale1 + 1, buf1 + lg1 - scale1, scale1 + 1);
+  buf1[lg1 - scale1] = '.';
+  memmove(buf2 + lg2 - scale2 + 1, buf2 + lg2 - scale2, scale2 + 1);
+  buf2[lg2 - scale2] = '.';
+  bc_init_num(&n1);
+  bc_init_num(&n2);
+  bc_init_num(&p1);
+  bc_init_num(&p2);
+  bc_str2num(&n1, buf1, scale1);
+  bc_str2num(&n2, buf2, scale2);
+  savelimb = mul_limb_digits;
+  mul_limb_digits = 100000;
+  bc_multiply(n1, n2, &p1, scale);
+  mul_limb_digits = savelimb;
+  bc_multiply(n1, n2, &p2, scale);
+  ok = bc_compare(p1, p2) == 0 && p1->n_scale == p2->n_scale
+       && p1->n_len == p2->n_len;
+  bc_free_num(&n1);
+  bc_free_num(&n2);
+  bc_free_num(&p1);
+  bc_free_num(&p2);
+  return ok;
+}
+
+static int test_bcshortmul()
+{
+  int lg1, lg2, scale;
+
+  printf("\ntesting short products\n");
+  for (lg1 = 12; lg1 <= 300; lg1 += 13)
+    for (lg2 = 12; lg2 <= 300; lg2 += 17)
+      for (scale = 0; scale < lg1 + lg2; scale += 9)
+        if (!tc_bcshortmul(lg1, lg1 - 1, lg2, lg2 - 1, scale, 0)
+            || !tc_bcshortmul(lg1, lg1 / 2, lg2, lg2 - 1, scale, 0)
+            || !tc_bcshortmul(lg1, lg1 - 1, lg2, lg2 - 1, scale, 1))
+        {
+          printf("mismatch for %d * %d digits, scale %d\n", lg1, lg2, scale);
+          return FALSE;
+        }
+  return TRUE;
+}
+
+static int test_bcascii()
+{
+  char chars[50];
+  char digits[50];
+  char back[50];
+  int lg, i;
+
+  printf("\ntesting bc_digits2ascii/bc_ascii2digits\n");
+  for (lg = 0; lg <= 40; ++lg)
+  {
+    randomdigits(chars, lg);
+    if (!bc_ascii2digits(digits, chars, lg))
+      return FALSE;
+    for (i = 0; i < lg; ++i)
+      if (digits[i] != chars[i] - '0')
+        return FALSE;
+    bc_digits2ascii(back, digits, lg);
+    if (memcmp(back, chars, lg) != 0)
+      return FALSE;
+    for (i = 0; i < lg; ++i)
+    {
+      chars[i] = i % 2 == 0? '0' - 1 : '9' + 1;
+      if (bc_ascii2digits(NULL, chars, lg) || bc_ascii2digits(digits, chars, lg))
+        return FALSE;
+      chars[i] = '5';
+    }
+  }
+  return TRUE;
+}
+
+static int test_bcallocstats()
+{
+  bc_alloc_stats st;
+  bc_num nums[20];
+  long live;
+  int i, save;
+
+  printf("\ntesting bc_num allocation statistics\n");
+  bc_trim_free_list();
+  save = bc_set_free_list_cap(5);
+  bc_reset_alloc_stats();
+  bc_get_alloc_stats(&st);
+  live = st.live;
+  if (st.allocations != 0 || st.free_list_length != 0 || st.peak_live != live)
+    return FALSE;
+  for (i = 0; i < 20; ++i)
+    nums[i] = bc_new_num(3, 2);
+  bc_get_alloc_stats(&st);
+  if (st.allocations != 20 || st.free_list_hits != 0
+      || st.live != live + 20 || st.peak_live != live + 20)
+    return FALSE;
+  for (i = 0; i < 20; ++i)
+    bc_free_num(&nums[i]);
+  bc_get_alloc_stats(&st);
+  if (st.live != live || st.free_list_length != 5 || st.peak_live != live + 20)
+    return FALSE;
+  nums[0] = bc_new_num(1, 0);
+  bc_get_alloc_stats(&st);
+  if (st.free_list_hits != 1 || st.free_list_length != 4)
+    return FALSE;
+  bc_free_num(&nums[0]);
+  bc_trim_free_list();
+  bc_get_alloc_stats(&st);
+  bc_set_free_list_cap(save);
+  return st.free_list_length == 0 && st.live == live;
+}
+
+static int test_bcdigitblocks()
+{
+  bc_alloc_stats st;
+  bc_num nums[4];
+  int i, save, ok;
+
+  printf("\ntesting bc_num digit blocks\n");
+  bc_trim_free_list();
+  save = bc_set_free_list_cap(2);
+  bc_reset_alloc_stats();
+  for (i = 0; i < 3; ++i)
+    nums[i] = bc_new_num(3, 2);
+  nums[3] = bc_new_num(300, 0);
+  for (i = 0; i < 4; ++i)
+    bc_free_num(&nums[i]);
+  bc_get_alloc_stats(&st);
+  /* the long number is not kept, and the cap holds */
+  if (st.block_hits != 0 || st.block_list_length != 2
+      || st.cached_bytes < 2 * 256)
+    return FALSE;
+  nums[0] = bc_new_num(40, 40);
+  bc_get_alloc_stats(&st);
+  if (st.block_hits != 1 || st.block_list_length != 1)
+    return FALSE;
+  /* reused digits start out cleared */
+  ok = bc_is_zero(nums[0]);
+  bc_free_num(&nums[0]);
+  bc_trim_free_list();
+  bc_get_alloc_stats(&st);
+  bc_set_free_list_cap(save);
+  return ok && st.block_list_length == 0 && st.cached_bytes == 0;
+}
+
+/* runs a chain of products and quotients inside nested arenas and checks
+   that the surviving result matches the one computed on the heap */
+static void _arenachain(bc_num a, bc_num b, bc_num *r)
+{
+  bc_num t;
+  int i;
+
+  bc_init_num(&t);
+  bc_multiply(a, b, r, 0);
+  for (i = 0; i < 20; ++i)
+  {
+    bc_multiply(*r, a, &t, 0);
+    bc_divide(t, b, r, 60);
+  }
+  bc_free_num(&t);
+}
+
+static int test_bcarena()
+{
+  char buf1[400];
+  char buf2[400];
+  bc_num a, b, inside, outside, other;
+  bc_alloc_stats st;
+  int ok;
+
+  printf("\ntesting bc_num arenas\n");
+  randomdigits(buf1, 120);
+  randomdigits(buf2, 90);
+  bc_init_num(&a);
+  bc_init_num(&b);
+  bc_init_num(&inside);
+  bc_init_num(&outside);
+  bc_init_num(&other);
+  bc_str2num(&a, buf1, 0);
+  bc_str2num(&b, buf2, 0);
+  _arenachain(a, b, &outside);
+  bc_reset_alloc_stats();
+  bc_arena_begin();
+  bc_arena_begin();
+  _arenachain(a, b, &inside);
+  bc_arena_end();
+  bc_get_alloc_stats(&st);
+  if (st.arena_survivors != 0 || st.arena_bytes == 0) return FALSE;
+  bc_arena_end();
+  bc_get_alloc_stats(&st);
+  if (st.arena_survivors == 0) return FALSE;
+  /* reuse the released space; <inside> must not be touched by this */
+  _arenachain(b, a, &other);
+  ok = bc_compare(inside, outside) == 0;
+  /* temporaries freed inside the arena are dead and must not be copied
+     out when it closes */
+  bc_free_num(&other);
+  bc_reset_alloc_stats();
+  bc_arena_begin();
+  _arenachain(b, a, &other);
+  bc_free_num(&other);
+  bc_arena_end();
+  bc_get_alloc_stats(&st);
+  ok = ok && st.arena_bytes != 0 && st.arena_survivors == 0;
+  bc_free_num(&a);
+  bc_free_num(&b);
+  bc_free_num(&inside);
+  bc_free_num(&outside);
+  return ok;
+}
+
+/* checks a + a = 2a and 3a - a = 2a on <lg> digit operands with
+   runs of nines, which make the vectorized digit kernels carry through
+   many positions */
+static int tc_bcaddsub(int lg, int nines)
+{
+  char buf[400];
+  bc_num a, m, r, two, three;
+  int i, ok;
+
+  randomdigits(buf, lg);
+  for (i = lg/3; i < lg && i < lg/3 + nines; ++i)
+    buf[i] = '9';
+  buf[lg] = 0;
+  a = m = r = two = three = NULL;
+  bc_str2num(&a, buf, 0);
+  bc_int2num(&two, 2);
+  bc_int2num(&three, 3);
+  bc_multiply(a, two, &m, 0);
+  bc_add(a, a, &r, 0);
+  ok = bc_compare(r, m) == 0;
+  bc_multiply(a, three, &r, 0);
+  bc_sub(r, a, &r, 0);
+  ok = ok && bc_compare(r, m) == 0;
+  bc_free_num(&a);
+  bc_free_num(&m);
+  bc_free_num(&r);
+  bc_free_num(&two);
+  bc_free_num(&three);
+  return ok;
+}
+
+static int test_bcaddsub()
+{
+  int lg, nines;
+
+  printf("\ntesting bc_add/bc_sub\n");
+  for (lg = 1; lg <= 300; lg += 3)
+    for (nines = 0; nines <= lg; nines += 1 + lg/8)
+      if (!tc_bcaddsub(lg, nines))
+      {
+        printf("mismatch for %d digits, %d nines\n", lg, nines);
+        return FALSE;
+      }
+  return TRUE;
+}
+
+/* compares the Newton division with the long division. <lg1> and
+   <lg2> are the operand lengths, <point1> and <point2> the positions of
+   their decimal points */
+static int tc_bcdiv(int lg1, int point1, int lg2, int point2, int scale)
+{
+  char buf1[400];
+  char buf2[400];
+  bc_num n1, n2, q1, q2;
+  int save, ok;
+
+  randomdigits(buf1 + 1, lg1);
+  randomdigits(buf2, lg2);
+  buf1[0] = '-';
+  memmove(buf1 + point1 + 2, buf1 + point1 + 1, lg1 - point1 + 1);
+  buf1[point1 + 1] = '.';
+  memmove(buf2 + point2 + 1, buf2 + point2, lg2 - point2 + 1);
+  buf2[point2] = '.';
+  bc_init_num(&n1);
+  bc_init_num(&n2);
+  bc_init_num(&q1);
+  bc_init_num(&q2);
+  bc_str2num(&n1, buf1, lg1);
+  bc_str2num(&n2, buf2, lg2);
+  save = div_newton_digits;
+  div_newton_digits = 100000;
+  bc_divide(n1, n2, &q1, scale);
+  div_newton_digits = 1;
+  bc_divide(n1, n2, &q2, scale);
+  div_newton_digits = save;
+  ok = bc_compare(q1, q2) == 0 && q1->n_scale == q2->n_scale
+       && q1->n_len == q2->n_len && q1->n_sign == q2->n_sign;
+  bc_free_num(&n1);
+  bc_free_num(&n2);
+  bc_free_num(&q1);
+  bc_free_num(&q2);
+  return ok;
+}
+
+static int test_bcdiv()
+{
+  int lg1, lg2, scale;
+
+  printf("\ntesting bc_divide\n");
+  for (lg1 = 2; lg1 <= 300; lg1 += 19)
+    for (lg2 = 2; lg2 <= 300; lg2 += 23)
+      for (scale = 0; scale <= 260; scale += 65)
+        if (!tc_bcdiv(lg1, lg1/2, lg2, 1, scale)
+            || !tc_bcdiv(lg1, 1, lg2, lg2 - 1, scale))
+        {
+          printf("mismatch for %d / %d digits, scale %d\n", lg1, lg2, scale);
+          return FALSE;
+        }
+  return TRUE;
+}
+
+/* checks r^2 <= x < (r + ulp)^2 for r = bc_sqrt(x) */
+static int tc_bcsqrt(int lg, int point, int scale)
+{
+  char buf[400];
+  bc_num x, r, ulp, sq;
+  int ok, rscale;
+
+  randomdigits(buf, lg);
+  memmove(buf + point + 1, buf + point, lg - point + 1);
+  buf[point] = '.';
+  bc_init_num(&x);
+  bc_init_num(&sq);
+  bc_str2num(&x, buf, lg);
+  r = bc_copy_num(x);
+  if (!bc_sqrt(&r, scale)) return bc_is_zero(x);
+  rscale = r->n_scale;
+  ulp = bc_new_num(1, rscale);
+  ulp->n_value[rscale] = 1;
+  bc_multiply(r, r, &sq, 2*rscale);
+  ok = bc_compare(sq, x) <= 0;
+  bc_add(r, ulp, &r, rscale);
+  bc_multiply(r, r, &sq, 2*rscale);
+  ok = ok && bc_compare(sq, x) > 0;
+  bc_free_num(&x);
+  bc_free_num(&r);
+  bc_free_num(&ulp);
+  bc_free_num(&sq);
+  return ok;
+}
+
+/* squares of random integers and their predecessors, where a root that
+   is off by one in the last digit shows immediately */
+static int tc_bcsqrtsquare(int lg)
+{
+  char buf[400];
+  bc_num k, x, r;
+  int ok;
+
+  randomdigits(buf, lg);
+  bc_init_num(&k);
+  bc_init_num(&x);
+  bc_str2num(&k, buf, 0);
+  if (bc_is_zero(k)) bc_add(k, _one_, &k, 0);
+  bc_multiply(k, k, &x, 0);
+  r = bc_copy_num(x);
+  bc_sqrt(&r, 0);
+  ok = bc_compare(r, k) == 0;
+  bc_sub(x, _one_, &x, 0);
+  bc_free_num(&r);
+  r = bc_copy_num(x);
+  bc_sqrt(&r, 0);
+  bc_sub(k, _one_, &k, 0);
+  ok = ok && bc_compare(r, k) == 0;
+  bc_free_num(&k);
+  bc_free_num(&x);
+  bc_free_num(&r);
+  return ok;
+}
+
+static int test_bcsqrt()
+{
+  int lg, scale;
+
+  printf("\ntesting bc_sqrt\n");
+  for (lg = 1; lg <= 300; lg += 13)
+    for (scale = 0; scale <= 260; scale += 37)
+      if (!tc_bcsqrt(lg, lg, scale) || !tc_bcsqrt(lg, 0, scale)
+          || !tc_bcsqrt(lg, lg/2, scale))
+      {
+        printf("bad root for %d digits, scale %d\n", lg, scale);
+        return FALSE;
+      }
+  for (lg = 1; lg <= 200; ++lg)
+    if (!tc_bcsqrtsquare(lg))
+    {
+      printf("bad root of a %d digit square\n", lg);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* compares bc_raisemod with a full power reduced by bc_modulo */
+static int tc_bcraisemod(int lgbase, int expo, int lgmod, int neg)
+{
+  char buf[400];
+  bc_num b, e, m, r1, r2;
+  int ok;
+
+  randomdigits(buf + 1, lgbase);
+  buf[0] = neg? '-' : '+';
+  bc_init_num(&b);
+  bc_init_num(&e);
+  bc_init_num(&m);
+  bc_init_num(&r1);
+  bc_init_num(&r2);
+  bc_str2num(&b, buf, 0);
+  randomdigits(buf, lgmod);
+  bc_str2num(&m, buf, 0);
+  if (bc_is_zero(m)) bc_add(m, _two_, &m, 0);
+  bc_int2num(&e, expo);
+  bc_raisemod(b, e, m, &r1, 0);
+  bc_raise(b, e, &r2, 0);
+  if (expo != 0) bc_modulo(r2, m, &r2, 0);
+  ok = bc_compare(r1, r2) == 0;
+  bc_free_num(&b);
+  bc_free_num(&e);
+  bc_free_num(&m);
+  bc_free_num(&r1);
+  bc_free_num(&r2);
+  return ok;
+}
+
+static int test_bcraisemod()
+{
+  bc_num p, pm1, b, r;
+  int lg, expo, ok;
+
+  printf("\ntesting bc_raisemod\n");
+  for (lg = 1; lg <= 40; lg += 3)
+    for (expo = 0; expo <= 120; expo += 7)
+      if (!tc_bcraisemod(lg, expo, lg, 0)
+          || !tc_bcraisemod(lg + 5, expo, lg, expo & 1)
+          || !tc_bcraisemod(lg, expo, 2*lg, 1))
+      {
+        printf("mismatch for %d digits, exponent %d\n", lg, expo);
+        return FALSE;
+      }
+  /* Fermat on the Mersenne prime 2^127-1, exercising the wide windows */
+  bc_init_num(&p);
+  bc_init_num(&pm1);
+  bc_init_num(&b);
+  bc_init_num(&r);
+  bc_str2num(&p, "170141183460469231731687303715884105727", 0);
+  bc_sub(p, _one_, &pm1, 0);
+  bc_str2num(&b, "123456789012345678901234567890", 0);
+  bc_raisemod(b, pm1, p, &r, 0);
+  ok = bc_compare(r, _one_) == 0;
+  bc_raisemod(b, p, p, &r, 0);
+  ok = ok && bc_compare(r, b) == 0;
+  bc_free_num(&p);
+  bc_free_num(&pm1);
+  bc_free_num(&b);
+  bc_free_num(&r);
+  return ok;
+}
+
 static int tc_div(char* msg, char* val1, char* val2, int digits, char* result)
 {
  floatstruct v1;
@@ -2371,6 +3097,9 @@ static int test_div()
   if(!tc_div("integer quotient, 4/3\n", "4", "0.3", INTQUOT, "1.3e1")) return FALSE;
   if(!tc_div("integer quotient, 1/3\n", "1", "0.3", INTQUOT, "3.e0")) return FALSE;
   if(!tc_div("integer quotient, 1/30\n", "1", "30", INTQUOT, "0")) return FALSE;
+  if(!tc_div("power of ten\n", "1.2345678", "-1e-3", 5, "-1.23456e3")) return FALSE;
+  if(!tc_div("integer quotient, power of ten\n", "12345", "1e2", INTQUOT, "1.23e2")) return FALSE;
+  if(!tc_div("power of ten, overflow\n", maxexp(nmb, "4.e"), "1e-1", 5, "NaN")) return FALSE;
   if(!tc_div("almost overflow\n", maxexp(nmb, "1.e"), "0.3", 5, maxexp(nmb2, "3.3333e"))) return FALSE;
   if(!tc_div("overflow\n", maxexp(nmb, "4.e"), "0.3", 5, "NaN")) return FALSE;
   if(!tc_div("big overflow\n", maxexp(nmb, "4.e"), minexp(nmb2, "1.e"), 5, "NaN")) return FALSE;
@@ -2433,6 +3162,48 @@ static int test_sqrt()
   return TRUE;
 }
 
+static int tc_hypot(char* msg, char* val1, char* val2, int digits, char* result)
+{
+  floatstruct v1, v2;
+  int lg;
+  char buf[30];
+
+  printf("%s", msg);
+  float_create(&v1);
+  float_create(&v2);
+  float_setscientific(&v1, val1, NULLTERMINATED);
+  float_setscientific(&v2, val2, NULLTERMINATED);
+  float_hypot(&v1, &v1, &v2, digits);
+  float_round(&v1, &v1, digits - 1, TONEAREST);
+  float_getscientific(buf, 30, &v1);
+  float_free(&v1);
+  float_free(&v2);
+  lg = strlen(result);
+  return strlen(buf) == lg && memcmp(buf, result, lg) == 0? TRUE : FALSE;
+}
+
+static int test_hypot()
+{
+  char nmb[30];
+  char nmb2[30];
+  char nmb3[30];
+
+  printf("\ntesting float_hypot\n");
+
+  if (!tc_hypot("invalid length\n", "3", "4", 0, "NaN")) return FALSE;
+  if (!tc_hypot("NaN\n", "NaN", "1", 5, "NaN")) return FALSE;
+  if (!tc_hypot("0, 0\n", "0", "0", 5, "0")) return FALSE;
+  if (!tc_hypot("0, -2\n", "0", "-2", 5, "2.e0")) return FALSE;
+  if (!tc_hypot("3, -4\n", "3", "-4", 5, "5.e0")) return FALSE;
+  if (!tc_hypot("-0.03, 0.04\n", "-0.03", "0.04", 5, "5.e-2")) return FALSE;
+  if (!tc_hypot("1, 1\n", "1", "1", 5, "1.414e0")) return FALSE;
+  if (!tc_hypot("tiny second\n", "2", "1e-20", 5, "2.e0")) return FALSE;
+  if (!tc_hypot("large squares\n", maxexp(nmb, "3.e"), maxexp(nmb2, "4.e"), 5, maxexp(nmb3, "5.e"))) return FALSE;
+  if (!tc_hypot("small squares\n", minexp(nmb, "4.e"), minexp(nmb2, "3.e"), 5, minexp(nmb3, "5.e"))) return FALSE;
+  if (!tc_hypot("overflow\n", maxexp(nmb, "8.e"), maxexp(nmb2, "8.e"), 5, "NaN")) return FALSE;
+  return TRUE;
+}
+
 static int tc_int(char* msg, char* value, char* result)
 {
   floatstruct f;
@@ -2612,6 +3383,58 @@ static int test_divmod()
   return TRUE;
 }
 
+static int tc_raisemod(char* msg, char* base, char* expo, char* mod, char* result)
+{
+  int ok;
+  floatstruct b;
+  floatstruct e;
+  floatstruct m;
+  floatstruct r;
+
+  printf("%s", msg);
+  float_create(&b);
+  float_create(&e);
+  float_create(&m);
+  float_create(&r);
+  float_setscientific(&b, base, NULLTERMINATED);
+  float_setscientific(&e, expo, NULLTERMINATED);
+  float_setscientific(&m, mod, NULLTERMINATED);
+  float_setscientific(&r, "-1.821923", NULLTERMINATED);
+  float_raisemod(&r, &b, &e, &m);
+  ok = scmp(&r, result);
+  float_raisemod(&b, &b, &e, &m);
+  ok = ok && scmp(&b, result);
+  float_free(&b);
+  float_free(&e);
+  float_free(&m);
+  float_free(&r);
+  return ok;
+}
+
+static int test_raisemod()
+{
+  printf("\ntesting float_raisemod\n");
+  if (!tc_raisemod("NaN base\n", "NaN", "2", "7", "NaN")) return FALSE;
+  if (!tc_raisemod("NaN exponent\n", "2", "NaN", "7", "NaN")) return FALSE;
+  if (!tc_raisemod("NaN modulus\n", "2", "2", "NaN", "NaN")) return FALSE;
+  if (!tc_raisemod("non-integer base\n", "1.5", "2", "7", "NaN")) return FALSE;
+  if (!tc_raisemod("non-integer exponent\n", "2", "2.5", "7", "NaN")) return FALSE;
+  if (!tc_raisemod("negative exponent\n", "2", "-1", "7", "NaN")) return FALSE;
+  if (!tc_raisemod("zero modulus\n", "2", "3", "0", "NaN")) return FALSE;
+  if (!tc_raisemod("modulus too long\n", "2", "3", "1e20", "NaN")) return FALSE;
+  if (!tc_raisemod("exponent 0\n", "2", "0", "7", "1.e0")) return FALSE;
+  if (!tc_raisemod("base 0\n", "0", "5", "7", "0")) return FALSE;
+  if (!tc_raisemod("modulus 1\n", "3", "5", "1", "0")) return FALSE;
+  if (!tc_raisemod("4^13 mod 497\n", "4", "13", "497", "4.45e2")) return FALSE;
+  if (!tc_raisemod("-4^13 mod 497\n", "-4", "13", "497", "-4.45e2")) return FALSE;
+  if (!tc_raisemod("-4^12 mod -497\n", "-4", "12", "-497", "4.84e2")) return FALSE;
+  if (!tc_raisemod("huge exponent\n", "123456789", "1e10", "1000000007",
+                   "1.82981676e8")) return FALSE;
+  if (!tc_raisemod("trailing zeros\n", "2", "100000000000000", "999999999999",
+                   "9.6932702428e10")) return FALSE;
+  return TRUE;
+}
+
 static void _relerror(floatnum x1, floatnum x2)
 {
   float_sub(x1, x1, x2, 3);
@@ -2942,6 +3765,78 @@ static int test_cosminus1near0()
   return 1;
 }
 
+/* the binary splitting path (digits >= SERIESSPLITDIGITS) against the
+   term by term summation */
+static int test_seriessplit()
+{
+  floatstruct x, x1;
+  int i, alternating;
+  char ok;
+  const char* args[] = {"0.0073423498723498273498723984723984723987"
+                        "2398472398472938472938742398472938472938",
+                        "-0.0099999999999999999999999999999999999999"
+                        "9999999999999999999999999999999999999999",
+                        "0.00000012345678912345678912345678912345678"
+                        "912345678912345678912345678912345678912345",
+                        "-0.041230000000000000000000001"};
+
+  printf("%s\n", "testing binary splitting of series");
+  float_create(&x);
+  float_create(&x1);
+  ok = 1;
+  for (i = -1; ok && ++i < 4;)
+    for (alternating = 0; ok && alternating < 2; ++alternating)
+    {
+      float_setasciiz(&x, args[i]);
+      float_copy(&x1, &x, EXACT);
+      arctanseries(&x, SERIESSPLITDIGITS - 5, alternating);
+      arctanseries(&x1, 120, alternating);
+      ok = _cmprelerror(&x, &x1, 7 - SERIESSPLITDIGITS);
+      float_setasciiz(&x, args[i]);
+      float_copy(&x1, &x, EXACT);
+      cosminus1series(&x, SERIESSPLITDIGITS - 5, alternating);
+      cosminus1series(&x1, 2*SERIESSPLITDIGITS + 10, alternating);
+      ok = ok && _cmprelerror(&x, &x1, 7 - SERIESSPLITDIGITS);
+    }
+  float_free(&x);
+  float_free(&x1);
+  return ok;
+}
+
+static int test_lnagm()
+{
+  floatstruct x, x1;
+  int i;
+  char ok;
+  const char* lnargs[] = {"2.7324031556", "0.5", "1.0000000000000000000001234",
+                          "1.2345678e47", "3.3e-1000"};
+  const char* expargs[] = {"0.7324031556", "2.2", "-45.6", "0.0123"};
+
+  printf("%s\n", "testing the AGM logarithm and the Newton exp");
+  float_create(&x);
+  float_create(&x1);
+  ok = 1;
+  for (i = -1; ok && ++i < 5;)
+  {
+    float_setasciiz(&x, lnargs[i]);
+    float_copy(&x1, &x, EXACT);
+    _ln(&x, LNAGMDIGITS - 5);
+    _ln(&x1, 120);
+    ok = _cmprelerror(&x, &x1, 7 - LNAGMDIGITS);
+  }
+  for (i = -1; ok && ++i < 4;)
+  {
+    float_setasciiz(&x, expargs[i]);
+    float_copy(&x1, &x, EXACT);
+    _exp(&x, EXPNEWTONDIGITS - 5);
+    _exp(&x1, 120);
+    ok = _cmprelerror(&x, &x1, 7 - EXPNEWTONDIGITS);
+  }
+  float_free(&x);
+  float_free(&x1);
+  return ok;
+}
+
 static int test_lnxplus1near0()
 {
   floatstruct x, x1, tmp, max;
@@ -5119,6 +6014,90 @@ static int test_cos()
   return 1;
 }
 
+static int tc_trigreduce(const char* x, const char* result)
+{
+  floatstruct tmp, r;
+  int ok;
+
+  float_create(&tmp);
+  float_create(&r);
+  float_setasciiz(&tmp, x);
+  float_setasciiz(&r, result);
+  ok = _trigreduce(&tmp, 100) && float_abscmp(&tmp, &cPi) <= 0;
+  if (ok)
+  {
+    _sin(&tmp, 100);
+    ok = _cmprelerror(&tmp, &r, -98);
+  }
+  float_free(&tmp);
+  float_free(&r);
+  return ok;
+}
+
+static int test_trigreduce()
+{
+  printf("%s\n", "testing _trigreduce");
+  return tc_trigreduce("3", "0.14112000805986722210074480280811027984693326425226"
+                            "5584151882641232422009967014471911282172853449863750")
+         && tc_trigreduce("-7", "-0.6569865987187890903969990915936351779368700104974"
+                                "90074657854334189292837131227031509935121601055212681")
+         /* near a multiple of pi */
+         && tc_trigreduce("245850922","6.1180653830011163142712109859873769427269562116969"
+                                      "4224216787321131950601589348552076243757225534067692938e-9")
+         && tc_trigreduce("1e60", "8.3038976521934266466406178542132875664117585146307"
+                                  "14107870333486144359807597155413375882569940853155815e-1")
+         && tc_trigreduce("-123456789012345678901234567890.123",
+                          "-9.2420402933701629848574600038392258817873076862041"
+                          "25258573326599766061691400300626877887668042165015035e-1");
+}
+
+static int test_sincos()
+{
+  floatstruct x, c, s1, c1x;
+  int i, ok;
+  const char* args[] = {"0", "1e-60", "-0.3", "0.7853981", "0.7853982",
+                        "1.5", "-2.9", "3.1415926535", "12.345", "123.5",
+                        "25"};
+
+  printf("%s\n", "testing float_sincos and float_sinhcosh");
+  float_create(&x);
+  float_create(&c);
+  float_create(&s1);
+  float_create(&c1x);
+  ok = 1;
+  for (i = -1; ok && ++i < (int)(sizeof(args)/sizeof(args[0]));)
+  {
+    float_setasciiz(&x, args[i]);
+    float_copy(&s1, &x, EXACT);
+    float_copy(&c1x, &x, EXACT);
+    ok = float_sincos(&x, &c, 100) && float_sin(&s1, 100)
+         && float_cos(&c1x, 100)
+         && (float_iszero(&s1)? float_iszero(&x) : _cmprelerror(&x, &s1, -98))
+         && _cmprelerror(&c, &c1x, -98);
+    if (!ok)
+      break;
+    float_setasciiz(&x, args[i]);
+    float_copy(&s1, &x, EXACT);
+    float_copy(&c1x, &x, EXACT);
+    ok = float_sinhcosh(&x, &c, 100) && float_sinh(&s1, 100)
+         && float_cosh(&c1x, 100)
+         && (float_iszero(&s1)? float_iszero(&x) : _cmprelerror(&x, &s1, -98))
+         && _cmprelerror(&c, &c1x, -98);
+  }
+  /* errors propagate to both results */
+  float_setnan(&x);
+  ok = ok && !float_sincos(&x, &c, 100) && float_isnan(&c)
+       && !float_sinhcosh(&x, &c, 100) && float_isnan(&c);
+  float_setasciiz(&x, "1e200");
+  ok = ok && !float_sinhcosh(&x, &c, 100) && float_isnan(&c);
+  float_geterror();
+  float_free(&x);
+  float_free(&c);
+  float_free(&s1);
+  float_free(&c1x);
+  return ok;
+}
+
 static int test_sin()
 {
   floatstruct x, tmp, max, step, ofs;
@@ -5316,6 +6295,40 @@ static int test_longint2floatnum()
   return 1;
 }
 
+/* converts random integers of up to DECPRECISION digits to a longint and
+   back, covering the divide and conquer paths of both directions */
+static int test_longintroundtrip()
+{
+  floatstruct x, y;
+  t_longint l;
+  char buf[DECPRECISION + 1];
+  int lg, i;
+
+  printf("testing longint round trip\n");
+  float_create(&x);
+  float_create(&y);
+  for (lg = 1; lg <= DECPRECISION; ++lg)
+    for (i = 0; i < 3; ++i)
+    {
+      randomdigits(buf, lg);
+      buf[0] = '1' + (buf[0] - '0') % 9;
+      if (i == 2)
+        memset(buf + lg / 3, '0', lg / 3);
+      float_setasciiz(&x, buf);
+      if (_floatnum2longint(&l, &x) != Success)
+        return 0;
+      _longint2floatnum(&y, &l);
+      if (float_cmp(&x, &y) != 0)
+      {
+        printf("round trip FAILED for %s\n", buf);
+        return 0;
+      }
+    }
+  float_free(&x);
+  float_free(&y);
+  return 1;
+}
+
 static int tc_raiseposi(char* base, unsigned exponent)
 {
   floatstruct x, y;
@@ -5504,6 +6517,40 @@ static int test_binetasymptotic()
   return 1;
 }
 
+static int tc_binetcoef(int i, const char* value)
+{
+  floatstruct x, y;
+  int ok;
+
+  float_create(&x);
+  float_create(&y);
+  floatmath_binetcoef(&x, i, 50);
+  float_setasciiz(&y, value);
+  ok = _cmprelerror(&x, &y, -48);
+  float_free(&x);
+  float_free(&y);
+  return ok;
+}
+
+static int test_binetcoef()
+{
+  floatstruct x;
+  int ok;
+
+  printf("testing the Binet series coefficients\n");
+  /* below and beyond the end of the Bernoulli table */
+  ok = tc_binetcoef(5, "8.4175084175084175084175084175084175084175084175084175e-4")
+    && tc_binetcoef(68, "-1.11702455808627934856913604180735378466539197660135272e120")
+    && tc_binetcoef(69, "5.19488169257332471742161057876322442830275351691125077e122")
+    && tc_binetcoef(80, "-7.24753284278060916968875890472829618220967096160977212e152");
+  /* beyond the table, the coefficients let Gamma reach full precision */
+  float_create(&x);
+  float_setasciiz(&x, "0.5");
+  ok = ok && _gamma(&x, 128) && _cmprelerror(&x, &cSqrtPi, -125);
+  float_free(&x);
+  return ok;
+}
+
 static int tc_pochhammer(char* x, char* n, char* result)
 {
   floatstruct fx, fn, fr;
@@ -6526,7 +7573,7 @@ static int test_erfcasymptotic()
 
 static int test_erfcsum()
 {
-  floatstruct x, x1, tmp, max;
+  floatstruct x, x1, tmp, max, alpha;
   int i, prec;
   char  buf[50];
 
@@ -6537,6 +7584,7 @@ static int test_erfcsum()
   float_create(&x1);
   float_create(&tmp);
   float_create(&max);
+  float_create(&alpha);
   printf("testing erfcsum\n");
 
   printf("testing error limit:\n");
@@ -6559,7 +7607,7 @@ static int test_erfcsum()
       float_add(&x, &x, &c1Div2, EXACT);
       _sub_ulp(&x, 101);
       float_copy(&x1, &x, EXACT);
-      if (!erfcsum(&x1, prec+1) || !erfcsum(&x, prec))
+      if (!erfcsum(&x1, &alpha, prec+1) || !erfcsum(&x, &alpha, prec))
       {
         printf("no convergence test case %d, prec %d: ", i, prec);
         return 0;
@@ -6586,11 +7634,11 @@ static int test_erfcsum()
   float_setasciiz(&tmp, "20");
   float_divi(&tmp, &tmp, 7, 110);
   float_mul(&x, &tmp, &tmp, 110);
-  erfcsum(&x, 100);
+  erfcsum(&x, &alpha, 100);
   /* we cannot know the free parameter alpha earlier, as it might be changed
   during the last series evaluation */
   float_mul(&x1, &tmp, &c2Pi, 110);
-  float_div(&x1, &x1, &erfcalpha, 110);
+  float_div(&x1, &x1, &alpha, 110);
   _exp(&x1, 110);
   float_sub(&x1, &c1, &x1, 110);
   float_div(&x1, &c2, &x1, 110);
@@ -6600,7 +7648,7 @@ static int test_erfcsum()
                        "623370565496031160355771016945224924345871");
   float_sub(&x1, &max, &x1, 110);
   float_div(&x1, &x1, &tmp, 110);
-  float_div(&x1, &x1, &erfcalpha, 110);
+  float_div(&x1, &x1, &alpha, 110);
   float_mul(&x1, &x1, &cPi, 110);
   float_mul(&max, &tmp, &tmp, 110);
   float_copy(&tmp, &max, EXACT);
@@ -6620,6 +7668,7 @@ static int test_erfcsum()
   float_free(&x1);
   float_free(&tmp);
   float_free(&max);
+  float_free(&alpha);
   return 1;
 }
 
@@ -6693,7 +7742,7 @@ static int test_erfc()
   {
     printf("%d\n", prec);
     /* clear all cached coefficients */
-    erfcdigits = 0;
+    floatmath_clearerfc();
     for (i = 0; ++i < 100;)
     {
       float_setinteger(&x, 1);
@@ -6812,6 +7861,346 @@ static int test_erf()
   return 1;
 }
 
+static int test_lazyconst()
+{
+  floatstruct x;
+  int i, ok;
+
+  printf("\ntesting lazy constants\n");
+  /* floatmath_init builds only the small integers */
+  if (float_isnan(&c12) || float_isnan(&cUnsignedBound)
+      || !float_isnan(&cLn2) || !float_isnan(&cPi)
+      || !float_isnan(&cBernoulliNum[0]))
+    return FALSE;
+  float_create(&x);
+  float_setasciiz(&x, "0.5");
+  _sin(&x, 30);
+  /* the Bernoulli numbers are still absent */
+  ok = !float_isnan(&cPiDiv2) && float_isnan(&cBernoulliDen[5])
+       && float_isnan(&cLn10) && float_geterror() == Success;
+  float_setasciiz(&x, "0.5");
+  _ln(&x, 30);
+  ok = ok && !float_isnan(&cLn10) && !float_isnan(&cPhi);
+  float_setasciiz(&x, "1000");
+  ok = ok && binetasymptotic(&x, 30) && !float_isnan(&cBernoulliNum[67]);
+  /* the precision of the first caller must not limit the constants */
+  ok = ok && float_getlength(&cPi) > 100 && float_getlength(&cLn2) > 100;
+  floatmath_warmup();
+  for (i = -1; ok && ++i < MAXBERNOULLIIDX;)
+    ok = !float_isnan(&cBernoulliNum[i]) && !float_isnan(&cBernoulliDen[i]);
+  ok = ok && !float_isnan(&c2DivSqrtPi) && !float_isnan(&cExp);
+  float_free(&x);
+  return ok;
+}
+
+static int tc_constcalc(constid which, const char* tail)
+{
+  bc_num n;
+  char* s;
+  int ok;
+
+  n = floatconst_bcvalue(which, 1000);
+  s = bc_num2str(n);
+  ok = strlen(s) > 1000 && strcmp(s + strlen(s) - 30, tail) == 0;
+  free(s);
+  bc_free_num(&n);
+  return ok;
+}
+
+static int tc_constvalue(constid which, floatnum table)
+{
+  floatstruct x;
+  int ok;
+
+  float_create(&x);
+  ok = floatconst_value(&x, which, 125)
+       && _cmprelerror(&x, table, -122);
+  float_free(&x);
+  return ok;
+}
+
+static int test_constcalc()
+{
+  bc_num n;
+  char* s;
+  floatstruct x;
+  int ok;
+
+  printf("\ntesting the constant engine\n");
+  /* last 30 of 1000 decimals */
+  if (!tc_constcalc(CONST_PI, "130019278766111959092164201989")
+      || !tc_constcalc(CONST_E, "873969655212671546889570350354")
+      || !tc_constcalc(CONST_LN2, "053401649256872747782344535347")
+      || !tc_constcalc(CONST_LN10, "287286965110862571492198849978")
+      || !tc_constcalc(CONST_PHI, "267575605231727775203536139362")
+      || !tc_constcalc(CONST_1DIVSQRTPI, "189719088968075314951201474552")
+      || !tc_constcalc(CONST_LNSQRT2PIMINUSHALF,
+                       "956619027007441304791141399988"))
+    return FALSE;
+  /* served from the cache */
+  n = floatconst_bcvalue(CONST_PI, 20);
+  s = bc_num2str(n);
+  ok = strcmp(s, "3.14159265358979323846") == 0;
+  free(s);
+  bc_free_num(&n);
+  if (!ok)
+    return FALSE;
+  floatmath_warmup();
+  if (!tc_constvalue(CONST_PI, &cPi)
+      || !tc_constvalue(CONST_PIDIV2, &cPiDiv2)
+      || !tc_constvalue(CONST_1DIVPI, &c1DivPi)
+      || !tc_constvalue(CONST_2DIVSQRTPI, &c2DivSqrtPi)
+      || !tc_constvalue(CONST_LNSQRT2PIMINUSHALF, &cLnSqrt2PiMinusHalf)
+      || !tc_constvalue(CONST_E, &cExp)
+      || !tc_constvalue(CONST_PHI, &cPhi)
+      || !tc_constvalue(CONST_LN2, &cLn2)
+      || !tc_constvalue(CONST_LN3, &cLn3)
+      || !tc_constvalue(CONST_LN7, &cLn7)
+      || !tc_constvalue(CONST_LN10, &cLn10))
+    return FALSE;
+  float_create(&x);
+  ok = !floatconst_value(&x, CONST_PI, 0)
+       && float_geterror() == InvalidPrecision
+       && !floatconst_value(&x, CONST_PI, maxdigits + 1)
+       && float_isnan(&x);
+  float_geterror();
+  float_free(&x);
+  floatconst_clearcache();
+  return ok;
+}
+
+#ifndef _WIN32
+/* runs in a thread of its own, which must see the default state,
+   whatever the main thread has set */
+static void* _contextthread(void* arg)
+{
+  int* ok;
+
+  ok = (int*)arg;
+  *ok = maxdigits == MAXDIGITS && float_getrange() == EXPMAX
+        && float_geterror() == Success;
+  float_setprecision(10);
+  float_seterror(Overflow);
+  return NULL;
+}
+#endif
+
+static int test_context()
+{
+  floatcontext ctx, tmp;
+  int ok, save;
+
+  printf("\ntesting the evaluation context\n");
+  /* the tests run above MAXDIGITS, which float_setcontext refuses */
+  save = maxdigits;
+  maxdigits = 100;
+  float_geterror();
+  float_getcontext(&ctx);
+  ok = ctx.maxdigits == maxdigits && ctx.maxexp == float_getrange()
+       && ctx.error == Success;
+  tmp.maxdigits = MAXDIGITS + 1;
+  tmp.maxexp = 100;
+  tmp.error = ZeroDivide;
+  float_setcontext(&tmp);
+  ok = ok && maxdigits == MAXDIGITS && float_getrange() == 100
+       && !float_isvalidexp(-102) && float_isvalidexp(-101);
+#ifndef _WIN32
+  {
+    pthread_t thread;
+    int threadok;
+
+    threadok = 0;
+    ok = ok && pthread_create(&thread, NULL, _contextthread, &threadok) == 0
+         && pthread_join(thread, NULL) == 0 && threadok;
+  }
+  /* the other thread did not touch our state */
+  ok = ok && maxdigits == MAXDIGITS;
+#endif
+  ok = ok && float_geterror() == ZeroDivide;
+  float_setcontext(&ctx);
+  ok = ok && maxdigits == 100 && float_getrange() == ctx.maxexp;
+  maxdigits = save;
+  return ok;
+}
+
+#ifndef _WIN32
+#define SHAREDCONSTRUNS 20000
+
+/* what a thread of test_sharedconst computes, and what it must get */
+typedef struct {
+  int digits;
+  floatstruct x;
+  floatstruct product;
+  floatstruct quotient;
+  floatstruct difference;
+  floatstruct copy;
+  int ok;
+} sharedconstjob;
+
+static int _sharedconstcompute(
+  sharedconstjob* job,
+  floatnum product,
+  floatnum quotient,
+  floatnum difference,
+  floatnum copy)
+{
+  bc_num n;
+
+  /* takes and releases references to _zero_ on the way */
+  bc_init_num(&n);
+  bc_free_num(&n);
+  return float_mul(product, &job->x, &cPi, job->digits)
+         && float_div(quotient, &cPi, &job->x, job->digits)
+         && float_sub(difference, &job->x, &cPi, job->digits)
+         && float_copy(copy, &cPi, job->digits);
+}
+
+static void* _sharedconstthread(void* arg)
+{
+  sharedconstjob* job;
+  floatstruct product, quotient, difference, copy;
+  int i;
+
+  job = (sharedconstjob*)arg;
+  float_create(&product);
+  float_create(&quotient);
+  float_create(&difference);
+  float_create(&copy);
+  job->ok = 1;
+  for (i = 0; job->ok && i < SHAREDCONSTRUNS; ++i)
+    job->ok = _sharedconstcompute(job, &product, &quotient, &difference, &copy)
+              && float_cmp(&product, &job->product) == 0
+              && float_cmp(&quotient, &job->quotient) == 0
+              && float_cmp(&difference, &job->difference) == 0
+              && float_cmp(&copy, &job->copy) == 0;
+  float_free(&product);
+  float_free(&quotient);
+  float_free(&difference);
+  float_free(&copy);
+  return NULL;
+}
+#endif
+
+/* two threads working with cPi at different precisions must neither see
+   each other's rounding nor change cPi */
+static int test_sharedconst()
+{
+  int ok = 1;
+#ifndef _WIN32
+  sharedconstjob jobs[2];
+  pthread_t threads[2];
+  floatstruct pi;
+  int i, started;
+
+  printf("testing shared constants on two threads\n");
+  floatmath_needpi();
+  float_create(&pi);
+  float_copy(&pi, &cPi, EXACT);
+  jobs[0].digits = 3;
+  jobs[1].digits = 90;
+  for (i = 0; i < 2; ++i)
+  {
+    float_create(&jobs[i].x);
+    float_create(&jobs[i].product);
+    float_create(&jobs[i].quotient);
+    float_create(&jobs[i].difference);
+    float_create(&jobs[i].copy);
+    float_setinteger(&jobs[i].x, 7);
+    ok = ok && _sharedconstcompute(&jobs[i], &jobs[i].product,
+                                   &jobs[i].quotient, &jobs[i].difference,
+                                   &jobs[i].copy);
+  }
+  for (started = 0; ok && started < 2; ++started)
+    ok = pthread_create(&threads[started], NULL, _sharedconstthread,
+                        &jobs[started]) == 0;
+  for (i = 0; i < started; ++i)
+    ok = pthread_join(threads[i], NULL) == 0 && ok && jobs[i].ok;
+  ok = ok && float_cmp(&pi, &cPi) == 0
+       && float_getlength(&pi) == float_getlength(&cPi)
+       && bc_is_zero(_zero_);
+  for (i = 0; i < 2; ++i)
+  {
+    float_free(&jobs[i].x);
+    float_free(&jobs[i].product);
+    float_free(&jobs[i].quotient);
+    float_free(&jobs[i].difference);
+    float_free(&jobs[i].copy);
+  }
+  float_free(&pi);
+#endif
+  return ok;
+}
+
+static int _cancelnow(void* data)
+{
+  ++*(int*)data;
+  return 1;
+}
+
+static int test_cancel()
+{
+  floatstruct x, n;
+  int calls, ok;
+
+  printf("\ntesting cancellation\n");
+  float_create(&x);
+  float_create(&n);
+  float_geterror();
+  calls = 0;
+  float_setcancelcheck(_cancelnow, &calls);
+  float_setinteger(&x, 3);
+  float_setinteger(&n, 40);
+  ok = !float_pochhammer(&x, &n, 20) && float_geterror() == TooExpensive
+       && calls > 0;
+  float_setcancelcheck(NULL, NULL);
+  ok = ok && !float_cancelled() && float_geterror() == Success;
+  float_setinteger(&x, 3);
+  ok = ok && float_pochhammer(&x, &n, 20) && float_geterror() == Success;
+  float_free(&n);
+  float_free(&x);
+  return ok;
+}
+
+static int test_budget()
+{
+  floatstruct x, y[4];
+  int i, ok;
+
+  printf("\ntesting budgets\n");
+  float_create(&x);
+  float_geterror();
+  float_setinteger(&x, 3);
+  float_reciprocal(&x, 20);
+  float_setbudget(3 * 20 * 20, 0);
+  ok = float_mul(&x, &x, &x, 20) && float_mul(&x, &x, &x, 20)
+       && float_mul(&x, &x, &x, 20) && float_workdone() == 3 * 20 * 20
+       && float_geterror() == Success;
+  ok = ok && !float_mul(&x, &x, &x, 20) && float_isnan(&x)
+       && float_geterror() == TooExpensive;
+  ok = ok && float_cancelled() && float_geterror() == TooExpensive;
+  float_setinteger(&x, 7);
+  ok = ok && !float_div(&x, &x, &x, 20) && float_geterror() == TooExpensive;
+  float_setbudget(0, 3);
+  ok = ok && float_workdone() == 0 && !float_cancelled();
+  for (i = 0; i < 4; ++i)
+  {
+    float_create(&y[i]);
+    float_setinteger(&y[i], i + 2);
+  }
+  float_setinteger(&x, 7);
+  ok = ok && !float_mul(&x, &x, &y[3], 20) && float_geterror() == TooExpensive;
+  for (i = 0; i < 4; ++i)
+    float_free(&y[i]);
+  float_setinteger(&x, 7);
+  ok = ok && float_mul(&x, &x, &x, 20) && float_geterror() == Success;
+  float_setbudget(0, 0);
+  float_setinteger(&x, 7);
+  ok = ok && float_mul(&x, &x, &x, EXACT) && float_workdone() == 0
+       && !float_cancelled() && float_geterror() == Success;
+  float_free(&x);
+  return ok;
+}
+
 static int testfailed(char* msg)
 {
   printf("\n%s FAILED, tests aborted\n", msg);
@@ -6831,6 +8220,13 @@ int main(int argc, char* argv[])
   float_stdconvert();
   maxdigits = 150;
 
+  if(!test_lazyconst()) return testfailed("floatmath_needpi");
+  if(!test_constcalc()) return testfailed("floatconst_value");
+  if(!test_context()) return testfailed("float_setcontext");
+  if(!test_sharedconst()) return testfailed("shared constants");
+  if(!test_cancel()) return testfailed("float_setcancelcheck");
+  if(!test_budget()) return testfailed("float_setbudget");
+
   if(!test_longadd()) return testfailed("_longadd");
   if(!test_longmul()) return testfailed("_longmul");
   if(!test_longshr()) return testfailed("_longshr");
@@ -6868,20 +8264,36 @@ int main(int argc, char* argv[])
   if(!test_cmp()) return testfailed("float_cmp");
   if(!test_copy()) return testfailed("float_copy");
   if(!test_move()) return testfailed("float_move");
+  if(!test_shrink()) return testfailed("float_shrink");
   if(!test_round()) return testfailed("float_round");
   if(!test_add()) return testfailed("float_add");
   if(!test_sub()) return testfailed("float_sub");
+  if(!test_bcaddsub()) return testfailed("bc_add/bc_sub");
   if(!test_mul()) return testfailed("float_mul");
+  if(!test_muladd()) return testfailed("float_muladd");
+  if(!test_bcmul()) return testfailed("bc_multiply");
+  if(!test_bccalibrate()) return testfailed("bc_calibrate_mul");
+  if(!test_bcshortmul()) return testfailed("bc_multiply (short)");
+  if(!test_bcascii()) return testfailed("bc_ascii2digits");
+  if(!test_bcallocstats()) return testfailed("bc_get_alloc_stats");
+  if(!test_bcdigitblocks()) return testfailed("bc_new_num digit blocks");
+  if(!test_bcarena()) return testfailed("bc_arena_begin");
   if(!test_div()) return testfailed("float_div");
+  if(!test_bcdiv()) return testfailed("bc_divide");
+  if(!test_bcraisemod()) return testfailed("bc_raisemod");
   if(!test_sqrt()) return testfailed("float_sqrt");
+  if(!test_hypot()) return testfailed("float_hypot");
+  if(!test_bcsqrt()) return testfailed("bc_sqrt");
   if(!test_int()) return testfailed("float_int");
   if(!test_frac()) return testfailed("float_frac");
   if(!test_divmod()) return testfailed("float_divmod");
+  if(!test_raisemod()) return testfailed("float_raisemod");
   printf("\nall floatnum tests PASSED\n\n");
   maxdigits = scalesave;
 
   if(!test_floatnum2longint()) return testfailed("_floatnum2longint");
   if(!test_longint2floatnum()) return testfailed("_longint2floatnum");
+  if(!test_longintroundtrip()) return testfailed("longint round trip");
   if(!test_out()) return testfailed("float_out");
   if(!test_in()) return testfailed("float_in");
 
@@ -6900,6 +8312,8 @@ int main(int argc, char* argv[])
   if(!test_artanhnear0()) return testfailed("artanhnear0");
   if(!test_cosminus1near0()) return testfailed("cosminus1near0");
   if(!test_arctannear0()) return testfailed("arctannear0");
+  if(!test_seriessplit()) return testfailed("arctanseries");
+  if(!test_lnagm()) return testfailed("_lnagm");
   if(!test_lnxplus1near0()) return testfailed("_lnxplus1near0");
   if(!test_lnreduce()) return testfailed("_lnreduce");
   if(!test_lnxplus1lt1()) return testfailed("_lnxplus1lt1");
@@ -6929,8 +8343,11 @@ int main(int argc, char* argv[])
   if(!test_tanltPiDiv4()) return testfailed("_tanltPiDiv4");
   if(!test_cos()) return testfailed("_cos");
   if(!test_sin()) return testfailed("_sin");
+  if(!test_trigreduce()) return testfailed("_trigreduce");
+  if(!test_sincos()) return testfailed("float_sincos");
   if(!test_tan()) return testfailed("_tan");
   if(!test_binetasymptotic()) return testfailed("lngammaseries");
+  if(!test_binetcoef()) return testfailed("floatmath_binetcoef");
   if(!test_pochhammer()) return testfailed("_pochhammer");
   if(!test_lngamma()) return testfailed("_lngamma");
   if(!test_gamma()) return testfailed("_gamma");
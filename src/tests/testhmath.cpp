@@ -22,10 +22,12 @@
 #include "tests/testcommon.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
 
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <utility>
 
 using namespace std;
 typedef HNumber::Format Format;
@@ -73,6 +75,51 @@ void test_create()
     CHECK(HNumber("1e-1000000000"), "NaN");
     CHECK_FORMAT(Format::Scientific() + Format::Precision(2), HNumber("1e1000000000"), "NaN");
     CHECK_FORMAT(Format::Scientific() + Format::Precision(2), HNumber("1e-1000000000"), "NaN");
+
+    // Moving hands the value over.
+    HNumber a("1.5");
+    HNumber b(std::move(a));
+    CHECK(b, "1.5");
+    CHECK(a, "NaN");
+    a = HNumber(7);
+    b = std::move(a);
+    CHECK(b, "7");
+    CHECK(a, "1.5");
+
+    // Copies share the value until one of them changes.
+    HNumber c("2.75");
+    HNumber e(c);
+    e += 1;
+    CHECK(c, "2.75");
+    CHECK(e, "3.75");
+    e = c;
+    CHECK(HMath::floor(e), "2");
+    CHECK(HMath::round(e), "3");
+    CHECK(HMath::trunc(e, 1), "2.7");
+    CHECK(e, "2.75");
+    CHECK(c, "2.75");
+
+    // Parsing from UTF-16 text stops where parse_str() stops.
+    QString text = "123";
+    CHECK(HMath::parse(text.constData(), text.size()), "123");
+    text = "999999999999999999";
+    CHECK(HMath::parse(text.constData(), text.size()), "999999999999999999");
+    text = "12345678901234567890123";
+    CHECK(HMath::parse(text.constData(), text.size()), "12345678901234567890123");
+    text = "1.5e3";
+    CHECK(HMath::parse(text.constData(), text.size()), "1500");
+    text = "0x1F";
+    CHECK(HMath::parse(text.constData(), text.size()), "31");
+    text = "-0.25";
+    CHECK(HMath::parse(text.constData(), text.size()), "-0.25");
+    text = QString(200, '0') + "7";
+    CHECK(HMath::parse(text.constData(), text.size()), "7");
+    text = QString::fromUtf8("4\u00B0");
+    CHECK(HMath::parse(text.constData(), text.size()), "4");
+    text = "";
+    CHECK(HMath::parse(text.constData(), text.size()), "NaN");
+    text = "abc";
+    CHECK(HMath::parse(text.constData(), text.size()), "NaN");
 }
 
 void test_format()
@@ -225,6 +272,42 @@ void test_op()
     CHECK(HNumber("1.5")* HNumber("1.5"), "2.25");
     CHECK(HNumber("NaN") * HNumber(1000), "NaN");
     CHECK(HNumber(1000) * HNumber("NaN"), "NaN");
+
+    // Small integers, and results leaving their range.
+    CHECK(HNumber(2147483647) * HNumber(2147483647) * HNumber(2147483647), "9903520300447984150353281023");
+    CHECK(HNumber(-2147483647) - HNumber(2147483647), "-4294967294");
+    CHECK(HNumber(-7) % HNumber(2), "-1");
+    CHECK(HNumber(7) % HNumber(0), "NaN");
+    CHECK(HMath::idiv(HNumber(-7), HNumber(2)), "-3");
+    CHECK(HMath::idiv(HNumber(7), HNumber(0)), "NaN");
+    CHECK(HNumber(-7) >> HNumber(1), "-4");
+    CHECK(HNumber(-3) << HNumber(4), "-48");
+    CHECK(HNumber(1) << HNumber(70), "1180591620717411303424");
+    CHECK(HNumber(-6) & HNumber(7), "2");
+    CHECK(~HNumber(5), "-6");
+
+    // Bitwise operations on values of up to 64 bits.
+    CHECK(HNumber("16045690984833335023") ^ HNumber("18446744069414584320"), "2401053092053106415");
+    CHECK(HNumber("18446744073709551615") & HNumber(-256), "18446744073709551360");
+    CHECK(~HNumber("18446744073709551615"), "-18446744073709551616");
+    CHECK(HNumber("16045690984833335023") >> HNumber(4), "1002855686552083438");
+    CHECK(HNumber("-18446744073709551615") >> HNumber(8), "-72057594037927936");
+    CHECK(HNumber("9223372036854775808") << HNumber(1), "18446744073709551616");
+    CHECK(HNumber("18446744073709551616") | HNumber(1), "18446744073709551617");
+    CHECK(HNumber("-2.5") & HNumber(-1), "-2");
+    CHECK(HNumber(1) << HNumber("2.5"), "NaN");
+    CHECK(HNumber(HNumber(3) < HNumber(4)), "1");
+    CHECK(HNumber(1) + HNumber("0.5"), "1.5");
+
+    // Sums of two products, rounded once.
+    CHECK(HMath::sumOfProducts(HNumber(2), HNumber(3), HNumber(4), HNumber(5)), "26");
+    CHECK(HMath::sumOfProducts(HNumber("4000000000"), HNumber("4000000000"), HNumber("4000000000"), HNumber("4000000000")), "32000000000000000000");
+    CHECK(HMath::sumOfProducts(HNumber("1.5"), HNumber(2), HNumber("0.25"), HNumber(4)), "4");
+    CHECK(HMath::sumOfProducts(HNumber("NaN"), HNumber(2), HNumber(1), HNumber(1)), "NaN");
+    CHECK(HMath::sumOfProducts(HNumber(1) / HNumber(3), HNumber(3), HNumber(-1), HNumber(1)), "0");
+    CHECK(HMath::sumOfProducts(HMath::sqrt(HNumber(2)), HMath::sqrt(HNumber(2)), HNumber(-2), HNumber(1)), "0");
+    CHECK(HNumber(HMath::sumOfProducts(HNumber(1) + HNumber("1e-40"), HNumber(1) + HNumber("1e-40"), HNumber(-1), HNumber(1))
+                  == HNumber("2.0000000000000000000000000000000000000001e-40")), "1");
 }
 
 void test_functions()
@@ -274,8 +357,27 @@ void test_functions()
     CHECK(HMath::gcd("-5", "0"), "5");
     CHECK(HMath::gcd("9", "-27"), "9");
     CHECK(HMath::gcd("99", "103"), "1");
+    CHECK(HMath::gcd("1915733798048403607189856256436293715858220560416768", "169528391082022807340688983774099865491708036775936"), "260998017181451471490840401845154587317633024");
+    CHECK(HMath::gcd("1000000000000000000000000000001", "7"), "1");
+
+    CHECK(HMath::lcm("NaN", "5"), "NaN");
+    CHECK(HMath::lcm("0", "5"), "0");
+    CHECK(HMath::lcm("12", "18"), "36");
+    CHECK(HMath::lcm("-4", "6"), "12");
+    CHECK(HMath::lcm("3458764513820540928", "5629499534213120"), "17293822569102704640");
     CHECK(HMath::gcd("-102", "306"), "102");
 
+    CHECK(HMath::powmod("NaN", "2", "7"), "NaN");
+    CHECK(HMath::powmod("2", "NaN", "7"), "NaN");
+    CHECK(HMath::powmod("2", "2", "NaN"), "NaN");
+    CHECK(HMath::powmod("2.5", "2", "7"), "NaN");
+    CHECK(HMath::powmod("2", "-1", "7"), "NaN");
+    CHECK(HMath::powmod("2", "3", "0"), "NaN");
+    CHECK(HMath::powmod("2", "0", "7"), "1");
+    CHECK(HMath::powmod("4", "13", "497"), "445");
+    CHECK(HMath::powmod("-4", "13", "497"), "-445");
+    CHECK(HMath::powmod("123456789", "10000000000", "1000000007"), "182981676");
+
     CHECK(HMath::round("NaN"), "NaN");
     CHECK(HMath::round("3.14"), "3");
     CHECK(HMath::round("-1.77"), "-2");
@@ -338,6 +440,12 @@ void test_functions()
     CHECK(HMath::frac("-3.14159"), "-0.14159");
     CHECK(HMath::frac("-0.14159"), "-0.14159");
 
+    CHECK(HMath::hypot("NaN", 1), "NaN");
+    CHECK(HMath::hypot(0, -7), "7");
+    CHECK(HMath::hypot(-5, 12), "13");
+    CHECK(HMath::hypot("3e400000000", "4e400000000"), "5e400000000");
+    CHECK_PRECISE(HMath::hypot(1, 2), "2.23606797749978969640917366873127623544061835961153");
+
     CHECK(HMath::sqrt("NaN"), "NaN");
     CHECK(HMath::sqrt(-1), "NaN");
     CHECK(HMath::sqrt(0), "0");
@@ -412,6 +520,7 @@ void test_functions()
     CHECK(HMath::factorial(8, 6), "336");
     CHECK(HMath::factorial(8, 7), "56");
     CHECK(HMath::factorial(8, 8), "8");
+    CHECK(HMath::factorial(30), "265252859812191058636308480000000");
 
     CHECK(HMath::nCr("NaN", "NaN"), "NaN");
     CHECK(HMath::nCr("NaN", 5), "NaN");
@@ -427,6 +536,8 @@ void test_functions()
     CHECK(HMath::nCr(21, 21), "1");
     CHECK(HMath::nCr(21, 22), "0");
     CHECK(HMath::nCr(0, 0), "1");
+    CHECK(HMath::nCr(1000000, 5), "8333250000291666250000200000");
+    CHECK(HMath::nCr(200, 100), "90548514656103281165404177077484163874504589675413336841320");
 
     CHECK(HMath::nPr("NaN", "NaN"), "NaN");
     CHECK(HMath::nPr("NaN", 5), "NaN");
@@ -443,6 +554,7 @@ void test_functions()
     CHECK(HMath::nPr(21, 5), "2441880");
     CHECK(HMath::nPr(21, 6), "39070080");
     CHECK(HMath::nPr(21, 7), "586051200");
+    CHECK(HMath::nPr("1e12", 4), "999999999994000000000010999999999994000000000000");
 
     CHECK(HMath::raise("NaN", "NaN"), "NaN");
     CHECK(HMath::raise("NaN", "0"), "NaN");
@@ -465,6 +577,16 @@ void test_functions()
     CHECK_PRECISE(HMath::raise("2", "0.1"), "1.07177346253629316421300632502334202290638460497756");
     CHECK_PRECISE(HMath::raise("2", "0.2"), "1.14869835499703500679862694677792758944385088909780");
     CHECK_PRECISE(HMath::raise("2", "0.3"), "1.23114441334491628449939306916774310987613776110082");
+    CHECK_PRECISE(HMath::raise("2", "0.5"), "1.41421356237309504880168872420969807856967187537695");
+    CHECK_PRECISE(HMath::raise("2", "1.5"), "2.82842712474619009760337744841939615713934375075390");
+    CHECK_PRECISE(HMath::raise("2", "-2.5"), "0.17677669529663688110021109052621225982120898442212");
+    CHECK_PRECISE(HMath::raise("10", "2.5"), "316.22776601683793319988935444327185337195551393252168");
+    CHECK(HMath::raise("4", "2.5"), "32");
+    CHECK(HMath::raise("-4", "0.5"), "NaN");
+    CHECK(HMath::raise(HNumber(2), HNumber(62)), "4611686018427387904");
+    CHECK(HMath::raise(HNumber(3), HNumber(39)), "4052555153018976267");
+    CHECK(HMath::raise(HNumber(-1), HNumber("999999999999999999")), "-1");
+    CHECK(HMath::raise(HNumber(0), HNumber(0)), "NaN");
 
     CHECK(HMath::exp("NaN"), "NaN");
     CHECK(HMath::exp("0"), "1");
@@ -501,6 +623,7 @@ void test_functions()
     CHECK(HMath::binomialCdf("5", "10", "0.5"), "0.623046875");
     CHECK(HMath::binomialCdf("-5", "10", "0.5"), "0");
     CHECK_PRECISE(HMath::binomialCdf("5", "10", "0.5"), "0.62304687500000000000000000000000000000000000000000");
+    CHECK_PRECISE(HMath::binomialCdf("400", "1000", "0.37"), "0.97669494518536487616481483334377729470053195831394");
 
     CHECK(HMath::binomialMean("NaN", "NaN"), "NaN");
     CHECK(HMath::binomialMean("NaN", "0.5"), "NaN");
@@ -537,6 +660,7 @@ void test_functions()
     CHECK(HMath::hypergeometricCdf("-1", "15", "10", "5"), "0");
     CHECK(HMath::hypergeometricCdf("1", "15", "10", "5"), "0.01698301698301698302");
     CHECK_PRECISE(HMath::hypergeometricCdf("1", "15", "10", "5"), "0.01698301698301698301698301698301698301698301698302");
+    CHECK_PRECISE(HMath::hypergeometricCdf("230", "2000", "600", "700"), "0.98173340191224736505845994489862632435194836643163");
 
     CHECK(HMath::hypergeometricMean("NaN", "NaN", "NaN"), "NaN");
     CHECK(HMath::hypergeometricMean("NaN", "NaN", "5"), "NaN");
@@ -563,6 +687,7 @@ void test_functions()
     CHECK(HMath::poissonCdf("-2", "5"), "0");
     CHECK(HMath::poissonCdf("2", "5"), "0.12465201948308114129");
     CHECK_PRECISE(HMath::poissonCdf("2", "5"), "0.12465201948308114128776689582824584860371732300607");
+    CHECK(HMath::poissonCdf("30000", "100"), "1");
 
     CHECK(HMath::poissonMean("NaN"), "NaN");
     CHECK(HMath::poissonMean("5"), "5");
@@ -898,6 +1023,39 @@ void test_functions()
     CHECK_PRECISE(HMath::cosh("0.9"), "1.43308638544877438784179040162404834162773784130523");
     CHECK_PRECISE(HMath::cosh("1.0"), "1.54308063481524377847790562075706168260152911236586");
 
+    {
+        HNumber s, c;
+        HMath::sinhcosh("1.0", s, c);
+        CHECK_PRECISE(s, "1.17520119364380145688238185059560081515571798133410");
+        CHECK_PRECISE(c, "1.54308063481524377847790562075706168260152911236586");
+        HMath::sinhcosh("NaN", s, c);
+        CHECK(s, "NaN");
+        CHECK(c, "NaN");
+        HMath::sincos("1.0", s, c);
+        CHECK_PRECISE(s, "0.84147098480789650665250232163029899962256306079837");
+        CHECK_PRECISE(c, "0.54030230586813971740093660744297660373231042061792");
+        HMath::sincos(HMath::pi(), s, c);
+        CHECK(s, "0");
+        CHECK(c, "-1");
+        HMath::sincosDegrees("-150", s, c);
+        CHECK(s, "-0.5");
+        CHECK_PRECISE(c, "-0.86602540378443864676372317075293618347140262690519");
+        HMath::sincosDegrees("36000000000000000000000000000000045", s, c);
+        CHECK_PRECISE(s, "0.70710678118654752440084436210484903928483593768847");
+        CHECK_PRECISE(c, "0.70710678118654752440084436210484903928483593768847");
+        HMath::sincosDegrees("270", s, c);
+        CHECK(s, "-1");
+        CHECK(c, "0");
+        HMath::sincosDegrees("12.5", s, c);
+        CHECK_PRECISE(s, "0.21643961393810287975955366961794072867338719355006");
+        HMath::sincosGons("-200", s, c);
+        CHECK(s, "0");
+        CHECK(c, "-1");
+        HMath::sincosGons("NaN", s, c);
+        CHECK(s, "NaN");
+        CHECK(c, "NaN");
+    }
+
     CHECK(HMath::tanh("NaN"), "NaN");
     CHECK_PRECISE(HMath::tanh("0.1"), "0.09966799462495581711830508367835218353896209577673");
     CHECK_PRECISE(HMath::tanh("0.2"), "0.19737532022490400073815731881101566838937268384235");
@@ -985,6 +1143,88 @@ void test_functions()
     CHECK_FORMAT(Format::Fixed() + Format::Hexadecimal(), HMath::encodeIeee754("1.5", "2", "1"), "0x3");
 }
 
+void test_working_precision()
+{
+    int save = HMath::setWorkingPrecision(10);
+    CHECK(HNumber(save == HMath::defaultWorkingPrecision()), "1");
+    CHECK(HNumber(1) / HNumber(3), "0.3333333333");
+    CHECK(HMath::sqrt(HNumber(2)), "1.414213562");
+    CHECK(HMath::ln(HNumber(2)), "0.6931471806");
+    CHECK(HMath::sin(HNumber(1)), "0.8414709848");
+    CHECK(HNumber(2) / HNumber(3) - HNumber("0.6666666667"), "0");
+    CHECK(HMath::pi(), "3.141592654");
+    CHECK(HMath::deg2rad(HNumber(90)), "1.570796327");
+
+    HMath::setWorkingPrecision(1);
+    CHECK(HNumber(HMath::workingPrecision() > 1), "1");
+    HMath::setWorkingPrecision(100000);
+    CHECK(HNumber(HMath::workingPrecision() == HMath::maxWorkingPrecision()), "1");
+    CHECK(HNumber(HMath::maxWorkingPrecision() > HMath::defaultWorkingPrecision()), "1");
+    CHECK_PRECISE(HNumber(1) / HNumber(7), "0.14285714285714285714285714285714285714285714285714");
+
+    // The constants change with the precision, their copies keep the value.
+    HMath::setWorkingPrecision(200);
+    CHECK(HNumber(PI != HMath::pi()), "1");
+    CHECK_PRECISE(PI, "3.14159265358979323846264338327950288419716939937511");
+
+    HMath::setWorkingPrecision(0);
+    CHECK(HNumber(HMath::workingPrecision() == HMath::defaultWorkingPrecision()), "1");
+    CHECK(HNumber(1) / HNumber(3), "0.33333333333333333333");
+    CHECK(HMath::deg2rad(HNumber(180)), "3.14159265358979323846");
+    CHECK(HMath::rad2deg(HMath::pi()), "180");
+    CHECK(HMath::gon2rad(HNumber(0)), "0");
+}
+
+// The size of the binary form, 9 bytes for a small integer.
+static HNumber packedSize(const HNumber& n)
+{
+    QByteArray packed;
+    QDataStream stream(&packed, QIODevice::WriteOnly);
+    n.serialize(stream);
+    return HNumber(packed.size());
+}
+
+void test_squeeze()
+{
+    HNumber n("12345678901234");
+    HNumber copy = n;
+    n.squeeze();
+    CHECK(n, "12345678901234");
+    CHECK(copy, "12345678901234");
+    CHECK(packedSize(n), "9");
+    CHECK(n + HNumber(1), "12345678901235");
+
+    n = HNumber("-1e17");
+    n.squeeze();
+    CHECK(n, "-100000000000000000");
+    CHECK(packedSize(n), "9");
+
+    n = HNumber("1e25");
+    n.squeeze();
+    CHECK(n, "10000000000000000000000000");
+    CHECK(HNumber(packedSize(n) > HNumber(9)), "1");
+
+    n = HNumber(1) / HNumber(3);
+    copy = n;
+    n.squeeze();
+    CHECK(n - copy, "0");
+    CHECK(n * HNumber(3) - copy * HNumber(3), "0");
+
+    n = HNumber("2.50") * HNumber(4);
+    n.squeeze();
+    CHECK(n, "10");
+    n = HNumber("1.25") * HNumber(2);
+    n.squeeze();
+    CHECK(n, "2.5");
+
+    n = HMath::nan(ZeroDivide);
+    n.squeeze();
+    CHECK(HNumber(n.isNan() && n.error() == ZeroDivide), "1");
+    n = HNumber(0);
+    n.squeeze();
+    CHECK(n, "0");
+}
+
 int main(int argc, char* argv[])
 {
     QCoreApplication app(argc, argv);
@@ -999,6 +1239,8 @@ int main(int argc, char* argv[])
     test_format();
     test_op();
     test_functions();
+    test_working_precision();
+    test_squeeze();
 
     if (!hmath_failed_tests)
         return 0;
@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
-SUBDIRS = testhmath.pro testcmath.pro testdmath.pro testevaluator.pro testfloatnum.pro testser.pro
+SUBDIRS = testhmath.pro testcmath.pro testdmath.pro testevaluator.pro testfloatnum.pro testser.pro benchfloatnum.pro
 HEADERS += testcommon.h